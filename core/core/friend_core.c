@@ -39,6 +39,7 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
 #ifdef USE_SELECT
 
@@ -82,6 +83,8 @@ void FriendCoreProcessSockBlock( void *fcv );
 
 void FriendCoreProcessSockNonBlock( void *fcv );
 
+static void FriendCoreHandshakeStart( FriendCoreInstance *fc, Socket *sock );
+
 int nothreads = 0;					/// threads coutner @todo to rewrite
 #define MAX_CALLHANDLER_THREADS 256			///< maximum number of simulatenous handlers
 //#define USE_BLOCKED_SOCKETS_TO_READ_HTTP
@@ -125,6 +128,18 @@ FriendCoreInstance *FriendCoreNew( void *sb, int id, FBOOL ssl, int port, int ma
 		
 		pthread_mutex_init( &(fc->fci_AcceptMutex), NULL );
 		pthread_cond_init( &(fc->fci_AcceptCond), NULL);
+		
+		fc->fci_DispatchMode = FRIEND_CORE_DISPATCH_PTHREAD;
+		fc->fci_EventLoopsNumber = 1;
+		fc->fci_WorkersNumber = FRIEND_CORE_HTTP_WORKERS;
+		fc->fci_WorkersQueueSize = FRIEND_CORE_HTTP_QUEUE_SIZE;
+		fc->fci_WorkersStackSize = FRIEND_CORE_HTTP_STACK_SIZE;
+		
+		fc->fci_KeepAlive = FALSE;
+		fc->fci_KeepAliveTimeout = FRIEND_CORE_KEEPALIVE_TIMEOUT;
+		fc->fci_KeepAliveMaxRequests = FRIEND_CORE_KEEPALIVE_MAX_REQUESTS;
+		fc->fci_HandshakeTimeout = FRIEND_CORE_SSL_HANDSHAKE_TIMEOUT;
+		pthread_mutex_init( &(fc->fci_IdleMutex), NULL );
 	}
 	else
 	{
@@ -155,6 +170,7 @@ void FriendCoreShutdown( FriendCoreInstance* fc )
 	
 	pthread_cond_destroy( &(fc->fci_AcceptCond) );
 	pthread_mutex_destroy( &(fc->fci_AcceptMutex) );
+	pthread_mutex_destroy( &(fc->fci_IdleMutex) );
 
 	FFree( fc );
 	
@@ -387,13 +403,8 @@ void *FriendCoreAcceptPhase2( void *data )
 				goto accerror;
 			}
 		
-			// Get incoming
-			int lbreak = 0;
-		
 			if( fc->fci_Sockets->s_SSLEnabled == TRUE )
 			{
-				int srl;
-				
 				s_Ssl = SSL_new( fc->fci_Sockets->s_Ctx );
 				
 				if( s_Ssl == NULL )
@@ -402,103 +413,15 @@ void *FriendCoreAcceptPhase2( void *data )
 				
 					goto accerror;
 				}
-				else
-				{
-					srl = SSL_set_fd( s_Ssl, fd );
-					SSL_set_accept_state( s_Ssl );
-					if( srl != 1 )
-					{
-						int error = SSL_get_error( s_Ssl, srl );
-						FERROR( "[FriendCoreAcceptPhase2] Could not set fd, error: %d fd: %d\n", error, fd );
-						goto accerror;
-					}
-					
-					int err = 0;
-					// we must be sure that SSL Accept is working
-					while( 1 )
-					{
-						DEBUG("[FriendCoreAcceptPhase2] before accept\n");
-						if( ( err = SSL_accept( s_Ssl ) ) == 1 )
-						{
-							lbreak = 1;
-							break;
-						}
-						DEBUG("[FriendCoreAcceptPhase2] after accept, err: %d\n", err );
-						if( err <= 0 || err == 2 )
-						{
-							int error = SSL_get_error( s_Ssl, err );
-							switch( error )
-							{
-								case SSL_ERROR_NONE:
-									// NO error..
-									FERROR( "[FriendCoreAcceptPhase2] No error\n" );
-									lbreak = 1;
-								break;
-								case SSL_ERROR_ZERO_RETURN:
-									FERROR("[FriendCoreAcceptPhase2] SSL_ACCEPT error: Socket closed.\n" );
-									goto accerror;
-								case SSL_ERROR_WANT_READ:
-									lbreak = 2;
-								break;
-								case SSL_ERROR_WANT_WRITE:
-									lbreak = 2;
-								break;
-								case SSL_ERROR_WANT_ACCEPT:
-									FERROR( "[FriendCoreAcceptPhase2] Want accept\n" );
-									goto accerror;
-								case SSL_ERROR_WANT_X509_LOOKUP:
-									FERROR( "[FriendCoreAcceptPhase2] Want 509 lookup\n" );
-									goto accerror;
-								case SSL_ERROR_SYSCALL:
-								{
-									int enume = ERR_get_error();
-									FERROR( "[FriendCoreAcceptPhase2] Error syscall. Goodbye! %s. Enume: %d\n", ERR_error_string( enume, NULL ), enume );
-									if( enume == 0 )
-									{
-										//continue;
-									}
-									//lbreak = 2;
-									//break;
-									goto accerror;
-								}
-								case SSL_ERROR_SSL:
-								{
-									int enume = ERR_get_error();
-									FERROR( "[FriendCoreAcceptPhase2] SSL_ERROR_SSL: %s. enume: %d\n", ERR_error_string( enume, NULL ), enume );
-									lbreak = 2;
-							
-									// HTTP to HTTPS redirection code
-									if( enume == 336027804 ) // http redirect
-									{
-										moveToHttp( fd );
-									}
-									else
-									{
-										goto accerror;
-									}
-									break;
-								}
-								default:
-								{
-									int enume = ERR_get_error();
-									FERROR( "[FriendCoreAcceptPhase2] default: %s. enume: %d error: %d\n", ERR_error_string( enume, NULL ), enume, error );
-								}
-								break;
-							}
-						}
-						if( lbreak >= 1 )
-						{
-							break;
-						}
-						//usleep( 0 );
 				
-						if( fc->fci_Shutdown == TRUE )
-						{
-							FINFO("[FriendCoreAcceptPhase2] Accept socket process will be stopped, becaouse Shutdown is in progress\n");
-							goto accerror;
-						}
-					}	// while( 1 )
-				}	// if SSL
+				int srl = SSL_set_fd( s_Ssl, fd );
+				if( srl != 1 )
+				{
+					int error = SSL_get_error( s_Ssl, srl );
+					FERROR( "[FriendCoreAcceptPhase2] Could not set fd, error: %d fd: %d\n", error, fd );
+					goto accerror;
+				}
+				SSL_set_accept_state( s_Ssl );
 			}
 
 			DEBUG("[FriendCoreAcceptPhase2] before getting incoming: fd %d\n", fd );
@@ -533,6 +456,10 @@ void *FriendCoreAcceptPhase2( void *data )
 							incoming->s_Ctx = s_Ctx;
 							s_Ssl = NULL;
 							s_Ctx = NULL;
+							
+							// handshake is done by main loop, request thread is created when first request arrives
+							FriendCoreHandshakeStart( fc, incoming );
+							continue;
 						}
 					}
 					else
@@ -548,8 +475,7 @@ void *FriendCoreAcceptPhase2( void *data )
 						pre->fc = fc; pre->sock = incoming;
 					
 #ifdef USE_PTHREAD
-						//size_t stacksize = 16777216; //16 * 1024 * 1024;
-						size_t stacksize = 8777216;	// half of previous stack
+						size_t stacksize = fc->fci_WorkersStackSize;
 						pthread_attr_t attr;
 						pthread_attr_init( &attr );
 						pthread_attr_setstacksize( &attr, stacksize );
@@ -1170,32 +1096,309 @@ accerror:
 //
 //
 
-void FriendCoreProcessSockBlock( void *fcv )
+/**
+* Check if comma separated header value contains token (case insensitive)
+*
+* @param val pointer to header value
+* @param end pointer to end of header value
+* @param token token which we are looking for
+* @return TRUE when token was found, otherwise FALSE
+*/
+static inline FBOOL FriendCoreHeaderHasToken( char *val, char *end, const char *token )
 {
-#ifdef USE_PTHREAD
-	pthread_detach( pthread_self() );
-#endif 
+	int tlen = strlen( token );
+	
+	while( val < end )
+	{
+		while( val < end && ( *val == ' ' || *val == '\t' || *val == ',' ) )
+		{
+			val++;
+		}
+		char *tokEnd = val;
+		while( tokEnd < end && *tokEnd != ',' && *tokEnd != ' ' && *tokEnd != '\t' )
+		{
+			tokEnd++;
+		}
+		if( ( tokEnd - val ) == tlen && strncasecmp( val, token, tlen ) == 0 )
+		{
+			return TRUE;
+		}
+		val = tokEnd;
+	}
+	return FALSE;
+}
 
-	if( fcv == NULL )
+/**
+* Get value of Content-Length header
+*
+* Only header lines are searched (body can contain same text) and header name is not case sensitive.
+*
+* @param data pointer to request
+* @param headerLen length of request header (with ending empty line)
+* @return body length or 0 when header was not found
+*/
+static inline FQUAD FriendCoreContentLength( char *data, int headerLen )
+{
+	char *end = data + headerLen;
+	char *line = data;
+	char *lineEnd;
+	
+	while( line < end && ( lineEnd = strstr( line, "\r\n" ) ) != NULL && lineEnd != line && lineEnd < end )
 	{
-#ifdef USE_PTHREAD
-		pthread_exit( 0 );
-#endif
-		return;
+		if( ( lineEnd - line ) > 15 && strncasecmp( line, "Content-Length:", 15 ) == 0 )
+		{
+			FQUAD len = strtoll( line + 15, NULL, 10 );
+			return len > 0 ? len : 0;
+		}
+		line = lineEnd + 2;
 	}
+	return 0;
+}
 
-	struct fcThreadInstance *th = ( struct fcThreadInstance *)fcv;
+/**
+* Check if client wants persistent connection
+*
+* HTTP/1.1 connections are persistent unless "Connection: close" was sent, HTTP/1.0 only with "Connection: keep-alive".
+* Chunked requests and protocol upgrades are not handled here, connection is closed after them.
+*
+* @param data pointer to request
+* @param headerLen length of request header (with ending empty line)
+* @return TRUE when connection can stay open after response
+*/
+static inline FBOOL FriendCoreKeepAliveRequested( char *data, int headerLen )
+{
+	char *end = data + headerLen;
+	char *lineEnd = strstr( data, "\r\n" );
+	
+	if( lineEnd == NULL || lineEnd >= end || ( lineEnd - data ) < 8 )
+	{
+		return FALSE;
+	}
+	
+	// request line ends with protocol version
+	FBOOL keepAlive = ( strncmp( lineEnd - 8, "HTTP/1.1", 8 ) == 0 );
+	
+	while( TRUE )
+	{
+		char *line = lineEnd + 2;
+		if( line >= end || ( lineEnd = strstr( line, "\r\n" ) ) == NULL || lineEnd == line )
+		{
+			break;
+		}
+		
+		int len = lineEnd - line;
+		if( len > 11 && strncasecmp( line, "Connection:", 11 ) == 0 )
+		{
+			if( FriendCoreHeaderHasToken( line + 11, lineEnd, "close" ) == TRUE || FriendCoreHeaderHasToken( line + 11, lineEnd, "upgrade" ) == TRUE )
+			{
+				return FALSE;
+			}
+			if( FriendCoreHeaderHasToken( line + 11, lineEnd, "keep-alive" ) == TRUE )
+			{
+				keepAlive = TRUE;
+			}
+		}
+		else if( len > 18 && strncasecmp( line, "Transfer-Encoding:", 18 ) == 0 )
+		{
+			return FALSE;
+		}
+	}
+	return keepAlive;
+}
 
-	if( th->sock == NULL )
+/**
+* Prepare response to be sent on persistent connection
+*
+* Only responses with known length can be followed by next request. Streamed responses are
+* ended by closing connection.
+*
+* @param fc pointer to Friend Core instance
+* @param sock pointer to Socket on which response will be sent
+* @param resp pointer to response
+* @return TRUE when connection can stay open after response
+*/
+static inline FBOOL FriendCoreKeepAliveResponse( FriendCoreInstance *fc, Socket *sock, Http *resp )
+{
+	if( resp->http_WriteType == FREE_ONLY || resp->http_Stream == TRUE || resp->http_WriteOnlyContent == TRUE || resp->http_ResponseHeadersRelease == FALSE )
 	{
-		FFree( th );
-#ifdef USE_PTHREAD
-		pthread_exit( 0 );
-#endif
-		return;
+		return FALSE;
+	}
+	
+	char *conLen = FCalloc( 32, sizeof(char) );
+	char *keepAlive = FCalloc( 64, sizeof(char) );
+	if( conLen == NULL || keepAlive == NULL )
+	{
+		if( conLen != NULL ) FFree( conLen );
+		if( keepAlive != NULL ) FFree( keepAlive );
+		return FALSE;
+	}
+	
+	// HttpBuild writes whole content, so length is always known
+	// 304 has no body, Content-Length there would describe the cached entity
+	if( resp->http_ResponseCode != HTTP_304_NOT_MODIFIED )
+	{
+		snprintf( conLen, 32, "%ld", (long int)resp->http_SizeOfContent );
+		HttpAddHeader( resp, HTTP_HEADER_CONTENT_LENGTH, conLen );
+	}
+	else
+	{
+		FFree( conLen );
+	}
+	
+	snprintf( keepAlive, 64, "timeout=%d, max=%d", fc->fci_KeepAliveTimeout, fc->fci_KeepAliveMaxRequests - sock->s_Requests );
+	HttpAddHeader( resp, HTTP_HEADER_KEEP_ALIVE, keepAlive );
+	HttpAddHeader( resp, HTTP_HEADER_CONNECTION, StringDuplicateN( "keep-alive", 10 ) );
+	
+	return TRUE;
+}
+
+/**
+* Put idle keep-alive connection back to main epoll
+*
+* Connection is closed when it cannot be added or server is going down
+*
+* @param fc pointer to Friend Core instance
+* @param sock pointer to Socket
+*/
+static void FriendCoreIdleAdd( FriendCoreInstance *fc, Socket *sock )
+{
+	struct epoll_event event;
+	
+	memset( &event, 0, sizeof( event ) );
+	event.data.ptr = sock;
+	event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+	
+	if( FRIEND_MUTEX_LOCK( &(fc->fci_IdleMutex) ) == 0 )
+	{
+		if( fc->fci_Shutdown == FALSE )
+		{
+			sock->s_LastActivity = time( NULL );
+			sock->s_IdlePrev = NULL;
+			sock->s_IdleNext = fc->fci_IdleSockets;
+			if( fc->fci_IdleSockets != NULL )
+			{
+				fc->fci_IdleSockets->s_IdlePrev = sock;
+			}
+			fc->fci_IdleSockets = sock;
+			
+			// socket stays registered after first request, EPOLLONESHOT only disables it
+			if( epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_MOD, sock->fd, &event ) == 0 || ( errno == ENOENT && epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_ADD, sock->fd, &event ) == 0 ) )
+			{
+				FRIEND_MUTEX_UNLOCK( &(fc->fci_IdleMutex) );
+				return;
+			}
+			
+			FERROR("[FriendCoreIdleAdd] Cannot add fd: %d to epoll, errno %d\n", sock->fd, errno );
+			fc->fci_IdleSockets = sock->s_IdleNext;
+			if( sock->s_IdleNext != NULL )
+			{
+				sock->s_IdleNext->s_IdlePrev = NULL;
+			}
+			sock->s_IdleNext = NULL;
+		}
+		FRIEND_MUTEX_UNLOCK( &(fc->fci_IdleMutex) );
+	}
+	
+	sock->s_Interface->SocketDelete( sock );
+}
+
+/**
+* Remove connection from idle list (called by main loop when connection got event)
+*
+* @param fc pointer to Friend Core instance
+* @param sock pointer to Socket
+*/
+static inline void FriendCoreIdleRemove( FriendCoreInstance *fc, Socket *sock )
+{
+	if( FRIEND_MUTEX_LOCK( &(fc->fci_IdleMutex) ) == 0 )
+	{
+		if( sock->s_IdlePrev != NULL )
+		{
+			sock->s_IdlePrev->s_IdleNext = sock->s_IdleNext;
+		}
+		else if( fc->fci_IdleSockets == sock )
+		{
+			fc->fci_IdleSockets = sock->s_IdleNext;
+		}
+		if( sock->s_IdleNext != NULL )
+		{
+			sock->s_IdleNext->s_IdlePrev = sock->s_IdlePrev;
+		}
+		sock->s_IdleNext = sock->s_IdlePrev = NULL;
+		FRIEND_MUTEX_UNLOCK( &(fc->fci_IdleMutex) );
+	}
+}
+
+/**
+* Close keep-alive connections which were idle for too long and TLS connections which
+* did not finish handshake or send first request in time (called by main loop)
+*
+* @param fc pointer to Friend Core instance
+* @param timeout idle time in seconds after which connection is closed, 0 closes all connections
+*/
+static void FriendCoreIdleExpire( FriendCoreInstance *fc, int timeout )
+{
+	Socket *expired = NULL;
+	time_t now = time( NULL );
+	
+	if( FRIEND_MUTEX_LOCK( &(fc->fci_IdleMutex) ) == 0 )
+	{
+		Socket *sock = fc->fci_IdleSockets;
+		while( sock != NULL )
+		{
+			Socket *next = sock->s_IdleNext;
+			
+			// connection which did not send first request yet (TLS handshake) has own limit
+			int limit = ( sock->s_Requests == 0 ) ? fc->fci_HandshakeTimeout : timeout;
+			
+			if( timeout <= 0 || ( now - sock->s_LastActivity ) >= limit )
+			{
+				if( sock->s_IdlePrev != NULL )
+				{
+					sock->s_IdlePrev->s_IdleNext = next;
+				}
+				else
+				{
+					fc->fci_IdleSockets = next;
+				}
+				if( next != NULL )
+				{
+					next->s_IdlePrev = sock->s_IdlePrev;
+				}
+				
+				epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
+				sock->s_IdlePrev = NULL;
+				sock->s_IdleNext = expired;
+				expired = sock;
+			}
+			sock = next;
+		}
+		FRIEND_MUTEX_UNLOCK( &(fc->fci_IdleMutex) );
+	}
+	
+	// close outside of lock, SSL shutdown is writing to socket
+	while( expired != NULL )
+	{
+		Socket *next = expired->s_IdleNext;
+		DEBUG("[FriendCoreIdleExpire] Closing idle connection, fd: %d\n", expired->fd );
+		expired->s_Interface->SocketDelete( expired );
+		expired = next;
 	}
+}
 
+/**
+* Read HTTP request from blocked socket, process it and release socket
+*
+* Used by request threads and by pool workers. When keep-alive is enabled
+* pipelined requests are processed one by one and then idle socket is
+* returned to main epoll instead of being closed.
+*
+* @param th pointer to fcThreadInstance, released by function
+*/
+static inline void FriendCoreProcessSockBlockInternal( struct fcThreadInstance *th )
+{
 	// Let's go!
+	FriendCoreInstance *fc = th->fc;
 
 	FQUAD bufferSize = HTTP_READ_BUFFER_DATA_SIZE;
 	FQUAD bufferSizeAlloc = HTTP_READ_BUFFER_DATA_SIZE_ALLOC;
@@ -1206,16 +1409,22 @@ void FriendCoreProcessSockBlock( void *fcv )
 
 	FQUAD expectedLength = 0;
 	FBOOL headerFound = FALSE;
+	FBOOL keepAlive = FALSE;
 	int headerLen = 0;
 	
 	SocketSetBlocking( th->sock, TRUE );
 	
 	DEBUG("[FriendCoreProcessSockBlock] start\n");
 	
-	if( locBuffer != NULL )
+	if( locBuffer != NULL && resultString != NULL )
 	{
 		int retryContentNotFull = 0;
 		
+next_request:
+		
+		retryContentNotFull = 0;
+		th->sock->s_SocketBlockTimeout = 0;
+		
 		while( TRUE )
 		{
 			// Increase timeouts in retries
@@ -1228,16 +1437,32 @@ void FriendCoreProcessSockBlock( void *fcv )
 				th->sock->s_SocketBlockTimeout = 250;
 			}
 			
-			// Read from socket
-			int res = th->sock->s_Interface->SocketReadBlocked( th->sock, locBuffer, bufferSize, bufferSize );
+			int res = 0;
+			
+			if( th->sock->s_PipelineData != NULL )
+			{
+				// next request was read together with previous one (pipelining)
+				res = th->sock->s_PipelineSize;
+				BufStringDiskAddSize( resultString, th->sock->s_PipelineData, res );
+				FFree( th->sock->s_PipelineData );
+				th->sock->s_PipelineData = NULL;
+				th->sock->s_PipelineSize = 0;
+			}
+			else
+			{
+				// Read from socket
+				res = th->sock->s_Interface->SocketReadBlocked( th->sock, locBuffer, bufferSize, bufferSize );
+				if( res > 0 )
+				{
+					// add received string to buffer.
+					BufStringDiskAddSize( resultString, locBuffer, res );
+				}
+			}
+			
 			if( res > 0 )
 			{
 				retryContentNotFull = 0;	// we must reset error counter
 				DEBUG("[FriendCoreProcessSockBlock] received bytes: %d buffer size: %lu\n", res, resultString->bsd_Size );
-				
-				// add received string to buffer.
-				// If 
-				int err = BufStringDiskAddSize( resultString, locBuffer, res );
 
 				if( headerFound == FALSE )
 				{
@@ -1248,24 +1473,34 @@ void FriendCoreProcessSockBlock( void *fcv )
 						// get length of header
 						headerLen = ((headEnd+4) - resultString->bsd_Buffer);
 						
-						char *conLen = strstr( resultString->bsd_Buffer, "Content-Length:" );
-						DEBUG("[FriendCoreProcessSockBlock] Pointer to conLen %p headerLen %d\n", conLen, headerLen );
-						if( conLen != NULL )
+						FQUAD conLen = FriendCoreContentLength( resultString->bsd_Buffer, headerLen );
+						DEBUG("[FriendCoreProcessSockBlock] Content length %ld headerLen %d\n", conLen, headerLen );
+						if( conLen > 0 )
 						{
-							DEBUG("[FriendCoreProcessSockBlock] Conlen is not empty!\n");
-							conLen += 16;
-							char *conLenEnd = strstr( conLen, "\r\n" );
-							if( conLenEnd != NULL )
-							{
-								char *end;
-								expectedLength = strtoll( conLen,  &end, 0 ) + headerLen;
-								DEBUG("[FriendCoreProcessSockBlock] Expected len %ld\n", expectedLength );
-							}
+							expectedLength = conLen + headerLen;
+							DEBUG("[FriendCoreProcessSockBlock] Expected len %ld\n", expectedLength );
 						}
 						DEBUG("[FriendCoreProcessSockBlock] Header found!\n");
 						headerFound = TRUE;
+						
+						if( fc->fci_KeepAlive == TRUE && ( th->sock->s_Requests + 1 ) < fc->fci_KeepAliveMaxRequests )
+						{
+							keepAlive = FriendCoreKeepAliveRequested( resultString->bsd_Buffer, headerLen );
+						}
+						
+						// on persistent connection request without body ends with header
+						if( keepAlive == TRUE && expectedLength == 0 )
+						{
+							expectedLength = headerLen;
+						}
 					}
 				}
+				
+				if( expectedLength > 0 && resultString->bsd_Size >= expectedLength )
+				{
+					DEBUG("[FriendCoreProcessSockBlock] We have everything!\n");
+					break;
+				}
 			}
 			else
 			{
@@ -1303,10 +1538,34 @@ void FriendCoreProcessSockBlock( void *fcv )
 
 		if( resultString->bsd_Size > 0 )
 		{
-			Http *resp = ProtocolHttp( th->sock, resultString->bsd_Buffer, resultString->bsd_Size );
+			FQUAD requestLength = resultString->bsd_Size;
+			
+			if( keepAlive == TRUE && resultString->bsd_Size > expectedLength )
+			{
+				// client sent next request without waiting for response, keep it for next round
+				if( resultString->bsd_FileHandler <= 0 && ( th->sock->s_PipelineData = FMalloc( resultString->bsd_Size - expectedLength ) ) != NULL )
+				{
+					th->sock->s_PipelineSize = resultString->bsd_Size - expectedLength;
+					memcpy( th->sock->s_PipelineData, resultString->bsd_Buffer + expectedLength, th->sock->s_PipelineSize );
+					resultString->bsd_Buffer[ expectedLength ] = 0;
+					requestLength = expectedLength;
+				}
+				else
+				{
+					keepAlive = FALSE;
+				}
+			}
+			
+			Http *resp = ProtocolHttp( th->sock, resultString->bsd_Buffer, requestLength );
+			th->sock->s_Requests++;
 
 			if( resp != NULL )
 			{
+				if( keepAlive == TRUE )
+				{
+					keepAlive = FriendCoreKeepAliveResponse( fc, th->sock, resp );
+				}
+				
 				if( resp->http_WriteType == FREE_ONLY )
 				{
 					HttpFree( resp );
@@ -1316,21 +1575,54 @@ void FriendCoreProcessSockBlock( void *fcv )
 					HttpWriteAndFree( resp, th->sock );
 				}
 			}
+			else
+			{
+				keepAlive = FALSE;
+			}
 		}
-
-		// Free up buffers
-		if( locBuffer )
+		else
 		{
-			FFree( locBuffer );
+			keepAlive = FALSE;
 		}
-	}
-
+		
+		if( keepAlive == TRUE && fc->fci_Shutdown == FALSE )
+		{
+			// data which epoll will not report: pipelined request or bytes buffered by OpenSSL
+			if( th->sock->s_PipelineData != NULL || ( th->sock->s_Ssl != NULL && SSL_pending( th->sock->s_Ssl ) > 0 ) )
+			{
+				BufStringDiskDelete( resultString );
+				if( ( resultString = BufStringDiskNewSize( TUNABLE_LARGE_HTTP_REQUEST_SIZE ) ) != NULL )
+				{
+					expectedLength = 0;
+					headerFound = FALSE;
+					keepAlive = FALSE;
+					headerLen = 0;
+					goto next_request;
+				}
+			}
+			else
+			{
+				FriendCoreIdleAdd( fc, th->sock );
+				th->sock = NULL;
+			}
+		}
+	}
+	
+	// Free up buffers
+	if( locBuffer )
+	{
+		FFree( locBuffer );
+	}
+
 	// Shortcut!
 	close_fcp:
 	
-	DEBUG( "[FriendCoreProcessSockBlock] Closing socket %d.\n", th->sock->fd );
-	th->sock->s_Interface->SocketDelete( th->sock );
-	th->sock = NULL;
+	if( th->sock != NULL )
+	{
+		DEBUG( "[FriendCoreProcessSockBlock] Closing socket %d.\n", th->sock->fd );
+		th->sock->s_Interface->SocketDelete( th->sock );
+		th->sock = NULL;
+	}
 
 	// Free the pair
 	if( th != NULL )
@@ -1339,7 +1631,35 @@ void FriendCoreProcessSockBlock( void *fcv )
 		th = NULL;
 	}
 
-	BufStringDiskDelete( resultString );
+	if( resultString != NULL )
+	{
+		BufStringDiskDelete( resultString );
+	}
+}
+
+//
+//
+//
+
+void FriendCoreProcessSockBlock( void *fcv )
+{
+#ifdef USE_PTHREAD
+	pthread_detach( pthread_self() );
+#endif 
+
+	if( fcv != NULL )
+	{
+		struct fcThreadInstance *th = ( struct fcThreadInstance *)fcv;
+
+		if( th->sock == NULL )
+		{
+			FFree( th );
+		}
+		else
+		{
+			FriendCoreProcessSockBlockInternal( th );
+		}
+	}
 
 #ifdef USE_PTHREAD
 	pthread_exit( 0 );
@@ -1419,19 +1739,12 @@ void FriendCoreProcessSockNonBlock( void *fcv )
 						// get length of header
 						headerLen = ((headEnd+4) - resultString->bsd_Buffer);
 						
-						char *conLen = strstr( resultString->bsd_Buffer, "Content-Length:" );
-						DEBUG("[FriendCoreProcessSockNonBlock] Pointer to conLen %p headerLen %d\n", conLen, headerLen );
-						if( conLen != NULL )
+						FQUAD conLen = FriendCoreContentLength( resultString->bsd_Buffer, headerLen );
+						DEBUG("[FriendCoreProcessSockNonBlock] Content length %ld headerLen %d\n", conLen, headerLen );
+						if( conLen > 0 )
 						{
-							DEBUG("[FriendCoreProcessSockNonBlock] Conlen is not empty!\n");
-							conLen += 16;
-							char *conLenEnd = strstr( conLen, "\r\n" );
-							if( conLenEnd != NULL )
-							{
-								char *end;
-								expectedLength = strtoll( conLen,  &end, 0 ) + headerLen;
-								DEBUG("[FriendCoreProcessSockNonBlock] Expected len %ld\n", expectedLength );
-							}
+							expectedLength = conLen + headerLen;
+							DEBUG("[FriendCoreProcessSockNonBlock] Expected len %ld\n", expectedLength );
 						}
 						DEBUG("[FriendCoreProcessSockNonBlock] Header found!\n");
 						headerFound = TRUE;
@@ -1515,6 +1828,443 @@ void FriendCoreProcessSockNonBlock( void *fcv )
 
 
 
+/**
+* Process connection in pool worker (pool mode)
+*
+* @param fcv pointer to fcThreadInstance
+*/
+void FriendCoreProcessSockPool( void *fcv )
+{
+	FriendCoreProcessSockBlockInternal( ( struct fcThreadInstance *)fcv );
+}
+
+/**
+* Pass connection which has data to read to request thread or pool worker
+*
+* @param fc pointer to Friend Core instance
+* @param sock pointer to Socket, released when it cannot be processed
+*/
+static void FriendCoreDispatch( FriendCoreInstance *fc, Socket *sock )
+{
+	struct fcThreadInstance *pre = FCalloc( 1, sizeof( struct fcThreadInstance ) );
+	if( pre == NULL )
+	{
+		sock->s_Interface->SocketDelete( sock );
+		return;
+	}
+	
+	pre->fc = fc; pre->sock = sock;
+	
+	if( fc->fci_DispatchMode == FRIEND_CORE_DISPATCH_POOL )
+	{
+		if( WorkerManagerQueue( fc->fci_WorkerManager, FriendCoreProcessSockPool, pre, 0 ) != 0 )
+		{
+			sock->s_Interface->SocketDelete( sock );
+			FFree( pre );
+		}
+		return;
+	}
+	
+#ifdef USE_PTHREAD
+	size_t stacksize = fc->fci_WorkersStackSize;
+	pthread_attr_t attr;
+	pthread_attr_init( &attr );
+	pthread_attr_setstacksize( &attr, stacksize );
+	
+	if( pthread_create( &pre->thread, &attr, (void *(*) (void *))&FriendCoreProcessSockBlock, ( void *)pre ) != 0 )
+	{
+		sock->s_Interface->SocketDelete( sock );
+		FFree( pre );
+	}
+	pthread_attr_destroy( &attr );
+#else
+#ifdef USE_WORKERS
+	DEBUG("[FriendCoreDispatch] Worker will be launched\n");
+	SystemBase *locsb = (SystemBase *)fc->fci_SB;
+	if( WorkerManagerRun( locsb->sl_WorkerManager,  FriendCoreProcess, pre, NULL, "FriendCoreProcess" ) != 0 )
+	{
+		SocketDelete( sock );
+	}
+#else
+	int pid = fork();
+	if( pid == 0 )
+	{
+		FriendCoreProcess( pre );
+	}
+#endif
+#endif
+}
+
+/**
+* Send HTTP to HTTPS redirect and close connection
+*
+* Runs in own thread, redirect waits for rest of request and must not stop main loop
+*
+* @param d pointer to Socket
+* @return NULL
+*/
+static void *FriendCoreRedirectThread( void *d )
+{
+	Socket *sock = (Socket *)d;
+	
+	pthread_detach( pthread_self() );
+	
+	moveToHttp( sock->fd );
+	sock->s_Interface->SocketDelete( sock );
+	
+	return NULL;
+}
+
+/**
+* Remove connection which failed TLS handshake from main epoll and release it (called by main loop)
+*
+* @param fc pointer to Friend Core instance
+* @param sock pointer to Socket
+*/
+static inline void FriendCoreHandshakeClose( FriendCoreInstance *fc, Socket *sock )
+{
+	FriendCoreIdleRemove( fc, sock );
+	epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
+	sock->s_Interface->SocketDelete( sock );
+}
+
+/**
+* Start TLS handshake on accepted connection
+*
+* Socket is switched to non-blocking mode and put into main epoll, main loop
+* continues handshake every time socket is ready. Connection is closed by
+* FriendCoreIdleExpire when handshake and first request do not finish in time.
+*
+* @param fc pointer to Friend Core instance
+* @param sock pointer to accepted Socket with SSL object attached
+*/
+static void FriendCoreHandshakeStart( FriendCoreInstance *fc, Socket *sock )
+{
+	SocketSetBlocking( sock, FALSE );
+	sock->s_Handshake = TRUE;
+	
+	// client starts with ClientHello, so first step waits for data
+	FriendCoreIdleAdd( fc, sock );
+}
+
+/**
+* Continue TLS handshake on connection which got event in main epoll (called by main loop)
+*
+* Socket is armed again for event OpenSSL is waiting for. When handshake is finished,
+* connection waits in main epoll for first request like idle keep-alive connection.
+*
+* @param fc pointer to Friend Core instance
+* @param sock pointer to Socket
+*/
+static void FriendCoreHandshakeStep( FriendCoreInstance *fc, Socket *sock )
+{
+	struct epoll_event event;
+	int err;
+	
+	ERR_clear_error();
+	if( ( err = SSL_accept( sock->s_Ssl ) ) == 1 )
+	{
+		DEBUG("[FriendCoreHandshakeStep] Handshake finished, fd: %d\n", sock->fd );
+		sock->s_Handshake = FALSE;
+		FriendCoreIdleRemove( fc, sock );
+		
+		// request could arrive together with last handshake message
+		if( SSL_pending( sock->s_Ssl ) > 0 )
+		{
+			FriendCoreDispatch( fc, sock );
+		}
+		else
+		{
+			FriendCoreIdleAdd( fc, sock );
+		}
+		return;
+	}
+	
+	memset( &event, 0, sizeof( event ) );
+	event.data.ptr = sock;
+	
+	int error = SSL_get_error( sock->s_Ssl, err );
+	switch( error )
+	{
+		case SSL_ERROR_WANT_READ:
+			event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+		break;
+		case SSL_ERROR_WANT_WRITE:
+			event.events = EPOLLOUT | EPOLLRDHUP | EPOLLONESHOT;
+		break;
+		case SSL_ERROR_SSL:
+		{
+			int enume = ERR_get_error();
+			// HTTP to HTTPS redirection code
+			if( enume == 336027804 )
+			{
+				pthread_t thread;
+				
+				FriendCoreIdleRemove( fc, sock );
+				epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
+				if( pthread_create( &thread, NULL, &FriendCoreRedirectThread, sock ) != 0 )
+				{
+					sock->s_Interface->SocketDelete( sock );
+				}
+				return;
+			}
+			FERROR( "[FriendCoreHandshakeStep] SSL_ERROR_SSL: %s. enume: %d\n", ERR_error_string( enume, NULL ), enume );
+			FriendCoreHandshakeClose( fc, sock );
+			return;
+		}
+		default:
+		{
+			int enume = ERR_get_error();
+			DEBUG( "[FriendCoreHandshakeStep] Handshake failed: %s. enume: %d error: %d\n", ERR_error_string( enume, NULL ), enume, error );
+			FriendCoreHandshakeClose( fc, sock );
+			return;
+		}
+	}
+	
+	if( epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_MOD, sock->fd, &event ) != 0 )
+	{
+		FERROR( "[FriendCoreHandshakeStep] Cannot arm fd: %d, errno %d\n", sock->fd, errno );
+		FriendCoreHandshakeClose( fc, sock );
+	}
+}
+
+/**
+* Accept all waiting connections and put them into main epoll (pool mode)
+*
+* Only accept is done in event loop. Connection waits in main epoll (EPOLLIN | EPOLLONESHOT) until
+* first request arrives, so worker is not blocked by client which connected and sent nothing yet.
+* TLS handshake is done by main loop and request processing by workers.
+*
+* @param fc pointer to Friend Core instance
+* @param listenSock pointer to listening Socket which got event
+*/
+static inline void FriendCoreAcceptToPool( FriendCoreInstance *fc, Socket *listenSock )
+{
+	while( fc->fci_Shutdown == FALSE )
+	{
+		struct sockaddr_in6 client;
+		socklen_t clientLen = sizeof( client );
+		
+		int fd = accept4( listenSock->fd, ( struct sockaddr* )&client, &clientLen, SOCK_NONBLOCK );
+		if( fd < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+			if( errno != EAGAIN && errno != EWOULDBLOCK )
+			{
+				DEBUG("[FriendCoreAcceptToPool] accept4 failed, errno: %d\n", errno );
+			}
+			break;
+		}
+		
+		Socket *incoming = ( Socket *)FCalloc( 1, sizeof( Socket ) );
+		
+		if( incoming == NULL )
+		{
+			FERROR("[FriendCoreAcceptToPool] Cannot allocate memory for socket!\n");
+			shutdown( fd, SHUT_RDWR );
+			close( fd );
+			continue;
+		}
+		
+		incoming->s_Data = fc;
+		incoming->fd = fd;
+		incoming->port = ntohs( client.sin6_port );
+		incoming->ip = client.sin6_addr;
+		incoming->s_SSLEnabled = listenSock->s_SSLEnabled;
+		incoming->s_SB = listenSock->s_SB;
+		incoming->s_Interface = listenSock->s_Interface;
+		
+		if( listenSock->s_SSLEnabled == TRUE )
+		{
+			if( ( incoming->s_Ssl = SSL_new( listenSock->s_Ctx ) ) == NULL || SSL_set_fd( incoming->s_Ssl, fd ) != 1 )
+			{
+				FERROR("[FriendCoreAcceptToPool] Cannot create SSL connection, fd: %d\n", fd );
+				incoming->s_Interface->SocketDelete( incoming );
+				continue;
+			}
+			SSL_set_accept_state( incoming->s_Ssl );
+			
+			// worker is taken when handshake is finished and request arrives
+			FriendCoreHandshakeStart( fc, incoming );
+			continue;
+		}
+		
+		// worker is taken when request arrives, main loop dispatches readable socket,
+		// FriendCoreIdleExpire closes connection which sends nothing in time
+		FriendCoreIdleAdd( fc, incoming );
+	}
+}
+
+/**
+* Additional event loop thread (pool mode)
+*
+* @param d pointer to FriendCoreEventLoop
+*/
+static void *FriendCoreEventLoopThread( void *d )
+{
+	FriendCoreEventLoop *el = (FriendCoreEventLoop *)d;
+	FriendCoreInstance *fc = el->fcel_FC;
+	struct epoll_event *events = FCalloc( fc->fci_MaxPoll, sizeof( struct epoll_event ) );
+	
+	if( events == NULL )
+	{
+		FERROR("[FriendCoreEventLoopThread] Cannot allocate memory for events\n");
+		return NULL;
+	}
+	
+	DEBUG("[FriendCoreEventLoopThread] Event loop %d started\n", el->fcel_Nr );
+	
+	while( fc->fci_Shutdown == FALSE && el->fcel_Quit == FALSE )
+	{
+		// timeout lets loop notice shutdown, main loop owns the pipe
+		int i, eventCount = epoll_wait( el->fcel_Epollfd, events, fc->fci_MaxPoll, 500 );
+		
+		for( i = 0; i < eventCount; i++ )
+		{
+			if( events[ i ].events & ( EPOLLERR | EPOLLHUP ) )
+			{
+				Log( FLOG_ERROR, "[FriendCoreEventLoopThread] Listening socket error, loop %d\n", el->fcel_Nr );
+				continue;
+			}
+			FriendCoreAcceptToPool( fc, el->fcel_Socket );
+		}
+	}
+	
+	FFree( events );
+	
+	DEBUG("[FriendCoreEventLoopThread] Event loop %d stopped\n", el->fcel_Nr );
+	return NULL;
+}
+
+/**
+* Create worker pool and additional event loops (pool mode)
+*
+* Main loop (FriendCoreEpoll) is loop number 0, every other loop gets own listening socket on the same port
+*
+* @param fc pointer to Friend Core instance
+* @return 0 when success, otherwise error number. Loops which were started are left for FriendCoreEventLoopsStop
+*/
+static int FriendCoreEventLoopsStart( FriendCoreInstance *fc )
+{
+	SystemBase *lsb = (SystemBase *)fc->fci_SB;
+	int i;
+	
+	fc->fci_WorkerManager = WorkerManagerNewPool( fc->fci_WorkersNumber, fc->fci_WorkersQueueSize, fc->fci_WorkersStackSize );
+	if( fc->fci_WorkerManager == NULL )
+	{
+		return 1;
+	}
+	
+	if( fc->fci_EventLoopsNumber <= 1 )
+	{
+		return 0;
+	}
+	
+	if( ( fc->fci_EventLoops = FCalloc( fc->fci_EventLoopsNumber, sizeof( FriendCoreEventLoop ) ) ) == NULL )
+	{
+		FERROR("[FriendCoreEventLoopsStart] Cannot allocate memory for event loops\n");
+		return 2;
+	}
+	
+	for( i=1 ; i < fc->fci_EventLoopsNumber ; i++ )
+	{
+		FriendCoreEventLoop *el = &(fc->fci_EventLoops[ i ]);
+		struct epoll_event event;
+		
+		el->fcel_FC = fc;
+		el->fcel_Nr = i;
+		el->fcel_Epollfd = -1;
+		
+		if( ( el->fcel_Socket = SocketNew( lsb, fc->fci_SSLEnabled, fc->fci_Port, SOCKET_TYPE_SERVER_REUSEPORT ) ) == NULL )
+		{
+			Log( FLOG_ERROR, "[FriendCoreEventLoopsStart] Cannot create socket for event loop %d\n", i );
+			break;
+		}
+		
+		if( SocketListen( el->fcel_Socket ) != 0 || ( el->fcel_Epollfd = epoll_create1( EPOLL_CLOEXEC ) ) == -1 )
+		{
+			Log( FLOG_ERROR, "[FriendCoreEventLoopsStart] Cannot setup event loop %d\n", i );
+			break;
+		}
+		
+		memset( &event, 0, sizeof( event ) );
+		event.data.ptr = el->fcel_Socket;
+		event.events = EPOLLIN;
+		
+		if( epoll_ctl( el->fcel_Epollfd, EPOLL_CTL_ADD, el->fcel_Socket->fd, &event ) == -1 )
+		{
+			Log( FLOG_ERROR, "[FriendCoreEventLoopsStart] epoll_ctl fail, event loop %d\n", i );
+			break;
+		}
+		
+		if( pthread_create( &(el->fcel_Thread), NULL, &FriendCoreEventLoopThread, el ) != 0 )
+		{
+			Log( FLOG_ERROR, "[FriendCoreEventLoopsStart] Cannot start event loop %d\n", i );
+			break;
+		}
+		el->fcel_Launched = TRUE;
+	}
+	
+	if( i < fc->fci_EventLoopsNumber )
+	{
+		Log( FLOG_ERROR, "[FriendCoreEventLoopsStart] Only %d of %d event loops started\n", i, fc->fci_EventLoopsNumber );
+		return 3;
+	}
+	
+	Log( FLOG_INFO, "[FriendCoreEventLoopsStart] Event loops running: %d, workers: %d\n", i, fc->fci_WorkersNumber );
+	
+	return 0;
+}
+
+/**
+* Stop additional event loops and worker pool (pool mode)
+*
+* @param fc pointer to Friend Core instance
+*/
+static void FriendCoreEventLoopsStop( FriendCoreInstance *fc )
+{
+	int i;
+	
+	if( fc->fci_EventLoops != NULL )
+	{
+		// loops are also stopped when start failed and server keeps running
+		for( i=1 ; i < fc->fci_EventLoopsNumber ; i++ )
+		{
+			fc->fci_EventLoops[ i ].fcel_Quit = TRUE;
+		}
+		
+		for( i=1 ; i < fc->fci_EventLoopsNumber ; i++ )
+		{
+			FriendCoreEventLoop *el = &(fc->fci_EventLoops[ i ]);
+			
+			if( el->fcel_Launched == TRUE )
+			{
+				pthread_join( el->fcel_Thread, NULL );
+			}
+			if( el->fcel_Epollfd >= 0 )
+			{
+				close( el->fcel_Epollfd );
+			}
+			if( el->fcel_Socket != NULL )
+			{
+				el->fcel_Socket->s_Interface->SocketDelete( el->fcel_Socket );
+			}
+		}
+		FFree( fc->fci_EventLoops );
+		fc->fci_EventLoops = NULL;
+	}
+	
+	// workers finish connections which are already queued
+	if( fc->fci_WorkerManager != NULL )
+	{
+		WorkerManagerDelete( fc->fci_WorkerManager );
+		fc->fci_WorkerManager = NULL;
+	}
+}
+
 pthread_t thread;
 
 #ifdef USE_SELECT
@@ -1726,17 +2476,36 @@ static inline void FriendCoreEpoll( FriendCoreInstance* fc )
 
 	events->events = EPOLLIN;
 	
+	if( fc->fci_DispatchMode == FRIEND_CORE_DISPATCH_POOL )
+	{
+		if( FriendCoreEventLoopsStart( fc ) != 0 )
+		{
+			Log( FLOG_ERROR, "[FriendCoreEpoll] Cannot start worker pool or event loops, thread per connection will be used\n");
+			FriendCoreEventLoopsStop( fc );
+			fc->fci_DispatchMode = FRIEND_CORE_DISPATCH_PTHREAD;
+		}
+	}
+	
 #ifdef ACCEPT_IN_THREAD
 	pthread_t thread;
 	
 	//epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_DISABLE, fc->fci_Sockets->fd, NULL );
 
-	if( pthread_create( &thread, NULL, &FriendCoreAcceptPhase2, ( void *)fc ) != 0 )
+	if( fc->fci_DispatchMode == FRIEND_CORE_DISPATCH_PTHREAD )
+	{
+		if( pthread_create( &thread, NULL, &FriendCoreAcceptPhase2, ( void *)fc ) != 0 )
+		{
+			DEBUG("[FriendCoreEpoll] Pthread Accept create fail\n");
+		}
+	}
+	else
 	{
-		DEBUG("[FriendCoreEpoll] Pthread Accept create fail\n");
+		fc->fci_AcceptThreadDestroyed = TRUE;
 	}
 #endif
 
+	time_t lastIdleCheck = 0;
+	
 	// All incoming network events go through here
 	while( !fc->fci_Shutdown )
 	{
@@ -1747,7 +2516,9 @@ static inline void FriendCoreEpoll( FriendCoreInstance* fc )
 		
 		// Wait for something to happen on any of the sockets we're listening on
 		DEBUG("[FriendCoreEpoll] Before epollwait\n");
-		eventCount = epoll_pwait( fc->fci_Epollfd, events, fc->fci_MaxPoll, -1, &curmask );
+		// with keep-alive loop must wake up to close idle connections
+		// with keep-alive or TLS loop must wake up to close idle connections and unfinished handshakes
+		eventCount = epoll_pwait( fc->fci_Epollfd, events, fc->fci_MaxPoll, ( fc->fci_KeepAlive == TRUE || fc->fci_SSLEnabled == TRUE || fc->fci_DispatchMode == FRIEND_CORE_DISPATCH_POOL ) ? 1000 : -1, &curmask );
 		DEBUG("[FriendCoreEpoll] Epollwait, eventcount: %d\n", eventCount );
 
 		for( i = 0; i < eventCount; i++ )
@@ -1766,7 +2537,7 @@ static inline void FriendCoreEpoll( FriendCoreInstance* fc )
 				( ( currentEvent->events & EPOLLERR ) ||
 				( currentEvent->events & EPOLLRDHUP ) ||
 				( currentEvent->events & EPOLLHUP ) ) || 
-				!( currentEvent->events & EPOLLIN ) 
+				!( currentEvent->events & ( EPOLLIN | EPOLLOUT ) ) 
 			)
 			{
 				if( ((Socket*)currentEvent->data.ptr)->fd == fc->fci_Sockets->fd )
@@ -1781,6 +2552,7 @@ static inline void FriendCoreEpoll( FriendCoreInstance* fc )
 				if( sock != NULL )
 				{
 					DEBUG("[FriendCoreEpoll] FD %d\n", sock->fd );
+					FriendCoreIdleRemove( fc, sock );
 					epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
 					sock->s_Interface->SocketDelete( sock );
 					sock = NULL;
@@ -1821,6 +2593,12 @@ static inline void FriendCoreEpoll( FriendCoreInstance* fc )
 			{
 				DEBUG("[FriendCoreEpoll] =====================before calling FriendCoreAcceptPhase2\n");
 				
+				if( fc->fci_DispatchMode == FRIEND_CORE_DISPATCH_POOL )
+				{
+					FriendCoreAcceptToPool( fc, fc->fci_Sockets );
+					continue;
+				}
+				
 #ifdef ACCEPT_IN_THREAD
 				if( FRIEND_MUTEX_LOCK( &(fc->fci_AcceptMutex) ) == 0 )
 				{
@@ -1850,65 +2628,38 @@ static inline void FriendCoreEpoll( FriendCoreInstance* fc )
 #endif // ACCEPT_IN_THREAD
 				DEBUG("[FriendCoreEpoll] Accept done\n");
 			}
+			// TLS handshake in progress, socket is ready for next step
+			else if( sock->s_Handshake == TRUE )
+			{
+				if( !fc->fci_Shutdown )
+				{
+					FriendCoreHandshakeStep( fc, sock );
+				}
+			}
 			// Get event that are incoming!
 			else if( currentEvent->events & EPOLLIN )
 			{
-				// Stop listening here..
-				epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
-				INFO("[FriendCoreEpoll] Socket fd: %d removed from epoll\n", sock->fd );
+				// Keep-alive connection, EPOLLONESHOT already stopped listening here..
+				FriendCoreIdleRemove( fc, sock );
 				
 				// Process
 				if( !fc->fci_Shutdown )
 				{
 					DEBUG("[FriendCoreEpoll] EPOLLIN\n");
-					
-					struct fcThreadInstance *pre = FCalloc( 1, sizeof( struct fcThreadInstance ) );
-					if( pre != NULL )
-					{
-						pre->fc = fc; pre->sock = sock;
-					
-#ifdef USE_PTHREAD
-						//size_t stacksize = 16777216; //16 * 1024 * 1024;
-						size_t stacksize = 8777216;	// half of previous stack
-						pthread_attr_t attr;
-						pthread_attr_init( &attr );
-						pthread_attr_setstacksize( &attr, stacksize );
-						
-						// Make sure we keep the number of threads under the limit
-						
-						//change NULL to &attr
-#ifdef USE_BLOCKED_SOCKETS_TO_READ_HTTP
-						if( pthread_create( &pre->thread, &attr, (void *(*) (void *))&FriendCoreProcessSockBlock, ( void *)pre ) != 0 )
-#else
-						if( pthread_create( &pre->thread, &attr, (void *(*) (void *))&FriendCoreProcessSockNonBlock, ( void *)pre ) != 0 )
-#endif
-						{
-							FFree( pre );
-						}
-#else
-#ifdef USE_WORKERS
-						DEBUG("[FriendCoreEpoll] Worker will be launched\n");
-						SystemBase *locsb = (SystemBase *)fc->fci_SB;
-						if( WorkerManagerRun( locsb->sl_WorkerManager,  FriendCoreProcess, pre, NULL, "FriendCoreProcess" ) != 0 )
-						{
-							SocketDelete( sock );
-							sock = NULL;
-						}
-						DEBUG("[FriendCoreEpoll] Worker launched\n");
-						//WorkerManagerRun( fc->fci_WorkerManager,  FriendCoreProcess, pre );
-#else
-						int pid = fork();
-						if( pid == 0 )
-						{
-							FriendCoreProcess( pre );
-						}
-#endif
-#endif
-					}
-					//DEBUG("EPOLLIN end\n");
+					FriendCoreDispatch( fc, sock );
+				}
+				else
+				{
+					sock->s_Interface->SocketDelete( sock );
 				}
 			}
 		}
+		
+		if( ( fc->fci_KeepAlive == TRUE || fc->fci_SSLEnabled == TRUE || fc->fci_DispatchMode == FRIEND_CORE_DISPATCH_POOL ) && lastIdleCheck != time( NULL ) )
+		{
+			lastIdleCheck = time( NULL );
+			FriendCoreIdleExpire( fc, fc->fci_KeepAliveTimeout );
+		}
 	}
 	
 	//DEBUG("End main loop\n");
@@ -1943,6 +2694,14 @@ static inline void FriendCoreEpoll( FriendCoreInstance* fc )
 	}
 #endif
 
+	if( fc->fci_DispatchMode == FRIEND_CORE_DISPATCH_POOL )
+	{
+		FriendCoreEventLoopsStop( fc );
+	}
+	
+	// close connections which are waiting for next request
+	FriendCoreIdleExpire( fc, 0 );
+	
 #ifdef ACCEPT_IN_THREAD
 	fc->fci_AcceptQuit = TRUE;
 	
@@ -2022,7 +2781,7 @@ int FriendCoreRun( FriendCoreInstance* fc )
 	
 	// Open new socket for lisenting
 
-	fc->fci_Sockets = SocketNew( lsb, fc->fci_SSLEnabled, fc->fci_Port, SOCKET_TYPE_SERVER );
+	fc->fci_Sockets = SocketNew( lsb, fc->fci_SSLEnabled, fc->fci_Port, fc->fci_DispatchMode == FRIEND_CORE_DISPATCH_POOL ? SOCKET_TYPE_SERVER_REUSEPORT : SOCKET_TYPE_SERVER );
 	
 	if( fc->fci_Sockets == NULL )
 	{
@@ -2042,7 +2801,6 @@ int FriendCoreRun( FriendCoreInstance* fc )
 	}
 	
 	SSL_CTX_get_read_ahead( fc->fci_Sockets->s_Ctx );
-	SSL_CTX_set_session_cache_mode( fc->fci_Sockets->s_Ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
 			
 	
 	if( SocketListen( fc->fci_Sockets ) != 0 )
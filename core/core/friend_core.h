@@ -40,6 +40,49 @@
 #endif
 #include <poll.h>
 
+//
+// HTTP request dispatch modes
+//
+
+enum {
+	FRIEND_CORE_DISPATCH_PTHREAD = 0,		///< accept thread, new thread for every connection
+	FRIEND_CORE_DISPATCH_POOL				///< event loops sharing port (SO_REUSEPORT), bounded worker pool
+};
+
+#ifndef FRIEND_CORE_HTTP_WORKERS
+#define FRIEND_CORE_HTTP_WORKERS 64
+#endif
+#ifndef FRIEND_CORE_HTTP_QUEUE_SIZE
+#define FRIEND_CORE_HTTP_QUEUE_SIZE 256
+#endif
+#ifndef FRIEND_CORE_HTTP_STACK_SIZE
+#define FRIEND_CORE_HTTP_STACK_SIZE 8777216
+#endif
+#ifndef FRIEND_CORE_SSL_HANDSHAKE_TIMEOUT
+#define FRIEND_CORE_SSL_HANDSHAKE_TIMEOUT 10	// seconds
+#endif
+#ifndef FRIEND_CORE_KEEPALIVE_TIMEOUT
+#define FRIEND_CORE_KEEPALIVE_TIMEOUT 15	// seconds
+#endif
+#ifndef FRIEND_CORE_KEEPALIVE_MAX_REQUESTS
+#define FRIEND_CORE_KEEPALIVE_MAX_REQUESTS 100
+#endif
+
+//
+// Additional event loop (pool mode). Every loop has own listening socket bound to the same port
+//
+
+typedef struct FriendCoreEventLoop
+{
+	struct FriendCoreInstance	*fcel_FC;			///< pointer to FriendCoreInstance
+	Socket						*fcel_Socket;		///< listening socket
+	int							fcel_Epollfd;		///< epoll file descriptor
+	int							fcel_Nr;			///< number of loop, used as worker queue hint
+	pthread_t					fcel_Thread;		///< loop thread
+	FBOOL						fcel_Launched;		///< TRUE when thread was started
+	FBOOL						fcel_Quit;			///< set by FriendCoreEventLoopsStop, loop finishes
+} FriendCoreEventLoop;
+
 
 /**
  * FriendCore instance data
@@ -83,6 +126,21 @@ typedef struct FriendCoreInstance
 	FBOOL					fci_AcceptThreadDestroyed;
 	struct epoll_event		fci_EpollEvent;
 	
+	int						fci_DispatchMode;		///< FRIEND_CORE_DISPATCH_PTHREAD or FRIEND_CORE_DISPATCH_POOL
+	int						fci_EventLoopsNumber;	///< number of event loops, main loop included (pool mode)
+	int						fci_WorkersNumber;		///< number of pool workers (pool mode)
+	int						fci_WorkersQueueSize;	///< maximum number of connections waiting per worker (pool mode)
+	int						fci_WorkersStackSize;	///< stack size of threads which handle requests
+	WorkerManager			*fci_WorkerManager;		///< request worker pool (pool mode)
+	FriendCoreEventLoop		*fci_EventLoops;		///< additional event loops (pool mode)
+	
+	FBOOL					fci_KeepAlive;			///< TRUE when HTTP connections are persistent
+	int						fci_KeepAliveTimeout;	///< idle connection is closed after this time (seconds)
+	int						fci_KeepAliveMaxRequests;	///< connection is closed after this number of requests
+	Socket					*fci_IdleSockets;		///< idle keep-alive connections and TLS handshakes waiting in main epoll
+	int						fci_HandshakeTimeout;	///< TLS handshake and first request must finish in this time (seconds)
+	pthread_mutex_t			fci_IdleMutex;
+	
 } FriendCoreInstance;
 
 /**
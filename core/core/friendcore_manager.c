@@ -184,6 +184,23 @@ FriendCoreManager *FriendCoreManagerNew()
 		fcm->fcm_DisableMobileWS = 0;
 		fcm->fcm_DisableExternalWS = 0;
 		fcm->fcm_WSExtendedDebug = 0;
+		fcm->fcm_WSThreads = 0;
+		fcm->fcm_WSWorkers = WEBSOCKET_WORKERS;
+		fcm->fcm_WSWorkersQueue = WEBSOCKET_WORKERS_QUEUE_SIZE;
+		fcm->fcm_WSMaxQueue = WEBSOCKET_CONNECTION_QUEUE_SIZE;
+		fcm->fcm_WSDeflate = TRUE;
+		fcm->fcm_WSDeflateLevel = WEBSOCKET_DEFLATE_LEVEL;
+		fcm->fcm_WSDeflateMemLevel = WEBSOCKET_DEFLATE_MEM_LEVEL;
+		
+		fcm->fcm_HttpWorkerPool = FALSE;
+		fcm->fcm_HttpEventLoops = 0;
+		fcm->fcm_HttpWorkers = FRIEND_CORE_HTTP_WORKERS;
+		fcm->fcm_HttpQueueSize = FRIEND_CORE_HTTP_QUEUE_SIZE;
+		fcm->fcm_HttpStackSize = FRIEND_CORE_HTTP_STACK_SIZE;
+		fcm->fcm_HttpKeepAlive = FALSE;
+		fcm->fcm_HttpKeepAliveTimeout = FRIEND_CORE_KEEPALIVE_TIMEOUT;
+		fcm->fcm_HttpKeepAliveMax = FRIEND_CORE_KEEPALIVE_MAX_REQUESTS;
+		fcm->fcm_HttpHandshakeTimeout = FRIEND_CORE_SSL_HANDSHAKE_TIMEOUT;
 		
 		Props *prop = NULL;
 		PropertiesInterface *plib = &(SLIB->sl_PropertiesInterface);
@@ -226,6 +243,23 @@ FriendCoreManager *FriendCoreManagerNew()
 				fcm->fcm_DisableMobileWS = plib->ReadIntNCS( prop, "core:disablemobilews", 0 );
 				fcm->fcm_DisableExternalWS = plib->ReadIntNCS( prop, "core:disableexternalws", 0 );
 				fcm->fcm_WSExtendedDebug = plib->ReadIntNCS( prop, "core:wsextendeddebug", 0 );
+				fcm->fcm_WSThreads = plib->ReadIntNCS( prop, "core:wsthreads", 0 );
+				fcm->fcm_WSWorkers = plib->ReadIntNCS( prop, "core:wsworkers", WEBSOCKET_WORKERS );
+				fcm->fcm_WSWorkersQueue = plib->ReadIntNCS( prop, "core:wsworkersqueue", WEBSOCKET_WORKERS_QUEUE_SIZE );
+				fcm->fcm_WSMaxQueue = plib->ReadIntNCS( prop, "core:wsmaxqueue", WEBSOCKET_CONNECTION_QUEUE_SIZE );
+				fcm->fcm_WSDeflate = plib->ReadIntNCS( prop, "core:wsdeflate", 1 );
+				fcm->fcm_WSDeflateLevel = plib->ReadIntNCS( prop, "core:wsdeflatelevel", WEBSOCKET_DEFLATE_LEVEL );
+				fcm->fcm_WSDeflateMemLevel = plib->ReadIntNCS( prop, "core:wsdeflatememlevel", WEBSOCKET_DEFLATE_MEM_LEVEL );
+				
+				fcm->fcm_HttpWorkerPool = plib->ReadIntNCS( prop, "core:httpworkerpool", 0 );
+				fcm->fcm_HttpEventLoops = plib->ReadIntNCS( prop, "core:httpeventloops", 0 );
+				fcm->fcm_HttpWorkers = plib->ReadIntNCS( prop, "core:httpworkers", FRIEND_CORE_HTTP_WORKERS );
+				fcm->fcm_HttpQueueSize = plib->ReadIntNCS( prop, "core:httpqueuesize", FRIEND_CORE_HTTP_QUEUE_SIZE );
+				fcm->fcm_HttpStackSize = plib->ReadIntNCS( prop, "core:httpstacksize", FRIEND_CORE_HTTP_STACK_SIZE );
+				fcm->fcm_HttpKeepAlive = plib->ReadIntNCS( prop, "core:httpkeepalive", 0 );
+				fcm->fcm_HttpKeepAliveTimeout = plib->ReadIntNCS( prop, "core:httpkeepalivetimeout", FRIEND_CORE_KEEPALIVE_TIMEOUT );
+				fcm->fcm_HttpKeepAliveMax = plib->ReadIntNCS( prop, "core:httpkeepalivemax", FRIEND_CORE_KEEPALIVE_MAX_REQUESTS );
+				fcm->fcm_HttpHandshakeTimeout = plib->ReadIntNCS( prop, "core:httphandshaketimeout", FRIEND_CORE_SSL_HANDSHAKE_TIMEOUT );
 				
 				char *tptr  = plib->ReadStringNCS( prop, "LoginModules:modules", "" );
 				if( tptr != NULL )
@@ -336,6 +370,42 @@ int FriendCoreManagerInit( FriendCoreManager *fcm )
 			return 1;
 		}
 		
+		if( fcm->fcm_HttpWorkerPool == TRUE )
+		{
+			FriendCoreInstance *fc = fcm->fcm_FriendCores;
+			
+			fc->fci_DispatchMode = FRIEND_CORE_DISPATCH_POOL;
+			fc->fci_EventLoopsNumber = fcm->fcm_HttpEventLoops;
+			if( fc->fci_EventLoopsNumber <= 0 )
+			{
+				fc->fci_EventLoopsNumber = (int)sysconf( _SC_NPROCESSORS_ONLN );
+				if( fc->fci_EventLoopsNumber <= 0 )
+				{
+					fc->fci_EventLoopsNumber = 1;
+				}
+			}
+			fc->fci_WorkersNumber = fcm->fcm_HttpWorkers;
+			fc->fci_WorkersQueueSize = fcm->fcm_HttpQueueSize;
+		}
+		if( fcm->fcm_HttpStackSize >= PTHREAD_STACK_MIN )
+		{
+			fcm->fcm_FriendCores->fci_WorkersStackSize = fcm->fcm_HttpStackSize;
+		}
+		
+		if( fcm->fcm_HttpKeepAlive == TRUE && fcm->fcm_HttpKeepAliveTimeout > 0 && fcm->fcm_HttpKeepAliveMax > 1 )
+		{
+			fcm->fcm_FriendCores->fci_KeepAlive = TRUE;
+			fcm->fcm_FriendCores->fci_KeepAliveTimeout = fcm->fcm_HttpKeepAliveTimeout;
+			fcm->fcm_FriendCores->fci_KeepAliveMaxRequests = fcm->fcm_HttpKeepAliveMax;
+		}
+		if( fcm->fcm_HttpHandshakeTimeout > 0 )
+		{
+			fcm->fcm_FriendCores->fci_HandshakeTimeout = fcm->fcm_HttpHandshakeTimeout;
+		}
+		
+		Log(FLOG_INFO, "-----HTTP dispatch: %s, event loops: %d, workers: %d, queue: %d, stack: %d\n", fcm->fcm_HttpWorkerPool ? "pool" : "thread per connection", fcm->fcm_FriendCores->fci_EventLoopsNumber, fcm->fcm_FriendCores->fci_WorkersNumber, fcm->fcm_FriendCores->fci_WorkersQueueSize, fcm->fcm_FriendCores->fci_WorkersStackSize );
+		Log(FLOG_INFO, "-----HTTP keep-alive: %d, timeout: %d, max requests: %d\n", fcm->fcm_FriendCores->fci_KeepAlive, fcm->fcm_FriendCores->fci_KeepAliveTimeout, fcm->fcm_FriendCores->fci_KeepAliveMaxRequests );
+		
 		fcm->fcm_FCI = FriendCoreInfoNew( SLIB );
 		
 		fcm->fcm_Shutdown = FALSE;
@@ -140,6 +140,23 @@ typedef struct FriendCoreManager
 	FBOOL						fcm_DisableMobileWS;
 	FBOOL						fcm_DisableExternalWS;
 	FBOOL						fcm_WSExtendedDebug;
+	int							fcm_WSThreads;			// websocket service threads (0 - number of CPUs)
+	int							fcm_WSWorkers;			// workers which process websocket messages
+	int							fcm_WSWorkersQueue;		// connections waiting per websocket worker
+	int							fcm_WSMaxQueue;			// messages waiting per websocket connection
+	FBOOL						fcm_WSDeflate;			// negotiate permessage-deflate on desktop websockets
+	int							fcm_WSDeflateLevel;		// compression level
+	int							fcm_WSDeflateMemLevel;	// zlib memory level
+	
+	FBOOL						fcm_HttpWorkerPool;		// use event loops and worker pool instead of thread per connection
+	int							fcm_HttpEventLoops;		// number of event loops (0 - number of CPUs)
+	int							fcm_HttpWorkers;		// number of workers in pool
+	int							fcm_HttpQueueSize;		// number of connections waiting per worker
+	int							fcm_HttpStackSize;		// stack size of thread which handles request
+	FBOOL						fcm_HttpKeepAlive;		// keep HTTP connections open between requests
+	int							fcm_HttpKeepAliveTimeout;	// idle connection timeout in seconds
+	int							fcm_HttpKeepAliveMax;	// maximum number of requests per connection
+	int							fcm_HttpHandshakeTimeout;	// TLS handshake and first request timeout in seconds
 }FriendCoreManager;
 
 //
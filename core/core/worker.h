@@ -63,6 +63,7 @@ typedef struct Worker
 	float						w_WorkSeconds;						///< frequency seconds
 	void						*w_Request;							// pointer to http request (used to debug)
 	char						w_FunctionString[ WORKER_FUNCTION_STRING_SIZE ];				// name of function
+	void						*w_Manager;							///< pointer to WorkerManager (pool mode)
 } Worker;
 
 //
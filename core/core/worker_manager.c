@@ -74,6 +74,96 @@ WorkerManager *WorkerManagerNew( int number )
 	return wm;
 }
 
+//
+// definition
+//
+
+void WorkerPoolThread( void *w );
+
+/**
+ * Creates a new Worker-Manager which works as bounded pool
+ *
+ * Every worker owns a queue with queueSize entries. Jobs are added by WorkerManagerQueue,
+ * idle workers take jobs from own queue first and then from queues of other workers.
+ * Workers sleep on condition variable when there is nothing to do.
+ *
+ * @param number number of workers
+ * @param queueSize maximum number of jobs waiting in one worker queue
+ * @param stackSize stack size of worker thread
+ * @return pointer to the Friend Worker-Manager structure
+ * @return NULL in case of errors
+ */
+WorkerManager *WorkerManagerNewPool( int number, int queueSize, size_t stackSize )
+{
+	WorkerManager *wm = NULL;
+	int i;
+	
+	DEBUG( "[WorkerManagerNewPool] Starting worker pool, workers %d queue %d stack %lu\n", number, queueSize, stackSize );
+	
+	if( number <= 0 || queueSize <= 0 )
+	{
+		FERROR( "[WorkerManagerNewPool] Number of workers and queue size must be bigger then 0\n" );
+		return NULL;
+	}
+	
+	if( ( wm = FCalloc( 1, sizeof( WorkerManager ) ) ) == NULL )
+	{
+		FERROR( "[WorkerManagerNewPool] Cannot allocate memory for WorkerManager\n" );
+		return NULL;
+	}
+	
+	wm->wm_MaxWorkers = number;
+	wm->wm_QueueSize = queueSize;
+	pthread_mutex_init( &wm->wm_Mutex, NULL );
+	pthread_cond_init( &wm->wm_PendingCond, NULL );
+	
+	wm->wm_Workers = FCalloc( wm->wm_MaxWorkers, sizeof(Worker *) );
+	wm->wm_Queues = FCalloc( wm->wm_MaxWorkers, sizeof(WorkerQueue) );
+	
+	if( wm->wm_Workers == NULL || wm->wm_Queues == NULL )
+	{
+		FERROR( "[WorkerManagerNewPool] Cannot allocate memory for workers\n" );
+		if( wm->wm_Workers != NULL ) FFree( wm->wm_Workers );
+		if( wm->wm_Queues != NULL ) FFree( wm->wm_Queues );
+		pthread_cond_destroy( &wm->wm_PendingCond );
+		pthread_mutex_destroy( &wm->wm_Mutex );
+		FFree( wm );
+		return NULL;
+	}
+	
+	for( i=0 ; i < wm->wm_MaxWorkers ; i++ )
+	{
+		wm->wm_Queues[ i ].wq_Size = queueSize;
+		wm->wm_Queues[ i ].wq_Jobs = FCalloc( queueSize, sizeof(WorkerJob) );
+		pthread_mutex_init( &(wm->wm_Queues[ i ].wq_Mutex), NULL );
+	}
+	
+	pthread_attr_t attr;
+	pthread_attr_init( &attr );
+	pthread_attr_setstacksize( &attr, stackSize );
+	
+	for( i=0 ; i < wm->wm_MaxWorkers ; i++ )
+	{
+		Worker *wrk = WorkerNew( i );
+		if( wrk != NULL )
+		{
+			wrk->w_Manager = wm;
+			wrk->w_Thread = ThreadNew( WorkerPoolThread, wrk, TRUE, &attr );
+			if( wrk->w_Thread == NULL )
+			{
+				FERROR( "[WorkerManagerNewPool] Cannot create thread for worker %d\n", i );
+			}
+		}
+		wm->wm_Workers[ i ] = wrk;
+	}
+	
+	pthread_attr_destroy( &attr );
+	
+	Log( FLOG_INFO, "[WorkerManagerNewPool] started %d threads, queue size %d\n", wm->wm_MaxWorkers, queueSize );
+	
+	return wm;
+}
+
 /**
  * Destroys a Worker-Manager and all associated workers.
  *
@@ -85,6 +175,17 @@ void WorkerManagerDelete( WorkerManager *wm )
 	{
 		int i = 0;
 		
+		// pool workers are waiting on manager condition, they will finish jobs which are still in queues
+		if( wm->wm_Queues != NULL )
+		{
+			if( FRIEND_MUTEX_LOCK( &wm->wm_Mutex ) == 0 )
+			{
+				wm->wm_Quit = TRUE;
+				pthread_cond_broadcast( &wm->wm_PendingCond );
+				FRIEND_MUTEX_UNLOCK( &wm->wm_Mutex );
+			}
+		}
+		
 		if( wm->wm_Workers )
 		{
 			for( ; i < wm->wm_MaxWorkers ; i++ )
@@ -93,6 +194,22 @@ void WorkerManagerDelete( WorkerManager *wm )
 			}
 			FFree( wm->wm_Workers );
 		}
+		
+		if( wm->wm_Queues != NULL )
+		{
+			for( i=0 ; i < wm->wm_MaxWorkers ; i++ )
+			{
+				if( wm->wm_Queues[ i ].wq_Jobs != NULL )
+				{
+					FFree( wm->wm_Queues[ i ].wq_Jobs );
+				}
+				pthread_mutex_destroy( &(wm->wm_Queues[ i ].wq_Mutex) );
+			}
+			FFree( wm->wm_Queues );
+			pthread_cond_destroy( &wm->wm_PendingCond );
+			
+			Log( FLOG_INFO, "[WorkerManager] pool stopped, executed %lu stolen %lu rejected %lu\n", wm->wm_Executed, wm->wm_Stolen, wm->wm_Rejected );
+		}
 		pthread_mutex_destroy( &wm->wm_Mutex );
 		
 		FFree( wm );
@@ -175,6 +292,12 @@ int WorkerManagerRun( WorkerManager *wm,  void (*foo)( void *), void *d, void *w
 		return -1;
 	}
 	
+	// pool does not wait for free worker, job is queued
+	if( wm->wm_Queues != NULL )
+	{
+		return WorkerManagerQueue( wm, foo, d, -1 );
+	}
+	
 	while( TRUE )
 	{
 		/*
@@ -303,6 +426,188 @@ int WorkerManagerRun( WorkerManager *wm,  void (*foo)( void *), void *d, void *w
 	return 0;
 }
 
+/**
+ * Take oldest job from queue
+ *
+ * @param q pointer to WorkerQueue
+ * @param job pointer to WorkerJob where job will be stored
+ * @return TRUE when job was taken, otherwise FALSE
+ */
+static inline FBOOL WorkerQueueTake( WorkerQueue *q, WorkerJob *job )
+{
+	FBOOL taken = FALSE;
+	
+	if( FRIEND_MUTEX_LOCK( &(q->wq_Mutex) ) == 0 )
+	{
+		if( q->wq_Count > 0 )
+		{
+			*job = q->wq_Jobs[ q->wq_Head ];
+			q->wq_Head = ( q->wq_Head + 1 ) % q->wq_Size;
+			q->wq_Count--;
+			taken = TRUE;
+		}
+		FRIEND_MUTEX_UNLOCK( &(q->wq_Mutex) );
+	}
+	return taken;
+}
+
+/**
+ * Add job at the end of queue
+ *
+ * @param q pointer to WorkerQueue
+ * @param job pointer to WorkerJob which will be copied to queue
+ * @return TRUE when job was added, FALSE when queue is full
+ */
+static inline FBOOL WorkerQueuePut( WorkerQueue *q, WorkerJob *job )
+{
+	FBOOL added = FALSE;
+	
+	if( FRIEND_MUTEX_LOCK( &(q->wq_Mutex) ) == 0 )
+	{
+		if( q->wq_Count < q->wq_Size )
+		{
+			q->wq_Jobs[ ( q->wq_Head + q->wq_Count ) % q->wq_Size ] = *job;
+			q->wq_Count++;
+			added = TRUE;
+		}
+		FRIEND_MUTEX_UNLOCK( &(q->wq_Mutex) );
+	}
+	return added;
+}
+
+/**
+ * Add job to worker pool
+ *
+ * Job is placed in queue selected by hint (for example number of event loop which accepted connection).
+ * If that queue is full next queues are tried. Function never waits for free worker.
+ *
+ * @param wm pointer to the Worker-Manager structure created by WorkerManagerNewPool
+ * @param foo pointer to function which will be called by worker
+ * @param d pointer to the data passed to function
+ * @param hint preferred queue number or -1
+ * @return 0 when job was queued, -1 when all queues are full or pool is stopping
+ */
+int WorkerManagerQueue( WorkerManager *wm, void (*foo)( void *), void *d, int hint )
+{
+	int i;
+	unsigned int first;
+	WorkerJob job;
+	
+	if( wm == NULL || wm->wm_Queues == NULL || wm->wm_Quit == TRUE )
+	{
+		return -1;
+	}
+	
+	job.wj_Function = foo;
+	job.wj_Data = d;
+	
+	if( hint < 0 )
+	{
+		// counter is shared by all callers, unsigned so index stays valid after wrap
+		first = __sync_fetch_and_add( &(wm->wm_NextQueue), 1 );
+	}
+	else
+	{
+		first = (unsigned int)hint;
+	}
+	
+	for( i=0 ; i < wm->wm_MaxWorkers ; i++ )
+	{
+		if( WorkerQueuePut( &(wm->wm_Queues[ ( first + i ) % (unsigned int)wm->wm_MaxWorkers ]), &job ) == TRUE )
+		{
+			if( FRIEND_MUTEX_LOCK( &wm->wm_Mutex ) == 0 )
+			{
+				wm->wm_Pending++;
+				pthread_cond_signal( &wm->wm_PendingCond );
+				FRIEND_MUTEX_UNLOCK( &wm->wm_Mutex );
+			}
+			return 0;
+		}
+	}
+	
+	__sync_fetch_and_add( &(wm->wm_Rejected), 1 );
+	Log( FLOG_ERROR, "[WorkerManagerQueue] All queues are full, job rejected\n");
+	
+	return -1;
+}
+
+/**
+ * Pool worker thread
+ *
+ * Every job is reserved first (wm_Pending), then taken from own queue or stolen from other worker queue.
+ * Worker quits when manager is stopped and all queued jobs are done.
+ *
+ * @param w pointer to Worker FThread
+ */
+void WorkerPoolThread( void *w )
+{
+	FThread *thread = (FThread *)w;
+	Worker *wrk = (Worker *)thread->t_Data;
+	WorkerManager *wm = (WorkerManager *)wrk->w_Manager;
+	
+	wrk->w_State = W_STATE_RUNNING;
+	wrk->w_ThreadPTR = pthread_self();
+	
+	while( TRUE )
+	{
+		WorkerJob job;
+		FBOOL reserved = FALSE;
+		int i;
+		
+		if( FRIEND_MUTEX_LOCK( &wm->wm_Mutex ) == 0 )
+		{
+			wrk->w_State = W_STATE_WAITING;
+			while( wm->wm_Pending == 0 && wm->wm_Quit == FALSE )
+			{
+				pthread_cond_wait( &wm->wm_PendingCond, &wm->wm_Mutex );
+			}
+			if( wm->wm_Pending > 0 )
+			{
+				wm->wm_Pending--;
+				reserved = TRUE;
+			}
+			FRIEND_MUTEX_UNLOCK( &wm->wm_Mutex );
+		}
+		
+		if( reserved == FALSE )
+		{
+			break;	// quit and nothing left to do
+		}
+		
+		// reserved job is in one of the queues, own queue first
+		while( TRUE )
+		{
+			if( WorkerQueueTake( &(wm->wm_Queues[ wrk->w_Nr ]), &job ) == TRUE )
+			{
+				break;
+			}
+			
+			for( i=1 ; i < wm->wm_MaxWorkers ; i++ )
+			{
+				if( WorkerQueueTake( &(wm->wm_Queues[ ( wrk->w_Nr + i ) % wm->wm_MaxWorkers ]), &job ) == TRUE )
+				{
+					__sync_fetch_and_add( &(wm->wm_Stolen), 1 );
+					break;
+				}
+			}
+			
+			if( i < wm->wm_MaxWorkers )
+			{
+				break;
+			}
+		}
+		
+		wrk->w_State = W_STATE_COMMAND_CALLED;
+		job.wj_Function( job.wj_Data );
+		__sync_fetch_and_add( &(wm->wm_Executed), 1 );
+	}
+	
+	wrk->w_Function = NULL;
+	wrk->w_Data = NULL;
+	wrk->w_State = W_STATE_TO_REMOVE;
+	thread->t_Launched = FALSE;
+}
+
 /*
 *
 * For debug
@@ -27,6 +27,29 @@
 #include "worker.h"
 #include "network/socket.h"
 
+//
+// Job waiting in worker pool queue
+//
+
+typedef struct WorkerJob
+{
+	void								(*wj_Function)( void *data );
+	void								*wj_Data;
+} WorkerJob;
+
+//
+// Bounded job queue. Every pool worker owns one, idle workers steal from others
+//
+
+typedef struct WorkerQueue
+{
+	WorkerJob							*wq_Jobs;				// ring buffer
+	int									wq_Size;				// capacity of ring buffer
+	int									wq_Head;				// position of oldest job
+	int									wq_Count;				// number of jobs in queue
+	pthread_mutex_t						wq_Mutex;
+} WorkerQueue;
+
 typedef struct WorkerManager
 {
 	Worker							**wm_Workers;			// array of  workers
@@ -35,6 +58,17 @@ typedef struct WorkerManager
 	pthread_mutex_t						wm_Mutex;
 	
 	float								w_AverageWorkSeconds;
+	
+	// pool mode
+	WorkerQueue							*wm_Queues;				// one queue per worker, NULL if manager was created by WorkerManagerNew
+	int									wm_QueueSize;			// maximum number of waiting jobs per queue
+	unsigned int						wm_NextQueue;			// round robin counter used when no hint is provided (atomic, wraps)
+	FULONG								wm_Pending;				// number of jobs waiting in all queues (protected by wm_Mutex)
+	FULONG								wm_Executed;			// number of jobs executed (statistics, atomic)
+	FULONG								wm_Stolen;				// number of jobs taken from other workers queue (statistics, atomic)
+	FULONG								wm_Rejected;			// number of jobs rejected because all queues were full (statistics, atomic)
+	pthread_cond_t						wm_PendingCond;			// signalled when new job is added
+	FBOOL								wm_Quit;
 } WorkerManager;
 
 //
@@ -43,6 +77,12 @@ typedef struct WorkerManager
 
 WorkerManager *WorkerManagerNew( int nr );
 
+//
+// Create worker manager which works as bounded pool
+//
+
+WorkerManager *WorkerManagerNewPool( int nr, int queueSize, size_t stackSize );
+
 //
 // Delete worker manager
 //
@@ -55,6 +95,12 @@ void WorkerManagerDelete( WorkerManager *wm );
 
 int WorkerManagerRun( WorkerManager *wm,  void (*foo)( void *), void *d, void *wrkinfo, char *path );
 
+//
+// add job to pool queue
+//
+
+int WorkerManagerQueue( WorkerManager *wm, void (*foo)( void *), void *d, int hint );
+
 //
 //
 //
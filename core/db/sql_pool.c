@@ -0,0 +1,638 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ *  SQL connection pool body
+ */
+
+#include "sql_pool.h"
+#include <core/library.h>
+#include <util/log/log.h>
+#include <util/string.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define SQL_POOL_AFFINITY_POOLS 4		// number of pools remembered by every thread
+
+//
+// last connection used by thread
+//
+
+typedef struct SQLPoolAffinity
+{
+	SQLPool					*spa_Pool;
+	int						spa_Slot;
+}SQLPoolAffinity;
+
+static __thread SQLPoolAffinity threadAffinity[ SQL_POOL_AFFINITY_POOLS ];
+
+/**
+ * Get current time in microseconds
+ *
+ * @return time in microseconds
+ */
+static FUQUAD SQLPoolTime( void )
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return (FUQUAD)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * Put slot on top of free stack. Must be called when pool is locked
+ *
+ * @param sp pointer to SQLPool
+ * @param slot slot number
+ */
+static void SQLPoolPushFree( SQLPool *sp, int slot )
+{
+	sp->sp_Connections[ slot ].sqlcp_FreePos = sp->sp_FreeCount;
+	sp->sp_Free[ sp->sp_FreeCount++ ] = slot;
+}
+
+/**
+ * Remove slot from free stack. Must be called when pool is locked
+ *
+ * @param sp pointer to SQLPool
+ * @param slot slot number
+ */
+static void SQLPoolRemoveFree( SQLPool *sp, int slot )
+{
+	int pos = sp->sp_Connections[ slot ].sqlcp_FreePos;
+	int last = sp->sp_Free[ --sp->sp_FreeCount ];
+
+	sp->sp_Free[ pos ] = last;
+	sp->sp_Connections[ last ].sqlcp_FreePos = pos;
+	sp->sp_Connections[ slot ].sqlcp_FreePos = -1;
+}
+
+/**
+ * Open new database connection
+ *
+ * @param sp pointer to SQLPool
+ * @param slot slot in which connection will be stored
+ * @return pointer to new connection or NULL when error appear
+ */
+static SQLLibrary *SQLPoolOpenConnection( SQLPool *sp, int slot )
+{
+	SQLLibrary *lib = (SQLLibrary *)LibraryOpen( sp->sp_SB, sp->sp_LibName, 0 );
+	if( lib == NULL )
+	{
+		FERROR("[SQLPoolOpenConnection] Cannot open %s\n", sp->sp_LibName );
+		return NULL;
+	}
+
+	if( sp->sp_Options != NULL )
+	{
+		// option parser modifies string
+		char *options = StringDuplicate( sp->sp_Options );
+		if( options != NULL )
+		{
+			lib->SetOption( lib, options );
+			FFree( options );
+		}
+	}
+
+	if( lib->Connect( lib, sp->sp_Host, sp->sp_DBName, sp->sp_Login, sp->sp_Password, sp->sp_Port ) != 0 )
+	{
+		FERROR("[SQLPoolOpenConnection] Pool %s cannot connect to %s:%d\n", sp->sp_Name, sp->sp_Host, sp->sp_Port );
+		LibraryClose( lib );
+		return NULL;
+	}
+
+	lib->l_PoolSlot = slot;
+	lib->l_Pool = sp;
+	lib->l_InUse = FALSE;
+
+	return lib;
+}
+
+/**
+ * Reconnect broken connections, ping idle connections and close connections above minimum which were not used for long time
+ *
+ * @param sp pointer to SQLPool, pool must be locked
+ * @param keepalive TRUE when idle connections should be pinged
+ * @return TRUE when some connection is still broken, otherwise FALSE
+ */
+static FBOOL SQLPoolCheck( SQLPool *sp, FBOOL keepalive )
+{
+	FBOOL broken = FALSE;
+	int i;
+
+	for( i=0 ; i < sp->sp_Max && sp->sp_Quit == FALSE ; i++ )
+	{
+		SQLConPool *con = &sp->sp_Connections[ i ];
+		SQLLibrary *lib = con->sqll_Sqllib;
+		time_t now = time( NULL );
+
+		if( lib == NULL )
+		{
+			continue;
+		}
+
+		if( con->sqlcp_Broken == TRUE )
+		{
+			pthread_mutex_unlock( &sp->sp_Mutex );
+			int error = lib->Reconnect( lib );
+			pthread_mutex_lock( &sp->sp_Mutex );
+
+			if( error == 0 )
+			{
+				Log( FLOG_INFO, "[SQLPoolCheck] Pool %s connection %d reconnected\n", sp->sp_Name, i );
+				lib->con.sql_Recconect = FALSE;
+				con->sqlcp_Broken = FALSE;
+				con->sqlcp_LastUse = now;
+				sp->sp_Stats.sps_Reconnects++;
+				sp->sp_Stats.sps_Broken--;
+				SQLPoolPushFree( sp, i );
+				pthread_cond_signal( &sp->sp_Cond );
+			}
+			else
+			{
+				broken = TRUE;
+			}
+			continue;
+		}
+
+		// only free connections are checked
+		if( con->sqlcp_FreePos < 0 )
+		{
+			continue;
+		}
+
+		if( sp->sp_Stats.sps_Opened > sp->sp_Min && sp->sp_IdleTimeout > 0 && ( now - con->sqlcp_LastUse ) >= sp->sp_IdleTimeout )
+		{
+			SQLPoolRemoveFree( sp, i );
+			con->sqll_Sqllib = NULL;
+			sp->sp_Stats.sps_Opened--;
+			sp->sp_Stats.sps_Closed++;
+
+			pthread_mutex_unlock( &sp->sp_Mutex );
+			DEBUG("[SQLPoolCheck] Pool %s closing idle connection %d\n", sp->sp_Name, i );
+			LibraryClose( lib );
+			pthread_mutex_lock( &sp->sp_Mutex );
+			continue;
+		}
+
+		if( keepalive == TRUE && lib->Ping != NULL && sp->sp_KeepAlive > 0 && ( now - con->sqlcp_LastUse ) >= sp->sp_KeepAlive )
+		{
+			// connection is taken from free stack for time of ping
+			SQLPoolRemoveFree( sp, i );
+			lib->l_InUse = TRUE;
+
+			pthread_mutex_unlock( &sp->sp_Mutex );
+			int error = lib->Ping( lib );
+			pthread_mutex_lock( &sp->sp_Mutex );
+
+			lib->l_InUse = FALSE;
+			con->sqlcp_LastUse = time( NULL );
+
+			if( error == 0 )
+			{
+				SQLPoolPushFree( sp, i );
+				pthread_cond_signal( &sp->sp_Cond );
+			}
+			else
+			{
+				Log( FLOG_ERROR, "[SQLPoolCheck] Pool %s connection %d does not respond\n", sp->sp_Name, i );
+				sp->sp_Stats.sps_PingFailures++;
+				sp->sp_Stats.sps_Broken++;
+				con->sqlcp_Broken = TRUE;
+				broken = TRUE;
+			}
+		}
+	}
+	return broken;
+}
+
+/**
+ * Pool maintenance thread
+ *
+ * @param data pointer to SQLPool
+ * @return NULL
+ */
+static void *SQLPoolThread( void *data )
+{
+	SQLPool *sp = (SQLPool *)data;
+	time_t nextKeepAlive = time( NULL ) + SQL_POOL_RETRY_TIME;
+	FBOOL broken = FALSE;
+
+	pthread_mutex_lock( &sp->sp_Mutex );
+
+	while( sp->sp_Quit == FALSE )
+	{
+		struct timespec ts;
+		clock_gettime( CLOCK_REALTIME, &ts );
+		ts.tv_sec += SQL_POOL_RETRY_TIME;
+
+		pthread_cond_timedwait( &sp->sp_CheckCond, &sp->sp_Mutex, &ts );
+		if( sp->sp_Quit == TRUE )
+		{
+			break;
+		}
+
+		time_t now = time( NULL );
+		FBOOL keepalive = ( now >= nextKeepAlive );
+
+		if( keepalive == TRUE || broken == TRUE || sp->sp_FreeCount + sp->sp_Stats.sps_InUse < sp->sp_Stats.sps_Opened )
+		{
+			broken = SQLPoolCheck( sp, keepalive );
+			if( keepalive == TRUE )
+			{
+				// idle connections are checked few times per keepalive period
+				nextKeepAlive = now + ( sp->sp_KeepAlive > 4 ? sp->sp_KeepAlive / 4 : 1 );
+			}
+		}
+	}
+
+	pthread_mutex_unlock( &sp->sp_Mutex );
+
+	return NULL;
+}
+
+/**
+ * Create pool and open minimum number of connections
+ *
+ * @param sb pointer to SystemBase
+ * @param name pool name used in logs
+ * @param libName name of SQL library
+ * @param host database host
+ * @param dbname database name
+ * @param login database user
+ * @param pass database user password
+ * @param port database port
+ * @param options library options or NULL
+ * @param min number of connections which are always opened
+ * @param max maximum number of connections
+ * @return pointer to new SQLPool or NULL when no connection could be opened
+ */
+SQLPool *SQLPoolNew( void *sb, const char *name, const char *libName, const char *host, const char *dbname, const char *login, const char *pass, int port, const char *options, int min, int max )
+{
+	SQLPool *sp;
+	int i;
+
+	if( min < 1 ) min = 1;
+	if( max < min ) max = min;
+
+	if( ( sp = FCalloc( 1, sizeof( SQLPool ) ) ) == NULL )
+	{
+		return NULL;
+	}
+
+	sp->sp_SB = sb;
+	sp->sp_Name = StringDuplicate( name );
+	sp->sp_LibName = StringDuplicate( libName );
+	sp->sp_Host = StringDuplicate( host );
+	sp->sp_DBName = StringDuplicate( dbname );
+	sp->sp_Login = StringDuplicate( login );
+	sp->sp_Password = StringDuplicate( pass );
+	sp->sp_Options = StringDuplicate( options );
+	sp->sp_Port = port;
+	sp->sp_Min = min;
+	sp->sp_Max = max;
+	sp->sp_Affinity = TRUE;
+	sp->sp_KeepAlive = SQL_POOL_KEEPALIVE;
+	sp->sp_IdleTimeout = SQL_POOL_IDLE_TIMEOUT;
+	sp->sp_Stats.sps_Min = min;
+	sp->sp_Stats.sps_Max = max;
+	sp->sp_Connections = FCalloc( max, sizeof( SQLConPool ) );
+	sp->sp_Free = FCalloc( max, sizeof( int ) );
+
+	pthread_mutex_init( &sp->sp_Mutex, NULL );
+	pthread_cond_init( &sp->sp_Cond, NULL );
+	pthread_cond_init( &sp->sp_CheckCond, NULL );
+
+	if( sp->sp_Connections == NULL || sp->sp_Free == NULL )
+	{
+		SQLPoolDelete( sp );
+		return NULL;
+	}
+
+	for( i=0 ; i < max ; i++ )
+	{
+		sp->sp_Connections[ i ].sql_ID = i;
+		sp->sp_Connections[ i ].sqlcp_FreePos = -1;
+	}
+
+	for( i=0 ; i < min ; i++ )
+	{
+		if( ( sp->sp_Connections[ i ].sqll_Sqllib = SQLPoolOpenConnection( sp, i ) ) == NULL )
+		{
+			SQLPoolDelete( sp );
+			return NULL;
+		}
+		sp->sp_Connections[ i ].sqlcp_LastUse = time( NULL );
+		sp->sp_Stats.sps_Opened++;
+		SQLPoolPushFree( sp, i );
+	}
+
+	if( pthread_create( &sp->sp_Thread, NULL, SQLPoolThread, sp ) == 0 )
+	{
+		sp->sp_ThreadStarted = TRUE;
+	}
+	else
+	{
+		FERROR("[SQLPoolNew] Cannot start pool thread, broken connections will not be restored\n");
+	}
+
+	Log( FLOG_INFO, "[SQLPoolNew] Pool %s created, connections %d - %d\n", sp->sp_Name, min, max );
+
+	return sp;
+}
+
+/**
+ * Close all connections and delete pool
+ *
+ * @param sp pointer to SQLPool
+ */
+void SQLPoolDelete( SQLPool *sp )
+{
+	int i;
+
+	if( sp == NULL )
+	{
+		return;
+	}
+
+	pthread_mutex_lock( &sp->sp_Mutex );
+	sp->sp_Quit = TRUE;
+	pthread_cond_broadcast( &sp->sp_Cond );
+	pthread_cond_broadcast( &sp->sp_CheckCond );
+	pthread_mutex_unlock( &sp->sp_Mutex );
+
+	if( sp->sp_ThreadStarted == TRUE )
+	{
+		pthread_join( sp->sp_Thread, NULL );
+	}
+
+	Log( FLOG_INFO, "[SQLPoolDelete] Pool %s gets: %lu, waits: %lu, wait time max: %lu us, in use max: %d, opened above minimum: %lu, reconnects: %lu\n",
+		sp->sp_Name, sp->sp_Stats.sps_Gets, sp->sp_Stats.sps_Waits, sp->sp_Stats.sps_WaitTimeMax, sp->sp_Stats.sps_InUseMax, sp->sp_Stats.sps_Created, sp->sp_Stats.sps_Reconnects );
+
+	if( sp->sp_Connections != NULL )
+	{
+		for( i=0 ; i < sp->sp_Max ; i++ )
+		{
+			if( sp->sp_Connections[ i ].sqll_Sqllib != NULL )
+			{
+				DEBUG( "[SQLPoolDelete] Closed mysql library slot %d\n", i );
+				LibraryClose( sp->sp_Connections[ i ].sqll_Sqllib );
+			}
+		}
+		FFree( sp->sp_Connections );
+	}
+
+	if( sp->sp_Free != NULL ) FFree( sp->sp_Free );
+	if( sp->sp_Name != NULL ) FFree( sp->sp_Name );
+	if( sp->sp_LibName != NULL ) FFree( sp->sp_LibName );
+	if( sp->sp_Host != NULL ) FFree( sp->sp_Host );
+	if( sp->sp_DBName != NULL ) FFree( sp->sp_DBName );
+	if( sp->sp_Login != NULL ) FFree( sp->sp_Login );
+	if( sp->sp_Password != NULL ) FFree( sp->sp_Password );
+	if( sp->sp_Options != NULL ) FFree( sp->sp_Options );
+
+	pthread_cond_destroy( &sp->sp_Cond );
+	pthread_cond_destroy( &sp->sp_CheckCond );
+	pthread_mutex_destroy( &sp->sp_Mutex );
+
+	FFree( sp );
+}
+
+/**
+ * Take connection from pool. Function waits when all connections are used and maximum was reached
+ *
+ * @param sp pointer to SQLPool
+ * @return pointer to SQLLibrary or NULL when pool is closed
+ */
+SQLLibrary *SQLPoolGet( SQLPool *sp )
+{
+	SQLPoolAffinity *aff = NULL;
+	FUQUAD waitStart = 0;
+	int slot = -1;
+	int i;
+
+	if( sp == NULL )
+	{
+		return NULL;
+	}
+
+	for( i=0 ; i < SQL_POOL_AFFINITY_POOLS ; i++ )
+	{
+		if( threadAffinity[ i ].spa_Pool == sp || threadAffinity[ i ].spa_Pool == NULL )
+		{
+			aff = &threadAffinity[ i ];
+			break;
+		}
+	}
+
+	pthread_mutex_lock( &sp->sp_Mutex );
+
+	sp->sp_Stats.sps_Gets++;
+
+	while( sp->sp_Quit == FALSE )
+	{
+		// connection used last time by this thread
+		if( sp->sp_Affinity == TRUE && aff != NULL && aff->spa_Pool == sp && sp->sp_Connections[ aff->spa_Slot ].sqlcp_FreePos >= 0 )
+		{
+			slot = aff->spa_Slot;
+			SQLPoolRemoveFree( sp, slot );
+			sp->sp_Stats.sps_AffinityHits++;
+			break;
+		}
+
+		// most recently used connection
+		if( sp->sp_FreeCount > 0 )
+		{
+			slot = sp->sp_Free[ sp->sp_FreeCount - 1 ];
+			SQLPoolRemoveFree( sp, slot );
+			break;
+		}
+
+		// all connections are used, new one is opened when maximum was not reached
+		if( sp->sp_Stats.sps_Opened + sp->sp_Opening < sp->sp_Max )
+		{
+			for( i=0 ; i < sp->sp_Max ; i++ )
+			{
+				if( sp->sp_Connections[ i ].sqll_Sqllib == NULL && sp->sp_Connections[ i ].sqlcp_FreePos == -1 && sp->sp_Connections[ i ].sqlcp_Broken == FALSE )
+				{
+					break;
+				}
+			}
+
+			if( i < sp->sp_Max )
+			{
+				// slot is reserved by broken flag until connection is opened
+				sp->sp_Connections[ i ].sqlcp_Broken = TRUE;
+				sp->sp_Opening++;
+				pthread_mutex_unlock( &sp->sp_Mutex );
+
+				SQLLibrary *lib = SQLPoolOpenConnection( sp, i );
+
+				pthread_mutex_lock( &sp->sp_Mutex );
+				sp->sp_Opening--;
+				sp->sp_Connections[ i ].sqlcp_Broken = FALSE;
+
+				if( lib != NULL )
+				{
+					sp->sp_Connections[ i ].sqll_Sqllib = lib;
+					sp->sp_Stats.sps_Opened++;
+					sp->sp_Stats.sps_Created++;
+					slot = i;
+					DEBUG("[SQLPoolGet] Pool %s opened connection %d, opened %d\n", sp->sp_Name, i, sp->sp_Stats.sps_Opened );
+					break;
+				}
+
+				// connection could be returned while lock was released, its signal was not seen by this thread
+				if( sp->sp_FreeCount > 0 )
+				{
+					continue;
+				}
+			}
+		}
+
+		if( waitStart == 0 )
+		{
+			waitStart = SQLPoolTime();
+			sp->sp_Stats.sps_Waits++;
+		}
+
+		struct timespec ts;
+		clock_gettime( CLOCK_REALTIME, &ts );
+		ts.tv_sec += SQL_POOL_WAIT_WARNING;
+
+		sp->sp_Stats.sps_Waiting++;
+		int rc = pthread_cond_timedwait( &sp->sp_Cond, &sp->sp_Mutex, &ts );
+		sp->sp_Stats.sps_Waiting--;
+
+		if( rc == ETIMEDOUT )
+		{
+			Log( FLOG_ERROR, "[SQLPoolGet] Pool %s: all %d connections are busy, waiting %lu ms\n", sp->sp_Name, sp->sp_Stats.sps_Opened, (FULONG)( ( SQLPoolTime() - waitStart ) / 1000 ) );
+		}
+	}
+
+	if( slot < 0 )
+	{
+		pthread_mutex_unlock( &sp->sp_Mutex );
+		return NULL;
+	}
+
+	if( waitStart != 0 )
+	{
+		FUQUAD waited = SQLPoolTime() - waitStart;
+		sp->sp_Stats.sps_WaitTime += waited;
+		if( waited > sp->sp_Stats.sps_WaitTimeMax )
+		{
+			sp->sp_Stats.sps_WaitTimeMax = waited;
+		}
+	}
+
+	sp->sp_Stats.sps_InUse++;
+	if( sp->sp_Stats.sps_InUse > sp->sp_Stats.sps_InUseMax )
+	{
+		sp->sp_Stats.sps_InUseMax = sp->sp_Stats.sps_InUse;
+	}
+
+	SQLLibrary *lib = sp->sp_Connections[ slot ].sqll_Sqllib;
+	lib->l_InUse = TRUE;
+
+	pthread_mutex_unlock( &sp->sp_Mutex );
+
+	if( aff != NULL )
+	{
+		aff->spa_Pool = sp;
+		aff->spa_Slot = slot;
+	}
+
+	return lib;
+}
+
+/**
+ * Return connection to pool. Broken connection is passed to pool thread for reconnection
+ *
+ * @param sp pointer to SQLPool
+ * @param lib pointer to SQLLibrary taken by SQLPoolGet
+ */
+void SQLPoolDrop( SQLPool *sp, SQLLibrary *lib )
+{
+	if( sp == NULL || lib == NULL )
+	{
+		return;
+	}
+
+	pthread_mutex_lock( &sp->sp_Mutex );
+
+	if( lib->l_InUse == TRUE && lib->l_PoolSlot >= 0 && lib->l_PoolSlot < sp->sp_Max && sp->sp_Connections[ lib->l_PoolSlot ].sqll_Sqllib == lib )
+	{
+		SQLConPool *con = &sp->sp_Connections[ lib->l_PoolSlot ];
+
+		lib->l_InUse = FALSE;
+		con->sqlcp_LastUse = time( NULL );
+		sp->sp_Stats.sps_InUse--;
+
+		if( lib->con.sql_Recconect == TRUE )
+		{
+			con->sqlcp_Broken = TRUE;
+			sp->sp_Stats.sps_Broken++;
+			pthread_cond_signal( &sp->sp_CheckCond );
+		}
+		else
+		{
+			SQLPoolPushFree( sp, lib->l_PoolSlot );
+			pthread_cond_signal( &sp->sp_Cond );
+		}
+	}
+	else
+	{
+		DEBUG( "[SQLPoolDrop] Pool %s connection %p was not taken from pool\n", sp->sp_Name, lib );
+	}
+
+	pthread_mutex_unlock( &sp->sp_Mutex );
+}
+
+/**
+ * Get pool statistics
+ *
+ * @param sp pointer to SQLPool
+ * @param st pointer to structure where statistics will be stored
+ */
+void SQLPoolGetStats( SQLPool *sp, SQLPoolStats *st )
+{
+	if( sp == NULL )
+	{
+		memset( st, 0, sizeof( SQLPoolStats ) );
+		return;
+	}
+
+	pthread_mutex_lock( &sp->sp_Mutex );
+	*st = sp->sp_Stats;
+	pthread_mutex_unlock( &sp->sp_Mutex );
+}
+
+/**
+ * Check if pool has at least one working connection. Used to decide if queries should be sent to other pool
+ *
+ * @param sp pointer to SQLPool
+ * @return TRUE when some connection is opened and not broken, otherwise FALSE
+ */
+FBOOL SQLPoolIsAvailable( SQLPool *sp )
+{
+	FBOOL available;
+
+	if( sp == NULL )
+	{
+		return FALSE;
+	}
+
+	pthread_mutex_lock( &sp->sp_Mutex );
+	available = ( sp->sp_Quit == FALSE && sp->sp_Stats.sps_Opened > sp->sp_Stats.sps_Broken );
+	pthread_mutex_unlock( &sp->sp_Mutex );
+
+	return available;
+}
@@ -0,0 +1,141 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ *  SQL connection pool
+ *
+ *  Free connections are kept on stack, most recently used one on top.
+ *  Threads which do not find free connection open new one (up to maximum)
+ *  or sleep on condition variable until connection is returned.
+ *  Background thread reconnects broken connections, pings idle ones
+ *  and closes connections above minimum which were not used for long time.
+ */
+
+#ifndef __DB_SQL_POOL_H__
+#define __DB_SQL_POOL_H__
+
+#include <core/types.h>
+#include <db/sqllib.h>
+#include <pthread.h>
+
+#define SQL_POOL_KEEPALIVE 60			// seconds after which idle connection is pinged
+#define SQL_POOL_IDLE_TIMEOUT 300		// seconds after which idle connection above minimum is closed
+#define SQL_POOL_RETRY_TIME 1			// seconds between reconnection attempts
+#define SQL_POOL_WAIT_WARNING 5			// seconds of waiting for connection after which warning is logged
+
+//
+// connection slot
+//
+
+typedef struct SQLConPool
+{
+	int				sql_ID;			// ID
+	SQLLibrary		*sqll_Sqllib;	// pointer to library, NULL when slot is not used
+	int				sqlcp_FreePos;	// position on free stack, -1 when connection is not free
+	FBOOL			sqlcp_Broken;	// waits for reconnection
+	time_t			sqlcp_LastUse;
+}SQLConPool;
+
+//
+// statistics
+//
+
+typedef struct SQLPoolStats
+{
+	int						sps_Opened;			// connections opened now
+	int						sps_InUse;
+	int						sps_InUseMax;
+	int						sps_Waiting;		// threads waiting now
+	int						sps_Min;
+	int						sps_Max;
+	FUQUAD					sps_Gets;
+	FUQUAD					sps_Waits;			// gets which had to wait
+	FUQUAD					sps_WaitTime;		// microseconds, sum of all waits
+	FUQUAD					sps_WaitTimeMax;	// microseconds
+	FUQUAD					sps_AffinityHits;	// thread got connection which it used last time
+	FUQUAD					sps_Created;		// connections opened above minimum
+	FUQUAD					sps_Closed;			// idle connections closed
+	FUQUAD					sps_Reconnects;
+	FUQUAD					sps_PingFailures;
+	int						sps_Broken;			// connections waiting for reconnection
+}SQLPoolStats;
+
+//
+// pool
+//
+
+typedef struct SQLPool
+{
+	void					*sp_SB;
+	char					*sp_Name;			// name used in logs
+	char					*sp_LibName;
+	char					*sp_Host;
+	char					*sp_DBName;
+	char					*sp_Login;
+	char					*sp_Password;
+	char					*sp_Options;
+	int						sp_Port;
+
+	SQLConPool				*sp_Connections;	// sp_Max slots
+	int						sp_Min;
+	int						sp_Max;
+	int						sp_Opening;			// connections which are being opened
+	int						*sp_Free;			// stack of free slots
+	int						sp_FreeCount;
+	FBOOL					sp_Affinity;		// thread gets connection which it used last time when it is free
+	int						sp_KeepAlive;		// seconds
+	int						sp_IdleTimeout;		// seconds
+
+	FBOOL					sp_Quit;
+	pthread_t				sp_Thread;
+	FBOOL					sp_ThreadStarted;
+	pthread_mutex_t			sp_Mutex;
+	pthread_cond_t			sp_Cond;			// connection was returned
+	pthread_cond_t			sp_CheckCond;		// broken connection was returned
+	SQLPoolStats			sp_Stats;
+}SQLPool;
+
+//
+// create pool and open minimum number of connections
+//
+
+SQLPool *SQLPoolNew( void *sb, const char *name, const char *libName, const char *host, const char *dbname, const char *login, const char *pass, int port, const char *options, int min, int max );
+
+//
+// close all connections and delete pool
+//
+
+void SQLPoolDelete( SQLPool *sp );
+
+//
+// get connection, waits when all connections are used
+//
+
+SQLLibrary *SQLPoolGet( SQLPool *sp );
+
+//
+// return connection to pool
+//
+
+void SQLPoolDrop( SQLPool *sp, SQLLibrary *lib );
+
+//
+// check if pool has at least one working connection
+//
+
+FBOOL SQLPoolIsAvailable( SQLPool *sp );
+
+//
+// get pool statistics
+//
+
+void SQLPoolGetStats( SQLPool *sp, SQLPoolStats *st );
+
+#endif // __DB_SQL_POOL_H__
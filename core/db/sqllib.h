@@ -89,9 +89,15 @@ typedef struct SQLLibrary
 	int						(*SetOption)( struct SQLLibrary *l, char *params );
 	char					*(*MakeEscapedString)( struct SQLLibrary *l, char *str );
 	int						(*GetStatus)( struct Library *l );
+	int						(*CompileDescriptor)( struct SQLLibrary *l, const FULONG *descr );	// optional, descriptor is compiled on first use otherwise
+	int						(*Ping)( struct SQLLibrary *l );	// optional, 0 when connection is alive
+	void					*(*LoadParams)( struct SQLLibrary *l, const FULONG *descr, const char *where, const FULONG *params, int *entries );	// '?' in where for every parameter, params: SQLT_INT/SQLT_LONG/SQLT_STR, value pairs closed by SQLT_END
 
 	SQLConnection con;
 	void					*sd;	// special data
+	int						l_PoolSlot;	// slot in SQLPool
+	void					*l_Pool;	// SQLPool which owns connection
+	FBOOL					l_Written;	// set by library when query modified data, cleared when connection returns to pool
 	
 } SQLLibrary;
 
@@ -22,6 +22,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 #include "network/http.h"
 #include "util/string.h"
 #include <util/log/log.h>
@@ -2237,6 +2239,489 @@ void HttpAddTextContent( Http* http, char* content )
 	HttpAddHeader( http, HTTP_HEADER_CONTENT_LENGTH, Httpsprintf( "%ld", (unsigned long int)http->http_SizeOfContent ) );
 }
 
+/**
+ * Create strong entity tag from file path hash, modification time and size
+ *
+ * @param hash pointer to 128bit hash (murmur) of file path
+ * @param mtime file modification timestamp
+ * @param size file size (0 when not known)
+ * @param suffix representation name (for example content encoding) or NULL
+ * @return new allocated entity tag (with quotes) or NULL when error appear
+ */
+
+char *HttpCreateETag( uint64_t *hash, time_t mtime, FULONG size, const char *suffix )
+{
+	char *etag = FMalloc( 128 );
+	if( etag != NULL )
+	{
+		snprintf( etag, 128, "\"%016llx%016llx-%lx-%lx%s%s\"", (unsigned long long)hash[ 0 ], (unsigned long long)hash[ 1 ], (unsigned long)mtime, (unsigned long)size, suffix != NULL ? "-" : "", suffix != NULL ? suffix : "" );
+	}
+	return etag;
+}
+
+static const char *HTTP_DAY_NAMES[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+static const char *HTTP_MONTH_NAMES[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+/**
+ * Format date in HTTP format (IMF-fixdate), locale independent
+ *
+ * @param t timestamp
+ * @return new allocated string or NULL when error appear
+ */
+
+char *HttpFormatDate( time_t t )
+{
+	struct tm tm;
+	if( gmtime_r( &t, &tm ) == NULL )
+	{
+		return NULL;
+	}
+	
+	char *date = FMalloc( 32 );
+	if( date != NULL )
+	{
+		snprintf( date, 32, "%s, %02d %s %04d %02d:%02d:%02d GMT", HTTP_DAY_NAMES[ tm.tm_wday ], tm.tm_mday, HTTP_MONTH_NAMES[ tm.tm_mon ], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec );
+	}
+	return date;
+}
+
+/**
+ * Parse HTTP date. Header parser split values on comma, so day name could be already removed.
+ *
+ * @param date date string ("Sun, 06 Nov 1994 08:49:37 GMT" or "06 Nov 1994 08:49:37 GMT")
+ * @return timestamp or 0 when date cannot be parsed
+ */
+
+static time_t HttpParseDate( const char *date )
+{
+	char month[ 4 ];
+	int day, year, hour, min, sec, m;
+	
+	const char *comma = strchr( date, ',' );
+	if( comma != NULL )
+	{
+		date = comma + 1;
+	}
+	
+	if( sscanf( date, " %d %3s %d %d:%d:%d", &day, month, &year, &hour, &min, &sec ) != 6 )
+	{
+		return 0;
+	}
+	
+	for( m = 0; m < 12; m++ )
+	{
+		if( strcmp( month, HTTP_MONTH_NAMES[ m ] ) == 0 )
+		{
+			break;
+		}
+	}
+	if( m == 12 || year < 1970 )
+	{
+		return 0;
+	}
+	
+	// days from civil date (UTC), timegm is not available in POSIX
+	int y = year - ( m < 2 );
+	int era = y / 400;
+	int yoe = y - era * 400;
+	int doy = ( 153 * ( m + ( m > 1 ? -2 : 10 ) ) + 2 ) / 5 + day - 1;
+	int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	long days = (long)era * 146097 + doe - 719468;
+	
+	return (time_t)( days * 86400 + hour * 3600 + min * 60 + sec );
+}
+
+/**
+ * Compare entity tag from If-None-Match with current one (weak comparison)
+ *
+ * @param candidate entity tag sent by client
+ * @param etag current entity tag
+ * @return TRUE when tags are the same, otherwise FALSE
+ */
+
+static FBOOL HttpETagMatch( const char *candidate, const char *etag )
+{
+	while( *candidate == ' ' || *candidate == '\t' )
+	{
+		candidate++;
+	}
+	if( *candidate == '*' )
+	{
+		return TRUE;
+	}
+	if( strncmp( candidate, "W/", 2 ) == 0 )
+	{
+		candidate += 2;
+	}
+	
+	// quotes could be removed by header parser, only opaque part is compared
+	if( *candidate == '"' )
+	{
+		candidate++;
+	}
+	if( *etag == '"' )
+	{
+		etag++;
+	}
+	int len = strlen( etag );
+	if( len > 0 && etag[ len-1 ] == '"' )
+	{
+		len--;
+	}
+	
+	if( len == 0 || strncmp( candidate, etag, len ) != 0 )
+	{
+		return FALSE;
+	}
+	return ( candidate[ len ] == 0 || candidate[ len ] == '"' || candidate[ len ] == ' ' );
+}
+
+/**
+ * Check if client already has current version of resource (If-None-Match / If-Modified-Since)
+ *
+ * @param request http request
+ * @param etag current entity tag or NULL
+ * @param mtime current modification timestamp or 0
+ * @return TRUE when 304 Not Modified can be returned, otherwise FALSE
+ */
+
+FBOOL HttpIsNotModified( Http *request, const char *etag, time_t mtime )
+{
+	if( request == NULL )
+	{
+		return FALSE;
+	}
+	
+	// If-None-Match takes precedence over If-Modified-Since
+	List *l = HttpGetHeaderList( request, "if-none-match" );
+	if( l != NULL )
+	{
+		if( etag == NULL )
+		{
+			return FALSE;
+		}
+		while( l != NULL )
+		{
+			if( l->l_Data != NULL && HttpETagMatch( (char *)l->l_Data, etag ) == TRUE )
+			{
+				return TRUE;
+			}
+			l = l->next;
+		}
+		return FALSE;
+	}
+	
+	if( mtime <= 0 )
+	{
+		return FALSE;
+	}
+	
+	l = HttpGetHeaderList( request, "if-modified-since" );
+	while( l != NULL )
+	{
+		if( l->l_Data != NULL )
+		{
+			time_t since = HttpParseDate( (char *)l->l_Data );
+			if( since > 0 )
+			{
+				return ( mtime <= since );
+			}
+		}
+		l = l->next;
+	}
+	return FALSE;
+}
+
+/**
+ * Add ETag and Last-Modified headers to response
+ *
+ * @param response http response
+ * @param etag entity tag (copy is made) or NULL
+ * @param mtime modification timestamp or 0
+ */
+
+void HttpAddCacheValidators( Http *response, const char *etag, time_t mtime )
+{
+	if( etag != NULL )
+	{
+		HttpAddHeader( response, HTTP_HEADER_ETAG, StringDuplicate( etag ) );
+	}
+	if( mtime > 0 )
+	{
+		char *date = HttpFormatDate( mtime );
+		if( date != NULL )
+		{
+			HttpAddHeader( response, HTTP_HEADER_LAST_MODIFIED, date );
+		}
+	}
+}
+
+/**
+ * Check if If-Range header allows to send ranges
+ *
+ * @param request http request
+ * @param etag current entity tag or NULL
+ * @param mtime current modification timestamp or 0
+ * @return TRUE when ranges can be sent, otherwise FALSE
+ */
+
+static FBOOL HttpIfRangeValid( Http *request, const char *etag, time_t mtime )
+{
+	List *l = HttpGetHeaderList( request, "if-range" );
+	if( l == NULL )
+	{
+		return TRUE;
+	}
+	
+	char *value = (char *)l->l_Data;
+	if( value == NULL )
+	{
+		return FALSE;
+	}
+	while( *value == ' ' )
+	{
+		value++;
+	}
+	
+	// entity tag, weak tags cannot be used with ranges
+	if( value[ 0 ] == '"' || strncmp( value, "W/", 2 ) == 0 )
+	{
+		return ( etag != NULL && value[ 0 ] == '"' && HttpETagMatch( value, etag ) == TRUE );
+	}
+	
+	// date must be exactly the same as last modification date
+	while( l != NULL )
+	{
+		if( l->l_Data != NULL )
+		{
+			time_t since = HttpParseDate( (char *)l->l_Data );
+			if( since > 0 )
+			{
+				return ( mtime > 0 && since == mtime );
+			}
+		}
+		l = l->next;
+	}
+	return FALSE;
+}
+
+/**
+ * Parse Range header. Header parser split values on comma, so every range is separate entry in list.
+ *
+ * @param request http request
+ * @param size size of whole content
+ * @param etag current entity tag or NULL (used by If-Range)
+ * @param mtime current modification timestamp or 0 (used by If-Range)
+ * @param ranges pointer to table where ranges will be stored
+ * @param max size of ranges table
+ * @return number of ranges, 0 when whole content should be sent, -1 when range cannot be satisfied (416)
+ */
+
+int HttpParseRange( Http *request, FQUAD size, const char *etag, time_t mtime, HttpRange *ranges, int max )
+{
+	if( request == NULL || size <= 0 )
+	{
+		return 0;
+	}
+	
+	List *l = HttpGetHeaderList( request, "range" );
+	if( l == NULL || HttpIfRangeValid( request, etag, mtime ) == FALSE )
+	{
+		return 0;
+	}
+	
+	int count = 0;
+	int entry = 0;
+	FBOOL unsatisfiable = FALSE;
+	
+	for( ; l != NULL ; l = l->next, entry++ )
+	{
+		char *spec = (char *)l->l_Data;
+		if( spec == NULL )
+		{
+			continue;
+		}
+		while( *spec == ' ' || *spec == '\t' )
+		{
+			spec++;
+		}
+		
+		// only bytes unit is supported
+		if( entry == 0 )
+		{
+			if( strncasecmp( spec, "bytes=", 6 ) != 0 )
+			{
+				return 0;
+			}
+			spec += 6;
+		}
+		
+		FQUAD start, end;
+		char *next = NULL;
+		
+		if( *spec == '-' )		// suffix, last N bytes
+		{
+			FQUAD suffix = strtoll( spec + 1, &next, 10 );
+			if( next == spec + 1 || suffix < 0 )
+			{
+				return 0;
+			}
+			if( suffix == 0 )
+			{
+				unsatisfiable = TRUE;
+				continue;
+			}
+			start = ( suffix >= size ) ? 0 : size - suffix;
+			end = size - 1;
+		}
+		else
+		{
+			start = strtoll( spec, &next, 10 );
+			if( next == spec || *next != '-' || start < 0 )
+			{
+				return 0;
+			}
+			spec = next + 1;
+			if( *spec >= '0' && *spec <= '9' )
+			{
+				end = strtoll( spec, &next, 10 );
+				if( end < start )
+				{
+					return 0;
+				}
+			}
+			else
+			{
+				end = size - 1;
+			}
+			
+			if( start >= size )
+			{
+				unsatisfiable = TRUE;
+				continue;
+			}
+			if( end >= size )
+			{
+				end = size - 1;
+			}
+		}
+		
+		// too many ranges, whole content is cheaper
+		if( count >= max )
+		{
+			return 0;
+		}
+		ranges[ count ].hr_Start = start;
+		ranges[ count ].hr_End = end;
+		count++;
+	}
+	
+	if( count == 0 && unsatisfiable == TRUE )
+	{
+		return -1;
+	}
+	return count;
+}
+
+/**
+ * Write response with whole content (200), one range (206), many ranges (206 multipart/byteranges)
+ * or error when range cannot be satisfied (416). Response headers should be set before call.
+ *
+ * @param response http response (headers only, no content)
+ * @param sock socket to which response will be written
+ * @param size size of whole content
+ * @param ranges table of ranges returned by HttpParseRange
+ * @param count value returned by HttpParseRange
+ * @param sendFunc function which sends part of content to socket
+ * @param data pointer passed to sendFunc
+ * @return number of content bytes sent
+ */
+
+FQUAD HttpWriteRanges( Http *response, Socket *sock, FQUAD size, HttpRange *ranges, int count, HttpRangeSendFunc sendFunc, void *data )
+{
+	FQUAD sent = 0;
+	
+	HttpAddHeader( response, HTTP_HEADER_ACCEPT_RANGES, StringDuplicate( "bytes" ) );
+	
+	if( count < 0 )
+	{
+		HttpSetCode( response, HTTP_416_REQUESTED_RANGE_NOT_SATISFIABLE );
+		HttpAddHeader( response, HTTP_HEADER_CONTENT_RANGE, Httpsprintf( "bytes */%lld", (long long)size ) );
+		HttpAddHeader( response, HTTP_HEADER_CONTENT_LENGTH, StringDuplicate( "0" ) );
+		HttpWrite( response, sock );
+	}
+	else if( count == 0 )
+	{
+		HttpAddHeader( response, HTTP_HEADER_CONTENT_LENGTH, Httpsprintf( "%lld", (long long)size ) );
+		HttpWrite( response, sock );
+		sent = sendFunc( data, sock, 0, size );
+	}
+	else if( count == 1 )
+	{
+		FQUAD length = ranges[ 0 ].hr_End - ranges[ 0 ].hr_Start + 1;
+		
+		HttpSetCode( response, HTTP_206_PARTIAL_CONTENT );
+		HttpAddHeader( response, HTTP_HEADER_CONTENT_RANGE, Httpsprintf( "bytes %lld-%lld/%lld", (long long)ranges[ 0 ].hr_Start, (long long)ranges[ 0 ].hr_End, (long long)size ) );
+		HttpAddHeader( response, HTTP_HEADER_CONTENT_LENGTH, Httpsprintf( "%lld", (long long)length ) );
+		HttpWrite( response, sock );
+		sent = sendFunc( data, sock, ranges[ 0 ].hr_Start, length );
+	}
+	else
+	{
+		char boundary[ 48 ];
+		char part[ 640 ];
+		int i;
+		
+		snprintf( boundary, sizeof(boundary), "FRIENDRANGE%08lx%08x", (unsigned long)time( NULL ), (unsigned int)rand() );
+		
+		char *partType = StringDuplicate( response->http_RespHeaders[ HTTP_HEADER_CONTENT_TYPE ] != NULL ? response->http_RespHeaders[ HTTP_HEADER_CONTENT_TYPE ] : "application/octet-stream" );
+		// part header must fit in buffer, otherwise sent part would not match Content-Length
+		if( partType != NULL && strlen( partType ) > 256 )
+		{
+			partType[ 256 ] = 0;
+		}
+		
+		// whole body length must be known before headers are sent
+		FQUAD total = 0;
+		for( i = 0 ; i < count ; i++ )
+		{
+			total += snprintf( part, sizeof(part), "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n", boundary, partType, (long long)ranges[ i ].hr_Start, (long long)ranges[ i ].hr_End, (long long)size );
+			total += ranges[ i ].hr_End - ranges[ i ].hr_Start + 1;
+		}
+		int endLength = snprintf( part, sizeof(part), "\r\n--%s--\r\n", boundary );
+		total += endLength;
+		
+		HttpSetCode( response, HTTP_206_PARTIAL_CONTENT );
+		HttpAddHeader( response, HTTP_HEADER_CONTENT_TYPE, Httpsprintf( "multipart/byteranges; boundary=%s", boundary ) );
+		HttpAddHeader( response, HTTP_HEADER_CONTENT_LENGTH, Httpsprintf( "%lld", (long long)total ) );
+		HttpWrite( response, sock );
+		
+		for( i = 0 ; i < count ; i++ )
+		{
+			FQUAD length = ranges[ i ].hr_End - ranges[ i ].hr_Start + 1;
+			int partLength = snprintf( part, sizeof(part), "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n", boundary, partType, (long long)ranges[ i ].hr_Start, (long long)ranges[ i ].hr_End, (long long)size );
+			if( partLength >= (int)sizeof(part) )
+			{
+				partLength = sizeof(part) - 1;
+			}
+			
+			sock->s_Interface->SocketWrite( sock, part, partLength );
+			FQUAD res = sendFunc( data, sock, ranges[ i ].hr_Start, length );
+			if( res != length )
+			{
+				break;
+			}
+			sent += res;
+		}
+		snprintf( part, sizeof(part), "\r\n--%s--\r\n", boundary );
+		sock->s_Interface->SocketWrite( sock, part, endLength );
+		
+		FFree( partType );
+	}
+	
+	return sent;
+}
+
 /**
  * build Http request string from Http request
  *
@@ -74,6 +74,12 @@ enum {
 	HTTP_HEADER_RANGE,
 	HTTP_HEADER_X_FRAME_OPTIONS,
 	HTTP_HEADER_UPGRADE,
+	HTTP_HEADER_KEEP_ALIVE,
+	HTTP_HEADER_CONTENT_ENCODING,
+	HTTP_HEADER_VARY,
+	HTTP_HEADER_ETAG,
+	HTTP_HEADER_LAST_MODIFIED,
+	HTTP_HEADER_CONTENT_RANGE,
 	HTTP_HEADER_END
 };
 
@@ -106,7 +112,13 @@ static const char *HEADERS[] = {
 	"depth",
 	"range",
 	"x-frame-options",
-	"upgrade"
+	"upgrade",
+	"keep-alive",
+	"content-encoding",
+	"vary",
+	"etag",
+	"last-modified",
+	"content-range"
 };
 
 //
@@ -474,6 +486,60 @@ void HttpAddTextContent( Http* http, char* content );
 
 void HttpSetContent( Http*, char* data, unsigned int length );
 
+//
+// Conditional requests (ETag / Last-Modified)
+//
+
+char *HttpCreateETag( uint64_t *hash, time_t mtime, FULONG size, const char *suffix );
+
+//
+//
+//
+
+char *HttpFormatDate( time_t t );
+
+//
+//
+//
+
+FBOOL HttpIsNotModified( Http *request, const char *etag, time_t mtime );
+
+//
+//
+//
+
+void HttpAddCacheValidators( Http *response, const char *etag, time_t mtime );
+
+//
+// Byte ranges (Range / If-Range, 206 / 416)
+//
+
+#define HTTP_MAX_RANGES		16		// more ranges in one request are ignored and whole content is sent
+
+typedef struct HttpRange
+{
+	FQUAD		hr_Start;
+	FQUAD		hr_End;		// inclusive
+} HttpRange;
+
+//
+// function which sends part of content to socket, used by HttpWriteRanges
+//
+
+typedef FQUAD (*HttpRangeSendFunc)( void *data, Socket *sock, FQUAD offset, FQUAD length );
+
+//
+//
+//
+
+int HttpParseRange( Http *request, FQUAD size, const char *etag, time_t mtime, HttpRange *ranges, int max );
+
+//
+//
+//
+
+FQUAD HttpWriteRanges( Http *response, Socket *sock, FQUAD size, HttpRange *ranges, int count, HttpRangeSendFunc sendFunc, void *data );
+
 //
 // Build the HTTP response
 //
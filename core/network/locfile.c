@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 #include <network/locfile.h>
 #include <util/string.h>
 #include <util/buffered_string.h>
@@ -34,6 +36,7 @@
 #include <errno.h>
 
 #include <hardware/machine_info.h>
+#include <zlib.h>
 
 #if LOCFILE_USE_MMAP == 0
 #include <sys/mman.h>
@@ -150,6 +153,7 @@ LocFile* LocFileNew( char* path, unsigned int flags )
 		MURMURHASH3( fo->lf_Path, fo->lf_PathLength, fo->hash );
 		
 		memcpy(  &(fo->lf_Info),  &st, sizeof( struct stat) );
+		fo->lf_ModificationTimestamp = st.st_mtime;
 
 		fseek( fp, 0, SEEK_END );
 		long fsize = ftell( fp );
@@ -216,6 +220,7 @@ LocFile* LocFileNewFromBuf( char* path, BufString *bs )
 		//DEBUG("PATH: %s \n", fo->lf_Path );
 
 		fo->lf_FileSize = bs->bs_Size;
+		fo->lf_ModificationTimestamp = time( NULL );	// content is created now
 		
 		if( ( fo->lf_Buffer = FMalloc( fo->lf_FileSize ) ) != NULL )
 		{
@@ -247,6 +252,19 @@ int LocFileReload( LocFile *file, char *path )
 		FFree( file->lf_Buffer );
 		file->lf_Buffer = NULL;
 	}
+	if( file->lf_GzipBuffer != NULL )
+	{
+		FFree( file->lf_GzipBuffer );
+		file->lf_GzipBuffer = NULL;
+		file->lf_GzipSize = 0;
+	}
+	if( file->lf_BrotliBuffer != NULL )
+	{
+		FFree( file->lf_BrotliBuffer );
+		file->lf_BrotliBuffer = NULL;
+		file->lf_BrotliSize = 0;
+	}
+	file->lf_EncodingsReady = FALSE;
 	
 	FILE* fp = fopen( path, "rb" );
 	if( fp == NULL )
@@ -262,6 +280,7 @@ int LocFileReload( LocFile *file, char *path )
 		return -2;
 	}
 	memcpy(  &(file->lf_Info),  &st, sizeof(stat) );
+	file->lf_ModificationTimestamp = st.st_mtime;
 	
 	fseek( fp, 0, SEEK_END );
 	long fsize = ftell( fp );
@@ -320,6 +339,16 @@ void LocFileDelete( LocFile* file )
 		FFree( file->lf_Mime );
 		file->lf_Mime = NULL;
 	}
+	if( file->lf_GzipBuffer != NULL )
+	{
+		FFree( file->lf_GzipBuffer );
+		file->lf_GzipBuffer = NULL;
+	}
+	if( file->lf_BrotliBuffer != NULL )
+	{
+		FFree( file->lf_BrotliBuffer );
+		file->lf_BrotliBuffer = NULL;
+	}
 
 	FFree( file );	
 }
@@ -397,6 +426,214 @@ char * GetExtension( char* name )
 	return extension;
 }
 
+//
+// extensions of files which are already compressed
+//
+
+static const char *LOCFILE_COMPRESSED_EXTENSIONS[] = {
+	"png", "jpg", "jpeg", "gif", "webp", "ico", "woff", "woff2", "zip", "gz", "br", "bz2", "xz", "7z",
+	"mp3", "mp4", "ogg", "ogv", "webm", "m4a", "pdf", "jar", NULL
+};
+
+/**
+ * Check if file content should be compressed
+ *
+ * @param file pointer to LocFile
+ * @return TRUE when file can be compressed, otherwise FALSE
+ */
+static FBOOL LocFileIsCompressible( LocFile *file )
+{
+	if( file->lf_Path == NULL )
+	{
+		return FALSE;
+	}
+	
+	char *ext = strrchr( file->lf_Path, '.' );
+	char *name = strrchr( file->lf_Path, '/' );
+	if( ext == NULL || ( name != NULL && ext < name ) )
+	{
+		return TRUE;
+	}
+	ext++;
+	
+	int i;
+	for( i=0 ; LOCFILE_COMPRESSED_EXTENSIONS[ i ] != NULL ; i++ )
+	{
+		if( strcasecmp( ext, LOCFILE_COMPRESSED_EXTENSIONS[ i ] ) == 0 )
+		{
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Load precompressed sibling of file (path + suffix), if it is not older than file itself
+ *
+ * @param file pointer to LocFile
+ * @param suffix sibling suffix (".gz", ".br")
+ * @param size pointer where size of loaded data will be stored
+ * @return pointer to loaded data or NULL when sibling does not exist or is stale
+ */
+static char *LocFileReadSibling( LocFile *file, const char *suffix, FULONG *size )
+{
+	int len = file->lf_PathLength + strlen( suffix ) + 1;
+	char *path = FMalloc( len );
+	if( path == NULL )
+	{
+		return NULL;
+	}
+	snprintf( path, len, "%s%s", file->lf_Path, suffix );
+	
+	char *buffer = NULL;
+	struct stat st;
+	if( stat( path, &st ) == 0 && S_ISREG( st.st_mode ) && st.st_mtime >= file->lf_Info.st_mtime && st.st_size > 0 )
+	{
+		FILE *fp = fopen( path, "rb" );
+		if( fp != NULL )
+		{
+			if( ( buffer = FMalloc( st.st_size ) ) != NULL )
+			{
+				if( fread( buffer, 1, st.st_size, fp ) == (size_t)st.st_size )
+				{
+					*size = st.st_size;
+				}
+				else
+				{
+					FFree( buffer );
+					buffer = NULL;
+				}
+			}
+			fclose( fp );
+		}
+	}
+	FFree( path );
+	return buffer;
+}
+
+/**
+ * Compress data with gzip
+ *
+ * @param src pointer to data
+ * @param srcSize size of data
+ * @param size pointer where size of compressed data will be stored
+ * @return pointer to compressed data or NULL when error appear
+ */
+static char *LocFileGzip( char *src, FULONG srcSize, FULONG *size )
+{
+	z_stream strm;
+	memset( &strm, 0, sizeof( strm ) );
+	
+	// 15 + 16 = max window with gzip header
+	if( deflateInit2( &strm, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+	{
+		return NULL;
+	}
+	
+	uLong bound = deflateBound( &strm, srcSize );
+	char *dst = FMalloc( bound );
+	if( dst == NULL )
+	{
+		deflateEnd( &strm );
+		return NULL;
+	}
+	
+	strm.next_in = (Bytef *)src;
+	strm.avail_in = srcSize;
+	strm.next_out = (Bytef *)dst;
+	strm.avail_out = bound;
+	
+	if( deflate( &strm, Z_FINISH ) != Z_STREAM_END )
+	{
+		deflateEnd( &strm );
+		FFree( dst );
+		return NULL;
+	}
+	*size = strm.total_out;
+	deflateEnd( &strm );
+	
+	return dst;
+}
+
+/**
+ * Prepare Content-Encoding variants of file.
+ * Precompressed siblings (file.br, file.gz) are used when they exist on disk.
+ * Without sibling file is gzipped in memory. Brotli is available only from siblings.
+ *
+ * @param file pointer to LocFile
+ * @return 0 when success, otherwise error number
+ */
+int LocFilePrepareEncodings( LocFile *file )
+{
+	if( file == NULL )
+	{
+		return -1;
+	}
+	if( file->lf_EncodingsReady == TRUE )
+	{
+		return 0;
+	}
+	
+	file->lf_EncodingsReady = TRUE;
+	
+	if( file->lf_Buffer != NULL && file->lf_FileSize >= LOCFILE_COMPRESS_MIN_SIZE && LocFileIsCompressible( file ) == TRUE )
+	{
+		// only files read from disk have siblings (virtual multi-file paths have no stat)
+		
+		if( file->lf_Info.st_mtime != 0 )
+		{
+			file->lf_BrotliBuffer = LocFileReadSibling( file, ".br", &(file->lf_BrotliSize) );
+			file->lf_GzipBuffer = LocFileReadSibling( file, ".gz", &(file->lf_GzipSize) );
+		}
+		
+		if( file->lf_GzipBuffer == NULL )
+		{
+			file->lf_GzipBuffer = LocFileGzip( file->lf_Buffer, file->lf_FileSize, &(file->lf_GzipSize) );
+			
+			// not worth to send when there is no real gain
+			if( file->lf_GzipBuffer != NULL && file->lf_GzipSize > ( file->lf_FileSize / 10 ) * 9 )
+			{
+				FFree( file->lf_GzipBuffer );
+				file->lf_GzipBuffer = NULL;
+				file->lf_GzipSize = 0;
+			}
+		}
+	}
+	
+	file->lf_CacheSize = file->lf_FileSize + file->lf_GzipSize + file->lf_BrotliSize;
+	
+	return 0;
+}
+
+/**
+ * Get file content in best encoding accepted by client
+ *
+ * @param file pointer to LocFile
+ * @param accepted accepted encodings (LOCFILE_ENCODING_* flags)
+ * @param size pointer where size of returned content will be stored
+ * @param encoding pointer where encoding name will be stored (NULL for raw content)
+ * @return pointer to content
+ */
+char *LocFileGetEncodedContent( LocFile *file, int accepted, FULONG *size, char **encoding )
+{
+	*encoding = NULL;
+	
+	if( ( accepted & LOCFILE_ENCODING_BROTLI ) && file->lf_BrotliBuffer != NULL )
+	{
+		*encoding = "br";
+		*size = file->lf_BrotliSize;
+		return file->lf_BrotliBuffer;
+	}
+	if( ( accepted & LOCFILE_ENCODING_GZIP ) && file->lf_GzipBuffer != NULL )
+	{
+		*encoding = "gzip";
+		*size = file->lf_GzipSize;
+		return file->lf_GzipBuffer;
+	}
+	*size = file->lf_FileSize;
+	return file->lf_Buffer;
+}
+
 #ifndef LOCFILE_USE_MMAP
 #error "LOCFILE_USE_MMAP must be defined to 0 or 1"
 #endif
@@ -29,6 +29,11 @@
 #define FILE_READ_NOW  0x00000002
 #define FILE_EXISTS    0x00000004
 
+#define LOCFILE_ENCODING_GZIP			0x00000001
+#define LOCFILE_ENCODING_BROTLI			0x00000002
+
+#define LOCFILE_COMPRESS_MIN_SIZE		512		// smaller files are not compressed on the fly
+
 #ifndef LOCFILE_USE_MMAP
 #error "LOCFILE_USE_MMAP must be defined to 0 or 1"
 #endif
@@ -55,7 +60,22 @@ typedef struct LocFile
 	uint64_t				hash[ 2 ];
 	
 	char					*lf_Mime;
-	int						lf_InUse;
+	int						lf_InUse;			// number of references taken by CacheManagerFileGet/Put
+	
+	// CacheManager
+	struct LocFile			*lf_CacheNext;		// CLOCK ring of files in cache stripe
+	struct LocFile			*lf_CachePrev;
+	FBOOL					lf_Referenced;		// CLOCK bit, set on every cache hit
+	FBOOL					lf_Cached;			// TRUE when file is stored in cache
+	time_t					lf_CheckTime;		// last time when file was compared with disk
+	
+	// Content-Encoding variants, prepared once when file is put to cache
+	char					*lf_GzipBuffer;
+	FULONG					lf_GzipSize;
+	char					*lf_BrotliBuffer;
+	FULONG					lf_BrotliSize;
+	FBOOL					lf_EncodingsReady;
+	FULONG					lf_CacheSize;		// raw size + all encoded variants
 } LocFile;
 
 //
@@ -104,4 +124,16 @@ LocFile* LocFileNewFromBuf( char* path, BufString *bs );
 
 char *GetExtension( char *name );
 
+//
+//
+//
+
+int LocFilePrepareEncodings( LocFile *file );
+
+//
+//
+//
+
+char *LocFileGetEncodedContent( LocFile *file, int accepted, FULONG *size, char **encoding );
+
 #endif
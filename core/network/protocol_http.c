@@ -17,6 +17,10 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <time.h>
 #include "core/friend_core.h"
 #include "core/library.h"
@@ -58,190 +62,22 @@ extern SystemBase *SLIB;
 
 char *GetArgsAndReplaceSession( Http *request, UserSession *loggedSession, FBOOL *arg );
 
-#define USE_NPOPEN_POLL
-
 // 
 //	TODO: This should be moved
 //It is to help us with fallback PHP support
 //
 /**
- * Function runs php script via PHP
+ * Function runs php script via PHP pool (php-fpm, persistent workers or new process)
  *
  * @param command pointer to php command provided as string
  * @return new ListString structure or NULL when problem appear
  */
 static inline ListString *RunPHPScript( const char *command )
 {
-	NPOpenFD pofd;
-	int err = newpopen( command, &pofd );
-	if( err != 0 )
-	{
-		FERROR("[RunPHPScript] cannot open pipe: %s\n", strerror( errno ) );
-		return NULL;
-	}
-	
-#define PHP_READ_SIZE 65536	
-	
-	char *buf = FMalloc( PHP_READ_SIZE+16 );
-	ListString *ls = ListStringNew();
-	
-#ifdef USE_NPOPEN_POLL
-
-	DEBUG("[RunPHPScript] command launched\n");
-
-	int size = 0;
-	int errCounter = 0;
-
-	struct pollfd fds[2];
-
-	// watch stdin for input 
-	fds[0].fd = pofd.np_FD[ NPOPEN_CONSOLE ];// STDIN_FILENO;
-	fds[0].events = POLLIN;
-
-	// watch stdout for ability to write
-	fds[1].fd = STDOUT_FILENO;
-	fds[1].events = POLLOUT;
-
-	while( TRUE )
-	{
-		DEBUG("[RunPHPScript] in loop\n");
-		
-		int ret = poll( fds, 2, MOD_TIMEOUT * 1000);
-
-		if( ret == 0 )
-		{
-			DEBUG("Timeout!\n");
-			break;
-		}
-		else if(  ret < 0 )
-		{
-			DEBUG("Error\n");
-			break;
-		}
-		size = read( pofd.np_FD[ NPOPEN_CONSOLE ], buf, PHP_READ_SIZE);
-
-		DEBUG( "[RunPHPScript] Adding %d of data\n", size );
-		if( size > 0 )
-		{
-			DEBUG( "[RunPHPScript] before adding to list\n");
-			ListStringAdd( ls, buf, size );
-			DEBUG( "[RunPHPScript] after adding to list\n");
-			//res += size;
-		}
-		else
-		{
-			errCounter++;
-			DEBUG("ErrCounter: %d\n", errCounter );
-
-			break;
-		}
-	}
-	
-	DEBUG("[RunPHPScript] File read\n");
-	
-#else
-	int errCounter = 0;
-	int size = 0;
-	
-	fd_set set;
-	struct timeval timeout;
-
-	// Initialize the timeout data structure. 
-
-	timeout.tv_sec = MOD_TIMEOUT;
-	timeout.tv_usec = 0;
-	
-	while( TRUE )
-	{
-			/* Initialize the file descriptor set. */
-		FD_ZERO( &set );
-		FD_SET( pofd.np_FD[ NPOPEN_CONSOLE ], &set);
-		DEBUG("[RunPHPScript] in loop\n");
-		
-		int ret = select( pofd.np_FD[ NPOPEN_CONSOLE ]+1, &set, NULL, NULL, &timeout );
-		// Make a new buffer and read
-		if( ret == 0 )
-		{
-			DEBUG("Timeout!\n");
-			break;
-		}
-		else if(  ret < 0 )
-		{
-			DEBUG("Error\n");
-			break;
-		}
-		size = read( pofd.np_FD[ NPOPEN_CONSOLE ], buf, PHP_READ_SIZE);
-
-		DEBUG( "[RunPHPScript] Adding %d of data\n", size );
-		if( size > 0 )
-		{
-			DEBUG( "[RunPHPScript] before adding to list\n");
-			ListStringAdd( ls, buf, size );
-			DEBUG( "[RunPHPScript] after adding to list\n");
-		}
-		else
-		{
-			errCounter++;
-			DEBUG("ErrCounter: %d\n", errCounter );
-			if( errCounter > MOD_NUMBER_TRIES )
-			{
-				//char clo[2];
-				//clo[0] = '\'';
-				//clo[1] = EOF;
-				//write( pofd.np_FD[ NPOPEN_INPUT ], clo, 2 );
-				//FERROR("Error in popen, Quit! Command: %s\n", command );
-				break;
-			}
-		}
-	}
-	DEBUG( "[RunPHPScript] after loop, memory will be released\n");
-	
-#endif
-	FFree( buf );
-	DEBUG("[RunPHPScript] File read\n");
-	
-	// Free pipe if it's there
-	newpclose( &pofd );
+	ListString *ls = PHPPoolRunCommand( SLIB->sl_PHPPool, command );
 	
-	ListStringJoin( ls );		//we join all string into one buffer
-	
-	DEBUG( "[RunPHPScript] Finished PHP call...(%lu length)-\n", ls->ls_Size );
+	DEBUG( "[RunPHPScript] Finished PHP call...(%lu length)-\n", ls != NULL ? (unsigned long)ls->ls_Size : 0 );
 	return ls;
-	
-	/*
-	FILE *pipe = popen( command, "r" );
-	if( !pipe )
-	{
-		Log( FLOG_ERROR,"Cannot open pipe for command: %s\n", command );
-		return NULL;
-	}
-
-	FULONG size = 0;
-	ListString *data = ListStringNew();
-
-#define PHP_READ_SIZE 65536
-	char *buf = FCalloc( PHP_READ_SIZE, sizeof( char ) );
-	if( buf != NULL )
-	{
-		while( !feof( pipe ) )
-		{
-			// Make a new buffer and read
-			size = fread( buf, sizeof(char), PHP_READ_SIZE, pipe );
-
-			if( size > 0 )
-			{
-				ListStringAdd( data, buf, size );
-			}
-			pthread_yield();
-		}
-		ListStringJoin( data );		
-		FFree( buf );
-	}
-	// Free buffer if it's there
-	pclose( pipe );
-
-	return data;
-	*/
 }
 
 /**
@@ -310,18 +146,7 @@ static inline int ReadServerFile( Uri *uri __attribute__((unused)), char *locpat
 					Log( FLOG_ERROR,"Cannot read file %s\n", completePath->raw );
 				}
 			}
-			else
-			{
-				struct stat attr;
-				stat( completePath->raw, &attr);
-
-				// if file is new file, reload it
-				//DEBUG1("\n\n\n\n\n SIZE %lld  stat %lld\n\n\n\n",attr.st_mtime ,file->info.st_mtime );
-				if( attr.st_mtime != file->lf_Info.st_mtime )
-				{
-					LocFileReload( file, completePath->raw);
-				}
-			}
+			// file changed on disk is removed from cache by CacheManagerFileGet
 		}
 		else
 		{
@@ -354,6 +179,10 @@ static inline int ReadServerFile( Uri *uri __attribute__((unused)), char *locpat
 		{
 			LocFileDelete( file );
 		}
+		else
+		{
+			CacheManagerFileRelease( SLIB->cm, file );
+		}
 
 		*result = 200;
 	}
@@ -403,6 +232,123 @@ static inline int ReadServerFile( Uri *uri __attribute__((unused)), char *locpat
 	return 0;
 }
 
+/**
+ * Send part of local file to socket, used by HttpWriteRanges
+ *
+ * @param data pointer to file descriptor
+ * @param sock pointer to Socket
+ * @param offset position in file
+ * @param length number of bytes to send
+ * @return number of bytes sent
+ */
+
+static FQUAD ProtocolHttpSendFd( void *data, Socket *sock, FQUAD offset, FQUAD length )
+{
+	return sock->s_Interface->SocketSendFile( sock, *(int *)data, offset, length );
+}
+
+/**
+ * Get encodings accepted by client from Accept-Encoding header
+ *
+ * @param request pointer to Http request
+ * @return LOCFILE_ENCODING_* flags
+ */
+static int ProtocolHttpAcceptedEncodings( Http *request )
+{
+	int accepted = 0;
+	List *l = HttpGetHeaderList( request, "accept-encoding" );
+	
+	while( l != NULL )
+	{
+		char *token = (char *)l->l_Data;
+		if( token != NULL )
+		{
+			while( *token == ' ' || *token == '\t' )
+			{
+				token++;
+			}
+			
+			int len = 0;
+			while( token[ len ] != 0 && token[ len ] != ';' && token[ len ] != ' ' && token[ len ] != '\t' )
+			{
+				len++;
+			}
+			
+			// "gzip;q=0" means that encoding is not acceptable
+			char *q = strstr( token + len, "q=" );
+			FBOOL refused = ( q != NULL && strtod( q + 2, NULL ) <= 0.0 );
+			
+			if( refused == FALSE )
+			{
+				if( len == 4 && strncasecmp( token, "gzip", 4 ) == 0 )
+				{
+					accepted |= LOCFILE_ENCODING_GZIP;
+				}
+				else if( len == 2 && strncasecmp( token, "br", 2 ) == 0 )
+				{
+					accepted |= LOCFILE_ENCODING_BROTLI;
+				}
+				else if( len == 1 && token[ 0 ] == '*' )
+				{
+					accepted |= LOCFILE_ENCODING_GZIP | LOCFILE_ENCODING_BROTLI;
+				}
+			}
+		}
+		l = l->next;
+	}
+	return accepted;
+}
+
+/**
+ * Set LocFile content as response body, compressed variant is used when client accepts it.
+ * Validators (ETag, Last-Modified) are added, when client already has current version
+ * response code is changed to 304 and no content is set.
+ * Content is set by reference, caller must clear it after HttpWrite.
+ *
+ * @param response pointer to Http response
+ * @param request pointer to Http request
+ * @param file pointer to LocFile which will be sent
+ * @return TRUE when 304 Not Modified will be returned, otherwise FALSE
+ */
+static FBOOL ProtocolHttpSetFileContent( Http *response, Http *request, LocFile *file )
+{
+	char *encoding = NULL;
+	FULONG size = file->lf_FileSize;
+	char *content = file->lf_Buffer;
+	
+	if( file->lf_GzipBuffer != NULL || file->lf_BrotliBuffer != NULL )
+	{
+		content = LocFileGetEncodedContent( file, ProtocolHttpAcceptedEncodings( request ), &size, &encoding );
+		
+		// response depends on request header, proxies must know that
+		HttpAddHeader( response, HTTP_HEADER_VARY, StringDuplicate( "Accept-Encoding" ) );
+	}
+	
+	// strong validator must be different for every encoding
+	char *etag = HttpCreateETag( file->hash, file->lf_ModificationTimestamp, file->lf_FileSize, encoding );
+	FBOOL notModified = HttpIsNotModified( request, etag, file->lf_ModificationTimestamp );
+	
+	HttpAddCacheValidators( response, etag, file->lf_ModificationTimestamp );
+	if( etag != NULL )
+	{
+		FFree( etag );
+	}
+	
+	if( notModified == TRUE )
+	{
+		HttpSetCode( response, HTTP_304_NOT_MODIFIED );
+		return TRUE;
+	}
+	
+	if( encoding != NULL )
+	{
+		HttpAddHeader( response, HTTP_HEADER_CONTENT_ENCODING, StringDuplicate( encoding ) );
+	}
+	HttpSetContent( response, content, size );
+	
+	return FALSE;
+}
+
 /**
  * Http protocol parser
  *
@@ -654,15 +600,7 @@ Http *ProtocolHttp( Socket* sock, char* data, FQUAD length )
 							{
 								if( tst->hme_Data != NULL )
 								{
-									session = SLIB->sl_USM->usm_Sessions;
-									while( session != NULL )
-									{
-										if(  strcmp( session->us_SessionID, (char *)tst->hme_Data ) == 0 )
-										{
-											break;
-										}
-										session = (UserSession *)session->node.mln_Succ;
-									}
+									session = USMGetSessionBySessionID( SLIB->sl_USM, (char *)tst->hme_Data );
 								}
 							}
 							UserLoggerStore( SLIB->sl_ULM, session, request->http_RawRequestPath, request->http_UserActionInfo );
@@ -1081,8 +1019,21 @@ Http *ProtocolHttp( Socket* sock, char* data, FQUAD length )
 
 									// 0 = filesystem do not provide modify timestamp
 									time_t tim = actFS->GetChangeTimestamp( rootDev, fs_Path );
+									char *etag = NULL;
+									FBOOL notModified = FALSE;
+									
+									if( tim != 0 )
+									{
+										uint64_t pathHash[ 2 ];
+										MURMURHASH3( fs_Path, strlen( fs_Path ), pathHash );
+										etag = HttpCreateETag( pathHash, tim, 0, NULL );
+										
+										notModified = HttpIsNotModified( request, etag, tim );
+									}
+									
 									// there is no need to cache files which are stored on local disk
-									if( tim == 0 ) //|| strcmp( actFS->GetPrefix(), "local" ) )
+									// drivers backed by real file descriptor are sent with zero-copy, cache would only add copy
+									if( tim == 0 || notModified == TRUE || actFS->FileSendToSocket != NULL ) //|| strcmp( actFS->GetPrefix(), "local" ) )
 									{
 
 									}
@@ -1093,9 +1044,9 @@ Http *ProtocolHttp( Socket* sock, char* data, FQUAD length )
 										// if TRUE file must be reloaded
 										if( cf != NULL )
 										{
-											cf->cf_ModificationTimestamp = tim;
 											if( cf->cf_ModificationTimestamp != tim )
 											{
+												cf->cf_ModificationTimestamp = tim;
 												cacheState = CACHE_FILE_REQUIRE_REFRESH;		// we can use same pointer to file, but there is need to store it again
 											}
 											else
@@ -1109,31 +1060,34 @@ Http *ProtocolHttp( Socket* sock, char* data, FQUAD length )
 										}
 									}
 
-									if( cacheState == CACHE_FILE_CAN_BE_USED )
+									// client already has current version of file, body is not sent
+									if( notModified == TRUE )
+									{
+										response = HttpNewSimple( HTTP_304_NOT_MODIFIED, tags );
+										HttpAddCacheValidators( response, etag, tim );
+										
+										result = 304;
+									}
+									else if( cacheState == CACHE_FILE_CAN_BE_USED )
 									{
 										int resp = 0;
-										int dataread = 0;
 
-										cf->cf_Fp = fopen( cf->cf_StorePath, "rb" );
-										if( cf->cf_Fp != NULL )
+										// cached copy is stored on local disk, it is sent without copying through user space
+										int fd = open( cf->cf_StorePath, O_RDONLY );
+										if( fd >= 0 )
 										{
-											char *tbuffer = FMalloc( SHARING_BUFFER_SIZE );
-											if( tbuffer != NULL )
+											struct stat st;
+											if( fstat( fd, &st ) == 0 && st.st_size > 0 )
 											{
-												while( !feof( cf->cf_Fp ) )
-												{
-													if( resp == 0 && dataread > 0 )
-													{
-														response = HttpNewSimple( HTTP_200_OK, tags );
-														HttpWrite( response, request->http_Socket );
-														resp = 1;
-													}
-													dataread = fread( tbuffer, 1, SHARING_BUFFER_SIZE, cf->cf_Fp );
-													request->http_Socket->s_Interface->SocketWrite( request->http_Socket, tbuffer, dataread );
-												}
-												FFree( tbuffer );
+												HttpRange ranges[ HTTP_MAX_RANGES ];
+												int rangeCount = HttpParseRange( request, st.st_size, etag, tim, ranges, HTTP_MAX_RANGES );
+												
+												response = HttpNewSimple( HTTP_200_OK, tags );
+												HttpAddCacheValidators( response, etag, tim );
+												HttpWriteRanges( response, request->http_Socket, st.st_size, ranges, rangeCount, ProtocolHttpSendFd, &fd );
+												resp = 1;
 											}
-											fclose( cf->cf_Fp );
+											close( fd );
 										}
 
 										if( resp == 0 )
@@ -1210,35 +1164,63 @@ Http *ProtocolHttp( Socket* sock, char* data, FQUAD length )
 
 												int dataread;
 
-												char *tbuffer = FMalloc( SHARING_BUFFER_SIZE );
-												if( tbuffer != NULL )
+												// file is not stored in cache and size is known, Range requests can be served
+												if( cffp == NULL && fp->f_Size > 0 )
 												{
-													DEBUG("tbuffer\n");
-													while( ( dataread = actFS->FileRead( fp, tbuffer, SHARING_BUFFER_SIZE ) ) != -1 )
+													HttpRange ranges[ HTTP_MAX_RANGES ];
+													int rangeCount = HttpParseRange( request, fp->f_Size, etag, tim, ranges, HTTP_MAX_RANGES );
+													
+													response = HttpNewSimple( HTTP_200_OK, tags );
+													HttpAddCacheValidators( response, etag, tim );
+													
+													fp->f_FSys = actFS;
+													HttpWriteRanges( response, request->http_Socket, fp->f_Size, ranges, rangeCount, FileSendRangeToSocket, fp );
+													resp = 1;
+												}
+												// driver backed by real file, data is sent with zero-copy
+												else if( actFS->FileSendToSocket != NULL && cffp == NULL )
+												{
+													response = HttpNewSimple( HTTP_200_OK, tags );
+													HttpAddCacheValidators( response, etag, tim );
+													HttpWrite( response, request->http_Socket );
+													resp = 1;
+													
+													actFS->FileSendToSocket( fp, request->http_Socket, 0, -1 );
+												}
+												else
+												{
+													char *tbuffer = FMalloc( SHARING_BUFFER_SIZE );
+													if( tbuffer != NULL )
 													{
-														DEBUG("inside of loop: read %d\n", dataread );
-														if( resp == 0 && dataread > 0 )
+														DEBUG("tbuffer\n");
+														while( ( dataread = actFS->FileRead( fp, tbuffer, SHARING_BUFFER_SIZE ) ) != -1 )
 														{
-															response = HttpNewSimple( HTTP_200_OK, tags );
-															HttpWrite( response, request->http_Socket );
-															resp = 1;
+															DEBUG("inside of loop: read %d\n", dataread );
+															if( resp == 0 && dataread > 0 )
+															{
+																response = HttpNewSimple( HTTP_200_OK, tags );
+																HttpAddCacheValidators( response, etag, tim );
+																HttpWrite( response, request->http_Socket );
+																resp = 1;
 															
-															request->http_Socket->s_Interface->SocketWrite( request->http_Socket, tbuffer, dataread );
-														}
-														else
-														{
-															request->http_Socket->s_Interface->SocketWrite( request->http_Socket, tbuffer, dataread );
-														}
+																request->http_Socket->s_Interface->SocketWrite( request->http_Socket, tbuffer, dataread );
+															}
+															else
+															{
+																request->http_Socket->s_Interface->SocketWrite( request->http_Socket, tbuffer, dataread );
+															}
 														
-														if( cffp != NULL )
-														{
-															DEBUG("Store %d\n", dataread );
-															fwrite( tbuffer, 1, dataread, cffp );
-															cf->cf_FileSize += dataread;
+															if( cffp != NULL )
+															{
+																DEBUG("Store %d\n", dataread );
+																fwrite( tbuffer, 1, dataread, cffp );
+																cf->cf_FileSize += dataread;
+															}
 														}
+														FFree( tbuffer );
 													}
-													FFree( tbuffer );
 												}
+												
 												DEBUG("should I send fail? %d\n", resp );
 												
 												if( resp == 0 )
@@ -1281,6 +1263,11 @@ Http *ProtocolHttp( Socket* sock, char* data, FQUAD length )
 										}
 
 									} // cache support
+									
+									if( etag != NULL )
+									{
+										FFree( etag );
+									}
 									FFree( extension );
 								}
 								else
@@ -1437,17 +1424,19 @@ Http *ProtocolHttp( Socket* sock, char* data, FQUAD length )
 
 									response = HttpNewSimple( HTTP_200_OK, tags );
 
-									HttpSetContent( response, file->lf_Buffer, file->lf_FileSize );
+									FBOOL notModified = ProtocolHttpSetFileContent( response, request, file );
 
 									// write here and set data to NULL!!!!!
 									// return response
 									HttpWrite( response, sock );
-									result = 200;
+									result = ( notModified == TRUE ) ? 304 : 200;
 
 									response->http_Content = NULL;
 									response->http_SizeOfContent = 0;
 
 									response->http_WriteType = FREE_ONLY;
+									
+									CacheManagerFileRelease( SLIB->cm, file );
 								}
 								else // file not found in cache
 								{
@@ -1535,8 +1524,6 @@ Http *ProtocolHttp( Socket* sock, char* data, FQUAD length )
 
 												response = HttpNewSimple( HTTP_200_OK, tags );
 
-												HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
-
 												LocFile* nlf = LocFileNewFromBuf( path->raw, bs );
 												if( nlf != NULL )
 												{
@@ -1549,11 +1536,13 @@ Http *ProtocolHttp( Socket* sock, char* data, FQUAD length )
 														if( CacheManagerFilePut( SLIB->cm, nlf ) != 0 )
 														{
 															LocFileDelete( nlf );
+															nlf = NULL;
 														}
 													}
 													else
 													{
 														LocFileDelete( nlf );
+														nlf = NULL;
 													}
 												}
 												else
@@ -1563,11 +1552,30 @@ Http *ProtocolHttp( Socket* sock, char* data, FQUAD length )
 												
 												//DEBUG("Multifile content: %s\n\n\n", bs->bs_Buffer );
 
-												bs->bs_Buffer = NULL;
+												// cached file already holds compressed variants
+												if( nlf != NULL )
+												{
+													ProtocolHttpSetFileContent( response, request, nlf );
+
+													HttpWrite( response, sock );
+
+													response->http_Content = NULL;
+													response->http_SizeOfContent = 0;
 
-												// write here and set data to NULL!!!!!
-												// retusn response
-												HttpWrite( response, sock );
+													response->http_WriteType = FREE_ONLY;
+
+													CacheManagerFileRelease( SLIB->cm, nlf );
+												}
+												else
+												{
+													HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
+
+													bs->bs_Buffer = NULL;
+
+													// write here and set data to NULL!!!!!
+													// retusn response
+													HttpWrite( response, sock );
+												}
 
 												//BufStringDelete( bs );
 
@@ -1736,24 +1744,7 @@ Http *ProtocolHttp( Socket* sock, char* data, FQUAD length )
 														}
 													}
 												}
-												else
-												{
-													struct stat attr;
-													stat( decoded, &attr);
-
-													// if file is new file, reload it
-													
-													if( attr.st_mtime != file->lf_Info.st_mtime )
-													{
-														Log( FLOG_DEBUG, "[ProtocolHttp] File will be reloaded\n");
-														LocFileReload( file, decoded );
-													}
-												}
-												
-												if( file != NULL )
-												{
-													file->lf_InUse = 1;
-												}
+												// file changed on disk is removed from cache by CacheManagerFileGet
 											}
 											else
 											{
@@ -1814,12 +1805,12 @@ Http *ProtocolHttp( Socket* sock, char* data, FQUAD length )
 
 											response = HttpNewSimple( HTTP_200_OK, tags );
 
-											HttpSetContent( response, file->lf_Buffer, file->lf_FileSize );
+											FBOOL notModified = ProtocolHttpSetFileContent( response, request, file );
 
 											// write here and set data to NULL!!!!!
 											// return response
 											HttpWrite( response, sock );
-											result = 200;
+											result = ( notModified == TRUE ) ? 304 : 200;
 
 											response->http_Content = NULL;
 											response->http_SizeOfContent = 0;
@@ -1835,7 +1826,7 @@ Http *ProtocolHttp( Socket* sock, char* data, FQUAD length )
 											}
 											else
 											{
-												file->lf_InUse = 0;
+												CacheManagerFileRelease( SLIB->cm, file );
 											}
 										}
 										else
@@ -918,8 +918,7 @@ Http *HandleWebDav( void *lsb, Http *req, char *data, int len )
 						UserAddSession( usr, ses );
 						USMSessionSaveDB( sb->sl_USM, ses );
 					
-						ses->node.mln_Succ = (MinNode *) sb->sl_USM->usm_Sessions;
-						sb->sl_USM->usm_Sessions = ses;
+						USMUserSessionAddToList( sb->sl_USM, ses );
 					}
 				}
 				char *err = NULL;
@@ -20,6 +20,7 @@
 #include <core/thread.h>
 #include <time.h>
 #include <util/friendqueue.h>
+#include <core/worker_manager.h>
 
 // disable / enable debug
 //#undef DEBUG
@@ -33,7 +34,7 @@ extern SystemBase *SLIB;
 //#define USE_PTHREAD 1		//
 //#define USE_WORKERS_PING
 #define USE_PTHREAD_PING 1	// use pthread for PING-PONG calls
-#define INPUT_QUEUE			// use queue to collect all incoming messages. All this messages will be parsed and executed in different thread
+#define INPUT_QUEUE			// use queue to collect all incoming messages. Messages of connection are parsed and executed in order by worker pool
 
 // enabled for development/IDE
 //#define ENABLE_WEBSOCKETS_THREADS 1
@@ -51,7 +52,7 @@ typedef struct WSThreadData
 	int							wstd_RequestLen;
 	char						*wstd_Msg;
 	size_t						wstd_Len;
-	pthread_t					wstd_Thread;
+	struct WSThreadData			*wstd_Next;				// next message in connection queue
 }WSThreadData;
 
 static int MAX_SIZE_WS_MESSAGE = WS_PROTOCOL_BUFFER_SIZE-2048;
@@ -110,16 +111,9 @@ void WSThreadPing( void *p )
 	int n = 0;
 	UserSession *us = data->wstd_WSD->wsc_UserSession;//data->wstd_UserSession;
 	
-	if( data == NULL || us == NULL || us->us_WSD == NULL )
+	if( us == NULL || us->us_WSD == NULL )
 	{
-		if( data != NULL )
-		{
-			if( data->wstd_Requestid != NULL )
-			{
-				FFree( data->wstd_Requestid );
-			}
-			FFree( data );
-		}
+		releaseWSData( data );
 		return;
 	}
 	
@@ -171,6 +165,214 @@ void ParseAndCallThread( void *d );
 //int ParseAndCall( InputMsg *im );
 int ParseAndCall( WSThreadData *wstd );
 
+/**
+ * Process messages of connection in order they were received. Only one worker processes connection at time,
+ * different connections are processed in parallel.
+ *
+ * @param p pointer to WSCData, worker owns one reference
+ */
+void WSConnectionProcess( void *p )
+{
+	WSCData *wsd = (WSCData *)p;
+	WebSocket *ws = (WebSocket *)wsd->wsc_WebSocket;
+	int processed = 0;
+	
+	while( TRUE )
+	{
+		FBOOL resume = FALSE;
+		FBOOL closed;
+		
+		pthread_mutex_lock( &(wsd->wsc_Mutex) );
+		WSThreadData *wstd = (WSThreadData *)wsd->wsc_QueueFirst;
+		if( wstd == NULL )
+		{
+			wsd->wsc_Scheduled = FALSE;
+			pthread_mutex_unlock( &(wsd->wsc_Mutex) );
+			break;
+		}
+		
+		// busy connection gives worker to others, job is put at end of pool queue
+		if( processed >= ws->ws_QueueMax )
+		{
+			pthread_mutex_unlock( &(wsd->wsc_Mutex) );
+			if( WorkerManagerQueue( (WorkerManager *)ws->ws_Workers, WSConnectionProcess, wsd, -1 ) == 0 )
+			{
+				return;	// reference was passed to new job
+			}
+			processed = 0;
+			continue;
+		}
+		
+		wsd->wsc_QueueFirst = wstd->wstd_Next;
+		if( wsd->wsc_QueueFirst == NULL )
+		{
+			wsd->wsc_QueueLast = NULL;
+		}
+		wsd->wsc_QueueCount--;
+		
+		if( wsd->wsc_RxPaused == TRUE && wsd->wsc_RxResume == FALSE && wsd->wsc_QueueCount <= ws->ws_QueueMax / 2 )
+		{
+			wsd->wsc_RxResume = TRUE;
+			resume = TRUE;
+		}
+		// when server is closing jobs which are still queued only drop messages and reference
+		closed = ( wsd->wsc_Closed == TRUE || ws->ws_Quit == TRUE );
+		pthread_mutex_unlock( &(wsd->wsc_Mutex) );
+		
+		wstd->wstd_Next = NULL;
+		
+		// reading can be enabled only by service thread of connection
+		if( resume == TRUE )
+		{
+			WebSocketRequestWritable( wsd );
+		}
+		
+		// answers cannot be delivered to closed connection
+		if( closed == TRUE )
+		{
+			releaseWSData( wstd );
+		}
+		else
+		{
+			// reads done for message follow writes of session
+			LibrarySQLSetSession( SLIB, (UserSession *)wsd->wsc_UserSession );
+			ParseAndCall( wstd );
+			LibrarySQLSetSession( SLIB, NULL );
+		}
+		processed++;
+	}
+	
+	WSCDataRelease( wsd );
+}
+
+/**
+ * Put message into connection queue and schedule connection in worker pool when it is not scheduled yet.
+ * Reading from connection is stopped when too many messages wait in queue.
+ * Called by service thread of connection.
+ *
+ * @param wsi pointer to lws
+ * @param wsd pointer to WSCData
+ * @param wstd message
+ * @return 0 when success, otherwise error number (connection should be closed)
+ */
+static int WSConnectionQueue( struct lws *wsi, WSCData *wsd, WSThreadData *wstd )
+{
+	WebSocket *ws = (WebSocket *)wsd->wsc_WebSocket;
+	FBOOL schedule = FALSE;
+	
+	wstd->wstd_Next = NULL;
+	
+	pthread_mutex_lock( &(wsd->wsc_Mutex) );
+	if( wsd->wsc_QueueLast != NULL )
+	{
+		((WSThreadData *)wsd->wsc_QueueLast)->wstd_Next = wstd;
+	}
+	else
+	{
+		wsd->wsc_QueueFirst = wstd;
+	}
+	wsd->wsc_QueueLast = wstd;
+	wsd->wsc_QueueCount++;
+	
+	if( wsd->wsc_QueueCount >= ws->ws_QueueMax && wsd->wsc_RxPaused == FALSE )
+	{
+		DEBUG("[WSConnectionQueue] Queue is full (%d), stop reading from connection %p\n", wsd->wsc_QueueCount, wsi );
+		wsd->wsc_RxPaused = TRUE;
+		wsd->wsc_RxResume = FALSE;
+		lws_rx_flow_control( wsi, 0 );
+	}
+	
+	if( wsd->wsc_Scheduled == FALSE )
+	{
+		wsd->wsc_Scheduled = TRUE;
+		schedule = TRUE;
+	}
+	pthread_mutex_unlock( &(wsd->wsc_Mutex) );
+	
+	if( schedule == TRUE )
+	{
+		WSCDataAcquire( wsd );
+		
+		if( WorkerManagerQueue( (WorkerManager *)ws->ws_Workers, WSConnectionProcess, wsd, -1 ) != 0 )
+		{
+			pthread_mutex_lock( &(wsd->wsc_Mutex) );
+			WSThreadData *first = (WSThreadData *)wsd->wsc_QueueFirst;
+			wsd->wsc_QueueFirst = NULL;
+			wsd->wsc_QueueLast = NULL;
+			wsd->wsc_QueueCount = 0;
+			wsd->wsc_Scheduled = FALSE;
+			pthread_mutex_unlock( &(wsd->wsc_Mutex) );
+			
+			while( first != NULL )
+			{
+				WSThreadData *next = first->wstd_Next;
+				releaseWSData( first );
+				first = next;
+			}
+			WSCDataRelease( wsd );
+			
+			Log( FLOG_ERROR, "[WSConnectionQueue] All websocket workers are busy, connection %p will be closed\n", wsi );
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Close connection (LWS_CALLBACK_CLOSED). Connection data is released when last worker or writer drops it.
+ *
+ * @param wsi pointer to lws
+ * @param wsd pointer to WSCData
+ */
+static void WSConnectionClose( struct lws *wsi, WSCData *wsd )
+{
+	pthread_mutex_lock( &(wsd->wsc_Mutex) );
+	if( wsd->wsc_Closed == TRUE )
+	{
+		pthread_mutex_unlock( &(wsd->wsc_Mutex) );
+		return;
+	}
+	// from now nobody can request writable callback or attach connection to session
+	wsd->wsc_Closed = TRUE;
+	wsd->wsc_Wsi = NULL;
+	pthread_mutex_unlock( &(wsd->wsc_Mutex) );
+	
+	WebSocketCancelWritable( wsd );
+	DetachWebsocketFromSession( wsd );
+	
+	lws_close_reason( wsi, LWS_CLOSE_STATUS_GOINGAWAY , NULL, 0 );
+	lws_set_wsi_user( wsi, NULL );
+	
+	WSCDataRelease( wsd );
+}
+
+/**
+ * Check if queue entry is next fragment of binary message
+ *
+ * @param e pointer to FQEntry
+ * @return TRUE when entry continues message, otherwise FALSE
+ */
+static inline FBOOL WSIsContinuation( FQEntry *e )
+{
+	return ( ( e->fq_Flags & ~LWS_WRITE_NO_FIN ) == LWS_WRITE_CONTINUATION );
+}
+
+/**
+ * Finish binary message which connection cannot continue (queue was cleared or fragments were taken by other connection).
+ * Empty last fragment ends message, client drops it because it cannot be parsed.
+ *
+ * @param wsi pointer to lws
+ * @param wsd pointer to WSCData
+ */
+static void WSFragmentsFinish( struct lws *wsi, WSCData *wsd )
+{
+	unsigned char buf[ LWS_SEND_BUFFER_PRE_PADDING+LWS_SEND_BUFFER_POST_PADDING+1 ];
+	
+	FERROR("[WSFragmentsFinish] Binary message was interrupted, connection %p\n", wsd );
+	lws_write( wsi, buf+LWS_SEND_BUFFER_PRE_PADDING, 0, LWS_WRITE_CONTINUATION );
+	wsd->wsc_InFragment = FALSE;
+}
+
 /**
  * Main FriendCore websocket callback
  *
@@ -225,7 +427,15 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 	switch( reason )
 	{
 		case LWS_CALLBACK_ESTABLISHED:
-			pthread_mutex_init( &(wsd->wsc_Mutex), NULL );
+			if( WSCDataNew( wsi ) == NULL )
+			{
+				return -1;
+			}
+		break;
+		
+		// other thread requested writable callback (WebSocketRequestWritable)
+		case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+			WebSocketServiceWritable( wsi );
 		break;
 		
 		case LWS_CALLBACK_WS_PEER_INITIATED_CLOSE:
@@ -233,27 +443,9 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 		break;
 		
 		case LWS_CALLBACK_CLOSED:
+			if( wsd != NULL )
 			{
-				while( TRUE )
-				{
-					if( wsd->wsc_InUseCounter <= 0 )
-					{
-						DEBUG("[WS] Callback closed!\n");
-						break;
-					}
-					DEBUG("[WS] Closing WS, number: %d\n", wsd->wsc_InUseCounter );
-					sleep( 1 );
-				}
-				DetachWebsocketFromSession( wsd );
-			
-				if( wsd->wsc_Buffer != NULL )
-				{
-					BufStringDelete( wsd->wsc_Buffer );
-				}
-			
-				lws_close_reason( wsi, LWS_CLOSE_STATUS_GOINGAWAY , NULL, 0 );
-				
-				pthread_mutex_destroy( &(wsd->wsc_Mutex) );
+				WSConnectionClose( wsi, wsd );
 			
 				Log( FLOG_DEBUG, "[WS] Callback session closed\n");
 			}
@@ -265,7 +457,11 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 
 		case LWS_CALLBACK_RECEIVE:
 			{
-				wsd->wsc_Wsi = wsi;
+				if( wsd == NULL )
+				{
+					FFree( in );
+					return -1;
+				}
 
 				UserSession *us = (UserSession *)wsd->wsc_UserSession;
 				if( us != NULL )
@@ -314,9 +510,7 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 				WSThreadData *wstd = FCalloc( 1, sizeof( WSThreadData ) );
 				if( wstd != NULL )
 				{
-					memset( &(wstd->wstd_Thread), 0, sizeof( pthread_t ) );
-					
-					DEBUG("[WS] Pass wsd to thread: %p\n", wsd );
+					DEBUG("[WS] Pass wsd to queue: %p\n", wsd );
 					wstd->wstd_WSD = wsd;
 					wstd->wstd_Msg = in;
 					wstd->wstd_Len = len;
@@ -325,10 +519,15 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 					// Using Websocket thread to read/write messages, rest should happen in userspace
 					//
 					
-					if( pthread_create( &(wstd->wstd_Thread), NULL,  (void *(*)(void *))ParseAndCall, ( void *)wstd ) != 0 )
+					if( WSConnectionQueue( wsi, wsd, wstd ) != 0 )
 					{
+						return -1;
 					}
 				}
+				else
+				{
+					FFree( in );
+				}
 #else
 				ParseAndCall( wsd, in, len );
 #endif
@@ -353,8 +552,13 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 		case LWS_CALLBACK_SERVER_WRITEABLE:
 			DEBUG1("[WS] LWS_CALLBACK_SERVER_WRITEABLE\n");
 			
-			if( wsd->wsc_UserSession == NULL || wsd->wsc_Wsi == NULL )
+			if( wsd == NULL || wsd->wsc_UserSession == NULL || wsd->wsc_Wsi == NULL )
 			{
+				// session was removed in the middle of binary message
+				if( wsd != NULL && wsd->wsc_Wsi != NULL && wsd->wsc_InFragment == TRUE )
+				{
+					WSFragmentsFinish( wsi, wsd );
+				}
 				if( in != NULL )
 				{
 					FFree( in );
@@ -376,7 +580,30 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 				{
 					FQueue *q = &(us->us_MsgQueue);
 					
-					if( q->fq_First != NULL )
+					// fragments of message started by other connection (session got new connection) cannot be sent here
+					while( wsd->wsc_InFragment == FALSE && q->fq_First != NULL && WSIsContinuation( q->fq_First ) == TRUE )
+					{
+						e = FQPop( q );
+						FFree( e->fq_Data );
+						FFree( e );
+					}
+					e = NULL;
+					
+					// rest of message was removed from queue or taken by other connection
+					if( wsd->wsc_InFragment == TRUE && ( q->fq_First == NULL || WSIsContinuation( q->fq_First ) == FALSE ) )
+					{
+						FBOOL more = ( q->fq_First != NULL && us->us_WSD == wsd );
+						FRIEND_MUTEX_UNLOCK( &(us->us_Mutex) );
+						WSFragmentsFinish( wsi, wsd );
+						if( more == TRUE )
+						{
+							lws_callback_on_writable( wsi );
+						}
+						break;
+					}
+					
+					// connection which was replaced only finishes message which it started
+					if( q->fq_First != NULL && ( us->us_WSD == wsd || wsd->wsc_InFragment == TRUE ) )
 					{
 						e = FQPop( q );
 						
@@ -384,7 +611,9 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 						unsigned char *t = e->fq_Data+LWS_SEND_BUFFER_PRE_PADDING;
 						t[ e->fq_Size+1 ] = 0;
 
-						lws_write( wsi, e->fq_Data+LWS_SEND_BUFFER_PRE_PADDING, e->fq_Size, LWS_WRITE_TEXT );
+						// fragments of binary message are queued one after another, nothing can be sent between them
+						lws_write( wsi, e->fq_Data+LWS_SEND_BUFFER_PRE_PADDING, e->fq_Size, (enum lws_write_protocol)e->fq_Flags );
+						wsd->wsc_InFragment = ( e->fq_Flags & LWS_WRITE_NO_FIN ) ? TRUE : FALSE;
 				
 #ifdef __PERF_MEAS
 						Log( FLOG_INFO, "PERFCHECK: Websocket message sent time: %f\n", ((GetCurrentTimestampD()-e->fq_stime)) );
@@ -407,9 +636,10 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 					
 						FRIEND_MUTEX_LOCK( &(us->us_Mutex) );
 					}
+					FBOOL more = ( q->fq_First != NULL && ( us->us_WSD == wsd || wsd->wsc_InFragment == TRUE ) );
 					FRIEND_MUTEX_UNLOCK( &(us->us_Mutex) );
 					
-					if( q->fq_First != NULL )
+					if( more == TRUE )
 					{
 						lws_callback_on_writable( wsi );
 					}
@@ -452,30 +682,9 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 		// protocol will be destroyed
 		if( wsd != NULL && wsd->wsc_Wsi != NULL )
 		{
-			while( TRUE )
-			{
-				if( wsd->wsc_InUseCounter <= 0 )
-				{
-					DEBUG("[WS] Callback closed!\n");
-					break;
-				}
-				DEBUG("[WS] Closing WS, number: %d\n", wsd->wsc_InUseCounter );
-				sleep( 1 );
-			}
-			DetachWebsocketFromSession( wsd );
-	
-			if( wsd->wsc_Buffer != NULL )
-			{
-				BufStringDelete( wsd->wsc_Buffer );
-			}
-	
-			lws_close_reason( wsi, LWS_CLOSE_STATUS_GOINGAWAY , NULL, 0 );
-		
-			pthread_mutex_destroy( &(wsd->wsc_Mutex) );
+			WSConnectionClose( wsi, wsd );
 	
 			Log( FLOG_DEBUG, "[WS] Callback LWS_CALLBACK_PROTOCOL_DESTROY\n");
-			
-			wsd->wsc_Wsi = NULL;
 		}
 		break;
 		
@@ -761,8 +970,6 @@ int ParseAndCall( WSThreadData *wstd )
 	jsmn_parser p;
 	jsmntok_t *t;
 	
-	pthread_detach( pthread_self() );
-	
 	UserSession *locus = wstd->wstd_WSD->wsc_UserSession;
 	if( locus != NULL )
 	{
@@ -858,41 +1065,21 @@ int ParseAndCall( WSThreadData *wstd )
 										if( wsreq->wr_Message != NULL && wsreq->wr_MessageSize > 0 && wsreq->wr_IsBroken == 0 )
 										{
 											DEBUG("[WS] Callback will be called again!\n");
-											if( wstd->wstd_Msg != NULL )
-											{
-												FFree( wstd->wstd_Msg );
-											}
-											wstd->wstd_Msg = wsreq->wr_Message;
-											wstd->wstd_Len = wsreq->wr_MessageSize;
 											
-											if( wstd->wstd_Http != NULL )
+											// joined message is processed as new one, current message is still used here
+											WSThreadData *joined = FCalloc( 1, sizeof( WSThreadData ) );
+											if( joined != NULL )
 											{
-												UriFree( wstd->wstd_Http->http_Uri );
-		
-												if( wstd->wstd_Http->http_RawRequestPath != NULL )
-												{
-													FFree( wstd->wstd_Http->http_RawRequestPath );
-													wstd->wstd_Http->http_RawRequestPath = NULL;
-												}
-
-												HttpFree( wstd->wstd_Http );
-												wstd->wstd_Http = NULL;
-											}
-	
-											if( wstd->wstd_Requestid != NULL )
-											{
-												FFree( wstd->wstd_Requestid );
-												wstd->wstd_Requestid = NULL;
+												joined->wstd_WSD = wstd->wstd_WSD;
+												joined->wstd_Msg = wsreq->wr_Message;
+												joined->wstd_Len = wsreq->wr_MessageSize;
+												
+												ParseAndCall( joined );
 											}
-											if( wstd->wstd_Path != NULL )
+											else
 											{
-												FFree( wstd->wstd_Path );
-												wstd->wstd_Path = NULL;
+												FFree( wsreq->wr_Message );
 											}
-	
-											BufStringDelete( wstd->wstd_Queryrawbs );
-											
-											ParseAndCall( wstd );
 											//FC_Callback( wsi, reason, user, wsreq->wr_Message, wsreq->wr_MessageSize );
 											DEBUG("[WS] Callback was called again!\n");
 										}
@@ -1002,17 +1189,10 @@ int ParseAndCall( WSThreadData *wstd )
 						// simple PING
 						if( tsize > 0 && strncmp( "ping",  in + t[ 6 ].start, tsize ) == 0 && r > 8 )
 						{
-							//WSThreadData *wstdata = FCalloc( 1, sizeof( WSThreadData ) );
-							// threads
-							pthread_t thread;
-							memset( &thread, 0, sizeof( pthread_t ) );
-
 							wstd->wstd_Requestid = StringDuplicateN( (char *)(in + t[ 8 ].start), t[ 8 ].end-t[ 8 ].start );
 
-							// Multithread mode
-							if( pthread_create( &thread, NULL,  (void *(*)(void *))WSThreadPing, ( void *)wstd ) != 0 )
-							{
-							}
+							// answer is only queued, worker does not have to wait for it. Message is released by WSThreadPing
+							WSThreadPing( wstd );
 							
 							wstd = NULL;
 						}
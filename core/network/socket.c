@@ -40,6 +40,7 @@
 #include <system/systembase.h>
 #include <sys/resource.h>
 #include <pthread.h>
+#include <sys/sendfile.h>
 
 //#undef __DEBUG
 //#define DEBUG( ...)
@@ -56,13 +57,17 @@ void SocketFree( Socket *sock );
 static int ssl_session_ctx_id = 1;
 static int ssl_sockopt_on = 1;
 
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT 15		// Linux value, hidden by strict POSIX flags used in build
+#endif
+
 /**
  * Open new socket on specified port
  *
  * @param sb pointer to SystemBase
  * @param ssl ctionset to TRUE if you want to setup secured conne
  * @param port number on which connection will be set
- * @param type of connection, for server :SOCKET_TYPE_SERVER, for client: SOCKET_TYPE_CLIENT
+ * @param type of connection, for server :SOCKET_TYPE_SERVER or SOCKET_TYPE_SERVER_REUSEPORT, for client: SOCKET_TYPE_CLIENT
  * @return Socket structure when success, otherwise NULL
  */
 
@@ -76,7 +81,7 @@ Socket* SocketNew( void *sb, FBOOL ssl, unsigned short port, int type )
 		return NULL;
 	}
 
-	if( type == SOCKET_TYPE_SERVER )
+	if( type == SOCKET_TYPE_SERVER || type == SOCKET_TYPE_SERVER_REUSEPORT )
 	{
 		if( ( sock = (Socket *) FCalloc( 1, sizeof( Socket ) ) ) != NULL )
 		{
@@ -170,10 +175,15 @@ Socket* SocketNew( void *sb, FBOOL ssl, unsigned short port, int type )
 			SocketSetBlocking( sock, FALSE );
 
 			SSL_CTX_set_mode( sock->s_Ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_AUTO_RETRY );
-			SSL_CTX_set_session_cache_mode( sock->s_Ctx, SSL_SESS_CACHE_BOTH ); // for now
-			SSL_CTX_set_options( sock->s_Ctx, SSL_OP_NO_SSLv3 | SSL_OP_NO_SSLv2 | SSL_OP_NO_TICKET | SSL_OP_ALL );
+			SSL_CTX_set_options( sock->s_Ctx, SSL_OP_NO_SSLv3 | SSL_OP_NO_SSLv2 | SSL_OP_ALL );
+#ifdef SOCKET_KTLS
+			// kernel TLS lets SSL_sendfile send files without copying them through user space
+			SSL_CTX_set_options( sock->s_Ctx, SSL_OP_ENABLE_KTLS );
+#endif
 			SSL_CTX_set_session_id_context( sock->s_Ctx, (void *)&ssl_session_ctx_id, sizeof(ssl_session_ctx_id) );
 			SSL_CTX_set_cipher_list( sock->s_Ctx, "HIGH:!aNULL:!MD5:!RC4" );
+			// session cache, tickets encrypted by keys shared with other listeners
+			TLSSessionManagerSetupContext( lsb->sl_TLSSessionManager, sock->s_Ctx );
 		}
 		else	// SSL not used
 		{
@@ -187,6 +197,18 @@ Socket* SocketNew( void *sb, FBOOL ssl, unsigned short port, int type )
 			sock->s_Interface->SocketDelete( sock );
 			return NULL;
 		}
+		
+		// kernel will balance incoming connections between all sockets bound to port
+		if( type == SOCKET_TYPE_SERVER_REUSEPORT )
+		{
+			if( setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, (char*)&ssl_sockopt_on, sizeof(ssl_sockopt_on) ) < 0 )
+			{
+				FERROR( "[SocketNew] ERROR setsockopt(SO_REUSEPORT) failed\n");
+				close( fd );
+				sock->s_Interface->SocketDelete( sock );
+				return NULL;
+			}
+		}
 
 		/*
 		struct timeval t = { 60, 0 };
@@ -2516,6 +2538,160 @@ FLONG SocketWriteSSL( Socket* sock, char* data, FLONG length )
 	return written;
 }
 
+/**
+ * Send file content through socket write function (used when zero-copy is not possible)
+ *
+ * @param sock pointer to Socket on which data will be send
+ * @param fd file descriptor of file
+ * @param offset position in file from which data will be send
+ * @param length number of bytes which will be send
+ * @return number of bytes sent
+ */
+static FQUAD SocketSendFileCopy( Socket* sock, int fd, FQUAD offset, FQUAD length )
+{
+	char *buffer = FMalloc( SOCKET_SENDFILE_BUFFER );
+	if( buffer == NULL )
+	{
+		return -1;
+	}
+	
+	FQUAD sent = 0;
+	while( sent < length )
+	{
+		FQUAD toRead = length - sent;
+		if( toRead > SOCKET_SENDFILE_BUFFER )
+		{
+			toRead = SOCKET_SENDFILE_BUFFER;
+		}
+		
+		ssize_t rd = pread( fd, buffer, toRead, offset + sent );
+		if( rd <= 0 )
+		{
+			break;
+		}
+		if( sock->s_Interface->SocketWrite( sock, buffer, rd ) != rd )
+		{
+			break;
+		}
+		sent += rd;
+	}
+	FFree( buffer );
+	
+	return sent;
+}
+
+/**
+ * Send file content to socket with sendfile, data is not copied to user space (NOSSL)
+ *
+ * @param sock pointer to Socket on which data will be send
+ * @param fd file descriptor of file
+ * @param offset position in file from which data will be send
+ * @param length number of bytes which will be send
+ * @return number of bytes sent
+ */
+FQUAD SocketSendFileNOSSL( Socket* sock, int fd, FQUAD offset, FQUAD length )
+{
+	off_t off = offset;
+	FQUAD sent = 0;
+	int retries = 0;
+	
+	while( sent < length )
+	{
+		size_t chunk = length - sent;
+		if( chunk > SOCKET_SENDFILE_CHUNK )
+		{
+			chunk = SOCKET_SENDFILE_CHUNK;
+		}
+		
+		ssize_t res = sendfile( sock->fd, fd, &off, chunk );
+		if( res > 0 )
+		{
+			sent += res;
+			retries = 0;
+		}
+		else if( res == 0 )		// end of file
+		{
+			break;
+		}
+		else
+		{
+			if( errno == EAGAIN || errno == EINTR )
+			{
+				usleep( 400 );
+				if( ++retries > 10 ) usleep( 20000 );
+				continue;
+			}
+			// file cannot be mmaped by kernel (special files), send it old way
+			if( ( errno == EINVAL || errno == ENOSYS ) && sent == 0 )
+			{
+				return SocketSendFileCopy( sock, fd, offset, length );
+			}
+			FERROR( "[SocketSendFileNOSSL] Failed to send: %d, %s\n", errno, strerror( errno ) );
+			break;
+		}
+	}
+	
+	DEBUG("[SocketSendFileNOSSL] end send %lld/%lld\n", (long long)sent, (long long)length );
+	return sent;
+}
+
+/**
+ * Send file content to socket (SSL). When kernel TLS is active on connection SSL_sendfile is used,
+ * otherwise data is encrypted in user space.
+ *
+ * @param sock pointer to Socket on which data will be send
+ * @param fd file descriptor of file
+ * @param offset position in file from which data will be send
+ * @param length number of bytes which will be send
+ * @return number of bytes sent
+ */
+FQUAD SocketSendFileSSL( Socket* sock, int fd, FQUAD offset, FQUAD length )
+{
+	if( sock->s_Ssl == NULL )
+	{
+		FERROR( "[SocketSendFileSSL] The ssl connection was dropped on this file descriptor!\n" );
+		return -1;
+	}
+	
+#ifdef SOCKET_KTLS
+	if( BIO_get_ktls_send( SSL_get_wbio( sock->s_Ssl ) ) )
+	{
+		FQUAD sent = 0;
+		int counter = 0;
+		
+		while( sent < length )
+		{
+			size_t chunk = length - sent;
+			if( chunk > SOCKET_SENDFILE_CHUNK )
+			{
+				chunk = SOCKET_SENDFILE_CHUNK;
+			}
+			
+			ossl_ssize_t res = SSL_sendfile( sock->s_Ssl, fd, offset + sent, chunk, 0 );
+			if( res > 0 )
+			{
+				sent += res;
+				counter = 0;
+			}
+			else
+			{
+				int err = SSL_get_error( sock->s_Ssl, res );
+				if( ( err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_SYSCALL ) && ( errno == EAGAIN || errno == EINTR ) && counter++ < 1000 )
+				{
+					usleep( 400 );
+					continue;
+				}
+				FERROR("[SocketSendFileSSL] Cannot send. Error %d, sent: %lld fullsize: %lld\n", err, (long long)sent, (long long)length );
+				break;
+			}
+		}
+		return sent;
+	}
+#endif
+	
+	return SocketSendFileCopy( sock, fd, offset, length );
+}
+
 /**
  * Abort write function
  *
@@ -2564,6 +2740,11 @@ void SocketDeleteNOSSL( Socket* sock )
 		DEBUG("[SocketDeleteNOSSL] socked closed: %d\n", sock->fd );
 		sock->fd = 0;
 	}
+	
+	if( sock->s_PipelineData != NULL )
+	{
+		FFree( sock->s_PipelineData );
+	}
 	FFree( sock );
 }
 
@@ -2677,5 +2858,10 @@ void SocketDeleteSSL( Socket* sock )
 		DEBUG("[SocketDeleteSSL] socked closed: %d\n", sock->fd );
 		sock->fd = 0;
 	}
+	
+	if( sock->s_PipelineData != NULL )
+	{
+		FFree( sock->s_PipelineData );
+	}
 	FFree( sock );
 }
@@ -19,6 +19,14 @@
 #include <openssl/crypto.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+
+// kernel TLS (SSL_sendfile) is available since OpenSSL 3.0
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined( OPENSSL_NO_KTLS )
+#define SOCKET_KTLS 1
+#endif
+
+#define SOCKET_SENDFILE_CHUNK		( 8 * 1024 * 1024 )		// max bytes sent by one sendfile call
+#define SOCKET_SENDFILE_BUFFER		262144					// buffer used when zero-copy is not possible
 #ifdef _WIN32
 #include <winsock2.h>
 #else
@@ -71,7 +79,8 @@ typedef void* (*SocketShutdownCallback_t)( Socket_t* sock );
 enum {
 	SOCKET_TYPE_SERVER = 0,
 	SOCKET_TYPE_CLIENT,
-	SOCKET_TYPE_CLIENT_WS
+	SOCKET_TYPE_CLIENT_WS,
+	SOCKET_TYPE_SERVER_REUSEPORT	// server socket which can share port with other sockets (SO_REUSEPORT)
 };
 
 //
@@ -156,6 +165,15 @@ typedef struct Socket
 	int                         s_SocketBlockTimeout; // How long to block on Blocking Sockets
 	
 	int							s_AcceptFlags;
+	
+	// HTTP keep-alive
+	int							s_Requests;        // Number of requests handled on this connection
+	time_t						s_LastActivity;    // When connection became idle
+	char						*s_PipelineData;   // Data of next (pipelined) request which was already read
+	int							s_PipelineSize;
+	struct Socket				*s_IdleNext;       // List of idle keep-alive connections
+	struct Socket				*s_IdlePrev;
+	FBOOL						s_Handshake;       // TLS handshake is done by main loop
 	int							(*VerifyPeer)( int ok, X509_STORE_CTX* ctx );
 
 	struct LSocketInterface_t	*s_Interface;
@@ -174,6 +192,7 @@ int					(*SocketReadBlocked)( Socket* sock, char* data, unsigned int length, uns
 int					(*SocketWaitRead)( Socket* sock, char* data, unsigned int length, unsigned int pass, int sec );
 BufString			*(*SocketReadTillEnd)( Socket* sock, unsigned int pass, int sec );
 FLONG				(*SocketWrite)( Socket* s, char* data, FLONG length );
+FQUAD				(*SocketSendFile)( Socket* s, int fd, FQUAD offset, FQUAD length );
 void				(*SocketDelete)( Socket* s );
 BufString			*(*SocketReadPackage)( Socket *sock );
 };
@@ -265,6 +284,13 @@ BufString *SocketReadTillEndSSL( Socket* sock, unsigned int pass, int sec );
 FLONG SocketWriteNOSSL( Socket* s, char* data, FLONG length );
 FLONG SocketWriteSSL( Socket* s, char* data, FLONG length );
 
+//
+// Send part of file to the socket (sendfile / SSL_sendfile, copy when zero-copy is not possible)
+//
+
+FQUAD SocketSendFileNOSSL( Socket* s, int fd, FQUAD offset, FQUAD length );
+FQUAD SocketSendFileSSL( Socket* s, int fd, FQUAD offset, FQUAD length );
+
 //
 // Request the socket to be closed (Acceptable if the other end also has closed the socket)
 //
@@ -0,0 +1,440 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ *  TLS session manager body
+ */
+
+#include "tls_session.h"
+#include <core/types.h>
+#include <system/systembase.h>
+#include <util/log/log.h>
+#include <util/string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#define TLS_SESSION_FILE_CHECK 60		// seconds between checks of key file
+
+static int tlsSessionExIndex = -1;		// SSL_CTX ex_data slot which points to manager
+
+/**
+ * Generate random ticket key
+ *
+ * @param key pointer to key which will be filled
+ * @return 0 when success, otherwise error number
+ */
+static int TLSSessionKeyGenerate( TLSSessionKey *key )
+{
+	if( RAND_bytes( key->tsk_Name, sizeof( key->tsk_Name ) ) != 1 ||
+		RAND_bytes( key->tsk_HMAC, sizeof( key->tsk_HMAC ) ) != 1 ||
+		RAND_bytes( key->tsk_AES, sizeof( key->tsk_AES ) ) != 1 )
+	{
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Load ticket keys from file. File contains 80 bytes entries (16 bytes name, 32 bytes HMAC key, 32 bytes AES key),
+ * first entry encrypts tickets. Keys from ring which are not in file are kept for decryption while there is place for them.
+ *
+ * @param tsm pointer to TLSSessionManager
+ * @param force load file even if it was not modified
+ * @return 0 when keys were loaded or file was not changed, otherwise error number
+ */
+static int TLSSessionLoadKeyFile( TLSSessionManager *tsm, FBOOL force )
+{
+	struct stat st;
+	unsigned char data[ TLS_SESSION_KEYS * TLS_SESSION_KEY_FILE_ENTRY ];
+	TLSSessionKey keys[ TLS_SESSION_KEYS ];
+	int count, i, j;
+
+	if( stat( tsm->tsm_KeyFile, &st ) != 0 )
+	{
+		FERROR("[TLSSessionLoadKeyFile] Cannot access ticket key file: %s\n", tsm->tsm_KeyFile );
+		return 1;
+	}
+
+	if( force == FALSE && st.st_mtime == tsm->tsm_KeyFileTime )
+	{
+		return 0;
+	}
+
+	if( st.st_size < TLS_SESSION_KEY_FILE_ENTRY || ( st.st_size % TLS_SESSION_KEY_FILE_ENTRY ) != 0 )
+	{
+		FERROR("[TLSSessionLoadKeyFile] Ticket key file %s size must be multiple of %d bytes\n", tsm->tsm_KeyFile, TLS_SESSION_KEY_FILE_ENTRY );
+		return 2;
+	}
+
+	FILE *fp = fopen( tsm->tsm_KeyFile, "rb" );
+	if( fp == NULL )
+	{
+		FERROR("[TLSSessionLoadKeyFile] Cannot open ticket key file: %s\n", tsm->tsm_KeyFile );
+		return 1;
+	}
+	count = fread( data, TLS_SESSION_KEY_FILE_ENTRY, TLS_SESSION_KEYS, fp );
+	fclose( fp );
+
+	if( count <= 0 )
+	{
+		FERROR("[TLSSessionLoadKeyFile] Cannot read ticket key file: %s\n", tsm->tsm_KeyFile );
+		return 3;
+	}
+
+	for( i=0 ; i < count ; i++ )
+	{
+		unsigned char *entry = data + ( i * TLS_SESSION_KEY_FILE_ENTRY );
+		memcpy( keys[ i ].tsk_Name, entry, TLS_SESSION_KEY_NAME_SIZE );
+		memcpy( keys[ i ].tsk_HMAC, entry + TLS_SESSION_KEY_NAME_SIZE, TLS_SESSION_KEY_SIZE );
+		memcpy( keys[ i ].tsk_AES, entry + TLS_SESSION_KEY_NAME_SIZE + TLS_SESSION_KEY_SIZE, TLS_SESSION_KEY_SIZE );
+	}
+	OPENSSL_cleanse( data, sizeof( data ) );
+
+	pthread_mutex_lock( &(tsm->tsm_Mutex) );
+
+	// tickets encrypted by keys removed from file are still accepted until ring is full
+	for( i=0 ; i < tsm->tsm_KeysCount && count < TLS_SESSION_KEYS ; i++ )
+	{
+		for( j=0 ; j < count ; j++ )
+		{
+			if( memcmp( keys[ j ].tsk_Name, tsm->tsm_Keys[ i ].tsk_Name, TLS_SESSION_KEY_NAME_SIZE ) == 0 )
+			{
+				break;
+			}
+		}
+		if( j == count )
+		{
+			keys[ count++ ] = tsm->tsm_Keys[ i ];
+		}
+	}
+
+	memcpy( tsm->tsm_Keys, keys, count * sizeof( TLSSessionKey ) );
+	tsm->tsm_KeysCount = count;
+	tsm->tsm_KeyFileTime = st.st_mtime;
+	tsm->tsm_Stats.tss_Rotations++;
+
+	pthread_mutex_unlock( &(tsm->tsm_Mutex) );
+
+	OPENSSL_cleanse( keys, sizeof( keys ) );
+
+	Log( FLOG_INFO, "[TLSSessionLoadKeyFile] Ticket keys loaded from %s, keys in ring %d\n", tsm->tsm_KeyFile, count );
+
+	return 0;
+}
+
+/**
+ * Session ticket callback, encrypts new tickets by current key and decrypts received tickets by key found by name
+ *
+ * @param ssl pointer to SSL connection
+ * @param name ticket key name
+ * @param iv initialization vector
+ * @param ectx cipher context
+ * @param hctx HMAC context
+ * @param enc 1 when ticket is created, 0 when it is received
+ * @return 1 when ticket is ok, 2 when ticket is ok but it must be renewed, 0 when ticket cannot be used, -1 on error
+ */
+static int TLSSessionTicketCallback( SSL *ssl, unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc )
+{
+	TLSSessionManager *tsm = SSL_CTX_get_ex_data( SSL_get_SSL_CTX( ssl ), tlsSessionExIndex );
+	TLSSessionKey key;
+	int i, pos = -1;
+
+	if( tsm == NULL )
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock( &(tsm->tsm_Mutex) );
+	if( enc == 1 )
+	{
+		if( tsm->tsm_KeysCount > 0 )
+		{
+			key = tsm->tsm_Keys[ 0 ];
+			pos = 0;
+		}
+	}
+	else
+	{
+		for( i=0 ; i < tsm->tsm_KeysCount ; i++ )
+		{
+			if( memcmp( name, tsm->tsm_Keys[ i ].tsk_Name, TLS_SESSION_KEY_NAME_SIZE ) == 0 )
+			{
+				key = tsm->tsm_Keys[ i ];
+				pos = i;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock( &(tsm->tsm_Mutex) );
+
+	if( pos < 0 )
+	{
+		if( enc == 0 )
+		{
+			__sync_fetch_and_add( &(tsm->tsm_Stats.tss_TicketsUnknown), 1 );
+		}
+		return 0;
+	}
+
+	if( enc == 1 )
+	{
+		if( RAND_bytes( iv, EVP_CIPHER_iv_length( EVP_aes_256_cbc() ) ) != 1 )
+		{
+			OPENSSL_cleanse( &key, sizeof( key ) );
+			return -1;
+		}
+		memcpy( name, key.tsk_Name, TLS_SESSION_KEY_NAME_SIZE );
+
+		if( EVP_EncryptInit_ex( ectx, EVP_aes_256_cbc(), NULL, key.tsk_AES, iv ) != 1 ||
+			HMAC_Init_ex( hctx, key.tsk_HMAC, TLS_SESSION_KEY_SIZE, EVP_sha256(), NULL ) != 1 )
+		{
+			OPENSSL_cleanse( &key, sizeof( key ) );
+			return -1;
+		}
+		__sync_fetch_and_add( &(tsm->tsm_Stats.tss_TicketsIssued), 1 );
+	}
+	else
+	{
+		if( HMAC_Init_ex( hctx, key.tsk_HMAC, TLS_SESSION_KEY_SIZE, EVP_sha256(), NULL ) != 1 ||
+			EVP_DecryptInit_ex( ectx, EVP_aes_256_cbc(), NULL, key.tsk_AES, iv ) != 1 )
+		{
+			OPENSSL_cleanse( &key, sizeof( key ) );
+			return -1;
+		}
+		if( pos > 0 )
+		{
+			__sync_fetch_and_add( &(tsm->tsm_Stats.tss_TicketsRenewed), 1 );
+		}
+	}
+	OPENSSL_cleanse( &key, sizeof( key ) );
+
+	// ticket encrypted by older key is accepted and replaced by new one
+	return pos == 0 ? 1 : 2;
+}
+
+/**
+ * Info callback, counts full and resumed handshakes
+ *
+ * @param ssl pointer to SSL connection
+ * @param where state flags
+ * @param ret return code
+ */
+static void TLSSessionInfoCallback( const SSL *ssl, int where, int ret )
+{
+	if( ( where & SSL_CB_HANDSHAKE_DONE ) == 0 )
+	{
+		return;
+	}
+
+	TLSSessionManager *tsm = SSL_CTX_get_ex_data( SSL_get_SSL_CTX( ssl ), tlsSessionExIndex );
+	if( tsm != NULL )
+	{
+		if( SSL_session_reused( (SSL *)ssl ) )
+		{
+			__sync_fetch_and_add( &(tsm->tsm_Stats.tss_ResumedHandshakes), 1 );
+		}
+		else
+		{
+			__sync_fetch_and_add( &(tsm->tsm_Stats.tss_FullHandshakes), 1 );
+		}
+	}
+}
+
+/**
+ * Create TLSSessionManager and first ticket keys
+ *
+ * @param sb pointer to SystemBase
+ * @return pointer to new TLSSessionManager or NULL when error appear
+ */
+TLSSessionManager *TLSSessionManagerNew( void *sb )
+{
+	SystemBase *locsb = (SystemBase *)sb;
+	TLSSessionManager *tsm;
+
+	if( ( tsm = FCalloc( 1, sizeof( TLSSessionManager ) ) ) != NULL )
+	{
+		tsm->tsm_SB = sb;
+		tsm->tsm_Tickets = TRUE;
+		tsm->tsm_Rotation = TLS_SESSION_ROTATION;
+
+		struct PropertiesInterface *plib = &( locsb->sl_PropertiesInterface );
+		char *fhome = getenv( "FRIEND_HOME" );
+		char coresPath[ 1024 ];
+		snprintf( coresPath, sizeof(coresPath), "%s/cfg/cfg.ini", fhome );
+
+		Props *prop = plib->Open( coresPath );
+		if( prop != NULL )
+		{
+			tsm->tsm_Tickets = plib->ReadIntNCS( prop, "core:sslsessiontickets", 1 ) != 0;
+			tsm->tsm_KeyFile = StringDuplicate( plib->ReadStringNCS( prop, "core:sslticketkeyfile", NULL ) );
+			tsm->tsm_Rotation = plib->ReadIntNCS( prop, "core:sslticketrotation", tsm->tsm_KeyFile != NULL ? TLS_SESSION_FILE_CHECK : TLS_SESSION_ROTATION );
+
+			plib->Close( prop );
+		}
+
+		if( tsm->tsm_Rotation <= 0 )
+		{
+			tsm->tsm_Rotation = TLS_SESSION_ROTATION;
+		}
+
+		pthread_mutex_init( &(tsm->tsm_Mutex), NULL );
+
+		if( tlsSessionExIndex < 0 )
+		{
+			tlsSessionExIndex = SSL_CTX_get_ex_new_index( 0, NULL, NULL, NULL, NULL );
+		}
+
+		if( tsm->tsm_Tickets == TRUE )
+		{
+			if( tsm->tsm_KeyFile == NULL || TLSSessionLoadKeyFile( tsm, TRUE ) != 0 )
+			{
+				if( tsm->tsm_KeyFile != NULL )
+				{
+					Log( FLOG_ERROR, "[TLSSessionManagerNew] Ticket key file %s cannot be used, keys will be generated\n", tsm->tsm_KeyFile );
+				}
+				if( TLSSessionKeyGenerate( &(tsm->tsm_Keys[ 0 ]) ) == 0 )
+				{
+					tsm->tsm_KeysCount = 1;
+				}
+				else
+				{
+					Log( FLOG_ERROR, "[TLSSessionManagerNew] Cannot generate ticket key, session tickets disabled\n" );
+					tsm->tsm_Tickets = FALSE;
+				}
+			}
+		}
+
+		Log( FLOG_INFO, "[TLSSessionManagerNew] Session tickets %s, key file %s, rotation %d seconds\n", tsm->tsm_Tickets ? "enabled" : "disabled", tsm->tsm_KeyFile != NULL ? tsm->tsm_KeyFile : "none", tsm->tsm_Rotation );
+	}
+	return tsm;
+}
+
+/**
+ * Delete TLSSessionManager, keys are wiped
+ *
+ * @param tsm pointer to TLSSessionManager
+ */
+void TLSSessionManagerDelete( TLSSessionManager *tsm )
+{
+	if( tsm == NULL )
+	{
+		return;
+	}
+
+	Log( FLOG_INFO, "[TLSSessionManagerDelete] Handshakes full %lu resumed %lu, tickets issued %lu renewed %lu unknown %lu\n", tsm->tsm_Stats.tss_FullHandshakes, tsm->tsm_Stats.tss_ResumedHandshakes, tsm->tsm_Stats.tss_TicketsIssued, tsm->tsm_Stats.tss_TicketsRenewed, tsm->tsm_Stats.tss_TicketsUnknown );
+
+	OPENSSL_cleanse( tsm->tsm_Keys, sizeof( tsm->tsm_Keys ) );
+	pthread_mutex_destroy( &(tsm->tsm_Mutex) );
+
+	if( tsm->tsm_KeyFile != NULL )
+	{
+		FFree( tsm->tsm_KeyFile );
+	}
+	FFree( tsm );
+}
+
+/**
+ * Setup server SSL_CTX. Tickets are encrypted by shared keys, handshakes are counted.
+ *
+ * @param tsm pointer to TLSSessionManager
+ * @param ctx pointer to server SSL_CTX
+ */
+void TLSSessionManagerSetupContext( TLSSessionManager *tsm, SSL_CTX *ctx )
+{
+	if( tsm == NULL || ctx == NULL )
+	{
+		return;
+	}
+
+	SSL_CTX_set_ex_data( ctx, tlsSessionExIndex, tsm );
+	SSL_CTX_set_info_callback( ctx, TLSSessionInfoCallback );
+	SSL_CTX_set_session_cache_mode( ctx, SSL_SESS_CACHE_SERVER );
+
+	if( tsm->tsm_Tickets == TRUE )
+	{
+		SSL_CTX_clear_options( ctx, SSL_OP_NO_TICKET );
+		SSL_CTX_set_tlsext_ticket_key_cb( ctx, TLSSessionTicketCallback );
+		// ticket is accepted while its key is in ring
+		SSL_CTX_set_timeout( ctx, ( tsm->tsm_KeyFile != NULL ? TLS_SESSION_ROTATION : tsm->tsm_Rotation ) * ( TLS_SESSION_KEYS - 1 ) );
+	}
+	else
+	{
+		SSL_CTX_set_options( ctx, SSL_OP_NO_TICKET );
+	}
+
+	__sync_fetch_and_add( &(tsm->tsm_Stats.tss_Contexts), 1 );
+}
+
+/**
+ * Rotate ticket keys. New key is generated and oldest one is removed,
+ * when key file is used it is loaded again if it was modified.
+ *
+ * @param tsm pointer to TLSSessionManager
+ */
+void TLSSessionManagerRotate( TLSSessionManager *tsm )
+{
+	TLSSessionKey key;
+
+	if( tsm == NULL || tsm->tsm_Tickets == FALSE )
+	{
+		return;
+	}
+
+	if( tsm->tsm_KeyFile != NULL )
+	{
+		TLSSessionLoadKeyFile( tsm, FALSE );
+		return;
+	}
+
+	if( TLSSessionKeyGenerate( &key ) != 0 )
+	{
+		FERROR("[TLSSessionManagerRotate] Cannot generate ticket key\n");
+		return;
+	}
+
+	pthread_mutex_lock( &(tsm->tsm_Mutex) );
+	memmove( &(tsm->tsm_Keys[ 1 ]), &(tsm->tsm_Keys[ 0 ]), ( TLS_SESSION_KEYS - 1 ) * sizeof( TLSSessionKey ) );
+	tsm->tsm_Keys[ 0 ] = key;
+	if( tsm->tsm_KeysCount < TLS_SESSION_KEYS )
+	{
+		tsm->tsm_KeysCount++;
+	}
+	tsm->tsm_Stats.tss_Rotations++;
+	pthread_mutex_unlock( &(tsm->tsm_Mutex) );
+
+	OPENSSL_cleanse( &key, sizeof( key ) );
+
+	DEBUG("[TLSSessionManagerRotate] Ticket key rotated, keys in ring %d\n", tsm->tsm_KeysCount );
+}
+
+/**
+ * Get TLS session statistics
+ *
+ * @param tsm pointer to TLSSessionManager
+ * @param st pointer to structure which will be filled
+ */
+void TLSSessionManagerGetStats( TLSSessionManager *tsm, TLSSessionStats *st )
+{
+	memset( st, 0, sizeof( TLSSessionStats ) );
+	if( tsm == NULL )
+	{
+		return;
+	}
+
+	pthread_mutex_lock( &(tsm->tsm_Mutex) );
+	*st = tsm->tsm_Stats;
+	st->tss_Keys = tsm->tsm_KeysCount;
+	pthread_mutex_unlock( &(tsm->tsm_Mutex) );
+}
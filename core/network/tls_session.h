@@ -0,0 +1,110 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ *  TLS session manager
+ *
+ *  Keeps ring of session ticket keys which is shared by all server TLS
+ *  contexts (HTTP, websockets, communication service). Newest key encrypts
+ *  tickets, older keys are only used to decrypt them. Keys are generated
+ *  in memory or loaded from file (same file on all servers behind load
+ *  balancer lets them resume sessions of each other) and rotated by event.
+ */
+
+#ifndef __NETWORK_TLS_SESSION_H__
+#define __NETWORK_TLS_SESSION_H__
+
+#include <core/types.h>
+#include <pthread.h>
+#include <openssl/ssl.h>
+
+#define TLS_SESSION_KEYS 3						// current key and keys accepted for decryption
+#define TLS_SESSION_ROTATION 43200				// seconds between key rotations
+#define TLS_SESSION_KEY_NAME_SIZE 16
+#define TLS_SESSION_KEY_SIZE 32
+#define TLS_SESSION_KEY_FILE_ENTRY ( TLS_SESSION_KEY_NAME_SIZE + 2 * TLS_SESSION_KEY_SIZE )	// name, HMAC key, AES key
+
+//
+// ticket key
+//
+
+typedef struct TLSSessionKey
+{
+	unsigned char			tsk_Name[ TLS_SESSION_KEY_NAME_SIZE ];
+	unsigned char			tsk_HMAC[ TLS_SESSION_KEY_SIZE ];
+	unsigned char			tsk_AES[ TLS_SESSION_KEY_SIZE ];
+}TLSSessionKey;
+
+//
+// statistics
+//
+
+typedef struct TLSSessionStats
+{
+	FULONG					tss_FullHandshakes;
+	FULONG					tss_ResumedHandshakes;
+	FULONG					tss_TicketsIssued;
+	FULONG					tss_TicketsRenewed;		// ticket encrypted by older key was replaced
+	FULONG					tss_TicketsUnknown;		// ticket key not found in ring
+	FULONG					tss_Rotations;
+	int						tss_Keys;
+	int						tss_Contexts;
+}TLSSessionStats;
+
+//
+// manager
+//
+
+typedef struct TLSSessionManager
+{
+	void					*tsm_SB;
+	FBOOL					tsm_Tickets;			// session tickets enabled
+	char					*tsm_KeyFile;			// NULL - keys are generated
+	int						tsm_Rotation;			// seconds
+	time_t					tsm_KeyFileTime;		// modification time of loaded key file
+
+	TLSSessionKey			tsm_Keys[ TLS_SESSION_KEYS ];	// first key encrypts tickets
+	int						tsm_KeysCount;
+	pthread_mutex_t			tsm_Mutex;
+
+	TLSSessionStats			tsm_Stats;
+}TLSSessionManager;
+
+//
+//
+//
+
+TLSSessionManager *TLSSessionManagerNew( void *sb );
+
+//
+//
+//
+
+void TLSSessionManagerDelete( TLSSessionManager *tsm );
+
+//
+// enable tickets and handshake statistics on server SSL_CTX
+//
+
+void TLSSessionManagerSetupContext( TLSSessionManager *tsm, SSL_CTX *ctx );
+
+//
+// new ticket key (or reload of key file), called by event
+//
+
+void TLSSessionManagerRotate( TLSSessionManager *tsm );
+
+//
+//
+//
+
+void TLSSessionManagerGetStats( TLSSessionManager *tsm, TLSSessionStats *st );
+
+#endif // __NETWORK_TLS_SESSION_H__
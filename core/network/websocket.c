@@ -34,6 +34,7 @@
 #include <util/log/log.h>
 #include <core/thread.h>
 #include <core/friendcore_manager.h>
+#include <core/worker_manager.h>
 #include <core/types.h>
 #include <network/socket.h>
 #include <network/http.h>
@@ -59,6 +60,7 @@
 #endif
 
 extern pthread_mutex_t WSThreadMutex;
+extern SystemBase *SLIB;
 
 static void dump_handshake_info(struct lws_tokens *lwst);
 
@@ -121,9 +123,18 @@ static struct lws_protocols protocols[] = {
 	{
 		"FC-protocol",
 		FC_Callback,
-		sizeof( struct WSCData ),
+		0,				// WSCData is allocated by WSCDataNew, it can live longer then connection
 		WS_PROTOCOL_BUFFER_SIZE,
-		2,
+		WEBSOCKET_PROTOCOL_ID_FC,
+		NULL,
+		WS_PROTOCOL_BUFFER_SIZE
+	},
+	{
+		"FC-protocol-binary",	// same as FC-protocol, but big messages are sent as binary fragments, not as base64 chunks
+		FC_Callback,
+		0,
+		WS_PROTOCOL_BUFFER_SIZE,
+		WEBSOCKET_PROTOCOL_ID_FC_BINARY,
 		NULL,
 		WS_PROTOCOL_BUFFER_SIZE
 	},
@@ -133,6 +144,21 @@ static struct lws_protocols protocols[] = {
 };
 
 
+#ifndef LWS_WITHOUT_EXTENSIONS
+//
+// extensions offered on desktop websockets
+//
+
+static const struct lws_extension extensions[] = {
+	{
+		"permessage-deflate",
+		lws_extension_callback_pm_deflate,
+		"permessage-deflate; client_no_context_takeover; client_max_window_bits"
+	},
+	{ NULL, NULL, NULL }		// End of list
+};
+#endif
+
 // list of supported protocols and callbacks 
 
 static struct lws_protocols protocols1[] = {
@@ -192,8 +218,15 @@ void hand(int s )
 	DEBUG("[WS] Signal handler %d\n", s);
 }
 
+//
+// index of service thread which runs current callback, -1 - not service thread.
+// Callbacks broadcast by libwebsockets (LWS_CALLBACK_EVENT_WAIT_CANCELLED) get wsi without tsi set
+//
+
+static __thread int s_ServiceThreadIndex = -1;
+
 /**
- * Main Websockets thread
+ * Websockets service thread, serves connections which libwebsockets assigned to its service thread index
  *
  * @param data pointer to Websockets thread
  * @return 0 when success, otherwise error number
@@ -201,28 +234,32 @@ void hand(int s )
 int WebsocketThread( FThread *data )
 {
 	int cnt = 0;
-	WebSocket *ws = (WebSocket *)data->t_Data;
+	WebSocketServiceThread *wst = (WebSocketServiceThread *)data->t_Data;
+	WebSocket *ws = (WebSocket *)wst->wst_WebSocket;
 	if( ws->ws_Context == NULL )
 	{
 		Log( FLOG_ERROR, "[WebsocketThread] WsContext is empty\n");
+		data->t_Launched = FALSE;
 		return 0;
 	}
 	
-	DEBUG1("[WS] Websocket thread started\n");
+	DEBUG1("[WS] Websocket thread %d started\n", wst->wst_Index );
 	
 	//signal( SIGPIPE, SIG_IGN );
 	//signal( SIGPIPE, hand );
 
-	if( ws->ws_ExtendedDebug )
+	if( ws->ws_ExtendedDebug && wst->wst_Index == 0 )
 	{
 		lws_set_log_level( LLL_ERR | LLL_WARN | LLL_NOTICE | LLL_INFO | LLL_DEBUG , NULL );
 	}
 	
-	Log( FLOG_INFO, "[WS] Service will be started now\n" );
+	Log( FLOG_INFO, "[WS] Service %d will be started now\n", wst->wst_Index );
+	
+	s_ServiceThreadIndex = wst->wst_Index;
 
 	while( TRUE )
 	{
-		int n = lws_service( ws->ws_Context, 50 );
+		int n = lws_service_tsi( ws->ws_Context, 50, wst->wst_Index );
 		
 		if( ws->ws_Quit == TRUE && ws->ws_NumberCalls <= 0 )
 		{
@@ -241,7 +278,7 @@ int WebsocketThread( FThread *data )
 			}
 		}
 	}
-	Log( FLOG_INFO, "[WS] Service stopped\n" );
+	Log( FLOG_INFO, "[WS] Service %d stopped\n", wst->wst_Index );
 
 done:
 	data->t_Launched = FALSE;
@@ -249,18 +286,232 @@ done:
 }
 
 /**
- * Websocket start thread function
+ * Websocket start thread function, one thread is started for every libwebsockets service thread index
  *
  * @param ws pointer to WebSocket structure
  * @return 0 when success, otherwise error number
  */
 int WebSocketStart( WebSocket *ws )
 {
-	DEBUG1("[WS] Starting websocket thread\n");
-	ws->ws_Thread = ThreadNew( WebsocketThread, ws, TRUE, NULL );
+	int i;
+	
+	DEBUG1("[WS] Starting websocket threads: %d\n", ws->ws_ThreadsCount );
+	for( i=0 ; i < ws->ws_ThreadsCount ; i++ )
+	{
+		ws->ws_ServiceThreads[ i ].wst_Thread = ThreadNew( WebsocketThread, &(ws->ws_ServiceThreads[ i ]), TRUE, NULL );
+	}
 	return 0;
 }
 
+/**
+ * Create connection data and attach it to libwebsockets connection (LWS_CALLBACK_ESTABLISHED).
+ * Data is not allocated by libwebsockets, because workers and writers can still use it when connection is closed.
+ *
+ * @param wsi pointer to lws
+ * @return pointer to new WSCData or NULL when error appear
+ */
+WSCData *WSCDataNew( struct lws *wsi )
+{
+	WSCData *wsd = FCalloc( 1, sizeof( WSCData ) );
+	if( wsd == NULL )
+	{
+		FERROR("[WSCDataNew] Cannot allocate memory for WSCData\n");
+		return NULL;
+	}
+	
+	if( ( wsd->wsc_Buffer = BufStringNew() ) == NULL )
+	{
+		FERROR("[WSCDataNew] Cannot allocate memory for buffer\n");
+		FFree( wsd );
+		return NULL;
+	}
+	
+	pthread_mutex_init( &(wsd->wsc_Mutex), NULL );
+	wsd->wsc_Refs = 1;			// released when connection is closed
+	wsd->wsc_Wsi = wsi;
+	wsd->wsc_Tsi = lws_get_tsi( wsi );
+	wsd->wsc_WebSocket = lws_context_user( lws_get_context( wsi ) );
+	wsd->wsc_Binary = ( lws_get_protocol( wsi )->id == WEBSOCKET_PROTOCOL_ID_FC_BINARY );
+	
+	lws_set_wsi_user( wsi, wsd );
+	
+#ifndef LWS_WITHOUT_EXTENSIONS
+	// deflate streams are created with first compressed message, settings can be changed till then
+	WebSocket *ws = (WebSocket *)wsd->wsc_WebSocket;
+	if( ws != NULL && ws->ws_DeflateLevel > 0 )
+	{
+		char val[ 16 ];
+		
+		snprintf( val, sizeof( val ), "%d", ws->ws_DeflateLevel );
+		lws_set_extension_option( wsi, "permessage-deflate", "compression_level", val );
+		snprintf( val, sizeof( val ), "%d", ws->ws_DeflateMemLevel );
+		lws_set_extension_option( wsi, "permessage-deflate", "mem_level", val );
+	}
+#endif
+	
+	return wsd;
+}
+
+/**
+ * Take reference to connection data
+ *
+ * @param wsd pointer to WSCData
+ */
+void WSCDataAcquire( WSCData *wsd )
+{
+	__sync_fetch_and_add( &(wsd->wsc_Refs), 1 );
+}
+
+/**
+ * Drop reference to connection data, last reference releases it
+ *
+ * @param wsd pointer to WSCData
+ */
+void WSCDataRelease( WSCData *wsd )
+{
+	if( __sync_sub_and_fetch( &(wsd->wsc_Refs), 1 ) > 0 )
+	{
+		return;
+	}
+	
+	DEBUG("[WSCDataRelease] Release connection data %p\n", wsd );
+	
+	if( wsd->wsc_Buffer != NULL )
+	{
+		BufStringDelete( wsd->wsc_Buffer );
+	}
+	pthread_mutex_destroy( &(wsd->wsc_Mutex) );
+	FFree( wsd );
+}
+
+/**
+ * Ask service thread which serves connection to call writable callback. libwebsockets allows to call
+ * lws_callback_on_writable only from service thread of connection, so connection is put on list of
+ * its service thread and only this thread is woken up.
+ *
+ * @param wsd pointer to WSCData
+ */
+void WebSocketRequestWritable( WSCData *wsd )
+{
+	WebSocket *ws = (WebSocket *)wsd->wsc_WebSocket;
+	if( ws == NULL || ws->ws_ServiceThreads == NULL || wsd->wsc_Tsi >= ws->ws_ThreadsCount )
+	{
+		return;
+	}
+	
+	WebSocketServiceThread *wst = &(ws->ws_ServiceThreads[ wsd->wsc_Tsi ]);
+	
+	// wsi is released by service thread after LWS_CALLBACK_CLOSED which clears wsc_Wsi under this mutex
+	pthread_mutex_lock( &(wsd->wsc_Mutex) );
+	if( wsd->wsc_Wsi != NULL )
+	{
+		FBOOL wake = FALSE;
+		
+		pthread_mutex_lock( &(wst->wst_Mutex) );
+		if( wsd->wsc_WritePending == FALSE )
+		{
+			wsd->wsc_WritePending = TRUE;
+			wsd->wsc_WriteNext = wst->wst_Writable;
+			wst->wst_Writable = wsd;
+			wake = TRUE;
+		}
+		pthread_mutex_unlock( &(wst->wst_Mutex) );
+		
+		// when connection is already on list, service thread was woken up and did not take list yet
+		if( wake == TRUE )
+		{
+			lws_cancel_service_pt( wsd->wsc_Wsi );
+		}
+	}
+	pthread_mutex_unlock( &(wsd->wsc_Mutex) );
+}
+
+/**
+ * Call writable callbacks requested for service thread (LWS_CALLBACK_EVENT_WAIT_CANCELLED)
+ *
+ * @param wsi pointer to lws, fake wsi of service thread which was woken up (only context is valid)
+ */
+void WebSocketServiceWritable( struct lws *wsi )
+{
+	WebSocket *ws = (WebSocket *)lws_context_user( lws_get_context( wsi ) );
+	int tsi = s_ServiceThreadIndex;
+	
+	if( ws == NULL || ws->ws_ServiceThreads == NULL || tsi < 0 || tsi >= ws->ws_ThreadsCount )
+	{
+		return;
+	}
+	
+	WebSocketServiceThread *wst = &(ws->ws_ServiceThreads[ tsi ]);
+	
+	// connections stay marked as pending till they are served, so other threads do not touch wsc_WriteNext.
+	// Connections are closed only by this thread, so nobody can release them in meantime
+	pthread_mutex_lock( &(wst->wst_Mutex) );
+	WSCData *wsd = wst->wst_Writable;
+	wst->wst_Writable = NULL;
+	pthread_mutex_unlock( &(wst->wst_Mutex) );
+	
+	while( wsd != NULL )
+	{
+		WSCData *next = wsd->wsc_WriteNext;
+		
+		pthread_mutex_lock( &(wst->wst_Mutex) );
+		wsd->wsc_WriteNext = NULL;
+		wsd->wsc_WritePending = FALSE;
+		pthread_mutex_unlock( &(wst->wst_Mutex) );
+		
+		pthread_mutex_lock( &(wsd->wsc_Mutex) );
+		if( wsd->wsc_Wsi != NULL )
+		{
+			// worker processed enough messages, connection can be read again
+			if( wsd->wsc_RxResume == TRUE )
+			{
+				DEBUG("[WebSocketServiceWritable] Resume reading from connection %p, service thread %d\n", wsd->wsc_Wsi, tsi );
+				wsd->wsc_RxResume = FALSE;
+				wsd->wsc_RxPaused = FALSE;
+				lws_rx_flow_control( wsd->wsc_Wsi, 1 );
+			}
+			lws_callback_on_writable( wsd->wsc_Wsi );
+		}
+		pthread_mutex_unlock( &(wsd->wsc_Mutex) );
+		
+		wsd = next;
+	}
+}
+
+/**
+ * Remove connection from writable list of its service thread, called when connection is closed
+ *
+ * @param wsd pointer to WSCData
+ */
+void WebSocketCancelWritable( WSCData *wsd )
+{
+	WebSocket *ws = (WebSocket *)wsd->wsc_WebSocket;
+	if( ws == NULL || ws->ws_ServiceThreads == NULL || wsd->wsc_Tsi >= ws->ws_ThreadsCount )
+	{
+		return;
+	}
+	
+	WebSocketServiceThread *wst = &(ws->ws_ServiceThreads[ wsd->wsc_Tsi ]);
+	
+	pthread_mutex_lock( &(wst->wst_Mutex) );
+	if( wsd->wsc_WritePending == TRUE )
+	{
+		WSCData **prev = &(wst->wst_Writable);
+		while( *prev != NULL )
+		{
+			if( *prev == wsd )
+			{
+				*prev = wsd->wsc_WriteNext;
+				break;
+			}
+			prev = &((*prev)->wsc_WriteNext);
+		}
+		wsd->wsc_WritePending = FALSE;
+		wsd->wsc_WriteNext = NULL;
+	}
+	pthread_mutex_unlock( &(wst->wst_Mutex) );
+}
+
 /**
  * Create WebSocket structure
  *
@@ -275,6 +526,7 @@ WebSocket *WebSocketNew( void *sb,  int port, FBOOL sslOn, int proto, FBOOL extD
 {
 	WebSocket *ws = NULL;
 	SystemBase *lsb = (SystemBase *)sb;
+	int n;
 	
 	DEBUG1("[WS] New websocket\n");
 	
@@ -326,6 +578,16 @@ WebSocket *WebSocketNew( void *sb,  int port, FBOOL sslOn, int proto, FBOOL extD
 		ws->ws_Info.gid = -1;
 		ws->ws_Info.uid = -1;
 		ws->ws_Info.extensions = NULL;
+#ifndef LWS_WITHOUT_EXTENSIONS
+		if( proto == 0 && ((FriendCoreManager *)lsb->fcm)->fcm_WSDeflate == TRUE )
+		{
+			FriendCoreManager *fcm = (FriendCoreManager *)lsb->fcm;
+			
+			ws->ws_Info.extensions = extensions;
+			ws->ws_DeflateLevel = ( fcm->fcm_WSDeflateLevel >= 1 && fcm->fcm_WSDeflateLevel <= 9 ) ? fcm->fcm_WSDeflateLevel : WEBSOCKET_DEFLATE_LEVEL;
+			ws->ws_DeflateMemLevel = ( fcm->fcm_WSDeflateMemLevel >= 1 && fcm->fcm_WSDeflateMemLevel <= 9 ) ? fcm->fcm_WSDeflateMemLevel : WEBSOCKET_DEFLATE_MEM_LEVEL;
+		}
+#endif
 		ws->ws_Info.ssl_cert_filepath = ws->ws_CertPath;
 		ws->ws_Info.ssl_private_key_filepath = ws->ws_KeyPath;
 		ws->ws_Info.options = ws->ws_Opts;// | LWS_SERVER_OPTION_REQUIRE_VALID_OPENSSL_CLIENT_CERT;
@@ -338,6 +600,25 @@ WebSocket *WebSocketNew( void *sb,  int port, FBOOL sslOn, int proto, FBOOL extD
 		
 		ws->ws_Info.user = ws;
 		
+		// desktop connections are served by many threads, libwebsockets assigns every new connection to least used one
+		if( proto == 0 )
+		{
+			int threads = ((FriendCoreManager *)lsb->fcm)->fcm_WSThreads;
+			if( threads <= 0 )
+			{
+				threads = (int)sysconf( _SC_NPROCESSORS_ONLN );
+			}
+			if( threads > WEBSOCKET_SERVICE_THREADS_MAX )
+			{
+				threads = WEBSOCKET_SERVICE_THREADS_MAX;
+			}
+			ws->ws_Info.count_threads = threads > 0 ? threads : 1;
+		}
+		else
+		{
+			ws->ws_Info.count_threads = 1;
+		}
+		
 		//ws->ws_Info.extensions = lws_get_internal_extensions();
 		//ws->ws_Info.extensions->per_context_private_data = ws;
 		//ws->ws_Info.ssl_cipher_list = "ALL";
@@ -370,6 +651,44 @@ WebSocket *WebSocketNew( void *sb,  int port, FBOOL sslOn, int proto, FBOOL extD
 			return NULL;
 		}
 		
+		// messages from desktop connections are processed by pool, every connection is served by one worker at time
+		if( proto == 0 )
+		{
+			FriendCoreManager *fcm = (FriendCoreManager *)lsb->fcm;
+			
+			ws->ws_QueueMax = fcm->fcm_WSMaxQueue > 0 ? fcm->fcm_WSMaxQueue : WEBSOCKET_CONNECTION_QUEUE_SIZE;
+			ws->ws_Workers = WorkerManagerNewPool( fcm->fcm_WSWorkers, fcm->fcm_WSWorkersQueue, fcm->fcm_HttpStackSize );
+			if( ws->ws_Workers == NULL )
+			{
+				Log( FLOG_ERROR, "[WebSocketNew] Cannot create worker pool\n" );
+				lws_context_destroy( ws->ws_Context );
+				FFree( ws );
+				return NULL;
+			}
+		}
+		
+		// libwebsockets limits number of threads to LWS_MAX_SMP
+		ws->ws_ThreadsCount = lws_get_count_threads( ws->ws_Context );
+		if( ( ws->ws_ServiceThreads = FCalloc( ws->ws_ThreadsCount, sizeof( WebSocketServiceThread ) ) ) == NULL )
+		{
+			Log( FLOG_ERROR, "[WebSocketNew] Cannot allocate memory for service threads\n" );
+			lws_context_destroy( ws->ws_Context );
+			if( ws->ws_Workers != NULL )
+			{
+				WorkerManagerDelete( ws->ws_Workers );
+			}
+			FFree( ws );
+			return NULL;
+		}
+		for( n=0 ; n < ws->ws_ThreadsCount ; n++ )
+		{
+			ws->ws_ServiceThreads[ n ].wst_WebSocket = ws;
+			ws->ws_ServiceThreads[ n ].wst_Index = n;
+			pthread_mutex_init( &(ws->ws_ServiceThreads[ n ].wst_Mutex), NULL );
+		}
+		
+		Log( FLOG_INFO, "[WebSocketNew] Websocket port %d service threads %d (requested %d)\n", ws->ws_Port, ws->ws_ThreadsCount, ws->ws_Info.count_threads );
+		
 		INFO("[WS] NEW Websockets ptr %p context %p\n", ws, ws->ws_Context);
 	}
 	else
@@ -394,11 +713,20 @@ void WebSocketDelete( WebSocket* ws )
 		ws->ws_Quit = TRUE;
 		DEBUG("[WS] Websocket close in progress\n");
 		int tries = 0;
+		int n;
 		
 #ifdef ENABLE_WEBSOCKETS_THREADS
 		while( TRUE )
 		{
-			if( ws->ws_NumberCalls <= 0 && ws->ws_Thread->t_Launched == FALSE )
+			int i, launched = 0;
+			for( i=0 ; i < ws->ws_ThreadsCount ; i++ )
+			{
+				if( ws->ws_ServiceThreads[ i ].wst_Thread != NULL && ws->ws_ServiceThreads[ i ].wst_Thread->t_Launched == TRUE )
+				{
+					launched++;
+				}
+			}
+			if( ws->ws_NumberCalls <= 0 && launched == 0 )
 			{
 				break;
 			}
@@ -414,12 +742,15 @@ void WebSocketDelete( WebSocket* ws )
 			}
 		}
 #endif
-		Log( FLOG_DEBUG, "[WS] Closing thread\n");
+		Log( FLOG_DEBUG, "[WS] Closing threads\n");
 		
-		if( ws->ws_Thread )
+		for( n=0 ; n < ws->ws_ThreadsCount ; n++ )
 		{
-			ThreadDelete( ws->ws_Thread );
-			ws->ws_Thread = NULL;
+			if( ws->ws_ServiceThreads[ n ].wst_Thread != NULL )
+			{
+				ThreadDelete( ws->ws_ServiceThreads[ n ].wst_Thread );
+				ws->ws_ServiceThreads[ n ].wst_Thread = NULL;
+			}
 		}
 		
 		pthread_mutex_destroy( &(ws->ws_Mutex) );
@@ -434,6 +765,24 @@ void WebSocketDelete( WebSocket* ws )
 			DEBUG( "[WS] context destroyed\n");
 		}
 		
+		// lws_context_destroy closed all connections (LWS_CALLBACK_CLOSED cleared wsc_Wsi), so workers cannot touch wsi anymore.
+		// Workers finish jobs which are still queued, those jobs drop messages and release their WSCDataAcquire reference
+		if( ws->ws_Workers != NULL )
+		{
+			WorkerManagerDelete( ws->ws_Workers );
+			ws->ws_Workers = NULL;
+		}
+		
+		// connections were closed by lws_context_destroy, writable lists are empty
+		if( ws->ws_ServiceThreads != NULL )
+		{
+			for( n=0 ; n < ws->ws_ThreadsCount ; n++ )
+			{
+				pthread_mutex_destroy( &(ws->ws_ServiceThreads[ n ].wst_Mutex) );
+			}
+			FFree( ws->ws_ServiceThreads );
+		}
+		
 		if( ws->ws_CertPath != NULL )
 		{
 		}
@@ -476,6 +825,14 @@ static int callback_http( struct lws *wsi __attribute__((unused)), enum lws_call
 		// if we returned non-zero from here, we kill the connection 
 		break;
 
+	//
+	// vhost SSL_CTX is passed in user, it gets the same ticket keys as HTTP and CommService listeners
+	//
+
+	case LWS_CALLBACK_OPENSSL_LOAD_EXTRA_SERVER_VERIFY_CERTS:
+		TLSSessionManagerSetupContext( SLIB->sl_TLSSessionManager, (SSL_CTX *)user );
+		break;
+
 	default:
 		//DEBUG1("[WS]:Default\n");
 		break;
@@ -596,19 +953,25 @@ int AttachWebsocketToSession( void *locsb, struct lws *wsi, const char *sessioni
 		return -1;
 	}
 	
-	if( FRIEND_MUTEX_LOCK( &(actUserSess->us_Mutex) ) == 0 )
+	// connection could be closed while message was waiting in queue, session must not point to it
+	if( FRIEND_MUTEX_LOCK( &(data->wsc_Mutex) ) == 0 )
 	{
-		actUserSess->us_Wsi = wsi;
-		actUserSess->us_WSD = data;
-		
-		FRIEND_MUTEX_UNLOCK( &(actUserSess->us_Mutex) );
-		
-		if( FRIEND_MUTEX_LOCK( &(data->wsc_Mutex) ) == 0 )
+		if( data->wsc_Closed == TRUE || data->wsc_Wsi == NULL )
 		{
-			data->wsc_UserSession = actUserSess;
-			data->wsc_Wsi = wsi;
 			FRIEND_MUTEX_UNLOCK( &(data->wsc_Mutex) );
+			Log( FLOG_INFO, "[WS] Connection was closed before it was attached to session %s\n", sessionid );
+			return -1;
+		}
+		
+		if( FRIEND_MUTEX_LOCK( &(actUserSess->us_Mutex) ) == 0 )
+		{
+			actUserSess->us_Wsi = data->wsc_Wsi;
+			actUserSess->us_WSD = data;
+			
+			FRIEND_MUTEX_UNLOCK( &(actUserSess->us_Mutex) );
 		}
+		data->wsc_UserSession = actUserSess;
+		FRIEND_MUTEX_UNLOCK( &(data->wsc_Mutex) );
 	}
 	
 	// create and use new WebSocket connection
@@ -680,8 +1043,12 @@ int DetachWebsocketFromSession( void *d )
 		//Log( FLOG_DEBUG, "[WS] Lock DetachWebsocketFromSession\n");
 		if( FRIEND_MUTEX_LOCK( &(us->us_Mutex) ) == 0 )
 		{
-			us->us_Wsi = NULL;
-			us->us_WSD = NULL;
+			// session could already get new connection
+			if( us->us_WSD == data )
+			{
+				us->us_Wsi = NULL;
+				us->us_WSD = NULL;
+			}
 			//us->us_InUseCounter--;
 		
 			FRIEND_MUTEX_UNLOCK( &(us->us_Mutex) );
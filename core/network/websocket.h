@@ -39,6 +39,43 @@
 
 #define MAX_POLL_ELEMENTS 256
 
+#ifndef WEBSOCKET_SERVICE_THREADS_MAX
+#define WEBSOCKET_SERVICE_THREADS_MAX 16		// must not be bigger than LWS_MAX_SMP used to build libwebsockets
+#endif
+#ifndef WEBSOCKET_WORKERS
+#define WEBSOCKET_WORKERS 16					// workers which process incoming messages
+#endif
+#ifndef WEBSOCKET_WORKERS_QUEUE_SIZE
+#define WEBSOCKET_WORKERS_QUEUE_SIZE 256		// connections waiting per worker
+#endif
+#ifndef WEBSOCKET_CONNECTION_QUEUE_SIZE
+#define WEBSOCKET_CONNECTION_QUEUE_SIZE 32		// messages waiting per connection
+#endif
+#ifndef WEBSOCKET_DEFLATE_LEVEL
+#define WEBSOCKET_DEFLATE_LEVEL 1				// permessage-deflate compression level (1-9)
+#endif
+#ifndef WEBSOCKET_DEFLATE_MEM_LEVEL
+#define WEBSOCKET_DEFLATE_MEM_LEVEL 8			// permessage-deflate zlib memory level (1-9)
+#endif
+
+#define WEBSOCKET_PROTOCOL_ID_FC 2				// FC-protocol, big messages are sent as base64 chunks
+#define WEBSOCKET_PROTOCOL_ID_FC_BINARY 5		// FC-protocol-binary, big messages are sent as binary fragments
+
+struct WSCData;
+
+//
+// libwebsockets service thread, every connection is served by one thread
+//
+
+typedef struct WebSocketServiceThread
+{
+	void								*wst_WebSocket;
+	FThread								*wst_Thread;
+	int									wst_Index;		// lws service thread index (tsi)
+	pthread_mutex_t						wst_Mutex;
+	struct WSCData						*wst_Writable;	// connections which wait for writable callback
+}WebSocketServiceThread;
+
 //
 // main WebSocket structure
 //
@@ -63,7 +100,13 @@ typedef struct WebSocket
 	struct lws_pollfd					ws_Pollfds[ MAX_POLL_ELEMENTS ];
 	int									ws_CountPollfds;
 	
-	FThread								*ws_Thread;
+	WebSocketServiceThread				*ws_ServiceThreads;
+	int									ws_ThreadsCount;
+	
+	void								*ws_Workers;	// WorkerManager pool which handles incoming messages, NULL - not used
+	int									ws_QueueMax;	// messages waiting per connection, reading from connection is stopped above it
+	int									ws_DeflateLevel;	// permessage-deflate settings, 0 - extension disabled
+	int									ws_DeflateMemLevel;
 	
 	FBOOL								ws_Quit;
 	FBOOL								ws_ExtendedDebug;
@@ -83,13 +126,31 @@ typedef struct WebSocket
 #define WS_CALLS_MAX 10
 #endif
 
+//
+// connection data, released when connection is closed and nobody else uses it (wsc_Refs)
+//
+
 typedef struct WSCData
 {
 	void							*wsc_UserSession;
-	struct lws				 		*wsc_Wsi;
+	struct lws				 		*wsc_Wsi;			// NULL when connection was closed
 	BufString						*wsc_Buffer;
 	pthread_mutex_t					wsc_Mutex;
-	int								wsc_InUseCounter;
+	int								wsc_Refs;			// connection, writers and scheduled message processing
+	FBOOL							wsc_Closed;
+	void							*wsc_WebSocket;
+	int								wsc_Tsi;			// service thread which serves connection
+	FBOOL							wsc_WritePending;	// connection is on service thread writable list
+	struct WSCData					*wsc_WriteNext;
+	
+	void							*wsc_QueueFirst;	// incoming messages, processed in order by one worker at time
+	void							*wsc_QueueLast;
+	int								wsc_QueueCount;
+	FBOOL							wsc_Scheduled;		// worker job was queued or is running
+	FBOOL							wsc_RxPaused;		// reading was stopped because queue is full
+	FBOOL							wsc_RxResume;		// service thread should enable reading again
+	FBOOL							wsc_Binary;			// client selected FC-protocol-binary
+	FBOOL							wsc_InFragment;		// last fragment of binary message was not sent yet, used only by service thread
 }WSCData;
 
 /*
@@ -132,6 +193,42 @@ void WebSocketDelete( WebSocket *ws );
 
 int WebSocketStart( WebSocket *ws );
 
+//
+// create connection data and attach it to wsi
+//
+
+WSCData *WSCDataNew( struct lws *wsi );
+
+//
+//
+//
+
+void WSCDataAcquire( WSCData *wsd );
+
+//
+// drop reference, data is released by last one
+//
+
+void WSCDataRelease( WSCData *wsd );
+
+//
+// ask service thread of connection for writable callback, can be called from any thread
+//
+
+void WebSocketRequestWritable( WSCData *wsd );
+
+//
+// call writable callbacks requested for service thread, called by service thread
+//
+
+void WebSocketServiceWritable( struct lws *wsi );
+
+//
+// remove closed connection from writable list
+//
+
+void WebSocketCancelWritable( WSCData *wsd );
+
 //
 //
 //
@@ -20,6 +20,109 @@
 #include <system/user/user.h>
 #include <mutex/mutex_manager.h>
 
+//
+// Locking
+//
+// Groups (first byte of path hash) are divided between CACHE_STRIPES stripes, every stripe has
+// own mutex, byte limit and CLOCK ring. Files returned by CacheManagerFileGet/Put are referenced
+// (lf_InUse) and must be released by CacheManagerFileRelease. File removed from cache while
+// it is used is deleted by last release.
+//
+
+/**
+ * Get stripe to which file belongs
+ *
+ * @param cm pointer to CacheManager
+ * @param hash path hash
+ * @return pointer to CacheStripe
+ */
+static inline CacheStripe *CacheManagerStripe( CacheManager *cm, uint64_t *hash )
+{
+	unsigned char id = (unsigned char)hash[0];
+	return &(cm->cm_Stripes[ id % CACHE_STRIPES ]);
+}
+
+/**
+ * Remove file from group and CLOCK ring (stripe mutex must be locked)
+ *
+ * @param cm pointer to CacheManager
+ * @param cs pointer to stripe
+ * @param lf file which will be removed
+ */
+static void CacheManagerUnlink( CacheManager *cm, CacheStripe *cs, LocFile *lf )
+{
+	unsigned char id = (unsigned char)lf->hash[0];
+	
+	// group list
+	LocFile **link = &(cm->cm_CacheFileGroup[ id ].cg_File);
+	while( *link != NULL )
+	{
+		if( *link == lf )
+		{
+			*link = (LocFile *)lf->node.mln_Succ;
+			break;
+		}
+		link = (LocFile **)&((*link)->node.mln_Succ);
+	}
+	lf->node.mln_Succ = NULL;
+	
+	// CLOCK ring
+	if( lf->lf_CacheNext == lf )
+	{
+		cs->cs_Hand = NULL;
+	}
+	else
+	{
+		lf->lf_CachePrev->lf_CacheNext = lf->lf_CacheNext;
+		lf->lf_CacheNext->lf_CachePrev = lf->lf_CachePrev;
+		if( cs->cs_Hand == lf )
+		{
+			cs->cs_Hand = lf->lf_CacheNext;
+		}
+	}
+	lf->lf_CacheNext = lf->lf_CachePrev = NULL;
+	
+	cs->cs_Size -= lf->lf_CacheSize;
+	cs->cs_Files--;
+	lf->lf_Cached = FALSE;
+	
+	// nobody use file, it can be deleted now, otherwise last CacheManagerFileRelease will do it
+	if( lf->lf_InUse <= 0 )
+	{
+		LocFileDelete( lf );
+	}
+}
+
+/**
+ * Remove not used files till there is space for new one (stripe mutex must be locked)
+ *
+ * @param cm pointer to CacheManager
+ * @param cs pointer to stripe
+ * @param size number of bytes needed
+ */
+static void CacheManagerEvict( CacheManager *cm, CacheStripe *cs, FUQUAD size )
+{
+	// every file is visited at most twice (first time its CLOCK bit is cleared)
+	FUQUAD steps = ( cs->cs_Files << 1 ) + 1;
+	
+	while( cs->cs_Hand != NULL && ( cs->cs_Size + size ) > cm->cm_StripeMax && steps-- > 0 )
+	{
+		LocFile *lf = cs->cs_Hand;
+		
+		if( lf->lf_Referenced == TRUE )
+		{
+			lf->lf_Referenced = FALSE;
+			cs->cs_Hand = lf->lf_CacheNext;
+		}
+		else
+		{
+			DEBUG("[CacheManagerEvict] File removed from cache %s size %lu\n", lf->lf_Path, lf->lf_CacheSize );
+			CacheManagerUnlink( cm, cs, lf );
+			cs->cs_Evictions++;
+		}
+	}
+}
+
 /**
  * create new CacheManager
  *
@@ -34,9 +137,13 @@ CacheManager *CacheManagerNew( FULONG size )
 	{
 		int i = 0;
 		
-		pthread_mutex_init( &(cm->cm_Mutex), NULL );
+		for( i = 0; i < CACHE_STRIPES; i++ )
+		{
+			pthread_mutex_init( &(cm->cm_Stripes[ i ].cs_Mutex), NULL );
+		}
 		
 		cm->cm_CacheMax = size;
+		cm->cm_StripeMax = size / CACHE_STRIPES;
 		
 		cm->cm_CacheFileGroup = FCalloc( CACHE_GROUP_MAX, sizeof(CacheFileGroup) );
 		if( cm->cm_CacheFileGroup != NULL )
@@ -47,6 +154,15 @@ CacheManager *CacheManagerNew( FULONG size )
 				cm->cm_CacheFileGroup[ i ].cg_File = NULL;
 			}
 		}
+		else
+		{
+			for( i = 0; i < CACHE_STRIPES; i++ )
+			{
+				pthread_mutex_destroy( &(cm->cm_Stripes[ i ].cs_Mutex) );
+			}
+			FFree( cm );
+			return NULL;
+		}
 	}
 	else
 	{
@@ -65,8 +181,10 @@ void CacheManagerDelete( CacheManager *cm )
 	if( cm != NULL )
 	{
 		int i = 0;
+		CacheManagerStats st;
 		
-		FRIEND_MUTEX_LOCK( &(cm->cm_Mutex) );
+		CacheManagerGetStats( cm, &st );
+		Log( FLOG_INFO, "[CacheManagerDelete] Cache hits %lu misses %lu evictions %lu invalidations %lu\n", st.cms_Hits, st.cms_Misses, st.cms_Evictions, st.cms_Invalidations );
 		
 		for( ; i < CACHE_GROUP_MAX; i++ )
 		{
@@ -84,18 +202,11 @@ void CacheManagerDelete( CacheManager *cm )
 			FFree( cm->cm_CacheFileGroup );
 		}
 		
-		FRIEND_MUTEX_UNLOCK( &(cm->cm_Mutex) );
-		
-		pthread_mutex_destroy( &(cm->cm_Mutex) );
-		/*
-		LocFile *lf = cm->cm_LocFileCache;
-		while( lf != NULL )
+		for( i = 0; i < CACHE_STRIPES; i++ )
 		{
-			LocFile *rf = lf;
-			lf = (LocFile *)lf->node.mln_Succ;
-			LocFileDelete( rf );
+			pthread_mutex_destroy( &(cm->cm_Stripes[ i ].cs_Mutex) );
 		}
-		*/
+		
 		FFree( cm );
 	}
 }
@@ -109,41 +220,28 @@ void CacheManagerClearCache( CacheManager *cm )
 {
 	if( cm != NULL )
 	{
-		if( FRIEND_MUTEX_LOCK( &(cm->cm_Mutex) ) == 0 )
-		{
-			int i = 0;
+		int i = 0;
 		
-			for( ; i < CACHE_GROUP_MAX; i++ )
+		for( ; i < CACHE_STRIPES; i++ )
+		{
+			CacheStripe *cs = &(cm->cm_Stripes[ i ]);
+			if( FRIEND_MUTEX_LOCK( &(cs->cs_Mutex) ) == 0 )
 			{
-				LocFile *lf = cm->cm_CacheFileGroup[ i ].cg_File;
-				while( lf != NULL )
+				// files which are in use are deleted by last release
+				while( cs->cs_Hand != NULL )
 				{
-					LocFile *rf = lf;
-					lf = (LocFile *)lf->node.mln_Succ;
-				
-					FRIEND_MUTEX_UNLOCK( &(cm->cm_Mutex) );
-					while( rf->lf_InUse > 0 )
-					{
-						usleep( 500 );
-					}
-					LocFileDelete( rf );
-					FRIEND_MUTEX_LOCK( &(cm->cm_Mutex) );
+					CacheManagerUnlink( cm, cs, cs->cs_Hand );
 				}
-			
-				cm->cm_CacheFileGroup[ i ].cg_File = NULL;
+				FRIEND_MUTEX_UNLOCK( &(cs->cs_Mutex) );
 			}
-		
-			cm->cm_LocFileCache = NULL;
-		
-			FRIEND_MUTEX_UNLOCK( &(cm->cm_Mutex) );
 		}
 	}
 }
 
-// we need task which will check if file was or not used too often
-
 /**
  * function store LocFile inside cache
+ * When file is stored it is referenced by caller, CacheManagerFileRelease must be called when it is not needed.
+ * Not used files are removed from cache when there is not enough space.
  *
  * @param cm pointer to CacheManager which will store file
  * @param lf pointer to LocFile structure which will be stored in cache
@@ -153,49 +251,79 @@ int CacheManagerFilePut( CacheManager *cm, LocFile *lf )
 {
 	if( cm != NULL )
 	{
-		INFO(" cache size %ld file size %ld cache max %ld\n",  cm->cm_CacheSize ,(FLONG)lf->lf_FileSize, (FLONG)cm->cm_CacheMax );
-		if( (cm->cm_CacheSize + lf->lf_FileSize) > cm->cm_CacheMax )
+		if( lf == NULL )
 		{
-			INFO("Cannot add file to cache, cache is FULL\n");
+			FERROR("Cannot store file in cache without filename!\n");
+			return -1;
+		}
+		
+		INFO(" file size %ld cache max %ld\n", (FLONG)lf->lf_FileSize, (FLONG)cm->cm_CacheMax );
+		if( lf->lf_FileSize > cm->cm_StripeMax )
+		{
+			INFO("Cannot add file to cache, file is too big\n");
 			return -3;
 		}
-		else
+		
+		// compressed variants are prepared once, outside of lock
+		LocFilePrepareEncodings( lf );
+		
+		unsigned char id = (unsigned char)lf->hash[0];		//we sort data by name
+		CacheStripe *cs = CacheManagerStripe( cm, lf->hash );
+		
+		if( FRIEND_MUTEX_LOCK( &(cs->cs_Mutex) ) == 0 )
 		{
-			if( lf != NULL )
+			// same file could be loaded by other request in meantime, old version is replaced
+			LocFile *old = cm->cm_CacheFileGroup[ id ].cg_File;
+			while( old != NULL )
 			{
-				char *hfirstChar = (char *)lf->hash;
-				unsigned char id = (unsigned char)hfirstChar[0];		//we sort data by name
-				
-				if( FRIEND_MUTEX_LOCK( &(cm->cm_Mutex) ) == 0 )
+				if( memcmp( old->hash, lf->hash, sizeof(lf->hash) ) == 0 )
 				{
-					if( cm->cm_CacheFileGroup != NULL )
-					{
-						DEBUG("ID %d\n", id );
-						if( cm->cm_CacheFileGroup[ id ].cg_File == NULL )
-						{
-							cm->cm_CacheFileGroup[ id ].cg_File = lf;
-						}
-						else
-						{
-							lf->node.mln_Succ = (MinNode *)cm->cm_CacheFileGroup[ id ].cg_File;
-							cm->cm_CacheFileGroup[ id ].cg_File = lf;
-						}
-				
-						//lf->node.mln_Succ = (MinNode *)cm->cm_LocFileCache;
-						//cm->cm_LocFileCache = lf;
+					CacheManagerUnlink( cm, cs, old );
+					break;
+				}
+				old = (LocFile *)old->node.mln_Succ;
+			}
 			
-						lf->lf_FileUsed++;
+			CacheManagerEvict( cm, cs, lf->lf_CacheSize );
 			
-						cm->cm_CacheSize += lf->lf_FileSize;
-					}
-					FRIEND_MUTEX_UNLOCK( &(cm->cm_Mutex) );
-				}
+			if( ( cs->cs_Size + lf->lf_CacheSize ) > cm->cm_StripeMax )
+			{
+				FRIEND_MUTEX_UNLOCK( &(cs->cs_Mutex) );
+				INFO("Cannot add file to cache, cache is FULL\n");
+				return -3;
+			}
+			
+			lf->node.mln_Succ = (MinNode *)cm->cm_CacheFileGroup[ id ].cg_File;
+			cm->cm_CacheFileGroup[ id ].cg_File = lf;
+			
+			// new file is put just behind hand, so it will be checked last
+			if( cs->cs_Hand == NULL )
+			{
+				lf->lf_CacheNext = lf->lf_CachePrev = lf;
+				cs->cs_Hand = lf;
 			}
 			else
 			{
-				FERROR("Cannot store file in cache without filename!\n");
-				return -1;
+				lf->lf_CacheNext = cs->cs_Hand;
+				lf->lf_CachePrev = cs->cs_Hand->lf_CachePrev;
+				cs->cs_Hand->lf_CachePrev->lf_CacheNext = lf;
+				cs->cs_Hand->lf_CachePrev = lf;
 			}
+			
+			lf->lf_Cached = TRUE;
+			lf->lf_Referenced = TRUE;
+			lf->lf_CheckTime = time( NULL );
+			lf->lf_InUse++;
+			lf->lf_FileUsed++;
+			
+			cs->cs_Size += lf->lf_CacheSize;
+			cs->cs_Files++;
+			
+			FRIEND_MUTEX_UNLOCK( &(cs->cs_Mutex) );
+		}
+		else
+		{
+			return -4;
 		}
 	}
 	else
@@ -267,16 +395,15 @@ LocFile *CacheManagerUserFileGet( void *locusr, char *path )
 
 /**
  * get LocFile from cache
+ * Returned file is referenced, CacheManagerFileRelease must be called when it is not needed.
  *
  * @param cm pointer to CacheManager
  * @param path path to file
- * @param checkByPath find file by compareing paths
+ * @param checkByPath TRUE when path is not a single file on disk (joined paths), then file is not compared with disk
  * @return pointer to LocFile when structure is stored in CacheManager, otherwise NULL
  */
-LocFile *CacheManagerFileGet( CacheManager *cm, char *path, FBOOL checkByPath __attribute__((unused)) )
+LocFile *CacheManagerFileGet( CacheManager *cm, char *path, FBOOL checkByPath )
 {
-	LocFile *ret = NULL;
-	
 	if( path == NULL )
 	{
 		FERROR("[CacheManagerFileGet] Cache meananger do not handle NULL file\n");
@@ -290,10 +417,12 @@ LocFile *CacheManagerFileGet( CacheManager *cm, char *path, FBOOL checkByPath __
 		
 		//char *hfirstChar = (char *)hash;
 		unsigned char id = (unsigned char)hash[0];
+		CacheStripe *cs = CacheManagerStripe( cm, hash );
+		time_t now = time( NULL );
 		
 		LocFile *lf = NULL;
 
-		if( FRIEND_MUTEX_LOCK( &(cm->cm_Mutex) ) == 0 )
+		if( FRIEND_MUTEX_LOCK( &(cs->cs_Mutex) ) == 0 )
 		{
 			CacheFileGroup *cg = &(cm->cm_CacheFileGroup[ id ]);
 			lf = cg->cg_File;
@@ -302,17 +431,105 @@ LocFile *CacheManagerFileGet( CacheManager *cm, char *path, FBOOL checkByPath __
 			{
 				if( memcmp( hash, lf->hash, sizeof(hash) ) == 0 )
 				{
-					lf->lf_FileUsed++;
-					FRIEND_MUTEX_UNLOCK( &(cm->cm_Mutex) );
-					return lf;
+					break;
 				}
-			
 				lf = (LocFile *)lf->node.mln_Succ;
 			}
-			FRIEND_MUTEX_UNLOCK( &(cm->cm_Mutex) );
+			
+			//
+			// file on disk could be changed, it is checked only from time to time
+			//
+			
+			if( lf != NULL && checkByPath == FALSE && lf->lf_Info.st_mtime != 0 && ( now - lf->lf_CheckTime ) >= CACHE_CHECK_INTERVAL )
+			{
+				struct stat attr;
+				
+				lf->lf_CheckTime = now;
+				if( stat( path, &attr ) != 0 || attr.st_mtime != lf->lf_Info.st_mtime || attr.st_size != lf->lf_Info.st_size )
+				{
+					DEBUG("[CacheManagerFileGet] File changed on disk, removed from cache %s\n", path );
+					CacheManagerUnlink( cm, cs, lf );
+					cs->cs_Invalidations++;
+					lf = NULL;
+				}
+			}
+			
+			if( lf != NULL )
+			{
+				lf->lf_Referenced = TRUE;
+				lf->lf_InUse++;
+				lf->lf_FileUsed++;
+				cs->cs_Hits++;
+			}
+			else
+			{
+				cs->cs_Misses++;
+			}
+			FRIEND_MUTEX_UNLOCK( &(cs->cs_Mutex) );
 		}
+		return lf;
+	}
+	
+	return NULL;
+}
+
+/**
+ * Release LocFile taken by CacheManagerFileGet or stored by CacheManagerFilePut
+ *
+ * @param cm pointer to CacheManager
+ * @param lf pointer to LocFile
+ */
+void CacheManagerFileRelease( CacheManager *cm, LocFile *lf )
+{
+	if( cm == NULL || lf == NULL )
+	{
+		return;
 	}
 	
-	return ret;
+	CacheStripe *cs = CacheManagerStripe( cm, lf->hash );
+	if( FRIEND_MUTEX_LOCK( &(cs->cs_Mutex) ) == 0 )
+	{
+		lf->lf_InUse--;
+		
+		// file was removed from cache while it was used
+		if( lf->lf_InUse <= 0 && lf->lf_Cached == FALSE )
+		{
+			LocFileDelete( lf );
+		}
+		FRIEND_MUTEX_UNLOCK( &(cs->cs_Mutex) );
+	}
+}
+
+/**
+ * Get cache statistics
+ *
+ * @param cm pointer to CacheManager
+ * @param st pointer to structure which will be filled
+ */
+void CacheManagerGetStats( CacheManager *cm, CacheManagerStats *st )
+{
+	int i;
+	
+	memset( st, 0, sizeof( CacheManagerStats ) );
+	if( cm == NULL )
+	{
+		return;
+	}
+	
+	st->cms_Max = cm->cm_CacheMax;
+	for( i = 0; i < CACHE_STRIPES; i++ )
+	{
+		CacheStripe *cs = &(cm->cm_Stripes[ i ]);
+		if( FRIEND_MUTEX_LOCK( &(cs->cs_Mutex) ) == 0 )
+		{
+			st->cms_Size += cs->cs_Size;
+			st->cms_Files += cs->cs_Files;
+			st->cms_Hits += cs->cs_Hits;
+			st->cms_Misses += cs->cs_Misses;
+			st->cms_Evictions += cs->cs_Evictions;
+			st->cms_Invalidations += cs->cs_Invalidations;
+			FRIEND_MUTEX_UNLOCK( &(cs->cs_Mutex) );
+		}
+	}
 }
 
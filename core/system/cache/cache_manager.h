@@ -27,6 +27,14 @@
 
 #define CACHE_GROUP_MAX 256
 
+#ifndef CACHE_STRIPES
+#define CACHE_STRIPES 16				// number of locks, groups are divided between them
+#endif
+
+#ifndef CACHE_CHECK_INTERVAL
+#define CACHE_CHECK_INTERVAL 2			// how often cached file is compared with file on disk (seconds)
+#endif
+
 //
 //
 //
@@ -37,6 +45,37 @@ typedef struct CacheFileGroup
 	int				cg_EntryId;			// first char
 }CacheFileGroup;
 
+//
+// Part of cache protected by one lock. Every stripe has own CLOCK ring and byte limit.
+//
+
+typedef struct CacheStripe
+{
+	pthread_mutex_t	cs_Mutex;
+	LocFile			*cs_Hand;				// CLOCK hand, NULL when stripe is empty
+	FUQUAD			cs_Size;				// bytes used by files
+	FUQUAD			cs_Files;				// number of files
+	FUQUAD			cs_Hits;
+	FUQUAD			cs_Misses;
+	FUQUAD			cs_Evictions;
+	FUQUAD			cs_Invalidations;
+}CacheStripe;
+
+//
+// Cache statistics
+//
+
+typedef struct CacheManagerStats
+{
+	FUQUAD			cms_Size;
+	FUQUAD			cms_Max;
+	FUQUAD			cms_Files;
+	FUQUAD			cms_Hits;
+	FUQUAD			cms_Misses;
+	FUQUAD			cms_Evictions;
+	FUQUAD			cms_Invalidations;
+}CacheManagerStats;
+
 //
 //
 //
@@ -44,10 +83,9 @@ typedef struct CacheFileGroup
 typedef struct CacheManager
 {
 	CacheFileGroup	*cm_CacheFileGroup;
-	LocFile			*cm_LocFileCache;
-	FUQUAD			cm_CacheSize;
+	CacheStripe		cm_Stripes[ CACHE_STRIPES ];
 	FUQUAD 			cm_CacheMax;
-	pthread_mutex_t cm_Mutex;
+	FUQUAD			cm_StripeMax;			// cm_CacheMax / CACHE_STRIPES
 }CacheManager;
 
 //
@@ -80,4 +118,16 @@ int CacheManagerFilePut( CacheManager *cm, LocFile *lf );
 
 LocFile *CacheManagerFileGet( CacheManager *cm, char *path, FBOOL checkByPath );
 
+//
+//
+//
+
+void CacheManagerFileRelease( CacheManager *cm, LocFile *lf );
+
+//
+//
+//
+
+void CacheManagerGetStats( CacheManager *cm, CacheManagerStats *st );
+
 #endif //__FILE_CACHE_MANAGER_H__
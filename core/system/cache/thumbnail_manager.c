@@ -0,0 +1,1145 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ *  Thumbnail manager body
+ */
+
+#include "thumbnail_manager.h"
+#include <core/types.h>
+#include <system/systembase.h>
+#include <system/datatypes/images/image_probe.h>
+#include <util/log/log.h>
+#include <util/string.h>
+#include <util/buffered_string.h>
+#include <util/murmurhash3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <setjmp.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <jpeglib.h>
+#include <gd.h>
+
+#define THUMBNAIL_TOUCH_TIME 3600		// hit does not update LRU time of file touched in last hour
+
+//
+// thumbnail file on disk, used by cleanup
+//
+
+typedef struct ThumbnailFile
+{
+	time_t					tf_Time;
+	off_t					tf_Size;
+	char					tf_Name[ 80 ];
+}ThumbnailFile;
+
+//
+// libjpeg error handler
+//
+
+typedef struct ThumbnailJPEGError
+{
+	struct jpeg_error_mgr	tje_Mgr;
+	jmp_buf					tje_Jump;
+}ThumbnailJPEGError;
+
+/**
+ * Build name of thumbnail file from key
+ *
+ * @param tm pointer to ThumbnailManager
+ * @param key thumbnail key
+ * @param dst place where name will be stored
+ * @param size size of dst
+ */
+static inline void ThumbnailFileName( ThumbnailManager *tm, const char *key, char *dst, int size )
+{
+	snprintf( dst, size, "%s/%c%c/%s", tm->tm_Path, key[ 0 ], key[ 1 ], key );
+}
+
+/**
+ * Build thumbnail key from device, path, file change time and thumbnail dimensions
+ *
+ * @param devid device id
+ * @param path path with or without device name
+ * @param changeTime file change timestamp
+ * @param width thumbnail width
+ * @param height thumbnail height
+ * @param key place where key (THUMBNAIL_KEY_SIZE bytes) will be stored
+ */
+static void ThumbnailKey( FULONG devid, const char *path, FLONG changeTime, int width, int height, char *key )
+{
+	const char *colon = strchr( path, ':' );
+	if( colon != NULL )
+	{
+		path = colon + 1;
+	}
+
+	BufString *bs = BufStringNew();
+	char tmp[ 128 ];
+	uint64_t hash[ 2 ] = { 0, 0 };
+
+	int len = snprintf( tmp, sizeof(tmp), "%lu:%ld:%dx%d:", devid, changeTime, width, height );
+	BufStringAddSize( bs, tmp, len );
+	BufStringAdd( bs, path );
+	MURMURHASH3( bs->bs_Buffer, bs->bs_Size, hash );
+	BufStringDelete( bs );
+
+	snprintf( key, THUMBNAIL_KEY_SIZE, "%016llx%016llx", (unsigned long long)hash[ 0 ], (unsigned long long)hash[ 1 ] );
+}
+
+/**
+ * Read thumbnail from disk cache, file modification time is used as last access time
+ *
+ * @param tm pointer to ThumbnailManager
+ * @param key thumbnail key
+ * @param size pointer to place where data size will be stored
+ * @return thumbnail data or NULL when it is not in cache
+ */
+static char *ThumbnailCacheRead( ThumbnailManager *tm, const char *key, int *size )
+{
+	char name[ 1024 ];
+	char *data = NULL;
+	struct stat st;
+
+	ThumbnailFileName( tm, key, name, sizeof(name) );
+
+	FILE *fp = fopen( name, "rb" );
+	if( fp == NULL )
+	{
+		return NULL;
+	}
+
+	if( fstat( fileno( fp ), &st ) == 0 && st.st_size > 0 && st.st_size < THUMBNAIL_MAX_SOURCE_SIZE )
+	{
+		if( ( data = FMalloc( st.st_size ) ) != NULL )
+		{
+			if( fread( data, 1, st.st_size, fp ) == (size_t)st.st_size )
+			{
+				*size = (int)st.st_size;
+			}
+			else
+			{
+				FFree( data );
+				data = NULL;
+			}
+		}
+	}
+	fclose( fp );
+
+	if( data != NULL && st.st_mtime + THUMBNAIL_TOUCH_TIME < time( NULL ) )
+	{
+		utime( name, NULL );
+	}
+	return data;
+}
+
+/**
+ * Store thumbnail in disk cache. File is written under temporary name and renamed,
+ * so readers never see partial thumbnail.
+ *
+ * @param tm pointer to ThumbnailManager
+ * @param key thumbnail key
+ * @param data thumbnail data
+ * @param size data size
+ */
+static void ThumbnailCacheWrite( ThumbnailManager *tm, const char *key, const char *data, int size )
+{
+	char name[ 1024 ];
+	char tmpname[ 1100 ];
+
+	snprintf( name, sizeof(name), "%s/%c%c", tm->tm_Path, key[ 0 ], key[ 1 ] );
+	mkdir( name, 0755 );
+
+	ThumbnailFileName( tm, key, name, sizeof(name) );
+	snprintf( tmpname, sizeof(tmpname), "%s.tmp%lu", name, (unsigned long)pthread_self() );
+
+	FILE *fp = fopen( tmpname, "wb" );
+	if( fp == NULL )
+	{
+		FERROR("[ThumbnailCacheWrite] Cannot create file %s\n", tmpname );
+		return;
+	}
+
+	FBOOL ok = ( fwrite( data, 1, size, fp ) == (size_t)size );
+	if( fclose( fp ) != 0 )
+	{
+		ok = FALSE;
+	}
+
+	if( ok == TRUE && rename( tmpname, name ) == 0 )
+	{
+		if( pthread_mutex_lock( &(tm->tm_Mutex) ) == 0 )
+		{
+			tm->tm_DiskSize += size;
+			pthread_mutex_unlock( &(tm->tm_Mutex) );
+		}
+	}
+	else
+	{
+		unlink( tmpname );
+	}
+}
+
+/**
+ * libjpeg error_exit replacement, default one terminates process
+ *
+ * @param cinfo libjpeg structure
+ */
+static void ThumbnailJPEGErrorExit( j_common_ptr cinfo )
+{
+	ThumbnailJPEGError *err = (ThumbnailJPEGError *)cinfo->err;
+	longjmp( err->tje_Jump, 1 );
+}
+
+/**
+ * libjpeg warnings are not printed
+ *
+ * @param cinfo libjpeg structure
+ */
+static void ThumbnailJPEGMessage( j_common_ptr cinfo )
+{
+}
+
+/**
+ * Decode JPEG with DCT scaling (1/2, 1/4, 1/8), so decoded image is not much bigger than thumbnail
+ *
+ * @param data JPEG file data
+ * @param size data size
+ * @param width minimal width of decoded image
+ * @param height minimal height of decoded image
+ * @return new gdImage or NULL when image cannot be decoded by libjpeg
+ */
+static gdImagePtr ThumbnailDecodeJPEG( char *data, int size, int width, int height )
+{
+	struct jpeg_decompress_struct cinfo;
+	ThumbnailJPEGError jerr;
+	gdImagePtr volatile img = NULL;
+	JSAMPLE * volatile row = NULL;
+
+	cinfo.err = jpeg_std_error( &(jerr.tje_Mgr) );
+	jerr.tje_Mgr.error_exit = ThumbnailJPEGErrorExit;
+	jerr.tje_Mgr.output_message = ThumbnailJPEGMessage;
+
+	if( setjmp( jerr.tje_Jump ) )
+	{
+		jpeg_destroy_decompress( &cinfo );
+		if( img != NULL )
+		{
+			gdImageDestroy( img );
+		}
+		if( row != NULL )
+		{
+			FFree( row );
+		}
+		return NULL;
+	}
+
+	jpeg_create_decompress( &cinfo );
+	jpeg_mem_src( &cinfo, (unsigned char *)data, size );
+	jpeg_read_header( &cinfo, TRUE );
+
+	// CMYK images are left for libgd, too big images are rejected there
+	if( cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK || (FQUAD)cinfo.image_width * (FQUAD)cinfo.image_height > THUMBNAIL_MAX_PIXELS )
+	{
+		jpeg_destroy_decompress( &cinfo );
+		return NULL;
+	}
+
+	unsigned int denom;
+	for( denom = 8 ; denom > 1 ; denom /= 2 )
+	{
+		if( cinfo.image_width / denom >= (unsigned int)width && cinfo.image_height / denom >= (unsigned int)height )
+		{
+			break;
+		}
+	}
+
+	cinfo.out_color_space = JCS_RGB;
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = denom;
+	cinfo.dct_method = JDCT_IFAST;
+
+	jpeg_start_decompress( &cinfo );
+
+	img = gdImageCreateTrueColor( cinfo.output_width, cinfo.output_height );
+	row = FMalloc( cinfo.output_width * cinfo.output_components );
+	if( img == NULL || row == NULL )
+	{
+		longjmp( jerr.tje_Jump, 1 );
+	}
+
+	while( cinfo.output_scanline < cinfo.output_height )
+	{
+		unsigned int x, y = cinfo.output_scanline;
+		JSAMPROW rows[ 1 ] = { row };
+
+		jpeg_read_scanlines( &cinfo, rows, 1 );
+		for( x=0 ; x < cinfo.output_width ; x++ )
+		{
+			img->tpixels[ y ][ x ] = gdTrueColor( row[ x*3 ], row[ x*3+1 ], row[ x*3+2 ] );
+		}
+	}
+
+	jpeg_finish_decompress( &cinfo );
+	jpeg_destroy_decompress( &cinfo );
+	FFree( row );
+
+	return img;
+}
+
+/**
+ * Decode image with libgd, image dimensions are checked before decoding
+ *
+ * @param data file data
+ * @param size data size
+ * @return new gdImage or NULL when image cannot be decoded
+ */
+static gdImagePtr ThumbnailDecode( char *data, int size )
+{
+	ImageProbeInfo info;
+
+	if( ImageProbe( (FBYTE *)data, size, &info ) == IMAGE_PROBE_OK && (FQUAD)info.ipi_Width * (FQUAD)info.ipi_Height > THUMBNAIL_MAX_PIXELS )
+	{
+		FERROR("[ThumbnailDecode] Image is too big: %dx%d\n", info.ipi_Width, info.ipi_Height );
+		return NULL;
+	}
+
+	gdImagePtr img = gdImageCreateFromPngPtr( size, data );
+	if( img == NULL )
+	{
+		img = gdImageCreateFromJpegPtr( size, data );
+	}
+	if( img == NULL )
+	{
+		img = gdImageCreateFromGifPtr( size, data );
+	}
+	if( img == NULL )
+	{
+		img = gdImageCreateFromBmpPtr( size, data );
+	}
+#ifdef USE_WEBP_LOADER
+	if( img == NULL )
+	{
+		img = gdImageCreateFromWebpPtr( size, data );
+	}
+#endif
+	if( img == NULL )
+	{
+		img = gdImageCreateFromTiffPtr( size, data );
+	}
+	if( img == NULL )
+	{
+		img = gdImageCreateFromTgaPtr( size, data );
+	}
+	return img;
+}
+
+/**
+ * Calculate thumbnail dimensions which fit in box and keep image proportions. Images are not enlarged.
+ *
+ * @param iw image width
+ * @param ih image height
+ * @param width box width
+ * @param height box height
+ * @param tw pointer to place where thumbnail width will be stored
+ * @param th pointer to place where thumbnail height will be stored
+ */
+static void ThumbnailFit( int iw, int ih, int width, int height, int *tw, int *th )
+{
+	if( iw <= width && ih <= height )
+	{
+		*tw = iw;
+		*th = ih;
+	}
+	else if( (FQUAD)iw * height > (FQUAD)ih * width )
+	{
+		*tw = width;
+		*th = (int)( (FQUAD)ih * width / iw );
+	}
+	else
+	{
+		*th = height;
+		*tw = (int)( (FQUAD)iw * height / ih );
+	}
+	if( *tw < 1 ) *tw = 1;
+	if( *th < 1 ) *th = 1;
+}
+
+/**
+ * Scale decoded image and encode it
+ *
+ * @param img decoded image
+ * @param width box width
+ * @param height box height
+ * @param jpeg TRUE when JPEG should be created, otherwise PNG
+ * @param size pointer to place where data size will be stored
+ * @return thumbnail data (allocated by FMalloc) or NULL when error appear
+ */
+static char *ThumbnailRender( gdImagePtr img, int width, int height, FBOOL jpeg, int *size )
+{
+	int tw, th, len = 0;
+	char *ret = NULL;
+
+	ThumbnailFit( img->sx, img->sy, width, height, &tw, &th );
+
+	gdImagePtr dst = gdImageCreateTrueColor( tw, th );
+	if( dst == NULL )
+	{
+		return NULL;
+	}
+
+	gdImageAlphaBlending( dst, 0 );
+	gdImageSaveAlpha( dst, 1 );
+	gdImageCopyResampled( dst, img, 0, 0, 0, 0, tw, th, img->sx, img->sy );
+
+	void *enc = ( jpeg == TRUE ) ? gdImageJpegPtr( dst, &len, 85 ) : gdImagePngPtr( dst, &len );
+	if( enc != NULL )
+	{
+		if( len > 0 && ( ret = FMalloc( len ) ) != NULL )
+		{
+			memcpy( ret, enc, len );
+			*size = len;
+		}
+		gdFree( enc );
+	}
+	gdImageDestroy( dst );
+
+	return ret;
+}
+
+/**
+ * Generate thumbnail of job and popular sizes of same image
+ *
+ * @param tm pointer to ThumbnailManager
+ * @param job job which will be handled
+ */
+static void ThumbnailGenerate( ThumbnailManager *tm, ThumbnailJob *job )
+{
+	File *dev = job->tj_Device;
+	FHandler *fh = (FHandler *)dev->f_FSys;
+	BufString *bs = NULL;
+	int i;
+
+	// eager sizes which are not on disk yet
+	int eager[ THUMBNAIL_MAX_EAGER_SIZES ];
+	char eagerKeys[ THUMBNAIL_MAX_EAGER_SIZES ][ THUMBNAIL_KEY_SIZE ];
+	int eagerCount = 0;
+	int decodeWidth = job->tj_Width;
+	int decodeHeight = job->tj_Height;
+
+	if( job->tj_ChangeTime > 0 )
+	{
+		for( i=0 ; i < tm->tm_EagerSizesCount ; i++ )
+		{
+			char name[ 1024 ];
+			struct stat st;
+			int s = tm->tm_EagerSizes[ i ];
+
+			if( s == job->tj_Width && s == job->tj_Height )
+			{
+				continue;
+			}
+
+			ThumbnailKey( dev->f_ID, job->tj_Path, job->tj_ChangeTime, s, s, eagerKeys[ eagerCount ] );
+			ThumbnailFileName( tm, eagerKeys[ eagerCount ], name, sizeof(name) );
+			if( stat( name, &st ) == 0 )
+			{
+				continue;
+			}
+
+			eager[ eagerCount++ ] = s;
+			if( s > decodeWidth ) decodeWidth = s;
+			if( s > decodeHeight ) decodeHeight = s;
+		}
+	}
+
+	File *fp = (File *)fh->FileOpen( dev, job->tj_Path, "rb" );
+	if( fp == NULL )
+	{
+		FERROR("[ThumbnailGenerate] Cannot open file: %s\n", job->tj_Path );
+		return;
+	}
+
+	bs = BufStringNew();
+	char *buffer = FMalloc( 65536 );
+	if( bs != NULL && buffer != NULL )
+	{
+		int len;
+		while( ( len = fh->FileRead( fp, buffer, 65536 ) ) > 0 )
+		{
+			BufStringAddSize( bs, buffer, len );
+			if( bs->bs_Size > THUMBNAIL_MAX_SOURCE_SIZE )
+			{
+				FERROR("[ThumbnailGenerate] File is too big: %s\n", job->tj_Path );
+				BufStringDelete( bs );
+				bs = NULL;
+				break;
+			}
+		}
+	}
+	if( buffer != NULL )
+	{
+		FFree( buffer );
+	}
+	fh->FileClose( dev, fp );
+
+	if( bs == NULL || bs->bs_Size == 0 )
+	{
+		if( bs != NULL )
+		{
+			BufStringDelete( bs );
+		}
+		return;
+	}
+
+	// JPEG is decoded at reduced resolution, size of thumbnail is calculated from header
+
+	gdImagePtr img = NULL;
+	ImageProbeInfo info;
+
+	FBOOL probed = ( ImageProbe( (FBYTE *)bs->bs_Buffer, (int)bs->bs_Size, &info ) == IMAGE_PROBE_OK );
+
+	// same limit as in ThumbnailDecode, checked before any decoder allocates image
+	if( probed == TRUE && (FQUAD)info.ipi_Width * (FQUAD)info.ipi_Height > THUMBNAIL_MAX_PIXELS )
+	{
+		FERROR("[ThumbnailGenerate] Image is too big: %dx%d %s\n", info.ipi_Width, info.ipi_Height, job->tj_Path );
+		BufStringDelete( bs );
+		return;
+	}
+	if( probed == TRUE && strcmp( info.ipi_Format, "jpeg" ) == 0 )
+	{
+		int tw, th;
+		ThumbnailFit( info.ipi_Width, info.ipi_Height, decodeWidth, decodeHeight, &tw, &th );
+		img = ThumbnailDecodeJPEG( bs->bs_Buffer, (int)bs->bs_Size, tw, th );
+	}
+	if( img == NULL )
+	{
+		img = ThumbnailDecode( bs->bs_Buffer, (int)bs->bs_Size );
+	}
+	BufStringDelete( bs );
+
+	if( img == NULL )
+	{
+		FERROR("[ThumbnailGenerate] Image format not recognized: %s\n", job->tj_Path );
+		return;
+	}
+
+	job->tj_Data = ThumbnailRender( img, job->tj_Width, job->tj_Height, job->tj_JPEG, &(job->tj_Size) );
+	if( job->tj_Data != NULL && job->tj_ChangeTime > 0 )
+	{
+		ThumbnailCacheWrite( tm, job->tj_Key, job->tj_Data, job->tj_Size );
+	}
+
+	for( i=0 ; i < eagerCount ; i++ )
+	{
+		int size = 0;
+		char *data = ThumbnailRender( img, eager[ i ], eager[ i ], job->tj_JPEG, &size );
+		if( data != NULL )
+		{
+			ThumbnailCacheWrite( tm, eagerKeys[ i ], data, size );
+			FFree( data );
+		}
+	}
+
+	gdImageDestroy( img );
+}
+
+/**
+ * Release job (tm_Mutex must be locked)
+ *
+ * @param job pointer to ThumbnailJob
+ */
+static void ThumbnailJobRelease( ThumbnailJob *job )
+{
+	if( --(job->tj_Refs) <= 0 )
+	{
+		if( job->tj_Data != NULL )
+		{
+			FFree( job->tj_Data );
+		}
+		FFree( job->tj_Path );
+		FFree( job );
+	}
+}
+
+/**
+ * Thread which generates thumbnails from queue
+ *
+ * @param data pointer to ThumbnailManager
+ * @return NULL
+ */
+static void *ThumbnailWorker( void *data )
+{
+	ThumbnailManager *tm = (ThumbnailManager *)data;
+
+	pthread_mutex_lock( &(tm->tm_Mutex) );
+	while( TRUE )
+	{
+		while( tm->tm_Queue == NULL && tm->tm_Quit == FALSE )
+		{
+			pthread_cond_wait( &(tm->tm_Cond), &(tm->tm_Mutex) );
+		}
+		if( tm->tm_Quit == TRUE )
+		{
+			break;
+		}
+
+		ThumbnailJob *job = tm->tm_Queue;
+		tm->tm_Queue = job->tj_Next;
+		if( tm->tm_Queue == NULL )
+		{
+			tm->tm_QueueLast = NULL;
+		}
+		tm->tm_QueueCount--;
+
+		job->tj_Next = tm->tm_Active;
+		tm->tm_Active = job;
+		job->tj_Started = TRUE;
+		pthread_mutex_unlock( &(tm->tm_Mutex) );
+
+		ThumbnailGenerate( tm, job );
+
+		pthread_mutex_lock( &(tm->tm_Mutex) );
+
+		ThumbnailJob **link = &(tm->tm_Active);
+		while( *link != NULL )
+		{
+			if( *link == job )
+			{
+				*link = job->tj_Next;
+				break;
+			}
+			link = &((*link)->tj_Next);
+		}
+		job->tj_Next = NULL;
+
+		job->tj_Device->f_Operations--;
+		job->tj_Device = NULL;
+		job->tj_Done = TRUE;
+		if( job->tj_Data != NULL )
+		{
+			tm->tm_Generated++;
+		}
+		pthread_cond_broadcast( &(tm->tm_DoneCond) );
+		ThumbnailJobRelease( job );
+	}
+	pthread_mutex_unlock( &(tm->tm_Mutex) );
+
+	return NULL;
+}
+
+/**
+ * Create new ThumbnailManager. Configuration is read from cfg.ini:
+ *
+ * [Thumbnails]
+ * path = cache/thumbnails
+ * maxsize = 512
+ * threads = 2
+ * queue = 64
+ * sizes = 64,128,256
+ * cleanup = 600
+ *
+ * @param sb pointer to SystemBase
+ * @return new ThumbnailManager structure when success, otherwise NULL
+ */
+ThumbnailManager *ThumbnailManagerNew( void *sb )
+{
+	SystemBase *locsb = (SystemBase *)sb;
+	ThumbnailManager *tm;
+
+	if( ( tm = FCalloc( 1, sizeof( ThumbnailManager ) ) ) != NULL )
+	{
+		char *sizes = NULL;
+		char path[ 1024 ];
+		int maxsize = 512;
+
+		tm->tm_SB = sb;
+		tm->tm_Threads = THUMBNAIL_THREADS;
+		tm->tm_QueueSize = THUMBNAIL_QUEUE_SIZE;
+		tm->tm_CleanupInterval = 600;
+
+		char *fhome = getenv( "FRIEND_HOME" );
+		if( fhome != NULL )
+		{
+			snprintf( path, sizeof(path), "%s/cache/thumbnails", fhome );
+		}
+		else
+		{
+			strcpy( path, "cache/thumbnails" );
+		}
+
+		struct PropertiesInterface *plib = &( locsb->sl_PropertiesInterface );
+		char coresPath[ 1024 ];
+		snprintf( coresPath, sizeof(coresPath), "%s/cfg/cfg.ini", fhome );
+
+		Props *prop = plib->Open( coresPath );
+		if( prop != NULL )
+		{
+			char *tmp = plib->ReadStringNCS( prop, "Thumbnails:path", NULL );
+			if( tmp != NULL )
+			{
+				snprintf( path, sizeof(path), "%s", tmp );
+			}
+			maxsize = plib->ReadIntNCS( prop, "Thumbnails:maxsize", 512 );
+			tm->tm_Threads = plib->ReadIntNCS( prop, "Thumbnails:threads", THUMBNAIL_THREADS );
+			tm->tm_QueueSize = plib->ReadIntNCS( prop, "Thumbnails:queue", THUMBNAIL_QUEUE_SIZE );
+			tm->tm_CleanupInterval = plib->ReadIntNCS( prop, "Thumbnails:cleanup", 600 );
+			sizes = StringDuplicate( plib->ReadStringNCS( prop, "Thumbnails:sizes", "64,128,256" ) );
+
+			plib->Close( prop );
+		}
+
+		if( sizes == NULL )
+		{
+			sizes = StringDuplicate( "64,128,256" );
+		}
+		if( sizes != NULL )
+		{
+			char *ptr = sizes;
+			while( *ptr != 0 && tm->tm_EagerSizesCount < THUMBNAIL_MAX_EAGER_SIZES )
+			{
+				int s = atoi( ptr );
+				if( s > 0 && s <= THUMBNAIL_MAX_DIMENSION )
+				{
+					tm->tm_EagerSizes[ tm->tm_EagerSizesCount++ ] = s;
+				}
+				while( *ptr != 0 && *ptr != ',' ) ptr++;
+				while( *ptr == ',' || *ptr == ' ' ) ptr++;
+			}
+			FFree( sizes );
+		}
+
+		tm->tm_MaxSize = (FUQUAD)( maxsize > 0 ? maxsize : 0 ) * 1048576;
+		if( tm->tm_Threads <= 0 )
+		{
+			tm->tm_Threads = 1;
+		}
+		if( tm->tm_QueueSize <= 0 )
+		{
+			tm->tm_QueueSize = THUMBNAIL_QUEUE_SIZE;
+		}
+		if( tm->tm_CleanupInterval < 60 )
+		{
+			tm->tm_CleanupInterval = 60;
+		}
+
+		// create cache directory with parents
+		tm->tm_Path = StringDuplicate( path );
+		char *sep = path;
+		while( ( sep = strchr( sep + 1, '/' ) ) != NULL )
+		{
+			*sep = 0;
+			mkdir( path, 0755 );
+			*sep = '/';
+		}
+		mkdir( path, 0755 );
+
+		pthread_mutex_init( &(tm->tm_Mutex), NULL );
+		pthread_cond_init( &(tm->tm_Cond), NULL );
+		pthread_cond_init( &(tm->tm_DoneCond), NULL );
+
+		if( ( tm->tm_ThreadIDs = FCalloc( tm->tm_Threads, sizeof( pthread_t ) ) ) != NULL )
+		{
+			int i;
+			for( i=0 ; i < tm->tm_Threads ; i++ )
+			{
+				if( pthread_create( &(tm->tm_ThreadIDs[ tm->tm_ThreadsStarted ]), NULL, ThumbnailWorker, tm ) == 0 )
+				{
+					tm->tm_ThreadsStarted++;
+				}
+			}
+		}
+
+		Log( FLOG_INFO, "[ThumbnailManagerNew] Thumbnails cache: %s, max size %lu, threads %d, queue %d, eager sizes %d\n", tm->tm_Path, tm->tm_MaxSize, tm->tm_ThreadsStarted, tm->tm_QueueSize, tm->tm_EagerSizesCount );
+	}
+	return tm;
+}
+
+/**
+ * Delete ThumbnailManager, threads are stopped and jobs which were not started are removed
+ *
+ * @param tm pointer to ThumbnailManager
+ */
+void ThumbnailManagerDelete( ThumbnailManager *tm )
+{
+	int i;
+
+	if( tm == NULL )
+	{
+		return;
+	}
+
+	Log( FLOG_INFO, "[ThumbnailManagerDelete] Thumbnails hits %lu misses %lu generated %lu rejected %lu removed %lu\n", tm->tm_Hits, tm->tm_Misses, tm->tm_Generated, tm->tm_Rejected, tm->tm_Removed );
+
+	pthread_mutex_lock( &(tm->tm_Mutex) );
+	tm->tm_Quit = TRUE;
+	pthread_cond_broadcast( &(tm->tm_Cond) );
+	pthread_cond_broadcast( &(tm->tm_DoneCond) );
+	pthread_mutex_unlock( &(tm->tm_Mutex) );
+
+	for( i=0 ; i < tm->tm_ThreadsStarted ; i++ )
+	{
+		pthread_join( tm->tm_ThreadIDs[ i ], NULL );
+	}
+
+	pthread_mutex_lock( &(tm->tm_Mutex) );
+	ThumbnailJob *job = tm->tm_Queue;
+	while( job != NULL )
+	{
+		ThumbnailJob *rem = job;
+		job = job->tj_Next;
+		rem->tj_Device->f_Operations--;
+		ThumbnailJobRelease( rem );
+	}
+	tm->tm_Queue = tm->tm_QueueLast = NULL;
+	pthread_mutex_unlock( &(tm->tm_Mutex) );
+
+	pthread_cond_destroy( &(tm->tm_Cond) );
+	pthread_cond_destroy( &(tm->tm_DoneCond) );
+	pthread_mutex_destroy( &(tm->tm_Mutex) );
+
+	if( tm->tm_ThreadIDs != NULL )
+	{
+		FFree( tm->tm_ThreadIDs );
+	}
+	if( tm->tm_Path != NULL )
+	{
+		FFree( tm->tm_Path );
+	}
+	FFree( tm );
+}
+
+/**
+ * Get thumbnail of image. Thumbnail is taken from disk cache or generated by ThumbnailManager threads,
+ * request which asks for thumbnail which is already generated waits for same job.
+ *
+ * @param tm pointer to ThumbnailManager
+ * @param dev device on which image is stored
+ * @param path path to image with device name
+ * @param width maximum thumbnail width
+ * @param height maximum thumbnail height
+ * @param data pointer to place where thumbnail data will be stored (must be released by caller)
+ * @param size pointer to place where thumbnail size will be stored
+ * @param changeTime pointer to place where file change timestamp will be stored (0 - not provided by filesystem)
+ * @return THUMBNAIL_OK when success, otherwise THUMBNAIL_* error
+ */
+int ThumbnailManagerGet( ThumbnailManager *tm, File *dev, const char *path, int width, int height, char **data, int *size, FLONG *changeTime )
+{
+	FHandler *fh = (FHandler *)dev->f_FSys;
+	char key[ THUMBNAIL_KEY_SIZE ];
+	FLONG ctime = 0;
+	int ret = THUMBNAIL_ERROR;
+
+	*data = NULL;
+	*size = 0;
+
+	if( width > THUMBNAIL_MAX_DIMENSION ) width = THUMBNAIL_MAX_DIMENSION;
+	if( height > THUMBNAIL_MAX_DIMENSION ) height = THUMBNAIL_MAX_DIMENSION;
+	if( width <= 0 || height <= 0 )
+	{
+		return THUMBNAIL_ERROR;
+	}
+
+	if( fh->GetChangeTimestamp != NULL )
+	{
+		ctime = fh->GetChangeTimestamp( dev, path );
+		if( ctime < 0 )
+		{
+			ctime = 0;
+		}
+	}
+	*changeTime = ctime;
+
+	ThumbnailKey( dev->f_ID, path, ctime, width, height, key );
+
+	if( ctime > 0 && ( *data = ThumbnailCacheRead( tm, key, size ) ) != NULL )
+	{
+		if( pthread_mutex_lock( &(tm->tm_Mutex) ) == 0 )
+		{
+			tm->tm_Hits++;
+			pthread_mutex_unlock( &(tm->tm_Mutex) );
+		}
+		return THUMBNAIL_OK;
+	}
+
+	pthread_mutex_lock( &(tm->tm_Mutex) );
+
+	tm->tm_Misses++;
+
+	// same thumbnail can be already in queue or generated
+	ThumbnailJob *job = NULL;
+	ThumbnailJob *lists[ 2 ] = { tm->tm_Active, tm->tm_Queue };
+	int i;
+	for( i=0 ; i < 2 && job == NULL ; i++ )
+	{
+		ThumbnailJob *j = lists[ i ];
+		while( j != NULL )
+		{
+			if( j->tj_Device == dev && strcmp( j->tj_Key, key ) == 0 )
+			{
+				job = j;
+				break;
+			}
+			j = j->tj_Next;
+		}
+	}
+
+	if( job == NULL )
+	{
+		if( tm->tm_QueueCount >= tm->tm_QueueSize || tm->tm_Quit == TRUE )
+		{
+			tm->tm_Rejected++;
+			pthread_mutex_unlock( &(tm->tm_Mutex) );
+			return THUMBNAIL_BUSY;
+		}
+
+		if( ( job = FCalloc( 1, sizeof( ThumbnailJob ) ) ) == NULL || ( job->tj_Path = StringDuplicate( (char *)path ) ) == NULL )
+		{
+			if( job != NULL )
+			{
+				FFree( job );
+			}
+			pthread_mutex_unlock( &(tm->tm_Mutex) );
+			return THUMBNAIL_ERROR;
+		}
+
+		char *ext = strrchr( path, '.' );
+		job->tj_JPEG = ( ext != NULL && ( strcasecmp( ext, ".jpg" ) == 0 || strcasecmp( ext, ".jpeg" ) == 0 ) );
+		strcpy( job->tj_Key, key );
+		job->tj_Device = dev;
+		job->tj_ChangeTime = ctime;
+		job->tj_Width = width;
+		job->tj_Height = height;
+		job->tj_Refs = 1;		// queue
+		dev->f_Operations++;
+
+		if( tm->tm_QueueLast != NULL )
+		{
+			tm->tm_QueueLast->tj_Next = job;
+		}
+		else
+		{
+			tm->tm_Queue = job;
+		}
+		tm->tm_QueueLast = job;
+		tm->tm_QueueCount++;
+		pthread_cond_signal( &(tm->tm_Cond) );
+	}
+	job->tj_Refs++;
+
+	struct timeval now;
+	struct timespec timeout;
+	gettimeofday( &now, NULL );
+	timeout.tv_sec = now.tv_sec + THUMBNAIL_WAIT_TIME;
+	timeout.tv_nsec = now.tv_usec * 1000;
+
+	while( job->tj_Done == FALSE && tm->tm_Quit == FALSE )
+	{
+		if( pthread_cond_timedwait( &(tm->tm_DoneCond), &(tm->tm_Mutex), &timeout ) != 0 )
+		{
+			break;
+		}
+	}
+
+	if( job->tj_Done == TRUE )
+	{
+		if( job->tj_Data != NULL && ( *data = FMalloc( job->tj_Size ) ) != NULL )
+		{
+			memcpy( *data, job->tj_Data, job->tj_Size );
+			*size = job->tj_Size;
+			ret = THUMBNAIL_OK;
+		}
+	}
+	else
+	{
+		ret = THUMBNAIL_TIMEOUT;
+
+		// nobody waits for job which was not started, remove it from queue
+		if( job->tj_Started == FALSE && job->tj_Refs == 2 )
+		{
+			ThumbnailJob *prev = NULL;
+			ThumbnailJob *j = tm->tm_Queue;
+			while( j != NULL && j != job )
+			{
+				prev = j;
+				j = j->tj_Next;
+			}
+			
+			if( j != NULL )
+			{
+				if( prev != NULL )
+				{
+					prev->tj_Next = job->tj_Next;
+				}
+				else
+				{
+					tm->tm_Queue = job->tj_Next;
+				}
+				if( tm->tm_QueueLast == job )
+				{
+					tm->tm_QueueLast = prev;
+				}
+				tm->tm_QueueCount--;
+				job->tj_Device->f_Operations--;
+				job->tj_Refs--;
+			}
+		}
+	}
+	ThumbnailJobRelease( job );
+
+	pthread_mutex_unlock( &(tm->tm_Mutex) );
+
+	return ret;
+}
+
+/**
+ * Compare thumbnail files by last access time
+ */
+static int ThumbnailFileCompare( const void *a, const void *b )
+{
+	const ThumbnailFile *fa = (const ThumbnailFile *)a;
+	const ThumbnailFile *fb = (const ThumbnailFile *)b;
+
+	if( fa->tf_Time < fb->tf_Time ) return -1;
+	if( fa->tf_Time > fb->tf_Time ) return 1;
+	return 0;
+}
+
+/**
+ * Remove least recently used thumbnails when cache is bigger than allowed.
+ * Cache is reduced to 90% of maximum size, so cleanup is not needed after every new thumbnail.
+ *
+ * @param tm pointer to ThumbnailManager
+ */
+void ThumbnailManagerCleanup( ThumbnailManager *tm )
+{
+	ThumbnailFile *files = NULL;
+	int count = 0, max = 0;
+	FUQUAD total = 0;
+	time_t now = time( NULL );
+	DIR *top;
+	struct dirent *dir;
+
+	if( tm == NULL || ( top = opendir( tm->tm_Path ) ) == NULL )
+	{
+		return;
+	}
+
+	while( ( dir = readdir( top ) ) != NULL )
+	{
+		char subpath[ 1024 ];
+		DIR *sub;
+		struct dirent *entry;
+
+		if( dir->d_name[ 0 ] == '.' || strlen( dir->d_name ) != 2 )
+		{
+			continue;
+		}
+
+		snprintf( subpath, sizeof(subpath), "%s/%s", tm->tm_Path, dir->d_name );
+		if( ( sub = opendir( subpath ) ) == NULL )
+		{
+			continue;
+		}
+
+		while( ( entry = readdir( sub ) ) != NULL )
+		{
+			char name[ 1200 ];
+			struct stat st;
+
+			if( entry->d_name[ 0 ] == '.' )
+			{
+				continue;
+			}
+
+			snprintf( name, sizeof(name), "%s/%s", subpath, entry->d_name );
+			if( stat( name, &st ) != 0 || !S_ISREG( st.st_mode ) )
+			{
+				continue;
+			}
+
+			// temporary file left by crash
+			if( strstr( entry->d_name, ".tmp" ) != NULL )
+			{
+				if( st.st_mtime + THUMBNAIL_TOUCH_TIME < now )
+				{
+					unlink( name );
+				}
+				continue;
+			}
+
+			if( count >= max )
+			{
+				int nmax = max > 0 ? max * 2 : 4096;
+				ThumbnailFile *nfiles = FMalloc( nmax * sizeof( ThumbnailFile ) );
+				if( nfiles == NULL )
+				{
+					continue;
+				}
+				if( files != NULL )
+				{
+					memcpy( nfiles, files, count * sizeof( ThumbnailFile ) );
+					FFree( files );
+				}
+				files = nfiles;
+				max = nmax;
+			}
+
+			files[ count ].tf_Time = st.st_mtime;
+			files[ count ].tf_Size = st.st_size;
+			snprintf( files[ count ].tf_Name, sizeof( files[ count ].tf_Name ), "%s/%s", dir->d_name, entry->d_name );
+			total += st.st_size;
+			count++;
+		}
+		closedir( sub );
+	}
+	closedir( top );
+
+	FULONG removed = 0;
+
+	if( tm->tm_MaxSize > 0 && total > tm->tm_MaxSize && files != NULL )
+	{
+		FUQUAD limit = tm->tm_MaxSize / 10 * 9;
+		int i;
+
+		qsort( files, count, sizeof( ThumbnailFile ), ThumbnailFileCompare );
+
+		for( i=0 ; i < count && total > limit ; i++ )
+		{
+			char name[ 1200 ];
+			snprintf( name, sizeof(name), "%s/%s", tm->tm_Path, files[ i ].tf_Name );
+			if( unlink( name ) == 0 )
+			{
+				total -= files[ i ].tf_Size;
+				removed++;
+			}
+		}
+	}
+
+	if( files != NULL )
+	{
+		FFree( files );
+	}
+
+	if( pthread_mutex_lock( &(tm->tm_Mutex) ) == 0 )
+	{
+		tm->tm_DiskSize = total;
+		tm->tm_Removed += removed;
+		pthread_mutex_unlock( &(tm->tm_Mutex) );
+	}
+
+	DEBUG("[ThumbnailManagerCleanup] Thumbnails %d size %lu removed %lu\n", count, total, removed );
+}
@@ -0,0 +1,133 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ *  Thumbnail manager
+ *
+ *  Thumbnails are generated by fixed number of background threads and stored
+ *  on disk under name built from hash of device, path, file change time and
+ *  thumbnail dimensions.
+ *  Least recently used thumbnails are removed by event when cache is full.
+ */
+
+#ifndef __SYSTEM_CACHE_THUMBNAIL_MANAGER_H__
+#define __SYSTEM_CACHE_THUMBNAIL_MANAGER_H__
+
+#include <core/types.h>
+#include <system/fsys/file.h>
+#include <pthread.h>
+
+#ifndef THUMBNAIL_THREADS
+#define THUMBNAIL_THREADS 2						// number of threads generating thumbnails
+#endif
+
+#ifndef THUMBNAIL_QUEUE_SIZE
+#define THUMBNAIL_QUEUE_SIZE 64					// requests above this number are rejected
+#endif
+
+#define THUMBNAIL_MAX_DIMENSION 1024			// biggest thumbnail width/height
+#define THUMBNAIL_MAX_SOURCE_SIZE 67108864		// bigger files are not read
+#define THUMBNAIL_MAX_PIXELS 40000000			// bigger non-JPEG images are not decoded
+#define THUMBNAIL_WAIT_TIME 30					// seconds which request waits for thumbnail
+#define THUMBNAIL_MAX_EAGER_SIZES 8
+#define THUMBNAIL_KEY_SIZE 33
+
+//
+// results of ThumbnailManagerGet
+//
+
+enum {
+	THUMBNAIL_OK = 0,
+	THUMBNAIL_BUSY,								// queue is full
+	THUMBNAIL_TIMEOUT,
+	THUMBNAIL_ERROR								// file cannot be read or it is not image
+};
+
+//
+// thumbnail waiting for generation or being generated
+//
+
+typedef struct ThumbnailJob
+{
+	struct ThumbnailJob		*tj_Next;
+	File					*tj_Device;
+	char					*tj_Path;			// path with device name
+	char					tj_Key[ THUMBNAIL_KEY_SIZE ];
+	FLONG					tj_ChangeTime;		// 0 - filesystem does not provide it, thumbnail is not stored
+	int						tj_Width;			// requested box, thumbnail keeps image proportions
+	int						tj_Height;
+	FBOOL					tj_JPEG;			// JPEG output, otherwise PNG
+
+	FBOOL					tj_Started;
+	FBOOL					tj_Done;
+	int						tj_Refs;			// queue/worker and waiting requests
+	char					*tj_Data;			// generated thumbnail
+	int						tj_Size;
+}ThumbnailJob;
+
+//
+// manager
+//
+
+typedef struct ThumbnailManager
+{
+	void					*tm_SB;
+	char					*tm_Path;			// cache directory
+	FUQUAD					tm_MaxSize;			// bytes, 0 - unlimited
+	FUQUAD					tm_DiskSize;		// bytes used by cache (updated by cleanup)
+	int						tm_CleanupInterval;	// seconds
+	int						tm_Threads;
+	int						tm_QueueSize;
+	int						tm_EagerSizes[ THUMBNAIL_MAX_EAGER_SIZES ];	// sizes generated together with requested one
+	int						tm_EagerSizesCount;
+
+	ThumbnailJob			*tm_Queue;
+	ThumbnailJob			*tm_QueueLast;
+	int						tm_QueueCount;
+	ThumbnailJob			*tm_Active;			// jobs handled by threads
+	pthread_t				*tm_ThreadIDs;
+	int						tm_ThreadsStarted;
+	FBOOL					tm_Quit;
+	pthread_mutex_t			tm_Mutex;
+	pthread_cond_t			tm_Cond;			// new job in queue
+	pthread_cond_t			tm_DoneCond;		// job finished
+
+	FULONG					tm_Hits;			// statistics
+	FULONG					tm_Misses;
+	FULONG					tm_Generated;
+	FULONG					tm_Rejected;
+	FULONG					tm_Removed;
+}ThumbnailManager;
+
+//
+//
+//
+
+ThumbnailManager *ThumbnailManagerNew( void *sb );
+
+//
+//
+//
+
+void ThumbnailManagerDelete( ThumbnailManager *tm );
+
+//
+// get thumbnail of image, path with device name. Data must be released by caller
+//
+
+int ThumbnailManagerGet( ThumbnailManager *tm, File *dev, const char *path, int width, int height, char **data, int *size, FLONG *changeTime );
+
+//
+// remove least recently used thumbnails when cache is bigger than allowed, called by EventManager
+//
+
+void ThumbnailManagerCleanup( ThumbnailManager *tm );
+
+#endif // __SYSTEM_CACHE_THUMBNAIL_MANAGER_H__
@@ -0,0 +1,344 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ * Body of image header probing
+ */
+
+#include "image_probe.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define BE16( p ) ( ( (unsigned int)(p)[ 0 ] << 8 ) | (unsigned int)(p)[ 1 ] )
+#define BE32( p ) ( ( (unsigned int)(p)[ 0 ] << 24 ) | ( (unsigned int)(p)[ 1 ] << 16 ) | ( (unsigned int)(p)[ 2 ] << 8 ) | (unsigned int)(p)[ 3 ] )
+#define LE16( p ) ( ( (unsigned int)(p)[ 1 ] << 8 ) | (unsigned int)(p)[ 0 ] )
+#define LE24( p ) ( ( (unsigned int)(p)[ 2 ] << 16 ) | ( (unsigned int)(p)[ 1 ] << 8 ) | (unsigned int)(p)[ 0 ] )
+#define LE32( p ) ( ( (unsigned int)(p)[ 3 ] << 24 ) | ( (unsigned int)(p)[ 2 ] << 16 ) | ( (unsigned int)(p)[ 1 ] << 8 ) | (unsigned int)(p)[ 0 ] )
+
+/**
+ * Get dimensions from PNG IHDR chunk
+ *
+ * @param data pointer to file data
+ * @param len number of bytes in data
+ * @param info pointer to structure where dimensions will be stored
+ * @return IMAGE_PROBE_* result
+ */
+static int ImageProbePNG( const FBYTE *data, int len, ImageProbeInfo *info )
+{
+	if( len < 24 )
+	{
+		return IMAGE_PROBE_MORE_DATA;
+	}
+	if( memcmp( data + 12, "IHDR", 4 ) != 0 )
+	{
+		return IMAGE_PROBE_UNKNOWN;
+	}
+	info->ipi_Format = "png";
+	info->ipi_Width = (int)BE32( data + 16 );
+	info->ipi_Height = (int)BE32( data + 20 );
+	return IMAGE_PROBE_OK;
+}
+
+/**
+ * Get dimensions from JPEG SOFn segment. Segments before it are skipped.
+ *
+ * @param data pointer to file data
+ * @param len number of bytes in data
+ * @param info pointer to structure where dimensions will be stored
+ * @return IMAGE_PROBE_* result
+ */
+static int ImageProbeJPEG( const FBYTE *data, int len, ImageProbeInfo *info )
+{
+	int pos = 2;
+
+	while( TRUE )
+	{
+		// markers can be preceded by any number of fill bytes
+		while( pos < len && data[ pos ] == 0xFF && pos + 1 < len && data[ pos + 1 ] == 0xFF )
+		{
+			pos++;
+		}
+		if( pos + 4 > len )
+		{
+			return IMAGE_PROBE_MORE_DATA;
+		}
+		if( data[ pos ] != 0xFF )
+		{
+			return IMAGE_PROBE_UNKNOWN;
+		}
+
+		FBYTE marker = data[ pos + 1 ];
+
+		// SOF0 - SOF15, without DHT, JPG and DAC
+		if( marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC )
+		{
+			if( pos + 9 > len )
+			{
+				return IMAGE_PROBE_MORE_DATA;
+			}
+			info->ipi_Format = "jpeg";
+			info->ipi_Height = (int)BE16( data + pos + 5 );
+			info->ipi_Width = (int)BE16( data + pos + 7 );
+			return IMAGE_PROBE_OK;
+		}
+
+		// markers without length
+		if( ( marker >= 0xD0 && marker <= 0xD7 ) || marker == 0x01 )
+		{
+			pos += 2;
+			continue;
+		}
+
+		// start of scan or end of image before frame header
+		if( marker == 0xDA || marker == 0xD9 )
+		{
+			return IMAGE_PROBE_UNKNOWN;
+		}
+
+		int seglen = (int)BE16( data + pos + 2 );
+		if( seglen < 2 )
+		{
+			return IMAGE_PROBE_UNKNOWN;
+		}
+		pos += 2 + seglen;
+	}
+	return IMAGE_PROBE_UNKNOWN;
+}
+
+/**
+ * Get dimensions from GIF logical screen descriptor
+ *
+ * @param data pointer to file data
+ * @param len number of bytes in data
+ * @param info pointer to structure where dimensions will be stored
+ * @return IMAGE_PROBE_* result
+ */
+static int ImageProbeGIF( const FBYTE *data, int len, ImageProbeInfo *info )
+{
+	if( len < 10 )
+	{
+		return IMAGE_PROBE_MORE_DATA;
+	}
+	info->ipi_Format = "gif";
+	info->ipi_Width = (int)LE16( data + 6 );
+	info->ipi_Height = (int)LE16( data + 8 );
+	return IMAGE_PROBE_OK;
+}
+
+/**
+ * Get dimensions from WebP VP8, VP8L or VP8X chunk
+ *
+ * @param data pointer to file data
+ * @param len number of bytes in data
+ * @param info pointer to structure where dimensions will be stored
+ * @return IMAGE_PROBE_* result
+ */
+static int ImageProbeWebP( const FBYTE *data, int len, ImageProbeInfo *info )
+{
+	if( len < 30 )
+	{
+		return IMAGE_PROBE_MORE_DATA;
+	}
+
+	info->ipi_Format = "webp";
+
+	if( memcmp( data + 12, "VP8 ", 4 ) == 0 )
+	{
+		// lossy, key frame start code after 3 bytes of frame tag
+		if( data[ 23 ] != 0x9D || data[ 24 ] != 0x01 || data[ 25 ] != 0x2A )
+		{
+			return IMAGE_PROBE_UNKNOWN;
+		}
+		info->ipi_Width = (int)( LE16( data + 26 ) & 0x3FFF );
+		info->ipi_Height = (int)( LE16( data + 28 ) & 0x3FFF );
+		return IMAGE_PROBE_OK;
+	}
+	else if( memcmp( data + 12, "VP8L", 4 ) == 0 )
+	{
+		// lossless, 14 bits width-1 and 14 bits height-1 after signature byte
+		if( data[ 20 ] != 0x2F )
+		{
+			return IMAGE_PROBE_UNKNOWN;
+		}
+		unsigned int bits = LE32( data + 21 );
+		info->ipi_Width = (int)( bits & 0x3FFF ) + 1;
+		info->ipi_Height = (int)( ( bits >> 14 ) & 0x3FFF ) + 1;
+		return IMAGE_PROBE_OK;
+	}
+	else if( memcmp( data + 12, "VP8X", 4 ) == 0 )
+	{
+		// extended, canvas size after flags
+		info->ipi_Width = (int)LE24( data + 24 ) + 1;
+		info->ipi_Height = (int)LE24( data + 27 ) + 1;
+		return IMAGE_PROBE_OK;
+	}
+	return IMAGE_PROBE_UNKNOWN;
+}
+
+/**
+ * Get dimensions from BMP info header
+ *
+ * @param data pointer to file data
+ * @param len number of bytes in data
+ * @param info pointer to structure where dimensions will be stored
+ * @return IMAGE_PROBE_* result
+ */
+static int ImageProbeBMP( const FBYTE *data, int len, ImageProbeInfo *info )
+{
+	if( len < 26 )
+	{
+		return IMAGE_PROBE_MORE_DATA;
+	}
+
+	info->ipi_Format = "bmp";
+
+	if( LE32( data + 14 ) == 12 )
+	{
+		// OS/2 BITMAPCOREHEADER
+		info->ipi_Width = (int)LE16( data + 18 );
+		info->ipi_Height = (int)LE16( data + 20 );
+	}
+	else
+	{
+		// height is negative for top-down bitmaps
+		info->ipi_Width = abs( (int)LE32( data + 18 ) );
+		info->ipi_Height = abs( (int)LE32( data + 22 ) );
+	}
+	return IMAGE_PROBE_OK;
+}
+
+/**
+ * Get dimensions from first TIFF IFD
+ *
+ * @param data pointer to file data
+ * @param len number of bytes in data
+ * @param info pointer to structure where dimensions will be stored
+ * @return IMAGE_PROBE_* result
+ */
+static int ImageProbeTIFF( const FBYTE *data, int len, ImageProbeInfo *info )
+{
+	FBOOL bigEndian = ( data[ 0 ] == 'M' );
+
+	if( len < 8 )
+	{
+		return IMAGE_PROBE_MORE_DATA;
+	}
+
+	unsigned int ifd = bigEndian ? BE32( data + 4 ) : LE32( data + 4 );
+	if( ifd < 8 || ifd >= IMAGE_PROBE_MAX_SIZE )
+	{
+		return IMAGE_PROBE_UNKNOWN;
+	}
+	if( ifd + 2 > (unsigned int)len )
+	{
+		return IMAGE_PROBE_MORE_DATA;
+	}
+
+	unsigned int entries = bigEndian ? BE16( data + ifd ) : LE16( data + ifd );
+	if( ifd + 2 + entries * 12 > (unsigned int)len )
+	{
+		return IMAGE_PROBE_MORE_DATA;
+	}
+
+	unsigned int i;
+	info->ipi_Format = "tiff";
+
+	for( i=0 ; i < entries ; i++ )
+	{
+		const FBYTE *e = data + ifd + 2 + i * 12;
+		unsigned int tag = bigEndian ? BE16( e ) : LE16( e );
+		unsigned int type = bigEndian ? BE16( e + 2 ) : LE16( e + 2 );
+		unsigned int value;
+
+		if( tag != 256 && tag != 257 )
+		{
+			continue;
+		}
+
+		if( type == 3 )			// SHORT
+		{
+			value = bigEndian ? BE16( e + 8 ) : LE16( e + 8 );
+		}
+		else if( type == 4 )	// LONG
+		{
+			value = bigEndian ? BE32( e + 8 ) : LE32( e + 8 );
+		}
+		else
+		{
+			continue;
+		}
+
+		if( tag == 256 )
+		{
+			info->ipi_Width = (int)value;
+		}
+		else
+		{
+			info->ipi_Height = (int)value;
+		}
+	}
+	return IMAGE_PROBE_OK;
+}
+
+/**
+ * Get image format and dimensions from first bytes of file, image data is not decoded
+ *
+ * @param data pointer to beginning of file
+ * @param len number of bytes in data
+ * @param info pointer to structure where format and dimensions will be stored
+ * @return IMAGE_PROBE_OK when dimensions were found, IMAGE_PROBE_MORE_DATA when header is longer than data, otherwise IMAGE_PROBE_UNKNOWN
+ */
+int ImageProbe( const FBYTE *data, int len, ImageProbeInfo *info )
+{
+	int ret = IMAGE_PROBE_UNKNOWN;
+
+	if( data == NULL || info == NULL )
+	{
+		return IMAGE_PROBE_UNKNOWN;
+	}
+
+	memset( info, 0, sizeof( ImageProbeInfo ) );
+
+	if( len < 12 )
+	{
+		return IMAGE_PROBE_MORE_DATA;
+	}
+
+	if( memcmp( data, "\x89PNG\r\n\x1A\n", 8 ) == 0 )
+	{
+		ret = ImageProbePNG( data, len, info );
+	}
+	else if( data[ 0 ] == 0xFF && data[ 1 ] == 0xD8 )
+	{
+		ret = ImageProbeJPEG( data, len, info );
+	}
+	else if( memcmp( data, "GIF87a", 6 ) == 0 || memcmp( data, "GIF89a", 6 ) == 0 )
+	{
+		ret = ImageProbeGIF( data, len, info );
+	}
+	else if( memcmp( data, "RIFF", 4 ) == 0 && memcmp( data + 8, "WEBP", 4 ) == 0 )
+	{
+		ret = ImageProbeWebP( data, len, info );
+	}
+	else if( data[ 0 ] == 'B' && data[ 1 ] == 'M' )
+	{
+		ret = ImageProbeBMP( data, len, info );
+	}
+	else if( memcmp( data, "II*\0", 4 ) == 0 || memcmp( data, "MM\0*", 4 ) == 0 )
+	{
+		ret = ImageProbeTIFF( data, len, info );
+	}
+
+	if( ret == IMAGE_PROBE_OK && ( info->ipi_Width <= 0 || info->ipi_Height <= 0 ) )
+	{
+		ret = IMAGE_PROBE_UNKNOWN;
+	}
+	return ret;
+}
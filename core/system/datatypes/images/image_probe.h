@@ -0,0 +1,58 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ * Image header probing
+ *
+ * Dimensions are taken from file header, image is not decoded.
+ * Supported formats: PNG, JPEG, GIF, WebP, BMP, TIFF
+ */
+
+#ifndef __SYSTEM_DATATYPES_IMAGES_IMAGE_PROBE_H__
+#define __SYSTEM_DATATYPES_IMAGES_IMAGE_PROBE_H__
+
+#include <core/types.h>
+
+#ifndef IMAGE_PROBE_START_SIZE
+#define IMAGE_PROBE_START_SIZE 4096			// number of bytes read before first probe
+#endif
+
+#ifndef IMAGE_PROBE_MAX_SIZE
+#define IMAGE_PROBE_MAX_SIZE 524288			// probe gives up when header was not found in this number of bytes
+#endif
+
+//
+// results of ImageProbe
+//
+
+enum {
+	IMAGE_PROBE_OK = 0,
+	IMAGE_PROBE_MORE_DATA,					// header is longer than provided data
+	IMAGE_PROBE_UNKNOWN						// format is not supported or data is broken
+};
+
+//
+// information found in header
+//
+
+typedef struct ImageProbeInfo
+{
+	const char				*ipi_Format;	// "png", "jpeg", "gif", "webp", "bmp", "tiff"
+	int						ipi_Width;
+	int						ipi_Height;
+}ImageProbeInfo;
+
+//
+// get image dimensions from first bytes of file
+//
+
+int ImageProbe( const FBYTE *data, int len, ImageProbeInfo *info );
+
+#endif // __SYSTEM_DATATYPES_IMAGES_IMAGE_PROBE_H__
@@ -372,7 +372,7 @@ int DoorNotificationCommunicateChanges( void *lsb, UserSession *ses __attribute_
 		return 1;
 	}
 	
-	SQLLibrary *sqllib = sb->LibrarySQLGet( sb );
+	SQLLibrary *sqllib = sb->LibrarySQLGetRead( sb );
 	if( sqllib != NULL )
 	{
 		char *pathNoDevice = path;
@@ -0,0 +1,741 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+/** @file fs_copy.c
+ *
+ *  Copy files and directories between devices
+ */
+
+#include "fs_copy.h"
+#include <system/systembase.h>
+#include <system/fsys/fsys.h>
+#include <system/fsys/fsys_activity.h>
+#include <system/json/jsmn.h>
+#include <system/json/json_converter.h>
+
+//
+// buffer passed between reader thread and writer
+//
+
+typedef struct FileCopyBuffer
+{
+	char					*fcb_Data;
+	int						fcb_Size;
+	FBOOL					fcb_Full;		// filled by reader, waiting for writer
+}FileCopyBuffer;
+
+typedef struct FileCopyPipe
+{
+	FHandler				*fcp_FS;		// source filesystem
+	File					*fcp_FP;		// opened source file
+	FileCopyBuffer			fcp_Buffers[ 2 ];
+	FBOOL					fcp_EOF;
+	FBOOL					fcp_Error;		// source could not be read, it is not end of file
+	FBOOL					fcp_Quit;
+	pthread_mutex_t			fcp_Mutex;
+	pthread_cond_t			fcp_Cond;
+}FileCopyPipe;
+
+/**
+ * Check if copy should be stopped (connection closed or FriendCore is going down)
+ *
+ * @param job pointer to FileCopyJob
+ * @return TRUE when copy must be stopped
+ */
+static inline FBOOL FileCopyStopped( FileCopyJob *job )
+{
+	return ( job->fcj_Request != NULL && job->fcj_Request->http_ShutdownPtr != NULL && *(job->fcj_Request->http_ShutdownPtr) == TRUE );
+}
+
+/**
+ * Pipeline reader thread. Fills free buffers with source file data.
+ *
+ * @param data pointer to FileCopyPipe
+ * @return NULL
+ */
+static void *FileCopyReader( void *data )
+{
+	FileCopyPipe *fcp = (FileCopyPipe *)data;
+	int idx = 0;
+
+	pthread_mutex_lock( &(fcp->fcp_Mutex) );
+	while( fcp->fcp_Quit == FALSE )
+	{
+		FileCopyBuffer *buf = &(fcp->fcp_Buffers[ idx ]);
+		if( buf->fcb_Full == TRUE )
+		{
+			pthread_cond_wait( &(fcp->fcp_Cond), &(fcp->fcp_Mutex) );
+			continue;
+		}
+		pthread_mutex_unlock( &(fcp->fcp_Mutex) );
+
+		int size = fcp->fcp_FS->FileRead( fcp->fcp_FP, buf->fcb_Data, FILE_COPY_BUFFER_SIZE );
+
+		pthread_mutex_lock( &(fcp->fcp_Mutex) );
+		if( size <= 0 )
+		{
+			if( size < 0 )
+			{
+				FERROR("[FileCopyReader] Cannot read source file, error %d\n", size );
+				fcp->fcp_Error = TRUE;
+			}
+			fcp->fcp_EOF = TRUE;
+			pthread_cond_broadcast( &(fcp->fcp_Cond) );
+			break;
+		}
+		buf->fcb_Size = size;
+		buf->fcb_Full = TRUE;
+		pthread_cond_broadcast( &(fcp->fcp_Cond) );
+		idx ^= 1;
+	}
+	pthread_mutex_unlock( &(fcp->fcp_Mutex) );
+
+	return NULL;
+}
+
+/**
+ * Copy data between opened files. Next block is read by separate thread while current one is written.
+ *
+ * @param job pointer to FileCopyJob
+ * @param rfp opened source file
+ * @param wfp opened destination file
+ * @param stored pointer to place where number of bytes stored in destination is put (also when copy failed)
+ * @return number of bytes written or -1 when error appear (short write, read error, copy stopped)
+ */
+static FQUAD FileCopyPipeRun( FileCopyJob *job, File *rfp, File *wfp, FQUAD *stored )
+{
+	FHandler *dstfs = (FHandler *)job->fcj_DstDev->f_FSys;
+	FileCopyPipe fcp;
+	pthread_t thread;
+	FQUAD written = 0;
+	FBOOL failed = FALSE;
+	int idx = 0;
+	
+	*stored = 0;
+
+	memset( &fcp, 0, sizeof( FileCopyPipe ) );
+	fcp.fcp_FS = (FHandler *)job->fcj_SrcDev->f_FSys;
+	fcp.fcp_FP = rfp;
+	fcp.fcp_Buffers[ 0 ].fcb_Data = FMalloc( FILE_COPY_BUFFER_SIZE );
+	fcp.fcp_Buffers[ 1 ].fcb_Data = FMalloc( FILE_COPY_BUFFER_SIZE );
+
+	if( fcp.fcp_Buffers[ 0 ].fcb_Data == NULL || fcp.fcp_Buffers[ 1 ].fcb_Data == NULL )
+	{
+		FERROR("[FileCopyPipeRun] Cannot allocate memory for buffers\n");
+		if( fcp.fcp_Buffers[ 0 ].fcb_Data != NULL ) FFree( fcp.fcp_Buffers[ 0 ].fcb_Data );
+		if( fcp.fcp_Buffers[ 1 ].fcb_Data != NULL ) FFree( fcp.fcp_Buffers[ 1 ].fcb_Data );
+		return -1;
+	}
+
+	pthread_mutex_init( &(fcp.fcp_Mutex), NULL );
+	pthread_cond_init( &(fcp.fcp_Cond), NULL );
+
+	if( pthread_create( &thread, NULL, FileCopyReader, &fcp ) != 0 )
+	{
+		FERROR("[FileCopyPipeRun] Cannot start reader thread\n");
+		written = -1;
+	}
+	else
+	{
+		pthread_mutex_lock( &(fcp.fcp_Mutex) );
+		while( TRUE )
+		{
+			FileCopyBuffer *buf = &(fcp.fcp_Buffers[ idx ]);
+			while( buf->fcb_Full == FALSE && fcp.fcp_EOF == FALSE )
+			{
+				pthread_cond_wait( &(fcp.fcp_Cond), &(fcp.fcp_Mutex) );
+			}
+			if( buf->fcb_Full == FALSE )	// all data read
+			{
+				break;
+			}
+			pthread_mutex_unlock( &(fcp.fcp_Mutex) );
+
+			FBOOL quit = FileCopyStopped( job );
+			if( quit == FALSE )
+			{
+				FQUAD size = buf->fcb_Size;
+
+				// device activity is shared by all threads which copy to this device
+				pthread_mutex_lock( &(job->fcj_Mutex) );
+				size = FileSystemActivityCheckAndUpdate( job->fcj_SB, &(job->fcj_DstDev->f_Activity), size );
+				pthread_mutex_unlock( &(job->fcj_Mutex) );
+
+				int bytes = dstfs->FileWrite( wfp, buf->fcb_Data, (int)size );
+				if( bytes > 0 )
+				{
+					written += bytes;
+				}
+				// storage limit reached or write error
+				if( bytes < buf->fcb_Size )
+				{
+					FERROR("[FileCopyPipeRun] Stored %d of %d bytes\n", bytes, buf->fcb_Size );
+					quit = TRUE;
+				}
+			}
+			// destination file is not complete
+			if( quit == TRUE )
+			{
+				failed = TRUE;
+			}
+
+			pthread_mutex_lock( &(fcp.fcp_Mutex) );
+			buf->fcb_Full = FALSE;
+			pthread_cond_broadcast( &(fcp.fcp_Cond) );
+			idx ^= 1;
+
+			if( quit == TRUE )
+			{
+				break;
+			}
+		}
+		fcp.fcp_Quit = TRUE;
+		pthread_cond_broadcast( &(fcp.fcp_Cond) );
+		pthread_mutex_unlock( &(fcp.fcp_Mutex) );
+
+		pthread_join( thread, NULL );
+		
+		*stored = written;
+		if( failed == TRUE || fcp.fcp_Error == TRUE )
+		{
+			written = -1;
+		}
+	}
+
+	pthread_cond_destroy( &(fcp.fcp_Cond) );
+	pthread_mutex_destroy( &(fcp.fcp_Mutex) );
+	FFree( fcp.fcp_Buffers[ 0 ].fcb_Data );
+	FFree( fcp.fcp_Buffers[ 1 ].fcb_Data );
+
+	return written;
+}
+
+/**
+ * Prepare copy between two devices
+ *
+ * @param job pointer to FileCopyJob which will be initialized
+ * @param sb pointer to SystemBase
+ * @param request http request to which progress messages are sent, can be NULL
+ * @param usr user for which access to every copied entry is checked, NULL when not needed
+ * @param srcdev source device
+ * @param dstdev destination device
+ */
+void FileCopyJobInit( FileCopyJob *job, void *sb, Http *request, User *usr, File *srcdev, File *dstdev )
+{
+	memset( job, 0, sizeof( FileCopyJob ) );
+	job->fcj_SB = sb;
+	job->fcj_Request = request;
+	job->fcj_User = usr;
+	job->fcj_SrcDev = srcdev;
+	job->fcj_DstDev = dstdev;
+	pthread_mutex_init( &(job->fcj_Mutex), NULL );
+	pthread_cond_init( &(job->fcj_Cond), NULL );
+}
+
+/**
+ * Release resources used by copy
+ *
+ * @param job pointer to FileCopyJob
+ */
+void FileCopyJobRelease( FileCopyJob *job )
+{
+	FileCopyTask *task = job->fcj_Tasks;
+	while( task != NULL )
+	{
+		FileCopyTask *rem = task;
+		task = task->fct_Next;
+		FFree( rem->fct_Src );
+		FFree( rem->fct_Dst );
+		FFree( rem );
+	}
+	job->fcj_Tasks = job->fcj_TasksLast = NULL;
+
+	pthread_cond_destroy( &(job->fcj_Cond) );
+	pthread_mutex_destroy( &(job->fcj_Mutex) );
+}
+
+/**
+ * Copy file. Filesystem FileCopy is used when both devices are handled by same filesystem,
+ * otherwise data is passed through FileCopyPipeRun.
+ *
+ * @param job pointer to FileCopyJob
+ * @param src source path (without device name)
+ * @param dst destination path (without device name)
+ * @param closeError pointer to place where destination FileClose result will be stored, can be NULL
+ * @return number of bytes written or -1 when error appear
+ */
+FQUAD FileCopyFile( FileCopyJob *job, const char *src, const char *dst, int *closeError )
+{
+	FHandler *srcfs = (FHandler *)job->fcj_SrcDev->f_FSys;
+	FHandler *dstfs = (FHandler *)job->fcj_DstDev->f_FSys;
+	FQUAD written = -1;
+
+	if( closeError != NULL )
+	{
+		*closeError = 0;
+	}
+
+	// native copy, not used when destination has storage limit which is checked block by block
+	if( srcfs == dstfs && srcfs->FileCopy != NULL && job->fcj_DstDev->f_Activity.fsa_StoredBytesLeft == 0 )
+	{
+		written = srcfs->FileCopy( job->fcj_DstDev, dst, job->fcj_SrcDev, src );
+		if( written >= 0 )
+		{
+			pthread_mutex_lock( &(job->fcj_Mutex) );
+			job->fcj_DstDev->f_BytesStored += written;
+			job->fcj_Written += written;
+			pthread_mutex_unlock( &(job->fcj_Mutex) );
+
+			DEBUG("[FileCopyFile] %s copied by filesystem, %ld bytes\n", src, written );
+			return written;
+		}
+		if( written == -1 )
+		{
+			FERROR("[FileCopyFile] Filesystem cannot copy %s to %s\n", src, dst );
+			return -1;
+		}
+	}
+
+	File *rfp = (File *)srcfs->FileOpen( job->fcj_SrcDev, src, "rb" );
+	if( rfp == NULL )
+	{
+		FERROR("[FileCopyFile] Cannot open source file %s\n", src );
+		return -1;
+	}
+
+	File *wfp = (File *)dstfs->FileOpen( job->fcj_DstDev, dst, "w+" );
+	if( wfp != NULL )
+	{
+		FQUAD stored = 0;
+		written = FileCopyPipeRun( job, rfp, wfp, &stored );
+
+		int error = dstfs->FileClose( job->fcj_DstDev, wfp );
+		if( closeError != NULL )
+		{
+			*closeError = error;
+		}
+
+		// partial data takes space on device too
+		if( stored > 0 )
+		{
+			pthread_mutex_lock( &(job->fcj_Mutex) );
+			job->fcj_DstDev->f_BytesStored += stored;
+			job->fcj_Written += stored;
+			pthread_mutex_unlock( &(job->fcj_Mutex) );
+		}
+	}
+	else
+	{
+		FERROR("[FileCopyFile] Cannot open destination file %s\n", dst );
+	}
+
+	srcfs->FileClose( job->fcj_SrcDev, rfp );
+
+	return written;
+}
+
+/**
+ * Send copy progress to user
+ *
+ * @param job pointer to FileCopyJob
+ * @param dst path of copied file
+ * @param done number of copied files
+ * @param files number of files found so far
+ */
+static void FileCopyProgress( FileCopyJob *job, const char *dst, int done, int files )
+{
+	if( job->fcj_Request == NULL )
+	{
+		return;
+	}
+
+	SystemBase *sb = (SystemBase *)job->fcj_SB;
+	char message[ 1024 ];
+	int namelen = strlen( dst );
+	const char *fname = dst;
+	if( namelen > 255 )
+	{
+		fname = dst + ( namelen - 255 );
+	}
+
+	int per = 0;
+	if( files > 0 )
+	{
+		per = (int)( (float)done/(float)files * 100.0f );
+	}
+
+	int size = snprintf( message, sizeof(message), "\"action\":\"copy\",\"filename\":\"%s\",\"progress\":%d", fname, per );
+
+	sb->SendProcessMessage( job->fcj_Request, message, size );
+}
+
+/**
+ * Directory copy worker thread. Copies files found by FileCopyScan.
+ *
+ * @param data pointer to FileCopyJob
+ * @return NULL
+ */
+static void *FileCopyWorker( void *data )
+{
+	FileCopyJob *job = (FileCopyJob *)data;
+
+	pthread_mutex_lock( &(job->fcj_Mutex) );
+	while( TRUE )
+	{
+		FileCopyTask *task = job->fcj_Tasks;
+		if( task == NULL )
+		{
+			if( job->fcj_ScanDone == TRUE )
+			{
+				break;
+			}
+			pthread_cond_wait( &(job->fcj_Cond), &(job->fcj_Mutex) );
+			continue;
+		}
+
+		job->fcj_Tasks = task->fct_Next;
+		if( job->fcj_Tasks == NULL )
+		{
+			job->fcj_TasksLast = NULL;
+		}
+		pthread_mutex_unlock( &(job->fcj_Mutex) );
+
+		FQUAD written = -1;
+		if( FileCopyStopped( job ) == FALSE )
+		{
+			written = FileCopyFile( job, task->fct_Src, task->fct_Dst, NULL );
+		}
+
+		pthread_mutex_lock( &(job->fcj_Mutex) );
+		if( written < 0 )
+		{
+			job->fcj_Errors++;
+		}
+		job->fcj_FilesDone++;
+		int done = job->fcj_FilesDone;
+		int files = job->fcj_Files;
+		pthread_mutex_unlock( &(job->fcj_Mutex) );
+
+		FileCopyProgress( job, task->fct_Dst, done, files );
+
+		FFree( task->fct_Src );
+		FFree( task->fct_Dst );
+		FFree( task );
+
+		pthread_mutex_lock( &(job->fcj_Mutex) );
+	}
+	pthread_mutex_unlock( &(job->fcj_Mutex) );
+
+	return NULL;
+}
+
+/**
+ * Create path of directory entry
+ *
+ * @param dir directory path
+ * @param name entry name taken from JSON (can contain escaped characters)
+ * @param namelen length of name
+ * @return new path or NULL when error appear
+ */
+static char *FileCopyMakePath( const char *dir, const char *name, int namelen )
+{
+	int dirlen = strlen( dir );
+	char *path = FCalloc( dirlen + namelen + 2, sizeof(char) );
+	if( path != NULL )
+	{
+		int pos = dirlen;
+		int i;
+
+		memcpy( path, dir, dirlen );
+		if( dirlen > 0 && dir[ dirlen-1 ] != '/' && dir[ dirlen-1 ] != ':' )
+		{
+			path[ pos++ ] = '/';
+		}
+		for( i=0 ; i < namelen ; i++ )
+		{
+			if( name[ i ] == '\\' && i+1 < namelen )
+			{
+				i++;
+			}
+			path[ pos++ ] = name[ i ];
+		}
+	}
+	return path;
+}
+
+/**
+ * Check if user has access to source entry (read) and destination entry (write)
+ *
+ * @param job pointer to FileCopyJob
+ * @param src source path
+ * @param dst destination path
+ * @return TRUE when entry can be copied
+ */
+static FBOOL FileCopyCheckAccess( FileCopyJob *job, const char *src, const char *dst )
+{
+	if( job->fcj_User == NULL )
+	{
+		return TRUE;
+	}
+	SystemBase *sb = (SystemBase *)job->fcj_SB;
+
+	if( FSManagerCheckAccess( sb->sl_FSM, src, job->fcj_SrcDev->f_ID, job->fcj_User, "-R----" ) == FALSE )
+	{
+		FERROR("[FileCopyCheckAccess] No read access to %s\n", src );
+		return FALSE;
+	}
+	if( FSManagerCheckAccess( sb->sl_FSM, dst, job->fcj_DstDev->f_ID, job->fcj_User, "--W---" ) == FALSE )
+	{
+		FERROR("[FileCopyCheckAccess] No write access to %s\n", dst );
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Check if destination directory is same as source directory or is placed inside it.
+ * Such copy would scan its own output without end.
+ *
+ * @param job pointer to FileCopyJob
+ * @param src source directory path
+ * @param dst destination directory path
+ * @return TRUE when destination is inside source
+ */
+static FBOOL FileCopyDestinationInside( FileCopyJob *job, const char *src, const char *dst )
+{
+	if( job->fcj_SrcDev != job->fcj_DstDev && job->fcj_SrcDev->f_ID != job->fcj_DstDev->f_ID )
+	{
+		return FALSE;
+	}
+
+	// compare without leading and trailing slashes, "a//b" is same as "a/b"
+	while( *src == '/' ) src++;
+	while( *dst == '/' ) dst++;
+
+	// device root contains everything
+	if( *src == 0 )
+	{
+		return TRUE;
+	}
+
+	while( *src != 0 )
+	{
+		if( *src == '/' )
+		{
+			if( *dst != '/' )
+			{
+				// "a/" is same as "a"
+				while( *src == '/' ) src++;
+				return ( *src == 0 && *dst == 0 );
+			}
+			while( *src == '/' ) src++;
+			while( *dst == '/' ) dst++;
+			continue;
+		}
+		if( *src != *dst )
+		{
+			return FALSE;
+		}
+		src++;
+		dst++;
+	}
+	// source fully matched, destination is same directory or continues with subdirectory
+	return ( *dst == 0 || *dst == '/' || *(dst-1) == '/' );
+}
+
+/**
+ * Create destination directory and go through source directory. Subdirectories are scanned
+ * recursively, files are put into job queue.
+ *
+ * @param job pointer to FileCopyJob
+ * @param src source directory path
+ * @param dst destination directory path
+ */
+static void FileCopyScan( FileCopyJob *job, const char *src, const char *dst )
+{
+	FHandler *srcfs = (FHandler *)job->fcj_SrcDev->f_FSys;
+	FHandler *dstfs = (FHandler *)job->fcj_DstDev->f_FSys;
+
+	if( FileCopyStopped( job ) == TRUE )
+	{
+		return;
+	}
+
+	dstfs->MakeDir( job->fcj_DstDev, dst );
+
+	BufString *bs = srcfs->Dir( job->fcj_SrcDev, src );
+	if( bs == NULL || strncmp( "ok<!--separate-->", bs->bs_Buffer, 17 ) != 0 )
+	{
+		FERROR("[FileCopyScan] Cannot read directory %s\n", src );
+		pthread_mutex_lock( &(job->fcj_Mutex) );
+		job->fcj_Errors++;
+		pthread_mutex_unlock( &(job->fcj_Mutex) );
+		if( bs != NULL )
+		{
+			BufStringDelete( bs );
+		}
+		return;
+	}
+
+	char *buffer = &bs->bs_Buffer[ 17 ];
+	unsigned int entr = 0;
+	jsmntok_t *tokens = JSONTokenise( buffer, &entr );
+
+	if( tokens != NULL )
+	{
+		unsigned int i, j;
+
+		// every object is one directory entry: Filename, Type (File/Directory), ...
+		for( i=0 ; i < entr ; i++ )
+		{
+			if( tokens[ i ].type != JSMN_OBJECT )
+			{
+				continue;
+			}
+
+			int objEnd = tokens[ i ].end;
+			char *name = NULL;
+			int namelen = 0;
+			FBOOL isdir = FALSE;
+
+			for( j=i+1 ; j+1 < entr && tokens[ j ].start < objEnd ; j++ )
+			{
+				jsmntok_t *val = &tokens[ j+1 ];
+
+				if( jsoneq( buffer, &tokens[ j ], "Filename" ) == 0 )
+				{
+					name = buffer + val->start;
+					namelen = val->end - val->start;
+				}
+				else if( jsoneq( buffer, &tokens[ j ], "Type" ) == 0 )
+				{
+					isdir = ( val->end - val->start == 9 && strncmp( "Directory", buffer + val->start, 9 ) == 0 );
+				}
+
+				// skip value with everything inside it
+				j++;
+				while( j+1 < entr && tokens[ j+1 ].start < val->end )
+				{
+					j++;
+				}
+			}
+			i = j - 1;
+
+			if( name == NULL || namelen <= 0 )
+			{
+				continue;
+			}
+
+			char *newsrc = FileCopyMakePath( src, name, namelen );
+			char *newdst = FileCopyMakePath( dst, name, namelen );
+
+			if( newsrc != NULL && newdst != NULL && FileCopyCheckAccess( job, newsrc, newdst ) == FALSE )
+			{
+				pthread_mutex_lock( &(job->fcj_Mutex) );
+				job->fcj_Errors++;
+				pthread_mutex_unlock( &(job->fcj_Mutex) );
+			}
+			else if( newsrc != NULL && newdst != NULL )
+			{
+				if( isdir == TRUE )
+				{
+					FileCopyScan( job, newsrc, newdst );
+				}
+				else
+				{
+					FileCopyTask *task = FCalloc( 1, sizeof( FileCopyTask ) );
+					if( task != NULL )
+					{
+						task->fct_Src = newsrc;
+						task->fct_Dst = newdst;
+						newsrc = newdst = NULL;
+
+						pthread_mutex_lock( &(job->fcj_Mutex) );
+						if( job->fcj_TasksLast != NULL )
+						{
+							job->fcj_TasksLast->fct_Next = task;
+						}
+						else
+						{
+							job->fcj_Tasks = task;
+						}
+						job->fcj_TasksLast = task;
+						job->fcj_Files++;
+						pthread_cond_signal( &(job->fcj_Cond) );
+						pthread_mutex_unlock( &(job->fcj_Mutex) );
+					}
+				}
+			}
+
+			if( newsrc != NULL )
+			{
+				FFree( newsrc );
+			}
+			if( newdst != NULL )
+			{
+				FFree( newdst );
+			}
+		}
+		FFree( tokens );
+	}
+
+	BufStringDelete( bs );
+}
+
+/**
+ * Copy directory with all subdirectories. Directories are scanned by current thread
+ * while files are copied by FILE_COPY_THREADS workers.
+ *
+ * @param job pointer to FileCopyJob
+ * @param src source directory path (without device name)
+ * @param dst destination directory path (without device name)
+ * @return 0 when all files were copied, -1 when destination is inside source, otherwise number of errors
+ */
+int FileCopyDirectory( FileCopyJob *job, const char *src, const char *dst )
+{
+	pthread_t threads[ FILE_COPY_THREADS ];
+	int started = 0;
+	int i;
+
+	if( FileCopyDestinationInside( job, src, dst ) == TRUE )
+	{
+		FERROR("[FileCopyDirectory] Destination %s is inside source %s\n", dst, src );
+		return -1;
+	}
+
+	for( i=0 ; i < FILE_COPY_THREADS ; i++ )
+	{
+		if( pthread_create( &(threads[ started ]), NULL, FileCopyWorker, job ) == 0 )
+		{
+			started++;
+		}
+	}
+
+	FileCopyScan( job, src, dst );
+
+	pthread_mutex_lock( &(job->fcj_Mutex) );
+	job->fcj_ScanDone = TRUE;
+	pthread_cond_broadcast( &(job->fcj_Cond) );
+	pthread_mutex_unlock( &(job->fcj_Mutex) );
+
+	// no threads, files are copied by caller
+	if( started == 0 )
+	{
+		FileCopyWorker( job );
+	}
+
+	for( i=0 ; i < started ; i++ )
+	{
+		pthread_join( threads[ i ], NULL );
+	}
+
+	DEBUG("[FileCopyDirectory] %s -> %s files %d errors %d bytes %ld\n", src, dst, job->fcj_FilesDone, job->fcj_Errors, job->fcj_Written );
+
+	return job->fcj_Errors;
+}
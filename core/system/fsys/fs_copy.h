@@ -0,0 +1,95 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ *  Copy files and directories between devices
+ *
+ *  When both devices are handled by same filesystem which provides FileCopy,
+ *  data is copied by filesystem itself. Otherwise it goes through pipeline
+ *  where one thread reads next block while current thread writes previous one.
+ */
+
+#ifndef __SYSTEM_FSYS_FS_COPY_H__
+#define __SYSTEM_FSYS_FS_COPY_H__
+
+#include <core/types.h>
+#include <network/http.h>
+#include <system/fsys/file.h>
+#include <system/user/user.h>
+#include <pthread.h>
+
+#ifndef FILE_COPY_BUFFER_SIZE
+#define FILE_COPY_BUFFER_SIZE 1048576		// size of each of two pipeline buffers
+#endif
+
+#ifndef FILE_COPY_THREADS
+#define FILE_COPY_THREADS 4					// number of files copied at same time during directory copy
+#endif
+
+//
+// file waiting for copy
+//
+
+typedef struct FileCopyTask
+{
+	struct FileCopyTask		*fct_Next;
+	char					*fct_Src;
+	char					*fct_Dst;
+}FileCopyTask;
+
+//
+// copy operation
+//
+
+typedef struct FileCopyJob
+{
+	void					*fcj_SB;
+	Http					*fcj_Request;		// progress messages are sent to it, can be NULL
+	File					*fcj_SrcDev;
+	File					*fcj_DstDev;
+	User					*fcj_User;			// access to every entry is checked for this user, can be NULL
+
+	FileCopyTask			*fcj_Tasks;			// files found during directory scan
+	FileCopyTask			*fcj_TasksLast;
+	FBOOL					fcj_ScanDone;		// no more tasks will be added
+	int						fcj_Files;			// number of files found
+	int						fcj_FilesDone;		// number of files copied
+	int						fcj_Errors;
+	FQUAD					fcj_Written;
+	pthread_mutex_t			fcj_Mutex;
+	pthread_cond_t			fcj_Cond;
+}FileCopyJob;
+
+//
+// prepare copy between two devices
+//
+
+void FileCopyJobInit( FileCopyJob *job, void *sb, Http *request, User *usr, File *srcdev, File *dstdev );
+
+//
+// release resources used by copy
+//
+
+void FileCopyJobRelease( FileCopyJob *job );
+
+//
+// copy file, paths without device name. Returns number of bytes written or -1
+//
+
+FQUAD FileCopyFile( FileCopyJob *job, const char *src, const char *dst, int *closeError );
+
+//
+// copy directory with all subdirectories, paths without device name. Returns 0 when all files were copied,
+// -1 when destination is inside source
+//
+
+int FileCopyDirectory( FileCopyJob *job, const char *src, const char *dst );
+
+#endif // __SYSTEM_FSYS_FS_COPY_H__
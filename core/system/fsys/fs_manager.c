@@ -20,9 +20,75 @@
 #include <network/mime.h>
 #include <util/md5.h>
 #include <system/systembase.h>
+#include <mutex/mutex_manager.h>
 
 #define DEFAULT_ACCESS "-RWED"
 
+/**
+ * Calculate hash of permission cache key
+ *
+ * @param uid user id
+ * @param devid device id
+ * @param path path on device
+ * @return hash value
+ */
+static inline unsigned int FSManagerPermHash( FULONG uid, FULONG devid, const char *path )
+{
+	unsigned int hash = 2166136261U ^ (unsigned int)( ( uid ^ ( uid >> 32 ) ) * 2654435761U ) ^ (unsigned int)( devid * 2246822519U );
+	while( *path != 0 )
+	{
+		hash ^= (unsigned char)*path++;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/**
+ * Remove all entries from permission cache (fm_Mutex must be locked)
+ *
+ * @param fm pointer to FSManager
+ */
+static void FSManagerPermCacheFlush( FSManager *fm )
+{
+	int i;
+	for( i=0 ; i < FS_PERM_CACHE_BUCKETS ; i++ )
+	{
+		FSPermCacheEntry *e = fm->fm_PermCache[ i ];
+		while( e != NULL )
+		{
+			FSPermCacheEntry *rem = e;
+			e = e->fpce_Next;
+			FFree( rem->fpce_Path );
+			FFree( rem );
+		}
+		fm->fm_PermCache[ i ] = NULL;
+	}
+	fm->fm_PermCacheCount = 0;
+}
+
+/**
+ * Remove all entries from file metadata cache (fm_MetaMutex must be locked)
+ *
+ * @param fm pointer to FSManager
+ */
+static void FSManagerMetaCacheFlush( FSManager *fm )
+{
+	int i;
+	for( i=0 ; i < FS_PERM_CACHE_BUCKETS ; i++ )
+	{
+		FSMetaCacheEntry *e = fm->fm_MetaCache[ i ];
+		while( e != NULL )
+		{
+			FSMetaCacheEntry *rem = e;
+			e = e->fmce_Next;
+			FFree( rem->fmce_Path );
+			FFree( rem );
+		}
+		fm->fm_MetaCache[ i ] = NULL;
+	}
+	fm->fm_MetaCacheCount = 0;
+}
+
 /**
  * FSManager create function.
  *
@@ -35,6 +101,9 @@ FSManager *FSManagerNew( void *sb )
 	if( ( fm = FCalloc( 1, sizeof( FSManager ) ) ) != NULL )
 	{
 		fm->fm_SB = sb;
+		fm->fm_PermCacheTTL = ((SystemBase *)sb)->sl_PermissionsCacheTTL;
+		pthread_mutex_init( &(fm->fm_Mutex), NULL );
+		pthread_mutex_init( &(fm->fm_MetaMutex), NULL );
 	}
 	
 	return fm;
@@ -49,10 +118,449 @@ void FSManagerDelete( FSManager *fm )
 {
 	if( fm != NULL )
 	{
+		Log( FLOG_INFO, "[FSManagerDelete] Permission cache hits %lu misses %lu invalidations %lu flushes %lu\n", fm->fm_Stats.fms_Hits, fm->fm_Stats.fms_Misses, fm->fm_Stats.fms_Invalidations, fm->fm_Stats.fms_Flushes );
+		
+		Log( FLOG_INFO, "[FSManagerDelete] Metadata cache hits %lu misses %lu\n", fm->fm_Stats.fms_MetaHits, fm->fm_Stats.fms_MetaMisses );
+		
+		FSManagerPermCacheFlush( fm );
+		FSManagerMetaCacheFlush( fm );
+		pthread_mutex_destroy( &(fm->fm_Mutex) );
+		pthread_mutex_destroy( &(fm->fm_MetaMutex) );
 		FFree( fm );
 	}
 }
 
+/**
+ * Get FPermLink rows which belong to user (directly, by group or as others) for path on device.
+ * Rows are taken from permission cache, DB is asked when entry is missing or older than fm_PermCacheTTL.
+ *
+ * @param fm pointer to FSManager
+ * @param sqlLib pointer to sql.library pointer, library is taken from pool when DB must be asked and released by caller
+ * @param path path without '/' on the end
+ * @param devid device id
+ * @param usr pointer to user for which rows are taken
+ * @param dst pointer to structure where rows summary will be stored
+ * @return TRUE when success, otherwise FALSE
+ */
+static FBOOL FSManagerPermGet( FSManager *fm, SQLLibrary **sqlLib, const char *path, FULONG devid, User *usr, FSPermCacheEntry *dst )
+{
+	SystemBase *sb = (SystemBase *)fm->fm_SB;
+	unsigned int hash = FSManagerPermHash( usr->u_ID, devid, path );
+	FULONG generation = 0;
+	time_t now = time( NULL );
+	
+	memset( dst, 0, sizeof( FSPermCacheEntry ) );
+	
+	if( fm->fm_PermCacheTTL > 0 && FRIEND_MUTEX_LOCK( &(fm->fm_Mutex) ) == 0 )
+	{
+		FSPermCacheEntry *e = fm->fm_PermCache[ hash & ( FS_PERM_CACHE_BUCKETS - 1 ) ];
+		while( e != NULL )
+		{
+			if( e->fpce_Hash == hash && e->fpce_UserID == usr->u_ID && e->fpce_DeviceID == devid && strcmp( e->fpce_Path, path ) == 0 )
+			{
+				break;
+			}
+			e = e->fpce_Next;
+		}
+		
+		// expired entry is replaced below
+		if( e != NULL && ( now - e->fpce_Time ) < fm->fm_PermCacheTTL )
+		{
+			*dst = *e;
+			dst->fpce_Next = NULL;
+			dst->fpce_Path = NULL;
+			fm->fm_Stats.fms_Hits++;
+			FRIEND_MUTEX_UNLOCK( &(fm->fm_Mutex) );
+			return TRUE;
+		}
+		
+		fm->fm_Stats.fms_Misses++;
+		generation = fm->fm_PermCacheGeneration;
+		FRIEND_MUTEX_UNLOCK( &(fm->fm_Mutex) );
+	}
+	
+	// rows are cached for fm_PermCacheTTL, replica could still return right which was just revoked
+	if( *sqlLib == NULL )
+	{
+		*sqlLib = sb->LibrarySQLGet( sb );
+		if( *sqlLib == NULL )
+		{
+			FERROR("[FSManagerPermGet] Cannot get sql.library slot!\n");
+			return FALSE;
+		}
+	}
+	
+	int querysize = 1024 + ( 2*strlen( path ) );
+	char *tmpQuery;
+	
+	if( ( tmpQuery = FCalloc( querysize, sizeof(char) ) ) == NULL )
+	{
+		FERROR("Cannot allocate memory for query!\n");
+		return FALSE;
+	}
+	
+	(*sqlLib)->SNPrintF( *sqlLib, tmpQuery, querysize, "SELECT Access, ObjectID, Type, PermissionID from `FPermLink` where \
+PermissionID in( \
+SELECT ID FROM `FFilePermission` WHERE \
+Path = '%s' \
+AND DeviceID = %lu \
+) \
+AND ( \
+( ObjectID in( select UserGroupID from `FUserToGroup` where UserID = %lu ) and Type = 1 ) \
+OR \
+( ObjectID = %lu and Type = 0 ) \
+OR \
+( Type = 2 ) \
+)", path, devid, usr->u_ID, usr->u_ID );
+	
+	DEBUG("[FSManagerPermGet] Checking access via SQL '%s'\n", tmpQuery );
+	
+	void *res = (*sqlLib)->Query( *sqlLib, tmpQuery );
+	FFree( tmpQuery );
+	
+	if( res == NULL )
+	{
+		return FALSE;
+	}
+	
+	//  ROW````
+	// 0 - access string
+	// 1  - objectid (group or userid)
+	// 2 - type of id  0 - user, 1- group,  2  - others
+	// 3 - permissionid
+	
+	char **row = NULL;
+	while( ( row = (*sqlLib)->FetchRow( *sqlLib, res ) ) ) 
+	{
+		int type = atoi( row[ 2 ] );
+		int i;
+		
+		dst->fpce_Rows++;
+		
+		if( type >= 0 && type <= 2 )
+		{
+			strncpy( dst->fpce_Access[ type ], row[ 0 ], 5 );
+			dst->fpce_Access[ type ][ 5 ] = 0;
+		}
+		
+		// -RWED
+		for( i=1 ; i < 5 && row[ 0 ][ i-1 ] != 0 ; i++ )
+		{
+			if( row[ 0 ][ i ] == DEFAULT_ACCESS[ i ] )
+			{
+				dst->fpce_Rights |= ( 1 << i );
+			}
+		}
+	}
+	(*sqlLib)->FreeResult( *sqlLib, res );
+	
+	// store rows in cache, unless permissions were changed while DB was asked
+	
+	if( fm->fm_PermCacheTTL > 0 && FRIEND_MUTEX_LOCK( &(fm->fm_Mutex) ) == 0 )
+	{
+		if( generation == fm->fm_PermCacheGeneration )
+		{
+			unsigned int pos = hash & ( FS_PERM_CACHE_BUCKETS - 1 );
+			FSPermCacheEntry **link = &(fm->fm_PermCache[ pos ]);
+			
+			// remove expired entry or entry added by other thread in meantime
+			while( *link != NULL )
+			{
+				FSPermCacheEntry *e = *link;
+				if( e->fpce_Hash == hash && e->fpce_UserID == usr->u_ID && e->fpce_DeviceID == devid && strcmp( e->fpce_Path, path ) == 0 )
+				{
+					*link = e->fpce_Next;
+					FFree( e->fpce_Path );
+					FFree( e );
+					fm->fm_PermCacheCount--;
+					break;
+				}
+				link = &(e->fpce_Next);
+			}
+			
+			if( fm->fm_PermCacheCount >= FS_PERM_CACHE_MAX_ENTRIES )
+			{
+				FSManagerPermCacheFlush( fm );
+				fm->fm_Stats.fms_Flushes++;
+			}
+			
+			FSPermCacheEntry *ne = FMalloc( sizeof( FSPermCacheEntry ) );
+			if( ne != NULL )
+			{
+				*ne = *dst;
+				ne->fpce_Hash = hash;
+				ne->fpce_UserID = usr->u_ID;
+				ne->fpce_DeviceID = devid;
+				ne->fpce_Time = now;
+				if( ( ne->fpce_Path = StringDuplicate( (char *)path ) ) != NULL )
+				{
+					ne->fpce_Next = fm->fm_PermCache[ pos ];
+					fm->fm_PermCache[ pos ] = ne;
+					fm->fm_PermCacheCount++;
+				}
+				else
+				{
+					FFree( ne );
+				}
+			}
+		}
+		FRIEND_MUTEX_UNLOCK( &(fm->fm_Mutex) );
+	}
+	
+	return TRUE;
+}
+
+/**
+ * Remove cached permissions of path and everything below it
+ *
+ * @param fm pointer to FSManager
+ * @param devid device id, 0 - all devices
+ * @param path path on device, NULL - whole device
+ */
+void FSManagerPermCacheInvalidate( FSManager *fm, FULONG devid, const char *path )
+{
+	if( fm == NULL )
+	{
+		return;
+	}
+	
+	int plen = 0;
+	if( path != NULL )
+	{
+		plen = strlen( path );
+		if( plen > 0 && path[ plen-1 ] == '/' )
+		{
+			plen--;
+		}
+	}
+	
+	if( FRIEND_MUTEX_LOCK( &(fm->fm_Mutex) ) == 0 )
+	{
+		int i;
+		
+		fm->fm_PermCacheGeneration++;
+		
+		for( i=0 ; i < FS_PERM_CACHE_BUCKETS ; i++ )
+		{
+			FSPermCacheEntry **link = &(fm->fm_PermCache[ i ]);
+			while( *link != NULL )
+			{
+				FSPermCacheEntry *e = *link;
+				if( ( devid == 0 || e->fpce_DeviceID == devid ) && ( path == NULL || strncmp( e->fpce_Path, path, plen ) == 0 ) )
+				{
+					*link = e->fpce_Next;
+					FFree( e->fpce_Path );
+					FFree( e );
+					fm->fm_PermCacheCount--;
+					fm->fm_Stats.fms_Invalidations++;
+				}
+				else
+				{
+					link = &(e->fpce_Next);
+				}
+			}
+		}
+		FRIEND_MUTEX_UNLOCK( &(fm->fm_Mutex) );
+	}
+}
+
+/**
+ * Remove cached permissions of user. Must be called when user groups are changed.
+ *
+ * @param fm pointer to FSManager
+ * @param uid user id, 0 - all users
+ */
+void FSManagerPermCacheInvalidateUser( FSManager *fm, FULONG uid )
+{
+	if( fm == NULL )
+	{
+		return;
+	}
+	
+	if( FRIEND_MUTEX_LOCK( &(fm->fm_Mutex) ) == 0 )
+	{
+		int i;
+		
+		fm->fm_PermCacheGeneration++;
+		
+		for( i=0 ; i < FS_PERM_CACHE_BUCKETS ; i++ )
+		{
+			FSPermCacheEntry **link = &(fm->fm_PermCache[ i ]);
+			while( *link != NULL )
+			{
+				FSPermCacheEntry *e = *link;
+				if( uid == 0 || e->fpce_UserID == uid )
+				{
+					*link = e->fpce_Next;
+					FFree( e->fpce_Path );
+					FFree( e );
+					fm->fm_PermCacheCount--;
+					fm->fm_Stats.fms_Invalidations++;
+				}
+				else
+				{
+					link = &(e->fpce_Next);
+				}
+			}
+		}
+		FRIEND_MUTEX_UNLOCK( &(fm->fm_Mutex) );
+	}
+}
+
+/**
+ * Get permission cache statistics
+ *
+ * @param fm pointer to FSManager
+ * @param st pointer to structure where statistics will be stored
+ */
+void FSManagerGetStats( FSManager *fm, FSManagerStats *st )
+{
+	memset( st, 0, sizeof( FSManagerStats ) );
+	if( fm != NULL && FRIEND_MUTEX_LOCK( &(fm->fm_Mutex) ) == 0 )
+	{
+		*st = fm->fm_Stats;
+		st->fms_Entries = fm->fm_PermCacheCount;
+		FRIEND_MUTEX_UNLOCK( &(fm->fm_Mutex) );
+	}
+	if( fm != NULL && FRIEND_MUTEX_LOCK( &(fm->fm_MetaMutex) ) == 0 )
+	{
+		st->fms_MetaEntries = fm->fm_MetaCacheCount;
+		st->fms_MetaHits = fm->fm_Stats.fms_MetaHits;
+		st->fms_MetaMisses = fm->fm_Stats.fms_MetaMisses;
+		FRIEND_MUTEX_UNLOCK( &(fm->fm_MetaMutex) );
+	}
+}
+
+/**
+ * Get cached metadata of file. Entry is removed when file was changed after it was stored.
+ *
+ * @param fm pointer to FSManager
+ * @param devid device id
+ * @param path path on device
+ * @param changeTime current file change timestamp returned by filesystem
+ * @param width pointer to place where image width will be stored (0 - file is not image)
+ * @param height pointer to place where image height will be stored
+ * @return TRUE when valid entry was found, otherwise FALSE
+ */
+FBOOL FSManagerMetaCacheGet( FSManager *fm, FULONG devid, const char *path, FLONG changeTime, int *width, int *height )
+{
+	FBOOL found = FALSE;
+	
+	if( fm == NULL || path == NULL || changeTime <= 0 )
+	{
+		return FALSE;
+	}
+	
+	unsigned int hash = FSManagerPermHash( 0, devid, path );
+	
+	if( FRIEND_MUTEX_LOCK( &(fm->fm_MetaMutex) ) == 0 )
+	{
+		FSMetaCacheEntry **link = &(fm->fm_MetaCache[ hash & ( FS_PERM_CACHE_BUCKETS - 1 ) ]);
+		while( *link != NULL )
+		{
+			FSMetaCacheEntry *e = *link;
+			if( e->fmce_Hash == hash && e->fmce_DeviceID == devid && strcmp( e->fmce_Path, path ) == 0 )
+			{
+				if( e->fmce_ChangeTime == changeTime )
+				{
+					*width = e->fmce_Width;
+					*height = e->fmce_Height;
+					found = TRUE;
+				}
+				else
+				{
+					*link = e->fmce_Next;
+					FFree( e->fmce_Path );
+					FFree( e );
+					fm->fm_MetaCacheCount--;
+				}
+				break;
+			}
+			link = &(e->fmce_Next);
+		}
+		
+		if( found == TRUE )
+		{
+			fm->fm_Stats.fms_MetaHits++;
+		}
+		else
+		{
+			fm->fm_Stats.fms_MetaMisses++;
+		}
+		FRIEND_MUTEX_UNLOCK( &(fm->fm_MetaMutex) );
+	}
+	return found;
+}
+
+/**
+ * Store metadata of file in cache
+ *
+ * @param fm pointer to FSManager
+ * @param devid device id
+ * @param path path on device
+ * @param changeTime file change timestamp returned by filesystem, entry is not stored when it is not provided
+ * @param width image width, 0 when file is not image
+ * @param height image height
+ */
+void FSManagerMetaCacheSet( FSManager *fm, FULONG devid, const char *path, FLONG changeTime, int width, int height )
+{
+	if( fm == NULL || path == NULL || changeTime <= 0 )
+	{
+		return;
+	}
+	
+	unsigned int hash = FSManagerPermHash( 0, devid, path );
+	
+	if( FRIEND_MUTEX_LOCK( &(fm->fm_MetaMutex) ) == 0 )
+	{
+		unsigned int pos = hash & ( FS_PERM_CACHE_BUCKETS - 1 );
+		FSMetaCacheEntry *e = fm->fm_MetaCache[ pos ];
+		
+		// entry could be added by other thread in meantime
+		while( e != NULL )
+		{
+			if( e->fmce_Hash == hash && e->fmce_DeviceID == devid && strcmp( e->fmce_Path, path ) == 0 )
+			{
+				break;
+			}
+			e = e->fmce_Next;
+		}
+		
+		if( e == NULL )
+		{
+			if( fm->fm_MetaCacheCount >= FS_META_CACHE_MAX_ENTRIES )
+			{
+				FSManagerMetaCacheFlush( fm );
+			}
+			
+			if( ( e = FCalloc( 1, sizeof( FSMetaCacheEntry ) ) ) != NULL )
+			{
+				if( ( e->fmce_Path = StringDuplicate( (char *)path ) ) != NULL )
+				{
+					e->fmce_Hash = hash;
+					e->fmce_DeviceID = devid;
+					e->fmce_Next = fm->fm_MetaCache[ pos ];
+					fm->fm_MetaCache[ pos ] = e;
+					fm->fm_MetaCacheCount++;
+				}
+				else
+				{
+					FFree( e );
+					e = NULL;
+				}
+			}
+		}
+		
+		if( e != NULL )
+		{
+			e->fmce_ChangeTime = changeTime;
+			e->fmce_Width = width;
+			e->fmce_Height = height;
+		}
+		FRIEND_MUTEX_UNLOCK( &(fm->fm_MetaMutex) );
+	}
+}
+
 /**
  * Chec File/Directory access rights
  *
@@ -66,10 +574,9 @@ void FSManagerDelete( FSManager *fm )
 FBOOL FSManagerCheckAccess( FSManager *fm, const char *path, FULONG devid, User *usr, char *perm )
 {
 	FBOOL result = FALSE;
-	char *localPath = NULL;
 	
 	DEBUG("[FSManagerCheckAccess] Check access for %s\n", path );
-	if( path == NULL )
+	if( fm == NULL || path == NULL || perm == NULL || usr == NULL )
 	{
 		return FALSE;
 	}
@@ -92,157 +599,72 @@ FBOOL FSManagerCheckAccess( FSManager *fm, const char *path, FULONG devid, User
 		}
 	}
 	
+	if( newPath == NULL )
+	{
+		return FALSE;
+	}
+	
 	SystemBase *sb = (SystemBase  *) fm->fm_SB;
-	SQLLibrary *sqlLib = sb->LibrarySQLGet( sb );
-	if( sqlLib != NULL )
+	SQLLibrary *sqlLib = NULL;
+	FSPermCacheEntry entry;
+	
+	if( FSManagerPermGet( fm, &sqlLib, newPath, devid, usr, &entry ) == TRUE )
 	{
-		if( fm != NULL && perm != NULL && newPath != NULL )
-		{
-			int querysize = 0;
-			querysize = 1024  + (2*strlen( newPath ));
-			int pathLen = strlen(newPath);
-			char *tmpQuery;
-		
-			DEBUG("[FSManagerCheckAccess] User ptr %p alloc size %d\n", usr, querysize );
+		FBOOL found = TRUE;
+		int rows = entry.fpce_Rows;
+		int rights = entry.fpce_Rights;
 		
-			if( ( tmpQuery = FCalloc( querysize, sizeof(char) ) ) != NULL )
+		if( perm[ 2 ] == 'W' )	// if we are checking write permission, we must check also parent folder permissions
+		{
+			char *parentPath = StringDuplicate( newPath );
+			int i;
+			// getting parent directory path
+			for( i=strlen( newPath ) ; i>=0 ; i-- )
 			{
-				if( perm[ 2 ] == 'W' )	// if we are checking write permission, we must check also parent folder permissions
+				if( parentPath[ i ] == '/' )
 				{
-					char *parentPath = StringDuplicate( newPath );
-					int i;
-					// getting parent directory path
-					for( i=pathLen ; i>=0 ; i-- )
-					{
-						if( parentPath[ i ] == '/' )
-						{
-							parentPath[ i ] = 0;
-							break;
-						}
-					}
-				
-					sqlLib->SNPrintF( sqlLib, tmpQuery, querysize, "SELECT Access, ObjectID, Type, PermissionID from `FPermLink` where \
-PermissionID in( \
-SELECT ID FROM `FFilePermission` WHERE \
-( Path = '%s' OR Path = '%s' ) \
-AND DeviceID = %lu \
-) \
-AND ( \
-( ObjectID in( select UserGroupID from `FUserToGroup` where UserID = %lu ) and Type = 1 ) \
-OR \
-( ObjectID = %lu and Type = 0 ) \
-OR \
-( Type = 2 ) \
-) \
-", newPath, parentPath, devid, usr->u_ID, usr->u_ID );
-				
-					FFree( parentPath );
+					parentPath[ i ] = 0;
+					break;
+				}
+			}
+			
+			if( strcmp( parentPath, newPath ) != 0 )
+			{
+				FSPermCacheEntry parentEntry;
+				if( FSManagerPermGet( fm, &sqlLib, parentPath, devid, usr, &parentEntry ) == TRUE )
+				{
+					rows += parentEntry.fpce_Rows;
+					rights |= parentEntry.fpce_Rights;
 				}
 				else
 				{
-					sqlLib->SNPrintF( sqlLib, tmpQuery, querysize, "SELECT Access, ObjectID, Type, PermissionID from `FPermLink` where \
-PermissionID in( \
-SELECT ID FROM `FFilePermission` WHERE \
-Path = '%s' \
-AND DeviceID = %lu \
-) \
-AND ( \
-( ObjectID in( select UserGroupID from `FUserToGroup` where UserID = %lu ) and Type = 1 ) \
-OR \
-( ObjectID = %lu and Type = 0 ) \
-OR \
-( Type = 2 ) \
-) \
-", newPath, devid, usr->u_ID, usr->u_ID );
+					found = FALSE;
 				}
-			
-				DEBUG("[FSManagerCheckAccess] Checking access via SQL '%s'\n", tmpQuery );
+			}
+			FFree( parentPath );
+		}
 		
-				void *res = sqlLib->Query( sqlLib, tmpQuery );
-				FBOOL access = FALSE;
+		if( found == TRUE )
+		{
+			DEBUG("[FSManagerCheckAccess] Checking permissions %c  -   permission param %s rows %d\n", (char)perm[ 0 ], perm, rows );
 			
-				char defaultAccessRights[] = "-RWED";
-
-				if( res != NULL )
-				{
-				// default access
-				// -RWED-     - ARWEDH
-				
-				//  ROW````
-				// 0 - access string
-				// 1  - objectid (group or userid)
-				// 2 - type of id  0 - user, 1- group,  2  - others
-				// 3 - permissionid
-				// 4 - ID - unused
-					int nrrows = sqlLib->NumberOfRows( sqlLib, res );
-
-					if( nrrows > 0 )
-					{
-						char **row = NULL;
-					
-						DEBUG("[FSManagerCheckAccess] Checking permissions %c  -   permission param %s\n", (char)perm[ 0 ], perm );
-					
-						while( ( row = sqlLib->FetchRow( sqlLib, res ) ) ) 
-						{
-							DEBUG("[FSManagerCheckAccess] Found permission entry %s  permissions to check PERM %s OBJID %s TYPE %s\n", row[ 0 ], perm, row[1], row[2] );
-						
-							// others rights
-							//if( row[ 2 ][ 0 ] == '2' )
-							//{
-							//	strcpy( defaultAccessRights, row[ 0 ] );
-							//}
-							//else
-							{
-								// read
-								if( perm[ 1 ] == 'R' && ((char)row[ 0 ][ 1 ]) == perm[ 1 ] )
-								{
-									access = TRUE;
-									break;
-								}
-								// write
-								if( perm[ 2 ] == 'W' && ((char)row[ 0 ][ 2 ]) == perm[ 2 ] )
-								{
-									access = TRUE;
-									break;
-								}
-						
-								if( perm[ 3 ] == 'E' && ((char)row[ 0 ][ 3 ]) == perm[ 3 ] )
-								{
-									access = TRUE;
-									break;
-								}
-						
-								if( perm[ 4 ] == 'D' && ((char)row[ 0 ][ 4 ]) == perm[ 4 ] )
-								{
-									access = TRUE;
-									break;
-								}
-							}
-						}
-					}
-					// number of rows > 0
-					// checking default access
-					else
-					{
-						access = TRUE;
-					}
-				
-					if( access == TRUE )
-					{
-						result = TRUE;
-					}
-					sqlLib->FreeResult( sqlLib, res );
-				}
-				FFree( tmpQuery );
+			// no permissions set, default access
+			if( rows == 0 )
+			{
+				result = TRUE;
 			}
-			else
+			else if( ( perm[ 1 ] == 'R' && ( rights & FS_PERM_READ ) ) ||
+				( perm[ 2 ] == 'W' && ( rights & FS_PERM_WRITE ) ) ||
+				( perm[ 3 ] == 'E' && ( rights & FS_PERM_EXECUTE ) ) ||
+				( perm[ 4 ] == 'D' && ( rights & FS_PERM_DELETE ) ) )
 			{
-				FERROR("Cannot allocate memory for query!\n");
-				FFree( newPath );
-				sb->LibrarySQLDrop( sb, sqlLib );
-				return result;
+				result = TRUE;
 			}
 		}
+	}
+	
+	if( sqlLib != NULL )
+	{
 		sb->LibrarySQLDrop( sb, sqlLib );
 	}
 	FFree( newPath );
@@ -291,7 +713,7 @@ BufString *FSManagerGetAccess( FSManager *fm, const char *path, FULONG devid, Us
 		if( ( tmpQuery = FCalloc( querysize, sizeof(char) ) ) != NULL )
 		{
 			SystemBase *sb = (SystemBase  *) fm->fm_SB;
-			SQLLibrary *sqlLib = sb->LibrarySQLGet( sb );
+			SQLLibrary *sqlLib = sb->LibrarySQLGetRead( sb );
 			
 			if( sqlLib == NULL )
 			{
@@ -712,6 +1134,8 @@ OR \
 		}
 
 		sb->LibrarySQLDrop( sb, sqllib );
+		
+		FSManagerPermCacheInvalidate( fm, devid, path );
 	}
 	return 0;
 }
@@ -872,6 +1296,8 @@ int FSManagerProtect( FSManager *fm, const char *path, FULONG devid, char *accgr
 			}
 		}
 		sb->LibrarySQLDrop( sb, sqllib );
+		
+		FSManagerPermCacheInvalidate( fm, devid, path );
 	}
 	return 0;
 }
@@ -896,12 +1322,7 @@ BufString *FSManagerAddPermissionsToDir( FSManager *fm, BufString *recv, FULONG
 	}
 	
 	SystemBase *sb = (SystemBase  *) fm->fm_SB;
-	SQLLibrary *sqlLib = sb->LibrarySQLGet( sb );
-	if( sqlLib == NULL )
-	{
-		FERROR("Cannot get sql.library slot!\n");
-		return NULL;
-	}
+	SQLLibrary *sqlLib = NULL;		// taken from pool only when permissions are not in cache
 	
 	char *permPtr = recv->bs_Buffer;
 	char *permPtrLast = permPtr;
@@ -913,9 +1334,9 @@ BufString *FSManagerAddPermissionsToDir( FSManager *fm, BufString *recv, FULONG
 	// while parsing JSON Im trying to find files by Path
 	// next Im trying to localize Permissions and Im filling this field with file permissions
 	
-	char parentAccess[ 3 ][ 5 ];
+	char parentAccess[ 3 ][ 6 ];
 	parentAccess[ 0 ][ 0 ] = parentAccess[ 1 ][ 0 ] = parentAccess[ 2 ][ 0 ] = 0;
-	char access[ 3 ][ 5 ];
+	char access[ 3 ][ 6 ];
 	access[ 0 ][ 0 ] = access[ 1 ][ 0 ] = access[ 2 ][ 0 ] = 0;
 	
 	while( ( pathPtr  = strstr( pathPtr, "\"Path\"" ) ) != NULL )
@@ -979,162 +1400,89 @@ BufString *FSManagerAddPermissionsToDir( FSManager *fm, BufString *recv, FULONG
 			
 			if( fm != NULL && newPath != NULL )
 			{
-				int querysize = 0;
-				querysize = 2048 + ( 2*strlen( newPath ) );
-				
-				char *tmpQuery = NULL;
-				
-				if( ( tmpQuery = FCalloc( querysize, sizeof(char) ) ) != NULL )
+				if( parentDirectoryAccess == FALSE )
 				{
-					if( parentDirectoryAccess == FALSE )
+					char *parentPath = StringDuplicate( newPath );
+					int i;
+					// getting parent directory path
+					if( plen > 0 )
 					{
-						char *parentPath = StringDuplicate( newPath );
-						int i;
-						// getting parent directory path
-						if( plen > 0 )
-						{
-							for( i=plen-1 ; i>=0 ; i-- )
-							{
-								if( parentPath[ i ] == '/' )
-								{
-									parentPath[ i ] = 0;
-									break;
-								}
-							}
-						}
-						
-						sqlLib->SNPrintF( sqlLib, tmpQuery, querysize, "SELECT Access, ObjectID, Type, PermissionID from `FPermLink` where \
-PermissionID in( \
-SELECT ID FROM `FFilePermission` WHERE \
-( Path = '%s' ) \
-AND DeviceID = %lu \
-) \
-AND ( \
-( ObjectID in( select UserGroupID from `FUserToGroup` where UserID = %lu ) and Type = 1 ) \
-OR \
-( ObjectID = %lu and Type = 0 ) \
-OR \
-( Type = 2 ) \
-)", parentPath, devid, usr->u_ID, usr->u_ID );
-						
-						void *res = sqlLib->Query( sqlLib, tmpQuery );
-						if( res != NULL )
+						for( i=plen-1 ; i>=0 ; i-- )
 						{
-							char **row = NULL;
-							
-							while( ( row = sqlLib->FetchRow( sqlLib, res ) ) ) 
+							if( parentPath[ i ] == '/' )
 							{
-								int type = atoi( row[ 2 ] );
-								switch( type )
-								{
-									case 0:
-									case 2:
-										strcpy( parentAccess[ type ], row[ 0 ] );
-										break;
-									case 1:
-										if( parentAccess[ 1 ][ 0 ] != 0 )
-										{
-											strcpy( parentAccess[ type ], row[ 0 ] );
-										}
-										break;
-								}
+								parentPath[ i ] = 0;
+								break;
 							}
-							sqlLib->FreeResult( sqlLib, res );
 						}
-				
-						FFree( parentPath );
-				
-						parentDirectoryAccess = TRUE;
-					}
-			
-			
-					access[ 0 ][ 0 ] = access[ 1 ][ 0 ] = access[ 2 ][ 0 ] = 0;
-					// fetch access rights to file
-
-					sqlLib->SNPrintF( sqlLib, tmpQuery, querysize, "SELECT Access, ObjectID, Type, PermissionID from `FPermLink` where \
-PermissionID in( \
-SELECT ID FROM `FFilePermission` WHERE \
-( Path = '%s' ) \
-AND DeviceID = %lu \
-) \
-AND ( \
-( ObjectID in( select UserGroupID from `FUserToGroup` where UserID = %lu ) and Type = 1 ) \
-OR \
-( ObjectID = %lu and Type = 0 ) \
-OR \
-( Type = 2 ) \
-)", newPath, devid, usr->u_ID, usr->u_ID );
-
-					void *res = sqlLib->Query( sqlLib, tmpQuery );
-					
-					if( res != NULL )
-					{
-						int pos = 0;
-						char **row = NULL;
-						
-						while( ( row = sqlLib->FetchRow( sqlLib, res ) ) ) 
-						{
-							int type = atoi( row[ 2 ] );
-							strcpy( access[ type ], row[ 0 ] );
-						}
-						
-						sqlLib->FreeResult( sqlLib, res );
-					}
-					
-					// copy access rights to string which will be returned
-					
-					if( access[ 0 ][ 0 ] != 0 )
-					{
-						BufStringAddSize( bsres, access[ 0 ], 5 );
-					}
-					else if( parentAccess[ 0 ][ 0 ] != 0 )
-					{
-						BufStringAddSize( bsres, parentAccess[ 0 ], 5 );
 					}
-					else
-					{
-						BufStringAddSize( bsres, DEFAULT_ACCESS, 5 );
-					}
-					
-					BufStringAddSize( bsres, ",", 1 );
 					
-					if( access[ 1 ][ 0 ] != 0 )
+					FSPermCacheEntry parentEntry;
+					if( parentPath != NULL && FSManagerPermGet( fm, &sqlLib, parentPath, devid, usr, &parentEntry ) == TRUE )
 					{
-						BufStringAddSize( bsres, access[ 1 ], 5 );
+						// group access is not taken from parent directory
+						strcpy( parentAccess[ 0 ], parentEntry.fpce_Access[ 0 ] );
+						strcpy( parentAccess[ 2 ], parentEntry.fpce_Access[ 2 ] );
 					}
-					else if( parentAccess[ 1 ][ 0 ] != 0 )
-					{
-						BufStringAddSize( bsres, parentAccess[ 1 ], 5 );
-					}
-					else
-					{
-						BufStringAddSize( bsres, DEFAULT_ACCESS, 5 );
-					}
-					
-					BufStringAddSize( bsres, ",", 1 );
 					
-					if( access[ 2 ][ 0 ] != 0 )
-					{
-						BufStringAddSize( bsres, access[ 2 ], 5 );
-					}
-					else if( parentAccess[ 2 ][ 0 ] != 0 )
-					{
-						BufStringAddSize( bsres, parentAccess[ 2 ], 5 );
-					}
-					else
-					{
-						BufStringAddSize( bsres, DEFAULT_ACCESS, 5 );
-					}
+					FFree( parentPath );
 					
-					FFree( tmpQuery );
+					parentDirectoryAccess = TRUE;
+				}
+				
+				// fetch access rights to file
+				
+				FSPermCacheEntry entry;
+				access[ 0 ][ 0 ] = access[ 1 ][ 0 ] = access[ 2 ][ 0 ] = 0;
+				
+				if( FSManagerPermGet( fm, &sqlLib, newPath, devid, usr, &entry ) == TRUE )
+				{
+					memcpy( access, entry.fpce_Access, sizeof( access ) );
+				}
+				
+				// copy access rights to string which will be returned
+				
+				if( access[ 0 ][ 0 ] != 0 )
+				{
+					BufStringAddSize( bsres, access[ 0 ], 5 );
+				}
+				else if( parentAccess[ 0 ][ 0 ] != 0 )
+				{
+					BufStringAddSize( bsres, parentAccess[ 0 ], 5 );
+				}
+				else
+				{
+					BufStringAddSize( bsres, DEFAULT_ACCESS, 5 );
+				}
+				
+				BufStringAddSize( bsres, ",", 1 );
+				
+				if( access[ 1 ][ 0 ] != 0 )
+				{
+					BufStringAddSize( bsres, access[ 1 ], 5 );
+				}
+				else if( parentAccess[ 1 ][ 0 ] != 0 )
+				{
+					BufStringAddSize( bsres, parentAccess[ 1 ], 5 );
 				}
 				else
 				{
-					FERROR("Cannot allocate memory for query!\n");
-					//BufStringDelete( bs );
-					FFree( newPath );
-					sb->LibrarySQLDrop( sb, sqlLib );
-					return NULL;
+					BufStringAddSize( bsres, DEFAULT_ACCESS, 5 );
+				}
+				
+				BufStringAddSize( bsres, ",", 1 );
+				
+				if( access[ 2 ][ 0 ] != 0 )
+				{
+					BufStringAddSize( bsres, access[ 2 ], 5 );
+				}
+				else if( parentAccess[ 2 ][ 0 ] != 0 )
+				{
+					BufStringAddSize( bsres, parentAccess[ 2 ], 5 );
+				}
+				else
+				{
+					BufStringAddSize( bsres, DEFAULT_ACCESS, 5 );
 				}
 			}
 			
@@ -1151,7 +1499,10 @@ OR \
 		}
 	}
 	
-	sb->LibrarySQLDrop( sb, sqlLib );
+	if( sqlLib != NULL )
+	{
+		sb->LibrarySQLDrop( sb, sqlLib );
+	}
 	
 	BufStringAddSize( bsres, permPtrLast, ( &recv->bs_Buffer[ recv->bs_Size ] )-permPtrLast );
 	
@@ -23,10 +23,93 @@
 #include "file_permissions.h"
 #include <system/user/user.h>
 #include <system/user/user_session.h>
+#include <time.h>
+
+#ifndef FS_PERM_CACHE_BUCKETS
+#define FS_PERM_CACHE_BUCKETS 1024		// number of buckets in permission cache, must be power of 2
+#endif
+
+#ifndef FS_PERM_CACHE_MAX_ENTRIES
+#define FS_PERM_CACHE_MAX_ENTRIES 65536	// cache is flushed when this number of entries is reached
+#endif
+
+#ifndef FS_META_CACHE_MAX_ENTRIES
+#define FS_META_CACHE_MAX_ENTRIES 65536	// file metadata cache is flushed when this number of entries is reached
+#endif
+
+//
+// rights found in FPermLink rows
+//
+
+enum {
+	FS_PERM_READ = 1<<1,
+	FS_PERM_WRITE = 1<<2,
+	FS_PERM_EXECUTE = 1<<3,
+	FS_PERM_DELETE = 1<<4
+};
+
+//
+// FPermLink rows which belong to user for one path on device
+//
+
+typedef struct FSPermCacheEntry
+{
+	struct FSPermCacheEntry	*fpce_Next;
+	unsigned int			fpce_Hash;
+	FULONG					fpce_UserID;
+	FULONG					fpce_DeviceID;
+	char					*fpce_Path;
+	time_t					fpce_Time;			// when entry was read from DB
+	int						fpce_Rows;			// number of rows, 0 - no permissions were set
+	int						fpce_Rights;		// FS_PERM_* given by any row
+	char					fpce_Access[ 3 ][ 6 ];	// last access string by type: user, group, others
+}FSPermCacheEntry;
+
+//
+// file metadata (image dimensions) valid as long as file change timestamp is same
+//
+
+typedef struct FSMetaCacheEntry
+{
+	struct FSMetaCacheEntry	*fmce_Next;
+	unsigned int			fmce_Hash;
+	FULONG					fmce_DeviceID;
+	char					*fmce_Path;
+	FLONG					fmce_ChangeTime;	// GetChangeTimestamp value when entry was created
+	int						fmce_Width;			// 0 - file is not image
+	int						fmce_Height;
+}FSMetaCacheEntry;
+
+//
+// permission cache statistics
+//
+
+typedef struct FSManagerStats
+{
+	FUQUAD					fms_Entries;
+	FUQUAD					fms_Hits;
+	FUQUAD					fms_Misses;
+	FUQUAD					fms_Invalidations;
+	FUQUAD					fms_Flushes;
+	FUQUAD					fms_MetaEntries;	// file metadata cache
+	FUQUAD					fms_MetaHits;
+	FUQUAD					fms_MetaMisses;
+}FSManagerStats;
 
 typedef struct FSManager
 {
 	void 					*fm_SB;
+	
+	FSPermCacheEntry		*fm_PermCache[ FS_PERM_CACHE_BUCKETS ];	// permission cache, key: user, device, path
+	int						fm_PermCacheCount;
+	int						fm_PermCacheTTL;		// seconds, 0 - cache disabled
+	FULONG					fm_PermCacheGeneration;	// changed by every invalidation
+	FSManagerStats			fm_Stats;
+	pthread_mutex_t			fm_Mutex;
+	
+	FSMetaCacheEntry		*fm_MetaCache[ FS_PERM_CACHE_BUCKETS ];	// file metadata cache, key: device, path
+	int						fm_MetaCacheCount;
+	pthread_mutex_t			fm_MetaMutex;
 }FSManager;
 
 //
@@ -72,4 +155,34 @@ int FSManagerProtect( FSManager *fm, const char *path, FULONG devid, char *accgr
 
 BufString *FSManagerAddPermissionsToDir( FSManager *fm, BufString *recv, FULONG devid, User *usr  );
 
+//
+// remove cached permissions of path and its subdirectories, path NULL - whole device, devid 0 - all devices
+//
+
+void FSManagerPermCacheInvalidate( FSManager *fm, FULONG devid, const char *path );
+
+//
+// remove cached permissions of user (group membership changed), uid 0 - all users
+//
+
+void FSManagerPermCacheInvalidateUser( FSManager *fm, FULONG uid );
+
+//
+// get cached metadata of file, returns TRUE when entry exists and file was not changed since it was stored
+//
+
+FBOOL FSManagerMetaCacheGet( FSManager *fm, FULONG devid, const char *path, FLONG changeTime, int *width, int *height );
+
+//
+// store metadata of file, changeTime must be value returned by filesystem GetChangeTimestamp
+//
+
+void FSManagerMetaCacheSet( FSManager *fm, FULONG devid, const char *path, FLONG changeTime, int width, int height );
+
+//
+// get permission and metadata cache statistics
+//
+
+void FSManagerGetStats( FSManager *fm, FSManagerStats *st );
+
 #endif // __SYSTEM_FSYS_FSMANAGER_H__
@@ -21,9 +21,14 @@
 #include <util/md5.h>
 #include <system/fsys/door_notification.h>
 #include <stdlib.h>
+#include <strings.h>
 #include <system/cache/cache_user_files.h>
 #include <system/cache/cache_manager.h>
 #include <system/fsys/fsys_activity.h>
+#include <system/fsys/fs_copy.h>
+#include <util/murmurhash3.h>
+#include <system/datatypes/images/image_probe.h>
+#include <system/cache/thumbnail_manager.h>
 
 #define CHECK_BAD_CHARS( PTH, INT, RETVAL ) \
 if( PTH[ INT ] == '/' || PTH[ INT ] == ':' || PTH[ INT ] == '\'' ) \
@@ -58,6 +63,200 @@ static inline char *CutNotificationPath( char *path )
 	return notifPath;
 }
 
+//
+// Internal function which reads beginning of file until image header is found
+// returns 0 when dimensions were found, otherwise -1
+//
+
+static int FileInfoProbeImage( FHandler *actFS, File *actDev, const char *path, Http *request, int *width, int *height )
+{
+	ImageProbeInfo info;
+	int ret = -1;
+	int size = IMAGE_PROBE_START_SIZE;
+	int len = 0;
+	FBYTE *data = FMalloc( size );
+	
+	if( data == NULL )
+	{
+		return -1;
+	}
+	
+	File *fp = (File *)actFS->FileOpen( actDev, path, "r" );
+	if( fp != NULL )
+	{
+		while( TRUE )
+		{
+			FBOOL eof = FALSE;
+			
+			// fill buffer, filesystem can return less data than requested
+			while( len < size )
+			{
+				int dataread = actFS->FileRead( fp, (char *)data + len, size - len );
+				if( dataread <= 0 )
+				{
+					eof = TRUE;
+					break;
+				}
+				len += dataread;
+			}
+			
+			int res = ImageProbe( data, len, &info );
+			if( res == IMAGE_PROBE_OK )
+			{
+				DEBUG("[FileInfoProbeImage] %s %dx%d found in %d bytes\n", info.ipi_Format, info.ipi_Width, info.ipi_Height, len );
+				*width = info.ipi_Width;
+				*height = info.ipi_Height;
+				ret = 0;
+				break;
+			}
+			
+			if( res != IMAGE_PROBE_MORE_DATA || eof == TRUE || size >= IMAGE_PROBE_MAX_SIZE )
+			{
+				break;
+			}
+			if( request->http_ShutdownPtr != NULL && *(request->http_ShutdownPtr) == TRUE )
+			{
+				break;
+			}
+			
+			FBYTE *ndata = FMalloc( size * 2 );
+			if( ndata == NULL )
+			{
+				break;
+			}
+			memcpy( ndata, data, len );
+			FFree( data );
+			data = ndata;
+			size *= 2;
+		}
+		actFS->FileClose( actDev, fp );
+	}
+	FFree( data );
+	
+	return ret;
+}
+
+//
+// Internal function which downloads whole file and decodes it with libgd
+// used for formats which are not recognized by ImageProbe
+// returns 0 when image was decoded, 1 when file is not image, -1 when file cannot be read
+//
+
+static int FileInfoDecodeImage( FHandler *actFS, File *actDev, const char *path, const char *extension, Http *request, int *width, int *height )
+{
+	int ret = -1;
+	char *tmpfilename = FCalloc( 1024, sizeof(char) );
+	if( tmpfilename == NULL )
+	{
+		return -1;
+	}
+	
+	snprintf( tmpfilename, 1024, "/tmp/Friendup/_file_info_%d%d.%s", rand()%9999, rand()%9999, extension );
+
+	int readbytes = 10240;
+	int dataread = 0;
+	char *dataBuffer = FCalloc( readbytes, sizeof( char ) );
+	FILE *dstFp;
+
+	// download file to server to check it
+	if( dataBuffer != NULL && ( dstFp = fopen( tmpfilename, "wb" ) ) != NULL )
+	{
+		FBOOL complete = FALSE;
+		File *fp = (File *)actFS->FileOpen( actDev, path, "r" );
+		if( fp != NULL )
+		{
+			complete = TRUE;
+			while( ( dataread = actFS->FileRead( fp, dataBuffer, readbytes ) ) != -1 )
+			{
+				if( request->http_ShutdownPtr != NULL && *(request->http_ShutdownPtr) == TRUE )
+				{
+					complete = FALSE;
+					break;
+				}
+		
+				if( dataread == 0 )
+				{
+					break;
+				}
+				fwrite( dataBuffer, dataread, 1, dstFp );
+			}
+			actFS->FileClose( actDev, fp );
+		}
+		fclose( dstFp );
+
+		// trying to figure out what kind of image it is
+		gdImagePtr img = NULL;
+		dstFp = fopen( tmpfilename, "rb" );
+		if( complete == TRUE && dstFp != NULL )
+		{
+			img = gdImageCreateFromPng( dstFp );
+			if( img == NULL )
+			{
+				fseek( dstFp, 0, SEEK_SET );
+				img = gdImageCreateFromJpeg( dstFp );
+				if( img == NULL )
+				{
+					fseek( dstFp, 0, SEEK_SET );
+					img = gdImageCreateFromBmp( dstFp );
+					if( img == NULL )
+					{
+						fseek( dstFp, 0, SEEK_SET );
+						img = gdImageCreateFromGif( dstFp );
+						if( img == NULL )
+						{
+#ifdef USE_WEBP_LOADER
+							fseek( dstFp, 0, SEEK_SET );
+							img = gdImageCreateFromWebp( dstFp );
+							if( img == NULL )
+							{
+#endif
+								fseek( dstFp, 0, SEEK_SET );
+								img = gdImageCreateFromTga( dstFp );
+								if( img == NULL )
+								{
+									fseek( dstFp, 0, SEEK_SET );
+									img = gdImageCreateFromTiff( dstFp );
+									if( img == NULL )
+									{
+										fseek( dstFp, 0, SEEK_SET );
+										img = gdImageCreateFromWBMP( dstFp );
+									}
+								}
+#ifdef USE_WEBP_LOADER
+							}
+#endif
+						}
+					}
+				}
+			}
+			ret = 1;
+		}
+		if( dstFp != NULL )
+		{
+			fclose( dstFp );
+		}
+
+		if( img != NULL )
+		{
+			DEBUG("[FileInfoDecodeImage] Image found\n");
+			*width = img->sx;
+			*height = img->sy;
+			gdImageDestroy( img );
+			ret = 0;
+		}
+		
+		// remove temporary file on the end
+		remove( tmpfilename );
+	}
+	if( dataBuffer != NULL )
+	{
+		FFree( dataBuffer );
+	}
+	FFree( tmpfilename );
+	
+	return ret;
+}
+
 /**
  * Filesystem web calls handler
  *
@@ -134,6 +333,7 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 		
 			HttpAddTextContent( response, "ok<!--separate-->{\"HELP\":\"commands: \"" 
 				"info - get information about file/directory\n"
+				",thumbnail - get thumbnail of image\n"
 				",dir - get all files in directory\n"
 				",rename - rename file or directory\n"
 				",delete - delete all files or directory (and all data in directory)\n"
@@ -403,122 +603,52 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 									const char *type = MimeFromExtension( extension );
 									if( strncmp( "image", type, 5 ) == 0 )
 									{
-										char *tmpfilename = FCalloc( 1024, sizeof(char) );
-										if( tmpfilename != NULL )
+										int width = 0;
+										int height = 0;
+										int res = 0;
+										FLONG changeTime = 0;
+										
+										// dimensions are cached as long as file was not changed
+										if( actFS->GetChangeTimestamp != NULL )
 										{
-											snprintf( tmpfilename, 1024, "/tmp/Friendup/_file_info_%d%d.%s", rand()%9999, rand()%9999, extension );
+											changeTime = actFS->GetChangeTimestamp( actDev, origDecodedPath );
+										}
 										
-											int readbytes = 10240;
-											int dataread = 0;
-											uint64_t totalBytes = 0;
-											char *dataBuffer = FCalloc( readbytes, sizeof( char ) );
-											FILE *dstFp;
-									
-											// download file to server to check it
-											if( ( dstFp = fopen( tmpfilename, "wb" ) ) != NULL )
+										if( FSManagerMetaCacheGet( l->sl_FSM, actDev->f_ID, path, changeTime, &width, &height ) == FALSE )
+										{
+											// only header is read, whole file is decoded when format is not recognized
+											if( FileInfoProbeImage( actFS, actDev, origDecodedPath, request, &width, &height ) != 0 )
 											{
-												File *fp = (File *)actFS->FileOpen( actDev, origDecodedPath, "r" );
-												if( fp != NULL )
-												{
-													while( ( dataread = actFS->FileRead( fp, dataBuffer, readbytes ) ) != -1 )
-													{
-														if( request->http_ShutdownPtr != NULL && *(request->http_ShutdownPtr) == TRUE )
-														{
-															break;
-														}
-												
-														if( dataread == 0 )
-														{
-															break;
-														}
-														fwrite( dataBuffer, dataread, 1, dstFp );
-										
-														totalBytes += readbytes;
-													}
-													actFS->FileClose( actDev, fp );
-													
-													// image was created, getting details
-												}
-												fclose( dstFp );
-
-												// trying to figure out what kind of image it is
-												gdImagePtr img = NULL;
-												dstFp = fopen( tmpfilename, "rb" );
-												if( dstFp != NULL )
-												{
-													img = gdImageCreateFromPng( dstFp );
-													if( img == NULL )
-													{
-														fseek( dstFp, 0, SEEK_SET );
-														img = gdImageCreateFromJpeg( dstFp );
-														if( img == NULL )
-														{
-															fseek( dstFp, 0, SEEK_SET );
-															img = gdImageCreateFromBmp( dstFp );
-															if( img == NULL )
-															{
-																fseek( dstFp, 0, SEEK_SET );
-																img = gdImageCreateFromGif( dstFp );
-																if( img == NULL )
-																{
-#ifdef USE_WEBP_LOADER
-																	fseek( dstFp, 0, SEEK_SET );
-																	img = gdImageCreateFromWebp( dstFp );
-																	if( img == NULL )
-																	{
-#endif
-																		fseek( dstFp, 0, SEEK_SET );
-																		img = gdImageCreateFromTga( dstFp );
-																		if( img == NULL )
-																		{
-																			fseek( dstFp, 0, SEEK_SET );
-																			img = gdImageCreateFromTiff( dstFp );
-																			if( img == NULL )
-																			{
-																				fseek( dstFp, 0, SEEK_SET );
-																				img = gdImageCreateFromWBMP( dstFp );
-																			}
-																		}
-#ifdef USE_WEBP_LOADER
-																	}
-#endif
-																}
-															}
-														}
-													}
-													fclose( dstFp );
-												}
-
-												// add details to result string
-												if( img != NULL )
-												{
-													char tmpBuffer[ 1024 ];
-													BufString *dstBs = BufStringNew();
-													
-													DEBUG("Image found\n");
-													
-													int textLen = snprintf( tmpBuffer, sizeof( tmpBuffer ), "\"Details\":[\"type\":\"%s\",\"width\":%d,\"height\":%d],", type, img->sx, img->sy );
-													char *textFound = strstr( resp->bs_Buffer, "\"Type\"" );
-													if( textFound != NULL )
-													{
-														int len = textFound-resp->bs_Buffer;
-														BufStringAddSize( dstBs, resp->bs_Buffer, len );
-														BufStringAddSize( dstBs, tmpBuffer, textLen );
-														BufStringAdd( dstBs, textFound );
-														
-														DEBUG("DSTString: %s\n", dstBs->bs_Buffer );
-														
-														BufStringDelete( resp );
-														resp = dstBs;
-													}
+												width = height = 0;
+												res = FileInfoDecodeImage( actFS, actDev, origDecodedPath, extension, request, &width, &height );
+											}
+											
+											if( res >= 0 )
+											{
+												FSManagerMetaCacheSet( l->sl_FSM, actDev->f_ID, path, changeTime, width, height );
+											}
+										}
 
-													gdImageDestroy( img );
-												}
+										// add details to result string
+										if( width > 0 && height > 0 )
+										{
+											char tmpBuffer[ 1024 ];
+											
+											int textLen = snprintf( tmpBuffer, sizeof( tmpBuffer ), "\"Details\":[\"type\":\"%s\",\"width\":%d,\"height\":%d],", type, width, height );
+											char *textFound = strstr( resp->bs_Buffer, "\"Type\"" );
+											if( textFound != NULL )
+											{
+												BufString *dstBs = BufStringNew();
+												int len = textFound-resp->bs_Buffer;
+												BufStringAddSize( dstBs, resp->bs_Buffer, len );
+												BufStringAddSize( dstBs, tmpBuffer, textLen );
+												BufStringAdd( dstBs, textFound );
 												
-												// remove temporary file on the end
-												remove( tmpfilename );
+												DEBUG("DSTString: %s\n", dstBs->bs_Buffer );
+												
+												BufStringDelete( resp );
+												resp = dstBs;
 											}
-											FFree( tmpfilename );
 										}
 									}
 								}
@@ -577,6 +707,114 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 					}
 				}
 				
+				/// @cond WEB_CALL_DOCUMENTATION
+				/**
+				*
+				* <HR><H2>system.library/file/thumbnail</H2>Get thumbnail of image
+				*
+				* @param sessionid - (required) session id of logged user
+				* @param path - (required) path to file with device name before ':' sign
+				* @param width - maximum thumbnail width (default 128)
+				* @param height - maximum thumbnail height (default 128)
+				* @return thumbnail in JPEG (for JPEG files) or PNG format when success, otherwise error code
+				*/
+				/// @endcond
+				else if( strcmp( urlpath[ 1 ], "thumbnail" ) == 0 )
+				{
+					int width = 128;
+					int height = 128;
+					
+					el = HttpGetPOSTParameter( request, "width" );
+					if( el == NULL ) el = HashmapGet( request->http_Query, "width" );
+					if( el != NULL )
+					{
+						width = atoi( (char *)el->hme_Data );
+					}
+					
+					el = HttpGetPOSTParameter( request, "height" );
+					if( el == NULL ) el = HashmapGet( request->http_Query, "height" );
+					if( el != NULL )
+					{
+						height = atoi( (char *)el->hme_Data );
+					}
+					
+					FBOOL have = FSManagerCheckAccess( l->sl_FSM, path, actDev->f_ID, loggedSession->us_User, "-R----" );
+					if( have == TRUE && l->sl_ThumbnailManager != NULL )
+					{
+						char *data = NULL;
+						int size = 0;
+						FLONG changeTime = 0;
+						
+						int res = ThumbnailManagerGet( l->sl_ThumbnailManager, actDev, origDecodedPath, width, height, &data, &size, &changeTime );
+						if( res == THUMBNAIL_OK )
+						{
+							char *ext = strrchr( path, '.' );
+							FBOOL jpeg = ( ext != NULL && ( strcasecmp( ext, ".jpg" ) == 0 || strcasecmp( ext, ".jpeg" ) == 0 ) );
+							char *etag = NULL;
+							
+							response = HttpNewSimpleA( HTTP_200_OK, request,  HTTP_HEADER_CONTENT_TYPE, (FULONG)StringDuplicate( jpeg == TRUE ? "image/jpeg" : "image/png" ),
+								HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+							
+							if( changeTime > 0 )
+							{
+								char suffix[ 32 ];
+								uint64_t pathHash[ 2 ];
+								MURMURHASH3( origDecodedPath, strlen( origDecodedPath ), pathHash );
+								pathHash[ 1 ] ^= actDev->f_ID;
+								snprintf( suffix, sizeof(suffix), "%dx%d", width, height );
+								
+								etag = HttpCreateETag( pathHash, changeTime, size, suffix );
+							}
+							
+							if( etag != NULL && HttpIsNotModified( request, etag, changeTime ) == TRUE )
+							{
+								HttpSetCode( response, HTTP_304_NOT_MODIFIED );
+								HttpAddCacheValidators( response, etag, changeTime );
+								FFree( data );
+							}
+							else
+							{
+								HttpSetContent( response, data, size );
+								HttpAddCacheValidators( response, etag, changeTime );
+							}
+							
+							if( etag != NULL )
+							{
+								FFree( etag );
+							}
+						}
+						else
+						{
+							char dictmsgbuf[ 256 ];
+							
+							response = HttpNewSimpleA( res == THUMBNAIL_ERROR ? HTTP_200_OK : HTTP_503_SERVICE_UNAVAILABLE, request,  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( DEFAULT_CONTENT_TYPE, 24 ),
+								HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+							
+							if( res == THUMBNAIL_ERROR )
+							{
+								snprintf( dictmsgbuf, sizeof(dictmsgbuf), "fail<!--separate-->{ \"response\": \"%s\", \"code\":\"%d\" }", l->sl_Dictionary->d_Msg[DICT_FILE_NOT_EXIST_OR_EMPTY] , DICT_FILE_NOT_EXIST_OR_EMPTY );
+							}
+							else
+							{
+								snprintf( dictmsgbuf, sizeof(dictmsgbuf), "fail<!--separate-->{ \"response\": \"thumbnail queue is full\", \"code\":\"%d\" }", HTTP_503_SERVICE_UNAVAILABLE );
+							}
+							HttpAddTextContent( response, dictmsgbuf );
+						}
+					}
+					else
+					{
+						char dictmsgbuf[ 256 ];
+						char dictmsgbuf1[ 196 ];
+						
+						response = HttpNewSimpleA( HTTP_200_OK, request,  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( DEFAULT_CONTENT_TYPE, 24 ),
+							HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+						
+						snprintf( dictmsgbuf1, sizeof(dictmsgbuf1), l->sl_Dictionary->d_Msg[DICT_NO_ACCESS_TO], path );
+						snprintf( dictmsgbuf, sizeof(dictmsgbuf), "fail<!--separate-->{ \"response\": \"%s\", \"code\":\"%d\" }", dictmsgbuf1 , DICT_NO_ACCESS_TO );
+						HttpAddTextContent( response, dictmsgbuf );
+					}
+				}
+				
 				/// @cond WEB_CALL_DOCUMENTATION
 				/**
 				*
@@ -1244,7 +1482,29 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 					FBOOL have = FSManagerCheckAccess( l->sl_FSM, origDecodedPath, actDev->f_ID, loggedSession->us_User, "-R----" );
 					if( have == TRUE )
 					{
-						if( mode != NULL && strcmp( mode, "rs" ) == 0 )		// read stream
+						// validators are used only when whole file is read and filesystem provides modification time
+						char *etag = NULL;
+						FLONG changeTime = 0;
+						
+						if( mode != NULL && mode[ 0 ] == 'r' && strcmp( mode, "rs" ) != 0 && offset == NULL && actFS->GetChangeTimestamp != NULL )
+						{
+							changeTime = actFS->GetChangeTimestamp( actDev, origDecodedPath );
+							if( changeTime > 0 )
+							{
+								uint64_t pathHash[ 2 ];
+								MURMURHASH3( origDecodedPath, strlen( origDecodedPath ), pathHash );
+								pathHash[ 1 ] ^= actDev->f_ID;
+								
+								etag = HttpCreateETag( pathHash, changeTime, 0, mode );
+							}
+						}
+						
+						if( etag != NULL && HttpIsNotModified( request, etag, changeTime ) == TRUE )
+						{
+							HttpSetCode( response, HTTP_304_NOT_MODIFIED );
+							HttpAddCacheValidators( response, etag, changeTime );
+						}
+						else if( mode != NULL && strcmp( mode, "rs" ) == 0 )		// read stream
 						{
 							actDev->f_SessionIDPTR = loggedSession->us_User->u_MainSessionID;
 							File *fp = (File *)actFS->FileOpen( actDev, origDecodedPath, mode );
@@ -1257,7 +1517,6 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 								response->http_RequestSource = request->http_RequestSource;
 								response->http_Stream = TRUE;
 								response->http_ResponseID = request->http_ResponseID;
-								HttpWrite( response, request->http_Socket );
 							
 								fp->f_Stream = request->http_Stream;
 								fp->f_Socket = request->http_Socket;
@@ -1265,7 +1524,28 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 							
 								#define FS_READ_BUFFER 262144
 								FQUAD readbytes = 0;// FS_READ_BUFFER;
-								char *dataBuffer = FCalloc( FS_READ_BUFFER + 1, sizeof( char ) ); 
+								char *dataBuffer = NULL;
+								
+								// plain http connection and file size is known, Range requests can be served (resumed downloads, media seeking)
+								if( request->http_RequestSource == HTTP_SOURCE_HTTP && request->http_Socket != NULL && fp->f_Size > 0 )
+								{
+									HttpRange ranges[ HTTP_MAX_RANGES ];
+									int rangeCount = HttpParseRange( request, fp->f_Size, NULL, 0, ranges, HTTP_MAX_RANGES );
+									
+									fp->f_FSys = actFS;
+									readbytes = HttpWriteRanges( response, request->http_Socket, fp->f_Size, ranges, rangeCount, FileSendRangeToSocket, fp );
+								}
+								// plain http connection and driver backed by real file, data is sent with zero-copy
+								else if( actFS->FileSendToSocket != NULL && request->http_RequestSource == HTTP_SOURCE_HTTP && request->http_Socket != NULL )
+								{
+									HttpWrite( response, request->http_Socket );
+									readbytes = actFS->FileSendToSocket( fp, request->http_Socket, 0, -1 );
+								}
+								else
+								{
+									HttpWrite( response, request->http_Socket );
+									dataBuffer = FCalloc( FS_READ_BUFFER + 1, sizeof( char ) ); 
+								}
 							
 								if( dataBuffer != NULL )
 								{
@@ -1478,6 +1758,7 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 							INFO("READ RETURN BYTES %d  - %s\n", totalBytes, mime );
 							*/
 									HttpSetContent( response, outputBuf, totalBytes );
+									HttpAddCacheValidators( response, etag, changeTime );
 								}
 								else
 								{
@@ -1524,6 +1805,11 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 							snprintf( dictmsgbuf, sizeof(dictmsgbuf), "fail<!--separate-->{ \"response\": \"%s\", \"code\":\"%d\" }", dictmsgbuf1 , DICT_PARAMETERS_MISSING );
 							HttpAddTextContent( response, dictmsgbuf );
 						}
+						
+						if( etag != NULL )
+						{
+							FFree( etag );
+						}
 					}
 					else
 					{
@@ -1731,6 +2017,7 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 				* @param sessionid - (required) session id of logged user
 				* @param from - (required) path to source file
 				* @param to - (required) path to destination path
+				* @param recursive - (optional) when set to 1 and destination ends with '/', whole directory is copied by server, progress is sent to user in "copy" messages
 				* @return { response: 0, Written: <number of bytes>} when success, otherwise error number
 				*/
 				/// @endcond
@@ -1746,6 +2033,14 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 					{
 						topath = (char *)el->hme_Data;
 						
+						FBOOL recursive = FALSE;
+						el = HttpGetPOSTParameter( request, "recursive" );
+						if( el == NULL ) el = HashmapGet( request->http_Query, "recursive" );
+						if( el != NULL && el->hme_Data != NULL && ( strcmp( (char *)el->hme_Data, "1" ) == 0 || strcmp( (char *)el->hme_Data, "true" ) == 0 ) )
+						{
+							recursive = TRUE;
+						}
+						
 						char *tpath;
 						if( ( tpath = FCalloc( strlen( topath ) + 10 + 256, sizeof(char) ) ) != NULL )
 						{
@@ -1771,7 +2066,7 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 							{
 								DEBUG("[FSMWebRequest] We have access to source: %s\n", path );
 							
-								FBOOL havedst = FSManagerCheckAccess( l->sl_FSM, dstpath, actDev->f_ID, loggedSession->us_User, "--W---" );
+								FBOOL havedst = FSManagerCheckAccess( l->sl_FSM, dstpath, dstrootf->f_ID, loggedSession->us_User, "--W---" );
 								if( havedst == TRUE )
 								{
 									dstrootf->f_Operations++;
@@ -1786,81 +2081,25 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 									{
 										DEBUG("[FSMWebRequest] Copy - executing file open on: %s to %s\n", path, topath );
 										
-										int64_t written = 0;
-										int64_t readall = 0;
+										int closeError = 0;
+										FileCopyJob job;
 										
 										actDev->f_SessionIDPTR = loggedSession->us_SessionID;//->us_User->u_MainSessionID;
-										File *rfp = (File *)actFS->FileOpen( actDev, path, "rb" );
-										int closeError = 0;
+										dstrootf->f_SessionIDPTR = loggedSession->us_SessionID;//->us_User->u_MainSessionID;
 										
-										if( rfp != NULL )
-										{
-											dstrootf->f_SessionIDPTR = loggedSession->us_SessionID;//->us_User->u_MainSessionID;
-											
-											File *wfp = (File *)dsthand->FileOpen( dstrootf, dstpath, "w+" );
-											
-											if( wfp != NULL )
-											{
-												// Using a big buffer!
-												char *dataBuffer = FCalloc( 524288, sizeof(char) );
-												if( dataBuffer != NULL )
-												{
-													DEBUG("[FSMWebRequest] file/copy - files opened, copy in progress\n");
+										// data is copied by filesystem when both devices are local, otherwise through read/write pipeline
+										FileCopyJobInit( &job, l, request, NULL, actDev, dstrootf );
+										int64_t result = FileCopyFile( &job, path, dstpath, &closeError );
+										// partial copy reports bytes which were stored
+										int64_t written = job.fcj_Written;
+										FileCopyJobRelease( &job );
 										
-													FQUAD dataread = 0;
-													int readTr = 0;
-
-													while( ( dataread = actFS->FileRead( rfp, dataBuffer, 524288 ) ) > 0 )
-													{
-														if( request->http_ShutdownPtr != NULL &&  *(request->http_ShutdownPtr) == TRUE )
-														{
-															break;
-														}
-													
-														readall += dataread;
-													
-														if( dataread > 0 )
-														{
-															int bytes = 0;
-														
-															dataread = FileSystemActivityCheckAndUpdate( l, &(dstrootf->f_Activity), dataread );
-
-															bytes = dsthand->FileWrite( wfp, dataBuffer, dataread );
-
-															written += bytes;
-
-															dstrootf->f_BytesStored += bytes;
-															
-															readTr = 0;
-														}
-														else
-														{
-															readTr++;
-															if( readTr > 25 )
-															{
-																DEBUG("Cannot read data from source!\n");
-																break;
-															}
-														}
-													}
-													FFree( dataBuffer );
-												}
-												else
-												{
-													DEBUG( "[FSMWebRequest] We could not do anything with the bad file pointers..\n" );
-												}
-												closeError = dsthand->FileClose( dstrootf, wfp );
-											}
-											
-											DEBUG( "[FSMWebRequest] Wrote %lu bytes. Read: %lu. Read file pointer %p. Write file pointer %p.\n", written, readall, rfp, wfp );
-											
-											actFS->FileClose( actDev, rfp );
-										}
+										DEBUG( "[FSMWebRequest] Wrote %lu bytes.\n", written );
 								
 										char tmp[ 128 ];
-										if( closeError != 0 )
+										if( closeError != 0 || result < 0 )
 										{
-											sprintf( tmp, "fail<!--separate-->{\"response\":\"0\",\"Written\":\"%lu\",\"Error\":\"%d\"}", written, closeError );
+											sprintf( tmp, "fail<!--separate-->{\"response\":\"0\",\"Written\":\"%lu\",\"Error\":\"%d\"}", written, closeError != 0 ? closeError : -1 );
 										}
 										else
 										{
@@ -1869,6 +2108,37 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 
 										HttpAddTextContent( response, tmp );
 									}
+									else if( recursive == TRUE )	// copy whole directory
+									{
+										FileCopyJob job;
+										char tmp[ 256 ];
+										
+										actDev->f_SessionIDPTR = loggedSession->us_SessionID;
+										dstrootf->f_SessionIDPTR = loggedSession->us_SessionID;
+										
+										// source and destination roots were checked above, every nested entry is checked during copy
+										FileCopyJobInit( &job, l, request, loggedSession->us_User, actDev, dstrootf );
+										int errors = FileCopyDirectory( &job, path, dstpath );
+										
+										if( errors < 0 )
+										{
+											snprintf( tmp, sizeof(tmp), "fail<!--separate-->{ \"response\": \"Destination is inside source directory\"}" );
+										}
+										else
+										{
+											snprintf( tmp, sizeof(tmp), "%s<!--separate-->{\"response\":\"0\",\"Files\":\"%d\",\"Written\":\"%ld\",\"Errors\":\"%d\"}", errors == 0 ? "ok" : "fail", job.fcj_FilesDone, job.fcj_Written, errors );
+										}
+										FileCopyJobRelease( &job );
+										
+										HttpAddTextContent( response, tmp );
+										
+										char *notifPath = CutNotificationPath( topath );
+										if( notifPath != NULL )
+										{
+											DoorNotificationCommunicateChanges( l, loggedSession, dstrootf, notifPath );
+											FFree( notifPath );
+										}
+									}
 									else		// make directory
 									{
 										DEBUG("[FSMWebRequest] On copy, make dir first: %s\n", topath );
@@ -22,6 +22,15 @@
 #include <system/fsys/door_notification.h>
 #include <stdlib.h>
 
+//
+// reads with offset can come for one file from many connections at once, seek and read
+// must not be mixed, files are spread between locks by pointer
+//
+
+#define UFILE_READ_LOCKS 16
+
+static pthread_mutex_t s_UFileReadLocks[ UFILE_READ_LOCKS ] = { [ 0 ... UFILE_READ_LOCKS-1 ] = PTHREAD_MUTEX_INITIALIZER };
+
 /**
  * Remote Filesystem web calls handler
  *
@@ -254,7 +263,7 @@ Http *FSMRemoteWebRequest( void *m, char **urlpath, Http *request, UserSession *
 							}
 							fp->f_Socket = request->http_Socket;
 						
-							sprintf( tmp, "ok<!--separate-->{\"fileptr\":\"%p\"} ", fp );
+							snprintf( tmp, sizeof(tmp), "ok<!--separate-->{\"fileptr\":\"%p\",\"size\":\"%llu\"} ", fp, (unsigned long long)fp->f_Size );
 							HttpAddTextContent( response, tmp );
 						
 							USMAddFile( l->sl_USM,  loggedSession, fp );
@@ -360,7 +369,9 @@ Http *FSMRemoteWebRequest( void *m, char **urlpath, Http *request, UserSession *
 	*
 	* @param sessionid - (required) session id of logged user
 	* @param fptr - (required) pointer to opened file
-	* @param size - (required) number of maximum bytes which you want to receive
+	* @param size - (required) number of maximum bytes which you want to receive, block is filled until end of file
+	* @param offset - (optional) position from which block is read, many blocks of one file can be requested at same time
+	* @param status - (optional) when set to 1 data is preceded by "ok<!--separate-->", error is returned as "fail<!--separate-->{"rb":"<code>"}"
 	* @return received bytes when success, otherwise error code
 	*/
 	/// @endcond
@@ -368,6 +379,8 @@ Http *FSMRemoteWebRequest( void *m, char **urlpath, Http *request, UserSession *
 	{
 		FULONG pointer = 0;
 		FULONG size = 0;
+		FQUAD offset = -1;
+		FBOOL status = FALSE;
 		int error = 0;
 		FBOOL streaming = FALSE;
 		
@@ -387,6 +400,21 @@ Http *FSMRemoteWebRequest( void *m, char **urlpath, Http *request, UserSession *
 			size = (FULONG)strtoul( (char *)el->hme_Data, &eptr, 0 );
 		}
 		
+		el  = HashmapGet( request->http_ParsedPostContent, "offset" );
+		if( el == NULL ) el = HashmapGet( request->http_Query, "offset" );
+		if( el != NULL )
+		{
+			char *eptr;
+			offset = (FQUAD)strtoll( (char *)el->hme_Data, &eptr, 0 );
+		}
+		
+		el  = HashmapGet( request->http_ParsedPostContent, "status" );
+		if( el == NULL ) el = HashmapGet( request->http_Query, "status" );
+		if( el != NULL && el->hme_Data != NULL && strcmp( (char *)el->hme_Data, "1" ) == 0 )
+		{
+			status = TRUE;
+		}
+		
 		response = HttpNewSimpleA( HTTP_200_OK, request,  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( "text/html", 9 ),
 								   HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
 		
@@ -419,17 +447,65 @@ Http *FSMRemoteWebRequest( void *m, char **urlpath, Http *request, UserSession *
 				char *buffer;
 				streaming = f->f_Stream;
 				
-				if( ( buffer = FCalloc( size+1, sizeof(char) ) ) != NULL )
+				// status is placed before data in same buffer
+				int head = ( status == TRUE && streaming == FALSE ) ? 17 : 0;
+				
+				if( ( buffer = FCalloc( size+head+1, sizeof(char) ) ) != NULL )
 				{
 					FHandler *actFS  =  f->f_RootDevice->f_FSys;
-					readsize = actFS->FileRead( f, buffer, size );
+					pthread_mutex_t *lock = NULL;
+					
+					if( offset >= 0 )
+					{
+						lock = &(s_UFileReadLocks[ pointer % UFILE_READ_LOCKS ]);
+						pthread_mutex_lock( lock );
+						if( actFS->FileSeek == NULL || actFS->FileSeek( f, offset ) == -1 )
+						{
+							pthread_mutex_unlock( lock );
+							lock = NULL;
+							readsize = -1;
+						}
+					}
+					
+					if( offset < 0 || lock != NULL )
+					{
+						readsize = actFS->FileRead( f, buffer + head, size );
+						
+						// remote drives read ahead with big blocks, whole block is filled to save round trips
+						if( streaming == FALSE )
+						{
+							while( readsize > 0 && (FULONG)readsize < size )
+							{
+								int r = actFS->FileRead( f, buffer + head + readsize, size - readsize );
+								if( r <= 0 )
+								{
+									break;
+								}
+								readsize += r;
+							}
+						}
+					}
+					
+					if( lock != NULL )
+					{
+						pthread_mutex_unlock( lock );
+					}
+					
 					DEBUG2("[FSMRemoteWebRequest] Read by native FS %d\n", readsize );
 					if( readsize > 0 )
 					{
-						DEBUG2("[FSMRemoteWebRequest] Read by native FS %d  last char %d\n", readsize, buffer[ readsize-1 ] );
+						DEBUG2("[FSMRemoteWebRequest] Read by native FS %d  last char %d\n", readsize, buffer[ head+readsize-1 ] );
 						if( streaming == FALSE )
 						{
-							HttpSetContent( response, buffer, readsize );
+							if( head > 0 )
+							{
+								memcpy( buffer, "ok<!--separate-->", head );
+							}
+							HttpSetContent( response, buffer, readsize + head );
+						}
+						else
+						{
+							FFree( buffer );
 						}
 					}
 					else
@@ -457,7 +533,7 @@ Http *FSMRemoteWebRequest( void *m, char **urlpath, Http *request, UserSession *
 		if( readsize < 1 )
 		{
 			char sizec[  256 ];
-			FULONG sizei = (FULONG)sprintf( sizec, "{\"rb\":\"%d\"}", readsize );
+			FULONG sizei = (FULONG)sprintf( sizec, "%s{\"rb\":\"%d\"}", ( status == TRUE && streaming == FALSE ) ? "fail<!--separate-->" : "", readsize );
 			
 			if( streaming == TRUE )
 			{
@@ -481,6 +557,71 @@ Http *FSMRemoteWebRequest( void *m, char **urlpath, Http *request, UserSession *
 	}*/
 	}
 	
+	/// @cond WEB_CALL_DOCUMENTATION
+	/**
+	*
+	* <HR><H2>system.library/ufile/seek</H2>Change position in opened file
+	*
+	* @param sessionid - (required) session id of logged user
+	* @param fptr - (required) pointer to opened file
+	* @param pos - (required) new position in file (from beginning)
+	* @return {"rb":"0"} when success, otherwise {"rb":"-1"}
+	*/
+	/// @endcond
+	else if( strcmp( urlpath[ 1 ], "seek" ) == 0 )
+	{
+		FULONG pointer = 0;
+		FQUAD pos = -1;
+		int seekResult = -1;
+		
+		HashmapElement *el  = HashmapGet( request->http_ParsedPostContent, "fptr" );
+		if( el == NULL ) el = HashmapGet( request->http_Query, "fptr" );
+		if( el != NULL )
+		{
+			char *eptr;
+			pointer = (FULONG)strtoul( (char *)el->hme_Data, &eptr, 0 );
+		}
+		
+		el  = HashmapGet( request->http_ParsedPostContent, "pos" );
+		if( el == NULL ) el = HashmapGet( request->http_Query, "pos" );
+		if( el != NULL )
+		{
+			char *eptr;
+			pos = (FQUAD)strtoll( (char *)el->hme_Data, &eptr, 0 );
+		}
+		
+		response = HttpNewSimpleA( HTTP_200_OK, request,  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( "text/html", 9 ),
+								   HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+		
+		response->http_ResponseID = request->http_ResponseID;
+		
+		if( pointer != 0 && pos >= 0 )
+		{
+			File *f = loggedSession->us_OpenedFiles;
+			while( f != NULL )
+			{
+				if( f->f_Pointer == pointer )
+				{
+					break;
+				}
+				f = (File *)f->node.mln_Succ;
+			}
+			
+			if( f != NULL )
+			{
+				FHandler *actFS  =  f->f_RootDevice->f_FSys;
+				if( actFS->FileSeek != NULL )
+				{
+					seekResult = actFS->FileSeek( f, pos );
+				}
+			}
+		}
+		
+		char rbc[ 64 ];
+		snprintf( rbc, sizeof(rbc), "{\"rb\":\"%d\"}", seekResult == -1 ? -1 : 0 );
+		HttpAddTextContent( response, rbc );
+	}
+	
 	/// @cond WEB_CALL_DOCUMENTATION
 	/**
 	*
@@ -100,6 +100,7 @@ FHandler *FHandlerCreate( const char *path, const char *name )
 			fsys->FileRead = dlsym( fsys->handle, "FileRead");
 			fsys->FileWrite = dlsym( fsys->handle, "FileWrite");
 			fsys->FileSeek = dlsym( fsys->handle, "FileSeek");
+			fsys->FileSendToSocket = dlsym( fsys->handle, "FileSendToSocket");	// NULL when driver is not backed by real file descriptor
 			
 			fsys->Info = dlsym( fsys->handle, "Info");
 			fsys->Call = dlsym( fsys->handle, "Call");
@@ -108,6 +109,7 @@ FHandler *FHandlerCreate( const char *path, const char *name )
 			fsys->Rename = dlsym( fsys->handle, "Rename");
 			fsys->Execute = dlsym( fsys->handle, "Execute");
 			fsys->Copy = dlsym( fsys->handle, "Copy" );
+			fsys->FileCopy = dlsym( fsys->handle, "FileCopy" );	// NULL when filesystem cannot copy files by itself
 			fsys->GetDiskInfo = dlsym( fsys->handle, "GetDiskInfo" );
 			
 			fsys->InfoGet = dlsym( fsys->handle, "InfoGet" );
@@ -220,3 +222,62 @@ void FilesystemDeleteAll( Filesystem *fs )
 		FilesystemDelete( rem );
 	}
 }
+
+/**
+ * Send part of opened file to socket. Zero-copy FileSendToSocket is used when filesystem provides it,
+ * otherwise file is positioned by FileSeek and read in chunks.
+ *
+ * @param data pointer to opened File structure, f_FSys must point to FHandler
+ * @param sock pointer to Socket
+ * @param offset position in file
+ * @param length number of bytes to send
+ * @return number of bytes sent or -1 when error appear
+ */
+FQUAD FileSendRangeToSocket( void *data, Socket *sock, FQUAD offset, FQUAD length )
+{
+	File *fp = (File *)data;
+	if( fp == NULL || fp->f_FSys == NULL || sock == NULL )
+	{
+		return -1;
+	}
+	FHandler *actFS = (FHandler *)fp->f_FSys;
+	
+	if( actFS->FileSendToSocket != NULL )
+	{
+		return actFS->FileSendToSocket( fp, sock, offset, length );
+	}
+	
+	if( actFS->FileSeek == NULL || actFS->FileSeek( fp, offset ) != 0 )
+	{
+		FERROR("[FileSendRangeToSocket] Cannot seek to position %lld\n", (long long)offset );
+		return -1;
+	}
+	
+	// data is written to socket here, file system cannot stream it by itself
+	fp->f_Stream = FALSE;
+	
+	char *buffer = FMalloc( SOCKET_SENDFILE_BUFFER );
+	if( buffer == NULL )
+	{
+		return -1;
+	}
+	
+	FQUAD sent = 0;
+	while( sent < length )
+	{
+		int toRead = ( length - sent ) > SOCKET_SENDFILE_BUFFER ? SOCKET_SENDFILE_BUFFER : (int)( length - sent );
+		int dataread = actFS->FileRead( fp, buffer, toRead );
+		if( dataread <= 0 )
+		{
+			break;
+		}
+		if( sock->s_Interface->SocketWrite( sock, buffer, dataread ) <= 0 )
+		{
+			break;
+		}
+		sent += dataread;
+	}
+	FFree( buffer );
+	
+	return sent;
+}
@@ -83,13 +83,15 @@ typedef struct FHandler
 	int                     (*FileClose)( struct File *s, void *fp );
 	int                     (*FileRead)( struct File *s, char *buf, int size );
 	int                     (*FileWrite)( struct File *s, char *buf, int size );
-	int                     (*FileSeek)( struct File *s, int pos );
+	int                     (*FileSeek)( struct File *s, FQUAD pos );		// absolute position, -1 when seek is not possible
+	FQUAD                   (*FileSendToSocket)( struct File *s, Socket *sock, FQUAD offset, FQUAD size );	// optional, zero-copy send of opened file
 	
 	int                     (*MakeDir)( struct File *s, const char *path );
 	int64_t                 (*Delete)( struct File *s, const char *path );
 	int                     (*Rename)( struct File *s, const char *path, const char *nname );
 	char                    *(*Execute)( struct File *s, const char *path, const char *args, UserSession *wsc );
 	int64_t                 (*Copy)( struct File *s, const char *dst, const char *src );
+	FQUAD                   (*FileCopy)( struct File *dst, const char *dstpath, struct File *src, const char *srcpath );	// optional, copy between devices of same filesystem without passing data through FriendCore, -2 when not possible
 	int                     (*GetDiskInfo)( struct File *s, int64_t *used, int64_t *size );
 	
 	char                    *(*InfoGet)( struct File *s, const char *path, const char *key );
@@ -176,6 +178,12 @@ void FilesystemDelete( Filesystem *fs );
 
 void FilesystemDeleteAll( Filesystem *fs );
 
+//
+// send part of opened file to socket (File->f_FSys must point to FHandler), compatible with HttpRangeSendFunc
+//
+
+FQUAD FileSendRangeToSocket( void *data, Socket *sock, FQUAD offset, FQUAD length );
+
 #endif // __SYSTEM_FSYS_FSYS_H_
 
 //
@@ -313,6 +313,10 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 			{
 				sd->fp = nf;
 			}
+			if( mode[ 0 ] == 'r' && nf->nf_Data != NULL )
+			{
+				locfil->f_Size = nf->nf_Data->bs_Size;
+			}
 			DEBUG("\nOffset set to %ld\n\n", nf->nf_Offset );
 			
 			DEBUG("File open, descriptor returned\n");
@@ -408,13 +412,17 @@ int FileWrite( struct File *f, char *buffer, int wsize )
 // seek
 //
 
-int FileSeek( struct File *s, int pos )
+int FileSeek( struct File *s, FQUAD pos )
 {
 	SpecialData *sd = (SpecialData *)s->f_SpecialData;
 	if( sd != NULL )
 	{
-		sd->fp->nf_Offset += pos;
-		return pos;
+		if( pos < 0 || sd->fp->nf_Data == NULL || (FULONG)pos > sd->fp->nf_Data->bs_Size )
+		{
+			return -1;
+		}
+		sd->fp->nf_Offset = pos;
+		return 0;
 	}
 	return -1;
 }
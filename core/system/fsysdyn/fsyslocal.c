@@ -25,6 +25,11 @@
 #include <system/datatypes/images/image.h>
 #include <system/datatypes/images/png.h>
 #include <sys/statvfs.h>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <errno.h>
 
 #define SUFFIX "fsys"
 #define PREFIX "local"
@@ -425,6 +430,16 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 				locfil->f_SpecialData = FCalloc( sizeof( SpecialData ), 1 );
 				
 				locfil->f_Stream = s->f_Stream;
+				
+				// size is required to serve byte ranges
+				if( mode[ 0 ] == 'r' )
+				{
+					struct stat st;
+					if( fstat( fileno( f ), &st ) == 0 )
+					{
+						locfil->f_Size = st.st_size;
+					}
+				}
 			
 				SpecialData *sd = (SpecialData *)locfil->f_SpecialData;
 			
@@ -545,16 +560,170 @@ int FileWrite( struct File *f, char *buffer, int wsize )
 // seek
 //
 
-int FileSeek( struct File *s, int pos )
+int FileSeek( struct File *s, FQUAD pos )
 {
 	SpecialData *sd = (SpecialData *)s->f_SpecialData;
 	if( sd )
 	{
-		return fseek( sd->fp, pos, SEEK_SET );
+		return fseeko( sd->fp, (off_t)pos, SEEK_SET );
 	}
 	return -1;
 }
 
+//
+// send data from file directly to socket (zero-copy)
+//
+
+FQUAD FileSendToSocket( struct File *f, Socket *sock, FQUAD offset, FQUAD size )
+{
+	SpecialData *sd = (SpecialData *)f->f_SpecialData;
+	if( sd == NULL || sd->fp == NULL || sock == NULL )
+	{
+		return -1;
+	}
+	
+	int fd = fileno( sd->fp );
+	struct stat st;
+	if( fstat( fd, &st ) != 0 )
+	{
+		return -1;
+	}
+	
+	// size < 0 means everything till end of file
+	if( offset >= st.st_size )
+	{
+		return 0;
+	}
+	if( size < 0 || offset + size > st.st_size )
+	{
+		size = st.st_size - offset;
+	}
+	
+	return sock->s_Interface->SocketSendFile( sock, fd, offset, size );
+}
+
+//
+// build real path of file on local device
+//
+
+static char *LocalRealPath( struct File *s, const char *path )
+{
+	const char *colon = strchr( path, ':' );
+	if( colon != NULL )
+	{
+		path = colon + 1;
+	}
+	
+	int rspath = strlen( s->f_Path );
+	char *name = FCalloc( rspath + strlen( path ) + 5, sizeof( char ) );
+	if( name != NULL )
+	{
+		if( rspath > 0 && s->f_Path[ rspath-1 ] == '/' )
+		{
+			sprintf( name, "%s%s", s->f_Path, path );
+		}
+		else
+		{
+			sprintf( name, "%s/%s", s->f_Path, path );
+		}
+	}
+	return name;
+}
+
+//
+// copy file between two local devices inside kernel, data is not passed through FriendCore
+// reflink is used when filesystem supports it (btrfs, xfs), otherwise sendfile
+// returns number of bytes copied, -1 when error appear, -2 when file must be copied by FileRead/FileWrite
+//
+
+FQUAD FileCopy( struct File *dst, const char *dstpath, struct File *src, const char *srcpath )
+{
+	char *dstname = LocalRealPath( dst, dstpath );
+	char *srcname = LocalRealPath( src, srcpath );
+	FQUAD copied = -2;
+	int in = -1, out = -1;
+	
+	if( dstname == NULL || srcname == NULL )
+	{
+		goto done;
+	}
+	
+	DEBUG("[LocalFS] FileCopy %s -> %s\n", srcname, dstname );
+	
+	struct stat st;
+	if( ( in = open( srcname, O_RDONLY ) ) < 0 || fstat( in, &st ) != 0 || !S_ISREG( st.st_mode ) )
+	{
+		goto done;
+	}
+	
+	// copy to itself would truncate source
+	struct stat dstst;
+	if( stat( dstname, &dstst ) == 0 && dstst.st_dev == st.st_dev && dstst.st_ino == st.st_ino )
+	{
+		copied = -1;
+		goto done;
+	}
+	
+	// missing directories are created by FileOpen
+	if( ( out = open( dstname, O_WRONLY|O_CREAT|O_TRUNC, 0666 ) ) < 0 )
+	{
+		goto done;
+	}
+	
+#ifdef FICLONE
+	if( ioctl( out, FICLONE, in ) == 0 )
+	{
+		copied = st.st_size;
+		goto done;
+	}
+#endif
+	
+	copied = 0;
+	off_t offset = 0;
+	while( offset < st.st_size )
+	{
+		FQUAD left = st.st_size - offset;
+		ssize_t n = sendfile( out, in, &offset, left > 0x40000000 ? 0x40000000 : (size_t)left );
+		if( n < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+			// old kernels cannot sendfile to regular files
+			copied = ( copied == 0 && ( errno == EINVAL || errno == ENOSYS ) ) ? -2 : -1;
+			break;
+		}
+		if( n == 0 )	// file was truncated in meantime
+		{
+			break;
+		}
+		copied += n;
+	}
+	
+done:
+	if( in >= 0 )
+	{
+		close( in );
+	}
+	if( out >= 0 )
+	{
+		if( close( out ) != 0 && copied >= 0 )
+		{
+			copied = -1;
+		}
+	}
+	if( dstname != NULL )
+	{
+		FFree( dstname );
+	}
+	if( srcname != NULL )
+	{
+		FFree( srcname );
+	}
+	return copied;
+}
+
 //
 // GetDiskInfo
 //
@@ -1228,12 +1397,18 @@ void FillStatLocal( BufString *bs, struct stat *s, File *d, const char *path )
 
 FLONG GetChangeTimestamp( struct File *s, const char *path )
 {
-	struct stat result;
-	if( stat( path, &result) == 0 )
+	FLONG rettime = -1;
+	char *name = LocalRealPath( s, path );
+	if( name != NULL )
 	{
-		return (FLONG)result.st_mtimensec;
+		struct stat result;
+		if( stat( name, &result) == 0 )
+		{
+			rettime = (FLONG)result.st_mtime;
+		}
+		FFree( name );
 	}
-	return (FLONG)-1;
+	return rettime;
 }
 
 //
@@ -914,9 +914,14 @@ int FileClose( struct File *s, void *fp )
 // Seek
 //
 
-int FileSeek( struct File *s, int pos )
+int FileSeek( struct File *s, FQUAD pos )
 {
-	return 0;
+	// data is streamed from script, only beginning of file is available
+	if( pos == 0 )
+	{
+		return 0;
+	}
+	return -1;
 }
 
 //
@@ -194,13 +194,32 @@ char *GetFileName( const char *path )
 #define PHP_READ_SIZE (1024 * 1024 * 2)
 #define USE_NPOPEN_POLL
 
+//
+// SystemBase stored in device data
+//
+
+static inline SystemBase *PHPFileSB( File *f )
+{
+	if( f != NULL && f->f_SpecialData != NULL )
+	{
+		return ((SpecialData *)f->f_SpecialData)->sb;
+	}
+	return NULL;
+}
+
 //
 // php call, send request, read answer (for big files
 //
 
-ListString *PHPCall( const char *command )
+ListString *PHPCall( SystemBase *sb, const char *command )
 {
 	DEBUG("[PHPFsys] run app: '%s'\n", command );
+	
+	// FriendCore php pool (php-fpm / persistent workers), falls back to new process by itself
+	if( sb != NULL && sb->RunPHPCommand != NULL )
+	{
+		return sb->RunPHPCommand( sb, command );
+	}
     
 	NPOpenFD pofd;
 	int err = newpopen( command, &pofd );
@@ -661,7 +680,7 @@ void *Mount( struct FHandler *s, struct TagItem *ti, User *usr, char **mountErro
 			
 					// Execute!
 					//int answerLength = 0;
-					ListString *result = PHPCall( command );
+					ListString *result = PHPCall( sb, command );
 					FFree( command );
 			
 					if( result && result->ls_Size >= 0 )
@@ -797,7 +816,7 @@ int UnMount( struct FHandler *s, void *f )
 					sprintf( command, "php 'modules/system/module.php' '%s';", FilterPHPVar( commandCnt ) );
 					FFree( commandCnt );
 			
-					ListString *result = PHPCall( command );
+					ListString *result = PHPCall( PHPFileSB( lf ), command );
 					
 					FFree( command );
 					
@@ -1322,9 +1341,14 @@ int FileClose( struct File *s, void *fp )
 // Seek
 //
 
-int FileSeek( struct File *s, int pos )
+int FileSeek( struct File *s, FQUAD pos )
 {
-	return 0;
+	// data is streamed from script, only beginning of file is available
+	if( pos == 0 )
+	{
+		return 0;
+	}
+	return -1;
 }
 
 //
@@ -1448,7 +1472,7 @@ char *InfoGet( struct File *f, const char *path, const char *key )
 				sprintf( command, "php 'modules/system/module.php' '%s';", FilterPHPVar( commandCnt ) );
 				FFree( commandCnt );
 	
-				ListString *result = PHPCall( command );
+				ListString *result = PHPCall( PHPFileSB( lf ), command );
 				
 				FFree( command );
 				
@@ -1557,7 +1581,7 @@ int MakeDir( struct File *f, const char *path )
 			
 				DEBUG("[fsysphp] MAKEDIR %s\n", command );
 	
-				ListString *result = PHPCall( command );
+				ListString *result = PHPCall( PHPFileSB( f ), command );
 		
 				if( result && result->ls_Size >= 0 )
 				{
@@ -1652,7 +1676,7 @@ FLONG Delete( struct File *s, const char *path )
 				DEBUG("PATH %s\n", commandCnt );
 				snprintf( command, cmdLength, "php 'modules/system/module.php' '%s';", FilterPHPVar( commandCnt ) );
 		
-				ListString *result = PHPCall( command );
+				ListString *result = PHPCall( PHPFileSB( s ), command );
 		
 				// TODO: we should parse result to get information about success
 				if( result != NULL )
@@ -1670,7 +1694,7 @@ FLONG Delete( struct File *s, const char *path )
 							ListStringDelete( result );
 							result = NULL;
 						}
-						result = PHPCall( command );
+						result = PHPCall( PHPFileSB( s ), command );
 						if( result != NULL )
 						{
 							DEBUG("Delete res 1: %s\n", result->ls_Data );
@@ -1751,7 +1775,7 @@ int Rename( struct File *s, const char *path, const char *nname )
 						s->f_SessionIDPTR ? s->f_SessionIDPTR : "", encPath ? encPath : "", newName ? newName : "" );
 					snprintf( command, cmdLength, "php 'modules/system/module.php' '%s';", FilterPHPVar( commandCnt ) );
 
-					ListString *result = PHPCall( command );
+					ListString *result = PHPCall( PHPFileSB( s ), command );
 		
 					if( result != NULL )
 					{
@@ -1766,7 +1790,7 @@ int Rename( struct File *s, const char *path, const char *nname )
 								ListStringDelete( result );
 								result = NULL;
 							}
-							result = PHPCall( command );
+							result = PHPCall( PHPFileSB( s ), command );
 						}
 						// TODO: we should parse result to get information about success
 						if( result != NULL )
@@ -1899,7 +1923,7 @@ BufString *Info( File *s, const char *path )
 			
 					// Execute!
 					BufString *bs = NULL;
-					ListString *result = PHPCall( command );
+					ListString *result = PHPCall( PHPFileSB( s ), command );
 					if( result != NULL )
 					{
 						if( result->ls_Data != NULL && strncmp( "fail<!--separate-->", result->ls_Data, 19 ) == 0 )
@@ -1913,7 +1937,7 @@ BufString *Info( File *s, const char *path )
 							
 							snprintf( command, cmdLength, "php 'modules/system/module.php' '%s';", commandCnt );
 		
-							result = PHPCall( command );
+							result = PHPCall( PHPFileSB( s ), command );
 						}
 						
 						bs = BufStringNewSize( result->ls_Size );
@@ -1990,7 +2014,7 @@ BufString *Call( File *s, const char *path, char *args )
 					FFree( commandCnt );
 			
 					BufString *bs = NULL;
-					ListString *result = PHPCall( command );
+					ListString *result = PHPCall( PHPFileSB( s ), command );
 					if( result != NULL )
 					{
 						bs =BufStringNewSize( result->ls_Size );
@@ -2068,7 +2092,7 @@ BufString *Dir( File *s, const char *path )
 					snprintf( command, cmdLength, "php 'modules/system/module.php' '%s';", FilterPHPVar( commandCnt ) );
 		
 					BufString *bs  = NULL;
-					ListString *result = PHPCall( command );
+					ListString *result = PHPCall( PHPFileSB( s ), command );
 					if( result != NULL )
 					{
 						if( result->ls_Data != NULL && strncmp( "fail<!--separate-->", result->ls_Data, 19 ) == 0 )
@@ -2079,7 +2103,7 @@ BufString *Dir( File *s, const char *path )
 								sd->type ? sd->type : "", s->f_SessionIDPTR ? s->f_SessionIDPTR : "", encPathSlash ? encPathSlash : "" );
 							snprintf( command, cmdLength, "php 'modules/system/module.php' '%s';", FilterPHPVar( commandCnt ) );
 		
-							result = PHPCall( command );
+							result = PHPCall( PHPFileSB( s ), command );
 						}
 						
 						if( result != NULL )
@@ -27,10 +27,18 @@
 #include <communication/comm_msg.h>
 #include <system/json/jsmn.h>
 #include <network/socket.h>
+#include <pthread.h>
+#include <limits.h>
 
 #define SUFFIX "fsys"
 #define PREFIX "Remote"
 
+#define REMOTE_CHUNK_SIZE 262144		// size of block requested from / sent to remote server by stream thread
+#define REMOTE_READ_WINDOW 4			// number of chunks read ahead of consumer, 0 - read on demand
+#define REMOTE_WRITE_WINDOW 4			// number of chunks waiting to be sent, 0 - write through
+#define REMOTE_READ_REQUESTS_MAX 16		// limit of block requests sent at same time for one opened file
+#define REMOTE_READ_OLD_PEER -3			// RemoteReadBlock: remote side does not know offset/status, block position is unknown
+
 /** @file
  * 
  *  Remote file system
@@ -40,6 +48,45 @@
  */
 
 
+//
+// data block transferred by stream thread
+//
+
+typedef struct RemoteChunk
+{
+	struct RemoteChunk				*rc_Next;
+	char							*rc_Data;
+	int								rc_Size;		// number of bytes in chunk
+	int								rc_Pos;			// bytes already taken by consumer
+	int								rc_Seq;			// number of block in read stream, blocks can arrive out of order
+}RemoteChunk;
+
+//
+// read-ahead / write-behind stream of opened file
+//
+
+typedef struct RemoteStream
+{
+	pthread_t						rs_Threads[ REMOTE_READ_REQUESTS_MAX ];	// one request in flight per thread
+	int								rs_ThreadCount;
+	pthread_mutex_t					rs_Mutex;
+	pthread_cond_t					rs_Cond;
+	struct File						*rs_File;
+	int								rs_Mode;		// MODE_READ or MODE_WRITE
+	RemoteChunk						*rs_First;		// queue of chunks
+	RemoteChunk						*rs_Last;
+	int								rs_Queued;		// number of chunks in queue
+	int								rs_Window;		// maximum number of chunks in queue
+	int								rs_ChunkSize;
+	FQUAD							rs_Offset;		// read: position of next requested block
+	int								rs_NextSeq;		// read: number of next requested block
+	int								rs_ReadSeq;		// read: number of block expected by consumer
+	int								rs_EOFSeq;		// read: number of first block after end of file (INT_MAX when not known)
+	FBOOL							rs_Quit;
+	FBOOL							rs_OldPeer;		// read: remote side ignored offset, data must be read on demand
+	int								rs_Error;		// write failed, reported by next FileWrite/FileClose
+}RemoteStream;
+
 //
 // special structure
 //
@@ -81,6 +128,14 @@ typedef struct SpecialData
 	char							*address;		// hold destination server address
 	int 							port;			// port
 	int								secured;		// is connection secured
+	
+	int								readWindow;		// device: chunks read ahead (ReadAhead option)
+	int								writeWindow;	// device: chunks written behind (WriteBehind option)
+	int								chunkSize;		// device: size of streamed chunk (ChunkSize option)
+	
+	RemoteStream					*stream;		// opened file: read-ahead / write-behind thread
+	RemoteChunk						*writeChunk;	// opened file: chunk filled by FileWrite
+	FQUAD							position;		// opened file: position seen by caller, read stream starts there
 }SpecialData;
 
 //
@@ -88,6 +143,9 @@ typedef struct SpecialData
 //
 
 DataForm *SendMessageRFS( SpecialData *sd, DataForm *df );
+static int RemoteStreamDelete( RemoteStream *rs );
+static int RemoteFlushWrite( struct File *f );
+int FileSeek( struct File *s, FQUAD pos );
 
 #define ANSWER_POSITION 3
 #define HEADER_POSITION (ANSWER_POSITION*COMM_MSG_HEADER_SIZE)
@@ -723,6 +781,10 @@ void *Mount( struct FHandler *s, struct TagItem *ti, User *usr, char **mountErro
 			sd->port = sd->csr->csr_port;
 			//sd->port = 6503;
 			
+			sd->readWindow = REMOTE_READ_WINDOW;
+			sd->writeWindow = REMOTE_WRITE_WINDOW;
+			sd->chunkSize = REMOTE_CHUNK_SIZE;
+			
 			if( config != NULL )
 			{
 				unsigned int i = 0, i1 = 0;
@@ -743,10 +805,29 @@ void *Mount( struct FHandler *s, struct TagItem *ti, User *usr, char **mountErro
 						
 							sd->privkey = StringDuplicateN( config + t[ i1 ].start, len );
 						}
+						else if( jsoneq( config, &t[i], "ReadAhead") == 0 )
+						{
+							sd->readWindow = atoi( config + t[ i1 ].start );
+						}
+						else if( jsoneq( config, &t[i], "WriteBehind") == 0 )
+						{
+							sd->writeWindow = atoi( config + t[ i1 ].start );
+						}
+						else if( jsoneq( config, &t[i], "ChunkSize") == 0 )
+						{
+							sd->chunkSize = atoi( config + t[ i1 ].start );
+						}
 					}
 				}
 			}
 			
+			if( sd->chunkSize < 4096 )
+			{
+				sd->chunkSize = 4096;
+			}
+			if( sd->readWindow < 0 ){ sd->readWindow = 0; }
+			if( sd->writeWindow < 0 ){ sd->writeWindow = 0; }
+			
 			sd->host = StringDuplicate( conname );
 			
 			sd->hosti = strlen( sd->host )+1;
@@ -1181,6 +1262,16 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 				{
 					DEBUG1("[RemoteOpen] Found json object\n");
 					int i = 0, i1 = 0;
+					FQUAD fileSize = 0;
+					
+					// size is sent by servers which support seek
+					for( i = 0; i < r - 1 ; i++ )
+					{
+						if( jsoneq( d, &t[i], "size") == 0 )
+						{
+							fileSize = strtoll( d + t[ i+1 ].start, NULL, 10 );
+						}
+					}
 				
 					for( i = 0; i < r ; i++ )
 					{
@@ -1201,6 +1292,7 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 								locfil->f_Path = StringDuplicate( path );
 								locfil->f_RootDevice = s;
 								locfil->f_Socket = s->f_Socket;
+								locfil->f_Size = fileSize;
 						
 								if( ( locfil->f_SpecialData = FCalloc( 1, sizeof( SpecialData ) ) ) != NULL )
 								{
@@ -1268,6 +1360,14 @@ int FileClose( struct File *root, void *fp )
 		SpecialData *rsd = (SpecialData *)root->f_SpecialData;
 		int hostsize = strlen( rsd->host )+1;
 		
+		// data waiting in write-behind queue must be stored before file is closed
+		int streamError = RemoteFlushWrite( f );
+		if( RemoteStreamDelete( sd->stream ) != 0 )
+		{
+			streamError = -1;
+		}
+		sd->stream = NULL;
+		
 		MsgItem tags[] = {
 			{ ID_FCRE, (FULONG)0, MSG_GROUP_START },
 				{ ID_FRID, (FULONG)0 , MSG_INTEGER_VALUE },
@@ -1312,6 +1412,12 @@ int FileClose( struct File *root, void *fp )
 		if( recvdf != NULL ) DataFormDelete( recvdf );
 		DataFormDelete( df );
 		
+		if( streamError != 0 )
+		{
+			FERROR("[RemoteClose] Not all data was stored on remote side: %s\n", f->f_Path );
+			result = -1;
+		}
+		
 		if( sd->host != NULL ) FFree( sd->host );
 		if( sd->id != NULL ) FFree( sd->id );
 		if( sd->login != NULL ) FFree( sd->login );
@@ -1336,10 +1442,12 @@ int FileClose( struct File *root, void *fp )
 }
 
 //
-// Read data from file
+// Read block of data from remote file (one round trip). Block is read from offset,
+// or from current remote position when offset is -1. Returns 0 at end of file and
+// REMOTE_READ_OLD_PEER when offset was given but remote side does not support it.
 //
 
-int FileRead( struct File *f, char *buffer, int rsize )
+static int RemoteReadBlock( struct File *f, char *buffer, int rsize, FQUAD offset )
 {
 	int result = -2;
 	
@@ -1349,6 +1457,9 @@ int FileRead( struct File *f, char *buffer, int rsize )
 	{
 		char sizec[ 256 ];
 		int sizei = snprintf( sizec, 256, "size=%d", rsize )+1;
+		// -1 is sent too, remote side reads from current position then
+		char offsetc[ 64 ];
+		int offseti = snprintf( offsetc, sizeof(offsetc), "offset=%lld", (long long)offset )+1;
 		
 		File *root = f->f_RootDevice;
 		SpecialData *rsd = (SpecialData *)root->f_SpecialData;
@@ -1364,6 +1475,8 @@ int FileRead( struct File *f, char *buffer, int rsize )
 					{ ID_PARM, (FULONG)0, MSG_GROUP_START },
 						{ ID_PRMT, (FULONG) sd->fileptri, (FULONG)sd->fileptr },
 						{ ID_PRMT, (FULONG) sizei, (FULONG) sizec },
+						{ ID_PRMT, (FULONG) offseti, (FULONG) offsetc },
+						{ ID_PRMT, (FULONG) 9, (FULONG)"status=1" },
 						{ ID_PRMT, (FULONG) rsd->logini, (FULONG)rsd->login },
 						{ ID_PRMT, (FULONG) rsd->passwdi,  (FULONG)rsd->passwd },
 						{ ID_PRMT, (FULONG) rsd->idi,  (FULONG)rsd->id },
@@ -1385,27 +1498,48 @@ int FileRead( struct File *f, char *buffer, int rsize )
 		{
 			char *d = (char *)recvdf + (ANSWER_POSITION*COMM_MSG_HEADER_SIZE);
 			
-			result =  recvdf->df_Size  - (ANSWER_POSITION*COMM_MSG_HEADER_SIZE);
-
-			// 1531 - 1483
+			// answer is ended by 0
+			int len = recvdf->df_Size - (ANSWER_POSITION*COMM_MSG_HEADER_SIZE) - 1;
 			
-			if( strncmp( d, "{\"rb\":\"-1\"}", 11 ) == 0 )
+			if( len >= 17 && strncmp( d, "ok<!--separate-->", 17 ) == 0 )
+			{
+				d += 17;
+				len -= 17;
+			}
+			// status is given by remote side, data can look like anything
+			else if( len >= 19 && strncmp( d, "fail<!--separate-->", 19 ) == 0 )
+			{
+				DataFormDelete( recvdf );
+				DataFormDelete( df );
+				// {"rb":"0"} - end of file
+				return ( strncmp( d + 19, "{\"rb\":\"0\"}", 10 ) == 0 ) ? 0 : -1;
+			}
+			// connection failed (SendMessageRFS) or remote side does not send status
+			else if( strncmp( d, "{\"rb\":\"-1\"}", 11 ) == 0 || ( len <= 15 && strncmp( d, "{\"rb\":\"", 7 ) == 0 ) )
 			{
 				DataFormDelete( recvdf );
 				DataFormDelete( df );
 				return -1;
 			}
-			
-			result = result-1;
-			
-			if( f->f_Stream == TRUE )
+			// older remote side ignores status and offset, it returned data from its current position
+			else if( offset >= 0 )
 			{
-				f->f_Socket->s_Interface->SocketWrite( f->f_Socket, d, (FLONG)result );
+				if( rsd->readWindow > 0 )
+				{
+					Log( FLOG_INFO, "[RemoteReadBlock] Remote host %s does not support block reads, read-ahead disabled\n", rsd->host );
+					rsd->readWindow = 0;
+				}
+				DataFormDelete( recvdf );
+				DataFormDelete( df );
+				return REMOTE_READ_OLD_PEER;
 			}
-			else
+			
+			result = len;
+			if( result > rsize )
 			{
-				memcpy( buffer, d, result );
+				result = rsize;
 			}
+			memcpy( buffer, d, result );
 		}
 		
 		if( recvdf != NULL ) DataFormDelete( recvdf );
@@ -1416,10 +1550,10 @@ int FileRead( struct File *f, char *buffer, int rsize )
 }
 
 //
-// write data to file
+// Send block of data to remote file (one round trip)
 //
 
-int FileWrite( struct File *f, char *buffer, int wsize )
+static int RemoteWriteBlock( struct File *f, char *buffer, int wsize )
 {
 	int result = -2;
 	
@@ -1538,18 +1672,557 @@ int FileWrite( struct File *f, char *buffer, int wsize )
 	return result;
 }
 
+//
+// Read stream thread. Every thread keeps one block request in flight, so up to window
+// blocks are requested at same time. Blocks are read from own offsets and can arrive
+// out of order, consumer takes them by number.
+//
+
+static void *RemoteStreamReader( void *arg )
+{
+	RemoteStream *rs = (RemoteStream *)arg;
+	
+	while( TRUE )
+	{
+		pthread_mutex_lock( &rs->rs_Mutex );
+		while( rs->rs_Quit == FALSE && rs->rs_NextSeq < rs->rs_EOFSeq && ( rs->rs_NextSeq - rs->rs_ReadSeq ) >= rs->rs_Window )
+		{
+			pthread_cond_wait( &rs->rs_Cond, &rs->rs_Mutex );
+		}
+		if( rs->rs_Quit == TRUE || rs->rs_NextSeq >= rs->rs_EOFSeq )
+		{
+			pthread_mutex_unlock( &rs->rs_Mutex );
+			break;
+		}
+		int seq = rs->rs_NextSeq++;
+		FQUAD offset = rs->rs_Offset;
+		rs->rs_Offset += rs->rs_ChunkSize;
+		pthread_mutex_unlock( &rs->rs_Mutex );
+		
+		RemoteChunk *rc = FCalloc( 1, sizeof( RemoteChunk ) );
+		int r = -1;
+		if( rc != NULL && ( rc->rc_Data = FMalloc( rs->rs_ChunkSize ) ) != NULL )
+		{
+			r = RemoteReadBlock( rs->rs_File, rc->rc_Data, rs->rs_ChunkSize, offset );
+		}
+		
+		pthread_mutex_lock( &rs->rs_Mutex );
+		if( r > 0 )
+		{
+			// remote side fills whole block, shorter block is last one
+			if( r < rs->rs_ChunkSize && seq + 1 < rs->rs_EOFSeq )
+			{
+				rs->rs_EOFSeq = seq + 1;
+			}
+			
+			rc->rc_Size = r;
+			rc->rc_Seq = seq;
+			
+			// queue is sorted by block number
+			RemoteChunk *prev = NULL, *next = rs->rs_First;
+			while( next != NULL && next->rc_Seq < seq )
+			{
+				prev = next;
+				next = next->rc_Next;
+			}
+			rc->rc_Next = next;
+			if( prev != NULL )
+			{
+				prev->rc_Next = rc;
+			}
+			else
+			{
+				rs->rs_First = rc;
+			}
+			if( next == NULL )
+			{
+				rs->rs_Last = rc;
+			}
+			rs->rs_Queued++;
+			rc = NULL;
+		}
+		else if( seq < rs->rs_EOFSeq )
+		{
+			// end of file or error, consumer gets data up to this block
+			rs->rs_EOFSeq = seq;
+		}
+		if( r == REMOTE_READ_OLD_PEER )
+		{
+			rs->rs_OldPeer = TRUE;
+		}
+		pthread_cond_broadcast( &rs->rs_Cond );
+		pthread_mutex_unlock( &rs->rs_Mutex );
+		
+		if( rc != NULL )
+		{
+			if( rc->rc_Data != NULL )
+			{
+				FFree( rc->rc_Data );
+			}
+			FFree( rc );
+		}
+	}
+	
+	return NULL;
+}
+
+//
+// Write stream thread: sends chunks queued by FileWrite in order.
+// Number of chunks in queue is limited by window, producer waits when queue is full.
+//
+
+static void *RemoteStreamWriter( void *arg )
+{
+	RemoteStream *rs = (RemoteStream *)arg;
+	
+	while( TRUE )
+	{
+		pthread_mutex_lock( &rs->rs_Mutex );
+		while( rs->rs_Quit == FALSE && rs->rs_First == NULL )
+		{
+			pthread_cond_wait( &rs->rs_Cond, &rs->rs_Mutex );
+		}
+		// queued data is always sent before thread quits
+		RemoteChunk *rc = rs->rs_First;
+		pthread_mutex_unlock( &rs->rs_Mutex );
+		
+		if( rc == NULL )
+		{
+			break;
+		}
+		
+		int w = -1;
+		if( rs->rs_Error == 0 )
+		{
+			w = RemoteWriteBlock( rs->rs_File, rc->rc_Data, rc->rc_Size );
+		}
+		
+		pthread_mutex_lock( &rs->rs_Mutex );
+		if( w != rc->rc_Size )
+		{
+			FERROR("[RemoteStreamWriter] Cannot store chunk on remote side, stored %d of %d bytes\n", w, rc->rc_Size );
+			rs->rs_Error = -1;
+		}
+		rs->rs_First = rc->rc_Next;
+		if( rs->rs_First == NULL )
+		{
+			rs->rs_Last = NULL;
+		}
+		rs->rs_Queued--;
+		pthread_cond_broadcast( &rs->rs_Cond );
+		pthread_mutex_unlock( &rs->rs_Mutex );
+		
+		FFree( rc->rc_Data );
+		FFree( rc );
+	}
+	
+	return NULL;
+}
+
+//
+// Create stream for opened file and start its threads. Read stream starts from offset.
+//
+
+static RemoteStream *RemoteStreamNew( struct File *f, int mode, int window, int chunkSize, FQUAD offset )
+{
+	RemoteStream *rs = FCalloc( 1, sizeof( RemoteStream ) );
+	if( rs != NULL )
+	{
+		int i, threads = 1;
+		
+		rs->rs_File = f;
+		rs->rs_Mode = mode;
+		rs->rs_Window = window;
+		rs->rs_ChunkSize = chunkSize;
+		rs->rs_Offset = offset;
+		rs->rs_EOFSeq = INT_MAX;
+		pthread_mutex_init( &rs->rs_Mutex, NULL );
+		pthread_cond_init( &rs->rs_Cond, NULL );
+		
+		if( mode == MODE_READ )
+		{
+			threads = ( window < REMOTE_READ_REQUESTS_MAX ) ? window : REMOTE_READ_REQUESTS_MAX;
+		}
+		
+		for( i=0 ; i < threads ; i++ )
+		{
+			if( pthread_create( &rs->rs_Threads[ rs->rs_ThreadCount ], NULL, mode == MODE_READ ? RemoteStreamReader : RemoteStreamWriter, rs ) == 0 )
+			{
+				rs->rs_ThreadCount++;
+			}
+		}
+		
+		if( rs->rs_ThreadCount == 0 )
+		{
+			FERROR("[RemoteStreamNew] Cannot create stream thread\n");
+			pthread_cond_destroy( &rs->rs_Cond );
+			pthread_mutex_destroy( &rs->rs_Mutex );
+			FFree( rs );
+			return NULL;
+		}
+	}
+	return rs;
+}
+
+//
+// Stop stream threads (queued writes are sent first) and release chunks which were read ahead.
+// Returns write error which appeared in stream.
+//
+
+static int RemoteStreamDelete( RemoteStream *rs )
+{
+	int i;
+	
+	if( rs == NULL )
+	{
+		return 0;
+	}
+	
+	pthread_mutex_lock( &rs->rs_Mutex );
+	rs->rs_Quit = TRUE;
+	pthread_cond_broadcast( &rs->rs_Cond );
+	pthread_mutex_unlock( &rs->rs_Mutex );
+	
+	for( i=0 ; i < rs->rs_ThreadCount ; i++ )
+	{
+		pthread_join( rs->rs_Threads[ i ], NULL );
+	}
+	
+	int error = rs->rs_Error;
+	
+	while( rs->rs_First != NULL )
+	{
+		RemoteChunk *rc = rs->rs_First;
+		rs->rs_First = rc->rc_Next;
+		FFree( rc->rc_Data );
+		FFree( rc );
+	}
+	
+	pthread_cond_destroy( &rs->rs_Cond );
+	pthread_mutex_destroy( &rs->rs_Mutex );
+	FFree( rs );
+	
+	return error;
+}
+
+//
+// Read data from file
+//
+
+int FileRead( struct File *f, char *buffer, int rsize )
+{
+	SpecialData *sd = (SpecialData *)f->f_SpecialData;
+	if( sd == NULL )
+	{
+		return -2;
+	}
+	
+	SpecialData *rsd = (SpecialData *)f->f_RootDevice->f_SpecialData;
+	int result = -1;
+	
+	// queued writes are not data of file yet, they are stored before reading
+	if( sd->writeChunk != NULL || ( sd->stream != NULL && sd->stream->rs_Mode == MODE_WRITE ) )
+	{
+		int streamError = RemoteFlushWrite( f );
+		if( RemoteStreamDelete( sd->stream ) != 0 || streamError != 0 )
+		{
+			FERROR("[RemoteRead] Not all data was stored on remote side\n");
+		}
+		sd->stream = NULL;
+	}
+	
+	if( rsd->readWindow <= 0 )
+	{
+		result = RemoteReadBlock( f, buffer, rsize, -1 );
+	}
+	else
+	{
+		if( sd->stream == NULL )
+		{
+			sd->stream = RemoteStreamNew( f, MODE_READ, rsd->readWindow, rsd->chunkSize, sd->position );
+		}
+		
+		RemoteStream *rs = sd->stream;
+		if( rs == NULL )
+		{
+			result = RemoteReadBlock( f, buffer, rsize, sd->position );
+		}
+		else
+		{
+			pthread_mutex_lock( &rs->rs_Mutex );
+			while( rs->rs_ReadSeq < rs->rs_EOFSeq && ( rs->rs_First == NULL || rs->rs_First->rc_Seq != rs->rs_ReadSeq ) )
+			{
+				pthread_cond_wait( &rs->rs_Cond, &rs->rs_Mutex );
+			}
+			
+			RemoteChunk *rc = rs->rs_First;
+			RemoteChunk *done = NULL;
+			if( rs->rs_ReadSeq < rs->rs_EOFSeq && rc != NULL && rc->rc_Seq == rs->rs_ReadSeq )
+			{
+				result = rc->rc_Size - rc->rc_Pos;
+				if( result > rsize )
+				{
+					result = rsize;
+				}
+				memcpy( buffer, rc->rc_Data + rc->rc_Pos, result );
+				rc->rc_Pos += result;
+				
+				// chunk consumed, thread can request next one
+				if( rc->rc_Pos >= rc->rc_Size )
+				{
+					rs->rs_First = rc->rc_Next;
+					if( rs->rs_First == NULL )
+					{
+						rs->rs_Last = NULL;
+					}
+					rs->rs_Queued--;
+					rs->rs_ReadSeq++;
+					done = rc;
+					pthread_cond_broadcast( &rs->rs_Cond );
+				}
+			}
+			// blocks are not read in order by remote side, nothing was given to caller from them
+			if( result < 0 && rs->rs_OldPeer == TRUE )
+			{
+				result = REMOTE_READ_OLD_PEER;
+			}
+			pthread_mutex_unlock( &rs->rs_Mutex );
+			
+			if( done != NULL )
+			{
+				FFree( done->rc_Data );
+				FFree( done );
+			}
+		}
+		
+		// remote position was moved by block requests, it is set back and file is read on demand
+		if( result == REMOTE_READ_OLD_PEER )
+		{
+			result = -1;
+			if( FileSeek( f, sd->position ) != -1 )
+			{
+				result = RemoteReadBlock( f, buffer, rsize, -1 );
+			}
+		}
+	}
+	
+	if( result > 0 )
+	{
+		sd->position += result;
+	}
+	
+	if( f->f_Stream == TRUE && result > 0 )
+	{
+		f->f_Socket->s_Interface->SocketWrite( f->f_Socket, buffer, (FLONG)result );
+	}
+	
+	return result;
+}
+
+//
+// Queue chunk filled by FileWrite, caller waits when write-behind window is full
+//
+
+static int RemoteFlushWrite( struct File *f )
+{
+	SpecialData *sd = (SpecialData *)f->f_SpecialData;
+	RemoteChunk *rc = sd->writeChunk;
+	
+	if( rc == NULL || rc->rc_Size == 0 )
+	{
+		return 0;
+	}
+	sd->writeChunk = NULL;
+	
+	RemoteStream *rs = sd->stream;
+	if( rs == NULL )
+	{
+		int w = RemoteWriteBlock( f, rc->rc_Data, rc->rc_Size );
+		int error = ( w == rc->rc_Size ) ? 0 : -1;
+		FFree( rc->rc_Data );
+		FFree( rc );
+		return error;
+	}
+	
+	pthread_mutex_lock( &rs->rs_Mutex );
+	while( rs->rs_Queued >= rs->rs_Window && rs->rs_Error == 0 )
+	{
+		pthread_cond_wait( &rs->rs_Cond, &rs->rs_Mutex );
+	}
+	
+	if( rs->rs_Last != NULL )
+	{
+		rs->rs_Last->rc_Next = rc;
+	}
+	else
+	{
+		rs->rs_First = rc;
+	}
+	rs->rs_Last = rc;
+	rs->rs_Queued++;
+	pthread_cond_broadcast( &rs->rs_Cond );
+	
+	int error = rs->rs_Error;
+	pthread_mutex_unlock( &rs->rs_Mutex );
+	
+	return error;
+}
+
+//
+// write data to file
+//
+
+int FileWrite( struct File *f, char *buffer, int wsize )
+{
+	SpecialData *sd = (SpecialData *)f->f_SpecialData;
+	if( sd == NULL )
+	{
+		return -2;
+	}
+	
+	SpecialData *rsd = (SpecialData *)f->f_RootDevice->f_SpecialData;
+	
+	// blocks read ahead are dropped and remote position (moved by reads with offset) is set to caller position
+	if( sd->stream != NULL && sd->stream->rs_Mode == MODE_READ )
+	{
+		FileSeek( f, sd->position );
+	}
+	
+	if( rsd->writeWindow <= 0 )
+	{
+		int w = RemoteWriteBlock( f, buffer, wsize );
+		if( w > 0 )
+		{
+			sd->position += w;
+		}
+		return w;
+	}
+	
+	if( sd->stream == NULL )
+	{
+		sd->stream = RemoteStreamNew( f, MODE_WRITE, rsd->writeWindow, rsd->chunkSize, sd->position );
+	}
+	
+	// error from previous batch is reported to caller
+	if( sd->stream != NULL && sd->stream->rs_Error != 0 )
+	{
+		return -1;
+	}
+	
+	// data is collected into chunks, chunks are acknowledged by remote side in background
+	int stored = 0;
+	while( stored < wsize )
+	{
+		if( sd->writeChunk == NULL )
+		{
+			RemoteChunk *rc = FCalloc( 1, sizeof( RemoteChunk ) );
+			if( rc == NULL || ( rc->rc_Data = FMalloc( rsd->chunkSize ) ) == NULL )
+			{
+				FERROR("[RemoteWrite] Cannot allocate memory for buffer\n");
+				if( rc != NULL )
+				{
+					FFree( rc );
+				}
+				return -2;
+			}
+			sd->writeChunk = rc;
+		}
+		
+		RemoteChunk *rc = sd->writeChunk;
+		int copy = rsd->chunkSize - rc->rc_Size;
+		if( copy > ( wsize - stored ) )
+		{
+			copy = wsize - stored;
+		}
+		memcpy( rc->rc_Data + rc->rc_Size, buffer + stored, copy );
+		rc->rc_Size += copy;
+		stored += copy;
+		sd->position += copy;
+		
+		if( rc->rc_Size >= rsd->chunkSize )
+		{
+			if( RemoteFlushWrite( f ) != 0 )
+			{
+				return -1;
+			}
+		}
+	}
+	
+	return stored;
+}
+
 //
 // seek
 //
 
-int FileSeek( struct File *s, int pos )
+int FileSeek( struct File *s, FQUAD pos )
 {
+	int result = -1;
+	
 	SpecialData *sd = (SpecialData *)s->f_SpecialData;
-	if( sd )
+	if( sd != NULL && s->f_RootDevice != NULL )
 	{
-		//return fseek( (FILE *)sd->fp, pos, SEEK_SET );
+		// pending writes are stored and data read ahead is dropped, stream starts again from new position
+		int streamError = RemoteFlushWrite( s );
+		if( RemoteStreamDelete( sd->stream ) != 0 || streamError != 0 )
+		{
+			FERROR("[RemoteSeek] Not all data was stored on remote side\n");
+		}
+		sd->stream = NULL;
+		
+		// only position of remote file is changed, data is not transferred
+		char posc[ 64 ];
+		int posi = snprintf( posc, sizeof(posc), "pos=%lld", (long long)pos )+1;
+		
+		File *root = s->f_RootDevice;
+		SpecialData *rsd = (SpecialData *)root->f_SpecialData;
+		int hostsize = strlen( rsd->host )+1;
+		
+		MsgItem tags[] = {
+			{ ID_FCRE, (FULONG)0, MSG_GROUP_START },
+				{ ID_FRID, (FULONG)0 , MSG_INTEGER_VALUE },
+				{ ID_QUER, (FULONG)hostsize, (FULONG)rsd->host  },
+				{ ID_SLIB, (FULONG)0, (FULONG)NULL },
+				{ ID_HTTP, (FULONG)0, MSG_GROUP_START },
+					{ ID_PATH, (FULONG)26, (FULONG)"system.library/ufile/seek" },
+					{ ID_PARM, (FULONG)0, MSG_GROUP_START },
+						{ ID_PRMT, (FULONG) sd->fileptri, (FULONG)sd->fileptr },
+						{ ID_PRMT, (FULONG) posi, (FULONG) posc },
+						{ ID_PRMT, (FULONG) rsd->logini, (FULONG)rsd->login },
+						{ ID_PRMT, (FULONG) rsd->passwdi,  (FULONG)rsd->passwd },
+						{ ID_PRMT, (FULONG) rsd->idi,  (FULONG)rsd->id },
+					{ MSG_GROUP_END, 0,  0 },
+				{ MSG_GROUP_END, 0,  0 },
+			{ MSG_GROUP_END, 0,  0 },
+			{ MSG_END, MSG_END, MSG_END }
+		};
+		
+		DataForm *df = DataFormNew( tags );
+		
+		DataForm *recvdf = SendMessageRFSRelogin( rsd, df );
+		
+		DEBUG("[RemoteSeek] Response received %p\n", recvdf );
+		
+		if( recvdf != NULL && recvdf->df_ID == ID_FCRE && recvdf->df_Size > 0 )
+		{
+			char *d = (char *)recvdf + (ANSWER_POSITION*COMM_MSG_HEADER_SIZE);
+			
+			// {"rb":"<result>"}
+			if( strncmp( d, "{\"rb\":\"", 7 ) == 0 )
+			{
+				result = atoi( d + 7 );
+			}
+		}
+		
+		if( result != -1 )
+		{
+			sd->position = pos;
+		}
+		
+		if( recvdf != NULL ) DataFormDelete( recvdf );
+		DataFormDelete( df );
 	}
-	return -1;
+	return result;
 }
 
 //
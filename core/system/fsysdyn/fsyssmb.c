@@ -721,7 +721,7 @@ int FileWrite( struct File *f, char *buffer, int wsize )
 // seek
 //
 
-int FileSeek( struct File *s, int pos )
+int FileSeek( struct File *s, FQUAD pos )
 {
 	SpecialData *sd = (SpecialData *)s->f_SpecialData;
 	if( sd )
@@ -63,6 +63,30 @@
 
 #define __ENABLE_MUTEX
 
+#ifndef SSH2_POOL_SIZE
+#define SSH2_POOL_SIZE 4				// maximum number of sftp sessions opened to one device
+#endif
+
+#define SSH2_POOL_IDLE_TIMEOUT 120		// idle sessions are closed after this number of seconds
+#define SSH2_POOL_CHECK_INTERVAL 15		// sessions idle longer than this are checked before use
+#define SSH2_POOL_WAIT_TIMEOUT 30		// seconds to wait for free session when pool is full
+
+#define SSH2_READ_AHEAD_SIZE 262144		// libssh2 keeps up to 4x this size of read requests in flight
+
+//
+// Authenticated SSH connection with SFTP subsystem
+//
+
+typedef struct SSH2Session
+{
+	struct SSH2Session						*ss_Next;
+	int										ss_Sock;
+	LIBSSH2_SESSION							*ss_Session;
+	LIBSSH2_SFTP							*ss_SFTP;
+	time_t									ss_LastUsed;
+	FBOOL									ss_Broken;		// session cannot be reused
+}SSH2Session;
+
 //
 // Special SSH data
 //
@@ -98,6 +122,22 @@ typedef struct SpecialData
 	LIBSSH2_SFTP_HANDLE						*sd_FileHandle;
 	char                                    sd_privkeyFileName[ 512 ];
 	int										sd_LoginType;
+	
+	// device: pool of sessions
+	SSH2Session								*sd_Idle;			// sessions waiting for use
+	int										sd_SessionCount;	// number of created sessions
+	int										sd_Waiting;			// threads inside SSH2SessionGet
+	FBOOL									sd_PoolQuit;
+	FBOOL									sd_PoolFree;		// device was unmounted while sessions were used, last user releases it
+	pthread_mutex_t							sd_PoolMutex;
+	pthread_cond_t							sd_PoolCond;
+	
+	// opened file: session taken from device pool and read-ahead buffer
+	SSH2Session								*sd_Session;
+	struct SpecialData						*sd_Device;
+	char									*sd_ReadBuffer;
+	int										sd_ReadLen;
+	int										sd_ReadPos;
 }SpecialData;
 
 typedef struct HandlerData
@@ -122,23 +162,17 @@ const char *GetPrefix()
 //
 //
 
-static inline void DisconnectLoop( SpecialData *sd, HandlerData *hd )
-{
-#ifdef __ENABLE_MUTEX
-pthread_mutex_unlock( &hd->hd_Mutex );
-#endif
-while( TRUE )
+static inline void DisconnectLoop( LIBSSH2_SESSION *session )
 {
-	if( libssh2_session_free( sd->session ) != LIBSSH2_ERROR_EAGAIN )
+	while( TRUE )
 	{
-		break;
-		
+		if( libssh2_session_free( session ) != LIBSSH2_ERROR_EAGAIN )
+		{
+			break;
+			
+		}
+		usleep( 1000 ); 
 	}
-	usleep( 1000 ); 
-}
-#ifdef __ENABLE_MUTEX
-pthread_mutex_lock( &hd->hd_Mutex );
-#endif
 }
 
 //
@@ -201,167 +235,417 @@ void deinit( struct FHandler *s )
 //
 //
 
-static int ServerReconnect( SpecialData *sd, HandlerData *hd __attribute__((unused)) )
+static void SSH2SessionDisconnect( SSH2Session *ss )
 {
-	if( sd->session != NULL )
+	if( ss->ss_Session != NULL )
 	{
-		if( sd->sftp_session != NULL )
+		if( ss->ss_SFTP != NULL )
 		{
-			libssh2_sftp_shutdown( sd->sftp_session );
-			sd->sftp_session = NULL;
+			libssh2_sftp_shutdown( ss->ss_SFTP );
+			ss->ss_SFTP = NULL;
 		}
-	
-		libssh2_session_disconnect( sd->session,  "Normal Shutdown, Thank you for playing" );
 		
-		DisconnectLoop( sd ,hd );
-		sd->session = NULL;
+		libssh2_session_disconnect( ss->ss_Session,  "Normal Shutdown, Thank you for playing" );
+		
+		DisconnectLoop( ss->ss_Session );
+		ss->ss_Session = NULL;
 	}
 	
-	if( sd->sock != 0 )
+	if( ss->ss_Sock > 0 )
 	{
-		close( sd->sock );
-		sd->sock = 0;
+		shutdown( ss->ss_Sock, SHUT_RDWR );
+		close( ss->ss_Sock );
 	}
+	ss->ss_Sock = 0;
+}
+
+/**
+ * Connect and authenticate session with device credentials (old connection is closed)
+ *
+ * @param sd pointer to device SpecialData
+ * @param ss pointer to session which will be (re)connected
+ * @return 0 when success, otherwise error number
+ */
+static int SSH2SessionConnect( SpecialData *sd, SSH2Session *ss )
+{
+	SSH2SessionDisconnect( ss );
 	
-	sd->sock = socket( AF_INET, SOCK_STREAM, 0 );
-	if( sd->sock != 0 )
+	ss->ss_Sock = socket( AF_INET, SOCK_STREAM, 0 );
+	if( ss->ss_Sock < 0 )
 	{
-		char *userauthlist = NULL;
-		// Set a timeout
-		struct timeval timeout;      
-		timeout.tv_sec = 4; // 4 secs!
-		timeout.tv_usec = 0;
-		setsockopt( sd->sock, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof( timeout) );
-		setsockopt( sd->sock, SOL_SOCKET, SO_SNDTIMEO, (char *)&timeout, sizeof( timeout ) );
-		
-		if( connect( sd->sock, (struct sockaddr *)&(sd->sin), sizeof(sd->sin) ) != 0 ) 
-		{
-			shutdown( sd->sock, SHUT_RDWR );
-			close( sd->sock );
-			sd->sock = 0;
-			FERROR( "Connect_client:: could not connect to host=[%s]\n", sd->sd_Host);
-			return -1;
-		}
+		ss->ss_Sock = 0;
+		FERROR("[SSH2SessionConnect] Cannot create socket\n");
+		return -1;
+	}
+	
+	// Set a timeout
+	struct timeval timeout;      
+	timeout.tv_sec = 4; // 4 secs!
+	timeout.tv_usec = 0;
+	setsockopt( ss->ss_Sock, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof( timeout) );
+	setsockopt( ss->ss_Sock, SOL_SOCKET, SO_SNDTIMEO, (char *)&timeout, sizeof( timeout ) );
+	
+	if( connect( ss->ss_Sock, (struct sockaddr *)&(sd->sin), sizeof(sd->sin) ) != 0 ) 
+	{
+		FERROR( "[SSH2SessionConnect] could not connect to host=[%s]\n", sd->sd_Host);
+		SSH2SessionDisconnect( ss );
+		return -1;
+	}
+	
+	ss->ss_Session = libssh2_session_init();
+	if( ss->ss_Session == NULL )
+	{
+		FERROR("[SSH2SessionConnect] Cannot initalize session!\n");
+		SSH2SessionDisconnect( ss );
+		return -3;
+	}
+	libssh2_session_set_timeout( ss->ss_Session, 5000 );
+	
+	if( libssh2_session_handshake( ss->ss_Session, ss->ss_Sock ) < 0 ) 
+	{
+		DEBUG("[SSH2SessionConnect] Failure establishing SSH session\n");
+		SSH2SessionDisconnect( ss );
+		return -2;
+	}
+	
+	libssh2_keepalive_config( ss->ss_Session, 1, 5 );
+	
+	if( libssh2_hostkey_hash( ss->ss_Session, LIBSSH2_HOSTKEY_HASH_SHA1 ) == NULL )
+	{
+		DEBUG("[SSH2SessionConnect] Failure establishing SSH session\n");
+		SSH2SessionDisconnect( ss );
+		return -3;
+	}
+	
+	int rc = -1;
+	if( sd->sd_LoginType == 1 )
+	{
+		rc = libssh2_userauth_password( ss->ss_Session, sd->sd_LoginUser, sd->sd_LoginPass );
+	}
+	else if ( sd->sd_LoginType == 4 )
+	{
+		rc = libssh2_userauth_publickey_fromfile( ss->ss_Session, sd->sd_LoginUser, NULL, sd->sd_privkeyFileName, sd->sd_LoginPass );
+	}
+	
+	if( rc != 0 )
+	{
+		FERROR("[SSH2SessionConnect] User not authenticated, login type %d\n", sd->sd_LoginType );
+		SSH2SessionDisconnect( ss );
+		return -4;
+	}
+	
+	ss->ss_SFTP = libssh2_sftp_init( ss->ss_Session );
+	if( ss->ss_SFTP == NULL ) 
+	{
+		FERROR("[SSH2SessionConnect] Unable to init SFTP session %d\n", libssh2_session_last_errno( ss->ss_Session ) );
+		SSH2SessionDisconnect( ss );
+		return -6;
+	}
+	
+	// Since we have not set non-blocking, tell libssh2 we are blocking 
+	libssh2_session_set_blocking( ss->ss_Session, 1 );
+	ss->ss_Broken = FALSE;
+	
+	return 0;
+}
+
+/**
+ * Check if idle session is still alive
+ *
+ * @param ss pointer to session
+ * @return TRUE when session can be used
+ */
+static FBOOL SSH2SessionAlive( SSH2Session *ss )
+{
+	if( ss->ss_Session == NULL || ss->ss_SFTP == NULL || ss->ss_Sock <= 0 )
+	{
+		return FALSE;
+	}
+	
+	// server closed connection?
+	char c;
+	int r = recv( ss->ss_Sock, &c, 1, MSG_PEEK | MSG_DONTWAIT );
+	if( r == 0 || ( r < 0 && errno != EAGAIN && errno != EWOULDBLOCK ) )
+	{
+		return FALSE;
+	}
+	
+	int next = 0;
+	if( libssh2_keepalive_send( ss->ss_Session, &next ) != 0 )
+	{
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Release device data. Called when device is unmounted and no session is used anymore.
+ *
+ * @param sd pointer to device SpecialData
+ */
+static void SSH2DeviceFree( SpecialData *sd )
+{
+	pthread_cond_destroy( &sd->sd_PoolCond );
+	pthread_mutex_destroy( &sd->sd_PoolMutex );
+	
+	if( sd->sd_Host ){ FFree( sd->sd_Host ); }
+	if( sd->sd_LoginUser ){ FFree( sd->sd_LoginUser ); }
+	if( sd->sd_LoginPass ){ FFree( sd->sd_LoginPass ); }
+	
+	remove( sd->sd_privkeyFileName );
+	
+	FFree( sd );
+}
+
+/**
+ * Check if unmounted device is not used anymore and must be released by caller (called under sd_PoolMutex)
+ *
+ * @param sd pointer to device SpecialData
+ * @return TRUE when caller must call SSH2DeviceFree after unlocking sd_PoolMutex
+ */
+static inline FBOOL SSH2PoolUnused( SpecialData *sd )
+{
+	if( sd->sd_PoolFree == TRUE && sd->sd_SessionCount <= 0 && sd->sd_Waiting <= 0 )
+	{
+		sd->sd_PoolFree = FALSE;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/**
+ * Return session to device pool. Broken sessions are closed, idle sessions which were not used
+ *  for SSH2_POOL_IDLE_TIMEOUT are closed too (one session is always kept)
+ *
+ * @param sd pointer to device SpecialData
+ * @param ss pointer to session taken by SSH2SessionGet
+ */
+static void SSH2SessionRelease( SpecialData *sd, SSH2Session *ss )
+{
+	SSH2Session *expired = NULL;
+	time_t now = time( NULL );
+	
+	if( ss == NULL )
+	{
+		return;
+	}
+	
+	pthread_mutex_lock( &sd->sd_PoolMutex );
+	if( ss->ss_Broken == TRUE || ss->ss_SFTP == NULL || sd->sd_PoolQuit == TRUE )
+	{
+		ss->ss_Next = expired;
+		expired = ss;
+		sd->sd_SessionCount--;
+	}
+	else
+	{
+		ss->ss_LastUsed = now;
+		ss->ss_Next = sd->sd_Idle;
+		sd->sd_Idle = ss;
 		
-		sd->session = libssh2_session_init();
-		if( sd->session == NULL )
+		// sessions are pushed on front, so the oldest ones are at the end of the list
+		SSH2Session *prev = sd->sd_Idle;
+		while( prev->ss_Next != NULL )
 		{
-			FERROR("Cannot initalize session!\n");
-			return -3;
+			if( ( now - prev->ss_Next->ss_LastUsed ) > SSH2_POOL_IDLE_TIMEOUT )
+			{
+				SSH2Session *old = prev->ss_Next;
+				prev->ss_Next = old->ss_Next;
+				old->ss_Next = expired;
+				expired = old;
+				sd->sd_SessionCount--;
+			}
+			else
+			{
+				prev = prev->ss_Next;
+			}
 		}
-		libssh2_session_set_timeout( sd->session, 5000 );
-		
-		if( libssh2_session_handshake( sd->session, sd->sock ) < 0 ) 
+	}
+	FBOOL freeDevice = SSH2PoolUnused( sd );
+	pthread_cond_broadcast( &sd->sd_PoolCond );
+	pthread_mutex_unlock( &sd->sd_PoolMutex );
+	
+	// closing connection may take time, it is done without lock
+	while( expired != NULL )
+	{
+		SSH2Session *next = expired->ss_Next;
+		SSH2SessionDisconnect( expired );
+		FFree( expired );
+		expired = next;
+	}
+	
+	if( freeDevice == TRUE )
+	{
+		SSH2DeviceFree( sd );
+	}
+}
+
+/**
+ * Take session from device pool. New session is created when there is no idle one and pool is not full,
+ *  otherwise function waits until other thread will release its session.
+ *
+ * @param sd pointer to device SpecialData
+ * @return pointer to connected session or NULL when error appear
+ */
+static SSH2Session *SSH2SessionGet( SpecialData *sd )
+{
+	SSH2Session *ss = NULL;
+	FBOOL create = FALSE;
+	
+	pthread_mutex_lock( &sd->sd_PoolMutex );
+	sd->sd_Waiting++;
+	while( sd->sd_PoolQuit == FALSE )
+	{
+		if( sd->sd_Idle != NULL )
 		{
-			DEBUG("Failure establishing SSH session\n");
-			DisconnectLoop( sd ,hd );
-			sd->session = NULL;
-			shutdown( sd->sock, SHUT_RDWR );
-			close( sd->sock );
-			sd->sock = 0;
-			return -2;
+			ss = sd->sd_Idle;
+			sd->sd_Idle = ss->ss_Next;
+			ss->ss_Next = NULL;
+			break;
 		}
 		
-		libssh2_keepalive_config( sd->session, 1, 5 );
-		
-		sd->fingerprint = libssh2_hostkey_hash( sd->session, LIBSSH2_HOSTKEY_HASH_SHA1 );
-		
-		if( sd->fingerprint == NULL )
+		if( sd->sd_SessionCount < SSH2_POOL_SIZE )
 		{
-			DEBUG("Failure establishing SSH session\n");
-			DisconnectLoop( sd ,hd );
-			sd->session = NULL;
-			shutdown( sd->sock, SHUT_RDWR );
-			close( sd->sock );
-			sd->sock = 0;
-			return -3;
+			sd->sd_SessionCount++;
+			create = TRUE;
+			break;
 		}
-
-		DEBUG( "Now going into userauthlist.\n" );
-		
-		userauthlist = libssh2_userauth_list( sd->session, sd->sd_LoginUser, strlen(sd->sd_LoginUser) );
 		
-		int authpw = 0;
-		if( strstr(userauthlist, "password") != NULL )
+		struct timespec ts;
+		clock_gettime( CLOCK_REALTIME, &ts );
+		ts.tv_sec += SSH2_POOL_WAIT_TIMEOUT;
+		if( pthread_cond_timedwait( &sd->sd_PoolCond, &sd->sd_PoolMutex, &ts ) == ETIMEDOUT )
 		{
-			authpw |= 1;
-		}
-		if( strstr(userauthlist, "keyboard-interactive") != NULL )
-		{
-			authpw |= 2;
+			FERROR("[SSH2SessionGet] No free session for host %s\n", sd->sd_Host );
+			break;
 		}
-		if( strstr(userauthlist, "publickey") != NULL )
+	}
+	sd->sd_Waiting--;
+	FBOOL freeDevice = SSH2PoolUnused( sd );
+	pthread_cond_broadcast( &sd->sd_PoolCond );
+	pthread_mutex_unlock( &sd->sd_PoolMutex );
+	
+	if( freeDevice == TRUE )
+	{
+		SSH2DeviceFree( sd );
+		return NULL;
+	}
+	
+	if( create == TRUE )
+	{
+		if( ( ss = FCalloc( 1, sizeof( SSH2Session ) ) ) != NULL )
 		{
-			authpw |= 4;
+			if( SSH2SessionConnect( sd, ss ) != 0 )
+			{
+				FFree( ss );
+				ss = NULL;
+			}
 		}
 		
-		if( sd->sd_LoginType == 1 )
+		if( ss == NULL )
 		{
-			sd->rc = libssh2_userauth_password( sd->session, sd->sd_LoginUser, sd->sd_LoginPass );
-			if( sd->rc != 0 )
+			pthread_mutex_lock( &sd->sd_PoolMutex );
+			sd->sd_SessionCount--;
+			freeDevice = SSH2PoolUnused( sd );
+			pthread_cond_broadcast( &sd->sd_PoolCond );
+			pthread_mutex_unlock( &sd->sd_PoolMutex );
+			
+			if( freeDevice == TRUE )
 			{
-				FERROR("User not authenticated\n");
-				DisconnectLoop( sd ,hd );
-				sd->session = NULL;
-				shutdown( sd->sock, SHUT_RDWR );
-				close( sd->sock );
-				sd->sock = 0;
-				return -3;
+				SSH2DeviceFree( sd );
 			}
+			return NULL;
 		}
-		else if ( sd->sd_LoginType == 4 )
+		DEBUG("[SSH2SessionGet] New session created for host %s, sessions %d\n", sd->sd_Host, sd->sd_SessionCount );
+	}
+	else if( ss != NULL && ( time( NULL ) - ss->ss_LastUsed ) > SSH2_POOL_CHECK_INTERVAL )
+	{
+		if( SSH2SessionAlive( ss ) == FALSE )
 		{
-			// Or by public key  
-			//if( libssh2_userauth_publickey_frommem( sdat->session, sdat->sd_LoginUser, strlen(sdat->sd_LoginUser), NULL, 0, privkey, strlen(privkey), NULL ) )
-			//{
-			if (libssh2_userauth_publickey_fromfile( sd->session, sd->sd_LoginUser, NULL, sd->sd_privkeyFileName, sd->sd_LoginPass ) ) 
-			{	
-				FERROR("User not authenticated\n");
-				DisconnectLoop( sd ,hd );
-				sd->session = NULL;
-				shutdown( sd->sock, SHUT_RDWR );
-				close( sd->sock );
-				sd->sock = 0;
-				return -4;
-			}
-			else
+			DEBUG("[SSH2SessionGet] Session to host %s is broken, reconnecting\n", sd->sd_Host );
+			if( SSH2SessionConnect( sd, ss ) != 0 )
 			{
-				DEBUG( "\tAuthentication by public key succeeded.\n");
+				ss->ss_Broken = TRUE;
+				SSH2SessionRelease( sd, ss );
+				return NULL;
 			}
 		}
-		else
+	}
+	
+	return ss;
+}
+
+/**
+ * Reconnect session after failed operation. Nothing is done when server only returned sftp error
+ *  (no such file, permission denied), connection is fine then.
+ *
+ * @param sd pointer to device SpecialData
+ * @param ss pointer to session
+ * @return TRUE when session was reconnected and operation can be repeated
+ */
+static FBOOL SSH2SessionRecover( SpecialData *sd, SSH2Session *ss )
+{
+	if( ss->ss_Session != NULL && libssh2_session_last_errno( ss->ss_Session ) == LIBSSH2_ERROR_SFTP_PROTOCOL )
+	{
+		return FALSE;
+	}
+	
+	if( SSH2SessionConnect( sd, ss ) != 0 )
+	{
+		ss->ss_Broken = TRUE;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Close all sessions of device and release device data. Waits a while for sessions used by opened files,
+ *  when they are still used after that, data is released by last SSH2SessionRelease.
+ *
+ * @param sd pointer to device SpecialData
+ */
+static void SSH2PoolDelete( SpecialData *sd )
+{
+	pthread_mutex_lock( &sd->sd_PoolMutex );
+	sd->sd_PoolQuit = TRUE;
+	pthread_cond_broadcast( &sd->sd_PoolCond );
+	
+	struct timespec ts;
+	clock_gettime( CLOCK_REALTIME, &ts );
+	ts.tv_sec += 5;
+	
+	while( TRUE )
+	{
+		while( sd->sd_Idle != NULL )
 		{
-			FERROR("User not authenticated\n");
-			DisconnectLoop( sd ,hd );
-			sd->session = NULL;
-			shutdown( sd->sock, SHUT_RDWR );
-			close( sd->sock );
-			sd->sock = 0;
-			return -5;
+			SSH2Session *ss = sd->sd_Idle;
+			sd->sd_Idle = ss->ss_Next;
+			sd->sd_SessionCount--;
+			
+			pthread_mutex_unlock( &sd->sd_PoolMutex );
+			SSH2SessionDisconnect( ss );
+			FFree( ss );
+			pthread_mutex_lock( &sd->sd_PoolMutex );
 		}
 		
-		DEBUG("Auth %s %s ret %d\n", sd->sd_LoginUser, sd->sd_LoginPass, sd->rc );
-		
-		sd->sftp_session = libssh2_sftp_init( sd->session );
-		
-		if (!sd->sftp_session) 
+		if( ( sd->sd_SessionCount <= 0 && sd->sd_Waiting <= 0 ) || pthread_cond_timedwait( &sd->sd_PoolCond, &sd->sd_PoolMutex, &ts ) == ETIMEDOUT )
 		{
-			int err = libssh2_session_last_errno( sd->session );
-			
-			FERROR("Unable to init SFTP session %d\n", err );
-			
-			DisconnectLoop( sd ,hd );
-			sd->session = NULL;
-			shutdown( sd->sock, SHUT_RDWR );
-			close( sd->sock );
-			sd->sock = 0;
-			return -6;
+			break;
 		}
-		
-		// Since we have not set non-blocking, tell libssh2 we are blocking 
-		libssh2_session_set_blocking( sd->session, 1);
 	}
-	return 0;
+	
+	sd->sd_PoolFree = TRUE;
+	FBOOL freeDevice = SSH2PoolUnused( sd );
+	if( freeDevice == FALSE )
+	{
+		FERROR("[SSH2PoolDelete] %d sessions to host %s are still in use, device will be released when they are closed\n", sd->sd_SessionCount, sd->sd_Host );
+	}
+	pthread_mutex_unlock( &sd->sd_PoolMutex );
+	
+	if( freeDevice == TRUE )
+	{
+		SSH2DeviceFree( sd );
+	}
 }
 
 //
@@ -377,43 +661,12 @@ int UnMount( struct FHandler *s, void *f )
 		if( lf->f_SpecialData )
 		{
 			SpecialData *sdat = (SpecialData *) lf->f_SpecialData;
-			HandlerData *hd = (HandlerData *)s->fh_SpecialData;
-			
-#ifdef __ENABLE_MUTEX
-			pthread_mutex_lock( &hd->hd_Mutex );
-#endif
+			lf->f_SpecialData = NULL;
 			
-			if( sdat->session != NULL )
-			{
-				if( sdat->sftp_session != NULL )
-				{
-					libssh2_sftp_shutdown( sdat->sftp_session );
-					sdat->sftp_session = NULL;
-				}
-			
-				libssh2_session_disconnect( sdat->session,  "Normal Shutdown, Thank you for playing" );
-				DisconnectLoop( sdat ,hd );
-				sdat->session = NULL;
-			}
-
-			if( sdat->sock != 0 )
-			{
-				close( sdat->sock );
-			}
-			
-#ifdef __ENABLE_MUTEX
-			pthread_mutex_unlock( &hd->hd_Mutex );
-#endif
+			// data is released now or by last opened file
+			SSH2PoolDelete( sdat );
 			
 			DEBUG("all done!\n");
-			
-			if( sdat->sd_Host ){ FFree( sdat->sd_Host ); }
-			if( sdat->sd_LoginUser ){ FFree( sdat->sd_LoginUser ); }
-			if( sdat->sd_LoginPass ){ FFree( sdat->sd_LoginPass ); }
-			
-			remove( sdat->sd_privkeyFileName );
-			
-			FFree( lf->f_SpecialData );
 		}
 	}
 	
@@ -807,6 +1060,26 @@ void *Mount( struct FHandler *s, struct TagItem *ti, User *usrs __attribute__((u
  
 		// Since we have not set non-blocking, tell libssh2 we are blocking 
 		libssh2_session_set_blocking( sdat->session, 1);
+		
+		// first session becomes part of device pool, next ones are created on demand
+		SSH2Session *ss = FCalloc( 1, sizeof( SSH2Session ) );
+		if( ss == NULL )
+		{
+			FERROR("Cannot allocate memory for session\n");
+			goto shutdown;
+		}
+		ss->ss_Sock = sdat->sock;
+		ss->ss_Session = sdat->session;
+		ss->ss_SFTP = sdat->sftp_session;
+		ss->ss_LastUsed = time( NULL );
+		sdat->sock = 0;
+		sdat->session = NULL;
+		sdat->sftp_session = NULL;
+		
+		pthread_mutex_init( &sdat->sd_PoolMutex, NULL );
+		pthread_cond_init( &sdat->sd_PoolCond, NULL );
+		sdat->sd_Idle = ss;
+		sdat->sd_SessionCount = 1;
 
 #ifdef __ENABLE_MUTEX
 		pthread_mutex_unlock( &hd->hd_Mutex );
@@ -886,47 +1159,13 @@ int Release( struct FHandler *s, void *f )
 		if( lf->f_SpecialData )
 		{
 			SpecialData *sdat = (SpecialData *) lf->f_SpecialData;
-			HandlerData *hd = (HandlerData *)s->fh_SpecialData;
-			
-#ifdef __ENABLE_MUTEX
-			DEBUG("release locked %p\n", &hd->hd_Mutex );
-			pthread_mutex_lock( &hd->hd_Mutex );
-#endif
-			if( sdat->session != NULL )
-			{
-				if( sdat->sftp_session != NULL )
-				{
-					libssh2_sftp_shutdown( sdat->sftp_session );
-					sdat->sftp_session = NULL;
-				}
-				libssh2_session_disconnect( sdat->session,  "Normal Shutdown, Thank you for playing");
-				if( sdat->session != NULL )
-				{
-					while( TRUE ){ if( libssh2_session_free( sdat->session ) != LIBSSH2_ERROR_EAGAIN ){ break; } usleep( 1000 ); }
-					sdat->session = NULL;
-				}
-			}
+			lf->f_SpecialData = NULL;
 			
-#ifdef __ENABLE_MUTEX
-			pthread_mutex_unlock( &hd->hd_Mutex );
-#endif
+			// data is released now or by last opened file
+			SSH2PoolDelete( sdat );
 
 			DEBUG("all done!\n");
 			//libssh2_exit();
-			
-			if( sdat->sock != 0 )
-			{
-				close( sdat->sock);
-				DEBUG("socket closed\n");
-			}
-			
-			if( sdat->sd_Host ){ FFree( sdat->sd_Host ); }
-			if( sdat->sd_LoginUser ){ FFree( sdat->sd_LoginUser ); }
-			if( sdat->sd_LoginPass ){ FFree( sdat->sd_LoginPass ); }
-			
-			remove( sdat->sd_privkeyFileName );
-			
-			FFree( lf->f_SpecialData );
 		}
 	}
 	
@@ -1004,13 +1243,20 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 			}
 		}
 		
-		FHandler *fh = (FHandler *)s->f_FSys;
-		HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
+		// session stays assigned to opened file until FileClose
+		SSH2Session *ss = SSH2SessionGet( sdat );
+		if( ss == NULL )
+		{
+			FERROR("Cannot get ssh session, file: %s\n", comm );
+			FFree( comm );
+			FFree( commClean );
+			if( cleanPath != NULL )
+			{
+				FFree( cleanPath );
+			}
+			return NULL;
+		}
 		
-#ifdef __ENABLE_MUTEX
-		DEBUG("open1 locked %p\n", &hd->hd_Mutex );
-		pthread_mutex_lock( &hd->hd_Mutex );
-#endif
 		int slash = 0;
 		for( i = 0; i < spath; i++ )
 		{
@@ -1023,7 +1269,7 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 				{
 					snprintf( directory, alsize, "%s%.*s", s->f_Path, i, cleanPath );
 					
-					libssh2_sftp_mkdir( sdat->sftp_session, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
+					libssh2_sftp_mkdir( ss->ss_SFTP, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
 					
 					
 					FFree( directory );
@@ -1031,10 +1277,6 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 				slash++;
 			}
 		}
-#ifdef __ENABLE_MUTEX
-		pthread_mutex_unlock( &hd->hd_Mutex );
-		DEBUG("open1 locked %p\n", &hd->hd_Mutex );
-#endif
 		
 		FFree( commClean );
 		if( cleanPath != NULL )
@@ -1055,42 +1297,30 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 		//
 		LIBSSH2_SFTP_HANDLE *handle = NULL;
 		
-#ifdef __ENABLE_MUTEX
-		DEBUG("open locked %p\n", &hd->hd_Mutex );
-		pthread_mutex_lock( &hd->hd_Mutex );
-#endif
-		
 		if( strcmp( mode, "rs" ) == 0 || strcmp( mode, "rb" ) == 0 || strcmp( mode, "r" ) == 0 )
 		{
-			handle = libssh2_sftp_open( sdat->sftp_session, comm, LIBSSH2_FXF_READ, 0 );
-			if( handle == NULL )
+			handle = libssh2_sftp_open( ss->ss_SFTP, comm, LIBSSH2_FXF_READ, 0 );
+			if( handle == NULL && SSH2SessionRecover( sdat, ss ) == TRUE )
 			{
-				ServerReconnect( sdat, hd );
-				handle = libssh2_sftp_open( sdat->sftp_session, comm, LIBSSH2_FXF_READ, 0 );
+				handle = libssh2_sftp_open( ss->ss_SFTP, comm, LIBSSH2_FXF_READ, 0 );
 			}
 		}
 		else
 		{
-			handle = libssh2_sftp_open( sdat->sftp_session, comm,
+			handle = libssh2_sftp_open( ss->ss_SFTP, comm,
 				LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_TRUNC,
 				LIBSSH2_SFTP_S_IRUSR|LIBSSH2_SFTP_S_IWUSR|
 				LIBSSH2_SFTP_S_IRGRP|LIBSSH2_SFTP_S_IROTH );
 			
-			if( handle == NULL )
+			if( handle == NULL && SSH2SessionRecover( sdat, ss ) == TRUE )
 			{
-				ServerReconnect( sdat, hd );
-				handle = libssh2_sftp_open( sdat->sftp_session, comm,
+				handle = libssh2_sftp_open( ss->ss_SFTP, comm,
 											LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_TRUNC,
 								LIBSSH2_SFTP_S_IRUSR|LIBSSH2_SFTP_S_IWUSR|
 								LIBSSH2_SFTP_S_IRGRP|LIBSSH2_SFTP_S_IROTH );
 			}
 		}
 		
-#ifdef __ENABLE_MUTEX
-		pthread_mutex_unlock( &hd->hd_Mutex );
-		DEBUG("open unlocked %p\n", &hd->hd_Mutex );
-#endif
-		
 		if( handle != NULL )
 		{
 			// Ready the file structure
@@ -1111,6 +1341,20 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 					SpecialData *locsd = (SpecialData *)s->f_SpecialData;
 					sd->sb = locsd->sb;
 					sd->sd_FileHandle = handle;
+					sd->sd_Session = ss;
+					sd->sd_Device = sdat;
+					
+					// size is required to serve byte ranges
+					LIBSSH2_SFTP_ATTRIBUTES attrs;
+					if( mode[ 0 ] == 'r' && libssh2_sftp_fstat( handle, &attrs ) == 0 && ( attrs.flags & LIBSSH2_SFTP_ATTR_SIZE ) )
+					{
+						locfil->f_Size = attrs.filesize;
+					}
+				}
+				else
+				{
+					libssh2_sftp_close( handle );
+					SSH2SessionRelease( sdat, ss );
 				}
 				DEBUG("FileOpened, memory allocated for ssh2fs\n");
 				
@@ -1119,6 +1363,8 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 				
 				return locfil;
 			}
+			libssh2_sftp_close( handle );
+			SSH2SessionRelease( sdat, ss );
 			FFree( comm );
 			return NULL;
 		}
@@ -1126,6 +1372,7 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 		{
 			FERROR("Cannot open file: %s  mode %s\n", comm, mode );
 		}
+		SSH2SessionRelease( sdat, ss );
 		FFree( comm );
 	}
 	
@@ -1152,8 +1399,6 @@ int FileClose( struct File *s, void *fp )
 	if( fp != NULL )
 	{
 		//SpecialData *sdat = (SpecialData *)s->f_SpecialData;
-		FHandler *fh = (FHandler *)s->f_FSys;
-		HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
 		int close = 0;
 		
 		File *lfp = ( File *)fp;
@@ -1162,15 +1407,18 @@ int FileClose( struct File *s, void *fp )
 		{
 			SpecialData *sd = ( SpecialData *)lfp->f_SpecialData;
 			
-#ifdef __ENABLE_MUTEX
-			pthread_mutex_lock( &hd->hd_Mutex );
-#endif
-			libssh2_sftp_close( sd->sd_FileHandle );
+			// session is used only by this file, no lock is needed
+			if( libssh2_sftp_close( sd->sd_FileHandle ) != 0 && sd->sd_Session != NULL )
+			{
+				sd->sd_Session->ss_Broken = ( libssh2_session_last_errno( sd->sd_Session->ss_Session ) != LIBSSH2_ERROR_SFTP_PROTOCOL );
+			}
 			
-#ifdef __ENABLE_MUTEX
-			pthread_mutex_unlock( &hd->hd_Mutex );
-#endif
+			SSH2SessionRelease( sd->sd_Device != NULL ? sd->sd_Device : (SpecialData *)s->f_SpecialData, sd->sd_Session );
 			
+			if( sd->sd_ReadBuffer != NULL )
+			{
+				FFree( sd->sd_ReadBuffer );
+			}
 			FFree( lfp->f_SpecialData );
 		}
 		
@@ -1198,34 +1446,53 @@ int FileRead( struct File *f, char *buffer, int rsize )
 	
 	if( sd != NULL )
 	{
-		FHandler *fh = NULL;
-		HandlerData *hd = NULL;
-		
-		fh = (FHandler *)f->f_FSys;
-		if( fh != NULL )
+		// libssh2 keeps read requests in flight for 4x size of passed buffer, small reads
+		// are served from big read-ahead buffer so large files are not limited by round trip time
+		if( sd->sd_ReadBuffer == NULL && rsize < SSH2_READ_AHEAD_SIZE )
 		{
-			hd = (HandlerData *)fh->fh_SpecialData;
+			sd->sd_ReadBuffer = FMalloc( SSH2_READ_AHEAD_SIZE );
+			sd->sd_ReadLen = sd->sd_ReadPos = 0;
 		}
 		
-#ifdef __ENABLE_MUTEX
-		if( hd != NULL )
+		if( sd->sd_ReadBuffer == NULL || rsize >= SSH2_READ_AHEAD_SIZE )
 		{
-			pthread_mutex_lock( &hd->hd_Mutex );
+			result = libssh2_sftp_read( sd->sd_FileHandle, buffer, rsize );
+		}
+		else
+		{
+			if( sd->sd_ReadPos >= sd->sd_ReadLen )
+			{
+				sd->sd_ReadPos = 0;
+				sd->sd_ReadLen = 0;
+				result = libssh2_sftp_read( sd->sd_FileHandle, sd->sd_ReadBuffer, SSH2_READ_AHEAD_SIZE );
+				if( result > 0 )
+				{
+					sd->sd_ReadLen = result;
+				}
+			}
+			
+			if( sd->sd_ReadPos < sd->sd_ReadLen )
+			{
+				result = sd->sd_ReadLen - sd->sd_ReadPos;
+				if( result > rsize )
+				{
+					result = rsize;
+				}
+				memcpy( buffer, sd->sd_ReadBuffer + sd->sd_ReadPos, result );
+				sd->sd_ReadPos += result;
+			}
 		}
-#endif
-		result = libssh2_sftp_read( sd->sd_FileHandle, buffer, rsize );
 		
-		if( f->f_Stream == TRUE && result > 0 )
+		if( result < 0 && sd->sd_Session != NULL && sd->sd_Session->ss_Session != NULL &&
+			libssh2_session_last_errno( sd->sd_Session->ss_Session ) != LIBSSH2_ERROR_SFTP_PROTOCOL )
 		{
-			f->f_Socket->s_Interface->SocketWrite( f->f_Socket, buffer, (FLONG)result );
+			sd->sd_Session->ss_Broken = TRUE;
 		}
 		
-#ifdef __ENABLE_MUTEX
-		if( hd != NULL )
+		if( f->f_Stream == TRUE && result > 0 )
 		{
-			pthread_mutex_unlock( &hd->hd_Mutex );
+			f->f_Socket->s_Interface->SocketWrite( f->f_Socket, buffer, (FLONG)result );
 		}
-#endif
 	}
 	DEBUG("FileRead %d\n", result );
 	if( result <= 0 )
@@ -1248,25 +1515,15 @@ int FileWrite( struct File *f, char *buffer, int wsize )
 	SpecialData *sd = (SpecialData *)f->f_SpecialData;
 	if( sd )
 	{
-		FHandler *fh = NULL;
-		HandlerData *hd = NULL;
-		fh = (FHandler *)f->f_FSys;
-		if( fh != NULL )
-		{
-			hd = (HandlerData *)fh->fh_SpecialData;
-		}
-		
-#ifdef __ENABLE_MUTEX
-		if( hd != NULL )
-		{
-			pthread_mutex_lock( &hd->hd_Mutex );
-		}
-#endif
 		do
 		{
 			int rc = libssh2_sftp_write( sd->sd_FileHandle, bufptr, wsize );
 			if( rc < 0 )
 			{
+				if( sd->sd_Session != NULL && libssh2_session_last_errno( sd->sd_Session->ss_Session ) != LIBSSH2_ERROR_SFTP_PROTOCOL )
+				{
+					sd->sd_Session->ss_Broken = TRUE;
+				}
 				break;
 			}
 			bufptr += rc;
@@ -1274,13 +1531,6 @@ int FileWrite( struct File *f, char *buffer, int wsize )
 			result += rc;
 		}
 		while( wsize );
-		
-#ifdef __ENABLE_MUTEX
-		if( hd != NULL )
-		{
-			pthread_mutex_unlock( &hd->hd_Mutex );
-		}
-#endif
 	}
 	DEBUG("FileWrite %d\n", result );
 	return result;
@@ -1290,15 +1540,18 @@ int FileWrite( struct File *f, char *buffer, int wsize )
 //
 //
 
-int FileSeek( struct File *s, int pos )
+int FileSeek( struct File *s, FQUAD pos )
 {
 	SpecialData *sd = (SpecialData *)s->f_SpecialData;
 	if( sd )
 	{
-		libssh2_sftp_seek( sd->sd_FileHandle, pos );
+		// only offset of handle is changed, no data is transferred
+		libssh2_sftp_seek64( sd->sd_FileHandle, (libssh2_uint64_t)pos );
+		sd->sd_ReadLen = sd->sd_ReadPos = 0;
+		DEBUG("Seek %lld\n", (long long)pos );
+		return 0;
 	}
-	DEBUG("Seek %d\n", pos );
-	return pos;
+	return -1;
 }
 
 //
@@ -1331,8 +1584,6 @@ int MakeDir( struct File *s, const char *path )
 		return -2;
 	}
 	SpecialData *sdat = (SpecialData *)s->f_SpecialData;
-	FHandler *fh = (FHandler *)s->f_FSys;
-	HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
 	
 	strcpy( newPath, s->f_Path );
 	if( s->f_Path[ rspath-1 ] != '/' )
@@ -1340,12 +1591,16 @@ int MakeDir( struct File *s, const char *path )
 		strcat( newPath, "/" );
 	}
 	
-#ifdef __ENABLE_MUTEX
-	pthread_mutex_lock( &hd->hd_Mutex );
-#endif
 	// Create a string that has the real file path of the file
 	if( path != NULL )
 	{
+		SSH2Session *ss = SSH2SessionGet( sdat );
+		if( ss == NULL )
+		{
+			FFree( newPath );
+			return -1;
+		}
+		
 		int dirLen = rspath + spath;
 		char *directory = FCalloc( dirLen, sizeof( char ) );
 		if( directory != NULL )
@@ -1370,11 +1625,10 @@ int MakeDir( struct File *s, const char *path )
 						
 						FERROR("PATH CREATED %s   NPATH %s   PATH %s\n", directory,  newPath, path );
 						
-						error = libssh2_sftp_mkdir( sdat->sftp_session, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
-						if( error != 0 )
+						error = libssh2_sftp_mkdir( ss->ss_SFTP, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
+						if( error != 0 && SSH2SessionRecover( sdat, ss ) == TRUE )
 						{
-							ServerReconnect( sdat, hd );
-							error = libssh2_sftp_mkdir( sdat->sftp_session, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
+							error = libssh2_sftp_mkdir( ss->ss_SFTP, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
 						}
 						
 						// Create if not exist!
@@ -1393,20 +1647,15 @@ int MakeDir( struct File *s, const char *path )
 			//struct stat filest;
 			
 			snprintf( directory, dirLen, "%s%s", newPath, path );
-			error = libssh2_sftp_mkdir( sdat->sftp_session, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
+			error = libssh2_sftp_mkdir( ss->ss_SFTP, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
 
 			FFree( directory );
 		}
-#ifdef __ENABLE_MUTEX
-		pthread_mutex_unlock( &hd->hd_Mutex );
-#endif
+		SSH2SessionRelease( sdat, ss );
 		
 		FFree( newPath );
 		return error;
 	}
-#ifdef __ENABLE_MUTEX
-	pthread_mutex_unlock( &hd->hd_Mutex );
-#endif
 	FFree( newPath );
 	
 	return -1;
@@ -1416,13 +1665,13 @@ int MakeDir( struct File *s, const char *path )
 // rm files/dirs
 //
 
-static FLONG RemoveDirectory( SpecialData *sdat, const char *path )
+static FLONG RemoveDirectory( LIBSSH2_SFTP *sftp, const char *path )
 {
 	LIBSSH2_SFTP_HANDLE *sftphandle;
 	FLONG r = 0;
 	
 	// Request a dir listing via SFTP 
-	sftphandle = libssh2_sftp_opendir( sdat->sftp_session, path );
+	sftphandle = libssh2_sftp_opendir( sftp, path );
 	int pathlen = strlen( path );
 	
 	if ( sftphandle != NULL )	// this is directory
@@ -1463,12 +1712,12 @@ static FLONG RemoveDirectory( SpecialData *sdat, const char *path )
 
 					if ( isDir == 1 )
 					{
-						r2 = RemoveDirectory( sdat, buf );
-						libssh2_sftp_rmdir( sdat->sftp_session, buf );
+						r2 = RemoveDirectory( sftp, buf );
+						libssh2_sftp_rmdir( sftp, buf );
 					}
 					else
 					{
-						r2 = libssh2_sftp_unlink( sdat->sftp_session, buf );
+						r2 = libssh2_sftp_unlink( sftp, buf );
 					}
 					FFree(buf);
 				}
@@ -1489,11 +1738,11 @@ static FLONG RemoveDirectory( SpecialData *sdat, const char *path )
 	
 		libssh2_sftp_closedir( sftphandle );
 		DEBUG("Will remove now : %s\n", path );
-		libssh2_sftp_rmdir( sdat->sftp_session, path );
+		libssh2_sftp_rmdir( sftp, path );
 	}
 	else
 	{
-		r = libssh2_sftp_unlink( sdat->sftp_session, path );
+		r = libssh2_sftp_unlink( sftp, path );
 	}
 	
 	return r;
@@ -1514,8 +1763,6 @@ FLONG Delete( struct File *s, const char *path )
 	int rspath = strlen( s->f_Path );
 	
 	SpecialData *sdat = (SpecialData *)s->f_SpecialData;
-	FHandler *fh = (FHandler *)s->f_FSys;
-	HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
 	
 	int i;
 	for( i = 0 ; i < spath ; i++ )
@@ -1549,13 +1796,13 @@ FLONG Delete( struct File *s, const char *path )
 		
 		DEBUG("Delete file or directory '%s'\n", comm );
 		
-#ifdef __ENABLE_MUTEX
-		pthread_mutex_lock( &hd->hd_Mutex );
-#endif
-		FLONG ret = RemoveDirectory( sdat, comm );
-#ifdef __ENABLE_MUTEX
-		pthread_mutex_unlock( &hd->hd_Mutex );
-#endif
+		FLONG ret = -1;
+		SSH2Session *ss = SSH2SessionGet( sdat );
+		if( ss != NULL )
+		{
+			ret = RemoveDirectory( ss->ss_SFTP, comm );
+			SSH2SessionRelease( sdat, ss );
+		}
 		
 		FFree( comm );
 		return ret;
@@ -1579,8 +1826,6 @@ int Rename( struct File *s, const char *path, const char *nname )
 	int spath = strlen( path );
 	int rspath = strlen( s->f_Path );
 	SpecialData *sdat = (SpecialData *)s->f_SpecialData;
-	FHandler *fh = (FHandler *)s->f_FSys;
-	HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
 	
 	int i;
 	for( i = 0 ; i < spath ; i++ )
@@ -1645,20 +1890,19 @@ int Rename( struct File *s, const char *path, const char *nname )
 		}
 	}
 	
-#ifdef __ENABLE_MUTEX
-	pthread_mutex_lock( &hd->hd_Mutex );
-#endif
 	// 4. Execute!
 	DEBUG( "executing: rename %s %s\n", source, dest );
-	int res = libssh2_sftp_rename( sdat->sftp_session, source, dest );// rename( source, dest );
-	if( res != 0 )
+	int res = -1;
+	SSH2Session *ss = SSH2SessionGet( sdat );
+	if( ss != NULL )
 	{
-		ServerReconnect( sdat, hd );
-		res = libssh2_sftp_rename( sdat->sftp_session, source, dest );
+		res = libssh2_sftp_rename( ss->ss_SFTP, source, dest );// rename( source, dest );
+		if( res != 0 && SSH2SessionRecover( sdat, ss ) == TRUE )
+		{
+			res = libssh2_sftp_rename( ss->ss_SFTP, source, dest );
+		}
+		SSH2SessionRelease( sdat, ss );
 	}
-#ifdef __ENABLE_MUTEX
-	pthread_mutex_unlock( &hd->hd_Mutex );
-#endif
 	
 	// 5. Free up
 	FFree( source );
@@ -1729,7 +1973,7 @@ FLONG GetChangeTimestamp( struct File *s, const char *path )
 	int rspath = strlen( s->f_Path );
 	SpecialData *sdat = (SpecialData *)s->f_SpecialData;
 	
-	if( sdat == NULL || sdat->sftp_session == NULL )
+	if( sdat == NULL )
 	{
 		return 0;
 	}
@@ -1742,9 +1986,6 @@ FLONG GetChangeTimestamp( struct File *s, const char *path )
 	
 	if( ( comm = FCalloc( rspath + spath + 512, sizeof(char) ) ) != NULL )
 	{
-		FHandler *fh = (FHandler *)s->f_FSys;
-		HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
-		
 		strcpy( comm, s->f_Path );
 		
 		if( comm[ strlen( comm ) -1 ] != '/' )
@@ -1757,18 +1998,17 @@ FLONG GetChangeTimestamp( struct File *s, const char *path )
 			strcat( comm, path );
 		}
 		
-#ifdef __ENABLE_MUTEX
-		DEBUG("info lock %p\n", &hd->hd_Mutex );
-		pthread_mutex_lock( &hd->hd_Mutex );
-#endif
-		
 		DEBUG("PATH created %s\n", comm );
 		
-		LIBSSH2_SFTP_HANDLE *handle = libssh2_sftp_open( sdat->sftp_session, comm, LIBSSH2_FXF_READ, 0 );
-		if( handle == NULL )
+		LIBSSH2_SFTP_HANDLE *handle = NULL;
+		SSH2Session *ss = SSH2SessionGet( sdat );
+		if( ss != NULL )
 		{
-			ServerReconnect( sdat, hd );
-			handle = libssh2_sftp_open( sdat->sftp_session, comm, LIBSSH2_FXF_READ, 0 );
+			handle = libssh2_sftp_open( ss->ss_SFTP, comm, LIBSSH2_FXF_READ, 0 );
+			if( handle == NULL && SSH2SessionRecover( sdat, ss ) == TRUE )
+			{
+				handle = libssh2_sftp_open( ss->ss_SFTP, comm, LIBSSH2_FXF_READ, 0 );
+			}
 		}
 		
 		if( handle != NULL )
@@ -1783,11 +2023,7 @@ FLONG GetChangeTimestamp( struct File *s, const char *path )
 			
 			libssh2_sftp_close_handle( handle );
 		}
-		
-#ifdef __ENABLE_MUTEX
-		pthread_mutex_unlock( &hd->hd_Mutex );
-		DEBUG("intfo SFTP unlock %p\n", &hd->hd_Mutex );
-#endif
+		SSH2SessionRelease( sdat, ss );
 		
 		FFree( comm );
 	}
@@ -1815,7 +2051,7 @@ BufString *Info( File *s, const char *path )
 	int rspath = strlen( s->f_Path );
 	SpecialData *sdat = (SpecialData *)s->f_SpecialData;
 	
-	if( sdat == NULL || sdat->sftp_session == NULL )
+	if( sdat == NULL )
 	{
 		BufStringAdd( bs, "fail<!--separate-->Could not open directory.");
 		
@@ -1849,21 +2085,17 @@ BufString *Info( File *s, const char *path )
 			strcat( comm, path );
 		}
 		
-		FHandler *fh = (FHandler *)s->f_FSys;
-		HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
-		
-#ifdef __ENABLE_MUTEX
-		DEBUG("info lock %p\n", &hd->hd_Mutex );
-		pthread_mutex_lock( &hd->hd_Mutex );
-#endif
-		
 		DEBUG("PATH created %s\n", comm );
 		
-		LIBSSH2_SFTP_HANDLE *handle = libssh2_sftp_open( sdat->sftp_session, comm, LIBSSH2_FXF_READ, 0 );
-		if( handle == NULL )
+		LIBSSH2_SFTP_HANDLE *handle = NULL;
+		SSH2Session *ss = SSH2SessionGet( sdat );
+		if( ss != NULL )
 		{
-			ServerReconnect( sdat, hd );
-			handle = libssh2_sftp_open( sdat->sftp_session, comm, LIBSSH2_FXF_READ, 0 );
+			handle = libssh2_sftp_open( ss->ss_SFTP, comm, LIBSSH2_FXF_READ, 0 );
+			if( handle == NULL && SSH2SessionRecover( sdat, ss ) == TRUE )
+			{
+				handle = libssh2_sftp_open( ss->ss_SFTP, comm, LIBSSH2_FXF_READ, 0 );
+			}
 		}
 		
 		DEBUG("info handle %p\n", handle );
@@ -1957,11 +2189,7 @@ BufString *Info( File *s, const char *path )
 			
 			libssh2_sftp_close_handle( handle );
 		}
-		
-#ifdef __ENABLE_MUTEX
-		pthread_mutex_unlock( &hd->hd_Mutex );
-		DEBUG("intfo SFTP unlock %p\n", &hd->hd_Mutex );
-#endif
+		SSH2SessionRelease( sdat, ss );
 		
 		FFree( comm );
 	}
@@ -2012,8 +2240,6 @@ BufString *Dir( File *s, const char *path )
 		LIBSSH2_SFTP_HANDLE *sftphandle = NULL;
 		
 		SpecialData *sd = (SpecialData *)s->f_SpecialData;
-		FHandler *fh = (FHandler *)s->f_FSys;
-		HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
 		SystemBase *sb = (SystemBase *)sd->sb;
 		int pos = 0;
 		
@@ -2035,50 +2261,27 @@ BufString *Dir( File *s, const char *path )
 			strcat( comm, "/" );
 		}
 		
-#ifdef __ENABLE_MUTEX
-		DEBUG("locking %p\n", &hd->hd_Mutex );
-		pthread_mutex_lock( &hd->hd_Mutex );
-#endif
-		
-		DEBUG("lock passed %p %p\n", sd, sd->sftp_session );
-		
-		if( sd != NULL && sd->sftp_session != NULL )
+		// listing is read with session taken from pool, other threads can use other sessions meanwhile
+		SSH2Session *ss = SSH2SessionGet( sd );
+		if( ss != NULL )
 		{
 			// Request a dir listing via SFTP 
-			sftphandle = libssh2_sftp_opendir( sd->sftp_session, comm );
-			if( sftphandle == NULL )
+			sftphandle = libssh2_sftp_opendir( ss->ss_SFTP, comm );
+			if( sftphandle == NULL && SSH2SessionRecover( sd, ss ) == TRUE )
 			{
-				ServerReconnect( sd, hd );
-				sftphandle = libssh2_sftp_opendir( sd->sftp_session, comm );
+				sftphandle = libssh2_sftp_opendir( ss->ss_SFTP, comm );
 			}
 			DEBUG("Dir opened\n");
-			
-			if ( sftphandle == NULL)
-			{
-				FERROR( "Unable to open dir with SFTP: %s\n", comm );
-				BufStringAdd( bs, "fail<!--separate-->Could not open directory.");
-				
-#ifdef __ENABLE_MUTEX
-				pthread_mutex_unlock( &hd->hd_Mutex );
-#endif
-				return bs;
-			}
-			else
-			{
-				
-			}
-			FERROR( "libssh2_sftp_opendir() is done, now receive listing!\n");
-#ifdef __ENABLE_MUTEX
-			pthread_mutex_unlock( &hd->hd_Mutex );
-#endif
 		}
-		else
+		
+		if( sftphandle == NULL )
 		{
+			FERROR( "Unable to open dir with SFTP: %s\n", comm );
 			BufStringAdd( bs, "fail<!--separate-->Could not open directory.");
 			
-#ifdef __ENABLE_MUTEX
-			pthread_mutex_unlock( &hd->hd_Mutex );
-#endif
+			SSH2SessionRelease( sd, ss );
+			FFree( comm );
+			FFree( tempString );
 			return bs;
 		}
 
@@ -2098,14 +2301,8 @@ BufString *Dir( File *s, const char *path )
 			
 			DEBUG("dir\n");
 			
-#ifdef __ENABLE_MUTEX
-			pthread_mutex_lock( &hd->hd_Mutex );
-#endif
 			// loop until we fail *
 			int rc = libssh2_sftp_readdir_ex( sftphandle, mem, sizeof(mem), longentry, sizeof(longentry), &attrs);
-#ifdef __ENABLE_MUTEX
-			pthread_mutex_unlock( &hd->hd_Mutex );
-#endif
 			if( rc > 0 )//&&  > 0 && strcmp( mem, ".." ) > 0 )
 			{
 				DEBUG("FILE/DIR >%s<\n", mem );
@@ -2235,13 +2432,8 @@ BufString *Dir( File *s, const char *path )
 			
 		}while (1);
 		
-#ifdef __ENABLE_MUTEX
-		pthread_mutex_lock( &hd->hd_Mutex );
-#endif
 		libssh2_sftp_closedir( sftphandle );
-#ifdef __ENABLE_MUTEX
-		pthread_mutex_unlock( &hd->hd_Mutex );
-#endif
+		SSH2SessionRelease( sd, ss );
 		
 		BufStringAdd( bs, "]" );
 		
@@ -19,6 +19,12 @@
 #include <system/log/user_logger.h>
 #include <system/systembase.h>
 #include <time.h>
+#include <sys/uio.h>
+#include <limits.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 
 typedef struct SpecialData
 {
@@ -169,11 +175,14 @@ void deinit( struct UserLogger *s )
 //
 //
 
+int StoreEntries( struct UserLogger *s, UserLog **entries, int count );
+
 int StoreInformation( struct UserLogger *s, UserSession *session, char *actions, char *information )
 {
-	SpecialData *sd = s->ul_SD;
-	
 	UserLog logEntry;
+	UserLog *entries[ 1 ];
+	
+	memset( &logEntry, 0, sizeof( UserLog ) );
 	logEntry.ul_CreatedTime = time( NULL );
 	logEntry.ul_Action = actions;
 	logEntry.ul_Information = information;
@@ -187,42 +196,125 @@ int StoreInformation( struct UserLogger *s, UserSession *session, char *actions,
 		logEntry.ul_UserID = 0;
 		logEntry.ul_UserSessionID = NULL;
 	}
-	struct tm *tm = localtime( &logEntry.ul_CreatedTime );
-	char datestring[ 64 ];
-	strftime( datestring, sizeof(datestring), "%c", tm );
+	entries[ 0 ] = &logEntry;
+	
+	return StoreEntries( s, entries, 1 );
+}
+
+//
+// store many entries by one writev call
+//
+
+int StoreEntries( struct UserLogger *s, UserLog **entries, int count )
+{
+	SpecialData *sd = s->ul_SD;
+	int i;
+	
+	if( sd == NULL || sd->sd_FP == NULL || count <= 0 )
+	{
+		return 1;
+	}
+	
+	struct iovec *iov = FCalloc( count, sizeof( struct iovec ) );
+	char **lines = FCalloc( count, sizeof( char *) );
+	if( iov == NULL || lines == NULL )
+	{
+		if( iov != NULL ) FFree( iov );
+		if( lines != NULL ) FFree( lines );
+		return 2;
+	}
+	
+	//
+	// prepare lines before lock is taken
+	//
+	
+	for( i=0 ; i < count ; i++ )
+	{
+		UserLog *le = entries[ i ];
+		struct tm tm;
+		char datestring[ 64 ];
+		
+		localtime_r( &(le->ul_CreatedTime), &tm );
+		strftime( datestring, sizeof(datestring), "%c", &tm );
+		
+		int size = 256 + ( le->ul_UserSessionID != NULL ? strlen( le->ul_UserSessionID ) : 0 ) + ( le->ul_Action != NULL ? strlen( le->ul_Action ) : 0 ) + ( le->ul_Information != NULL ? strlen( le->ul_Information ) : 0 );
+		char *line = FMalloc( size );
+		if( line != NULL )
+		{
+			int len = snprintf( line, size, "Date: %s, UserID: %lu, UserSessionID: %s, Action: %s, Information: %s\n",  datestring, le->ul_UserID, le->ul_UserSessionID, le->ul_Action, le->ul_Information );
+			lines[ i ] = line;
+			iov[ i ].iov_base = line;
+			iov[ i ].iov_len = len < size ? len : size - 1;
+		}
+	}
 	
 	time_t rawtime;
 	struct tm timeinfo;
 	rawtime = time(NULL);
 	localtime_r(&rawtime, &timeinfo);
-
-	// Get System Date 
-	sd->sd_Year = timeinfo.tm_year+1900;
-	sd->sd_Month = timeinfo.tm_mon+1;
+	
+	FRIEND_MUTEX_LOCK( &(sd->sd_Mutex) );
+	
+	// change file name every day
+	if( sd->sd_Day != timeinfo.tm_mday )
+	{
+		// Get System Date 
+		sd->sd_Year = timeinfo.tm_year+1900;
+		sd->sd_Month = timeinfo.tm_mon+1;
+		sd->sd_Day = timeinfo.tm_mday;
+		fclose( sd->sd_FP );
+		
+		snprintf( sd->sd_DstFilePath, sd->sd_DstFilePathLength, "%s%s-%d-%d-%d.log", sd->sd_FilePath, sd->sd_FileName, sd->sd_Year, sd->sd_Month, sd->sd_Day );
+		
+		sd->sd_FP = fopen( sd->sd_DstFilePath, "a" );
+	}
 	
 	if( sd->sd_FP != NULL )
 	{
-		FRIEND_MUTEX_LOCK( &(sd->sd_Mutex) );
-		// change file name every day
-		if( sd->sd_Day != timeinfo.tm_mday )
+		// file is opened in append mode, whole batch goes to file by few syscalls
+		int fd = fileno( sd->sd_FP );
+		int pos = 0;
+		while( pos < count )
 		{
-			sd->sd_Day = timeinfo.tm_mday;
-			fclose( sd->sd_FP );
-			
-			snprintf( sd->sd_DstFilePath, sd->sd_DstFilePathLength, "%s%s-%d-%d-%d.log", sd->sd_FilePath, sd->sd_FileName, sd->sd_Year, sd->sd_Month, sd->sd_Day );
+			int n = count - pos;
+			if( n > IOV_MAX )
+			{
+				n = IOV_MAX;
+			}
 			
-			sd->sd_FP = fopen( sd->sd_DstFilePath, "a" );
-			//char fileName[ 1024 ];
-			//snprintf( fileName, sizeof( fileName ), "%d-%d-%d-%s", sd->sd_Year, sd->sd_Month, sd->sd_Day, sd->sd_FileName );
+			ssize_t written = writev( fd, &(iov[ pos ]), n );
+			if( written <= 0 )
+			{
+				FERROR("[UserLoggerFile] Cannot write to log file: %s\n", sd->sd_DstFilePath );
+				break;
+			}
 			
-			//sd->sd_FP = fopen( fileName, "a" );
+			// skip entries which were written, partially written entry is moved
+			while( n > 0 && (size_t)written >= iov[ pos ].iov_len )
+			{
+				written -= iov[ pos ].iov_len;
+				pos++;
+				n--;
+			}
+			if( n > 0 && written > 0 )
+			{
+				iov[ pos ].iov_base = ((char *)iov[ pos ].iov_base) + written;
+				iov[ pos ].iov_len -= written;
+			}
 		}
-		
-		fprintf( sd->sd_FP, "Date: %s, UserID: %lu, UserSessionID: %s, Action: %s, Information: %s\n",  datestring, logEntry.ul_UserID, logEntry.ul_UserSessionID, actions, information );
-		
-		FRIEND_MUTEX_UNLOCK( &(sd->sd_Mutex) );
 	}
 	
+	FRIEND_MUTEX_UNLOCK( &(sd->sd_Mutex) );
+	
+	for( i=0 ; i < count ; i++ )
+	{
+		if( lines[ i ] != NULL )
+		{
+			FFree( lines[ i ] );
+		}
+	}
+	FFree( lines );
+	FFree( iov );
+	
 	return 0;
 }
-
@@ -18,6 +18,7 @@
 #include "user_logger_sql.h"
 #include <system/log/user_logger.h>
 #include <system/systembase.h>
+#include <util/buffered_string.h>
 
 typedef struct SpecialData
 {
@@ -153,3 +154,77 @@ int StoreInformation( struct UserLogger *s, UserSession *session, char *actions,
 	return 0;
 }
 
+//
+// add string value to multi-row INSERT, NULL is stored as NULL
+//
+
+static void StoreEntriesAddValue( SpecialData *sd, BufString *bs, char *val )
+{
+	if( val != NULL )
+	{
+		// every character can be escaped
+		int size = ( strlen( val ) << 1 ) + 8;
+		char *tmp = FMalloc( size );
+		if( tmp != NULL )
+		{
+			sd->sd_LibSQL->SNPrintF( sd->sd_LibSQL, tmp, size, "'%s'", val );
+			BufStringAdd( bs, tmp );
+			FFree( tmp );
+			return;
+		}
+	}
+	BufStringAddSize( bs, "NULL", 4 );
+}
+
+//
+// store many entries by one multi-row INSERT
+//
+
+int StoreEntries( struct UserLogger *s, UserLog **entries, int count )
+{
+	SpecialData *sd = s->ul_SD;
+	int i, rows = 0;
+	
+	if( sd == NULL || sd->sd_LibSQL == NULL || count <= 0 )
+	{
+		return 1;
+	}
+	
+	BufString *bs = BufStringNew();
+	if( bs == NULL )
+	{
+		return 2;
+	}
+	
+	BufStringAdd( bs, "INSERT INTO `FUserLog` (`UsersessiondID`,`UserID`,`Action`,`Information`,`CreatedTime`) VALUES " );
+	
+	FRIEND_MUTEX_LOCK( &(sd->sd_Mutex) );
+	
+	for( i=0 ; i < count ; i++ )
+	{
+		UserLog *le = entries[ i ];
+		char temp[ 64 ];
+		
+		BufStringAdd( bs, rows == 0 ? "(" : ",(" );
+		StoreEntriesAddValue( sd, bs, le->ul_UserSessionID );
+		snprintf( temp, sizeof( temp ), ",%lu,", le->ul_UserID );
+		BufStringAdd( bs, temp );
+		StoreEntriesAddValue( sd, bs, le->ul_Action );
+		BufStringAddSize( bs, ",", 1 );
+		StoreEntriesAddValue( sd, bs, le->ul_Information );
+		snprintf( temp, sizeof( temp ), ",%lld)", (long long)le->ul_CreatedTime );
+		BufStringAdd( bs, temp );
+		rows++;
+	}
+	
+	if( rows > 0 )
+	{
+		sd->sd_LibSQL->QueryWithoutResults( sd->sd_LibSQL, bs->bs_Buffer );
+	}
+	
+	FRIEND_MUTEX_UNLOCK( &(sd->sd_Mutex) );
+	
+	BufStringDelete( bs );
+	
+	return 0;
+}
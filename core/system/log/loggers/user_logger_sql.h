@@ -54,6 +54,7 @@ typedef struct UserLoggerSQL
 	void                    (*deinit)( struct UserLogger *s );
 
 	int                     (*StoreInformation)( struct UserLogger *s, UserSession *session, char *actions, char *information );
+	int                     (*StoreEntries)( struct UserLogger *s, UserLog **entries, int count );
 	
 	void                   *ul_SD;  // special data
 	void                   *ul_SB; // system base
@@ -27,6 +27,208 @@
 #include <dirent.h>
 #include <system/systembase.h>
 
+//
+// Queue
+//
+// Bounded MPSC ring (sequence numbers per slot). Request threads reserve position by CAS on
+// ulm_QueueHead, ulm_Mutex is taken only to wake up drainer. Only drainer thread takes entries,
+// so ulm_QueueTail is not shared.
+//
+
+/**
+ * Put entry into queue
+ *
+ * @param ulm pointer to UserLoggerManager
+ * @param entry entry which will be stored
+ * @return TRUE when entry was added, FALSE when queue is full
+ */
+static FBOOL UserLoggerQueuePush( UserLoggerManager *ulm, UserLog *entry )
+{
+	FULONG mask = ulm->ulm_QueueSize - 1;
+	FULONG pos = ulm->ulm_QueueHead;
+	UserLoggerSlot *slot;
+	
+	while( TRUE )
+	{
+		slot = &(ulm->ulm_Queue[ pos & mask ]);
+		FULONG seq = slot->uls_Sequence;
+		__sync_synchronize();
+		long diff = (long)seq - (long)pos;
+		
+		if( diff == 0 )
+		{
+			if( __sync_bool_compare_and_swap( &(ulm->ulm_QueueHead), pos, pos + 1 ) )
+			{
+				break;
+			}
+		}
+		else if( diff < 0 )
+		{
+			return FALSE;
+		}
+		pos = ulm->ulm_QueueHead;
+	}
+	
+	slot->uls_Entry = entry;
+	__sync_synchronize();
+	slot->uls_Sequence = pos + 1;
+	
+	// wake up drainer when batch is ready, otherwise it will take entries after ulm_FlushInterval
+	if( ( ( pos + 1 ) % ulm->ulm_BatchSize ) == 0 )
+	{
+		pthread_mutex_lock( &(ulm->ulm_Mutex) );
+		pthread_cond_signal( &(ulm->ulm_Cond) );
+		pthread_mutex_unlock( &(ulm->ulm_Mutex) );
+	}
+	return TRUE;
+}
+
+/**
+ * Take entry from queue (drainer only)
+ *
+ * @param ulm pointer to UserLoggerManager
+ * @return entry or NULL when queue is empty
+ */
+static UserLog *UserLoggerQueuePop( UserLoggerManager *ulm )
+{
+	FULONG mask = ulm->ulm_QueueSize - 1;
+	FULONG pos = ulm->ulm_QueueTail;
+	UserLoggerSlot *slot = &(ulm->ulm_Queue[ pos & mask ]);
+	
+	FULONG seq = slot->uls_Sequence;
+	__sync_synchronize();
+	if( (long)seq - (long)( pos + 1 ) < 0 )
+	{
+		return NULL;
+	}
+	
+	UserLog *entry = slot->uls_Entry;
+	slot->uls_Entry = NULL;
+	__sync_synchronize();
+	slot->uls_Sequence = pos + mask + 1;
+	ulm->ulm_QueueTail = pos + 1;
+	
+	return entry;
+}
+
+/**
+ * Pass entries to active logger
+ *
+ * @param ulm pointer to UserLoggerManager
+ * @param entries array of entries
+ * @param count number of entries
+ */
+static void UserLoggerManagerWrite( UserLoggerManager *ulm, UserLog **entries, int count )
+{
+	UserLogger *logger = ulm->ulm_ActiveLogger;
+	int i;
+	
+	if( logger->StoreEntries != NULL )
+	{
+		logger->StoreEntries( logger, entries, count );
+	}
+	else if( logger->StoreInformation != NULL )
+	{
+		// old loggers take information from session, only user id and session id are used
+		UserSession ses;
+		for( i=0 ; i < count ; i++ )
+		{
+			memset( &ses, 0, sizeof( UserSession ) );
+			ses.us_UserID = entries[ i ]->ul_UserID;
+			ses.us_SessionID = entries[ i ]->ul_UserSessionID;
+			logger->StoreInformation( logger, &ses, entries[ i ]->ul_Action, entries[ i ]->ul_Information );
+		}
+	}
+	
+	for( i=0 ; i < count ; i++ )
+	{
+		FFree( entries[ i ] );
+	}
+	__sync_fetch_and_add( &(ulm->ulm_Stored), count );
+}
+
+/**
+ * Drainer thread, takes entries from queue and stores them in batches
+ *
+ * @param ptr pointer to FThread
+ * @return NULL
+ */
+static void *UserLoggerManagerDrainer( void *ptr )
+{
+	FThread *th = (FThread *)ptr;
+	UserLoggerManager *ulm = (UserLoggerManager *)th->t_Data;
+	UserLog **entries = FCalloc( ulm->ulm_BatchSize, sizeof( UserLog *) );
+	
+	if( entries == NULL )
+	{
+		FERROR("[UserLoggerManagerDrainer] Cannot allocate memory for entries\n");
+		th->t_Launched = FALSE;
+		return NULL;
+	}
+	
+	while( TRUE )
+	{
+		int count = 0;
+		UserLog *entry;
+		
+		while( count < ulm->ulm_BatchSize && ( entry = UserLoggerQueuePop( ulm ) ) != NULL )
+		{
+			entries[ count++ ] = entry;
+		}
+		
+		if( count > 0 )
+		{
+			if( th->t_Quit == TRUE && ulm->ulm_FlushOnShutdown == FALSE )
+			{
+				int i;
+				for( i=0 ; i < count ; i++ )
+				{
+					FFree( entries[ i ] );
+				}
+				__sync_fetch_and_add( &(ulm->ulm_Dropped), count );
+			}
+			else
+			{
+				UserLoggerManagerWrite( ulm, entries, count );
+			}
+			
+			if( count == ulm->ulm_BatchSize )
+			{
+				continue;
+			}
+		}
+		
+		// queue is empty
+		if( th->t_Quit == TRUE )
+		{
+			break;
+		}
+		
+		struct timespec ts;
+		clock_gettime( CLOCK_REALTIME, &ts );
+		ts.tv_sec += ulm->ulm_FlushInterval / 1000;
+		ts.tv_nsec += ( ulm->ulm_FlushInterval % 1000 ) * 1000000;
+		if( ts.tv_nsec >= 1000000000 )
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		
+		// batch could be completed after queue was checked, its signal was sent before this thread waits
+		pthread_mutex_lock( &(ulm->ulm_Mutex) );
+		if( th->t_Quit == FALSE && ( ulm->ulm_QueueHead - ulm->ulm_QueueTail ) < (FULONG)ulm->ulm_BatchSize )
+		{
+			pthread_cond_timedwait( &(ulm->ulm_Cond), &(ulm->ulm_Mutex), &ts );
+		}
+		pthread_mutex_unlock( &(ulm->ulm_Mutex) );
+	}
+	
+	FFree( entries );
+	th->t_Launched = FALSE;
+	
+	return NULL;
+}
+
 /**
  * Create new UserLoggerManager
  *
@@ -49,6 +251,12 @@ UserLoggerManager *UserLoggerManagerNew( void *sb )
 		struct PropertiesInterface *plib = NULL;
 		char *actLogger = NULL;
 		Props *prop = NULL;
+		int queueSize = USER_LOGGER_QUEUE_SIZE;
+		
+		ulm->ulm_BatchSize = USER_LOGGER_BATCH_SIZE;
+		ulm->ulm_FlushInterval = USER_LOGGER_FLUSH_INTERVAL;
+		ulm->ulm_FlushOnShutdown = TRUE;
+		ulm->ulm_Overflow = USER_LOGGER_OVERFLOW_DROP;
 		
 		plib = &( locsb->sl_PropertiesInterface );
 		{
@@ -61,6 +269,16 @@ UserLoggerManager *UserLoggerManagerNew( void *sb )
 				DEBUG("reading actLogger\n");
 				actLogger = plib->ReadStringNCS( prop, "Logger:active", NULL );
 				DEBUG("actLogger %s\n", actLogger );
+				
+				queueSize = plib->ReadIntNCS( prop, "Logger:queuesize", USER_LOGGER_QUEUE_SIZE );
+				ulm->ulm_BatchSize = plib->ReadIntNCS( prop, "Logger:batchsize", USER_LOGGER_BATCH_SIZE );
+				ulm->ulm_FlushInterval = plib->ReadIntNCS( prop, "Logger:flushinterval", USER_LOGGER_FLUSH_INTERVAL );
+				ulm->ulm_FlushOnShutdown = plib->ReadIntNCS( prop, "Logger:flushonshutdown", 1 );
+				char *overflow = plib->ReadStringNCS( prop, "Logger:overflow", "drop" );
+				if( overflow != NULL && strcmp( overflow, "block" ) == 0 )
+				{
+					ulm->ulm_Overflow = USER_LOGGER_OVERFLOW_BLOCK;
+				}
 			}
 
 			// read directory and load loggers
@@ -113,6 +331,53 @@ UserLoggerManager *UserLoggerManagerNew( void *sb )
 		
 			plib->Close( prop );
 		}
+		
+		//
+		// entries are stored by drainer thread
+		//
+		
+		if( ulm->ulm_ActiveLogger != NULL )
+		{
+			if( ulm->ulm_BatchSize < 1 )
+			{
+				ulm->ulm_BatchSize = 1;
+			}
+			if( ulm->ulm_FlushInterval < 1 )
+			{
+				ulm->ulm_FlushInterval = 1;
+			}
+			
+			// size of queue must be power of 2
+			ulm->ulm_QueueSize = 16;
+			while( ulm->ulm_QueueSize < (FULONG)queueSize )
+			{
+				ulm->ulm_QueueSize <<= 1;
+			}
+			
+			if( ( ulm->ulm_Queue = FCalloc( ulm->ulm_QueueSize, sizeof( UserLoggerSlot ) ) ) != NULL )
+			{
+				FULONG i;
+				for( i=0 ; i < ulm->ulm_QueueSize ; i++ )
+				{
+					ulm->ulm_Queue[ i ].uls_Sequence = i;
+				}
+				
+				pthread_mutex_init( &(ulm->ulm_Mutex), NULL );
+				pthread_cond_init( &(ulm->ulm_Cond), NULL );
+				
+				ulm->ulm_Thread = ThreadNew( UserLoggerManagerDrainer, ulm, TRUE, NULL );
+			}
+			
+			if( ulm->ulm_Thread == NULL )
+			{
+				FERROR("[UserLoggerManagerNew] Cannot start logger thread, entries will not be stored\n");
+				ulm->ulm_ActiveLogger = NULL;
+			}
+			else
+			{
+				Log( FLOG_INFO, "[UserLoggerManagerNew] Logger %s, queue %lu, batch %d, overflow %s\n", ulm->ulm_ActiveLogger->Name, ulm->ulm_QueueSize, ulm->ulm_BatchSize, ulm->ulm_Overflow == USER_LOGGER_OVERFLOW_BLOCK ? "block" : "drop" );
+			}
+		}
 	}
 	
 	return ulm;
@@ -128,6 +393,27 @@ void UserLoggerManagerDelete( UserLoggerManager *ulm )
 	DEBUG("UserLoggerManagerDelete\n");
 	if( ulm != NULL )
 	{
+		if( ulm->ulm_Thread != NULL )
+		{
+			// drainer stores or drops rest of entries before it quits
+			ulm->ulm_Thread->t_Quit = TRUE;
+			pthread_mutex_lock( &(ulm->ulm_Mutex) );
+			pthread_cond_signal( &(ulm->ulm_Cond) );
+			pthread_mutex_unlock( &(ulm->ulm_Mutex) );
+			
+			ThreadDelete( ulm->ulm_Thread );
+			ulm->ulm_Thread = NULL;
+			
+			pthread_cond_destroy( &(ulm->ulm_Cond) );
+			pthread_mutex_destroy( &(ulm->ulm_Mutex) );
+		}
+		
+		if( ulm->ulm_Queue != NULL )
+		{
+			Log( FLOG_INFO, "[UserLoggerManagerDelete] Entries stored: %lu dropped: %lu\n", ulm->ulm_Stored, ulm->ulm_Dropped );
+			FFree( ulm->ulm_Queue );
+		}
+		
 		UserLogger *ul = ulm->ulm_Loggers;
 		UserLogger *dl = ul;
 		
@@ -142,3 +428,71 @@ void UserLoggerManagerDelete( UserLoggerManager *ulm )
 		FFree( ulm );
 	}
 }
+/**
+ * Add entry to logger queue. Function do not wait for logger, entry is stored by drainer thread.
+ *
+ * @param ulm pointer to UserLoggerManager
+ * @param ses pointer to UserSession
+ * @param path action (request path)
+ * @param information additional information
+ * @return 0 when success, otherwise error number
+ */
+int UserLoggerManagerAdd( UserLoggerManager *ulm, UserSession *ses, char *path, char *information )
+{
+	if( ulm->ulm_Queue == NULL || ulm->ulm_Thread == NULL )
+	{
+		return 1;
+	}
+	
+	int sidLen = ses->us_SessionID != NULL ? strlen( ses->us_SessionID ) + 1 : 0;
+	int pathLen = path != NULL ? strlen( path ) + 1 : 0;
+	int infoLen = information != NULL ? strlen( information ) + 1 : 0;
+	
+	// entry and strings are allocated in one block, drainer releases it by one FFree
+	UserLog *entry = FMalloc( sizeof( UserLog ) + sidLen + pathLen + infoLen );
+	if( entry == NULL )
+	{
+		__sync_fetch_and_add( &(ulm->ulm_Dropped), 1 );
+		return 2;
+	}
+	
+	char *data = (char *)( entry + 1 );
+	memset( entry, 0, sizeof( UserLog ) );
+	entry->ul_UserID = ses->us_UserID;
+	entry->ul_CreatedTime = time( NULL );
+	if( sidLen > 0 )
+	{
+		entry->ul_UserSessionID = memcpy( data, ses->us_SessionID, sidLen );
+		data += sidLen;
+	}
+	if( pathLen > 0 )
+	{
+		entry->ul_Action = memcpy( data, path, pathLen );
+		data += pathLen;
+	}
+	if( infoLen > 0 )
+	{
+		entry->ul_Information = memcpy( data, information, infoLen );
+	}
+	
+	while( UserLoggerQueuePush( ulm, entry ) == FALSE )
+	{
+		if( ulm->ulm_Overflow == USER_LOGGER_OVERFLOW_DROP || ulm->ulm_Thread->t_Quit == TRUE )
+		{
+			FFree( entry );
+			FULONG dropped = __sync_add_and_fetch( &(ulm->ulm_Dropped), 1 );
+			if( ( dropped % 1000 ) == 1 )
+			{
+				Log( FLOG_ERROR, "[UserLoggerManagerAdd] Logger queue is full, entries dropped: %lu\n", dropped );
+			}
+			return 3;
+		}
+		pthread_mutex_lock( &(ulm->ulm_Mutex) );
+		pthread_cond_signal( &(ulm->ulm_Cond) );
+		pthread_mutex_unlock( &(ulm->ulm_Mutex) );
+		usleep( 100 );
+	}
+	
+	return 0;
+}
+
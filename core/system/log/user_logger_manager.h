@@ -24,6 +24,39 @@
 #include "user_logger.h"
 #include <util/log/log.h>
 
+#include <core/thread.h>
+
+#ifndef USER_LOGGER_QUEUE_SIZE
+#define USER_LOGGER_QUEUE_SIZE 4096		// number of entries waiting for drainer, must be power of 2
+#endif
+
+#ifndef USER_LOGGER_BATCH_SIZE
+#define USER_LOGGER_BATCH_SIZE 128		// maximum number of entries stored by one logger call
+#endif
+
+#ifndef USER_LOGGER_FLUSH_INTERVAL
+#define USER_LOGGER_FLUSH_INTERVAL 200	// how long drainer waits for new entries (ms)
+#endif
+
+//
+// what happens when queue is full
+//
+
+enum {
+	USER_LOGGER_OVERFLOW_DROP = 0,		// entry is dropped and counted
+	USER_LOGGER_OVERFLOW_BLOCK			// caller waits till drainer makes space
+};
+
+//
+// queue slot, sequence tells if slot is free or contains entry
+//
+
+typedef struct UserLoggerSlot
+{
+	volatile FULONG			uls_Sequence;
+	UserLog					*uls_Entry;
+}UserLoggerSlot;
+
 //
 // definition
 //
@@ -33,6 +66,22 @@ typedef struct UserLoggerManager
 	void                         *ulm_SB; // pointer to SystemBase
 	UserLogger             *ulm_Loggers;
 	UserLogger             *ulm_ActiveLogger;
+	
+	// entries are put into bounded ring by request threads (no locks) and taken by one drainer thread
+	UserLoggerSlot			*ulm_Queue;
+	FULONG					ulm_QueueSize;			// number of slots (power of 2)
+	volatile FULONG			ulm_QueueHead;			// position of next entry put by producers
+	FULONG					ulm_QueueTail;			// position of next entry taken by drainer
+	int						ulm_Overflow;			// USER_LOGGER_OVERFLOW_DROP or USER_LOGGER_OVERFLOW_BLOCK
+	int						ulm_BatchSize;			// maximum number of entries stored at once
+	int						ulm_FlushInterval;		// drainer wait time (ms)
+	FBOOL					ulm_FlushOnShutdown;	// store all queued entries when FC is closed
+	volatile FULONG			ulm_Stored;				// number of entries passed to logger
+	volatile FULONG			ulm_Dropped;			// number of entries dropped because queue was full
+	
+	FThread					*ulm_Thread;			// drainer
+	pthread_mutex_t			ulm_Mutex;				// used only to wait for new entries
+	pthread_cond_t			ulm_Cond;
 }UserLoggerManager;
 
 //
@@ -51,12 +100,18 @@ void UserLoggerManagerDelete( UserLoggerManager *ulm );
 //
 //
 
+int UserLoggerManagerAdd( UserLoggerManager *ulm, UserSession *ses, char *path, char *information );
+
+//
+//
+//
+
 static inline void UserLoggerStore( UserLoggerManager *ulm, UserSession *ses, char *path, char *information )
 {
 	DEBUG("SESSION %p\n", ses );
 	if( ulm->ulm_ActiveLogger != NULL && ses != NULL )
 	{
-		ulm->ulm_ActiveLogger->StoreInformation( ulm->ulm_ActiveLogger, ses, path, information );
+		UserLoggerManagerAdd( ulm, ses, path, information );
 	}
 }
 
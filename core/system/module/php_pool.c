@@ -0,0 +1,1171 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ *  PHP runner, pool of long-lived PHP processes
+ *
+ *  Every php call used to fork/exec new interpreter which costs more than
+ *  script itself. Pool keeps connections to php-fpm (FastCGI) or persistent
+ *  worker processes and passes script name and arguments to them.
+ *
+ *  Arguments are always sent as list of strings "<length>\n<data>", php side
+ *  (php/fcgi_argv.php or php/worker.php) recreates $argv from them, so scripts
+ *  work in the same way as when they are launched from command line.
+ */
+
+#include "php_pool.h"
+#include <core/types.h>
+#include <system/systembase.h>
+#include <util/log/log.h>
+#include <util/string.h>
+#include <util/buffered_string.h>
+#include <util/newpopen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+//
+// FastCGI protocol
+//
+
+#define FCGI_VERSION_1			1
+#define FCGI_BEGIN_REQUEST		1
+#define FCGI_END_REQUEST		3
+#define FCGI_PARAMS				4
+#define FCGI_STDIN				5
+#define FCGI_STDOUT				6
+#define FCGI_STDERR				7
+#define FCGI_RESPONDER			1
+#define FCGI_KEEP_CONN			1
+#define FCGI_REQUEST_ID			1		// one request at time on connection
+#define FCGI_MAX_RECORD			65535
+#define FCGI_MAX_HEADERS		8192
+
+/**
+ * Write whole buffer to worker socket
+ *
+ * @param fd socket
+ * @param data pointer to data
+ * @param size size of data
+ * @return 0 when success, otherwise -1
+ */
+static int PHPPoolWriteAll( int fd, const char *data, FQUAD size )
+{
+	while( size > 0 )
+	{
+		ssize_t wrote = send( fd, data, size, MSG_NOSIGNAL );
+		if( wrote < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+			return -1;
+		}
+		data += wrote;
+		size -= wrote;
+	}
+	return 0;
+}
+
+/**
+ * Read exact number of bytes from worker socket
+ *
+ * @param pp pointer to PHPPool
+ * @param fd socket
+ * @param data pointer to buffer
+ * @param size number of bytes to read
+ * @return 0 when success, otherwise -1 (timeout, connection closed)
+ */
+static int PHPPoolReadAll( PHPPool *pp, int fd, char *data, int size )
+{
+	struct pollfd fds;
+	fds.fd = fd;
+	fds.events = POLLIN;
+
+	while( size > 0 )
+	{
+		int ret = poll( &fds, 1, pp->pp_Timeout * 1000 );
+		if( ret < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		if( ret <= 0 )
+		{
+			FERROR("[PHPPoolReadAll] Timeout or error while waiting for php output\n");
+			return -1;
+		}
+
+		ssize_t rd = recv( fd, data, size, 0 );
+		if( rd < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		if( rd <= 0 )
+		{
+			return -1;
+		}
+		data += rd;
+		size -= rd;
+	}
+	return 0;
+}
+
+/**
+ * Add strings in form "<length>\n<data>" to buffer
+ *
+ * @param bs pointer to BufString
+ * @param strings table of strings
+ * @param count number of strings
+ */
+static void PHPPoolEncodeStrings( BufString *bs, char **strings, int count )
+{
+	int i;
+	char len[ 32 ];
+
+	for( i = 0 ; i < count ; i++ )
+	{
+		int size = strings[ i ] != NULL ? strlen( strings[ i ] ) : 0;
+		int lenSize = snprintf( len, sizeof(len), "%d\n", size );
+		BufStringAddSize( bs, len, lenSize );
+		if( size > 0 )
+		{
+			BufStringAddSize( bs, strings[ i ], size );
+		}
+	}
+}
+
+/**
+ * Connect to php-fpm
+ *
+ * @param pp pointer to PHPPool
+ * @return socket or -1 when error appear
+ */
+static int PHPPoolConnectFPM( PHPPool *pp )
+{
+	int fd = -1;
+
+	if( pp->pp_FPMAddress[ 0 ] == '/' )
+	{
+		struct sockaddr_un addr;
+		memset( &addr, 0, sizeof(addr) );
+		addr.sun_family = AF_UNIX;
+		strncpy( addr.sun_path, pp->pp_FPMAddress, sizeof(addr.sun_path) - 1 );
+
+		if( ( fd = socket( AF_UNIX, SOCK_STREAM, 0 ) ) < 0 )
+		{
+			return -1;
+		}
+		if( connect( fd, (struct sockaddr *)&addr, sizeof(addr) ) != 0 )
+		{
+			close( fd );
+			return -1;
+		}
+	}
+	else
+	{
+		char host[ 256 ];
+		char *port = strrchr( pp->pp_FPMAddress, ':' );
+		if( port == NULL || ( port - pp->pp_FPMAddress ) >= (int)sizeof(host) )
+		{
+			FERROR("[PHPPoolConnectFPM] Wrong php-fpm address: %s\n", pp->pp_FPMAddress );
+			return -1;
+		}
+		memcpy( host, pp->pp_FPMAddress, port - pp->pp_FPMAddress );
+		host[ port - pp->pp_FPMAddress ] = 0;
+
+		struct addrinfo hints, *res = NULL, *ai;
+		memset( &hints, 0, sizeof(hints) );
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+
+		if( getaddrinfo( host, port + 1, &hints, &res ) != 0 )
+		{
+			return -1;
+		}
+		for( ai = res ; ai != NULL ; ai = ai->ai_next )
+		{
+			if( ( fd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol ) ) < 0 )
+			{
+				continue;
+			}
+			if( connect( fd, ai->ai_addr, ai->ai_addrlen ) == 0 )
+			{
+				break;
+			}
+			close( fd );
+			fd = -1;
+		}
+		freeaddrinfo( res );
+	}
+	return fd;
+}
+
+/**
+ * Launch persistent worker process
+ *
+ * @param pp pointer to PHPPool
+ * @param pw pointer to PHPWorker which will be filled
+ * @return 0 when success, otherwise -1
+ */
+static int PHPPoolSpawnWorker( PHPPool *pp, PHPWorker *pw )
+{
+	int sv[ 2 ];
+
+	if( socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) != 0 )
+	{
+		return -1;
+	}
+
+	pid_t pid = fork();
+	if( pid == 0 )
+	{
+		// own process group, whole group is killed when request times out
+		setpgid( 0, 0 );
+
+		dup2( sv[ 1 ], STDIN_FILENO );
+		dup2( sv[ 1 ], STDOUT_FILENO );
+		close( sv[ 0 ] );
+		close( sv[ 1 ] );
+
+		execlp( "php", "php", pp->pp_WorkerScript, (char *)NULL );
+		_exit( 127 );
+	}
+
+	close( sv[ 1 ] );
+	if( pid < 0 )
+	{
+		close( sv[ 0 ] );
+		return -1;
+	}
+	setpgid( pid, pid );
+
+	pw->pw_FD = sv[ 0 ];
+	pw->pw_PID = pid;
+	return 0;
+}
+
+/**
+ * Close connection or stop worker process
+ *
+ * @param pw pointer to PHPWorker
+ */
+static void PHPWorkerDelete( PHPWorker *pw )
+{
+	if( pw->pw_FD >= 0 )
+	{
+		close( pw->pw_FD );		// idle worker quits when its input is closed
+	}
+	if( pw->pw_PID > 0 )
+	{
+		if( pw->pw_Broken == TRUE )
+		{
+			kill( -pw->pw_PID, SIGKILL );
+		}
+		waitpid( pw->pw_PID, NULL, 0 );
+	}
+	FFree( pw );
+}
+
+/**
+ * Take idle worker or create new one when pool is not full
+ *
+ * @param pp pointer to PHPPool
+ * @return pointer to PHPWorker or NULL when worker is not available
+ */
+static PHPWorker *PHPPoolAcquire( PHPPool *pp )
+{
+	PHPWorker *pw = NULL;
+	FBOOL create = FALSE;
+
+	if( FRIEND_MUTEX_LOCK( &(pp->pp_Mutex) ) == 0 )
+	{
+		struct timespec deadline;
+		clock_gettime( CLOCK_REALTIME, &deadline );
+		deadline.tv_sec += pp->pp_Timeout;
+
+		while( pp->pp_Quit == FALSE && pp->pp_Idle == NULL && pp->pp_Count >= pp->pp_Size )
+		{
+			if( pthread_cond_timedwait( &(pp->pp_Cond), &(pp->pp_Mutex), &deadline ) == ETIMEDOUT )
+			{
+				break;
+			}
+		}
+
+		if( pp->pp_Quit == FALSE )
+		{
+			if( pp->pp_Idle != NULL )
+			{
+				pw = pp->pp_Idle;
+				pp->pp_Idle = (PHPWorker *)pw->node.mln_Succ;
+				pw->node.mln_Succ = NULL;
+			}
+			else if( pp->pp_Count < pp->pp_Size )
+			{
+				pp->pp_Count++;
+				create = TRUE;
+			}
+		}
+		FRIEND_MUTEX_UNLOCK( &(pp->pp_Mutex) );
+	}
+
+	if( create == TRUE )
+	{
+		int err = -1;
+
+		if( ( pw = FCalloc( 1, sizeof(PHPWorker) ) ) != NULL )
+		{
+			pw->pw_FD = -1;
+			if( pp->pp_Runner == PHP_POOL_RUNNER_FASTCGI )
+			{
+				if( ( pw->pw_FD = PHPPoolConnectFPM( pp ) ) >= 0 )
+				{
+					err = 0;
+				}
+			}
+			else
+			{
+				err = PHPPoolSpawnWorker( pp, pw );
+			}
+		}
+
+		if( err != 0 )
+		{
+			FERROR("[PHPPoolAcquire] Cannot create php worker: %s\n", strerror( errno ) );
+			if( pw != NULL )
+			{
+				PHPWorkerDelete( pw );
+				pw = NULL;
+			}
+			if( FRIEND_MUTEX_LOCK( &(pp->pp_Mutex) ) == 0 )
+			{
+				pp->pp_Count--;
+				pthread_cond_signal( &(pp->pp_Cond) );
+				FRIEND_MUTEX_UNLOCK( &(pp->pp_Mutex) );
+			}
+		}
+		else
+		{
+			struct timeval tv;
+			tv.tv_sec = pp->pp_Timeout;
+			tv.tv_usec = 0;
+			setsockopt( pw->pw_FD, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv) );
+		}
+	}
+	return pw;
+}
+
+/**
+ * Return worker to pool. Broken and worn out workers are removed.
+ *
+ * @param pp pointer to PHPPool
+ * @param pw pointer to PHPWorker
+ */
+static void PHPPoolRelease( PHPPool *pp, PHPWorker *pw )
+{
+	pw->pw_Requests++;
+
+	FBOOL remove = ( pw->pw_Broken == TRUE || pp->pp_Quit == TRUE || ( pp->pp_MaxRequests > 0 && pw->pw_Requests >= pp->pp_MaxRequests ) );
+
+	if( FRIEND_MUTEX_LOCK( &(pp->pp_Mutex) ) == 0 )
+	{
+		pp->pp_Requests++;
+		if( remove == TRUE )
+		{
+			pp->pp_Count--;
+			if( pw->pw_Broken == FALSE )
+			{
+				pp->pp_Recycled++;
+			}
+		}
+		else
+		{
+			pw->node.mln_Succ = (MinNode *)pp->pp_Idle;
+			pp->pp_Idle = pw;
+		}
+		pthread_cond_signal( &(pp->pp_Cond) );
+		FRIEND_MUTEX_UNLOCK( &(pp->pp_Mutex) );
+	}
+
+	if( remove == TRUE )
+	{
+		PHPWorkerDelete( pw );
+	}
+}
+
+/**
+ * Send one FastCGI stream (record type), data is split to records of maximum size
+ *
+ * @param fd socket
+ * @param type record type
+ * @param data pointer to data or NULL (end of stream)
+ * @param size size of data
+ * @return 0 when success, otherwise -1
+ */
+static int PHPPoolFCGIWrite( int fd, int type, const char *data, FQUAD size )
+{
+	unsigned char header[ 8 ];
+	static const char padding[ 8 ] = { 0 };
+
+	do
+	{
+		int len = size > FCGI_MAX_RECORD ? FCGI_MAX_RECORD : (int)size;
+		int pad = ( 8 - ( len % 8 ) ) % 8;
+
+		header[ 0 ] = FCGI_VERSION_1;
+		header[ 1 ] = type;
+		header[ 2 ] = ( FCGI_REQUEST_ID >> 8 ) & 0xff;
+		header[ 3 ] = FCGI_REQUEST_ID & 0xff;
+		header[ 4 ] = ( len >> 8 ) & 0xff;
+		header[ 5 ] = len & 0xff;
+		header[ 6 ] = pad;
+		header[ 7 ] = 0;
+
+		if( PHPPoolWriteAll( fd, (char *)header, 8 ) != 0 )
+		{
+			return -1;
+		}
+		if( len > 0 && PHPPoolWriteAll( fd, data, len ) != 0 )
+		{
+			return -1;
+		}
+		if( pad > 0 && PHPPoolWriteAll( fd, padding, pad ) != 0 )
+		{
+			return -1;
+		}
+		data += len;
+		size -= len;
+	}
+	while( size > 0 );
+
+	return 0;
+}
+
+/**
+ * Add FastCGI name-value pair to buffer
+ *
+ * @param bs pointer to BufString
+ * @param name parameter name
+ * @param value parameter value
+ */
+static void PHPPoolFCGIParam( BufString *bs, const char *name, const char *value )
+{
+	unsigned char len[ 8 ];
+	int pos = 0;
+	unsigned int sizes[ 2 ] = { strlen( name ), strlen( value ) };
+	int i;
+
+	for( i = 0 ; i < 2 ; i++ )
+	{
+		if( sizes[ i ] < 128 )
+		{
+			len[ pos++ ] = sizes[ i ];
+		}
+		else
+		{
+			len[ pos++ ] = ( ( sizes[ i ] >> 24 ) & 0x7f ) | 0x80;
+			len[ pos++ ] = ( sizes[ i ] >> 16 ) & 0xff;
+			len[ pos++ ] = ( sizes[ i ] >> 8 ) & 0xff;
+			len[ pos++ ] = sizes[ i ] & 0xff;
+		}
+	}
+	BufStringAddSize( bs, (char *)len, pos );
+	BufStringAddSize( bs, name, sizes[ 0 ] );
+	BufStringAddSize( bs, value, sizes[ 1 ] );
+}
+
+/**
+ * Run script in php-fpm. Arguments are sent as request body, php/fcgi_argv.php
+ * (auto_prepend_file) recreates $argv from them.
+ *
+ * @param pp pointer to PHPPool
+ * @param pw pointer to PHPWorker (connection)
+ * @param strings script path followed by arguments
+ * @param count number of strings
+ * @param ls pointer to ListString where output is stored
+ * @return PHP_POOL_OK when success, otherwise error number
+ */
+static int PHPPoolRunFastCGI( PHPPool *pp, PHPWorker *pw, char **strings, int count, ListString *ls )
+{
+	char path[ 2048 ];
+	char value[ 2048 ];
+	unsigned char begin[ 8 ] = { 0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0 };
+
+	if( strings[ 0 ][ 0 ] == '/' )
+	{
+		snprintf( path, sizeof(path), "%s", strings[ 0 ] );
+	}
+	else
+	{
+		snprintf( path, sizeof(path), "%s/%s", pp->pp_Home, strings[ 0 ] );
+	}
+
+	BufString *body = BufStringNew();
+	BufString *params = BufStringNew();
+	if( body == NULL || params == NULL )
+	{
+		if( body != NULL ) BufStringDelete( body );
+		if( params != NULL ) BufStringDelete( params );
+		return PHP_POOL_UNAVAILABLE;
+	}
+
+	PHPPoolEncodeStrings( body, strings, count );
+
+	PHPPoolFCGIParam( params, "GATEWAY_INTERFACE", "CGI/1.1" );
+	PHPPoolFCGIParam( params, "SERVER_PROTOCOL", "HTTP/1.1" );
+	PHPPoolFCGIParam( params, "REQUEST_METHOD", "POST" );
+	PHPPoolFCGIParam( params, "CONTENT_TYPE", "application/octet-stream" );
+	snprintf( value, sizeof(value), "%ld", (long)body->bs_Size );
+	PHPPoolFCGIParam( params, "CONTENT_LENGTH", value );
+	PHPPoolFCGIParam( params, "SCRIPT_FILENAME", path );
+	PHPPoolFCGIParam( params, "SCRIPT_NAME", strings[ 0 ] );
+	PHPPoolFCGIParam( params, "DOCUMENT_ROOT", pp->pp_Home );
+	snprintf( value, sizeof(value), "%d", count );
+	PHPPoolFCGIParam( params, "FRIEND_ARGC", value );
+	snprintf( value, sizeof(value), "auto_prepend_file=%s/php/fcgi_argv.php", pp->pp_Home );
+	PHPPoolFCGIParam( params, "PHP_VALUE", value );
+
+	int error = PHP_POOL_OK;
+
+	if( PHPPoolFCGIWrite( pw->pw_FD, FCGI_BEGIN_REQUEST, (char *)begin, 8 ) != 0 ||
+		PHPPoolFCGIWrite( pw->pw_FD, FCGI_PARAMS, params->bs_Buffer, params->bs_Size ) != 0 ||
+		PHPPoolFCGIWrite( pw->pw_FD, FCGI_PARAMS, NULL, 0 ) != 0 ||
+		PHPPoolFCGIWrite( pw->pw_FD, FCGI_STDIN, body->bs_Buffer, body->bs_Size ) != 0 ||
+		PHPPoolFCGIWrite( pw->pw_FD, FCGI_STDIN, NULL, 0 ) != 0 )
+	{
+		// request was not delivered, connection could be closed by php-fpm while it was idle
+		error = PHP_POOL_UNAVAILABLE;
+		pw->pw_Broken = TRUE;
+	}
+
+	BufStringDelete( body );
+	BufStringDelete( params );
+
+	if( error != PHP_POOL_OK )
+	{
+		return error;
+	}
+
+	// read records till end of request, CGI headers sent by php-fpm are skipped
+
+	char *buffer = FMalloc( FCGI_MAX_RECORD + 256 );
+	char *headers = FMalloc( FCGI_MAX_HEADERS );
+	int headersSize = 0;
+	FBOOL body_started = FALSE;
+
+	if( buffer == NULL || headers == NULL )
+	{
+		if( buffer != NULL ) FFree( buffer );
+		if( headers != NULL ) FFree( headers );
+		pw->pw_Broken = TRUE;
+		return PHP_POOL_ERROR;
+	}
+
+	while( TRUE )
+	{
+		unsigned char header[ 8 ];
+		if( PHPPoolReadAll( pp, pw->pw_FD, (char *)header, 8 ) != 0 )
+		{
+			error = PHP_POOL_ERROR;
+			break;
+		}
+		int len = ( header[ 4 ] << 8 ) | header[ 5 ];
+		int pad = header[ 6 ];
+
+		if( PHPPoolReadAll( pp, pw->pw_FD, buffer, len + pad ) != 0 )
+		{
+			error = PHP_POOL_ERROR;
+			break;
+		}
+
+		if( header[ 1 ] == FCGI_END_REQUEST )
+		{
+			break;
+		}
+		else if( header[ 1 ] == FCGI_STDERR && len > 0 )
+		{
+			buffer[ len ] = 0;
+			FERROR("[PHPPoolRunFastCGI] %s: %s\n", strings[ 0 ], buffer );
+		}
+		else if( header[ 1 ] == FCGI_STDOUT && len > 0 )
+		{
+			if( body_started == TRUE )
+			{
+				ListStringAdd( ls, buffer, len );
+				continue;
+			}
+
+			// collect headers till empty line, rest is output of script
+			char *data = buffer;
+			int copy = ( len > FCGI_MAX_HEADERS - headersSize ) ? FCGI_MAX_HEADERS - headersSize : len;
+			memcpy( headers + headersSize, data, copy );
+			headersSize += copy;
+
+			int i;
+			for( i = 0 ; i + 3 < headersSize ; i++ )
+			{
+				if( headers[ i ] == '\r' && headers[ i+1 ] == '\n' && headers[ i+2 ] == '\r' && headers[ i+3 ] == '\n' )
+				{
+					body_started = TRUE;
+					ListStringAdd( ls, headers + i + 4, headersSize - ( i + 4 ) );
+					break;
+				}
+			}
+
+			if( body_started == FALSE && headersSize >= FCGI_MAX_HEADERS )
+			{
+				// no CGI headers, whole output belongs to script
+				body_started = TRUE;
+				ListStringAdd( ls, headers, headersSize );
+			}
+			if( body_started == TRUE && copy < len )
+			{
+				ListStringAdd( ls, data + copy, len - copy );
+			}
+		}
+	}
+
+	FFree( buffer );
+	FFree( headers );
+
+	if( error != PHP_POOL_OK )
+	{
+		pw->pw_Broken = TRUE;
+	}
+	return error;
+}
+
+/**
+ * Run script in persistent worker (php/worker.php). Output comes in frames
+ * "<4 bytes length><data>", empty frame ends request.
+ *
+ * @param pp pointer to PHPPool
+ * @param pw pointer to PHPWorker
+ * @param strings script path followed by arguments
+ * @param count number of strings
+ * @param ls pointer to ListString where output is stored
+ * @return PHP_POOL_OK when success, otherwise error number
+ */
+static int PHPPoolRunWorker( PHPPool *pp, PHPWorker *pw, char **strings, int count, ListString *ls )
+{
+	char countString[ 32 ];
+	int countSize = snprintf( countString, sizeof(countString), "%d\n", count );
+
+	BufString *request = BufStringNew();
+	if( request == NULL )
+	{
+		return PHP_POOL_UNAVAILABLE;
+	}
+	BufStringAddSize( request, countString, countSize );
+	PHPPoolEncodeStrings( request, strings, count );
+
+	int error = PHP_POOL_OK;
+	if( PHPPoolWriteAll( pw->pw_FD, request->bs_Buffer, request->bs_Size ) != 0 )
+	{
+		// worker died while it was waiting
+		pw->pw_Broken = TRUE;
+		error = PHP_POOL_UNAVAILABLE;
+	}
+	BufStringDelete( request );
+
+	if( error != PHP_POOL_OK )
+	{
+		return error;
+	}
+
+	char *buffer = FMalloc( PHP_POOL_READ_SIZE );
+	if( buffer == NULL )
+	{
+		pw->pw_Broken = TRUE;
+		return PHP_POOL_ERROR;
+	}
+
+	while( TRUE )
+	{
+		unsigned char frame[ 4 ];
+		if( PHPPoolReadAll( pp, pw->pw_FD, (char *)frame, 4 ) != 0 )
+		{
+			error = PHP_POOL_ERROR;
+			break;
+		}
+
+		FULONG len = ( (FULONG)frame[ 0 ] << 24 ) | ( frame[ 1 ] << 16 ) | ( frame[ 2 ] << 8 ) | frame[ 3 ];
+		if( len == 0 )
+		{
+			break;
+		}
+
+		// big frames are moved to list in parts, whole output is never kept in one buffer
+		while( len > 0 )
+		{
+			int part = len > PHP_POOL_READ_SIZE ? PHP_POOL_READ_SIZE : (int)len;
+			if( PHPPoolReadAll( pp, pw->pw_FD, buffer, part ) != 0 )
+			{
+				error = PHP_POOL_ERROR;
+				break;
+			}
+			ListStringAdd( ls, buffer, part );
+			len -= part;
+		}
+		if( error != PHP_POOL_OK )
+		{
+			break;
+		}
+	}
+
+	FFree( buffer );
+
+	if( error != PHP_POOL_OK )
+	{
+		pw->pw_Broken = TRUE;
+	}
+	return error;
+}
+
+/**
+ * Run command in new process (used when pool is disabled or cannot handle call)
+ *
+ * @param command shell command
+ * @param timeout seconds without output after which reading is stopped
+ * @return new ListString structure or NULL when problem appear
+ */
+static ListString *PHPPoolRunProcess( const char *command, int timeout )
+{
+	NPOpenFD pofd;
+	int err = newpopen( command, &pofd );
+	if( err != 0 )
+	{
+		FERROR("[PHPPoolRunProcess] cannot open pipe: %s\n", strerror( errno ) );
+		return NULL;
+	}
+
+	char *buf = FMalloc( PHP_POOL_READ_SIZE+16 );
+	ListString *ls = ListStringNew();
+
+	struct pollfd fds[ 1 ];
+	fds[0].fd = pofd.np_FD[ NPOPEN_CONSOLE ];
+	fds[0].events = POLLIN;
+
+	while( buf != NULL && ls != NULL )
+	{
+		int ret = poll( fds, 1, timeout * 1000 );
+		if( ret <= 0 )
+		{
+			DEBUG("[PHPPoolRunProcess] Timeout or error\n");
+			break;
+		}
+
+		int size = read( pofd.np_FD[ NPOPEN_CONSOLE ], buf, PHP_POOL_READ_SIZE );
+		if( size <= 0 )
+		{
+			break;
+		}
+		ListStringAdd( ls, buf, size );
+	}
+
+	if( buf != NULL )
+	{
+		FFree( buf );
+	}
+	newpclose( &pofd );
+
+	return ls;
+}
+
+/**
+ * Split shell command "php 'script' "arg" ..." into script and arguments
+ *
+ * @param command shell command
+ * @param strings table where pointers to script and arguments will be stored
+ * @param count pointer to place where number of strings will be stored
+ * @return buffer which holds strings (must be released) or NULL when command cannot be run without shell
+ */
+static char *PHPPoolParseCommand( const char *command, char **strings, int *count )
+{
+	char *buffer = FCalloc( strlen( command ) + 1, sizeof(char) );
+	if( buffer == NULL )
+	{
+		return NULL;
+	}
+
+	const char *src = command;
+	char *dst = buffer;
+	int words = 0;
+
+	while( TRUE )
+	{
+		while( *src == ' ' || *src == '\t' )
+		{
+			src++;
+		}
+		// command separator or redirection ends arguments list ( ...; 2>&1 )
+		if( *src == 0 || *src == ';' || *src == '>' || ( *src >= '0' && *src <= '9' && src[ 1 ] == '>' ) )
+		{
+			break;
+		}
+		if( words >= PHP_POOL_MAX_ARGS + 1 )
+		{
+			FFree( buffer );
+			return NULL;
+		}
+
+		char *word = dst;
+		while( *src != 0 && *src != ' ' && *src != '\t' && *src != ';' )
+		{
+			if( *src == '\'' )
+			{
+				src++;
+				while( *src != 0 && *src != '\'' )
+				{
+					*dst++ = *src++;
+				}
+				if( *src == 0 )
+				{
+					FFree( buffer );
+					return NULL;
+				}
+				src++;
+			}
+			else if( *src == '"' )
+			{
+				src++;
+				while( *src != 0 && *src != '"' )
+				{
+					if( *src == '\\' && ( src[ 1 ] == '"' || src[ 1 ] == '\\' || src[ 1 ] == '$' || src[ 1 ] == '`' ) )
+					{
+						src++;
+					}
+					else if( *src == '$' || *src == '`' )
+					{
+						FFree( buffer );		// shell expansion is required
+						return NULL;
+					}
+					*dst++ = *src++;
+				}
+				if( *src == 0 )
+				{
+					FFree( buffer );
+					return NULL;
+				}
+				src++;
+			}
+			else if( strchr( "|&<>$`(){}*?\\", *src ) != NULL )
+			{
+				FFree( buffer );
+				return NULL;
+			}
+			else
+			{
+				*dst++ = *src++;
+			}
+		}
+		*dst++ = 0;
+
+		if( words == 0 )
+		{
+			if( strcmp( word, "php" ) != 0 )
+			{
+				FFree( buffer );
+				return NULL;
+			}
+		}
+		else
+		{
+			strings[ words - 1 ] = word;
+		}
+		words++;
+	}
+
+	if( words < 2 )
+	{
+		FFree( buffer );
+		return NULL;
+	}
+	*count = words - 1;
+	return buffer;
+}
+
+/**
+ * Create new PHPPool. Configuration is read from cfg.ini:
+ *
+ * [PHP]
+ * runner = process | fastcgi | worker
+ * poolsize = 8
+ * timeout = 10
+ * maxrequests = 500
+ * fpmsocket = /run/php/php-fpm.sock or 127.0.0.1:9000
+ * workerscript = php/worker.php
+ *
+ * @param sb pointer to SystemBase
+ * @return new PHPPool structure when success, otherwise NULL
+ */
+PHPPool *PHPPoolNew( void *sb )
+{
+	SystemBase *locsb = (SystemBase *)sb;
+	PHPPool *pp;
+
+	if( ( pp = FCalloc( 1, sizeof( PHPPool ) ) ) != NULL )
+	{
+		char *runner = NULL;
+		char *fpm = NULL;
+		char *worker = NULL;
+		char cwd[ 1024 ];
+
+		pp->pp_Runner = PHP_POOL_RUNNER_PROCESS;
+		pp->pp_Size = PHP_POOL_SIZE;
+		pp->pp_Timeout = MOD_TIMEOUT;
+		pp->pp_MaxRequests = PHP_POOL_MAX_REQUESTS;
+
+		struct PropertiesInterface *plib = &( locsb->sl_PropertiesInterface );
+		char coresPath[ 1024 ];
+		snprintf( coresPath, sizeof(coresPath), "%s/cfg/cfg.ini", getenv( "FRIEND_HOME" ) );
+
+		Props *prop = plib->Open( coresPath );
+		if( prop != NULL )
+		{
+			runner = plib->ReadStringNCS( prop, "PHP:runner", "process" );
+			pp->pp_Size = plib->ReadIntNCS( prop, "PHP:poolsize", PHP_POOL_SIZE );
+			pp->pp_Timeout = plib->ReadIntNCS( prop, "PHP:timeout", MOD_TIMEOUT );
+			pp->pp_MaxRequests = plib->ReadIntNCS( prop, "PHP:maxrequests", PHP_POOL_MAX_REQUESTS );
+			fpm = plib->ReadStringNCS( prop, "PHP:fpmsocket", "/run/php/php-fpm.sock" );
+			worker = plib->ReadStringNCS( prop, "PHP:workerscript", "php/worker.php" );
+
+			if( runner != NULL )
+			{
+				if( strcmp( runner, "fastcgi" ) == 0 )
+				{
+					pp->pp_Runner = PHP_POOL_RUNNER_FASTCGI;
+				}
+				else if( strcmp( runner, "worker" ) == 0 )
+				{
+					pp->pp_Runner = PHP_POOL_RUNNER_WORKER;
+				}
+			}
+			pp->pp_FPMAddress = StringDuplicate( fpm );
+			pp->pp_WorkerScript = StringDuplicate( worker );
+
+			plib->Close( prop );
+		}
+
+		if( pp->pp_FPMAddress == NULL )
+		{
+			pp->pp_FPMAddress = StringDuplicate( "/run/php/php-fpm.sock" );
+		}
+		if( pp->pp_WorkerScript == NULL )
+		{
+			pp->pp_WorkerScript = StringDuplicate( "php/worker.php" );
+		}
+		if( pp->pp_Size <= 0 )
+		{
+			pp->pp_Size = 1;
+		}
+		if( pp->pp_Timeout <= 0 )
+		{
+			pp->pp_Timeout = MOD_TIMEOUT;
+		}
+
+		pp->pp_Home = StringDuplicate( getcwd( cwd, sizeof(cwd) ) != NULL ? cwd : "." );
+
+		pthread_mutex_init( &(pp->pp_Mutex), NULL );
+		pthread_cond_init( &(pp->pp_Cond), NULL );
+
+		Log( FLOG_INFO, "[PHPPoolNew] PHP runner: %s, pool size %d, timeout %d, max requests %d\n",
+			pp->pp_Runner == PHP_POOL_RUNNER_FASTCGI ? pp->pp_FPMAddress : ( pp->pp_Runner == PHP_POOL_RUNNER_WORKER ? pp->pp_WorkerScript : "process" ),
+			pp->pp_Size, pp->pp_Timeout, pp->pp_MaxRequests );
+	}
+	return pp;
+}
+
+/**
+ * Delete PHPPool, idle workers are stopped
+ *
+ * @param pp pointer to PHPPool
+ */
+void PHPPoolDelete( PHPPool *pp )
+{
+	if( pp == NULL )
+	{
+		return;
+	}
+
+	PHPWorker *idle = NULL;
+	if( FRIEND_MUTEX_LOCK( &(pp->pp_Mutex) ) == 0 )
+	{
+		pp->pp_Quit = TRUE;
+		idle = pp->pp_Idle;
+		pp->pp_Idle = NULL;
+		pthread_cond_broadcast( &(pp->pp_Cond) );
+		FRIEND_MUTEX_UNLOCK( &(pp->pp_Mutex) );
+	}
+
+	while( idle != NULL )
+	{
+		PHPWorker *rem = idle;
+		idle = (PHPWorker *)idle->node.mln_Succ;
+		PHPWorkerDelete( rem );
+	}
+
+	// workers which are still busy are removed by PHPPoolRelease
+	int tries = 0;
+	while( tries++ < 50 )
+	{
+		int count = 0;
+		if( FRIEND_MUTEX_LOCK( &(pp->pp_Mutex) ) == 0 )
+		{
+			count = pp->pp_Count;
+			FRIEND_MUTEX_UNLOCK( &(pp->pp_Mutex) );
+		}
+		if( count <= 0 )
+		{
+			break;
+		}
+		usleep( 100000 );
+	}
+
+	Log( FLOG_INFO, "[PHPPoolDelete] PHP calls: %lu, recycled workers: %lu, process fallbacks: %lu\n", pp->pp_Requests, pp->pp_Recycled, pp->pp_Fallbacks );
+
+	pthread_cond_destroy( &(pp->pp_Cond) );
+	pthread_mutex_destroy( &(pp->pp_Mutex) );
+
+	if( pp->pp_FPMAddress != NULL )
+	{
+		FFree( pp->pp_FPMAddress );
+	}
+	if( pp->pp_WorkerScript != NULL )
+	{
+		FFree( pp->pp_WorkerScript );
+	}
+	if( pp->pp_Home != NULL )
+	{
+		FFree( pp->pp_Home );
+	}
+	FFree( pp );
+}
+
+/**
+ * Run php script in pool worker
+ *
+ * @param pp pointer to PHPPool
+ * @param script path to script (relative to FriendCore directory or absolute)
+ * @param args table of arguments
+ * @param argc number of arguments
+ * @param ls pointer to ListString where output will be added (output is not joined)
+ * @return PHP_POOL_OK when success, PHP_POOL_UNAVAILABLE when nothing was executed, otherwise PHP_POOL_ERROR
+ */
+int PHPPoolRun( PHPPool *pp, const char *script, char **args, int argc, ListString *ls )
+{
+	char *strings[ PHP_POOL_MAX_ARGS + 1 ];
+	int i;
+
+	if( pp == NULL || pp->pp_Runner == PHP_POOL_RUNNER_PROCESS || script == NULL || ls == NULL || argc > PHP_POOL_MAX_ARGS )
+	{
+		return PHP_POOL_UNAVAILABLE;
+	}
+
+	strings[ 0 ] = (char *)script;
+	for( i = 0 ; i < argc ; i++ )
+	{
+		strings[ i + 1 ] = args[ i ];
+	}
+
+	int error = PHP_POOL_UNAVAILABLE;
+	int attempt;
+
+	// idle connection could be closed by other side, such call is repeated on fresh worker
+	for( attempt = 0 ; attempt < 2 && error == PHP_POOL_UNAVAILABLE ; attempt++ )
+	{
+		PHPWorker *pw = PHPPoolAcquire( pp );
+		if( pw == NULL )
+		{
+			break;
+		}
+
+		if( pp->pp_Runner == PHP_POOL_RUNNER_FASTCGI )
+		{
+			error = PHPPoolRunFastCGI( pp, pw, strings, argc + 1, ls );
+		}
+		else
+		{
+			error = PHPPoolRunWorker( pp, pw, strings, argc + 1, ls );
+		}
+		PHPPoolRelease( pp, pw );
+	}
+
+	return error;
+}
+
+/**
+ * Run php command. Command is executed by pool when it is enabled and command
+ * does not need shell, otherwise new process is launched.
+ *
+ * @param pp pointer to PHPPool (can be NULL)
+ * @param command shell command in form: php 'script' 'arg' ...
+ * @return new ListString structure with joined output or NULL when problem appear
+ */
+ListString *PHPPoolRunCommand( PHPPool *pp, const char *command )
+{
+	ListString *ls = NULL;
+
+	if( command == NULL )
+	{
+		return NULL;
+	}
+
+	if( pp != NULL && pp->pp_Runner != PHP_POOL_RUNNER_PROCESS )
+	{
+		char *strings[ PHP_POOL_MAX_ARGS + 1 ];
+		int count = 0;
+
+		char *buffer = PHPPoolParseCommand( command, strings, &count );
+		if( buffer != NULL )
+		{
+			if( ( ls = ListStringNew() ) != NULL )
+			{
+				int error = PHPPoolRun( pp, strings[ 0 ], &(strings[ 1 ]), count - 1, ls );
+				if( error == PHP_POOL_UNAVAILABLE )
+				{
+					ListStringDelete( ls );
+					ls = NULL;
+				}
+			}
+			FFree( buffer );
+		}
+
+		if( ls == NULL )
+		{
+			DEBUG("[PHPPoolRunCommand] Command will be run in new process: %s\n", command );
+			if( FRIEND_MUTEX_LOCK( &(pp->pp_Mutex) ) == 0 )
+			{
+				pp->pp_Fallbacks++;
+				FRIEND_MUTEX_UNLOCK( &(pp->pp_Mutex) );
+			}
+		}
+	}
+
+	if( ls == NULL )
+	{
+		ls = PHPPoolRunProcess( command, pp != NULL ? pp->pp_Timeout : MOD_TIMEOUT );
+	}
+
+	if( ls != NULL )
+	{
+		ListStringJoin( ls );
+	}
+	return ls;
+}
@@ -0,0 +1,120 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ *  PHP runner, pool of long-lived PHP processes
+ *
+ *  Scripts are executed by php-fpm (FastCGI) or by bundled worker loop
+ *  (php/worker.php) instead of spawning new php process for every call.
+ */
+
+#ifndef __SYSTEM_MODULE_PHP_POOL_H__
+#define __SYSTEM_MODULE_PHP_POOL_H__
+
+#include <core/types.h>
+#include <core/nodes.h>
+#include <util/list_string.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#ifndef PHP_POOL_SIZE
+#define PHP_POOL_SIZE 8					// maximum number of php workers / php-fpm connections
+#endif
+
+#ifndef PHP_POOL_MAX_REQUESTS
+#define PHP_POOL_MAX_REQUESTS 500		// worker is replaced after this number of requests
+#endif
+
+#define PHP_POOL_READ_SIZE 65536
+#define PHP_POOL_MAX_ARGS 16
+
+//
+// how php scripts are launched
+//
+
+enum {
+	PHP_POOL_RUNNER_PROCESS = 0,		// new php process for every call (old behaviour)
+	PHP_POOL_RUNNER_FASTCGI,			// php-fpm connected by unix or tcp socket
+	PHP_POOL_RUNNER_WORKER				// persistent php processes running php/worker.php
+};
+
+//
+// results of PHPPoolRun
+//
+
+enum {
+	PHP_POOL_OK = 0,
+	PHP_POOL_UNAVAILABLE,				// worker cannot be created, nothing was executed
+	PHP_POOL_ERROR						// script failed or timed out
+};
+
+//
+// single php-fpm connection or worker process
+//
+
+typedef struct PHPWorker
+{
+	MinNode					node;
+	int						pw_FD;			// php-fpm socket or socketpair connected to worker stdin/stdout
+	pid_t					pw_PID;			// worker process (PHP_POOL_RUNNER_WORKER only)
+	int						pw_Requests;	// number of handled requests
+	FBOOL					pw_Broken;		// connection cannot be reused
+}PHPWorker;
+
+//
+// pool
+//
+
+typedef struct PHPPool
+{
+	int						pp_Runner;			// PHP_POOL_RUNNER_*
+	int						pp_Size;			// maximum number of workers
+	int						pp_Timeout;			// seconds without output after which script is stopped
+	int						pp_MaxRequests;		// worker recycling, 0 - never
+	char					*pp_FPMAddress;		// php-fpm socket path or host:port
+	char					*pp_WorkerScript;	// script run by persistent workers
+	char					*pp_Home;			// FriendCore working directory, scripts paths are relative to it
+
+	PHPWorker				*pp_Idle;			// workers waiting for requests
+	int						pp_Count;			// number of created workers
+	FBOOL					pp_Quit;
+	pthread_mutex_t			pp_Mutex;
+	pthread_cond_t			pp_Cond;
+
+	FULONG					pp_Requests;		// statistics
+	FULONG					pp_Recycled;
+	FULONG					pp_Fallbacks;
+}PHPPool;
+
+//
+//
+//
+
+PHPPool *PHPPoolNew( void *sb );
+
+//
+//
+//
+
+void PHPPoolDelete( PHPPool *pp );
+
+//
+// run script with arguments, output is appended to ls
+//
+
+int PHPPoolRun( PHPPool *pp, const char *script, char **args, int argc, ListString *ls );
+
+//
+// run shell command in form: php 'script' 'arg' ... , falls back to new process when pool cannot handle it
+//
+
+ListString *PHPPoolRunCommand( PHPPool *pp, const char *command );
+
+#endif // __SYSTEM_MODULE_PHP_POOL_H__
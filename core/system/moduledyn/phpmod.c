@@ -163,6 +163,28 @@ char *Run( struct EModule *mod, const char *path, const char *args, FULONG *leng
 	
 	DEBUG( "[PHPmod] run app: %s\n", command );
 	
+	// pool of php-fpm connections / persistent workers is used when FriendCore provides it
+	SystemBase *sb = (SystemBase *)mod->em_SB;
+	if( sb != NULL && sb->RunPHPCommand != NULL )
+	{
+		char *final = NULL;
+		ListString *pls = sb->RunPHPCommand( sb, command );
+		if( pls != NULL )
+		{
+			res = pls->ls_Size;
+			final = pls->ls_Data;
+			pls->ls_Data = NULL;
+			ListStringDelete( pls );
+		}
+		
+		if( length != NULL )
+		{
+			*length = ( unsigned long int )res;
+		}
+		FFree( command ); FFree( epath ); FFree( earg );
+		return final;
+	}
+	
 #define PHP_READ_SIZE 65536
 	
 	char *buf = FMalloc( PHP_READ_SIZE+16 );
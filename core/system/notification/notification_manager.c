@@ -357,11 +357,12 @@ NotificationSent *NotificationManagerGetNotificationsSentDB( NotificationManager
 	char where[ 1024 ];
 	int entries;
 	
-	if( FRIEND_MUTEX_LOCK( &(nm->nm_Mutex) ) == 0 )	
+	SQLLibrary *sqlLib = sb->LibrarySQLGetRead( sb );
+	if( sqlLib != NULL )
 	{
 		snprintf( where, sizeof(where), "ID='%lu'", ID );
-		ns = nm->nm_SQLLib->Load( nm->nm_SQLLib, NotificationSentDesc, where, &entries );
-		FRIEND_MUTEX_UNLOCK( &(nm->nm_Mutex) );
+		ns = sqlLib->Load( sqlLib, NotificationSentDesc, where, &entries );
+		sb->LibrarySQLDrop( sb, sqlLib );
 	}
 	return ns;
 }
@@ -138,6 +138,7 @@ SystemBase *SystemInit( void )
 	l->l_SocketISSL.SocketWaitRead = SocketWaitReadSSL;
 	l->l_SocketISSL.SocketReadTillEnd = SocketReadTillEndSSL;
 	l->l_SocketISSL.SocketWrite = SocketWriteSSL;
+	l->l_SocketISSL.SocketSendFile = SocketSendFileSSL;
 	l->l_SocketISSL.SocketDelete = SocketDeleteSSL;
 	l->l_SocketISSL.SocketReadPackage = SocketReadPackageSSL;
 
@@ -151,6 +152,7 @@ SystemBase *SystemInit( void )
 	l->l_SocketINOSSL.SocketWaitRead = SocketWaitReadNOSSL;
 	l->l_SocketINOSSL.SocketReadTillEnd = SocketReadTillEndNOSSL;
 	l->l_SocketINOSSL.SocketWrite = SocketWriteNOSSL;
+	l->l_SocketINOSSL.SocketSendFile = SocketSendFileNOSSL;
 	l->l_SocketINOSSL.SocketDelete = SocketDeleteNOSSL;
 	l->l_SocketINOSSL.SocketReadPackage = SocketReadPackageNOSSL;
 
@@ -164,6 +166,9 @@ SystemBase *SystemInit( void )
 	LIBXML_TEST_VERSION;
 	
 	l->sl_RemoveSessionsAfterTime = 60; //10800;
+	l->sl_SessionsFlushInterval = 10;
+	l->sl_StaticCacheMax = 1000000000;
+	l->sl_PermissionsCacheTTL = 60;
 	
 	//
 	// sl_Autotask
@@ -228,7 +233,6 @@ SystemBase *SystemInit( void )
 	// init libraries
 	
 	l->UserLibCounter = 0;
-	l->MsqLlibCounter = 0;
 	l->AppLibCounter = 0;
 	l->PropLibCounter = 0;
 	l->ZLibCounter = 0;
@@ -258,6 +262,7 @@ SystemBase *SystemInit( void )
 	l->AuthModuleDrop = AuthModuleDrop;
 	l->LibrarySQLGet = LibrarySQLGet;
 	l->LibrarySQLDrop = LibrarySQLDrop;
+	l->LibrarySQLGetRead = LibrarySQLGetRead;
 	l->LibraryApplicationGet = LibraryApplicationGet;
 	l->LibraryApplicationDrop = LibraryApplicationDrop;
 	l->LibraryZGet = LibraryZGet;
@@ -271,6 +276,7 @@ SystemBase *SystemInit( void )
 	l->GetRootDeviceByName = GetRootDeviceByName;
 	l->SystemInitExternal = SystemInitExternal;
 	l->RunMod = RunMod;
+	l->RunPHPCommand = RunPHPCommand;
 	l->GetSentinelUser = GetSentinelUser;
 	l->UserDeviceMount = UserDeviceMount;
 	l->UserDeviceUnMount = UserDeviceUnMount;
@@ -290,6 +296,10 @@ SystemBase *SystemInit( void )
 	int port = 3306;
 	char *options = NULL;
 	l->sqlpoolConnections = DEFAULT_SQLLIB_POOL_NUMBER;
+	int sqlpoolMin = DEFAULT_SQLLIB_POOL_NUMBER;
+	int sqlpoolAffinity = 1;
+	int sqlpoolKeepAlive = SQL_POOL_KEEPALIVE;
+	int sqlpoolIdleTimeout = SQL_POOL_IDLE_TIMEOUT;
 	Props *prop = NULL;
 
 	// Get a copy of the properties.library
@@ -361,8 +371,14 @@ SystemBase *SystemInit( void )
 			DEBUG("[SystemBase] dbname %s\n",dbname );
 			port = plib->ReadIntNCS( prop, "databaseuser:port", 3306 );
 			DEBUG("[SystemBase] port read %d\n", port );
-			l->sqlpoolConnections = plib->ReadIntNCS( prop, "databaseuser:connections", DEFAULT_SQLLIB_POOL_NUMBER );
-			DEBUG("[SystemBase] connections read %d\n", l->sqlpoolConnections );
+			// connections - fixed pool size, minconnections/maxconnections - pool grows on demand and shrinks when idle
+			sqlpoolMin = plib->ReadIntNCS( prop, "databaseuser:connections", DEFAULT_SQLLIB_POOL_NUMBER );
+			sqlpoolMin = plib->ReadIntNCS( prop, "databaseuser:minconnections", sqlpoolMin );
+			l->sqlpoolConnections = plib->ReadIntNCS( prop, "databaseuser:maxconnections", sqlpoolMin );
+			DEBUG("[SystemBase] connections read %d - %d\n", sqlpoolMin, l->sqlpoolConnections );
+			sqlpoolAffinity = plib->ReadIntNCS( prop, "databaseuser:affinity", 1 );
+			sqlpoolKeepAlive = plib->ReadIntNCS( prop, "databaseuser:keepalive", SQL_POOL_KEEPALIVE );
+			sqlpoolIdleTimeout = plib->ReadIntNCS( prop, "databaseuser:idletimeout", SQL_POOL_IDLE_TIMEOUT );
 			options = plib->ReadStringNCS( prop, "databaseuser:options", NULL );
 			DEBUG("[SystemBase] options %s\n",options );
 			
@@ -370,6 +386,13 @@ SystemBase *SystemInit( void )
 			l->sl_UnMountDevicesInDB = plib->ReadIntNCS( prop, "Options:UnmountInDB", 1 );
 			l->sl_SocketTimeout  = plib->ReadIntNCS( prop, "core:SSLSocketTimeout", 10000 );
 			l->sl_USFCacheMax = plib->ReadIntNCS( prop, "core:USFCachePerDevice", 102400000 );
+			l->sl_SessionsFlushInterval = plib->ReadIntNCS( prop, "core:SessionsFlushInterval", 10 );
+			l->sl_StaticCacheMax = plib->ReadIntNCS( prop, "core:StaticCacheSize", 1000000000 );
+			l->sl_PermissionsCacheTTL = plib->ReadIntNCS( prop, "core:PermissionsCacheTTL", 60 );
+			if( l->sl_SessionsFlushInterval < 1 )
+			{
+				l->sl_SessionsFlushInterval = 1;
+			}
 			
 			l->l_EnableHTTPChecker = plib->ReadIntNCS( prop, "Options:HttpChecker", 0 );
 			
@@ -480,35 +503,51 @@ SystemBase *SystemInit( void )
 		Log( FLOG_INFO, "-----User: %s\n", login );
 		Log( FLOG_INFO, "----------------------------------------\n");
 
-		l->sqlpool = FCalloc( l->sqlpoolConnections, sizeof( SQLConPool) );
-		if( l->sqlpool != NULL )
+		l->sl_SQLPool = SQLPoolNew( l, "primary", l->sl_DefaultDBLib, host, dbname, login, pass, port, options, sqlpoolMin, l->sqlpoolConnections );
+		if( l->sl_SQLPool != NULL )
 		{
-			unsigned int i = 0;
-			int error = 0;
-
-			for( ; i < (unsigned int)l->sqlpoolConnections; i++ )
+			l->sqlpoolConnections = l->sl_SQLPool->sp_Max;
+			l->sl_SQLPool->sp_Affinity = ( sqlpoolAffinity != 0 );
+			l->sl_SQLPool->sp_KeepAlive = sqlpoolKeepAlive;
+			l->sl_SQLPool->sp_IdleTimeout = sqlpoolIdleTimeout;
+		}
+		
+		// read replicas, reads are sent to primary when replica host is not set
+		if( prop != NULL && l->sl_SQLPool != NULL && plib->ReadStringNCS( prop, "databasereplica:host", NULL ) != NULL )
+		{
+			char *rhost = plib->ReadStringNCS( prop, "databasereplica:host", NULL );
+			int rport = plib->ReadIntNCS( prop, "databasereplica:port", port );
+			char *rdbname = plib->ReadStringNCS( prop, "databasereplica:dbname", dbname );
+			char *rlogin = plib->ReadStringNCS( prop, "databasereplica:login", login );
+			char *rpass = plib->ReadStringNCS( prop, "databasereplica:password", pass );
+			int rmin = plib->ReadIntNCS( prop, "databasereplica:connections", sqlpoolMin );
+			rmin = plib->ReadIntNCS( prop, "databasereplica:minconnections", rmin );
+			int rmax = plib->ReadIntNCS( prop, "databasereplica:maxconnections", rmin );
+			l->sl_SQLReplicaStickiness = plib->ReadIntNCS( prop, "databasereplica:stickiness", 5 );
+			
+			// replica connections refuse writes, so query sent to wrong pool is not lost silently
+			char roptions[ 512 ];
+			if( options != NULL )
 			{
-				l->sqlpool[ i ].sqll_Sqllib = (struct SQLLibrary *)LibraryOpen( l, l->sl_DefaultDBLib, 0 );
-				if( l->sqlpool[ i ].sqll_Sqllib != NULL )
-				{
-					l->sqlpool[ i ].sql_ID = i;
-					error = l->sqlpool[i ].sqll_Sqllib->SetOption( l->sqlpool[ i ].sqll_Sqllib, options );
-					error = l->sqlpool[i ].sqll_Sqllib->Connect( l->sqlpool[ i ].sqll_Sqllib, host, dbname, login, pass, port );
-					if( error != 0 )
-					{
-						break;
-					}
-				}
+				snprintf( roptions, sizeof(roptions), "%s;READONLY,1", options );
 			}
+			else
+			{
+				snprintf( roptions, sizeof(roptions), "READONLY,1" );
+			}
+			
+			Log( FLOG_INFO, "-----Replica host: %s port: %d\n", rhost, rport );
 			
-			if( error != 0 )
+			l->sl_SQLReplicaPool = SQLPoolNew( l, "replica", l->sl_DefaultDBLib, rhost, rdbname, rlogin, rpass, rport, roptions, rmin, rmax );
+			if( l->sl_SQLReplicaPool != NULL )
 			{
-				i = 0;
-				for( ; i < (unsigned int)l->sqlpoolConnections; i++ )
-				{
-					LibraryClose( l->sqlpool[ i ].sqll_Sqllib );
-					l->sqlpool[i ].sqll_Sqllib = NULL;
-				}
+				l->sl_SQLReplicaPool->sp_Affinity = ( sqlpoolAffinity != 0 );
+				l->sl_SQLReplicaPool->sp_KeepAlive = sqlpoolKeepAlive;
+				l->sl_SQLReplicaPool->sp_IdleTimeout = sqlpoolIdleTimeout;
+			}
+			else
+			{
+				Log( FLOG_ERROR, "[SystemBase] Cannot connect to replica %s, all queries will be sent to primary\n", rhost );
 			}
 		}
 		if( prop ) plib->Close( prop );
@@ -520,11 +559,10 @@ SystemBase *SystemInit( void )
 	Log( FLOG_INFO, "[SystemBase] Reading configuration END\n");
 	Log( FLOG_INFO, "[SystemBase] ----------------------------------------\n");
 	
-	if( l->sqlpool == NULL || l->sqlpool[ 0 ].sqll_Sqllib == NULL )
+	if( l->sl_SQLPool == NULL )
 	{
 		Log( FLOG_ERROR, "Cannot open 'mysql.library' in first slot\n");
 		FFree( tempString );
-		FFree( l->sqlpool );
 		FFree( l );
 		//LogDelete();
 		return NULL;
@@ -544,6 +582,13 @@ SystemBase *SystemInit( void )
 	SQLLibrary *lsqllib  = l->LibrarySQLGet( l );
 	if( lsqllib != NULL )
 	{
+		// compile descriptors of most often loaded tables before first request
+		if( lsqllib->CompileDescriptor != NULL )
+		{
+			lsqllib->CompileDescriptor( lsqllib, UserDesc );
+			lsqllib->CompileDescriptor( lsqllib, UserSessionDesc );
+		}
+		
 		// session timeout
 		
 		char query[ 1024 ];
@@ -611,6 +656,13 @@ SystemBase *SystemInit( void )
 		Log( FLOG_ERROR, "Cannot initialize sl_NotificationManager\n");
 	}
 	
+	// ticket keys must exist before first TLS context is created
+	l->sl_TLSSessionManager = TLSSessionManagerNew( l );
+	if( l->sl_TLSSessionManager == NULL )
+	{
+		Log( FLOG_ERROR, "Cannot initialize TLSSessionManager\n");
+	}
+	
 	l->fcm = FriendCoreManagerNew();
 
 	l->sl_WorkerManager = WorkerManagerNew( l->sl_WorkersNumber );
@@ -971,8 +1023,20 @@ SystemBase *SystemInit( void )
 		Log( FLOG_ERROR, "Cannot initialize UserLoggerManagerNew\n");
 	}
 	
-	// 100 MB
-	l->cm = CacheManagerNew( 1000000000 );
+	l->sl_PHPPool = PHPPoolNew( l );
+	if( l->sl_PHPPool == NULL )
+	{
+		Log( FLOG_ERROR, "Cannot initialize PHPPool\n");
+	}
+	
+	l->sl_ThumbnailManager = ThumbnailManagerNew( l );
+	if( l->sl_ThumbnailManager == NULL )
+	{
+		Log( FLOG_ERROR, "Cannot initialize ThumbnailManager\n");
+	}
+	
+	// static files cache, least used files are removed when it is full
+	l->cm = CacheManagerNew( l->sl_StaticCacheMax );
 	if( l->cm == NULL )
 	{
 		Log( FLOG_ERROR, "Cannot initialize CacheManager\n");
@@ -1035,10 +1099,21 @@ SystemBase *SystemInit( void )
 
 	EventAdd( l->sl_EventManager, "DoorNotificationRemoveEntries", DoorNotificationRemoveEntries, l, time( NULL )+MINS30, MINS30, -1 );
 	EventAdd( l->sl_EventManager, "USMRemoveOldSessions", USMRemoveOldSessions, l, time( NULL )+MINS1, MINS1, -1 );
+	EventAdd( l->sl_EventManager, "USMSessionsFlushLoggedTime", USMSessionsFlushLoggedTime, l, time( NULL )+l->sl_SessionsFlushInterval, l->sl_SessionsFlushInterval, -1 );
 	// test, to remove
 	EventAdd( l->sl_EventManager, "PIDThreadManagerRemoveThreads", PIDThreadManagerRemoveThreads, l->sl_PIDTM, time( NULL )+MINS60, MINS60, -1 );
 	EventAdd( l->sl_EventManager, "CacheUFManagerRefresh", CacheUFManagerRefresh, l->sl_CacheUFM, time( NULL )+DAYS5, DAYS5, -1 );
 	
+	if( l->sl_ThumbnailManager != NULL )
+	{
+		EventAdd( l->sl_EventManager, "ThumbnailManagerCleanup", ThumbnailManagerCleanup, l->sl_ThumbnailManager, time( NULL )+l->sl_ThumbnailManager->tm_CleanupInterval, l->sl_ThumbnailManager->tm_CleanupInterval, -1 );
+	}
+	
+	if( l->sl_TLSSessionManager != NULL )
+	{
+		EventAdd( l->sl_EventManager, "TLSSessionManagerRotate", TLSSessionManagerRotate, l->sl_TLSSessionManager, time( NULL )+l->sl_TLSSessionManager->tsm_Rotation, l->sl_TLSSessionManager->tsm_Rotation, -1 );
+	}
+	
 	EventAdd( l->sl_EventManager, "WebdavTokenManagerDeleteOld", WebdavTokenManagerDeleteOld, l->sl_WDavTokM, time( NULL )+MINS360, MINS360, -1 );
 	
 	EventAdd( l->sl_EventManager, "CommServicePING", CommServicePING, l->fcm->fcm_CommService, time( NULL )+MINS1, MINS1, -1 );
@@ -1183,6 +1258,8 @@ void SystemClose( SystemBase *l )
 	}
 	if( l->sl_USM != NULL )
 	{
+		// store LoggedTime which was not written yet by event
+		USMSessionsFlushLoggedTime( l );
 		USMDelete( l->sl_USM );
 	}
 	if( l->sl_UM != NULL )
@@ -1213,6 +1290,21 @@ void SystemClose( SystemBase *l )
 	{
 		UserLoggerManagerDelete( l->sl_ULM );
 	}
+	if( l->sl_PHPPool != NULL )
+	{
+		PHPPoolDelete( l->sl_PHPPool );
+		l->sl_PHPPool = NULL;
+	}
+	if( l->sl_TLSSessionManager != NULL )
+	{
+		TLSSessionManagerDelete( l->sl_TLSSessionManager );
+		l->sl_TLSSessionManager = NULL;
+	}
+	if( l->sl_ThumbnailManager != NULL )
+	{
+		ThumbnailManagerDelete( l->sl_ThumbnailManager );
+		l->sl_ThumbnailManager = NULL;
+	}
 	if( l->sl_CacheUFM != NULL )
 	{
 		CacheUFManagerDelete( l->sl_CacheUFM );
@@ -1335,16 +1427,15 @@ void SystemClose( SystemBase *l )
 	
 	// Close mysql library
 	DEBUG( "[SystemBase] Closing and looking into mysql pool\n" );
-	if( l->sqlpool != NULL )
+	if( l->sl_SQLReplicaPool != NULL )
 	{
-		unsigned int i = 0;
-		for( ; i < (unsigned int)l->sqlpoolConnections; i++ )
-		{
-			DEBUG( "[SystemBase] Closed mysql library slot %d\n", i );
-			LibraryClose( l->sqlpool[ i ].sqll_Sqllib );
-		}
-		
-		FFree( l->sqlpool );
+		SQLPoolDelete( l->sl_SQLReplicaPool );
+		l->sl_SQLReplicaPool = NULL;
+	}
+	if( l->sl_SQLPool != NULL )
+	{
+		SQLPoolDelete( l->sl_SQLPool );
+		l->sl_SQLPool = NULL;
 	}
 
 	// release them all strings ;)
@@ -1518,6 +1609,8 @@ int SystemInitExternal( SystemBase *l )
 			DEBUG("[SystemBase] Assigning sessions to users by ID %ld\n", usess->us_ID );
 			
 			l->sl_USM->usm_SessionCounter++;
+			// value came from DB, there is no need to write it back
+			usess->us_LoggedTimeSaved = usess->us_LoggedTime;
 			
 			// checking if user exist, if not it is created
 			User *usr = l->sl_UM->um_Users;
@@ -1566,6 +1659,9 @@ int SystemInitExternal( SystemBase *l )
 			usess = (UserSession *)usess->node.mln_Succ;
 		}
 		
+		// sessions loaded from DB must be registered in session manager indexes
+		USMRebuildIndex( l->sl_USM );
+		
 		//
 		// attach sentinel user
 		//
@@ -2282,6 +2378,19 @@ char *RunMod( SystemBase *l, const char *type, const char *path, const char *arg
 	return results;
 }
 
+/**
+ * Run php command (php 'script' 'arg' ...) through PHP pool
+ *
+ * @param l pointer to SystemBase
+ * @param command shell command
+ * @return new ListString structure with output or NULL when error appear
+ */
+
+ListString *RunPHPCommand( SystemBase *l, const char *command )
+{
+	return PHPPoolRunCommand( l->sl_PHPPool, command );
+}
+
 /**
  * Get last error from SystemBase
  *
@@ -2319,6 +2428,14 @@ void AuthModuleDrop( SystemBase *l __attribute__((unused)), AuthMod *uclose __at
 {
 }
 
+//
+// user session for which thread is working now (set for web and websocket requests), its last write
+// decides where reads go. Last write of thread is used too, threads without session read own writes.
+//
+
+static __thread UserSession *sqlThreadSession = NULL;
+static __thread time_t sqlThreadLastWrite = 0;
+
 /**
  * Get mysql.library from pool
  *
@@ -2328,82 +2445,7 @@ void AuthModuleDrop( SystemBase *l __attribute__((unused)), AuthMod *uclose __at
 
 SQLLibrary *LibrarySQLGet( SystemBase *l )
 {
-	SQLLibrary *retlib = NULL;
-	int i ;
-	int timer = 0;
-	
-	while( TRUE )
-	{
-		if( FRIEND_MUTEX_LOCK( &l->sl_ResourceMutex ) == 0 )
-		{
-			if( l->sqlpool[ l->MsqLlibCounter ].sqll_Sqllib->l_InUse == FALSE )
-			{
-				retlib = l->sqlpool[l->MsqLlibCounter ].sqll_Sqllib;
-				DEBUG("retlibptr %p pool %p\n", retlib, l->sqlpool[l->MsqLlibCounter ].sqll_Sqllib );
-				int status = retlib->GetStatus( (void *)l->sqlpool[l->MsqLlibCounter ].sqll_Sqllib );
-				if( retlib == NULL || status != SQL_STATUS_READY ) //retlib->con.sql_Con->status != MYSQL_STATUS_READY )
-				{
-					FERROR( "[LibraryMYSQLGet] We found a NULL pointer on slot %d retlib %p status %d!\n", l->MsqLlibCounter, retlib, status );
-					// Increment and check
-					if( ++l->MsqLlibCounter >= l->sqlpoolConnections ) l->MsqLlibCounter = 0;
-					FRIEND_MUTEX_UNLOCK( &l->sl_ResourceMutex );
-					// Give some grace time..
-					usleep( 5000 );
-					continue;
-				}
-				
-				l->sqlpool[ l->MsqLlibCounter ].sqll_Sqllib->l_InUse = TRUE;
-				if( l->sqlpool[ l->MsqLlibCounter ].sqll_Sqllib->con.sql_Recconect == TRUE )
-				{
-					l->sqlpool[ l->MsqLlibCounter ].sqll_Sqllib->Reconnect(  l->sqlpool[ l->MsqLlibCounter ].sqll_Sqllib );
-					l->sqlpool[ l->MsqLlibCounter ].sqll_Sqllib->con.sql_Recconect = FALSE;
-				}
-			
-				INFO( "[LibraryMYSQLGet] We found mysql library on slot %d.\n", l->MsqLlibCounter );
-			
-				// Increment and check
-				if( ++l->MsqLlibCounter >= l->sqlpoolConnections )
-				{
-					l->MsqLlibCounter = 0;
-				}
-				FRIEND_MUTEX_UNLOCK( &l->sl_ResourceMutex );
-				break;
-			}
-			else
-			{
-				FRIEND_MUTEX_UNLOCK( &l->sl_ResourceMutex );
-			}
-		}
-		
-		timer++;
-		// We got too many connections, give grace time
-		if( timer >= l->sqlpoolConnections )
-		{
-			timer = 0;
-			usleep( 5000 );
-		}
-		
-		l->MsqLlibCounter++;
-		if( l->MsqLlibCounter >= l->sqlpoolConnections )
-		{
-			l->MsqLlibCounter = 0;
-		}
-		
-		/*
-		retries++;
-		if( retries >= l->sqlpoolConnections )
-		{
-			if( usingSleep++ >= 32 )
-			{
-				DEBUG( "All SQL connections are busy!\n" );
-				break;
-			}
-			usleep( 5000 );
-		}
-		*/
-	}
-	
-	return retlib;
+	return SQLPoolGet( l->sl_SQLPool );
 }
 
 /**
@@ -2415,28 +2457,75 @@ SQLLibrary *LibrarySQLGet( SystemBase *l )
 
 void LibrarySQLDrop( SystemBase *l, SQLLibrary *mclose )
 {
-	int i = 0;
-	int closed = -1;
+	if( mclose == NULL )
+	{
+		return;
+	}
 	
-	if( mclose->l_InUse == TRUE )
+	if( mclose->l_Written == TRUE )
 	{
-		if( FRIEND_MUTEX_LOCK( &l->sl_ResourceMutex ) == 0 )
+		mclose->l_Written = FALSE;
+		sqlThreadLastWrite = time( NULL );
+		if( sqlThreadSession != NULL )
 		{
-			mclose->l_InUse = FALSE;
-			FRIEND_MUTEX_UNLOCK( &l->sl_ResourceMutex );
+			sqlThreadSession->us_LastSQLWrite = sqlThreadLastWrite;
 		}
-		closed = i;
-	}
-		
-	if( mclose->l_InUse != FALSE )
-	{
-		DEBUG( "[SystemBase] Mysql slot %d is still in use\n", i );
 	}
 	
-	if( closed != -1 )
+	SQLPoolDrop( mclose->l_Pool != NULL ? (SQLPool *)mclose->l_Pool : l->sl_SQLPool, mclose );
+}
+
+/**
+ * Set user session for which current thread is working. Writes done until session is
+ * cleared send reads of this session to primary for sl_SQLReplicaStickiness seconds,
+ * also when next request of session is handled by other thread.
+ *
+ * @param l pointer to SystemBase
+ * @param us pointer to UserSession or NULL when thread finished work for session
+ * @return session which was set before, caller restores it when nested work is finished
+ */
+
+UserSession *LibrarySQLSetSession( SystemBase *l __attribute__((unused)), UserSession *us )
+{
+	UserSession *prev = sqlThreadSession;
+	sqlThreadSession = us;
+	return prev;
+}
+
+/**
+ * Get mysql.library for read only queries. Connection is taken from replica pool
+ * unless user session or current thread wrote data recently (so it can read own writes) or replica is not available.
+ * Lookups which must see newest data (login, checks before insert) use LibrarySQLGet.
+ *
+ * @param l pointer to SystemBase
+ * @return pointer to mysql.library, must be returned by LibrarySQLDrop
+ */
+
+SQLLibrary *LibrarySQLGetRead( SystemBase *l )
+{
+	if( l->sl_SQLReplicaPool != NULL )
 	{
-		INFO( "[SystemBase] MYSQL slot %d was closed properly.\n", closed );
+		time_t now = time( NULL );
+		
+		if( ( sqlThreadSession != NULL && sqlThreadSession->us_LastSQLWrite != 0 && ( now - sqlThreadSession->us_LastSQLWrite ) < l->sl_SQLReplicaStickiness ) ||
+			( sqlThreadLastWrite != 0 && ( now - sqlThreadLastWrite ) < l->sl_SQLReplicaStickiness ) )
+		{
+			__sync_fetch_and_add( &(l->sl_SQLReplicaSticky), 1 );
+		}
+		else if( SQLPoolIsAvailable( l->sl_SQLReplicaPool ) == TRUE )
+		{
+			SQLLibrary *lib = SQLPoolGet( l->sl_SQLReplicaPool );
+			if( lib != NULL )
+			{
+				return lib;
+			}
+		}
+		else
+		{
+			__sync_fetch_and_add( &(l->sl_SQLReplicaFallbacks), 1 );
+		}
 	}
+	return SQLPoolGet( l->sl_SQLPool );
 }
 
 /**
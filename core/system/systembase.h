@@ -40,11 +40,15 @@
 #include <system/fsys/device_handling.h>
 #include <util/buffered_string.h>
 #include <db/sqllib.h>
+#include <db/sql_pool.h>
 #include <application/applicationlibrary.h>
 #include <system/dictionary/dictionary.h>
 #include <z/zlibrary.h>
 #include <image/imagelibrary.h>
 #include <system/module/module.h>
+#include <system/module/php_pool.h>
+#include <system/cache/thumbnail_manager.h>
+#include <network/tls_session.h>
 #include <system/fsys/dosdriver.h>
 #include <util/log/log.h>
 #include <magic.h>
@@ -215,13 +219,6 @@ enum {
 
 #define DEFAULT_SQLLIB_POOL_NUMBER 32
 
-typedef struct SQLConPool
-{
-	int				sql_ID;			// ID
-//	int				sqlcp_InUse;	// is in use
-	SQLLibrary		*sqll_Sqllib;	// pointer to library
-}SQLConPool;
-
 //
 //
 //
@@ -276,6 +273,7 @@ typedef struct SystemBase
 	char 							*sl_ActiveModuleName;	// name of active module
 	char							*sl_DefaultDBLib;		// default DB library name
 	time_t							sl_RemoveSessionsAfterTime;	// time after which session will be removed
+	int								sl_SessionsFlushInterval;	// how often session LoggedTime is stored in DB (seconds)
 	int								sl_MaxLogsInMB;			// Maximum size of logs in log folder in MB ( if > then old ones will be removed)
 	char							*sl_MasterServer;		// FriendCore master server
 	
@@ -286,8 +284,12 @@ typedef struct SystemBase
 	// = 86400
 	//
 
-	struct SQLConPool				*sqlpool;			// mysql.library pool
-	int								sqlpoolConnections;	// number of database connections
+	SQLPool							*sl_SQLPool;		// mysql.library pool
+	int								sqlpoolConnections;	// maximum number of database connections
+	SQLPool							*sl_SQLReplicaPool;	// read replicas pool, NULL when replicas are not used
+	int								sl_SQLReplicaStickiness;	// seconds after write in which user session reads from primary
+	FUQUAD							sl_SQLReplicaSticky;	// reads sent to primary because thread wrote data
+	FUQUAD							sl_SQLReplicaFallbacks;	// reads sent to primary because replica was not available
 	struct ApplicationLibrary		*alib;				// application library
 	struct ZLibrary					*zlib;						// z.library
 	struct ImageLibrary				*ilib;						// image.library
@@ -312,9 +314,11 @@ typedef struct SystemBase
 	UtilInterface					sl_UtilInterface; // util interface
 	
 	EModule							*sl_PHPModule;
+	PHPPool							*sl_PHPPool;		// php-fpm connections / persistent php workers
+	ThumbnailManager				*sl_ThumbnailManager;	// thumbnails generation and disk cache
+	TLSSessionManager				*sl_TLSSessionManager;	// session ticket keys shared by all TLS contexts
 
 	int								UserLibCounter;						// counter of opened libraries
-	int								MsqLlibCounter;
 	int								AppLibCounter;
 	int 							PropLibCounter;
 	int 							ZLibCounter;
@@ -332,6 +336,8 @@ typedef struct SystemBase
 	FBOOL							sl_UnMountDevicesInDB;
 	char							*sl_XFrameOption;
 	FLONG							sl_USFCacheMax; // User Shared File Manager cache max (per device)
+	FULONG							sl_StaticCacheMax; // static files cache size (bytes)
+	int								sl_PermissionsCacheTTL; // how long file permissions are cached (seconds), 0 - disabled
 	Sentinel 						*sl_Sentinel;
 
 	void							(*SystemClose)( struct SystemBase *l );
@@ -354,6 +360,8 @@ typedef struct SystemBase
 
 	void							(*LibrarySQLDrop)( struct SystemBase *l, struct SQLLibrary * );
 
+	struct SQLLibrary				*(*LibrarySQLGetRead)( struct SystemBase *l );
+
 	struct ApplicationLibrary		*(*LibraryApplicationGet)( struct SystemBase *l );
 
 	void							(*LibraryApplicationDrop)( struct SystemBase *l, struct ApplicationLibrary * );
@@ -384,6 +392,8 @@ typedef struct SystemBase
 
 	char							*(*RunMod)( struct SystemBase *l, const char *mime, const char *path, const char *args, unsigned long *length );
 
+	ListString						*(*RunPHPCommand)( struct SystemBase *l, const char *command );
+
 	int								(*GetError)( struct SystemBase *l );
 	
 	void							(*Log)( int lev, char* fmt, ...) ;
@@ -484,6 +494,18 @@ void LibrarySQLDrop( struct SystemBase *l, SQLLibrary *mclose );
 //
 //
 
+struct SQLLibrary *LibrarySQLGetRead( struct SystemBase *l );
+
+//
+// set user session for which current thread is working, NULL when finished, previous session is returned
+//
+
+UserSession *LibrarySQLSetSession( struct SystemBase *l, UserSession *us );
+
+//
+//
+//
+
 struct AuthMod *AuthModuleGet( struct SystemBase *l );
 
 //
@@ -508,6 +530,12 @@ char *RunMod( struct SystemBase *l, const char *mime, const char *path, const ch
 //
 //
 
+ListString *RunPHPCommand( struct SystemBase *l, const char *command );
+
+//
+//
+//
+
 int GetError( struct SystemBase *l );
 
 //
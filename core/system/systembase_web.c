@@ -318,7 +318,7 @@ char *GetArgsAndReplaceSession( Http *request, UserSession *loggedSession, FBOOL
  * @return http response
  */
 
-Http *SysWebRequest( SystemBase *l, char **urlpath, Http **request, UserSession *loggedSession, int *result )
+static Http *SysWebRequestProcess( SystemBase *l, char **urlpath, Http **request, UserSession *loggedSession, int *result )
 {
 	*result = 0;
 	Http *response = NULL;
@@ -575,122 +575,75 @@ Http *SysWebRequest( SystemBase *l, char **urlpath, Http **request, UserSession
 				
 				if( uname != NULL && uname->hme_Data != NULL  )
 				{
-					UserSession *curusrsess = l->sl_USM->usm_Sessions;
-					while( curusrsess != NULL )
+					// find user by name and take his session from session manager index
+					UserSession *curusrsess = NULL;
+					User *curusr = NULL;
+					
+					if( FRIEND_MUTEX_LOCK( &(l->sl_UM->um_Mutex) ) == 0 )
 					{
-						if( curusrsess != NULL )
+						curusr = l->sl_UM->um_Users;
+						while( curusr != NULL )
 						{
-							if( FRIEND_MUTEX_LOCK( &(curusrsess->us_Mutex) ) == 0 )
+							if( curusr->u_Name != NULL && strcasecmp( curusr->u_Name, (char *)uname->hme_Data ) == 0 )
 							{
-								curusrsess->us_InUseCounter++;
-								FRIEND_MUTEX_UNLOCK( &(curusrsess->us_Mutex) );
+								break;
 							}
+							curusr = (User *)curusr->node.mln_Succ;
 						}
-						User *curusr = curusrsess->us_User;
-						
-						if( curusr != NULL )
+						FRIEND_MUTEX_UNLOCK( &(l->sl_UM->um_Mutex) );
+					}
+					
+					if( curusr != NULL )
+					{
+						curusrsess = USMGetSessionByUserID( l->sl_USM, curusr->u_ID );
+					}
+					
+					if( curusrsess != NULL )
+					{
+						if( FRIEND_MUTEX_LOCK( &(curusrsess->us_Mutex) ) == 0 )
 						{
-							DEBUG("CHECK remote user: %s pass %s  provided pass %s uname param: %s\n", curusr->u_Name, curusr->u_Password, (char *)lpass, (char *)uname->hme_Data );
+							curusrsess->us_InUseCounter++;
+							FRIEND_MUTEX_UNLOCK( &(curusrsess->us_Mutex) );
+						}
 						
-							if( strcasecmp( curusr->u_Name, (char *)uname->hme_Data ) == 0 )
-							{
-								FBOOL isUserSentinel = FALSE;
-							
-								Sentinel *sent = l->GetSentinelUser( l );
-								if( sent != NULL )
-								{
-									if( curusr == sent->s_User )
-									{
-										isUserSentinel = TRUE;
-									}
-								}
-							
-								if( isUserSentinel == TRUE || l->sl_ActiveAuthModule->CheckPassword( l->sl_ActiveAuthModule, *request, curusr, (char *)passwd->hme_Data, &blockedTime ) == TRUE )
-								{
-									//snprintf( sessionid, sizeof(sessionid), "%lu", curusrsess->us_User->u_ID );
-									//strcpy( sessionid, curusrsess->us_User->u_MainSessionID );
-
-									loggedSession =  curusrsess;
-									userAdded = TRUE;		// there is no need to free resources
-									
-									if( curusrsess != NULL )
-									{
-										if( FRIEND_MUTEX_LOCK( &(curusrsess->us_Mutex) ) == 0 )
-										{
-											curusrsess->us_InUseCounter--;
-											FRIEND_MUTEX_UNLOCK( &(curusrsess->us_Mutex) );
-										}
-									}
-
-									break;
-								}	// compare password
-							}		// compare user name
-						}	//if usr != NULL
-						if( curusrsess != NULL )
+						DEBUG("CHECK remote user: %s pass %s  provided pass %s uname param: %s\n", curusr->u_Name, curusr->u_Password, (char *)lpass, (char *)uname->hme_Data );
+						
+						FBOOL isUserSentinel = FALSE;
+						
+						Sentinel *sent = l->GetSentinelUser( l );
+						if( sent != NULL )
 						{
-							if( FRIEND_MUTEX_LOCK( &(curusrsess->us_Mutex) ) == 0 )
+							if( curusr == sent->s_User )
 							{
-								curusrsess->us_InUseCounter--;
-								FRIEND_MUTEX_UNLOCK( &(curusrsess->us_Mutex) );
+								isUserSentinel = TRUE;
 							}
 						}
-						curusrsess = (UserSession *)curusrsess->node.mln_Succ;
+						
+						if( isUserSentinel == TRUE || l->sl_ActiveAuthModule->CheckPassword( l->sl_ActiveAuthModule, *request, curusr, (char *)passwd->hme_Data, &blockedTime ) == TRUE )
+						{
+							loggedSession =  curusrsess;
+							userAdded = TRUE;		// there is no need to free resources
+						}	// compare password
+						
+						if( FRIEND_MUTEX_LOCK( &(curusrsess->us_Mutex) ) == 0 )
+						{
+							curusrsess->us_InUseCounter--;
+							FRIEND_MUTEX_UNLOCK( &(curusrsess->us_Mutex) );
+						}
 					}
 				}
 			}
 			else
 			{
-				DEBUG("CHECK1\n");
-				if( FRIEND_MUTEX_LOCK( &(l->sl_USM->usm_Mutex) ) == 0 )
+				UserSession *curusrsess = USMGetSessionBySessionIDOrMainSessionID( l->sl_USM, sessionid );
+				
+				// only sessions attached to user are accepted
+				if( curusrsess != NULL && curusrsess->us_User != NULL && curusrsess->us_User->u_MainSessionID != NULL )
 				{
-					UserSession *curusrsess = l->sl_USM->usm_Sessions;
-
-					while( curusrsess != NULL )
-					{
-						if( curusrsess != NULL )
-						{
-							if( FRIEND_MUTEX_LOCK( &(curusrsess->us_Mutex) ) == 0 )
-							{
-								curusrsess->us_InUseCounter++;
-								FRIEND_MUTEX_UNLOCK( &(curusrsess->us_Mutex) );
-							}
-						}
-						if( curusrsess->us_SessionID != NULL && curusrsess->us_User && curusrsess->us_User->u_MainSessionID != NULL )
-						{
-							if(  (strcmp( curusrsess->us_SessionID, sessionid ) == 0 || strcmp( curusrsess->us_User->u_MainSessionID, sessionid ) == 0 ) )
-							{
-
-								loggedSession = curusrsess;
-								userAdded = TRUE;		// there is no need to free resources
-								User *curusr = curusrsess->us_User;
-								if( curusr != NULL )
-								{
-									DEBUG("FOUND user: %s session sessionid %s provided session %s\n", curusr->u_Name, curusrsess->us_SessionID, sessionid );
-								}
-								if( curusrsess != NULL )
-								{
-									if( FRIEND_MUTEX_LOCK( &(curusrsess->us_Mutex) ) == 0 )
-									{
-										curusrsess->us_InUseCounter--;
-										FRIEND_MUTEX_UNLOCK( &(curusrsess->us_Mutex) );
-									}
-								}
-								break;
-							}
-						}
-						if( curusrsess != NULL )
-						{
-							if( FRIEND_MUTEX_LOCK( &(curusrsess->us_Mutex) ) == 0 )
-							{
-								curusrsess->us_InUseCounter--;
-								FRIEND_MUTEX_UNLOCK( &(curusrsess->us_Mutex) );
-							}
-						}
-						curusrsess = (UserSession *)curusrsess->node.mln_Succ;
-					}
-					FRIEND_MUTEX_UNLOCK( &(l->sl_USM->usm_Mutex) );
+					loggedSession = curusrsess;
+					userAdded = TRUE;		// there is no need to free resources
+					DEBUG("FOUND user: %s session sessionid %s provided session %s\n", curusrsess->us_User->u_Name, curusrsess->us_SessionID, sessionid );
 				}
-				DEBUG("CHECK1END\n");
 			}
 			
 			if( deviceid != NULL )
@@ -799,21 +752,7 @@ Http *SysWebRequest( SystemBase *l, char **urlpath, Http **request, UserSession
 				loggedSession->us_User->u_LoggedTime = timestamp;
 			}
 			
-			SQLLibrary *sqllib  = l->LibrarySQLGet( l );
-			if( sqllib != NULL )
-			{
-				char *tmpQuery = FCalloc( 1025, sizeof( char ) );
-				if( tmpQuery )
-				{
-					sqllib->SNPrintF( sqllib, tmpQuery, 1024, "UPDATE FUserSession SET `LoggedTime` = '%ld' WHERE `SessionID` = '%s'", timestamp, sessionid );
-					sqllib->QueryWithoutResults( sqllib, tmpQuery );
-				
-					INFO("Logged time updated: %lu\n", timestamp );
-				
-					FFree( tmpQuery );
-				}
-				l->LibrarySQLDrop( l, sqllib );
-			}
+			// value is stored in DB by USMSessionsFlushLoggedTime (EventManager)
 		}
 	}
 	
@@ -902,6 +841,7 @@ Http *SysWebRequest( SystemBase *l, char **urlpath, Http **request, UserSession
 	{
 		(*request)->http_UserSession = loggedSession;
 	}
+	LibrarySQLSetSession( l, loggedSession );
 	
 	if( strcmp( urlpath[ 0 ], "file" ) == 0 )
 	{
@@ -996,7 +936,11 @@ Http *SysWebRequest( SystemBase *l, char **urlpath, Http **request, UserSession
 		
 		HttpAddTextContent( response, "ok<!--separate-->{\"HELP\":\"commands: \"" 
 				"module - run module"
-				", clearcache - clear static files cache\""
+				", clearcache - clear static files cache"
+				", cachestats - static files cache statistics"
+				", permcachestats - file permissions and metadata cache statistics"
+				", sqlpoolstats - database connection pool statistics"
+				", tlsstats - TLS handshake and session ticket statistics\""
 				", \"groups\",\""
 				"user - functions releated to user and session management"
 				", device - functions releated to device management"
@@ -1610,6 +1554,119 @@ Http *SysWebRequest( SystemBase *l, char **urlpath, Http **request, UserSession
 		CacheManagerClearCache( l->cm );
 	}
 	
+	//
+	// cache statistics
+	//
+	
+	else if( strcmp( urlpath[ 0 ], "cachestats" ) == 0 )
+	{
+		response = HttpNewSimpleA( HTTP_200_OK, (*request),  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( "text/html", 9 ),
+			HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+		
+		char buffer[ 512 ];
+		if( UMUserIsAdmin( l->sl_UM, (*request), loggedSession->us_User ) == TRUE )
+		{
+			CacheManagerStats st;
+			CacheManagerGetStats( l->cm, &st );
+			snprintf( buffer, sizeof(buffer), "ok<!--separate-->{\"size\":%lu,\"max\":%lu,\"files\":%lu,\"hits\":%lu,\"misses\":%lu,\"evictions\":%lu,\"invalidations\":%lu}", 
+				st.cms_Size, st.cms_Max, st.cms_Files, st.cms_Hits, st.cms_Misses, st.cms_Evictions, st.cms_Invalidations );
+		}
+		else
+		{
+			snprintf( buffer, sizeof(buffer), "fail<!--separate-->{ \"response\": \"%s\", \"code\":\"%d\" }", l->sl_Dictionary->d_Msg[DICT_ADMIN_RIGHT_REQUIRED] , DICT_ADMIN_RIGHT_REQUIRED );
+		}
+		HttpAddTextContent( response, buffer );
+		*result = 200;
+	}
+	
+	//
+	// file permissions and metadata cache statistics
+	//
+	
+	else if( strcmp( urlpath[ 0 ], "permcachestats" ) == 0 )
+	{
+		response = HttpNewSimpleA( HTTP_200_OK, (*request),  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( "text/html", 9 ),
+			HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+		
+		char buffer[ 512 ];
+		if( UMUserIsAdmin( l->sl_UM, (*request), loggedSession->us_User ) == TRUE )
+		{
+			FSManagerStats st;
+			FSManagerGetStats( l->sl_FSM, &st );
+			snprintf( buffer, sizeof(buffer), "ok<!--separate-->{\"entries\":%lu,\"ttl\":%d,\"hits\":%lu,\"misses\":%lu,\"invalidations\":%lu,\"flushes\":%lu,\"metaentries\":%lu,\"metahits\":%lu,\"metamisses\":%lu}", 
+				st.fms_Entries, l->sl_PermissionsCacheTTL, st.fms_Hits, st.fms_Misses, st.fms_Invalidations, st.fms_Flushes, st.fms_MetaEntries, st.fms_MetaHits, st.fms_MetaMisses );
+		}
+		else
+		{
+			snprintf( buffer, sizeof(buffer), "fail<!--separate-->{ \"response\": \"%s\", \"code\":\"%d\" }", l->sl_Dictionary->d_Msg[DICT_ADMIN_RIGHT_REQUIRED] , DICT_ADMIN_RIGHT_REQUIRED );
+		}
+		HttpAddTextContent( response, buffer );
+		*result = 200;
+	}
+	
+	//
+	// database connection pool statistics
+	//
+	
+	else if( strcmp( urlpath[ 0 ], "sqlpoolstats" ) == 0 )
+	{
+		response = HttpNewSimpleA( HTTP_200_OK, (*request),  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( "text/html", 9 ),
+			HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+		
+		char buffer[ 1536 ];
+		if( UMUserIsAdmin( l->sl_UM, (*request), loggedSession->us_User ) == TRUE )
+		{
+			SQLPool *pools[ 2 ] = { l->sl_SQLPool, l->sl_SQLReplicaPool };
+			const char *names[ 2 ] = { "primary", "replica" };
+			int i, pos;
+			
+			pos = snprintf( buffer, sizeof(buffer), "ok<!--separate-->{\"replicasticky\":%lu,\"replicafallbacks\":%lu", l->sl_SQLReplicaSticky, l->sl_SQLReplicaFallbacks );
+			for( i=0 ; i < 2 ; i++ )
+			{
+				SQLPoolStats st;
+				if( pools[ i ] == NULL )
+				{
+					continue;
+				}
+				SQLPoolGetStats( pools[ i ], &st );
+				pos += snprintf( buffer + pos, sizeof(buffer) - pos, ",\"%s\":{\"opened\":%d,\"inuse\":%d,\"inusemax\":%d,\"waiting\":%d,\"broken\":%d,\"min\":%d,\"max\":%d,\"gets\":%lu,\"waits\":%lu,\"waittime\":%lu,\"waittimemax\":%lu,\"affinityhits\":%lu,\"created\":%lu,\"closed\":%lu,\"reconnects\":%lu,\"pingfailures\":%lu}", 
+					names[ i ], st.sps_Opened, st.sps_InUse, st.sps_InUseMax, st.sps_Waiting, st.sps_Broken, st.sps_Min, st.sps_Max, st.sps_Gets, st.sps_Waits, st.sps_WaitTime, st.sps_WaitTimeMax, st.sps_AffinityHits, st.sps_Created, st.sps_Closed, st.sps_Reconnects, st.sps_PingFailures );
+			}
+			snprintf( buffer + pos, sizeof(buffer) - pos, "}" );
+		}
+		else
+		{
+			snprintf( buffer, sizeof(buffer), "fail<!--separate-->{ \"response\": \"%s\", \"code\":\"%d\" }", l->sl_Dictionary->d_Msg[DICT_ADMIN_RIGHT_REQUIRED] , DICT_ADMIN_RIGHT_REQUIRED );
+		}
+		HttpAddTextContent( response, buffer );
+		*result = 200;
+	}
+	
+	//
+	// TLS handshake and session ticket statistics
+	//
+	
+	else if( strcmp( urlpath[ 0 ], "tlsstats" ) == 0 )
+	{
+		response = HttpNewSimpleA( HTTP_200_OK, (*request),  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( "text/html", 9 ),
+			HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+		
+		char buffer[ 512 ];
+		if( UMUserIsAdmin( l->sl_UM, (*request), loggedSession->us_User ) == TRUE )
+		{
+			TLSSessionStats st;
+			TLSSessionManagerGetStats( l->sl_TLSSessionManager, &st );
+			snprintf( buffer, sizeof(buffer), "ok<!--separate-->{\"tickets\":%d,\"keys\":%d,\"contexts\":%d,\"fullhandshakes\":%lu,\"resumedhandshakes\":%lu,\"ticketsissued\":%lu,\"ticketsrenewed\":%lu,\"ticketsunknown\":%lu,\"rotations\":%lu}", 
+				l->sl_TLSSessionManager != NULL ? l->sl_TLSSessionManager->tsm_Tickets : 0, st.tss_Keys, st.tss_Contexts, st.tss_FullHandshakes, st.tss_ResumedHandshakes, st.tss_TicketsIssued, st.tss_TicketsRenewed, st.tss_TicketsUnknown, st.tss_Rotations );
+		}
+		else
+		{
+			snprintf( buffer, sizeof(buffer), "fail<!--separate-->{ \"response\": \"%s\", \"code\":\"%d\" }", l->sl_Dictionary->d_Msg[DICT_ADMIN_RIGHT_REQUIRED] , DICT_ADMIN_RIGHT_REQUIRED );
+		}
+		HttpAddTextContent( response, buffer );
+		*result = 200;
+	}
+	
 	//
 	// USB
 	//
@@ -1928,37 +1985,14 @@ Http *SysWebRequest( SystemBase *l, char **urlpath, Http **request, UserSession
 
 					if( deviceid == NULL )
 					{
-						User *tuser = NULL;
-						
-						if( FRIEND_MUTEX_LOCK( &(l->sl_USM->usm_Mutex) ) == 0 )
+						// find user by name and take his session from session manager index
+						User *tuser = UMGetUserByName( l->sl_UM, usrname );
+						if( tuser != NULL )
 						{
-							tusers = l->sl_USM->usm_Sessions;
-
-							while( tusers != NULL )
-							{
-								tuser = tusers->us_User;
-								// Check both username and password
-
-								if( strcmp( tuser->u_Name, usrname ) == 0 )
-								{
-									FBOOL isUserSentinel = FALSE;
-							
-									Sentinel *sent = l->GetSentinelUser( l );
-									if( sent != NULL )
-									{
-										if( tuser == sent->s_User )
-										{
-											isUserSentinel = TRUE;
-										}
-									}
-									break;
-								}
-								tusers = (UserSession *)tusers->node.mln_Succ;
-							}
-							FRIEND_MUTEX_UNLOCK( &(l->sl_USM->usm_Mutex) );
+							tusers = USMGetSessionByUserID( l->sl_USM, tuser->u_ID );
 						}
 						
-						if( tuser != NULL )
+						if( tusers != NULL )
 						{
 							if( isUserSentinel == TRUE || l->sl_ActiveAuthModule->CheckPassword( l->sl_ActiveAuthModule, *request, tuser, pass, &blockedTime ) == TRUE )
 							{
@@ -1969,44 +2003,23 @@ Http *SysWebRequest( SystemBase *l, char **urlpath, Http **request, UserSession
 					}
 					else	// deviceid != NULL
 					{
+						// session with same device identity and user name, only sentinel flag is taken from it
+						User *tuser = UMGetUserByName( l->sl_UM, usrname );
+						if( tuser != NULL )
+						{
+							tusers = USMGetSessionByDeviceIDandUser( l->sl_USM, deviceid, tuser->u_ID );
+						}
 						
-						if( FRIEND_MUTEX_LOCK( &(l->sl_USM->usm_Mutex) ) == 0 )
+						if( tusers != NULL )
 						{
-							User *tuser = NULL;
-							
-							tusers = l->sl_USM->usm_Sessions;
-							while( tusers != NULL )
+							Sentinel *sent = l->GetSentinelUser( l );
+							if( sent != NULL )
 							{
-								User *tuser = tusers->us_User;
-								// Check both username and password
-
-								if( tusers->us_DeviceIdentity != NULL && tuser != NULL )
+								if( tuser == sent->s_User )
 								{
-									if( strcmp( tusers->us_DeviceIdentity, deviceid ) == 0 && strcmp( tuser->u_Name, usrname ) == 0 )
-									{
-										Sentinel *sent = l->GetSentinelUser( l );
-										if( sent != NULL )
-										{
-											if( tuser == sent->s_User )
-											{
-												isUserSentinel = TRUE;
-											}
-											DEBUG("Same identity, same user name, is sentinel %d  userptr %p sentinelptr %p\n", isUserSentinel, tuser, sent->s_User );
-										}
-										break;
-									}
-								}
-								tusers = (UserSession *)tusers->node.mln_Succ;
-							}
-							FRIEND_MUTEX_UNLOCK( &(l->sl_USM->usm_Mutex) );
-							
-							if( tuser != NULL )
-							{
-								if( isUserSentinel == TRUE || l->sl_ActiveAuthModule->CheckPassword( l->sl_ActiveAuthModule, *request, tuser, pass, &blockedTime ) == TRUE )
-								{
-									dstusrsess = tusers;
-									DEBUG("Found user session  id %s\n", tusers->us_SessionID );
+									isUserSentinel = TRUE;
 								}
+								DEBUG("Same identity, same user name, is sentinel %d  userptr %p sentinelptr %p\n", isUserSentinel, tuser, sent->s_User );
 							}
 						}
 					}
@@ -2400,3 +2413,23 @@ error:
 	return response;
 }
 
+/**
+ * Network handler. Database reads of request follow writes done for its user session.
+ *
+ * @param l pointer to SystemBase
+ * @param urlpath pointer to table with path entries
+ * @param request http request
+ * @param loggedSession user session when it is already known, otherwise NULL
+ * @param result pointer to place where result code will be stored
+ * @return http response
+ */
+
+Http *SysWebRequest( SystemBase *l, char **urlpath, Http **request, UserSession *loggedSession, int *result )
+{
+	// websocket worker sets session of connection before, it is restored for rest of its work
+	UserSession *prev = LibrarySQLSetSession( l, loggedSession );
+	Http *response = SysWebRequestProcess( l, urlpath, request, loggedSession, result );
+	LibrarySQLSetSession( l, prev );
+	return response;
+}
+
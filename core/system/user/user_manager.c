@@ -268,6 +268,7 @@ User *UMUserGetByName( UserManager *um, const char *name )
 User * UMUserGetByNameDB( UserManager *um, const char *name )
 {
 	SystemBase *sb = (SystemBase *)um->um_SB;
+	// used by login and by check before user is created, replica could miss newest users
 	SQLLibrary *sqlLib = sb->LibrarySQLGet( sb );
 	
 	if( sqlLib == NULL )
@@ -277,11 +278,10 @@ User * UMUserGetByNameDB( UserManager *um, const char *name )
 	}
 
 	User *user = NULL;
-	char tmpQuery[ 1024 ];
-	sqlLib->SNPrintF( sqlLib, tmpQuery, sizeof(tmpQuery)," Name = '%s'", name );
+	FULONG params[] = { SQLT_STR, (FULONG)name, SQLT_END };
 	
 	int entries;
-	user = sqlLib->Load( sqlLib, UserDesc, tmpQuery, &entries );
+	user = sqlLib->LoadParams( sqlLib, UserDesc, "Name=?", params, &entries );
 	
 	// No need for sql lib anymore here
 	sb->LibrarySQLDrop( sb, sqlLib );
@@ -320,12 +320,10 @@ User * UMUserGetByIDDB( UserManager *um, FULONG id )
 	}
 
 	User *user = NULL;
-	char tmpQuery[ 1024 ];
-
-	sqlLib->SNPrintF( sqlLib, tmpQuery, sizeof(tmpQuery)," ID = '%lu'", id );
+	FULONG params[] = { SQLT_INT, id, SQLT_END };
 	
 	int entries = 0;
-	user = sqlLib->Load( sqlLib, UserDesc, tmpQuery, &entries );
+	user = sqlLib->LoadParams( sqlLib, UserDesc, "ID=?", params, &entries );
 	
 	DEBUG("[UMUserGetByIDDB] User poitner %p  number of entries %d\n", user, entries );
 	// No need for sql lib anymore here
@@ -660,16 +658,13 @@ User *UMGetUserByNameDB( UserManager *um, const char *name )
 	
 	if( sqlLib != NULL )
 	{
-		int len = strlen(name)+128;
-		char *where = FMalloc( len );
+		FULONG params[] = { SQLT_STR, (FULONG)name, SQLT_END };
 	
 		DEBUG("[UMGetUserByNameDB] start\n");
-
-		sqlLib->SNPrintF( sqlLib, where, len, " `Name`='%s'", name );
 	
 		int entries;
 	
-		user = ( struct User *)sqlLib->Load( sqlLib, UserDesc, where, &entries );
+		user = ( struct User *)sqlLib->LoadParams( sqlLib, UserDesc, "`Name`=?", params, &entries );
 		sb->LibrarySQLDrop( sb, sqlLib );
 
 		User *tmp = user;
@@ -680,7 +675,6 @@ User *UMGetUserByNameDB( UserManager *um, const char *name )
 		
 			tmp = (User *)tmp->node.mln_Succ;
 		}
-		FFree( where );
 	}
 	
 	DEBUG("[UMGetUserByNameDB] end\n");
@@ -707,16 +701,13 @@ User *UMGetUserByUUIDDB( UserManager *um, const char *uuid, FBOOL loadAndAssign
 	
 	if( sqlLib != NULL )
 	{
-		int len = strlen( uuid )+128;
-		char *where = FMalloc( len );
+		FULONG params[] = { SQLT_STR, (FULONG)uuid, SQLT_END };
 	
 		DEBUG("[UMGetUserByNameDB] start\n");
-
-		sqlLib->SNPrintF( sqlLib, where, len, " `UniqueID`='%s'", uuid );
 	
 		int entries;
 	
-		user = ( struct User *)sqlLib->Load( sqlLib, UserDesc, where, &entries );
+		user = ( struct User *)sqlLib->LoadParams( sqlLib, UserDesc, "`UniqueID`=?", params, &entries );
 		sb->LibrarySQLDrop( sb, sqlLib );
 
 		if( loadAndAssign == TRUE )
@@ -730,7 +721,6 @@ User *UMGetUserByUUIDDB( UserManager *um, const char *uuid, FBOOL loadAndAssign
 				tmp = (User *)tmp->node.mln_Succ;
 			}
 		}
-		FFree( where );
 	}
 	
 	DEBUG("[UMGetUserByNameDB] end\n");
@@ -757,19 +747,14 @@ User *UMGetOnlyUserByUUIDDB( UserManager *um, const char *uuid )
 	
 	if( sqlLib != NULL )
 	{
-		int len = strlen( uuid )+128;
-		char *where = FMalloc( len );
+		FULONG params[] = { SQLT_STR, (FULONG)uuid, SQLT_END };
 	
 		DEBUG("[UMGetUserByNameDB] start\n");
-
-		sqlLib->SNPrintF( sqlLib, where, len, " `UniqueID`='%s'", uuid );
 	
 		int entries;
 	
-		user = ( struct User *)sqlLib->Load( sqlLib, UserDesc, where, &entries );
+		user = ( struct User *)sqlLib->LoadParams( sqlLib, UserDesc, "`UniqueID`=?", params, &entries );
 		sb->LibrarySQLDrop( sb, sqlLib );
-
-		FFree( where );
 	}
 	
 	DEBUG("[UMGetUserByNameDB] end\n");
@@ -786,8 +771,7 @@ User *UMGetOnlyUserByUUIDDB( UserManager *um, const char *uuid )
 User *UMGetUserByNameDBCon( UserManager *um, SQLLibrary *sqlLib, const char *name )
 {
 	SystemBase *sb = (SystemBase *)um->um_SB;
-	char where[ 128 ];
-	where[ 0 ] = 0;
+	FULONG params[] = { SQLT_STR, (FULONG)name, SQLT_END };
 	
 	DEBUG("[UMGetUserByNameDB] start\n");
 	
@@ -796,13 +780,11 @@ User *UMGetUserByNameDBCon( UserManager *um, SQLLibrary *sqlLib, const char *nam
 		FERROR("Cannot get user, mysql.library was not open\n");
 		return NULL;
 	}
-
-	sqlLib->SNPrintF( sqlLib, where, sizeof(where), " `Name` = '%s'", name );
 	
 	struct User *user = NULL;
 	int entries;
 	
-	user = ( struct User *)sqlLib->Load( sqlLib, UserDesc, where, &entries );
+	user = ( struct User *)sqlLib->LoadParams( sqlLib, UserDesc, "`Name`=?", params, &entries );
 	
 	User *tmp = user;
 	while( tmp != NULL )
@@ -879,8 +861,7 @@ FULONG UMGetUserIDByName( UserManager *um, const char *name )
 User *UMGetUserByIDDB( UserManager *um, FULONG id )
 {
 	SystemBase *sb = (SystemBase *)um->um_SB;
-	char where[ 128 ];
-	where[ 0 ] = 0;
+	FULONG params[] = { SQLT_INT, id, SQLT_END };
 	
 	DEBUG("[UMGetUserByNameDB] start\n");
 	
@@ -890,13 +871,11 @@ User *UMGetUserByIDDB( UserManager *um, FULONG id )
 		FERROR("Cannot get user, mysql.library was not open\n");
 		return NULL;
 	}
-
-	sqlLib->SNPrintF( sqlLib, where, sizeof(where), " `ID` = '%lu'", id );
 	
 	struct User *user = NULL;
 	int entries;
 	
-	user = ( struct User *)sqlLib->Load( sqlLib, UserDesc, where, &entries );
+	user = ( struct User *)sqlLib->LoadParams( sqlLib, UserDesc, "`ID`=?", params, &entries );
 	sb->LibrarySQLDrop( sb, sqlLib );
 	
 	User *tmp = user;
@@ -133,18 +133,21 @@ void UserSessionDelete( UserSession *us )
 		{
 			us->us_Wsi = NULL;
 			data = (WSCData *)us->us_WSD;
-			//us->us_WSD = NULL;
+			if( data != NULL )
+			{
+				WSCDataAcquire( data );
+			}
 			FRIEND_MUTEX_UNLOCK( &(us->us_Mutex) );
 		}
 		
-		if( us->us_WSD != NULL )
+		// connection stays open, but it is not attached to session anymore
+		if( data != NULL )
 		{
 			if( FRIEND_MUTEX_LOCK( &(data->wsc_Mutex) ) == 0 )
 			{
-				if( us->us_WSD != NULL )
+				if( data->wsc_UserSession == us )
 				{
 					data->wsc_UserSession = NULL;
-					data->wsc_Wsi = NULL;
 				}
 				FRIEND_MUTEX_UNLOCK( &(data->wsc_Mutex) );
 			}
@@ -157,6 +160,13 @@ void UserSessionDelete( UserSession *us )
 			FRIEND_MUTEX_UNLOCK( &(us->us_Mutex) );
 		}
 		
+		// connection could be in the middle of binary message, service thread must finish it
+		if( data != NULL )
+		{
+			WebSocketRequestWritable( data );
+			WSCDataRelease( data );
+		}
+		
 		//UserSessionWebsocketDeInit( &(us->us_Websockets) );
 
 		DEBUG("[UserSessionDelete] Session released  sessid: %s device: %s \n", us->us_SessionID, us->us_DeviceIdentity );
@@ -208,6 +218,112 @@ void UserSessionDelete( UserSession *us )
 
 #define MAX_SIZE_WS_MESSAGE (WS_PROTOCOL_BUFFER_SIZE-2048)
 
+/**
+ * Write big message as one binary websocket message split into fragments.
+ * Used only when client selected FC-protocol-binary, other clients get base64 chunks.
+ *
+ * @param us pointer to UserSession
+ * @param msgptr pointer to message
+ * @param msglen length of the messsage
+ * @return number of bytes queued or -1 when connection does not use binary protocol
+ */
+static int UserSessionWebsocketWriteFragments( UserSession *us, unsigned char *msgptr, int msglen )
+{
+	WSCData *wsd = NULL;
+	
+	if( FRIEND_MUTEX_LOCK( &(us->us_Mutex) ) == 0 )
+	{
+		wsd = us->us_WSD;
+		if( wsd != NULL && wsd->wsc_Binary == TRUE )
+		{
+			WSCDataAcquire( wsd );
+		}
+		else
+		{
+			wsd = NULL;
+		}
+		FRIEND_MUTEX_UNLOCK( &(us->us_Mutex) );
+	}
+	
+	if( wsd == NULL )
+	{
+		return -1;
+	}
+	
+	// all fragments are allocated first, message cannot be sent without its last fragment
+	int totalFragments = ( msglen + MAX_SIZE_WS_MESSAGE - 1 ) / MAX_SIZE_WS_MESSAGE;
+	FQEntry *first = NULL;
+	FQEntry *last = NULL;
+	int fragment, pos = 0;
+	
+	for( fragment = 0 ; fragment < totalFragments ; fragment++ )
+	{
+		int size = msglen - pos;
+		if( size > MAX_SIZE_WS_MESSAGE )
+		{
+			size = MAX_SIZE_WS_MESSAGE;
+		}
+		
+		FQEntry *en = FCalloc( 1, sizeof( FQEntry ) );
+		if( en == NULL || ( en->fq_Data = FMalloc( size+10+LWS_SEND_BUFFER_PRE_PADDING+LWS_SEND_BUFFER_POST_PADDING ) ) == NULL )
+		{
+			FERROR("[UserSessionWebsocketWriteFragments] Cannot allocate memory for fragment\n");
+			if( en != NULL )
+			{
+				FFree( en );
+			}
+			while( first != NULL )
+			{
+				FQEntry *next = (FQEntry *)first->node.mln_Succ;
+				FFree( first->fq_Data );
+				FFree( first );
+				first = next;
+			}
+			WSCDataRelease( wsd );
+			return 0;
+		}
+		
+		memcpy( en->fq_Data+LWS_SEND_BUFFER_PRE_PADDING, msgptr+pos, size );
+		en->fq_Size = size;
+		en->fq_Priority = 3;	// default priority
+		en->fq_Flags = ( fragment == 0 ) ? LWS_WRITE_BINARY : LWS_WRITE_CONTINUATION;
+		if( fragment < totalFragments-1 )
+		{
+			en->fq_Flags |= LWS_WRITE_NO_FIN;
+		}
+		pos += size;
+		
+		if( last == NULL )
+		{
+			first = en;
+		}
+		else
+		{
+			last->node.mln_Succ = (MinNode *)en;
+		}
+		last = en;
+	}
+	
+	DEBUG("[UserSessionWebsocketWriteFragments] Sending big message, size %d (%d fragments)\n", msglen, totalFragments );
+	
+	if( FRIEND_MUTEX_LOCK( &(us->us_Mutex) ) == 0 )
+	{
+		while( first != NULL )
+		{
+			FQEntry *next = (FQEntry *)first->node.mln_Succ;
+			first->node.mln_Succ = NULL;
+			FQPushFIFO( &(us->us_MsgQueue), first );
+			first = next;
+		}
+		FRIEND_MUTEX_UNLOCK( &(us->us_Mutex) );
+	}
+	
+	WebSocketRequestWritable( wsd );
+	WSCDataRelease( wsd );
+	
+	return msglen;
+}
+
 /**
  * Write data to websockets
  * If message is bigger then WS buffer then message is encoded, splitted and send
@@ -228,6 +344,13 @@ int UserSessionWebsocketWrite( UserSession *us, unsigned char *msgptr, int msgle
 		return 0;
 	}
 
+	// binary clients get big message in fragments, without base64 and JSON envelopes
+	if( msglen > MAX_SIZE_WS_MESSAGE && ( retval = UserSessionWebsocketWriteFragments( us, msgptr, msglen ) ) >= 0 )
+	{
+		return retval;
+	}
+	retval = 0;
+	
 	if( msglen > MAX_SIZE_WS_MESSAGE ) // message is too big, we must split data into chunks
 	{
 		DEBUG("[UserSessionWebsocketWrite] WebsocketWrite\n");
@@ -299,29 +422,18 @@ int UserSessionWebsocketWrite( UserSession *us, unsigned char *msgptr, int msgle
 					
 					us->us_InUseCounter--;
 				
+					// connection data cannot be released while we use it
 					WSCData *wsd = us->us_WSD;
+					if( wsd != NULL )
+					{
+						WSCDataAcquire( wsd );
+					}
 					FRIEND_MUTEX_UNLOCK( &(us->us_Mutex) );
 					
-					if( us->us_WSD != NULL )
+					if( wsd != NULL )
 					{
-						
-						if( FRIEND_MUTEX_LOCK( &(wsd->wsc_Mutex) ) == 0 )
-						{
-							wsd->wsc_InUseCounter++;
-							FRIEND_MUTEX_UNLOCK( &(wsd->wsc_Mutex) );
-						
-							if( wsd->wsc_Wsi != NULL )
-							{
-								lws_callback_on_writable( wsd->wsc_Wsi );
-								lws_cancel_service_pt( wsd->wsc_Wsi );
-							}
-						
-							if( FRIEND_MUTEX_LOCK( &(wsd->wsc_Mutex) ) == 0 )
-							{
-								wsd->wsc_InUseCounter--;
-								FRIEND_MUTEX_UNLOCK( &(wsd->wsc_Mutex) );
-							}
-						}
+						WebSocketRequestWritable( wsd );
+						WSCDataRelease( wsd );
 					}
 				}
 			}
@@ -338,7 +450,11 @@ int UserSessionWebsocketWrite( UserSession *us, unsigned char *msgptr, int msgle
 				DEBUG("[UserSessionWebsocketWrite] pointer usersession %p msglen %d\n", us, msglen );
 				DEBUG("[UserSessionWebsocketWrite] pointer us_WSD %p\n", us->us_WSD );
 				WSCData *wsd = us->us_WSD;
-				// double check
+				// connection data cannot be released while we use it
+				if( wsd != NULL )
+				{
+					WSCDataAcquire( wsd );
+				}
 				DEBUG("[UserSessionWebsocketWrite] no chnked 1\n");
 
 				us->us_InUseCounter++;
@@ -374,23 +490,10 @@ int UserSessionWebsocketWrite( UserSession *us, unsigned char *msgptr, int msgle
 
 				FRIEND_MUTEX_UNLOCK( &(us->us_Mutex) );
 				
-				if( us->us_Wsi != NULL )
+				if( wsd != NULL )
 				{
-					if( FRIEND_MUTEX_LOCK( &(wsd->wsc_Mutex) ) == 0 )
-					{
-						wsd->wsc_InUseCounter++;
-						FRIEND_MUTEX_UNLOCK( &(wsd->wsc_Mutex) );
-						if( wsd->wsc_Wsi != NULL )
-						{
-							lws_callback_on_writable( wsd->wsc_Wsi );
-							lws_cancel_service_pt( wsd->wsc_Wsi );
-						}
-						if( FRIEND_MUTEX_LOCK( &(wsd->wsc_Mutex) ) == 0 )
-						{
-							wsd->wsc_InUseCounter--;
-							FRIEND_MUTEX_UNLOCK( &(wsd->wsc_Mutex) );
-						}
-					}
+					WebSocketRequestWritable( wsd );
+					WSCDataRelease( wsd );
 				}
 				
 				// we have to be sure that us->us_Wsi is not equal to NULL
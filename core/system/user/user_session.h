@@ -50,6 +50,18 @@ CREATE TABLE IF NOT EXISTS `FUserSession` (
 
 */
 
+//
+// UserSessionManager hash indexes in which session is registered
+//
+
+enum
+{
+	USM_INDEX_SESSIONID = 0,
+	USM_INDEX_USERID,
+	USM_INDEX_DEVICE,
+	USM_INDEX_MAX
+};
+
 //
 // user session structure
 //
@@ -65,6 +77,8 @@ typedef struct UserSession
 	char					*us_DeviceIdentity;			// device identity
 	char					*us_SessionID;				// session id
 	time_t					us_LoggedTime;				// last update from user
+	time_t					us_LoggedTimeSaved;			// LoggedTime which was stored in DB (USMSessionsFlushLoggedTime)
+	time_t					us_LastSQLWrite;			// last database write done for session, its reads go to primary for a while
 	int						us_LoginStatus;				// login status
 	
 	File					*us_OpenedFiles;			// opened files in user session
@@ -89,6 +103,11 @@ typedef struct UserSession
 	FQueue					us_MsgQueue;			// message queue
 	time_t					us_LastPingTime;		// ping timestamp
 	void					*us_WSD;				// pointer to WebsocketData
+	
+	// UserSessionManager registry
+	struct UserSession		*us_IndexNext[ USM_INDEX_MAX ];	// next session in hash bucket
+	unsigned int			us_IndexHash[ USM_INDEX_MAX ];	// hash under which session was registered
+	FBOOL					us_Indexed;				// TRUE when session is in indexes
 }UserSession;
 
 //
@@ -25,6 +25,268 @@
 #include <system/fsys/door_notification.h>
 #include <util/session_id.h>
 
+//
+// Session registry
+//
+// Every session on usm_Sessions list is also registered in three hash indexes
+// (session id, user id, user id + device identity). Indexes are protected by usm_Mutex,
+// the same lock which protects the list.
+//
+
+/**
+ * Calculate hash of string (FNV-1a)
+ *
+ * @param str string, NULL is handled as empty string
+ * @param hash initial value
+ * @return hash value
+ */
+static inline unsigned int USMHashString( const char *str, unsigned int hash )
+{
+	if( str != NULL )
+	{
+		while( *str != 0 )
+		{
+			hash ^= (unsigned char)*str++;
+			hash *= 16777619U;
+		}
+	}
+	return hash;
+}
+
+/**
+ * Calculate hash of user id
+ *
+ * @param uid user id
+ * @return hash value
+ */
+static inline unsigned int USMHashUserID( FULONG uid )
+{
+	return (unsigned int)( ( uid ^ ( uid >> 32 ) ) * 2654435761U );
+}
+
+/**
+ * Calculate hash of user id and device identity
+ *
+ * @param uid user id
+ * @param devid device identity
+ * @return hash value
+ */
+static inline unsigned int USMHashDevice( FULONG uid, const char *devid )
+{
+	return USMHashString( devid, 2166136261U ^ USMHashUserID( uid ) );
+}
+
+/**
+ * Put session into index buckets (usm_Mutex must be locked)
+ *
+ * @param smgr pointer to UserSessionManager
+ * @param us pointer to UserSession
+ */
+static inline void USMIndexLink( UserSessionManager *smgr, UserSession *us )
+{
+	int i;
+	for( i=0 ; i < USM_INDEX_MAX ; i++ )
+	{
+		unsigned int pos = us->us_IndexHash[ i ] & ( smgr->usm_IndexSize - 1 );
+		us->us_IndexNext[ i ] = smgr->usm_Index[ i ][ pos ];
+		smgr->usm_Index[ i ][ pos ] = us;
+	}
+}
+
+/**
+ * Change number of buckets in indexes (usm_Mutex must be locked)
+ *
+ * @param smgr pointer to UserSessionManager
+ * @param size new number of buckets (power of 2)
+ * @return 0 when success, otherwise error number
+ */
+static int USMIndexResize( UserSessionManager *smgr, unsigned int size )
+{
+	UserSession **index[ USM_INDEX_MAX ];
+	int i;
+	
+	for( i=0 ; i < USM_INDEX_MAX ; i++ )
+	{
+		if( ( index[ i ] = FCalloc( size, sizeof( UserSession *) ) ) == NULL )
+		{
+			FERROR("[USMIndexResize] Cannot allocate memory for index\n");
+			while( --i >= 0 )
+			{
+				FFree( index[ i ] );
+			}
+			return 1;
+		}
+	}
+	
+	// collect all sessions from old buckets (session id index contains all of them)
+	UserSession *all = NULL;
+	if( smgr->usm_Index[ USM_INDEX_SESSIONID ] != NULL )
+	{
+		unsigned int b;
+		for( b=0 ; b < smgr->usm_IndexSize ; b++ )
+		{
+			UserSession *us = smgr->usm_Index[ USM_INDEX_SESSIONID ][ b ];
+			while( us != NULL )
+			{
+				UserSession *next = us->us_IndexNext[ USM_INDEX_SESSIONID ];
+				us->us_IndexNext[ USM_INDEX_USERID ] = all;
+				all = us;
+				us = next;
+			}
+		}
+	}
+	
+	for( i=0 ; i < USM_INDEX_MAX ; i++ )
+	{
+		if( smgr->usm_Index[ i ] != NULL )
+		{
+			FFree( smgr->usm_Index[ i ] );
+		}
+		smgr->usm_Index[ i ] = index[ i ];
+	}
+	smgr->usm_IndexSize = size;
+	
+	while( all != NULL )
+	{
+		UserSession *next = all->us_IndexNext[ USM_INDEX_USERID ];
+		USMIndexLink( smgr, all );
+		all = next;
+	}
+	return 0;
+}
+
+/**
+ * Register session in indexes (usm_Mutex must be locked)
+ *
+ * @param smgr pointer to UserSessionManager
+ * @param us pointer to UserSession
+ */
+static void USMIndexAdd( UserSessionManager *smgr, UserSession *us )
+{
+	if( us->us_Indexed == TRUE || smgr->usm_Index[ USM_INDEX_SESSIONID ] == NULL )
+	{
+		return;
+	}
+	
+	// keep chains short
+	if( (unsigned int)smgr->usm_IndexCount >= ( smgr->usm_IndexSize << 1 ) )
+	{
+		USMIndexResize( smgr, smgr->usm_IndexSize << 1 );
+	}
+	
+	// hashes are stored, so session can be removed even if its fields were changed
+	us->us_IndexHash[ USM_INDEX_SESSIONID ] = USMHashString( us->us_SessionID, 2166136261U );
+	us->us_IndexHash[ USM_INDEX_USERID ] = USMHashUserID( us->us_UserID );
+	us->us_IndexHash[ USM_INDEX_DEVICE ] = USMHashDevice( us->us_UserID, us->us_DeviceIdentity );
+	
+	USMIndexLink( smgr, us );
+	us->us_Indexed = TRUE;
+	smgr->usm_IndexCount++;
+}
+
+/**
+ * Remove session from indexes (usm_Mutex must be locked)
+ *
+ * @param smgr pointer to UserSessionManager
+ * @param us pointer to UserSession
+ */
+static void USMIndexRemove( UserSessionManager *smgr, UserSession *us )
+{
+	int i;
+	
+	if( us->us_Indexed == FALSE )
+	{
+		return;
+	}
+	
+	for( i=0 ; i < USM_INDEX_MAX ; i++ )
+	{
+		UserSession **link = &(smgr->usm_Index[ i ][ us->us_IndexHash[ i ] & ( smgr->usm_IndexSize - 1 ) ]);
+		while( *link != NULL )
+		{
+			if( *link == us )
+			{
+				*link = us->us_IndexNext[ i ];
+				break;
+			}
+			link = &((*link)->us_IndexNext[ i ]);
+		}
+		us->us_IndexNext[ i ] = NULL;
+	}
+	us->us_Indexed = FALSE;
+	smgr->usm_IndexCount--;
+}
+
+/**
+ * Find session by session id in index (usm_Mutex must be locked)
+ *
+ * @param smgr pointer to UserSessionManager
+ * @param sessionid session id
+ * @return pointer to UserSession or NULL when session was not found
+ */
+static inline UserSession *USMIndexFindSessionID( UserSessionManager *smgr, const char *sessionid )
+{
+	unsigned int hash = USMHashString( sessionid, 2166136261U );
+	UserSession *us = smgr->usm_Index[ USM_INDEX_SESSIONID ][ hash & ( smgr->usm_IndexSize - 1 ) ];
+	
+	while( us != NULL )
+	{
+		if( us->us_IndexHash[ USM_INDEX_SESSIONID ] == hash && us->us_SessionID != NULL && strcmp( sessionid, us->us_SessionID ) == 0 )
+		{
+			return us;
+		}
+		us = us->us_IndexNext[ USM_INDEX_SESSIONID ];
+	}
+	return NULL;
+}
+
+/**
+ * Find session by user id and device identity in index (usm_Mutex must be locked)
+ *
+ * @param smgr pointer to UserSessionManager
+ * @param uid user id
+ * @param devid device identity, NULL finds session without device identity
+ * @return pointer to UserSession or NULL when session was not found
+ */
+static inline UserSession *USMIndexFindDevice( UserSessionManager *smgr, FULONG uid, const char *devid )
+{
+	unsigned int hash = USMHashDevice( uid, devid );
+	UserSession *us = smgr->usm_Index[ USM_INDEX_DEVICE ][ hash & ( smgr->usm_IndexSize - 1 ) ];
+	
+	while( us != NULL )
+	{
+		if( us->us_IndexHash[ USM_INDEX_DEVICE ] == hash && us->us_UserID == uid )
+		{
+			if( devid == NULL ? us->us_DeviceIdentity == NULL : ( us->us_DeviceIdentity != NULL && strcmp( devid, us->us_DeviceIdentity ) == 0 ) )
+			{
+				return us;
+			}
+		}
+		us = us->us_IndexNext[ USM_INDEX_DEVICE ];
+	}
+	return NULL;
+}
+
+/**
+ * Register again all sessions which are on list (used after list was loaded from DB)
+ *
+ * @param smgr pointer to UserSessionManager
+ */
+void USMRebuildIndex( UserSessionManager *smgr )
+{
+	if( FRIEND_MUTEX_LOCK( &(smgr->usm_Mutex) ) == 0 )
+	{
+		UserSession *us = smgr->usm_Sessions;
+		while( us != NULL )
+		{
+			USMIndexRemove( smgr, us );
+			USMIndexAdd( smgr, us );
+			us = (UserSession *) us->node.mln_Succ;
+		}
+		FRIEND_MUTEX_UNLOCK( &(smgr->usm_Mutex) );
+	}
+}
+
 /**
  * Create new User Session Manager
  *
@@ -39,6 +301,12 @@ UserSessionManager *USMNew( void *sb )
 	{
 		sm->usm_SB = sb;
 		
+		if( USMIndexResize( sm, USM_INDEX_INITIAL_SIZE ) != 0 )
+		{
+			FFree( sm );
+			return NULL;
+		}
+		
 		pthread_mutex_init( &(sm->usm_Mutex), NULL );
 
 		return sm;
@@ -68,6 +336,15 @@ void USMDelete( UserSessionManager *smgr )
 		}
 		smgr->usm_Sessions = NULL;
 		
+		int i;
+		for( i=0 ; i < USM_INDEX_MAX ; i++ )
+		{
+			if( smgr->usm_Index[ i ] != NULL )
+			{
+				FFree( smgr->usm_Index[ i ] );
+			}
+		}
+		
 		pthread_mutex_destroy( &(smgr->usm_Mutex) );
 		
 		FFree( smgr );
@@ -83,20 +360,18 @@ void USMDelete( UserSessionManager *smgr )
  */
 User *USMGetUserBySessionID( UserSessionManager *usm, char *sessionid )
 {
-	DEBUG("CHECK3\n");
-	FRIEND_MUTEX_LOCK( &(usm->usm_Mutex) );
-	UserSession *us = usm->usm_Sessions;
-	while( us != NULL )
+	User *usr = NULL;
+	
+	if( sessionid != NULL && FRIEND_MUTEX_LOCK( &(usm->usm_Mutex) ) == 0 )
 	{
-		if( strcmp( sessionid, us->us_SessionID ) == 0 )
+		UserSession *us = USMIndexFindSessionID( usm, sessionid );
+		if( us != NULL )
 		{
-			FRIEND_MUTEX_UNLOCK( &(usm->usm_Mutex) );
-			return us->us_User;
+			usr = us->us_User;
 		}
-		us = (UserSession *) us->node.mln_Succ;
+		FRIEND_MUTEX_UNLOCK( &(usm->usm_Mutex) );
 	}
-	FRIEND_MUTEX_UNLOCK( &(usm->usm_Mutex) );
-	return NULL;
+	return usr;
 }
 
 /**
@@ -114,25 +389,52 @@ UserSession *USMGetSessionBySessionID( UserSessionManager *usm, char *sessionid
         FERROR("Sessionid is NULL!\n");
         return NULL;
     }
-    DEBUG("CHECK4\n");
+	UserSession *us = NULL;
 	
 	if( FRIEND_MUTEX_LOCK( &(usm->usm_Mutex) ) == 0 )
 	{
-		UserSession *us = usm->usm_Sessions;
-		while( us != NULL )
+		us = USMIndexFindSessionID( usm, sessionid );
+		FRIEND_MUTEX_UNLOCK( &(usm->usm_Mutex) );
+	}
+	return us;
+}
+
+/**
+ * Get UserSession by sessionid or by main sessionid of User
+ *
+ * Session id is taken from index. Main session id belongs to User and can be regenerated
+ * at any time, so it is only checked when session id was not found.
+ *
+ * @param usm pointer to UserSessionManager
+ * @param sessionid sessionid as string
+ * @return pointer to UserSession structure
+ */
+UserSession *USMGetSessionBySessionIDOrMainSessionID( UserSessionManager *usm, char *sessionid )
+{
+	UserSession *us = NULL;
+	
+	if( sessionid == NULL )
+	{
+		return NULL;
+	}
+	
+	if( FRIEND_MUTEX_LOCK( &(usm->usm_Mutex) ) == 0 )
+	{
+		if( ( us = USMIndexFindSessionID( usm, sessionid ) ) == NULL )
 		{
-			if( strcmp( sessionid, us->us_SessionID ) == 0 )
+			us = usm->usm_Sessions;
+			while( us != NULL )
 			{
-				DEBUG("CHECK4END\n");
-				FRIEND_MUTEX_UNLOCK( &(usm->usm_Mutex) );
-				return us;
+				if( us->us_User != NULL && us->us_User->u_MainSessionID != NULL && strcmp( us->us_User->u_MainSessionID, sessionid ) == 0 )
+				{
+					break;
+				}
+				us = (UserSession *) us->node.mln_Succ;
 			}
-			us = (UserSession *) us->node.mln_Succ;
 		}
-		DEBUG("CHECK4END\n");
 		FRIEND_MUTEX_UNLOCK( &(usm->usm_Mutex) );
 	}
-	return NULL;
+	return us;
 }
 
 /**
@@ -146,17 +448,16 @@ UserSession *USMGetSessionBySessionIDFromDB( UserSessionManager *smgr, char *id
 {
 	SystemBase *sb = (SystemBase *)smgr->usm_SB;
 	struct UserSession *usersession = NULL;
-	char tmpQuery[ 1024 ];
 	
 	SQLLibrary *sqlLib = sb->LibrarySQLGet( sb );
 	if( sqlLib != NULL )
 	{
 		int entries = 0;
-		sqlLib->SNPrintF( sqlLib, tmpQuery, sizeof(tmpQuery)," SessionID='%s'", id );
+		FULONG params[] = { SQLT_STR, (FULONG)id, SQLT_END };
 	
-		DEBUG( "[USMGetSessionBySessionIDFromDB] Sending query: %s...\n", tmpQuery );
+		DEBUG( "[USMGetSessionBySessionIDFromDB] Loading session: %s...\n", id );
 
-		usersession = ( struct UserSession *)sqlLib->Load( sqlLib, UserSessionDesc, tmpQuery, &entries );
+		usersession = ( struct UserSession *)sqlLib->LoadParams( sqlLib, UserSessionDesc, "SessionID=?", params, &entries );
 		sb->LibrarySQLDrop( sb, sqlLib );
 	}
 	else
@@ -180,24 +481,14 @@ UserSession *USMGetSessionBySessionIDFromDB( UserSessionManager *smgr, char *id
 UserSession *USMGetSessionByDeviceIDandUser( UserSessionManager *usm, char *devid, FULONG uid )
 {
 	DEBUG("[USMGetSessionByDeviceIDandUser] new, deviceid: >%s<\n", devid );
- 	if( FRIEND_MUTEX_LOCK( &(usm->usm_Mutex) ) == 0 )
+	UserSession *us = NULL;
+	
+	if( devid != NULL && FRIEND_MUTEX_LOCK( &(usm->usm_Mutex) ) == 0 )
 	{
-		UserSession *us = usm->usm_Sessions;
-		while( us != NULL )
-		{
-			DEBUG("[USMGetSessionByDeviceIDandUser] userid >%ld< devidentity >%s<\n", us->us_UserID, us->us_DeviceIdentity );
-			if( us->us_UserID == uid && us->us_DeviceIdentity != NULL && strcmp( devid, us->us_DeviceIdentity ) == 0 )
-			{
-				DEBUG("[USMGetSessionByDeviceIDandUser] found user by deviceid: %s\n", devid );
-				FRIEND_MUTEX_UNLOCK( &(usm->usm_Mutex) );
-				return us;
-			}
-			us = (UserSession *) us->node.mln_Succ;
-		}
-		DEBUG("[USMGetSessionByDeviceIDandUser] end\n");
+		us = USMIndexFindDevice( usm, uid, devid );
 		FRIEND_MUTEX_UNLOCK( &(usm->usm_Mutex) );
 	}
-	return NULL;
+	return us;
 }
 
 /**
@@ -212,20 +503,16 @@ UserSession *USMGetSessionByDeviceIDandUserDB( UserSessionManager *smgr, char *d
 {
 	SystemBase *sb = (SystemBase *)smgr->usm_SB;
 	struct UserSession *usersession = NULL;
-	char tmpQuery[ 1024 ];
 	
 	SQLLibrary *sqlLib = sb->LibrarySQLGet( sb );
 	if( sqlLib != NULL )
 	{
 		int entries = 0;
-		sqlLib->SNPrintF( sqlLib, tmpQuery, sizeof(tmpQuery)," ( DeviceIdentity='%s' AND UserID = %ld )", devid, uid );
-	
-		DEBUG( "[USMGetSessionByDeviceIDandUserDB] Sending query: %s...\n", tmpQuery );
+		FULONG params[] = { SQLT_STR, (FULONG)devid, SQLT_INT, uid, SQLT_END };
 	
-		// You added 'where' and on the end you did not used it??
+		DEBUG( "[USMGetSessionByDeviceIDandUserDB] Loading session: %s user %lu...\n", devid, uid );
 	
-		//usersession = ( UserSession *)sqlLib->Load( sqlLib, UserSessionDesc, NULL, &entries );
-		usersession = ( struct UserSession *)sqlLib->Load( sqlLib, UserSessionDesc, tmpQuery, &entries );
+		usersession = ( struct UserSession *)sqlLib->LoadParams( sqlLib, UserSessionDesc, "( DeviceIdentity=? AND UserID=? )", params, &entries );
 		sb->LibrarySQLDrop( sb, sqlLib );	
 	}
 	else
@@ -246,24 +533,28 @@ UserSession *USMGetSessionByDeviceIDandUserDB( UserSessionManager *smgr, char *d
  */
 UserSession *USMGetSessionByUserID( UserSessionManager *usm, FULONG id )
 {
-	DEBUG("CHECK6\n");
 	//  we  will take only first session of that user
-	FRIEND_MUTEX_LOCK( &(usm->usm_Mutex) );
-	UserSession *us = usm->usm_Sessions;
-	while( us != NULL )
+	UserSession *ret = NULL;
+	
+	if( FRIEND_MUTEX_LOCK( &(usm->usm_Mutex) ) == 0 )
 	{
-		if( us->us_User  != NULL  && us->us_User->u_ID == id )
+		unsigned int hash = USMHashUserID( id );
+		UserSession *us = usm->usm_Index[ USM_INDEX_USERID ][ hash & ( usm->usm_IndexSize - 1 ) ];
+		while( us != NULL )
 		{
-			if( us->us_User->u_SessionsList != NULL )
+			if( us->us_User  != NULL  && us->us_User->u_ID == id )
 			{
-				FRIEND_MUTEX_UNLOCK( &(usm->usm_Mutex) );
-				return us->us_User->u_SessionsList->us;
+				if( us->us_User->u_SessionsList != NULL )
+				{
+					ret = us->us_User->u_SessionsList->us;
+					break;
+				}
 			}
+			us = us->us_IndexNext[ USM_INDEX_USERID ];
 		}
-		us = (UserSession *) us->node.mln_Succ;
+		FRIEND_MUTEX_UNLOCK( &(usm->usm_Mutex) );
 	}
-	FRIEND_MUTEX_UNLOCK( &(usm->usm_Mutex) );
-	return NULL;
+	return ret;
 }
 
 /**
@@ -440,12 +731,12 @@ UserSession *USMUserSessionAddToList( UserSessionManager *smgr, UserSession *s )
 {
 	DEBUG("[USMUserSessionAddToList] start\n");
 	
-	DEBUG("CHECK7\n");
 	if( FRIEND_MUTEX_LOCK( &(smgr->usm_Mutex) ) == 0 )
 	{
 		s->node.mln_Succ = (MinNode *)smgr->usm_Sessions;
 		smgr->usm_Sessions = s;
 		smgr->usm_SessionCounter++;
+		USMIndexAdd( smgr, s );
 	
 		FRIEND_MUTEX_UNLOCK( &(smgr->usm_Mutex) );
 	}
@@ -474,57 +765,21 @@ UserSession *USMUserSessionAdd( UserSessionManager *smgr, UserSession *us )
 	FBOOL userHaveMoreSessions = FALSE;
 	FBOOL duplicateMasterSession = FALSE;
 	
-	DEBUG("CHECK8\n");
 	if( FRIEND_MUTEX_LOCK( &(smgr->usm_Mutex) ) == 0 )
 	{
-		DEBUG("CHECK8 LOCKED\n");
-		UserSession *ses =  smgr->usm_Sessions;
-		while( ses != NULL )
+		UserSession *ses = NULL;
+		
+		if( us->us_SessionID != NULL && ( ses = USMIndexFindSessionID( smgr, us->us_SessionID ) ) != NULL )
 		{
-			FBOOL quit = FALSE;
-			DEBUG("inside session\n");
-			
-			if( FRIEND_MUTEX_LOCK( &us->us_Mutex ) == 0 )
-			{
-				DEBUG("Session locked, compare: %s vs %s\n", us->us_SessionID, ses->us_SessionID );
-				
-				if( us->us_SessionID != NULL && ses->us_SessionID != NULL && strncmp( us->us_SessionID, ses->us_SessionID, 256 ) == 0 )
-				{
-					DEBUG("Found session with same sessionID, return!\n");
-					FRIEND_MUTEX_UNLOCK( &us->us_Mutex );
-					FRIEND_MUTEX_UNLOCK( &(smgr->usm_Mutex) );
-					return ses;
-				}
-				
-				if( ses->us_DeviceIdentity != NULL )
-				{
-					if( us->us_UserID == ses->us_UserID && strcmp( us->us_DeviceIdentity, ses->us_DeviceIdentity ) ==  0 )
-					{
-						DEBUG("[USMUserSessionAdd] Session found, no need to create new  one %lu devid %s\n", ses->us_UserID, ses->us_DeviceIdentity );
-						quit = TRUE;
-					}
-				}
-				else
-				{
-					if( ses->us_DeviceIdentity == us->us_DeviceIdentity )
-					{
-						DEBUG("[USMUserSessionAdd] Found session with empty deviceid\n");
-						quit = TRUE;
-					}
-				}
-				FRIEND_MUTEX_UNLOCK( &us->us_Mutex );
-			}
-			
-			if( quit == TRUE )
-			{
-				DEBUG("Break\n");
-				break;
-			}
+			DEBUG("Found session with same sessionID, return!\n");
+			FRIEND_MUTEX_UNLOCK( &(smgr->usm_Mutex) );
+			return ses;
+		}
 		
-			DEBUG("inside session 2 id: %s\n", us->us_SessionID );
-			ses = (UserSession *)ses->node.mln_Succ;
+		if( ( ses = USMIndexFindDevice( smgr, us->us_UserID, us->us_DeviceIdentity ) ) != NULL )
+		{
+			DEBUG("[USMUserSessionAdd] Session found, no need to create new  one %lu devid %s\n", ses->us_UserID, ses->us_DeviceIdentity );
 		}
-		DEBUG("CHECK8 after while\n");
 
 		// if session doesnt exist in memory we must add it to the list
 	
@@ -534,6 +789,7 @@ UserSession *USMUserSessionAdd( UserSessionManager *smgr, UserSession *us )
 	
 			us->node.mln_Succ = (MinNode *)smgr->usm_Sessions;
 			smgr->usm_Sessions = us;
+			USMIndexAdd( smgr, us );
 		}
 		else
 		{
@@ -541,7 +797,6 @@ UserSession *USMUserSessionAdd( UserSessionManager *smgr, UserSession *us )
 			us = ses;
 			DEBUG("User session was overwritten, ptr %p\n", us );
 		}
-		DEBUG("CHECK8END\n");
 		FRIEND_MUTEX_UNLOCK( &(smgr->usm_Mutex) );
 	}
 	
@@ -634,7 +889,6 @@ int USMUserSessionRemove( UserSessionManager *smgr, UserSession *remsess )
 	
 	DEBUG("[USMUserSessionRemove] UserSessionRemove\n");
 	
-	DEBUG("CHECK9\n");
 	if( FRIEND_MUTEX_LOCK( &(smgr->usm_Mutex) ) == 0 )
 	{
 		if( remsess == smgr->usm_Sessions )
@@ -682,6 +936,11 @@ int USMUserSessionRemove( UserSessionManager *smgr, UserSession *remsess )
 			}
 			smgr->usm_SessionCounter--;
 		}
+		
+		if( sessionRemoved == TRUE )
+		{
+			USMIndexRemove( smgr, remsess );
+		}
 		FRIEND_MUTEX_UNLOCK( &(smgr->usm_Mutex) );
 	}
 	
@@ -1010,6 +1269,132 @@ int USMRemoveOldSessionsinDB( void *lsb )
 	return 0;
 }
 
+/**
+ * Store LoggedTime of sessions which were used since last flush in DB
+ *
+ * In-memory us_LoggedTime is updated on every call. This function is called by EventManager
+ * and on shutdown, it writes all changed values with multi-row UPDATE statements.
+ *
+ * @param lsb pointer to SystemBase
+ * @return 0 when success, otherwise error number
+ */
+int USMSessionsFlushLoggedTime( void *lsb )
+{
+	SystemBase *sb = (SystemBase *)lsb;
+	UserSessionManager *smgr = sb->sl_USM;
+	int nr = 0;
+	
+	if( smgr == NULL )
+	{
+		return 1;
+	}
+	
+	SQLLibrary *sqllib = sb->LibrarySQLGet( sb );
+	if( sqllib == NULL )
+	{
+		FERROR("[USMSessionsFlushLoggedTime] Cannot get mysql.library\n");
+		return 2;
+	}
+	
+	//
+	// take values in batches, session mutex is not held while query is running
+	//
+	
+	while( TRUE )
+	{
+		char *sessionids[ USM_FLUSH_BATCH_SIZE ];
+		time_t times[ USM_FLUSH_BATCH_SIZE ];
+		int entries = 0;
+		int i;
+		
+		if( FRIEND_MUTEX_LOCK( &(smgr->usm_Mutex) ) == 0 )
+		{
+			UserSession *us = smgr->usm_Sessions;
+			while( us != NULL && entries < USM_FLUSH_BATCH_SIZE )
+			{
+				time_t loggedTime = us->us_LoggedTime;
+				if( loggedTime != us->us_LoggedTimeSaved && us->us_SessionID != NULL )
+				{
+					if( ( sessionids[ entries ] = StringDuplicate( us->us_SessionID ) ) != NULL )
+					{
+						times[ entries++ ] = loggedTime;
+					}
+				}
+				us = (UserSession *)us->node.mln_Succ;
+			}
+			FRIEND_MUTEX_UNLOCK( &(smgr->usm_Mutex) );
+		}
+		
+		if( entries == 0 )
+		{
+			break;
+		}
+		
+		int err = -1;
+		BufString *sqlreq = BufStringNew();
+		if( sqlreq != NULL )
+		{
+			char temp[ 512 ];
+			
+			BufStringAdd( sqlreq, "UPDATE `FUserSession` SET `LoggedTime` = CASE `SessionID`" );
+			for( i=0 ; i < entries ; i++ )
+			{
+				sqllib->SNPrintF( sqllib, temp, sizeof(temp), " WHEN '%s' THEN %lld", sessionids[ i ], (long long)times[ i ] );
+				BufStringAddSize( sqlreq, temp, strlen( temp ) );
+			}
+			BufStringAdd( sqlreq, " ELSE `LoggedTime` END WHERE `SessionID` IN(" );
+			for( i=0 ; i < entries ; i++ )
+			{
+				sqllib->SNPrintF( sqllib, temp, sizeof(temp), i == 0 ? "'%s'" : ",'%s'", sessionids[ i ] );
+				BufStringAddSize( sqlreq, temp, strlen( temp ) );
+			}
+			BufStringAddSize( sqlreq, ")", 1 );
+			
+			err = sqllib->QueryWithoutResults( sqllib, sqlreq->bs_Buffer );
+			
+			BufStringDelete( sqlreq );
+		}
+		
+		// values are marked as stored only when UPDATE succeeded, if session was used in meantime it will be taken by next flush
+		if( err == 0 && FRIEND_MUTEX_LOCK( &(smgr->usm_Mutex) ) == 0 )
+		{
+			for( i=0 ; i < entries ; i++ )
+			{
+				UserSession *us = USMIndexFindSessionID( smgr, sessionids[ i ] );
+				if( us != NULL )
+				{
+					us->us_LoggedTimeSaved = times[ i ];
+				}
+			}
+			FRIEND_MUTEX_UNLOCK( &(smgr->usm_Mutex) );
+		}
+		
+		for( i=0 ; i < entries ; i++ )
+		{
+			FFree( sessionids[ i ] );
+		}
+		
+		// not stored sessions would be taken again, they wait for next flush
+		if( err != 0 )
+		{
+			FERROR("[USMSessionsFlushLoggedTime] Cannot store LoggedTime, error %d\n", err );
+			break;
+		}
+		nr += entries;
+		
+		if( entries < USM_FLUSH_BATCH_SIZE )
+		{
+			break;
+		}
+	}
+	
+	sb->LibrarySQLDrop( sb, sqllib );
+	
+	DEBUG("[USMSessionsFlushLoggedTime] LoggedTime updated in %d sessions\n", nr );
+	
+	return 0;
+}
+
 /**
  * Send door notification
  *
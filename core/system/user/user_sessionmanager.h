@@ -23,6 +23,14 @@
 #include <system/usergroup/user_group.h>
 #include "user.h"
 
+#ifndef USM_INDEX_INITIAL_SIZE
+#define USM_INDEX_INITIAL_SIZE 1024		// number of buckets, must be power of 2
+#endif
+
+#ifndef USM_FLUSH_BATCH_SIZE
+#define USM_FLUSH_BATCH_SIZE 256		// maximum number of sessions updated by one SQL call
+#endif
+
 //
 // User Session Manager structure
 //
@@ -34,7 +42,11 @@ typedef struct UserSessionManager
 	int								usm_SessionCounter;
 	void 							*usm_UM;
 	
-	pthread_mutex_t					usm_Mutex;		// mutex
+	UserSession						**usm_Index[ USM_INDEX_MAX ];	// hash indexes: session id, user id, user id + device identity
+	unsigned int					usm_IndexSize;		// number of buckets in every index
+	int								usm_IndexCount;		// number of registered sessions
+	
+	pthread_mutex_t					usm_Mutex;		// mutex, protects list and indexes
 } UserSessionManager;
 
 
@@ -66,6 +78,12 @@ UserSession *USMGetSessionBySessionID( UserSessionManager *usm, char *id );
 //
 //
 
+UserSession *USMGetSessionBySessionIDOrMainSessionID( UserSessionManager *usm, char *sessionid );
+
+//
+//
+//
+
 UserSession *USMGetSessionBySessionIDFromDB( UserSessionManager *usm, char *id );
 
 //
@@ -132,6 +150,12 @@ UserSession *USMUserSessionAdd( UserSessionManager *smgr, UserSession *s );
 //
 //
 
+void USMRebuildIndex( UserSessionManager *smgr );
+
+//
+//
+//
+
 int USMUserSessionRemove( UserSessionManager *smgr, UserSession *s );
 
 //
@@ -168,6 +192,12 @@ int USMRemoveOldSessionsinDB( void *lsb );
 //
 //
 
+int USMSessionsFlushLoggedTime( void *lsb );
+
+//
+//
+//
+
 FBOOL USMSendDoorNotification( UserSessionManager *usm, void *notification, UserSession *ses, File *device, char *path );
 
 //
@@ -0,0 +1,144 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+#include "user_sessionmanager.h"
+#include <util/log/log.h>
+#include <mutex/mutex_manager.h>
+#include <sys/time.h>
+
+/* Basic benchmark of session lookup: hash index vs. walking through usm_Sessions list
+ * (which was done by every request before sessions were indexed).
+ *
+ * Run it by simply placing at the very beginning of main.c:
+ *
+ *             extern void user_sessionmanager_benchmark(void);
+ *             user_sessionmanager_benchmark();
+ *
+ */
+
+#define USM_BENCHMARK_LOOKUPS 100000
+
+/**
+ * Time between two timevals in microseconds
+ */
+static long long USMBenchmarkUsec( struct timeval *start, struct timeval *end )
+{
+	return ( (long long)( end->tv_sec - start->tv_sec ) * 1000000LL ) + ( end->tv_usec - start->tv_usec );
+}
+
+/**
+ * Find session in the way it was done before indexing
+ */
+static UserSession *USMBenchmarkScan( UserSessionManager *usm, char *sessionid )
+{
+	UserSession *us = usm->usm_Sessions;
+	while( us != NULL )
+	{
+		if( us->us_SessionID != NULL && strcmp( sessionid, us->us_SessionID ) == 0 )
+		{
+			return us;
+		}
+		us = (UserSession *)us->node.mln_Succ;
+	}
+	return NULL;
+}
+
+void user_sessionmanager_benchmark(void)
+{
+	int sizes[] = { 1000, 10000, 100000 };
+	unsigned int s;
+
+	for( s=0 ; s < sizeof(sizes)/sizeof(int) ; s++ )
+	{
+		int count = sizes[ s ];
+		int i;
+		char sessionid[ 64 ];
+		char deviceid[ 64 ];
+
+		UserSessionManager *usm = USMNew( NULL );
+		if( usm == NULL )
+		{
+			return;
+		}
+
+		for( i=0 ; i < count ; i++ )
+		{
+			snprintf( sessionid, sizeof(sessionid), "%08x%08xbenchmarksession", i * 2654435761U, i );
+			snprintf( deviceid, sizeof(deviceid), "device_%d", i % 5 );
+
+			UserSession *us = UserSessionNew( sessionid, deviceid );
+			if( us != NULL )
+			{
+				us->us_UserID = i / 5;
+				USMUserSessionAddToList( usm, us );
+			}
+		}
+
+		struct timeval start_time, end_time;
+		int found = 0;
+
+		// lookups through index
+
+		gettimeofday( &start_time, NULL );
+		for( i=0 ; i < USM_BENCHMARK_LOOKUPS ; i++ )
+		{
+			int n = ( i * 7919 ) % count;
+			snprintf( sessionid, sizeof(sessionid), "%08x%08xbenchmarksession", n * 2654435761U, n );
+			if( USMGetSessionBySessionID( usm, sessionid ) != NULL )
+			{
+				found++;
+			}
+		}
+		gettimeofday( &end_time, NULL );
+
+		long long indexTime = USMBenchmarkUsec( &start_time, &end_time );
+
+		// lookups through list (less iterations, result is scaled)
+
+		int scanLookups = USM_BENCHMARK_LOOKUPS / ( count / 1000 );
+		gettimeofday( &start_time, NULL );
+		for( i=0 ; i < scanLookups ; i++ )
+		{
+			int n = ( i * 7919 ) % count;
+			snprintf( sessionid, sizeof(sessionid), "%08x%08xbenchmarksession", n * 2654435761U, n );
+			if( FRIEND_MUTEX_LOCK( &(usm->usm_Mutex) ) == 0 )
+			{
+				if( USMBenchmarkScan( usm, sessionid ) != NULL )
+				{
+					found++;
+				}
+				FRIEND_MUTEX_UNLOCK( &(usm->usm_Mutex) );
+			}
+		}
+		gettimeofday( &end_time, NULL );
+
+		long long scanTime = USMBenchmarkUsec( &start_time, &end_time );
+
+		// lookups by user and device
+
+		gettimeofday( &start_time, NULL );
+		for( i=0 ; i < USM_BENCHMARK_LOOKUPS ; i++ )
+		{
+			int n = ( i * 7919 ) % count;
+			snprintf( deviceid, sizeof(deviceid), "device_%d", n % 5 );
+			if( USMGetSessionByDeviceIDandUser( usm, deviceid, n / 5 ) != NULL )
+			{
+				found++;
+			}
+		}
+		gettimeofday( &end_time, NULL );
+
+		long long deviceTime = USMBenchmarkUsec( &start_time, &end_time );
+
+		Log( FLOG_INFO, "Sessions %d: index %.3f us/lookup, list scan %.3f us/lookup, user+device index %.3f us/lookup (found %d)\n", count,
+			(double)indexTime / USM_BENCHMARK_LOOKUPS, (double)scanTime / scanLookups, (double)deviceTime / USM_BENCHMARK_LOOKUPS, found );
+
+		USMDelete( usm );
+	}
+}
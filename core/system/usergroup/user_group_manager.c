@@ -261,6 +261,8 @@ int UGMRemoveGroup( UserGroupManager *ugm, UserGroup *ug )
 			// remove connections between users and group
 			snprintf( tmpQuery, sizeof(tmpQuery), "delete FROM FUserToGroup WHERE UserGroupID=%lu", ug->ug_ID );
 			sqlLib->QueryWithoutResults(  sqlLib, tmpQuery );
+			// cached permissions of all group members are not valid anymore
+			FSManagerPermCacheInvalidateUser( l->sl_FSM, 0 );
 			// remove entry from FUserGroup
 			snprintf( tmpQuery, sizeof(tmpQuery), "delete FROM FUserGroup WHERE ID=%lu", ug->ug_ID );
 			sqlLib->QueryWithoutResults(  sqlLib, tmpQuery );
@@ -765,6 +767,8 @@ int UGMAssignGroupToUserByStringDB( UserGroupManager *ugm, User *usr, char *leve
 	{
 		FERROR("Cannot call query: '%s'\n", bsInsert->bs_Buffer );
 	}
+	
+	FSManagerPermCacheInvalidateUser( sb->sl_FSM, usr->u_ID );
 
 	//BufStringAddSize( bsGroups, "]}", 2 );
 	
@@ -806,6 +810,7 @@ int UGMAddUserToGroupDB( UserGroupManager *um, FULONG groupID, FULONG userID )
 		{
 			FERROR("Cannot call query: '%s'\n", tmpQuery );
 		}
+		FSManagerPermCacheInvalidateUser( sb->sl_FSM, userID );
 		
 		sb->LibrarySQLDrop( sb, sqlLib );
 	}
@@ -884,6 +889,7 @@ int UGMRemoveUserFromGroupDB( UserGroupManager *um, FULONG groupID, FULONG userI
 		{
 			FERROR("Cannot call query: '%s'\n", tmpQuery );
 		}
+		FSManagerPermCacheInvalidateUser( sb->sl_FSM, userID );
 		
 		sb->LibrarySQLDrop( sb, sqlLib );
 	}
@@ -950,7 +956,7 @@ FBOOL UGMUserToGroupISConnectedDB( UserGroupManager *um, FULONG ugroupid, FULONG
 FBOOL UGMGetGroupsDB( UserGroupManager *um, FULONG uid, BufString *bs, const char *type, FULONG parentID, int status )
 {
 	SystemBase *sb = (SystemBase *)um->ugm_SB;
-	SQLLibrary *sqlLib = sb->LibrarySQLGet( sb );
+	SQLLibrary *sqlLib = sb->LibrarySQLGetRead( sb );
 	FBOOL ret = FALSE;
 	
 	if( sqlLib != NULL )
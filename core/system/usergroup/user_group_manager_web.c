@@ -1175,6 +1175,7 @@ where u.ID in (SELECT ID FROM FUser WHERE ID NOT IN (select UserID from FUserToG
 							// remove connections between users and group
 							snprintf( tmpQuery, sizeof(tmpQuery), "delete FROM FUserToGroup WHERE UserGroupID=%lu", groupID );
 							sqlLib->QueryWithoutResults(  sqlLib, tmpQuery );
+							FSManagerPermCacheInvalidateUser( l->sl_FSM, 0 );
 
 						} // users == false (remove all users)
 						else
@@ -2073,6 +2074,7 @@ where u.ID in (SELECT ID FROM FUser WHERE ID NOT IN (select UserID from FUserToG
 							// remove connections between users and group
 							snprintf( tmpQuery, sizeof(tmpQuery), "delete FROM FUserToGroup WHERE UserGroupID=%lu", groupID );
 							sqlLib->QueryWithoutResults(  sqlLib, tmpQuery );
+							FSManagerPermCacheInvalidateUser( l->sl_FSM, 0 );
 							
 							l->LibrarySQLDrop( l, sqlLib );
 						}
@@ -30,6 +30,7 @@ typedef struct FQEntry
 	char			*fq_RequestID;	// request ID
 	int				fq_Size;		// size of message
 	int				fq_Priority;	// message priority
+	int				fq_Flags;		// websockets: lws_write_protocol used to send message (0 - text)
 	time_t			fq_Timestamp;	// message timestamp
 #ifdef __PERF_MEAS
 	double			fq_stime;		// time used to check how much time take to sent it
@@ -46,6 +46,9 @@ FriendWebSocket = function( conf )
 		// need some room for meta data aswell.
 
 	self.chunks = {};
+	// FC-protocol-binary (opt-in): big messages come as binary frames instead of base64 chunks
+	self.binaryFrames = ( conf.binaryFrames === true );
+	self.decoder = null;
 	self.allowReconnect = true;
 	self.pingInterval = 1000 * 20;
 	self.maxPingWait = 1000 * 10;
@@ -163,7 +166,16 @@ FriendWebSocket.prototype.connect = function()
 	{
 		try
 		{
-			self.ws = new window.WebSocket( self.url, 'FC-protocol' );
+			// server which does not know binary protocol selects FC-protocol
+			if( self.binaryFrames && window.TextDecoder )
+			{
+				self.ws = new window.WebSocket( self.url, [ 'FC-protocol-binary', 'FC-protocol' ] );
+				self.ws.binaryType = 'arraybuffer';
+			}
+			else
+			{
+				self.ws = new window.WebSocket( self.url, 'FC-protocol' );
+			}
 			self.ws.onerror = function()
 			{
 				reject( 'error' );
@@ -349,7 +361,14 @@ FriendWebSocket.prototype.handleSocketMessage = function( e )
 	
 	// TODO: Debug why some data isn't encapsulated
 	// console.log( e.data );
-	var msg = friendUP.tool.objectify( e.data );
+	var data = e.data;
+	if( data instanceof ArrayBuffer )
+	{
+		if( !self.decoder )
+			self.decoder = new TextDecoder( 'utf-8' );
+		data = self.decoder.decode( data );
+	}
+	var msg = friendUP.tool.objectify( data );
 	if( !msg )
 	{
 		console.log( 'FriendWebSocket.handleSocketMessage - invalid data, could not parse JSON',
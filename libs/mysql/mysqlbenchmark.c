@@ -0,0 +1,252 @@
+/*©lgpl*************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the GNU Lesser   *
+* General Public License, found in the file license_lgpl.txt.                  *
+*                                                                              *
+*****************************************************************************©*/
+/** @file
+ *
+ *  mysql.library benchmark
+ *
+ *  Loads FUser by name and FUserSession by user id with the UserDesc and
+ *  UserSessionDesc descriptors used by FriendCore, in three modes:
+ *  - text: statement cache disabled (STMTCACHE,0), values embedded in "where"
+ *  - load: statement cache enabled, values embedded in "where". Such texts are
+ *    prepared only when they repeat within last 64 Load calls of a connection,
+ *    so with more than 32 users every call is still a text query
+ *  - params: LoadParams, one prepared statement per lookup for all users
+ *
+ *  UserInit and UserSessionInit are replaced by local functions which only
+ *  initialise the mutex, websocket request manager of session is not created.
+ *
+ *  Usage: MySQLBenchmark <host> <database> <user> <password> [port] [iterations] [users]
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <time.h>
+#include <pthread.h>
+#include <core/types.h>
+#include <core/nodes.h>
+#include <db/sqllib.h>
+#include <system/user/user.h>
+#include <system/user/user_session.h>
+
+#define BENCH_MAX_USERS 1000
+
+/**
+ * Initialise loaded user, replaces UserInit referenced by UserDesc
+ *
+ * @param u pointer to User
+ * @return 0
+ */
+int UserInit( User *u )
+{
+	pthread_mutex_init( &(u->u_Mutex), NULL );
+	return 0;
+}
+
+/**
+ * Initialise loaded session, replaces UserSessionInit referenced by UserSessionDesc
+ *
+ * @param us pointer to UserSession
+ */
+void UserSessionInit( UserSession *us )
+{
+	pthread_mutex_init( &us->us_Mutex, NULL );
+}
+
+/**
+ * Release list of loaded users
+ *
+ * @param usr pointer to first user
+ */
+static void BenchUserDelete( User *usr )
+{
+	while( usr != NULL )
+	{
+		User *next = (User *)usr->node.mln_Succ;
+		pthread_mutex_destroy( &(usr->u_Mutex) );
+		free( usr->u_Name ); free( usr->u_Password ); free( usr->u_FullName );
+		free( usr->u_Email ); free( usr->u_MainSessionID ); free( usr->u_UUID );
+		free( usr );
+		usr = next;
+	}
+}
+
+/**
+ * Release list of loaded sessions
+ *
+ * @param us pointer to first session
+ */
+static void BenchUserSessionDelete( UserSession *us )
+{
+	while( us != NULL )
+	{
+		UserSession *next = (UserSession *)us->node.mln_Succ;
+		pthread_mutex_destroy( &us->us_Mutex );
+		free( us->us_DeviceIdentity ); free( us->us_SessionID );
+		free( us );
+		us = next;
+	}
+}
+
+/**
+ * Get current time in microseconds
+ *
+ * @return time in microseconds
+ */
+static FQUAD BenchTime( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (FQUAD)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Load users by name and their sessions, like login and session checks do
+ *
+ * @param l pointer to mysql.library structure
+ * @param names names of users
+ * @param ids IDs of users
+ * @param count number of users
+ * @param iterations number of loads of every user
+ * @param params TRUE when LoadParams is used, otherwise values are put into "where"
+ * @param mode name of mode printed in results
+ */
+static void BenchRun( SQLLibrary *l, char **names, FULONG *ids, int count, int iterations, FBOOL params, const char *mode )
+{
+	char where[ 512 ];
+	int i, j, entries;
+	FQUAD userTime = 0, sessionTime = 0, start;
+
+	for( i=0 ; i < iterations ; i++ )
+	{
+		for( j=0 ; j < count ; j++ )
+		{
+			User *usr;
+			UserSession *us;
+
+			start = BenchTime();
+			if( params == TRUE )
+			{
+				FULONG userParams[] = { SQLT_STR, (FULONG)names[ j ], SQLT_END };
+				usr = l->LoadParams( l, UserDesc, "`Name`=?", userParams, &entries );
+			}
+			else
+			{
+				l->SNPrintF( l, where, sizeof(where), "`Name`='%s'", names[ j ] );
+				usr = l->Load( l, UserDesc, where, &entries );
+			}
+			userTime += BenchTime() - start;
+			BenchUserDelete( usr );
+
+			start = BenchTime();
+			if( params == TRUE )
+			{
+				FULONG sessionParams[] = { SQLT_INT, ids[ j ], SQLT_END };
+				us = l->LoadParams( l, UserSessionDesc, "`UserID`=?", sessionParams, &entries );
+			}
+			else
+			{
+				snprintf( where, sizeof(where), "`UserID`=%lu", ids[ j ] );
+				us = l->Load( l, UserSessionDesc, where, &entries );
+			}
+			sessionTime += BenchTime() - start;
+			BenchUserSessionDelete( us );
+		}
+	}
+
+	int loads = iterations * count;
+	printf( "%-8s FUser load: %8.1f us  FUserSession load: %8.1f us  (%d loads each, %d users)\n", mode, (double)userTime / loads, (double)sessionTime / loads, loads, count );
+}
+
+int main( int argc, char **argv )
+{
+	if( argc < 5 )
+	{
+		printf( "Usage: %s <host> <database> <user> <password> [port] [iterations] [users]\n", argv[ 0 ] );
+		return 1;
+	}
+
+	int port = argc > 5 ? atoi( argv[ 5 ] ) : 3306;
+	int iterations = argc > 6 ? atoi( argv[ 6 ] ) : 10;
+	int maxUsers = argc > 7 ? atoi( argv[ 7 ] ) : BENCH_MAX_USERS;
+
+	if( maxUsers <= 0 || maxUsers > BENCH_MAX_USERS )
+	{
+		maxUsers = BENCH_MAX_USERS;
+	}
+
+	void *handle = dlopen( "bin/mysql.library", RTLD_NOW|RTLD_GLOBAL );
+	if( handle == NULL )
+	{
+		printf( "Cannot open bin/mysql.library: %s\n", dlerror() );
+		return 1;
+	}
+
+	void *(*libInit)( void * ) = dlsym( handle, "libInit" );
+	void (*libClose)( struct SQLLibrary * ) = dlsym( handle, "libClose" );
+	SQLLibrary *l = libInit ? libInit( NULL ) : NULL;
+
+	if( l == NULL || l->Connect( l, argv[ 1 ], argv[ 2 ], argv[ 3 ], argv[ 4 ], port ) != 0 )
+	{
+		printf( "Cannot connect to database\n" );
+		return 1;
+	}
+
+	// users which are used by benchmark, each one is loaded by its own "where"
+	char *names[ BENCH_MAX_USERS ];
+	FULONG ids[ BENCH_MAX_USERS ];
+	char limit[ 64 ];
+	int count = 0, entries = 0;
+
+	snprintf( limit, sizeof(limit), "1=1 LIMIT %d", maxUsers );
+	User *users = l->Load( l, UserDesc, limit, &entries );
+	User *usr = users;
+	while( usr != NULL && count < maxUsers )
+	{
+		if( usr->u_Name != NULL )
+		{
+			names[ count ] = strdup( usr->u_Name );
+			ids[ count++ ] = usr->u_ID;
+		}
+		usr = (User *)usr->node.mln_Succ;
+	}
+	BenchUserDelete( users );
+
+	if( count == 0 )
+	{
+		printf( "FUser table is empty\n" );
+		libClose( l );
+		return 1;
+	}
+
+	char textOption[] = "STMTCACHE,0";
+	char cacheOption[] = "STMTCACHE,1";
+
+	l->SetOption( l, textOption );
+	BenchRun( l, names, ids, count, iterations, FALSE, "text" );
+
+	l->SetOption( l, cacheOption );
+	l->CompileDescriptor( l, UserDesc );
+	l->CompileDescriptor( l, UserSessionDesc );
+	BenchRun( l, names, ids, count, iterations, FALSE, "load" );
+	BenchRun( l, names, ids, count, iterations, TRUE, "params" );
+
+	while( count > 0 )
+	{
+		free( names[ --count ] );
+	}
+
+	libClose( l );
+	dlclose( handle );
+
+	return 0;
+}
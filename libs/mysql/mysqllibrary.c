@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <dlfcn.h>
 #include <string.h>
+#include <strings.h>
 #include <util/string.h>
 #include <interface/properties_interface.h>
 #include <core/nodes.h>
@@ -31,17 +32,119 @@
 #include <system/systembase.h>
 #include <ctype.h>
 #include <mysql.h>
+#include <errmsg.h>
+#include <mysqld_error.h>
+#include <pthread.h>
 
 #define LIB_NAME "mysql.library"
 #define LIB_VERSION 1
 #define LIB_REVISION 0
 
+#define FRIEND_MAX_BIND 256
+
+#define MYSQL_DESCRIPTOR_HASH_SIZE 256		// buckets of descriptor pointer -> compiled descriptor table
+#define MYSQL_STATEMENT_CACHE_SIZE 64		// prepared statements kept by one connection
+#define MYSQL_WHERE_HISTORY 64				// Load "where" texts remembered to find repeated ones
+#define MYSQL_LOAD_PARAMS 8					// maximum number of LoadParams parameters
+#define MYSQL_SAVE_MASK_COLUMNS 64			// Save statements of descriptors with more columns are not kept
+#define MYSQL_DATE_SIZE 32
+
+#if defined( MYSQL_VERSION_ID ) && MYSQL_VERSION_ID >= 80000 && !defined( MARIADB_BASE_VERSION )
+typedef bool my_bool;						// removed from MySQL 8 client library
+#endif
+
+//
+// column of compiled descriptor
+//
+
+typedef struct MYSQLColumn
+{
+	FULONG					mc_Type;			// SQLT_*
+	char					*mc_Name;
+	FULONG					mc_Offset;			// offset in structure or pointer to init function
+}MYSQLColumn;
+
+//
+// descriptor compiled into queries, shared by all connections
+//
+
+typedef struct MYSQLDescriptor
+{
+	struct MYSQLDescriptor	*md_Next;
+	char					*md_TableName;
+	FULONG					md_StructSize;
+	MYSQLColumn				*md_Columns;		// columns in SELECT order
+	int						md_ColumnsCount;
+	MYSQLColumn				*md_Extra;			// SQLT_NODE and SQLT_INIT_FUNCTION entries in descriptor order
+	int						md_ExtraCount;
+	MYSQLColumn				*md_ID;				// primary key, NULL when descriptor does not contain it
+	char					*md_Select;			// "SELECT `a`,`b` FROM table"
+	int						md_SelectSize;
+	char					*md_Update;			// "UPDATE table set a = ?, b = ? where ID = ?"
+	int						*md_UpdateColumns;	// indexes of md_Columns bound by md_Update
+	int						md_UpdateCount;
+	char					*md_Count;			// "select count(*) from table"
+}MYSQLDescriptor;
+
+//
+// descriptor address -> compiled descriptor. Static descriptors are defined in headers,
+// so every source file has its own copy of them and all copies point to one entry
+//
+
+typedef struct MYSQLDescriptorAlias
+{
+	struct MYSQLDescriptorAlias	*mda_Next;
+	const FULONG			*mda_Descr;
+	MYSQLDescriptor			*mda_Desc;
+}MYSQLDescriptorAlias;
+
+//
+// prepared statement kept by connection
+//
+
+enum {
+	MYSQL_STATEMENT_LOAD = 0,
+	MYSQL_STATEMENT_UPDATE,
+	MYSQL_STATEMENT_SAVE
+};
+
+typedef struct MYSQLStatement
+{
+	struct MYSQLStatement	*ms_Next;
+	MYSQLDescriptor			*ms_Desc;
+	int						ms_Type;			// MYSQL_STATEMENT_*
+	FUQUAD					ms_Mask;			// Save: bits of md_Columns which are stored
+	char					*ms_Where;			// Load: custom "where", NULL - all entries
+	char					*ms_Query;
+	FBOOL					ms_Cached;			// FALSE - statement is released after call
+	FBOOL					ms_Failed;			// statement cannot be prepared, text query is used
+	MYSQL_STMT				*ms_Stmt;			// NULL until statement is prepared
+	MYSQL_BIND				*ms_Bind;			// one entry per descriptor column and primary key
+	unsigned long			*ms_Lengths;
+	my_bool					*ms_Nulls;
+	MYSQL_TIME				*ms_Times;
+	char					*ms_Dates;			// MYSQL_DATE_SIZE bytes per column
+	MYSQL_BIND				*ms_Params;			// LoadParams: parameters of current call, not owned by statement
+	int						ms_ParamsCount;
+}MYSQLStatement;
+
 // special data
 
 typedef struct SpecialData{
-	int							sd_Protocol;
+	int							sd_Protocol;		// MYSQL_OPT_PROTOCOL set by SetOption, 0 - client default
+	FBOOL						sd_StatementCache;	// prepared statements are kept between calls
+	FBOOL						sd_ReadOnly;		// session refuses writes (read replica)
+	MYSQLStatement				*sd_Statements;		// most recently used first
+	int							sd_StatementsCount;
+	FULONG						sd_WhereHistory[ MYSQL_WHERE_HISTORY ];	// hashes of last Load "where" texts
+	int							sd_WhereHistoryPos;
 }SpecialData;
 
+static pthread_mutex_t descriptorMutex = PTHREAD_MUTEX_INITIALIZER;
+static MYSQLDescriptor *descriptors = NULL;
+static MYSQLDescriptorAlias *descriptorAliases[ MYSQL_DESCRIPTOR_HASH_SIZE ];
+static int librariesOpened = 0;		// compiled descriptors are released when last connection is closed
+
 /**
  * return version of library
  *
@@ -62,544 +165,1553 @@ long GetRevision(void)
 	return LIB_REVISION;
 }
 
+//
+// Compiled descriptors
+//
+
 /**
- * Load data from database
+ * Release compiled descriptor
  *
- * @param l pointer to mysql.library structure
- * @param descr pointer to taglist which represent DB to C structure conversion
- * @param where pointer to string which represent "where" part of query. If value is equal to NULL all data are taken from db.
- * @param entries pointer to interger where number of loaded entries will be returned
- * @return pointer to new structure or list of structures.
+ * @param md pointer to compiled descriptor
  */
-void *Load( struct SQLLibrary *l, FULONG *descr, char *where, int *entries )
+static void DescriptorDelete( MYSQLDescriptor *md )
 {
-	//char tmpQuery[ 1024 ];
-	BufString *tmpQuerybs = BufStringNew();
-	void *firstObject = NULL;
-	DEBUG("[MYSQLLibrary] Load\n");
-	
-	// Check if there was a description structure for the table
-	if( descr == NULL  )
+	int i;
+
+	if( md->md_Columns != NULL )
 	{
-		FERROR("Data description was not provided!\n");
-		return NULL;
+		for( i=0 ; i < md->md_ColumnsCount ; i++ )
+		{
+			if( md->md_Columns[ i ].mc_Name != NULL ) FFree( md->md_Columns[ i ].mc_Name );
+		}
+		FFree( md->md_Columns );
 	}
-	
-	// Check if a table name is specified
-	if( descr[ 0 ] != SQLT_TABNAME )
+	if( md->md_Extra != NULL )
 	{
-		FERROR("SQLT_TABNAME was not provided!\n");
-		return NULL;
+		for( i=0 ; i < md->md_ExtraCount ; i++ )
+		{
+			if( md->md_Extra[ i ].mc_Name != NULL ) FFree( md->md_Extra[ i ].mc_Name );
+		}
+		FFree( md->md_Extra );
 	}
+	if( md->md_TableName != NULL ) FFree( md->md_TableName );
+	if( md->md_Select != NULL ) FFree( md->md_Select );
+	if( md->md_Update != NULL ) FFree( md->md_Update );
+	if( md->md_UpdateColumns != NULL ) FFree( md->md_UpdateColumns );
+	if( md->md_Count != NULL ) FFree( md->md_Count );
+	FFree( md );
+}
 
-	char tmpvar[ 512 ];
-	int pos = 0;
-	int size = 0;
-	BufStringAdd( tmpQuerybs, "SELECT " );
-	FULONG *dptr = &descr[ SQL_DATA_STRUCT_START ]; 
-	
-	while( dptr[0] != SQLT_END )
+/**
+ * Check if descriptor describes same table and structure as compiled descriptor
+ *
+ * @param md pointer to compiled descriptor
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @return TRUE when descriptors are equal, otherwise FALSE
+ */
+static FBOOL DescriptorEqual( MYSQLDescriptor *md, const FULONG *descr )
+{
+	const FULONG *dptr = &descr[ SQL_DATA_STRUCT_START ];
+	int col = 0, extra = 0;
+
+	if( md->md_StructSize != descr[ SQL_DATA_STRUCTURE_SIZE ] || strcmp( md->md_TableName, (char *)descr[ SQL_DATA_TABLE_NAME ] ) != 0 )
+	{
+		return FALSE;
+	}
+
+	for( ; dptr[ 0 ] != SQLT_END ; dptr += 3 )
 	{
-		if( dptr[0] != SQLT_NODE && dptr[0] != SQLT_INIT_FUNCTION )
+		MYSQLColumn *mc;
+
+		if( dptr[ 0 ] == SQLT_NODE || dptr[ 0 ] == SQLT_INIT_FUNCTION )
 		{
-			if( pos == 0 )
-			{
-				size = snprintf( tmpvar, sizeof(tmpvar),"`%s`", (char *)dptr[ 1 ] );
-			}
-			else
-			{
-				size = snprintf( tmpvar, sizeof(tmpvar),",`%s`", (char *)dptr[ 1 ] );
-			}
-			pos++;
-			
-			BufStringAddSize( tmpQuerybs, tmpvar, size );
+			if( extra >= md->md_ExtraCount ) return FALSE;
+			mc = &md->md_Extra[ extra++ ];
+		}
+		else
+		{
+			if( col >= md->md_ColumnsCount ) return FALSE;
+			mc = &md->md_Columns[ col++ ];
+		}
+
+		if( mc->mc_Type != dptr[ 0 ] || mc->mc_Offset != dptr[ 2 ] || strcmp( mc->mc_Name, (char *)dptr[ 1 ] ) != 0 )
+		{
+			return FALSE;
 		}
-		dptr += 3;
 	}
-	
-	// Check that there is a where query
+	return ( col == md->md_ColumnsCount && extra == md->md_ExtraCount );
+}
 
-	if( where != NULL )
+/**
+ * Compile descriptor into column lists and query texts
+ *
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @return pointer to new compiled descriptor or NULL when error appear
+ */
+static MYSQLDescriptor *DescriptorCompile( const FULONG *descr )
+{
+	MYSQLDescriptor *md;
+	const FULONG *dptr;
+	int columns = 0;
+	int extra = 0;
+
+	for( dptr = &descr[ SQL_DATA_STRUCT_START ] ; dptr[ 0 ] != SQLT_END ; dptr += 3 )
 	{
-		size = snprintf( tmpvar, sizeof(tmpvar), " FROM %s WHERE %s", (char *)descr[ 1 ], where );
+		if( dptr[ 0 ] == SQLT_NODE || dptr[ 0 ] == SQLT_INIT_FUNCTION )
+		{
+			extra++;
+		}
+		else
+		{
+			columns++;
+		}
 	}
-	// Just select all
-	else
+
+	if( columns >= FRIEND_MAX_BIND )
 	{
-		size = snprintf( tmpvar, sizeof(tmpvar), " FROM %s", (char *)descr[ 1 ] );
+		FERROR("[DescriptorCompile] Too many columns in table %s\n", (char *)descr[ SQL_DATA_TABLE_NAME ] );
+		return NULL;
 	}
-	
-	BufStringAddSize( tmpQuerybs, tmpvar, size );
-	
-	if( mysql_query( l->con.sql_Con, tmpQuerybs->bs_Buffer ) )
+
+	if( ( md = FCalloc( 1, sizeof( MYSQLDescriptor ) ) ) == NULL )
 	{
-		FERROR("Cannot run query: '%s'\n", tmpQuerybs->bs_Buffer );
-		BufStringDelete( tmpQuerybs );
-		FERROR( "[MYSQLLibrary]  %s\n", mysql_error( l->con.sql_Con ) );
 		return NULL;
 	}
-	
-	DEBUG("[MYSQLLibrary] SQL SELECT QUERY '%s\n", tmpQuerybs->bs_Buffer );
-	BufStringDelete( tmpQuerybs );
 
-	MYSQL_RES *result = mysql_store_result( l->con.sql_Con );
-  
-	if( result == NULL )
+	md->md_TableName = StringDuplicate( (char *)descr[ SQL_DATA_TABLE_NAME ] );
+	md->md_StructSize = descr[ SQL_DATA_STRUCTURE_SIZE ];
+	md->md_Columns = FCalloc( columns + 1, sizeof( MYSQLColumn ) );
+	md->md_Extra = FCalloc( extra + 1, sizeof( MYSQLColumn ) );
+	md->md_UpdateColumns = FCalloc( columns + 1, sizeof( int ) );
+
+	BufString *selectbs = BufStringNew();
+	BufString *updatebs = BufStringNew();
+
+	if( md->md_TableName == NULL || md->md_Columns == NULL || md->md_Extra == NULL || md->md_UpdateColumns == NULL || selectbs == NULL || updatebs == NULL )
 	{
+		BufStringDelete( selectbs );
+		BufStringDelete( updatebs );
+		DescriptorDelete( md );
 		return NULL;
- 	}
+	}
 
-	MYSQL_ROW row;
-	
-	// This is where the data starts!
-	MinNode *node = NULL;
-	
-	int j = 0;
-	*entries = 0;
+	char tmp[ 512 ];
+	int size;
 
-	//
-	// Receiving data as linked list of objects
-	//
+	BufStringAddSize( selectbs, "SELECT ", 7 );
+	size = snprintf( tmp, sizeof(tmp), "UPDATE %s set", md->md_TableName );
+	BufStringAddSize( updatebs, tmp, size );
 
-	while( ( row = mysql_fetch_row( result ) ) != NULL )
+	for( dptr = &descr[ SQL_DATA_STRUCT_START ] ; dptr[ 0 ] != SQLT_END ; dptr += 3 )
 	{
-		unsigned long *lengths = mysql_fetch_lengths(result);
-		(*entries)++;
-		
-		void *data = FCalloc( 1, descr[ SQL_DATA_STRUCTURE_SIZE ] );
-		int dataUsed = 0; // Tell if we need to free data..
-		
-		// Link the first object (which holds the start of the data)
-		if( firstObject == NULL ) firstObject = data;
-		
-		FUBYTE *strptr = (FUBYTE *)data;	// pointer to structure to which will will insert data
-		
-		// first 2 entries inform about table and size, rest information provided is about columns
-		dptr = &descr[ SQL_DATA_STRUCT_START ]; 
-		
-		int i = 0;
-			
-		// While the column is not the last
-		while( dptr[0] != SQLT_END )
+		MYSQLColumn *mc;
+
+		if( dptr[ 0 ] == SQLT_NODE || dptr[ 0 ] == SQLT_INIT_FUNCTION )
 		{
-			switch( dptr[ 0 ] )
-			{
-				case SQLT_NODE:
-					{
-						dataUsed = 1;
-						MinNode *locnode = (MinNode *)strptr + dptr[ 2 ];
-						if( node != NULL )
-						{
-							node->mln_Succ = (MinNode *)data;
-							node = locnode;
-						}
-						else node = locnode;
-					}
-					break;
-					case SQLT_IDINT:	// primary key
-					case SQLT_INT:
-						{
-							int tmp = 0;
-							if( row[ i ] != NULL )
-							{
-								tmp = (int)atol( row[ i ] );
-							}
-							memcpy( strptr + dptr[ 2 ], &tmp, sizeof( int ) );
-						}
-						break;
-					case SQLT_STR:
-						{
-							if( row[i] != NULL )
-							{
-								//int len = strlen( row[i] );
-								char *tmpval = calloc( lengths[i] + 1, sizeof( char ) );
-								if( tmpval )
-								{
-									// Copy mysql data
-									memcpy( tmpval, row[i], lengths[i] );
-									// Add tmpval to string pointer list..
-									memcpy( strptr + dptr[2], &tmpval, sizeof( char * ) );
-								}
-							}
-							else
-							{
+			mc = &md->md_Extra[ md->md_ExtraCount++ ];
+			mc->mc_Type = dptr[ 0 ];
+			mc->mc_Name = StringDuplicate( (char *)dptr[ 1 ] );
+			mc->mc_Offset = dptr[ 2 ];
+			continue;
+		}
 
-							}
-						}
-						break;
-						
-					case SQLT_DATETIME:
-						{
-							//struct tm ltm;
-							//ltm.tm_year += 1900;
-							//ltm.tm_mon ++;
-							struct tm extm;
-							
-							if( sscanf( (char *)row[i], "%d-%d-%d %d:%d:%d", &(extm.tm_year), &(extm.tm_mon), &(extm.tm_mday), &(extm.tm_hour), &(extm.tm_min), &(extm.tm_sec) ) != EOF )
-							{
-							}
-							if( extm.tm_year > 1900 )
-							{
-								extm.tm_year -= 1900;
-							}
-							// Remember, C count from 0 !
-							extm.tm_mon--;
-							
-							memcpy( strptr + dptr[ 2 ], &extm, sizeof( struct tm ) );
-							DEBUG("[MYSQLLibrary] TIMESTAMP load %s\n", row[ i ] );
-						}
-						break;
-						
-					case SQLT_DATE:
-						{
-							struct tm *ltm = (struct tm *)strptr + dptr[ 2 ];
-							struct tm extm;
-							if( sscanf( (char *)row[i], "%d-%d-%d", &(extm.tm_year), &(extm.tm_mon), &(extm.tm_mday) ) != EOF )
-							{
-								extm.tm_hour = extm.tm_min = extm.tm_sec = 0;
-							}
-							if( extm.tm_year > 1900 )
-							{
-								extm.tm_year -= 1900;
-							}
-							memcpy( strptr + dptr[ 2 ], &extm, sizeof( struct tm ) );
-							
-							DEBUG("[MYSQLLibrary] DATE load %s\n", row[ i ] );
-							
-							DEBUG("[MYSQLLibrary] Year %d  month %d  day %d\n", ltm->tm_year, ltm->tm_mon, ltm->tm_mday );
-						}
-						break;
+		mc = &md->md_Columns[ md->md_ColumnsCount ];
+		mc->mc_Type = dptr[ 0 ];
+		mc->mc_Name = StringDuplicate( (char *)dptr[ 1 ] );
+		mc->mc_Offset = dptr[ 2 ];
 
-					case SQLT_LONG:
-						{
-							FLONG tmp = 0;
-							if( row[ i ] != NULL )
-							{
-								char *end;
-								tmp = (FLONG)strtoll( row[ i ], &end, 0 );
-							}
-							memcpy( strptr + dptr[ 2 ], &tmp, sizeof( FLONG ) );
-						}
-					break;
-					
-					case SQLT_BLOB:
-						{
-							/*
-							DEBUG("[MYSQLLibrary] Read BLOB\n");
-							ListString *ls = ListStringNew();
-							if( ls != NULL )
-							{
-								ListStringAdd( ls, row[i], lengths[i] );
-								
-								ListStringJoin( ls );
-							}
-							else
-							{
-								FERROR("Cannot allocate memory for BLOB\n");
-							}
-							
-							// copy pointer to this list
-							memcpy( strptr + dptr[2], &ls, sizeof( ListString * ) );
-							//ListStringDelete( ls );
-							*/
-						}
-					break;
-					
-						case SQLT_INIT_FUNCTION:
-						{
-							//DEBUG("[MYSQLLibrary] Init function found, calling it\n");
-							if( ((void *)dptr[2]) != NULL && data != NULL )
-							{
-								void (*funcptr)( void * ) = (void *)(void *)dptr[2];
-								funcptr( (void *)data );
-							}
-						}
-					break;
-				}
-				
-				i++;
-				dptr += 3;
+		if( md->md_ColumnsCount == 0 )
+		{
+			size = snprintf( tmp, sizeof(tmp), "`%s`", mc->mc_Name );
 		}
-		j++;
-		// We allocated memory without using it..
-		if( dataUsed == 0 ) 
+		else
 		{
-			if( data == firstObject )
-			{
-				firstObject = NULL;
-			}
-			FFree( data );
+			size = snprintf( tmp, sizeof(tmp), ",`%s`", mc->mc_Name );
+		}
+		BufStringAddSize( selectbs, tmp, size );
+
+		switch( mc->mc_Type )
+		{
+			case SQLT_IDINT:	// primary key is not updated
+				md->md_ID = mc;
+			break;
+
+			case SQLT_DATETIME:
+			case SQLT_DATE:
+				if( mc->mc_Offset == 0 )
+				{
+					break;
+				}
+			// fall through
+			case SQLT_INT:
+			case SQLT_STR:
+				if( md->md_UpdateCount == 0 )
+				{
+					size = snprintf( tmp, sizeof(tmp), " %s = ?", mc->mc_Name );
+				}
+				else
+				{
+					size = snprintf( tmp, sizeof(tmp), ", %s = ?", mc->mc_Name );
+				}
+				BufStringAddSize( updatebs, tmp, size );
+				md->md_UpdateColumns[ md->md_UpdateCount++ ] = md->md_ColumnsCount;
+			break;
 		}
+
+		md->md_ColumnsCount++;
 	}
 
-	mysql_free_result( result );
-	DEBUG("[MYSQLLibrary] Load END\n");
-	
-	return firstObject;
+	size = snprintf( tmp, sizeof(tmp), " FROM %s", md->md_TableName );
+	BufStringAddSize( selectbs, tmp, size );
+
+	if( md->md_ID != NULL )
+	{
+		size = snprintf( tmp, sizeof(tmp), " where %s = ?", md->md_ID->mc_Name );
+		BufStringAddSize( updatebs, tmp, size );
+	}
+
+	size = snprintf( tmp, sizeof(tmp), "select count(*) from %s", md->md_TableName );
+
+	md->md_Select = StringDuplicate( selectbs->bs_Buffer );
+	md->md_SelectSize = selectbs->bs_Size;
+	md->md_Update = StringDuplicate( updatebs->bs_Buffer );
+	md->md_Count = StringDuplicate( tmp );
+
+	BufStringDelete( selectbs );
+	BufStringDelete( updatebs );
+
+	if( md->md_Select == NULL || md->md_Update == NULL || md->md_Count == NULL )
+	{
+		DescriptorDelete( md );
+		return NULL;
+	}
+
+	DEBUG("[DescriptorCompile] Table %s compiled, columns %d, select: %s\n", md->md_TableName, md->md_ColumnsCount, md->md_Select );
+
+	return md;
 }
 
 /**
- * Update data in database. Structure must contain primaryID key.
+ * Get compiled descriptor. Descriptor is compiled when it is used first time
  *
- * @param l pointer to mysql.library structure
  * @param descr pointer to taglist which represent DB to C structure conversion
- * @param data pointer to object which will be updated in DB
- * @return 0 when success, otherwise error number
+ * @return pointer to compiled descriptor or NULL when descriptor is not valid
  */
-int Update( struct SQLLibrary *l, FULONG *descr, void *data )
+static MYSQLDescriptor *DescriptorGet( const FULONG *descr )
 {
-	BufString *querybs = BufStringNew();
-	char tmpQuery[ 2048 ];
-	int primaryId = -1;
-	char *primaryIdName = NULL;
-	DEBUG("[MYSQLLibrary] Update\n");
-	
-	if( descr == NULL || data == NULL )
+	MYSQLDescriptorAlias *mda;
+	MYSQLDescriptor *md = NULL;
+
+	if( descr == NULL || descr[ 0 ] != SQLT_TABNAME )
 	{
-		BufStringDelete( querybs );
-		DEBUG("[MYSQLLibrary] Data structure or description was not provided!\n");
-		return 0;
+		return NULL;
 	}
-	
-	if( descr[ 0 ] != SQLT_TABNAME )
+
+	unsigned int hash = (unsigned int)( ( (FULONG)descr >> 3 ) % MYSQL_DESCRIPTOR_HASH_SIZE );
+
+	pthread_mutex_lock( &descriptorMutex );
+
+	for( mda = descriptorAliases[ hash ] ; mda != NULL ; mda = mda->mda_Next )
 	{
+		if( mda->mda_Descr == descr )
+		{
+			md = mda->mda_Desc;
+			break;
+		}
+	}
+
+	if( md == NULL )
+	{
+		for( md = descriptors ; md != NULL ; md = md->md_Next )
+		{
+			if( DescriptorEqual( md, descr ) == TRUE )
+			{
+				break;
+			}
+		}
+
+		if( md == NULL && ( md = DescriptorCompile( descr ) ) != NULL )
+		{
+			md->md_Next = descriptors;
+			descriptors = md;
+		}
+
+		if( md != NULL && ( mda = FCalloc( 1, sizeof( MYSQLDescriptorAlias ) ) ) != NULL )
+		{
+			mda->mda_Descr = descr;
+			mda->mda_Desc = md;
+			mda->mda_Next = descriptorAliases[ hash ];
+			descriptorAliases[ hash ] = mda;
+		}
+	}
+
+	pthread_mutex_unlock( &descriptorMutex );
+
+	return md;
+}
+
+/**
+ * Release all compiled descriptors. Must be called when descriptorMutex is locked
+ */
+static void DescriptorsRelease( void )
+{
+	int i;
+
+	for( i=0 ; i < MYSQL_DESCRIPTOR_HASH_SIZE ; i++ )
+	{
+		while( descriptorAliases[ i ] != NULL )
+		{
+			MYSQLDescriptorAlias *mda = descriptorAliases[ i ];
+			descriptorAliases[ i ] = mda->mda_Next;
+			FFree( mda );
+		}
+	}
+
+	while( descriptors != NULL )
+	{
+		MYSQLDescriptor *md = descriptors;
+		descriptors = md->md_Next;
+		DescriptorDelete( md );
+	}
+}
+
+/**
+ * Compile descriptor before first query, compiled descriptor is shared by all connections
+ *
+ * @param l pointer to mysql.library structure
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @return 0 when success, otherwise error number
+ */
+int CompileDescriptor( struct SQLLibrary *l, const FULONG *descr )
+{
+	if( DescriptorGet( descr ) == NULL )
+	{
+		FERROR("[MYSQLLibrary] Cannot compile descriptor %p\n", descr );
+		return -1;
+	}
+	return 0;
+}
+
+//
+// Prepared statements
+//
+
+/**
+ * Release statement
+ *
+ * @param ms pointer to statement
+ */
+static void StatementDelete( MYSQLStatement *ms )
+{
+	if( ms->ms_Stmt != NULL ) mysql_stmt_close( ms->ms_Stmt );
+	if( ms->ms_Where != NULL ) FFree( ms->ms_Where );
+	if( ms->ms_Query != NULL ) FFree( ms->ms_Query );
+	if( ms->ms_Bind != NULL ) FFree( ms->ms_Bind );
+	if( ms->ms_Lengths != NULL ) FFree( ms->ms_Lengths );
+	if( ms->ms_Nulls != NULL ) FFree( ms->ms_Nulls );
+	if( ms->ms_Times != NULL ) FFree( ms->ms_Times );
+	if( ms->ms_Dates != NULL ) FFree( ms->ms_Dates );
+	FFree( ms );
+}
+
+/**
+ * Create statement with buffers for all descriptor columns. Statement is not prepared
+ *
+ * @param md pointer to compiled descriptor
+ * @param type MYSQL_STATEMENT_* type
+ * @param mask columns stored by Save statement
+ * @param where custom "where" of Load statement or NULL
+ * @return pointer to new statement or NULL when error appear
+ */
+static MYSQLStatement *StatementNew( MYSQLDescriptor *md, int type, FUQUAD mask, const char *where )
+{
+	MYSQLStatement *ms;
+	int binds = md->md_ColumnsCount + 1;
+
+	if( ( ms = FCalloc( 1, sizeof( MYSQLStatement ) ) ) == NULL )
+	{
+		return NULL;
+	}
+
+	ms->ms_Desc = md;
+	ms->ms_Type = type;
+	ms->ms_Mask = mask;
+	ms->ms_Bind = FCalloc( binds, sizeof( MYSQL_BIND ) );
+	ms->ms_Lengths = FCalloc( binds, sizeof( unsigned long ) );
+	ms->ms_Nulls = FCalloc( binds, sizeof( my_bool ) );
+	ms->ms_Times = FCalloc( binds, sizeof( MYSQL_TIME ) );
+	ms->ms_Dates = FCalloc( binds, MYSQL_DATE_SIZE );
+
+	if( where != NULL )
+	{
+		ms->ms_Where = StringDuplicate( where );
+	}
+
+	if( ms->ms_Bind == NULL || ms->ms_Lengths == NULL || ms->ms_Nulls == NULL || ms->ms_Times == NULL || ms->ms_Dates == NULL || ( where != NULL && ms->ms_Where == NULL ) )
+	{
+		StatementDelete( ms );
+		return NULL;
+	}
+	return ms;
+}
+
+/**
+ * Close prepared statements of connection. Entries are kept and prepared again when they are used
+ *
+ * @param sd pointer to connection special data
+ */
+static void StatementsClose( SpecialData *sd )
+{
+	MYSQLStatement *ms;
+
+	for( ms = sd->sd_Statements ; ms != NULL ; ms = ms->ms_Next )
+	{
+		if( ms->ms_Stmt != NULL )
+		{
+			mysql_stmt_close( ms->ms_Stmt );
+			ms->ms_Stmt = NULL;
+		}
+	}
+}
+
+/**
+ * Release all statements of connection
+ *
+ * @param sd pointer to connection special data
+ */
+static void StatementsRelease( SpecialData *sd )
+{
+	while( sd->sd_Statements != NULL )
+	{
+		MYSQLStatement *ms = sd->sd_Statements;
+		sd->sd_Statements = ms->ms_Next;
+		StatementDelete( ms );
+	}
+	sd->sd_StatementsCount = 0;
+}
+
+/**
+ * Find statement in connection cache. Found entry becomes most recently used one
+ *
+ * @param sd pointer to connection special data
+ * @param md pointer to compiled descriptor
+ * @param type MYSQL_STATEMENT_* type
+ * @param mask columns stored by Save statement
+ * @param where custom "where" of Load statement or NULL
+ * @return pointer to statement or NULL when it is not cached
+ */
+static MYSQLStatement *StatementFind( SpecialData *sd, MYSQLDescriptor *md, int type, FUQUAD mask, const char *where )
+{
+	MYSQLStatement *ms, *prev = NULL;
+
+	for( ms = sd->sd_Statements ; ms != NULL ; prev = ms, ms = ms->ms_Next )
+	{
+		if( ms->ms_Desc == md && ms->ms_Type == type && ms->ms_Mask == mask &&
+			( ms->ms_Where == where || ( ms->ms_Where != NULL && where != NULL && strcmp( ms->ms_Where, where ) == 0 ) ) )
+		{
+			if( prev != NULL )
+			{
+				prev->ms_Next = ms->ms_Next;
+				ms->ms_Next = sd->sd_Statements;
+				sd->sd_Statements = ms;
+			}
+			return ms;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Get statement from connection cache. Missing entry is created, least recently used one is removed when cache is full
+ *
+ * @param l pointer to mysql.library structure
+ * @param md pointer to compiled descriptor
+ * @param type MYSQL_STATEMENT_* type
+ * @param mask columns stored by Save statement
+ * @param where custom "where" of Load statement or NULL
+ * @param cache FALSE when statement should not be kept by connection
+ * @return pointer to statement or NULL when error appear
+ */
+static MYSQLStatement *StatementGet( struct SQLLibrary *l, MYSQLDescriptor *md, int type, FUQUAD mask, const char *where, FBOOL cache )
+{
+	SpecialData *sd = (SpecialData *)l->sd;
+	MYSQLStatement *ms, *prev = NULL;
+
+	if( sd->sd_StatementCache == FALSE || cache == FALSE )
+	{
+		return StatementNew( md, type, mask, where );
+	}
+
+	if( ( ms = StatementFind( sd, md, type, mask, where ) ) != NULL )
+	{
+		return ms;
+	}
+
+	if( sd->sd_StatementsCount >= MYSQL_STATEMENT_CACHE_SIZE )
+	{
+		// entries which were not prepared go first, then least recently used one
+		MYSQLStatement *remove = NULL, *removePrev = NULL, *last = NULL, *lastPrev = NULL;
+
+		for( prev = NULL, ms = sd->sd_Statements ; ms != NULL ; prev = ms, ms = ms->ms_Next )
+		{
+			if( ms->ms_Stmt == NULL )
+			{
+				remove = ms;
+				removePrev = prev;
+			}
+			last = ms;
+			lastPrev = prev;
+		}
+
+		if( remove == NULL )
+		{
+			remove = last;
+			removePrev = lastPrev;
+		}
+
+		if( removePrev != NULL )
+		{
+			removePrev->ms_Next = remove->ms_Next;
+		}
+		else
+		{
+			sd->sd_Statements = remove->ms_Next;
+		}
+		StatementDelete( remove );
+		sd->sd_StatementsCount--;
+	}
+
+	if( ( ms = StatementNew( md, type, mask, where ) ) != NULL )
+	{
+		ms->ms_Cached = TRUE;
+		ms->ms_Next = sd->sd_Statements;
+		sd->sd_Statements = ms;
+		sd->sd_StatementsCount++;
+	}
+	return ms;
+}
+
+/**
+ * Release statement which is not kept by connection
+ *
+ * @param ms pointer to statement
+ */
+static void StatementDrop( MYSQLStatement *ms )
+{
+	if( ms != NULL && ms->ms_Cached == FALSE )
+	{
+		StatementDelete( ms );
+	}
+}
+
+/**
+ * Get last error of statement
+ *
+ * @param l pointer to mysql.library structure
+ * @param ms pointer to statement
+ * @return error message
+ */
+static const char *StatementError( struct SQLLibrary *l, MYSQLStatement *ms )
+{
+	if( ms->ms_Stmt != NULL )
+	{
+		return mysql_stmt_error( ms->ms_Stmt );
+	}
+	return mysql_error( l->con.sql_Con );
+}
+
+/**
+ * Check if statement failed because server does not know it anymore (connection was lost or restored)
+ *
+ * @param stmt pointer to mysql statement
+ * @return TRUE when statement must be prepared again, otherwise FALSE
+ */
+static FBOOL StatementLost( MYSQL_STMT *stmt )
+{
+	unsigned int err = mysql_stmt_errno( stmt );
+
+	return ( err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST || err == CR_NO_PREPARE_STMT || err == ER_UNKNOWN_STMT_HANDLER );
+}
+
+/**
+ * Prepare statement when needed, bind parameters and execute it. Statement is prepared again once when server lost it
+ *
+ * @param l pointer to mysql.library structure
+ * @param ms pointer to statement with query text and parameters in ms_Bind (ms_Params when set)
+ * @return 0 when success, -1 when statement cannot be prepared, -2 when execution failed
+ */
+static int StatementExecute( struct SQLLibrary *l, MYSQLStatement *ms )
+{
+	int retry;
+
+	for( retry = 0 ; retry < 2 ; retry++ )
+	{
+		if( ms->ms_Stmt == NULL )
+		{
+			if( ( ms->ms_Stmt = mysql_stmt_init( l->con.sql_Con ) ) == NULL )
+			{
+				return -1;
+			}
+
+			if( mysql_stmt_prepare( ms->ms_Stmt, ms->ms_Query, strlen( ms->ms_Query ) ) != 0 )
+			{
+				FERROR("[StatementExecute] Cannot prepare '%s': %s\n", ms->ms_Query, mysql_stmt_error( ms->ms_Stmt ) );
+				mysql_stmt_close( ms->ms_Stmt );
+				ms->ms_Stmt = NULL;
+				return -1;
+			}
+			DEBUG("[StatementExecute] Prepared: %s\n", ms->ms_Query );
+		}
+
+		MYSQL_BIND *params = ms->ms_Bind;
+		if( ms->ms_Params != NULL )
+		{
+			// library reads one bind entry per placeholder
+			if( mysql_stmt_param_count( ms->ms_Stmt ) != (unsigned long)ms->ms_ParamsCount )
+			{
+				FERROR("[StatementExecute] '%s' expects %lu parameters, %d provided\n", ms->ms_Query, mysql_stmt_param_count( ms->ms_Stmt ), ms->ms_ParamsCount );
+				return -1;
+			}
+			params = ms->ms_Params;
+		}
+
+		if( ( mysql_stmt_param_count( ms->ms_Stmt ) == 0 || mysql_stmt_bind_param( ms->ms_Stmt, params ) == 0 ) && mysql_stmt_execute( ms->ms_Stmt ) == 0 )
+		{
+			return 0;
+		}
+
+		if( retry > 0 || StatementLost( ms->ms_Stmt ) == FALSE )
+		{
+			unsigned int err = mysql_stmt_errno( ms->ms_Stmt );
+			if( err == CR_SERVER_LOST || err == CR_SERVER_GONE_ERROR )
+			{
+				l->con.sql_Recconect = TRUE;
+			}
+			break;
+		}
+
+		// all statements of connection are gone after reconnection
+		StatementsClose( (SpecialData *)l->sd );
+		if( ms->ms_Stmt != NULL )
+		{
+			mysql_stmt_close( ms->ms_Stmt );
+			ms->ms_Stmt = NULL;
+		}
+	}
+	return -2;
+}
+
+/**
+ * Bind structure field as statement parameter
+ *
+ * @param ms pointer to statement
+ * @param pos parameter position
+ * @param mc pointer to column description
+ * @param data pointer to structure
+ * @param save TRUE when dates are serialised for INSERT, FALSE for UPDATE
+ */
+static void StatementBindParam( MYSQLStatement *ms, int pos, MYSQLColumn *mc, FUBYTE *data, FBOOL save )
+{
+	MYSQL_BIND *bind = &ms->ms_Bind[ pos ];
+	char *date = &ms->ms_Dates[ pos * MYSQL_DATE_SIZE ];
+
+	switch( mc->mc_Type )
+	{
+		case SQLT_IDINT:
+		case SQLT_INT:
+			bind->buffer_type = MYSQL_TYPE_LONG;
+			bind->buffer = data + mc->mc_Offset;
+		break;
+
+		case SQLT_STR:
+			{
+				char *tmpchar;
+				memcpy( &tmpchar, data + mc->mc_Offset, sizeof( char *) );
+
+				if( tmpchar != NULL )
+				{
+					ms->ms_Lengths[ pos ] = strlen( tmpchar );
+					bind->buffer_type = MYSQL_TYPE_STRING;
+					bind->buffer = tmpchar;
+					bind->buffer_length = ms->ms_Lengths[ pos ];
+					bind->length = &ms->ms_Lengths[ pos ];
+				}
+				else	// string was set to NULL
+				{
+					bind->buffer_type = MYSQL_TYPE_NULL;
+				}
+			}
+		break;
+
+		case SQLT_DATETIME:
+			{
+				// '2015-08-10 16:28:31'
+				struct tm tp;
+				localtime_r( (time_t *)( data + mc->mc_Offset ), &tp );
+
+				if( tp.tm_year < 1901 ) tp.tm_year += 1900;
+				if( save == TRUE )
+				{
+					if( tp.tm_mon < 0 ) tp.tm_mon = 0;
+				}
+				else
+				{
+					if( tp.tm_mon < 1 ) tp.tm_mon = 1;
+				}
+				if( tp.tm_mday < 1 ) tp.tm_mday = 1;
+				// month is counted from 0 in C, if we want to put this into database it must be month counted from 1
+				ms->ms_Lengths[ pos ] = snprintf( date, MYSQL_DATE_SIZE, "%04d-%02d-%02d %02d:%02d:%02d", tp.tm_year, tp.tm_mon+1, tp.tm_mday, tp.tm_hour, tp.tm_min, tp.tm_sec );
+				bind->buffer_type = MYSQL_TYPE_STRING;
+				bind->buffer = date;
+				bind->buffer_length = ms->ms_Lengths[ pos ];
+				bind->length = &ms->ms_Lengths[ pos ];
+			}
+		break;
+
+		case SQLT_DATE:
+			{
+				// '2015-08-10'
+				struct tm *tp = (struct tm *)( data + mc->mc_Offset );
+
+				if( tp->tm_year < 1901 ) tp->tm_year += 1900;
+				if( save == TRUE )
+				{
+					if( tp->tm_mon < 0 ) tp->tm_mon = 0;
+					if( tp->tm_mday < 1 ) tp->tm_mday = 1;
+					ms->ms_Lengths[ pos ] = snprintf( date, MYSQL_DATE_SIZE, "%04d-%02d-%02d", tp->tm_year, tp->tm_mon+1, tp->tm_mday );
+				}
+				else
+				{
+					if( tp->tm_mon < 1 ) tp->tm_mon = 1;
+					if( tp->tm_mday < 1 ) tp->tm_mday = 1;
+					ms->ms_Lengths[ pos ] = snprintf( date, MYSQL_DATE_SIZE, "%04d-%02d-%02d", tp->tm_year, tp->tm_mon, tp->tm_mday );
+				}
+				bind->buffer_type = MYSQL_TYPE_STRING;
+				bind->buffer = date;
+				bind->buffer_length = ms->ms_Lengths[ pos ];
+				bind->length = &ms->ms_Lengths[ pos ];
+			}
+		break;
+
+		case SQLT_BLOB:
+			{
+				ListString *ls = NULL;
+				memcpy( &ls, data + mc->mc_Offset, sizeof( ListString *) );
+
+				ms->ms_Lengths[ pos ] = ls->ls_Size;
+				bind->buffer_type = MYSQL_TYPE_BLOB;
+				bind->buffer = ls->ls_Data;
+				bind->buffer_length = ms->ms_Lengths[ pos ];
+				bind->length = &ms->ms_Lengths[ pos ];
+			}
+		break;
+
+		default:
+			bind->buffer_type = MYSQL_TYPE_NULL;
+		break;
+	}
+}
+
+//
+// Load
+//
+
+/**
+ * Link loaded object into list and call init function. Objects of descriptor without SQLT_NODE are not kept
+ *
+ * @param md pointer to compiled descriptor
+ * @param data pointer to loaded object
+ * @param node pointer to node of previous object
+ * @param firstObject pointer to first object of list
+ * @return TRUE when object was added to list, otherwise FALSE and object must be released
+ */
+static FBOOL LoadObjectFinish( MYSQLDescriptor *md, FUBYTE *data, MinNode **node, void **firstObject )
+{
+	FBOOL dataUsed = FALSE;
+	int i;
+
+	for( i=0 ; i < md->md_ExtraCount ; i++ )
+	{
+		MYSQLColumn *mc = &md->md_Extra[ i ];
+
+		switch( mc->mc_Type )
+		{
+			case SQLT_NODE:
+				{
+					dataUsed = TRUE;
+					MinNode *locnode = (MinNode *)( data + mc->mc_Offset );
+					if( *node != NULL )
+					{
+						(*node)->mln_Succ = (MinNode *)data;
+					}
+					*node = locnode;
+				}
+			break;
+
+			case SQLT_INIT_FUNCTION:
+				{
+					if( ((void *)mc->mc_Offset) != NULL )
+					{
+						void (*funcptr)( void * ) = (void *)mc->mc_Offset;
+						funcptr( (void *)data );
+					}
+				}
+			break;
+		}
+	}
+
+	if( dataUsed == TRUE && *firstObject == NULL )
+	{
+		*firstObject = data;
+	}
+	return dataUsed;
+}
+
+/**
+ * Load data by text query, used for queries which are not repeated
+ *
+ * @param l pointer to mysql.library structure
+ * @param md pointer to compiled descriptor
+ * @param where "where" part of query or NULL
+ * @param entries pointer to interger where number of loaded entries will be returned
+ * @return pointer to new structure or list of structures.
+ */
+static void *LoadText( struct SQLLibrary *l, MYSQLDescriptor *md, char *where, int *entries )
+{
+	BufString *tmpQuerybs = BufStringNew();
+	void *firstObject = NULL;
+
+	BufStringAddSize( tmpQuerybs, md->md_Select, md->md_SelectSize );
+
+	// Check that there is a where query
+	if( where != NULL )
+	{
+		BufStringAddSize( tmpQuerybs, " WHERE ", 7 );
+		BufStringAdd( tmpQuerybs, where );
+	}
+
+	if( mysql_query( l->con.sql_Con, tmpQuerybs->bs_Buffer ) )
+	{
+		FERROR("Cannot run query: '%s'\n", tmpQuerybs->bs_Buffer );
+		BufStringDelete( tmpQuerybs );
+		FERROR( "[MYSQLLibrary]  %s\n", mysql_error( l->con.sql_Con ) );
+		return NULL;
+	}
+
+	DEBUG("[MYSQLLibrary] SQL SELECT QUERY '%s\n", tmpQuerybs->bs_Buffer );
+	BufStringDelete( tmpQuerybs );
+
+	MYSQL_RES *result = mysql_store_result( l->con.sql_Con );
+
+	if( result == NULL )
+	{
+		return NULL;
+ 	}
+
+	MYSQL_ROW row;
+
+	// This is where the data starts!
+	MinNode *node = NULL;
+
+	*entries = 0;
+
+	//
+	// Receiving data as linked list of objects
+	//
+
+	while( ( row = mysql_fetch_row( result ) ) != NULL )
+	{
+		unsigned long *lengths = mysql_fetch_lengths(result);
+		(*entries)++;
+
+		void *data = FCalloc( 1, md->md_StructSize );
+		FUBYTE *strptr = (FUBYTE *)data;	// pointer to structure to which will will insert data
+		int i;
+
+		if( data == NULL )
+		{
+			break;
+		}
+
+		for( i=0 ; i < md->md_ColumnsCount ; i++ )
+		{
+			MYSQLColumn *mc = &md->md_Columns[ i ];
+
+			switch( mc->mc_Type )
+			{
+				case SQLT_IDINT:	// primary key
+				case SQLT_INT:
+					{
+						int tmp = 0;
+						if( row[ i ] != NULL )
+						{
+							tmp = (int)atol( row[ i ] );
+						}
+						memcpy( strptr + mc->mc_Offset, &tmp, sizeof( int ) );
+					}
+				break;
+
+				case SQLT_STR:
+					{
+						if( row[i] != NULL )
+						{
+							char *tmpval = calloc( lengths[i] + 1, sizeof( char ) );
+							if( tmpval )
+							{
+								// Copy mysql data
+								memcpy( tmpval, row[i], lengths[i] );
+								// Add tmpval to string pointer list..
+								memcpy( strptr + mc->mc_Offset, &tmpval, sizeof( char * ) );
+							}
+						}
+					}
+				break;
+
+				case SQLT_DATETIME:
+					{
+						struct tm extm;
+						memset( &extm, 0, sizeof( struct tm ) );
+
+						if( row[ i ] != NULL )
+						{
+							sscanf( (char *)row[i], "%d-%d-%d %d:%d:%d", &(extm.tm_year), &(extm.tm_mon), &(extm.tm_mday), &(extm.tm_hour), &(extm.tm_min), &(extm.tm_sec) );
+						}
+						if( extm.tm_year > 1900 )
+						{
+							extm.tm_year -= 1900;
+						}
+						// Remember, C count from 0 !
+						extm.tm_mon--;
+
+						memcpy( strptr + mc->mc_Offset, &extm, sizeof( struct tm ) );
+					}
+				break;
+
+				case SQLT_DATE:
+					{
+						struct tm extm;
+						memset( &extm, 0, sizeof( struct tm ) );
+
+						if( row[ i ] != NULL )
+						{
+							sscanf( (char *)row[i], "%d-%d-%d", &(extm.tm_year), &(extm.tm_mon), &(extm.tm_mday) );
+						}
+						if( extm.tm_year > 1900 )
+						{
+							extm.tm_year -= 1900;
+						}
+						memcpy( strptr + mc->mc_Offset, &extm, sizeof( struct tm ) );
+					}
+				break;
+
+				case SQLT_LONG:
+					{
+						FLONG tmp = 0;
+						if( row[ i ] != NULL )
+						{
+							char *end;
+							tmp = (FLONG)strtoll( row[ i ], &end, 0 );
+						}
+						memcpy( strptr + mc->mc_Offset, &tmp, sizeof( FLONG ) );
+					}
+				break;
+			}
+		}
+
+		// We allocated memory without using it..
+		if( LoadObjectFinish( md, strptr, &node, &firstObject ) == FALSE )
+		{
+			FFree( data );
+		}
+	}
+
+	mysql_free_result( result );
+
+	return firstObject;
+}
+
+/**
+ * Load data by prepared statement. Result columns are bound directly to structure fields
+ *
+ * @param l pointer to mysql.library structure
+ * @param ms pointer to Load statement
+ * @param entries pointer to interger where number of loaded entries will be returned
+ * @param failed pointer to variable set to TRUE when statement cannot be used and text query should be sent
+ * @return pointer to new structure or list of structures.
+ */
+static void *LoadPrepared( struct SQLLibrary *l, MYSQLStatement *ms, int *entries, FBOOL *failed )
+{
+	MYSQLDescriptor *md = ms->ms_Desc;
+	MYSQL_BIND *bind = ms->ms_Bind;
+	void *firstObject = NULL;
+	MinNode *node = NULL;
+	int i;
+
+	*failed = TRUE;
+
+	if( ms->ms_Query == NULL )
+	{
+		BufString *querybs = BufStringNew();
+		if( querybs == NULL )
+		{
+			return NULL;
+		}
+		BufStringAddSize( querybs, md->md_Select, md->md_SelectSize );
+		if( ms->ms_Where != NULL )
+		{
+			BufStringAddSize( querybs, " WHERE ", 7 );
+			BufStringAdd( querybs, ms->ms_Where );
+		}
+		ms->ms_Query = StringDuplicate( querybs->bs_Buffer );
 		BufStringDelete( querybs );
-		DEBUG("[MYSQLLibrary] SQLT_TABNAME was not provided!\n");
-		return 0;
+
+		if( ms->ms_Query == NULL )
+		{
+			return NULL;
+		}
 	}
-	
-	char *whereColName = NULL;
-	int whereColValue = -1;
-	FULONG *dptr = &descr[ SQL_DATA_STRUCT_START ];
-	unsigned char *strptr = (unsigned char *)data;	// pointer to structure to which will will insert data
-	
-	while( dptr[0] != SQLT_END )
+
+	if( StatementExecute( l, ms ) != 0 )
+	{
+		FERROR("[MYSQLLibrary] Cannot execute '%s': %s\n", ms->ms_Query, StatementError( l, ms ) );
+		return NULL;
+	}
+
+	if( mysql_stmt_field_count( ms->ms_Stmt ) != (unsigned int)md->md_ColumnsCount || mysql_stmt_store_result( ms->ms_Stmt ) != 0 )
+	{
+		FERROR("[MYSQLLibrary] Cannot read result of '%s': %s\n", ms->ms_Query, StatementError( l, ms ) );
+		mysql_stmt_free_result( ms->ms_Stmt );
+		return NULL;
+	}
+
+	*failed = FALSE;
+	*entries = 0;
+
+	while( TRUE )
 	{
-		switch( dptr[ 0 ] )
+		FUBYTE *data = FCalloc( 1, md->md_StructSize );
+		if( data == NULL )
+		{
+			break;
+		}
+
+		memset( bind, 0, md->md_ColumnsCount * sizeof( MYSQL_BIND ) );
+
+		for( i=0 ; i < md->md_ColumnsCount ; i++ )
+		{
+			MYSQLColumn *mc = &md->md_Columns[ i ];
+
+			bind[ i ].length = &ms->ms_Lengths[ i ];
+			bind[ i ].is_null = &ms->ms_Nulls[ i ];
+
+			switch( mc->mc_Type )
+			{
+				case SQLT_IDINT:
+				case SQLT_INT:
+					bind[ i ].buffer_type = MYSQL_TYPE_LONG;
+					bind[ i ].buffer = data + mc->mc_Offset;
+				break;
+
+				case SQLT_LONG:
+					bind[ i ].buffer_type = MYSQL_TYPE_LONGLONG;
+					bind[ i ].buffer = data + mc->mc_Offset;
+				break;
+
+				case SQLT_STR:
+					// only length is fetched, string is read by mysql_stmt_fetch_column
+					bind[ i ].buffer_type = MYSQL_TYPE_STRING;
+				break;
+
+				case SQLT_DATETIME:
+					bind[ i ].buffer_type = MYSQL_TYPE_DATETIME;
+					bind[ i ].buffer = &ms->ms_Times[ i ];
+				break;
+
+				case SQLT_DATE:
+					bind[ i ].buffer_type = MYSQL_TYPE_DATE;
+					bind[ i ].buffer = &ms->ms_Times[ i ];
+				break;
+
+				default:	// BLOBs are not loaded
+					bind[ i ].buffer_type = MYSQL_TYPE_NULL;
+				break;
+			}
+		}
+
+		int res = 1;
+		if( mysql_stmt_bind_result( ms->ms_Stmt, bind ) == 0 )
 		{
-			case SQLT_IDINT:	// primary key
-				{
-					memcpy( &whereColValue, strptr + dptr[ 2 ], sizeof( int ) );
-					whereColName = (char *) dptr[ 1 ];		// data field name
-					break;
-				}
+			res = mysql_stmt_fetch( ms->ms_Stmt );
 		}
-		if( whereColName != NULL )
+
+		if( res != 0 && res != MYSQL_DATA_TRUNCATED )
 		{
+			if( res != MYSQL_NO_DATA )
+			{
+				FERROR("[MYSQLLibrary] Cannot fetch row of '%s': %s\n", ms->ms_Query, mysql_stmt_error( ms->ms_Stmt ) );
+			}
+			FFree( data );
 			break;
 		}
-		
-		dptr += 3;
-	}
 
-	//"UPDATE %s set SessionID = '%s', LoggedTime = '%lld' where Name = '%s'"
-	
-	int lsize = sprintf( tmpQuery, "UPDATE %s set ", (char *)descr[ 1 ] );
-	BufStringAddSize( querybs, tmpQuery, lsize );
+		(*entries)++;
 
-	DEBUG("[MYSQLLibrary] Update SQL: %s\n", tmpQuery );
-	
-	dptr = &descr[ SQL_DATA_STRUCT_START ];		// first 2 entries inform about table, rest information provided is about columns
-	
-	int cols = 0;
-	
-	while( dptr[0] != SQLT_END )
-	{
-		switch( dptr[ 0 ] )
+		for( i=0 ; i < md->md_ColumnsCount ; i++ )
 		{
-			case SQLT_IDINT:	// primary key
-				{
-					// we just skip that in update
-					
-					int tmpint;
-					memcpy( &tmpint, strptr + dptr[ 2 ], sizeof( int ) );
-					primaryId = tmpint;
-					primaryIdName = ( char *)dptr[ 1 ];
-					
-					//DEBUG("[MYSQLLibrary] : we dont update PRIMARY KEY %d\n", primaryId );
-				}
-				break;
-				
-			case SQLT_INT:
-				{
-					char tmp[ 256 ];
-					int tmpint;
-					int sprintfsize = 0;
-					
-					memcpy( &tmpint, strptr + dptr[ 2 ], sizeof( int ) );
-					if( cols == 0 )
-					{
-						sprintfsize = sprintf( tmp, " %s = %d", (char *)dptr[ 1 ], tmpint );
-					}
-					else
-					{
-						sprintfsize = sprintf( tmp, ", %s = %d", (char *)dptr[ 1 ], tmpint );
-					}
-					//strcat( tmpQuery, tmp );
-					BufStringAddSize( querybs, tmp, sprintfsize );
-					cols++;
+			MYSQLColumn *mc = &md->md_Columns[ i ];
 
-					//DEBUG("[MYSQLLibrary] update set int %d to %s\n", tmpint, (char *)dptr[ 1 ] );
-				}
-				break;
-				
-			case SQLT_STR:
-				{
-					char tmp[ 256 ];
-					char *tmpchar;
-					memcpy( &tmpchar, strptr + dptr[ 2 ], sizeof( char *) );
-					//DEBUG("[MYSQLLibrary] update, pointer %p\n", tmpchar );
-					int sprintfsize = 0;
-					
-					if( tmpchar != NULL )
+			if( ms->ms_Nulls[ i ] )
+			{
+				continue;
+			}
+
+			switch( mc->mc_Type )
+			{
+				case SQLT_STR:
 					{
-						char *ttext = NULL;
-						char *esctext = NULL;
-						
-						int tmpcharsize = strlen( tmpchar );
-						int ttextsize = strlen( (char *)dptr[ 1 ] ) + ( tmpcharsize << 1 ) + 256;
-						
-						if( ( ttext = FCalloc( ttextsize, sizeof(char) ) ) != NULL )
+						char *tmpval = calloc( ms->ms_Lengths[ i ] + 1, sizeof( char ) );
+						if( tmpval )
 						{
-							if( ( esctext = FCalloc( (tmpcharsize << 1 ) + 1, sizeof(char) ) ) != NULL )
+							MYSQL_BIND col;
+							memset( &col, 0, sizeof( MYSQL_BIND ) );
+							col.buffer_type = MYSQL_TYPE_STRING;
+							col.buffer = tmpval;
+							col.buffer_length = ms->ms_Lengths[ i ];
+
+							if( ms->ms_Lengths[ i ] > 0 )
 							{
-								mysql_real_escape_string( l->con.sql_Con, esctext, tmpchar, tmpcharsize );
-								
-								if( cols == 0 )
-								{
-									sprintfsize = sprintf( ttext, " %s = '%s'", (char *)dptr[ 1 ], esctext );
-								}
-								else
-								{
-									sprintfsize = sprintf( ttext, ", %s = '%s'", (char *)dptr[ 1 ], esctext );
-								}
-								//strcat( tmpQuery, tmp );
-								BufStringAddSize( querybs, ttext, sprintfsize );
-								FFree( esctext );
+								mysql_stmt_fetch_column( ms->ms_Stmt, &col, i, 0 );
 							}
-							FFree( ttext );
+							memcpy( data + mc->mc_Offset, &tmpval, sizeof( char * ) );
 						}
-						
-						//DEBUG("[MYSQLLibrary] update set string %s to %s\n", tmpchar, (char *)dptr[ 1 ] );
-						
-						cols++;
 					}
-					else	// string was set to NULL
+				break;
+
+				case SQLT_DATETIME:
+				case SQLT_DATE:
 					{
-						if( cols == 0 )
+						MYSQL_TIME *t = &ms->ms_Times[ i ];
+						struct tm extm;
+						memset( &extm, 0, sizeof( struct tm ) );
+
+						extm.tm_year = t->year;
+						if( extm.tm_year > 1900 )
+						{
+							extm.tm_year -= 1900;
+						}
+						extm.tm_mday = t->day;
+						if( mc->mc_Type == SQLT_DATETIME )
 						{
-							sprintfsize = sprintf( tmp, " %s = NULL", (char *)dptr[ 1 ] );
+							// Remember, C count from 0 !
+							extm.tm_mon = t->month - 1;
+							extm.tm_hour = t->hour;
+							extm.tm_min = t->minute;
+							extm.tm_sec = t->second;
 						}
 						else
 						{
-							sprintfsize = sprintf( tmp, ", %s = NULL", (char *)dptr[ 1 ] );
+							extm.tm_mon = t->month;
 						}
-						BufStringAddSize( querybs, tmp, sprintfsize );
-						//strcat( tmpQuery, tmp );
-						
-						cols++;
+						memcpy( data + mc->mc_Offset, &extm, sizeof( struct tm ) );
 					}
-						
-				}
 				break;
-				
-				case SQLT_DATETIME:
+			}
+		}
+
+		// We allocated memory without using it..
+		if( LoadObjectFinish( md, data, &node, &firstObject ) == FALSE )
+		{
+			FFree( data );
+		}
+	}
+
+	mysql_stmt_free_result( ms->ms_Stmt );
+
+	return firstObject;
+}
+
+/**
+ * Check if Load "where" text was used recently. New text is remembered
+ *
+ * @param sd pointer to connection special data
+ * @param where custom "where" of Load or NULL
+ * @return TRUE when same text was used by one of last MYSQL_WHERE_HISTORY calls, otherwise FALSE
+ */
+static FBOOL WhereRepeated( SpecialData *sd, const char *where )
+{
+	FULONG hash = 5381;
+	int i;
+
+	if( where != NULL )
+	{
+		for( ; *where != 0 ; where++ )
+		{
+			hash = ( ( hash << 5 ) + hash ) + (unsigned char)*where;
+		}
+	}
+
+	for( i=0 ; i < MYSQL_WHERE_HISTORY ; i++ )
+	{
+		if( sd->sd_WhereHistory[ i ] == hash )
+		{
+			return TRUE;
+		}
+	}
+
+	sd->sd_WhereHistory[ sd->sd_WhereHistoryPos ] = hash;
+	sd->sd_WhereHistoryPos = ( sd->sd_WhereHistoryPos + 1 ) % MYSQL_WHERE_HISTORY;
+	return FALSE;
+}
+
+/**
+ * Load data from database
+ *
+ * Values embedded in "where" make every call a new text, such queries are sent as text and are not cached.
+ * Only "where" texts which repeat are prepared, use LoadParams for lookups by value.
+ *
+ * @param l pointer to mysql.library structure
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @param where pointer to string which represent "where" part of query. If value is equal to NULL all data are taken from db.
+ * @param entries pointer to interger where number of loaded entries will be returned
+ * @return pointer to new structure or list of structures.
+ */
+void *Load( struct SQLLibrary *l, FULONG *descr, char *where, int *entries )
+{
+	SpecialData *sd = (SpecialData *)l->sd;
+	DEBUG("[MYSQLLibrary] Load\n");
+
+	// Check if there was a description structure for the table
+	if( descr == NULL  )
+	{
+		FERROR("Data description was not provided!\n");
+		return NULL;
+	}
+
+	MYSQLDescriptor *md = DescriptorGet( descr );
+	if( md == NULL )
+	{
+		FERROR("SQLT_TABNAME was not provided!\n");
+		return NULL;
+	}
+
+	if( sd->sd_StatementCache == TRUE )
+	{
+		// query is prepared when it is repeated, single queries are sent as text and do not take cache entries
+		MYSQLStatement *ms = StatementFind( sd, md, MYSQL_STATEMENT_LOAD, 0, where );
+		if( ms == NULL && WhereRepeated( sd, where ) == TRUE )
+		{
+			ms = StatementGet( l, md, MYSQL_STATEMENT_LOAD, 0, where, TRUE );
+		}
+
+		if( ms != NULL && ms->ms_Failed == FALSE )
+		{
+			FBOOL failed = FALSE;
+			void *firstObject = LoadPrepared( l, ms, entries, &failed );
+			if( failed == FALSE )
+			{
+				DEBUG("[MYSQLLibrary] Load END\n");
+				return firstObject;
+			}
+
+			ms->ms_Failed = TRUE;
+			if( ms->ms_Stmt != NULL )
+			{
+				mysql_stmt_close( ms->ms_Stmt );
+				ms->ms_Stmt = NULL;
+			}
+		}
+	}
+
+	void *firstObject = LoadText( l, md, where, entries );
+	DEBUG("[MYSQLLibrary] Load END\n");
+
+	return firstObject;
+}
+
+/**
+ * Put parameter values into "where" text, used when statement cannot be prepared
+ *
+ * @param l pointer to mysql.library structure
+ * @param where "where" text with '?' for every parameter
+ * @param params parameters, SQLT_INT, SQLT_LONG or SQLT_STR and value pairs closed by SQLT_END
+ * @return pointer to new "where" text or NULL when error appear
+ */
+static char *LoadParamsWhere( struct SQLLibrary *l, const char *where, const FULONG *params )
+{
+	BufString *bs = BufStringNew();
+	const char *start = where;
+
+	if( bs == NULL )
+	{
+		return NULL;
+	}
+
+	for( ; *where != 0 ; where++ )
+	{
+		if( *where != '?' )
+		{
+			continue;
+		}
+
+		BufStringAddSize( bs, start, where - start );
+		start = where + 1;
+
+		if( params[ 0 ] == SQLT_END )
+		{
+			FERROR("[LoadParamsWhere] Not enough parameters for '%s'\n", start );
+			BufStringDelete( bs );
+			return NULL;
+		}
+
+		if( params[ 0 ] == SQLT_STR )
+		{
+			char *esc = l->MakeEscapedString( l, (char *)params[ 1 ] );
+			if( esc != NULL )
+			{
+				BufStringAddSize( bs, "'", 1 );
+				BufStringAdd( bs, esc );
+				BufStringAddSize( bs, "'", 1 );
+				FFree( esc );
+			}
+			else
+			{
+				BufStringAddSize( bs, "NULL", 4 );
+			}
+		}
+		else
+		{
+			char num[ 32 ];
+			int numSize = snprintf( num, sizeof( num ), "%lld", (long long)params[ 1 ] );
+			BufStringAddSize( bs, num, numSize );
+		}
+		params += 2;
+	}
+	BufStringAdd( bs, start );
+
+	char *result = StringDuplicate( bs->bs_Buffer );
+	BufStringDelete( bs );
+	return result;
+}
+
+/**
+ * Load data from database by "where" with parameters. Statement is prepared on first call and kept by connection,
+ * values are sent separately so all lookups share one statement.
+ *
+ * @param l pointer to mysql.library structure
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @param where pointer to string which represent "where" part of query, every '?' is a parameter
+ * @param params parameters, SQLT_INT, SQLT_LONG or SQLT_STR and value pairs closed by SQLT_END. NULL string is sent as NULL
+ * @param entries pointer to interger where number of loaded entries will be returned
+ * @return pointer to new structure or list of structures.
+ */
+void *LoadParams( struct SQLLibrary *l, const FULONG *descr, const char *where, const FULONG *params, int *entries )
+{
+	SpecialData *sd = (SpecialData *)l->sd;
+	MYSQL_BIND bind[ MYSQL_LOAD_PARAMS ];
+	long long values[ MYSQL_LOAD_PARAMS ];
+	unsigned long lengths[ MYSQL_LOAD_PARAMS ];
+	const FULONG *param;
+	int count = 0;
+
+	if( descr == NULL || where == NULL || params == NULL )
+	{
+		FERROR("[LoadParams] Data description, where or parameters were not provided!\n");
+		return NULL;
+	}
+
+	MYSQLDescriptor *md = DescriptorGet( descr );
+	if( md == NULL )
+	{
+		FERROR("SQLT_TABNAME was not provided!\n");
+		return NULL;
+	}
+
+	memset( bind, 0, sizeof( bind ) );
+	for( param = params ; param[ 0 ] != SQLT_END ; param += 2, count++ )
+	{
+		if( count >= MYSQL_LOAD_PARAMS )
+		{
+			FERROR("[LoadParams] Too many parameters for '%s'\n", where );
+			return NULL;
+		}
+
+		switch( param[ 0 ] )
+		{
+			case SQLT_INT:
+			case SQLT_LONG:
+				values[ count ] = (long long)param[ 1 ];
+				bind[ count ].buffer_type = MYSQL_TYPE_LONGLONG;
+				bind[ count ].buffer = &values[ count ];
+			break;
+
+			case SQLT_STR:
+				if( param[ 1 ] == 0 )
 				{
-					int sprintfsize = 0;
-					// '2015-08-10 16:28:31'
-					char date[ 64 ];
-					char tmp[ 256 ];
-					
-					time_t *timepointer = (time_t *)( strptr+dptr[2] );
-					struct tm *tp;
-					tp = localtime( timepointer );
+					bind[ count ].buffer_type = MYSQL_TYPE_NULL;
+				}
+				else
+				{
+					lengths[ count ] = strlen( (char *)param[ 1 ] );
+					bind[ count ].buffer_type = MYSQL_TYPE_STRING;
+					bind[ count ].buffer = (char *)param[ 1 ];
+					bind[ count ].buffer_length = lengths[ count ];
+					bind[ count ].length = &lengths[ count ];
+				}
+			break;
+
+			default:
+				FERROR("[LoadParams] Unsupported parameter type %lu for '%s'\n", param[ 0 ], where );
+				return NULL;
+		}
+	}
+
+	if( sd->sd_StatementCache == TRUE )
+	{
+		MYSQLStatement *ms = StatementGet( l, md, MYSQL_STATEMENT_LOAD, 0, where, TRUE );
+
+		if( ms != NULL && ms->ms_Failed == FALSE )
+		{
+			FBOOL failed = FALSE;
+
+			ms->ms_Params = bind;
+			ms->ms_ParamsCount = count;
+			void *firstObject = LoadPrepared( l, ms, entries, &failed );
+			ms->ms_Params = NULL;
+			ms->ms_ParamsCount = 0;
+
+			if( failed == FALSE )
+			{
+				return firstObject;
+			}
+
+			ms->ms_Failed = TRUE;
+			if( ms->ms_Stmt != NULL )
+			{
+				mysql_stmt_close( ms->ms_Stmt );
+				ms->ms_Stmt = NULL;
+			}
+		}
+	}
+
+	char *textWhere = LoadParamsWhere( l, where, params );
+	if( textWhere == NULL )
+	{
+		return NULL;
+	}
+	void *firstObject = LoadText( l, md, textWhere, entries );
+	FFree( textWhere );
+
+	return firstObject;
+}
+
+/**
+ * Update data in database. Structure must contain primaryID key.
+ *
+ * @param l pointer to mysql.library structure
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @param data pointer to object which will be updated in DB
+ * @return 0 when success, otherwise error number
+ */
+int Update( struct SQLLibrary *l, FULONG *descr, void *data )
+{
+	DEBUG("[MYSQLLibrary] Update\n");
+
+	if( descr == NULL || data == NULL )
+	{
+		DEBUG("[MYSQLLibrary] Data structure or description was not provided!\n");
+		return 0;
+	}
+
+	MYSQLDescriptor *md = DescriptorGet( descr );
+	if( md == NULL )
+	{
+		DEBUG("[MYSQLLibrary] SQLT_TABNAME was not provided!\n");
+		return 0;
+	}
+
+	l->l_Written = TRUE;
+
+	MYSQLStatement *ms = StatementGet( l, md, MYSQL_STATEMENT_UPDATE, 0, NULL, TRUE );
+	if( ms == NULL )
+	{
+		return 2;
+	}
 
-					if( (dptr[2]) != 0 )
-					{
-						if( tp->tm_year < 1901 ) tp->tm_year += 1900;
-						if( tp->tm_mon < 1 ) tp->tm_mon = 1;
-						if( tp->tm_mday < 1 ) tp->tm_mday = 1;
-						// month is counted from 0 in C, if we want to put this into database it must be month counted from 1
-						sprintf( date, "%04d-%02d-%02d %02d:%02d:%02d", tp->tm_year, tp->tm_mon+1, tp->tm_mday, tp->tm_hour, tp->tm_min, tp->tm_sec );
-						
-						//DEBUG("[MYSQLLibrary] DATE serialised %s\n", date );
-					
-						if( cols == 0 )
-						{
-							sprintfsize = sprintf( tmp, " %s = '%s'", (char *)dptr[ 1 ], date );
-						}
-						else
-						{
-							sprintfsize = sprintf( tmp, ", %s = '%s'", (char *)dptr[ 1 ], date );
-						}
-						BufStringAddSize( querybs, tmp, sprintfsize );
-						//strcat( tmpQuery, tmp );
-						cols++;
-					}
-				}
-			break;
-			
-			case SQLT_DATE:
-				{
-					int sprintfsize = 0;
-					char date[ 64 ];
-					char tmp[ 256 ];
-					
-					struct tm *tp = (struct tm *)( strptr+dptr[2]);
+	if( ms->ms_Query == NULL && ( ms->ms_Query = StringDuplicate( md->md_Update ) ) == NULL )
+	{
+		StatementDrop( ms );
+		return 2;
+	}
 
-					if( (dptr[2]) != 0 )
-					{
-						if( tp->tm_year < 1901 ) tp->tm_year += 1900;
-						if( tp->tm_mon < 1 ) tp->tm_mon = 1;
-						if( tp->tm_mday < 1 ) tp->tm_mday = 1;
-						sprintf( date, "%04d-%02d-%02d", tp->tm_year, tp->tm_mon, tp->tm_mday );
-						
-						//DEBUG("[MYSQLLibrary] DATE serialised %s\n", date );
-					
-						if( cols == 0 )
-						{
-							sprintfsize = sprintf( tmp, " %s = '%s'", (char *)dptr[ 1 ], date );
-						}
-						else
-						{
-							sprintfsize = sprintf( tmp, ", %s = '%s'", (char *)dptr[ 1 ], date );
-						}
-						BufStringAddSize( querybs, tmp, sprintfsize );
-						//strcat( tmpQuery, tmp );
-						cols++;
-					}
-				}
-			break;
-		}
-		
-		//cols++;
-		dptr += 3;
+	FUBYTE *strptr = (FUBYTE *)data;	// pointer to structure from which data are taken
+	int i;
+
+	memset( ms->ms_Bind, 0, ( md->md_ColumnsCount + 1 ) * sizeof( MYSQL_BIND ) );
+
+	for( i=0 ; i < md->md_UpdateCount ; i++ )
+	{
+		StatementBindParam( ms, i, &md->md_Columns[ md->md_UpdateColumns[ i ] ], strptr, FALSE );
 	}
-	
-	if( primaryIdName != NULL )
+
+	if( md->md_ID != NULL )
 	{
-		char tmpvar[ 256 ];
-		int sprintfsize = sprintf( tmpvar, " where %s = %d", primaryIdName, primaryId );
-		//DEBUG("SQL update %s\n", tmpQuery );
-		//strcat( tmpQuery, tmpvar );
-		BufStringAddSize( querybs, tmpvar, sprintfsize );
+		StatementBindParam( ms, i, md->md_ID, strptr, FALSE );
 	}
-	DEBUG("[MYSQLLibrary] UPDATE QUERY '%s'\n", querybs->bs_Buffer );
-	
-	if( mysql_query( l->con.sql_Con, querybs->bs_Buffer ) )
+
+	DEBUG("[MYSQLLibrary] UPDATE QUERY '%s'\n", ms->ms_Query );
+
+	if( StatementExecute( l, ms ) != 0 )
 	{
 		SystemBase *sb = (SystemBase *)l->sb;
-		sb->sl_UtilInterface.Log( FLOG_ERROR, "Update query error: %s\n", querybs->bs_Buffer );
-		BufStringDelete( querybs );
-		
+		sb->sl_UtilInterface.Log( FLOG_ERROR, "Update query error: %s, query: %s\n", StatementError( l, ms ), ms->ms_Query );
+		StatementDrop( ms );
+
 		return 2;
 	}
-	BufStringDelete( querybs );
-	
+	StatementDrop( ms );
+
 	return 0;
 }
 
-#define FRIEND_MAX_BIND 256
+/**
+ * Check if structure field is stored by Save. Columns with NULL values are skipped
+ *
+ * @param mc pointer to column description
+ * @param data pointer to structure
+ * @return TRUE when column is stored, otherwise FALSE
+ */
+static FBOOL SaveColumnStored( MYSQLColumn *mc, FUBYTE *data )
+{
+	switch( mc->mc_Type )
+	{
+		case SQLT_INT:
+			return TRUE;
+
+		case SQLT_STR:
+			{
+				char *tmpchar;
+				memcpy( &tmpchar, data + mc->mc_Offset, sizeof( char *) );
+				return ( tmpchar != NULL );
+			}
+
+		case SQLT_DATETIME:
+		case SQLT_DATE:
+			return ( mc->mc_Offset != 0 );
+
+		case SQLT_BLOB:
+			{
+				ListString *ls = NULL;
+				memcpy( &ls, data + mc->mc_Offset, sizeof( ListString *) );
+				if( ls != NULL && ls->ls_Data != NULL )
+				{
+					return TRUE;
+				}
+				FERROR("Cannot store blob, buffer is empty!\n");
+			}
+			return FALSE;
+	}
+	return FALSE;
+}
 
 /**
  * Save data in database. Primary ID will be stored in structure
@@ -611,284 +1723,113 @@ int Update( struct SQLLibrary *l, FULONG *descr, void *data )
  */
 int Save( struct SQLLibrary *l, const FULONG *descr, void *data )
 {
-	char *finalQuery = NULL;
 	int retValue = 0;
-	BufString *tablequerybs = BufStringNew();
-	BufString *dataquerybs = BufStringNew();
-	
+
 	DEBUG("[MYSQLLibrary] Save\n");
-	
+
 	if( descr == NULL || data == NULL )
 	{
-		BufStringDelete( tablequerybs );
-		BufStringDelete( dataquerybs );
 		FERROR("Data structure or description was not provided!\n");
 		return 0;
 	}
-	
-	if( descr[ 0 ] != SQLT_TABNAME )
+
+	MYSQLDescriptor *md = DescriptorGet( descr );
+	if( md == NULL )
 	{
-		BufStringDelete( tablequerybs );
-		BufStringDelete( dataquerybs );
 		FERROR("SQLT_TABNAME was not provided!\n");
 		return 0;
 	}
 
-	FULONG *dptr = (FULONG *)&descr[ SQL_DATA_STRUCT_START ];		// first 2 entries inform about table, rest information provided is about columns
-	unsigned char *strptr = (unsigned char *)data;	// pointer to structure to which will will insert data
-	int opt = 0;
-	int *primaryid = NULL;
-	//int entries = 0;
-	int statementEntry = 0;
-	
-	MYSQL_STMT *stmt;
-	MYSQL_BIND bindTable[ FRIEND_MAX_BIND ];
-	long bindLength[ FRIEND_MAX_BIND ];
-	ListString *bindData[ FRIEND_MAX_BIND ];
-	
-	memset( bindTable, 0, sizeof(bindTable) );
-	
-	stmt = mysql_stmt_init( l->con.sql_Con );
-	if( stmt != NULL )
-	{
-		// we calculate how many entries we will have
-		while( dptr[0] != SQLT_END )
-		{
-			switch( dptr[ 0 ] )
-			{
-				case SQLT_IDINT:	// primary key
-				{
-					// we just skip that in save
-
-					primaryid = (int *)(strptr + dptr[ 2 ]);
-					//opt++;
-				}
-				break;
-				
-				case SQLT_INT:
-				{
-					char tmp[ 256 ];
-					int tmpint;
-					memcpy( &tmpint, strptr + dptr[2], sizeof( int ) );
-					int locsize = sprintf( tmp, " %d", tmpint );
-					
-					if( opt > 0 )
-					{
-						BufStringAddSize( tablequerybs, ",", 1 );
-						BufStringAddSize( dataquerybs, ",", 1 );
-					}
-					BufStringAdd( tablequerybs, (char *)dptr[ 1 ]  );
-					BufStringAddSize( dataquerybs, tmp, locsize );
-
-					opt++;
-				}
-				break;
-				
-				case SQLT_STR:
-				{
-					char *tmpchar;
-
-					memcpy( &tmpchar, strptr+dptr[2], sizeof( char *) );
-
-					if( tmpchar != NULL )
-					{
-						if( opt > 0 )
-						{
-							BufStringAddSize( tablequerybs, ",", 1 );
-							BufStringAddSize( dataquerybs, ",", 1 );
-						}
-
-						BufStringAddSize( dataquerybs, "'", 1 );
-						BufStringAdd( tablequerybs, (char *)dptr[ 1 ] );
-
-						char *esctext;
-						int tmpcharsize = strlen( tmpchar );
-						if( ( esctext = FCalloc( (tmpcharsize << 1 ) + 1, sizeof(char) ) ) != NULL )
-						{
-							mysql_real_escape_string( l->con.sql_Con, esctext, tmpchar, tmpcharsize );
-							//BufStringAdd( dataquerybs, tmpchar );
-							BufStringAdd( dataquerybs, esctext );
-							
-							FFree( esctext );
-						}
-						BufStringAddSize( dataquerybs, "'", 1 );
-					}
-					
-					opt++;
-				}
-				break;
-				
-				case SQLT_DATETIME:
-				{
-					// '2015-08-10 16:28:31'
-					char date[ 64 ];
-					
-					time_t *timepointer = (time_t *)( strptr+dptr[2]);
-					struct tm *tp;
-					tp = localtime( timepointer );
-					if( dptr[2] != 0 )
-					{
-						if( tp->tm_year < 1901 ) tp->tm_year += 1900;
-						if( tp->tm_mon < 0 ) tp->tm_mon = 0;	// this probably never happen
-						if( tp->tm_mday < 1 ) tp->tm_mday = 1;
-
-						sprintf( date, "%04d-%02d-%02d %02d:%02d:%02d", tp->tm_year, tp->tm_mon+1, tp->tm_mday, tp->tm_hour, tp->tm_min, tp->tm_sec );
-						
-						if( opt > 0 )
-						{
-							BufStringAddSize( tablequerybs, ",", 1 );
-							BufStringAddSize( dataquerybs, ",", 1 );
-						}
-
-						BufStringAddSize( dataquerybs, "'", 1 );
-						BufStringAdd( tablequerybs, (char *)dptr[ 1 ] );
-
-						BufStringAdd( dataquerybs, date );
-						BufStringAddSize( dataquerybs, "'", 1 );
+	l->l_Written = TRUE;
 
-					}
-					opt++;
-				}
-				break;
-				
-				case SQLT_DATE:
-				{
-					// '2015-08-10'
-					char date[ 64 ];
-					
-					struct tm *tp = (struct tm *)( strptr+dptr[2]);
-					if( dptr[2] != 0 )
-					{
-						if( tp->tm_year < 1901 ) tp->tm_year += 1900;
-						if( tp->tm_mon < 0 ) tp->tm_mon = 0;
-						if( tp->tm_mday < 1 ) tp->tm_mday = 1;
+	FUBYTE *strptr = (FUBYTE *)data;	// pointer to structure from which data are taken
+	FBOOL stored[ FRIEND_MAX_BIND ];
+	FUQUAD mask = 0;
+	int i;
 
-						sprintf( date, "%04d-%02d-%02d", tp->tm_year, tp->tm_mon+1, tp->tm_mday );
-						
-						if( opt > 0 )
-						{
-							BufStringAddSize( tablequerybs, ",", 1 );
-							BufStringAddSize( dataquerybs, ",", 1 );
-						}
-
-						BufStringAddSize( dataquerybs, "'", 1 );
-						BufStringAdd( tablequerybs, (char *)dptr[ 1 ] );
+	// every combination of stored columns has own statement
+	for( i=0 ; i < md->md_ColumnsCount ; i++ )
+	{
+		stored[ i ] = SaveColumnStored( &md->md_Columns[ i ], strptr );
+		if( stored[ i ] == TRUE && i < MYSQL_SAVE_MASK_COLUMNS )
+		{
+			mask |= ( (FUQUAD)1 << i );
+		}
+	}
 
-						BufStringAdd( dataquerybs, date );
-						BufStringAddSize( dataquerybs, "'", 1 );
+	MYSQLStatement *ms = StatementGet( l, md, MYSQL_STATEMENT_SAVE, mask, NULL, md->md_ColumnsCount <= MYSQL_SAVE_MASK_COLUMNS );
+	if( ms == NULL )
+	{
+		return 1;
+	}
 
-					}
-					opt++;
-				}
-				break;
-				
-				case SQLT_BLOB:
-				{
-					ListString *ls = NULL;
+	if( ms->ms_Query == NULL )
+	{
+		BufString *querybs = BufStringNew();
+		int opt = 0;
+		char tmp[ 512 ];
+		int size = snprintf( tmp, sizeof(tmp), "INSERT INTO %s ( ", md->md_TableName );
 
-					memcpy( &ls, strptr+dptr[2], sizeof( ListString *) );
-					
-					if( ls != NULL && ls->ls_Data != NULL )
-					{
-						if( opt > 0 )
-						{
-							BufStringAddSize( tablequerybs, ",", 1 );
-							BufStringAddSize( dataquerybs, ",", 1 );
-						}
-					
-						BufStringAdd( tablequerybs, (char *)dptr[ 1 ] );
-						BufStringAddSize( dataquerybs, "?", 1 );
-					
-						bindData[ statementEntry ] = ls;
-						bindTable[ statementEntry ].buffer_type = MYSQL_TYPE_STRING;
-						bindTable[ statementEntry ].buffer         = (void *) &(bindData[ statementEntry ]->ls_Data);
-						bindTable[ statementEntry ].is_unsigned    = 1;
-						bindTable[ statementEntry ].length= (long unsigned int *) bindLength[ statementEntry ];
-						bindTable[ statementEntry ].is_null= 0;
-
-						statementEntry++;
-					}
-					else
-					{
-						FERROR("Cannot store blob, buffer is empty!\n");
-					}
-					opt++;
-				}
-				break;
-			}	// end switch
-		
-			dptr += 3;
-		}	// end of while, end of table
-		// end of if( statement init)
-	
-		int finalqsize = tablequerybs->bs_Size + dataquerybs->bs_Size + 256;
-		SystemBase *sb = (SystemBase *)l->sb;
-		
-		if( ( finalQuery = FCalloc( finalqsize, sizeof(char) ) ) != NULL )
+		BufStringAddSize( querybs, tmp, size );
+		for( i=0 ; i < md->md_ColumnsCount ; i++ )
 		{
-			sprintf( finalQuery, "INSERT INTO %s ( %s ) VALUES( %s )", (char *)descr[ 1 ], tablequerybs->bs_Buffer, dataquerybs->bs_Buffer );
-
-			if (mysql_stmt_prepare(stmt, finalQuery, strlen(finalQuery)))
+			if( stored[ i ] == TRUE )
 			{
-				sb->sl_UtilInterface.Log( FLOG_ERROR,  "\n mysql_stmt_prepare(), INSERT failed");
-				sb->sl_UtilInterface.Log( FLOG_ERROR,  "\n %s", mysql_stmt_error(stmt));
-				mysql_stmt_close( stmt ); // Free
-				BufStringDelete( tablequerybs );
-				BufStringDelete( dataquerybs );
-				FFree( finalQuery );
-				return 3;
-			}
-	
-			// Bind the buffers 
-			if (mysql_stmt_bind_param( stmt, bindTable ) )
-			{
-				sb->sl_UtilInterface.Log( FLOG_ERROR, "param bind failed! ");
-				sb->sl_UtilInterface.Log( FLOG_ERROR, " %s\n", mysql_stmt_error(stmt) );
-				mysql_stmt_close( stmt ); // Free
-				BufStringDelete( tablequerybs );
-				BufStringDelete( dataquerybs );
-				FFree( finalQuery );
-				return 1;
-			}
-
-			if( statementEntry > 0 )
-			{
-				int i;
-		
-				for( i=0; i < statementEntry ; i++ )
+				if( opt++ > 0 )
 				{
-					// Supply data in chunks to server 
-					if (mysql_stmt_send_long_data(stmt, i, bindData[ i ]->ls_Data , bindData[ i ]->ls_Size ) )
-					{
-						sb->sl_UtilInterface.Log( FLOG_ERROR," send_long_data failed %s\n", mysql_stmt_error(stmt));
-					}
+					BufStringAddSize( querybs, ",", 1 );
 				}
+				BufStringAdd( querybs, md->md_Columns[ i ].mc_Name );
 			}
-
-			// Now, execute the query 
-			if ( mysql_stmt_execute(stmt) )
+		}
+		BufStringAddSize( querybs, " ) VALUES( ", 11 );
+		for( i=0 ; i < opt ; i++ )
+		{
+			if( i > 0 )
 			{
-				//FERROR("mysql_stmt_execute failed %s\n", mysql_stmt_error(stmt));
-				sb->sl_UtilInterface.Log( FLOG_ERROR, "Save query error: %s, query: %s\n", mysql_stmt_error(stmt), finalQuery );
-				retValue = 1;
+				BufStringAddSize( querybs, ",", 1 );
 			}
-		
-			// Free up!
-			mysql_stmt_close( stmt );
-			
-			FFree( finalQuery );
+			BufStringAddSize( querybs, "?", 1 );
+		}
+		BufStringAddSize( querybs, " )", 2 );
+
+		ms->ms_Query = StringDuplicate( querybs->bs_Buffer );
+		BufStringDelete( querybs );
+
+		if( ms->ms_Query == NULL )
+		{
+			StatementDrop( ms );
+			return 1;
 		}
+	}
 
-		if( primaryid != NULL )
+	int pos = 0;
+	memset( ms->ms_Bind, 0, ( md->md_ColumnsCount + 1 ) * sizeof( MYSQL_BIND ) );
+
+	for( i=0 ; i < md->md_ColumnsCount ; i++ )
+	{
+		if( stored[ i ] == TRUE )
 		{
-			FULONG uid = mysql_insert_id( l->con.sql_Con );
-			memcpy( primaryid, &uid, sizeof( FULONG ) );
-			DEBUG("[MYSQLLibrary] New entry created in DB, ID: %lu\n", uid );
+			StatementBindParam( ms, pos++, &md->md_Columns[ i ], strptr, TRUE );
 		}
 	}
-	BufStringDelete( tablequerybs );
-	BufStringDelete( dataquerybs );
-	
+
+	int error = StatementExecute( l, ms );
+	if( error != 0 )
+	{
+		SystemBase *sb = (SystemBase *)l->sb;
+		sb->sl_UtilInterface.Log( FLOG_ERROR, "Save query error: %s, query: %s\n", StatementError( l, ms ), ms->ms_Query );
+		retValue = ( error == -1 ) ? 3 : 1;
+	}
+	else if( md->md_ID != NULL )
+	{
+		FULONG uid = (FULONG)mysql_stmt_insert_id( ms->ms_Stmt );
+		memcpy( strptr + md->md_ID->mc_Offset, &uid, sizeof( FULONG ) );
+		DEBUG("[MYSQLLibrary] New entry created in DB, ID: %lu\n", uid );
+	}
+
+	StatementDrop( ms );
+
 	return retValue;
 }
 
@@ -907,6 +1848,7 @@ void Delete( struct SQLLibrary *l, FULONG *descr, void *data )
 	// we should go trough for structure to find SQLT_IDINT
 
 	sprintf( tmpQuery, "delete from %s where ID = '%d'", (char *)descr[1], *strptr );
+	l->l_Written = TRUE;
 
 	if( mysql_query( l->con.sql_Con, tmpQuery ) )
 	{
@@ -936,6 +1878,7 @@ void DeleteWhere( struct SQLLibrary *l, FULONG *descr, char *where )
 	// we should go trough for structure to find SQLT_IDINT
 
 	sprintf( tmpQuery, "delete from %s WHERE %s", (char *)descr[1], where );
+	l->l_Written = TRUE;
 
 	if( mysql_query( l->con.sql_Con, tmpQuery ) )
 	{
@@ -972,24 +1915,23 @@ int NumberOfRecords( struct SQLLibrary *l, FULONG *descr, char *where )
 		return -1;
 	}
 	
-	if( descr[ 0 ] != SQLT_TABNAME )
+	MYSQLDescriptor *md = DescriptorGet( descr );
+	if( md == NULL )
 	{
 		FERROR("SQLT_TABNAME was not provided!\n");
 		return -2;
 	}
 
+	const char *query = md->md_Count;
 	if( where != NULL )
 	{
-		sprintf( tmpQuery, "select count(*) from %s", where );
-	}
-	else
-	{
-		sprintf( tmpQuery, "select count(*) from %s", (char *)descr[ 1 ] );
+		snprintf( tmpQuery, sizeof(tmpQuery), "select count(*) from %s", where );
+		query = tmpQuery;
 	}
 	
-	if( mysql_query( l->con.sql_Con, tmpQuery ) )
+	if( mysql_query( l->con.sql_Con, query ) )
 	{
-		FERROR("Cannot run query: '%s'\n", tmpQuery );
+		FERROR("Cannot run query: '%s'\n", query );
 		FERROR( "%s\n", mysql_error( l->con.sql_Con ) );
 		return -3;
 	}
@@ -1051,6 +1993,26 @@ int NumberOfRecordsCustomQuery( struct SQLLibrary *l, const char *query )
 	return intRet;
 }
 
+/**
+ * Check if query only reads data
+ *
+ * @param sel pointer to string with full sql query
+ * @return TRUE when query is SELECT, SHOW, DESCRIBE or EXPLAIN, otherwise FALSE
+ */
+static FBOOL QueryIsRead( const char *sel )
+{
+	while( *sel == ' ' || *sel == '\t' || *sel == '\n' || *sel == '\r' || *sel == '(' )
+	{
+		sel++;
+	}
+	
+	if( strncasecmp( sel, "SELECT", 6 ) == 0 || strncasecmp( sel, "SHOW", 4 ) == 0 || strncasecmp( sel, "DESCRIBE", 8 ) == 0 || strncasecmp( sel, "EXPLAIN", 7 ) == 0 )
+	{
+		return TRUE;
+	}
+	return FALSE;
+}
+
 /**
  * Select function
  *
@@ -1067,13 +2029,19 @@ MYSQL_RES *Query( struct SQLLibrary *l, const char *sel )
 		return NULL;
 	}
 	
+	if( QueryIsRead( sel ) == FALSE )
+	{
+		l->l_Written = TRUE;
+	}
+	
 	if( mysql_query( l->con.sql_Con, sel ) )
 	{
 		FERROR("Cannot run query: '%s'\n", sel );
 		const char *err = mysql_error( l->con.sql_Con );
 		FERROR( "%s\n", err );
 		
-		if( strstr( err, "List connection to MySQL server" ) != NULL )
+		unsigned int errnum = mysql_errno( l->con.sql_Con );
+		if( errnum == CR_SERVER_LOST || errnum == CR_SERVER_GONE_ERROR )
 		{
 			l->con.sql_Recconect = TRUE;
 		}
@@ -1102,6 +2070,10 @@ int QueryWithoutResults( struct SQLLibrary *l, const char *sel )
 		if( l->con.sql_Con != NULL )
 		{
 			DEBUG("[QueryWithoutResults] sql: %s\n", sel );
+			if( QueryIsRead( sel ) == FALSE )
+			{
+				l->l_Written = TRUE;
+			}
 			int err = mysql_query( l->con.sql_Con, sel );
 
 			if( err != 0 )
@@ -1109,7 +2081,8 @@ int QueryWithoutResults( struct SQLLibrary *l, const char *sel )
 				const char *errstr = mysql_error( l->con.sql_Con );
 				
 				FERROR("mysql_execute failed  SQL: %s error: %s\n", sel, errstr );
-				if( strstr( errstr, "List connection to MySQL server" ) != NULL )
+				unsigned int errnum = mysql_errno( l->con.sql_Con );
+				if( errnum == CR_SERVER_LOST || errnum == CR_SERVER_GONE_ERROR )
 				{
 					l->con.sql_Recconect = TRUE;
 				}else if( strstr( errstr, "Duplicate column name " ) != NULL )
@@ -1837,6 +2810,29 @@ char* StringDuplicate( const char* str )
 	return strcpy( FCalloc( strlen( str ) + 1, sizeof( char ) ), str );
 }
 
+/**
+ * Set options of connection handle before it is connected. Options given by SetOption
+ * are stored, so they are set again on handle created by Reconnect.
+ *
+ * @param l pointer to mysql.library structure
+ */
+static void ConnectionOptionsSet( struct SQLLibrary *l )
+{
+	SpecialData *sd = (SpecialData *)l->sd;
+	
+	mysql_options( l->con.sql_Con, MYSQL_SET_CHARSET_NAME, "utf8" );
+	mysql_options( l->con.sql_Con, MYSQL_INIT_COMMAND, "SET NAMES utf8");
+	if( sd->sd_ReadOnly == TRUE )
+	{
+		// init commands are run again when client reconnects automatically
+		mysql_options( l->con.sql_Con, MYSQL_INIT_COMMAND, "SET SESSION TRANSACTION READ ONLY" );
+	}
+	if( sd->sd_Protocol != 0 )
+	{
+		mysql_options( l->con.sql_Con, MYSQL_OPT_PROTOCOL, &(sd->sd_Protocol) );
+	}
+}
+
 /**
  * Connect mysql.library to database function
  *
@@ -1845,7 +2841,22 @@ char* StringDuplicate( const char* str )
  */
 int Reconnect( struct SQLLibrary *l )
 {
-	void *connection = mysql_real_connect( l->con.sql_Con, l->con.sql_Host, l->con.sql_DBName, l->con.sql_User, l->con.sql_Pass, l->con.sql_Port, NULL, 0 );
+	// prepared statements do not survive new connection
+	StatementsRelease( (SpecialData *)l->sd );
+	
+	// handle which was connected once cannot be connected again
+	if( l->con.sql_Con != NULL )
+	{
+		mysql_close( l->con.sql_Con );
+	}
+	if( ( l->con.sql_Con = mysql_init( NULL ) ) == NULL )
+	{
+		return -1;
+	}
+	
+	ConnectionOptionsSet( l );
+	
+	void *connection = mysql_real_connect( l->con.sql_Con, l->con.sql_Host, l->con.sql_User, l->con.sql_Pass, l->con.sql_DBName, l->con.sql_Port, NULL, 0 );
 	if( connection == NULL )
 	{
 		FERROR( "[MYSQLLibrary] Failed to connect to database: '%s'.\n", mysql_error(l->con.sql_Con) );
@@ -1857,6 +2868,21 @@ int Reconnect( struct SQLLibrary *l )
 	return 0;
 }
 
+/**
+ * Check if connection to database is alive
+ *
+ * @param l pointer to mysql.library structure
+ * @return 0 when connection is alive, otherwise error number
+ */
+int Ping( struct SQLLibrary *l )
+{
+	if( l->con.sql_Con == NULL || mysql_ping( l->con.sql_Con ) != 0 )
+	{
+		return -1;
+	}
+	return 0;
+}
+
 /**
  * Connect mysql.library to database function
  *
@@ -1878,8 +2904,7 @@ int Connect( struct SQLLibrary *l, const char *host, const char *dbname, const c
 		l->con.sql_Con = mysql_init(NULL);
 	}
 	
-	mysql_options( l->con.sql_Con, MYSQL_SET_CHARSET_NAME, "utf8" );
-	mysql_options( l->con.sql_Con, MYSQL_INIT_COMMAND, "SET NAMES utf8");
+	ConnectionOptionsSet( l );
 	
 	void *connection = mysql_real_connect( l->con.sql_Con, host, usr, pass, dbname, port, NULL, 0 );
 	if( connection == NULL )
@@ -1916,6 +2941,8 @@ int Disconnect( struct SQLLibrary *l )
 	if( l->con.sql_User != NULL ){ FFree( l->con.sql_User );  l->con.sql_User = NULL; }
 	if( l->con.sql_Pass != NULL ){ FFree( l->con.sql_Pass );  l->con.sql_Pass = NULL; }
 	
+	StatementsRelease( (SpecialData *)l->sd );
+	
 	mysql_close( l->con.sql_Con );
 	return 0;
 }
@@ -1970,8 +2997,29 @@ int SetOption( struct SQLLibrary *l, char *opts )
 				{
 					if( strcmp( val, "TCP" ) == 0 )
 					{
-						int prot = MYSQL_PROTOCOL_TCP;
-						mysql_options( l->con.sql_Con, MYSQL_OPT_PROTOCOL, &prot );
+						// stored, Reconnect creates new handle
+						SpecialData *sd = (SpecialData *)l->sd;
+						sd->sd_Protocol = MYSQL_PROTOCOL_TCP;
+						if( l->con.sql_Con != NULL )
+						{
+							mysql_options( l->con.sql_Con, MYSQL_OPT_PROTOCOL, &(sd->sd_Protocol) );
+						}
+					}
+				}
+				else if( strcmp( par, "READONLY" ) == 0 )
+				{
+					// READONLY,1 - connection to read replica, set on every (re)connect
+					SpecialData *sd = (SpecialData *)l->sd;
+					sd->sd_ReadOnly = ( strcmp( val, "0" ) != 0 );
+				}
+				else if( strcmp( par, "STMTCACHE" ) == 0 )
+				{
+					// STMTCACHE,0 - every query is sent as text and statements are not kept
+					SpecialData *sd = (SpecialData *)l->sd;
+					sd->sd_StatementCache = ( strcmp( val, "0" ) != 0 );
+					if( sd->sd_StatementCache == FALSE )
+					{
+						StatementsRelease( sd );
 					}
 				}
 				
@@ -2037,6 +3085,9 @@ void *libInit( void *sb )
 	l->Connect = Connect;
 	l->Disconnect = Disconnect;
 	l->Reconnect = Reconnect;
+	l->CompileDescriptor = CompileDescriptor;
+	l->Ping = Ping;
+	l->LoadParams = LoadParams;
 	
 	l->sd = FCalloc( 1, sizeof(SpecialData) );
 	if( l->sd == NULL )
@@ -2044,6 +3095,11 @@ void *libInit( void *sb )
 		FFree( l );
 		return NULL;
 	}
+	((SpecialData *)l->sd)->sd_StatementCache = TRUE;
+	
+	pthread_mutex_lock( &descriptorMutex );
+	librariesOpened++;
+	pthread_mutex_unlock( &descriptorMutex );
 
 	return ( void *)l;
 }
@@ -2059,7 +3115,9 @@ void libClose( struct SQLLibrary *l )
 	{
 		if( l->sd )
 		{
+			StatementsRelease( (SpecialData *)l->sd );
 			FFree( l->sd );
+			l->sd = NULL;
 		}
 		
 		if( l->con.sql_Host != NULL ){ FFree( l->con.sql_Host );  l->con.sql_Host = NULL; }
@@ -2070,6 +3128,14 @@ void libClose( struct SQLLibrary *l )
 		mysql_close( l->con.sql_Con );
 		l->con.sql_Con = NULL;
 	}
+	
+	pthread_mutex_lock( &descriptorMutex );
+	if( --librariesOpened <= 0 )
+	{
+		librariesOpened = 0;
+		DescriptorsRelease();
+	}
+	pthread_mutex_unlock( &descriptorMutex );
 	DEBUG("[MYSQLLibrary] close\n");
 }
 
@@ -387,6 +387,74 @@ void *Load( struct SQLLibrary *l, FULONG *descr, char *where, int *entries )
 	return firstObject;
 }
 
+/**
+ * Load data from database by "where" with parameters. Values are quoted and put in place of '?'
+ *
+ * @param l pointer to sql.library structure
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @param where pointer to string which represent "where" part of query, every '?' is a parameter
+ * @param params parameters, SQLT_INT, SQLT_LONG or SQLT_STR and value pairs closed by SQLT_END. NULL string is sent as NULL
+ * @param entries pointer to interger where number of loaded entries will be returned
+ * @return pointer to new structure or list of structures.
+ */
+void *LoadParams( struct SQLLibrary *l, const FULONG *descr, const char *where, const FULONG *params, int *entries )
+{
+	if( where == NULL || params == NULL )
+	{
+		FERROR("[SQLite] LoadParams: where or parameters were not provided!\n");
+		return NULL;
+	}
+
+	BufString *bs = BufStringNew();
+	const char *start = where;
+
+	if( bs == NULL )
+	{
+		return NULL;
+	}
+
+	for( ; *where != 0 ; where++ )
+	{
+		if( *where != '?' )
+		{
+			continue;
+		}
+
+		BufStringAddSize( bs, start, where - start );
+		start = where + 1;
+
+		if( params[ 0 ] == SQLT_END )
+		{
+			FERROR("[SQLite] LoadParams: not enough parameters\n");
+			BufStringDelete( bs );
+			return NULL;
+		}
+
+		char *val;
+		if( params[ 0 ] == SQLT_STR )
+		{
+			val = sqlite3_mprintf( "%Q", (char *)params[ 1 ] );
+		}
+		else
+		{
+			val = sqlite3_mprintf( "%lld", (long long)params[ 1 ] );
+		}
+
+		if( val != NULL )
+		{
+			BufStringAdd( bs, val );
+			sqlite3_free( val );
+		}
+		params += 2;
+	}
+	BufStringAdd( bs, start );
+
+	void *firstObject = Load( l, (FULONG *)descr, bs->bs_Buffer, entries );
+	BufStringDelete( bs );
+
+	return firstObject;
+}
+
 /**
  * Update data in database. Structure must contain primaryID key.
  *
@@ -1888,6 +1956,7 @@ void *libInit( void *sb )
 
 	// mysql.library structure
 	l->Load = Load;
+	l->LoadParams = LoadParams;
 	l->Save = dlsym ( l->l_Handle, "Save");
 	l->Update = dlsym ( l->l_Handle, "Update");
 	l->Delete = dlsym ( l->l_Handle, "Delete");
@@ -0,0 +1,40 @@
+<?php
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+
+// Prepended to scripts run by php-fpm for Friend Core ([PHP] runner = fastcgi).
+// Scripts expect command line arguments, Friend Core sends them in request
+// body as strings "<length>\n<data>".
+
+if( isset( $_SERVER['FRIEND_ARGC'] ) )
+{
+	// php-fpm runs script in its own directory, modules include files
+	// relative to Friend home (sent as DOCUMENT_ROOT)
+	if( isset( $_SERVER['DOCUMENT_ROOT'] ) && $_SERVER['DOCUMENT_ROOT'] != '' )
+	{
+		chdir( $_SERVER['DOCUMENT_ROOT'] );
+	}
+	
+	$__friendInput = file_get_contents( 'php://input' );
+	$__friendPos = 0;
+	$argv = array();
+	for( $__friendI = 0; $__friendI < intval( $_SERVER['FRIEND_ARGC'] ); $__friendI++ )
+	{
+		$__friendEnd = strpos( $__friendInput, "\n", $__friendPos );
+		if( $__friendEnd === false ) break;
+		$__friendLength = intval( substr( $__friendInput, $__friendPos, $__friendEnd - $__friendPos ) );
+		$argv[] = substr( $__friendInput, $__friendEnd + 1, $__friendLength );
+		$__friendPos = $__friendEnd + 1 + $__friendLength;
+	}
+	$argc = count( $argv );
+	$_SERVER['argv'] = $argv;
+	$_SERVER['argc'] = $argc;
+	unset( $__friendInput, $__friendPos, $__friendI, $__friendEnd, $__friendLength );
+}
@@ -0,0 +1,89 @@
+<?php
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright (c) Friend Software Labs AS. All rights reserved.                  *
+*                                                                              *
+* Licensed under the Source EULA. Please refer to the copy of the MIT License, *
+* found in the file license_mit.txt.                                           *
+*                                                                              *
+*****************************************************************************©*/
+
+/******************************************************************************\
+*                                                                              *
+* Persistent PHP worker used by Friend Core ([PHP] runner = worker)            *
+*                                                                              *
+* Request:  "<count>\n" followed by <count> strings "<length>\n<data>",        *
+*           first string is script path, others are arguments ($argv)          *
+* Response: frames "<4 bytes length><data>", empty frame ends response         *
+*                                                                              *
+* Every request is run in forked child, so exit()/die() and globals of         *
+* scripts do not affect worker. Interpreter is started only once.              *
+*                                                                              *
+\******************************************************************************/
+
+if( !function_exists( 'pcntl_fork' ) )
+{
+	fwrite( STDERR, "Friend PHP worker requires pcntl extension\n" );
+	exit( 1 );
+}
+
+function FriendWorkerReadString( $input )
+{
+	$line = fgets( $input );
+	if( $line === false ) return false;
+	$length = intval( $line );
+	$data = '';
+	while( strlen( $data ) < $length )
+	{
+		$chunk = fread( $input, $length - strlen( $data ) );
+		if( $chunk === false || $chunk === '' ) return false;
+		$data .= $chunk;
+	}
+	return $data;
+}
+
+function FriendWorkerOutput( $buffer )
+{
+	if( strlen( $buffer ) > 0 )
+	{
+		fwrite( STDOUT, pack( 'N', strlen( $buffer ) ) . $buffer );
+	}
+	return '';
+}
+
+while( ( $__friendWorkerLine = fgets( STDIN ) ) !== false )
+{
+	$__friendWorkerArgs = array();
+	$__friendWorkerCount = intval( $__friendWorkerLine );
+	for( $__friendWorkerI = 0; $__friendWorkerI < $__friendWorkerCount; $__friendWorkerI++ )
+	{
+		if( ( $__friendWorkerString = FriendWorkerReadString( STDIN ) ) === false )
+		{
+			exit( 0 );
+		}
+		$__friendWorkerArgs[] = $__friendWorkerString;
+	}
+
+	$__friendWorkerPid = pcntl_fork();
+	if( $__friendWorkerPid == 0 )
+	{
+		// Script sees the same environment as when it is launched from command line
+		$argv = $__friendWorkerArgs;
+		$argc = count( $argv );
+		$_SERVER['argv'] = $argv;
+		$_SERVER['argc'] = $argc;
+		unset( $__friendWorkerLine, $__friendWorkerArgs, $__friendWorkerCount, $__friendWorkerI, $__friendWorkerString, $__friendWorkerPid );
+
+		// Output is streamed to Friend Core in frames, scripts cannot remove this buffer
+		ob_start( 'FriendWorkerOutput', 65536, PHP_OUTPUT_HANDLER_CLEANABLE | PHP_OUTPUT_HANDLER_FLUSHABLE );
+		include( $argv[0] );
+		exit( 0 );
+	}
+	else if( $__friendWorkerPid > 0 )
+	{
+		pcntl_waitpid( $__friendWorkerPid, $__friendWorkerStatus );
+	}
+	fwrite( STDOUT, pack( 'N', 0 ) );
+	fflush( STDOUT );
+}
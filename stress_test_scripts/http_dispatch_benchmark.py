@@ -0,0 +1,156 @@
+#!/usr/bin/env python
+# Compares FriendCore HTTP dispatch modes.
+# Sends requests from many client threads (new connection for every request, like login storm)
+# and samples resident memory and number of threads of FriendCore process.
+#
+# Run it once with core:httpworkerpool=0 and once with core:httpworkerpool=1 in cfg.ini:
+#
+#   ./http_dispatch_benchmark.py localhost 6502 `pidof FriendCore` 200 30 /webclient/index.html
+#
+# With 'keepalive' argument every client reuses one connection (core:httpkeepalive=1),
+# latency percentiles show what is saved on TCP/TLS handshakes:
+#
+#   ./http_dispatch_benchmark.py localhost 6502 `pidof FriendCore` 50 30 /system.library/help ssl keepalive
+#
+# arguments: host port pid clients seconds [path] [ssl|nossl] [keepalive]
+
+from __future__ import print_function
+
+import socket
+import ssl
+import sys
+import threading
+import time
+
+target_ip = sys.argv[1]
+target_port = int(sys.argv[2])
+target_pid = int(sys.argv[3])
+clients = int(sys.argv[4])
+duration = int(sys.argv[5])
+path = sys.argv[6] if len(sys.argv) > 6 else '/webclient/index.html'
+use_ssl = len(sys.argv) > 7 and sys.argv[7] == 'ssl'
+keep_alive = len(sys.argv) > 8 and sys.argv[8] == 'keepalive'
+
+lock = threading.Lock()
+done = 0
+errors = 0
+latencies = []
+stop = False
+
+
+def proc_status():
+    rss = 0
+    threads = 0
+    with open('/proc/%d/status' % target_pid) as f:
+        for line in f:
+            if line.startswith('VmRSS:'):
+                rss = int(line.split()[1])
+            elif line.startswith('Threads:'):
+                threads = int(line.split()[1])
+    return rss, threads
+
+
+def read_response(s):
+    # read one response, body length is taken from content-length header
+    data = b''
+    while b'\r\n\r\n' not in data:
+        chunk = s.recv(65536)
+        if not chunk:
+            return data, False
+        data += chunk
+    header, body = data.split(b'\r\n\r\n', 1)
+    length = None
+    persistent = False
+    for line in header.split(b'\r\n')[1:]:
+        name, _, value = line.partition(b':')
+        name = name.strip().lower()
+        if name == b'content-length':
+            length = int(value.strip())
+        elif name == b'connection':
+            persistent = value.strip().lower() == b'keep-alive'
+    if length is None:
+        persistent = False
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            body += chunk
+    else:
+        while len(body) < length:
+            chunk = s.recv(65536)
+            if not chunk:
+                return header, False
+            body += chunk
+    return header + body, persistent
+
+
+def client():
+    global done, errors
+    request = 'GET %s HTTP/1.1\r\nHost: %s\r\nConnection: %s\r\n\r\n' % (path, target_ip, 'keep-alive' if keep_alive else 'close')
+    context = None
+    if use_ssl:
+        context = ssl.create_default_context()
+        context.check_hostname = False
+        context.verify_mode = ssl.CERT_NONE
+    s = None
+    while not stop:
+        try:
+            begin = time.time()
+            if s is None:
+                s = socket.create_connection((target_ip, target_port), timeout=30)
+                if context is not None:
+                    s = context.wrap_socket(s, server_hostname=target_ip)
+            s.sendall(request.encode('ascii'))
+            response, persistent = read_response(s)
+            if not keep_alive or not persistent:
+                s.close()
+                s = None
+            with lock:
+                if len(response) > 0:
+                    done += 1
+                    latencies.append(time.time() - begin)
+                else:
+                    errors += 1
+        except Exception:
+            if s is not None:
+                s.close()
+                s = None
+            with lock:
+                errors += 1
+
+
+workers = []
+for i in range(clients):
+    t = threading.Thread(target=client)
+    t.daemon = True
+    t.start()
+    workers.append(t)
+
+peak_rss = 0
+peak_threads = 0
+start = time.time()
+last_done = 0
+while time.time() - start < duration:
+    time.sleep(1)
+    rss, threads = proc_status()
+    peak_rss = max(peak_rss, rss)
+    peak_threads = max(peak_threads, threads)
+    with lock:
+        current = done
+    print('%3ds  %6d req/s  rss %7d kB  threads %5d  errors %d' % (time.time() - start, current - last_done, rss, threads, errors))
+    last_done = current
+
+stop = True
+elapsed = time.time() - start
+
+print('-----')
+print('requests:     %d' % done)
+print('errors:       %d' % errors)
+print('requests/s:   %.1f' % (done / elapsed))
+print('peak rss:     %d kB' % peak_rss)
+print('peak threads: %d' % peak_threads)
+with lock:
+    latencies.sort()
+    if latencies:
+        print('latency p50:  %.2f ms' % (latencies[len(latencies) // 2] * 1000))
+        print('latency p99:  %.2f ms' % (latencies[int(len(latencies) * 0.99)] * 1000))
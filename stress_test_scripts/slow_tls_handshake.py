@@ -0,0 +1,91 @@
+#!/usr/bin/env python
+# Opens connections which never finish TLS handshake (like evil_socket_opener.py, some of them
+# send first bytes of ClientHello and stop) and measures how long normal clients wait for
+# finished TLS handshake. With handshake done by main loop latency should stay flat while
+# number of stalled connections grows, stalled connections are closed after
+# core:httphandshaketimeout seconds.
+#
+#   ./slow_tls_handshake.py localhost 6502 2000 50
+#
+# arguments: host port evil_connections [evil_per_step]
+
+from __future__ import print_function
+
+import socket
+import ssl
+import sys
+import time
+import traceback
+
+target_ip = sys.argv[1]
+target_port = int(sys.argv[2])
+evil_total = int(sys.argv[3]) if len(sys.argv) > 3 else 1000
+evil_step = int(sys.argv[4]) if len(sys.argv) > 4 else 50
+probes = 20
+
+# TLS record header and start of ClientHello, rest never comes
+partial_hello = b'\x16\x03\x01\x02\x00\x01\x00\x01\xfc\x03\x03'
+
+context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+context.check_hostname = False
+context.verify_mode = ssl.CERT_NONE
+
+socket_array = []
+
+
+def open_evil(count):
+    opened = 0
+    for i in range(count):
+        try:
+            s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            s.connect((target_ip, target_port))
+            if (len(socket_array) % 2) == 0:
+                s.send(partial_hello)
+            socket_array.append(s)
+            opened += 1
+        except Exception:
+            traceback.print_exc()
+            print('Could not create socket %d' % len(socket_array))
+            break
+    return opened
+
+
+def probe():
+    # time from connect to finished handshake
+    start = time.time()
+    s = socket.create_connection((target_ip, target_port), timeout=30)
+    try:
+        t = context.wrap_socket(s)
+        t.close()
+    except Exception:
+        s.close()
+        raise
+    return (time.time() - start) * 1000.0
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+print('%8s %10s %10s %10s %8s' % ('stalled', 'p50 ms', 'p99 ms', 'max ms', 'errors'))
+
+while len(socket_array) <= evil_total:
+    latencies = []
+    errors = 0
+    for i in range(probes):
+        try:
+            latencies.append(probe())
+        except Exception:
+            errors += 1
+    if latencies:
+        print('%8d %10.1f %10.1f %10.1f %8d' % (len(socket_array), percentile(latencies, 50), percentile(latencies, 99), max(latencies), errors))
+    else:
+        print('%8d %10s %10s %10s %8d' % (len(socket_array), '-', '-', '-', errors))
+    sys.stdout.flush()
+
+    if len(socket_array) == evil_total or open_evil(min(evil_step, evil_total - len(socket_array))) == 0:
+        break
+
+for s in socket_array:
+    s.close()
@@ -0,0 +1,146 @@
+#!/usr/bin/env python
+# Checks websocket back-pressure: every connection sends more pings than core:wsmaxqueue at once,
+# so Friend Core stops reading from it (lws_rx_flow_control) and must resume reading when worker
+# processed half of queue. libwebsockets gives new connections to least used service thread,
+# so with connections >= core:wsthreads paused connections are served by every service thread
+# (also tsi > 0). Connection which does not get all pongs stayed paused.
+#
+# Answers are sent to websocket of user session, so every connection needs own session
+# (log in with different device identities).
+#
+#   ./ws_backpressure.py localhost 6500 sessionid1,sessionid2,sessionid3,sessionid4 200 ssl
+#
+# arguments: host port sessions [pings_per_connection] [ssl]
+
+from __future__ import print_function
+
+import base64
+import json
+import os
+import socket
+import ssl
+import struct
+import sys
+import threading
+import time
+
+target_ip = sys.argv[1]
+target_port = int(sys.argv[2])
+sessions = sys.argv[3].split(',')
+pings = int(sys.argv[4]) if len(sys.argv) > 4 else 200
+use_ssl = len(sys.argv) > 5 and sys.argv[5] == 'ssl'
+timeout = 60
+
+results = {}
+
+
+def connect():
+    s = socket.create_connection((target_ip, target_port), timeout=timeout)
+    if use_ssl:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+        context.check_hostname = False
+        context.verify_mode = ssl.CERT_NONE
+        s = context.wrap_socket(s)
+    key = base64.b64encode(os.urandom(16)).decode()
+    s.sendall(('GET / HTTP/1.1\r\nHost: %s:%d\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n'
+               'Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Protocol: FC-protocol\r\n\r\n'
+               % (target_ip, target_port, key)).encode())
+    response = b''
+    while b'\r\n\r\n' not in response:
+        data = s.recv(4096)
+        if not data:
+            raise Exception('connection closed during handshake')
+        response += data
+    if b' 101 ' not in response.split(b'\r\n')[0]:
+        raise Exception('handshake failed: %s' % response.split(b'\r\n')[0])
+    return s, response.split(b'\r\n\r\n', 1)[1]
+
+
+def frame(text):
+    payload = text.encode()
+    mask = os.urandom(4)
+    header = b'\x81'
+    if len(payload) < 126:
+        header += struct.pack('!B', 0x80 | len(payload))
+    elif len(payload) < 65536:
+        header += struct.pack('!BH', 0x80 | 126, len(payload))
+    else:
+        header += struct.pack('!BQ', 0x80 | 127, len(payload))
+    masked = bytearray(payload)
+    for i in range(len(masked)):
+        masked[i] ^= bytearray(mask)[i % 4]
+    return header + mask + bytes(masked)
+
+
+class Reader(object):
+    def __init__(self, s, data):
+        self.s = s
+        self.data = data
+
+    def need(self, n):
+        while len(self.data) < n:
+            chunk = self.s.recv(65536)
+            if not chunk:
+                raise Exception('connection closed')
+            self.data += chunk
+
+    def message(self):
+        text = b''
+        while True:
+            self.need(2)
+            b0, b1 = bytearray(self.data[:2])
+            length = b1 & 0x7f
+            pos = 2
+            if length == 126:
+                self.need(4)
+                length = struct.unpack('!H', self.data[2:4])[0]
+                pos = 4
+            elif length == 127:
+                self.need(10)
+                length = struct.unpack('!Q', self.data[2:10])[0]
+                pos = 10
+            self.need(pos + length)
+            text += self.data[pos:pos + length]
+            self.data = self.data[pos + length:]
+            if b0 & 0x80:
+                return text.decode('utf-8', 'replace')
+
+
+def run(index, session):
+    received = 0
+    start = time.time()
+    try:
+        s, rest = connect()
+        reader = Reader(s, rest)
+        s.sendall(frame(json.dumps({'type': 'con', 'data': {'sessionId': session}})))
+        # all pings at once, more than connection queue can hold
+        s.sendall(b''.join(frame(json.dumps({'type': 'con', 'data': {'type': 'ping', 'data': 'bp-%d-%d' % (index, i)}}))
+                           for i in range(pings)))
+        while received < pings:
+            msg = reader.message()
+            if '"pong"' in msg and ('bp-%d-' % index) in msg:
+                received += 1
+        s.close()
+        results[index] = (received, time.time() - start, None)
+    except Exception as e:
+        results[index] = (received, time.time() - start, str(e))
+
+
+threads = [threading.Thread(target=run, args=(i, session)) for i, session in enumerate(sessions)]
+for t in threads:
+    t.start()
+for t in threads:
+    t.join()
+
+failed = 0
+print('%6s %8s %10s  %s' % ('conn', 'pongs', 'seconds', 'error'))
+for i in range(len(sessions)):
+    received, seconds, error = results.get(i, (0, 0, 'no result'))
+    if received < pings:
+        failed += 1
+    print('%6d %8d %10.2f  %s' % (i, received, seconds, error or ''))
+
+if failed:
+    print('%d connections did not get all pongs (reading was not resumed)' % failed)
+    sys.exit(1)
+print('all connections resumed')